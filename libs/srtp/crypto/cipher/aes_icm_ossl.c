@@ -234,15 +234,22 @@ static srtp_err_status_t srtp_aes_icm_openssl_context_init(void *cv,
                 srtp_octet_string_hex_string(key, c->key_size));
     debug_print(srtp_mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
 
+    c->bytes_in_buffer = 0;
+
+    /*
+     * The counter blocks are built here and run through ECB, so setting the
+     * per packet IV does not re-initialise the EVP context and a whole
+     * packet of keystream is produced by a single multi-block call.
+     */
     switch (c->key_size) {
     case SRTP_AES_256_KEY_LEN:
-        evp = EVP_aes_256_ctr();
+        evp = EVP_aes_256_ecb();
         break;
     case SRTP_AES_192_KEY_LEN:
-        evp = EVP_aes_192_ctr();
+        evp = EVP_aes_192_ecb();
         break;
     case SRTP_AES_128_KEY_LEN:
-        evp = EVP_aes_128_ctr();
+        evp = EVP_aes_128_ecb();
         break;
     default:
         return srtp_err_status_bad_param;
@@ -253,6 +260,7 @@ static srtp_err_status_t srtp_aes_icm_openssl_context_init(void *cv,
     if (!EVP_EncryptInit_ex(c->ctx, evp, NULL, key, NULL)) {
         return srtp_err_status_fail;
     } else {
+        EVP_CIPHER_CTX_set_padding(c->ctx, 0);
         return srtp_err_status_ok;
     }
 
@@ -281,10 +289,79 @@ static srtp_err_status_t srtp_aes_icm_openssl_set_iv(
     debug_print(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
-    if (!EVP_EncryptInit_ex(c->ctx, NULL, NULL, NULL, c->counter.v8)) {
-        return srtp_err_status_fail;
-    } else {
-        return srtp_err_status_ok;
+    /* indicate that the keystream_buffer is empty */
+    c->bytes_in_buffer = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * Number of counter blocks encrypted per EVP call, enough for a full
+ * size audio or video packet in one go.
+ */
+#define AES_ICM_BATCH_BLOCKS 96
+
+/*
+ * 128 bit big-endian increment, the same counter progression as the
+ * OpenSSL CTR mode this engine used before
+ */
+static inline void srtp_aes_icm_openssl_advance(v128_t *counter)
+{
+    int i;
+
+    for (i = 15; i >= 0; i--) {
+        if (++counter->v8[i]) {
+            break;
+        }
+    }
+}
+
+/*
+ * Lay out the next blocks counter values in ctr[] and advance the counter.
+ * Only the low 64 bits change unless they wrap, which takes the slow path.
+ */
+static inline void srtp_aes_icm_openssl_counters(srtp_aes_icm_ctx_t *c,
+                                                 uint8_t *ctr,
+                                                 unsigned int blocks)
+{
+    uint64_t lo = be64_to_cpu(c->counter.v64[1]);
+    unsigned int i;
+
+    if (lo + blocks < lo) {
+        for (i = 0; i < blocks; i++) {
+            memcpy(ctr + i * 16, c->counter.v8, 16);
+            srtp_aes_icm_openssl_advance(&c->counter);
+        }
+        return;
+    }
+
+    for (i = 0; i < blocks; i++) {
+        uint64_t v = be64_to_cpu(lo + i);
+
+        memcpy(ctr + i * 16, &c->counter.v64[0], 8);
+        memcpy(ctr + i * 16 + 8, &v, 8);
+    }
+
+    c->counter.v64[1] = be64_to_cpu(lo + blocks);
+}
+
+static inline void srtp_aes_icm_openssl_xor(unsigned char *buf,
+                                            const uint8_t *ks,
+                                            unsigned int len)
+{
+    unsigned int i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+
+        memcpy(&a, buf + i, 8);
+        memcpy(&b, ks + i, 8);
+        a ^= b;
+        memcpy(buf + i, &a, 8);
+    }
+
+    for (; i < len; i++) {
+        buf[i] ^= ks[i];
     }
 }
 
@@ -301,19 +378,49 @@ static srtp_err_status_t srtp_aes_icm_openssl_encrypt(void *cv,
                                                       unsigned int *enc_len)
 {
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
-    int len = 0;
+    uint8_t ctr[AES_ICM_BATCH_BLOCKS * 16];
+    uint8_t ks[AES_ICM_BATCH_BLOCKS * 16];
+    unsigned int bytes_to_encr = *enc_len;
 
     debug_print(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
 
-    if (!EVP_EncryptUpdate(c->ctx, buf, &len, buf, *enc_len)) {
-        return srtp_err_status_cipher_fail;
+    /* use keystream left over from the previous call first */
+    while (c->bytes_in_buffer > 0 && bytes_to_encr > 0) {
+        *buf++ ^= c->keystream_buffer.v8[16 - c->bytes_in_buffer--];
+        bytes_to_encr--;
     }
-    *enc_len = len;
 
-    if (!EVP_EncryptFinal_ex(c->ctx, buf + len, &len)) {
-        return srtp_err_status_cipher_fail;
+    while (bytes_to_encr > 0) {
+        unsigned int blocks = (bytes_to_encr + 15) / 16;
+        unsigned int used;
+        int len = 0;
+
+        if (blocks > AES_ICM_BATCH_BLOCKS) {
+            blocks = AES_ICM_BATCH_BLOCKS;
+        }
+
+        srtp_aes_icm_openssl_counters(c, ctr, blocks);
+
+        if (!EVP_EncryptUpdate(c->ctx, ks, &len, ctr, blocks * 16) ||
+            len != (int)(blocks * 16)) {
+            return srtp_err_status_cipher_fail;
+        }
+
+        used = blocks * 16;
+        if (used > bytes_to_encr) {
+            used = bytes_to_encr;
+        }
+
+        srtp_aes_icm_openssl_xor(buf, ks, used);
+        buf += used;
+        bytes_to_encr -= used;
+
+        if (used < blocks * 16) {
+            /* keep the rest of the last block for the next call */
+            memcpy(c->keystream_buffer.v8, ks + (blocks - 1) * 16, 16);
+            c->bytes_in_buffer = blocks * 16 - used;
+        }
     }
-    *enc_len += len;
 
     return srtp_err_status_ok;
 }
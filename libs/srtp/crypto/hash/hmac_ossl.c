@@ -51,9 +51,10 @@
 #include "err.h" /* for srtp_debug */
 #include "auth_test_cases.h"
 #include <openssl/evp.h>
-#include <openssl/hmac.h>
+#include <openssl/sha.h>
 
 #define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
 
 /* the debug module for authentiation */
 
@@ -62,11 +63,25 @@ srtp_debug_module_t srtp_mod_hmac = {
     "hmac sha-1 openssl" /* printable name for module   */
 };
 
+/*
+ * The SHA-1 states after absorbing the key XOR ipad and XOR opad blocks
+ * are computed once per key. Starting a packet is then a copy of the
+ * inner state instead of an HMAC_Init_ex(), which on OpenSSL 3 duplicates
+ * the provider digest contexts (two allocations) for every packet. The
+ * tag is the same HMAC-SHA1 value.
+ */
+typedef struct {
+    SHA_CTX ipad; /* state after key ^ ipad         */
+    SHA_CTX opad; /* state after key ^ opad         */
+    SHA_CTX ctx;  /* inner hash of the current packet */
+} srtp_hmac_ossl_ctx_t;
+
 static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
                                          int key_len,
                                          int out_len)
 {
     extern const srtp_auth_type_t srtp_hmac;
+    uint8_t *pointer;
 
     debug_print(srtp_mod_hmac, "allocating auth func with key length %d",
                 key_len);
@@ -78,38 +93,15 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
         return srtp_err_status_bad_param;
     }
 
-/* OpenSSL 1.1.0 made HMAC_CTX an opaque structure, which must be allocated
-   using HMAC_CTX_new.  But this function doesn't exist in OpenSSL 1.0.x. */
-#if OPENSSL_VERSION_NUMBER < 0x10100000L || LIBRESSL_VERSION_NUMBER
-    {
-        /* allocate memory for auth and HMAC_CTX structures */
-        uint8_t *pointer;
-        HMAC_CTX *new_hmac_ctx;
-        pointer = (uint8_t *)srtp_crypto_alloc(sizeof(HMAC_CTX) +
-                                               sizeof(srtp_auth_t));
-        if (pointer == NULL) {
-            return srtp_err_status_alloc_fail;
-        }
-        *a = (srtp_auth_t *)pointer;
-        (*a)->state = pointer + sizeof(srtp_auth_t);
-        new_hmac_ctx = (HMAC_CTX *)((*a)->state);
-
-        HMAC_CTX_init(new_hmac_ctx);
-    }
-
-#else
-    *a = (srtp_auth_t *)srtp_crypto_alloc(sizeof(srtp_auth_t));
-    if (*a == NULL) {
+    /* allocate memory for auth and hmac state structures */
+    pointer = (uint8_t *)srtp_crypto_alloc(sizeof(srtp_hmac_ossl_ctx_t) +
+                                           sizeof(srtp_auth_t));
+    if (pointer == NULL) {
         return srtp_err_status_alloc_fail;
     }
 
-    (*a)->state = HMAC_CTX_new();
-    if ((*a)->state == NULL) {
-        srtp_crypto_free(*a);
-        *a = NULL;
-        return srtp_err_status_alloc_fail;
-    }
-#endif
+    *a = (srtp_auth_t *)pointer;
+    (*a)->state = pointer + sizeof(srtp_auth_t);
 
     /* set pointers */
     (*a)->type = &srtp_hmac;
@@ -122,22 +114,9 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
 
 static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
 {
-    HMAC_CTX *hmac_ctx;
-
-    hmac_ctx = (HMAC_CTX *)a->state;
-
-#if OPENSSL_VERSION_NUMBER < 0x10100000L || LIBRESSL_VERSION_NUMBER
-    HMAC_CTX_cleanup(hmac_ctx);
-
     /* zeroize entire state*/
-    octet_string_set_to_zero(a, sizeof(HMAC_CTX) + sizeof(srtp_auth_t));
-
-#else
-    HMAC_CTX_free(hmac_ctx);
-
-    /* zeroize entire state*/
-    octet_string_set_to_zero(a, sizeof(srtp_auth_t));
-#endif
+    octet_string_set_to_zero(a, sizeof(srtp_hmac_ossl_ctx_t) +
+                                    sizeof(srtp_auth_t));
 
     /* free memory */
     srtp_crypto_free(a);
@@ -147,10 +126,9 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
 
 static srtp_err_status_t srtp_hmac_start(void *statev)
 {
-    HMAC_CTX *state = (HMAC_CTX *)statev;
+    srtp_hmac_ossl_ctx_t *state = (srtp_hmac_ossl_ctx_t *)statev;
 
-    if (HMAC_Init_ex(state, NULL, 0, NULL, NULL) == 0)
-        return srtp_err_status_auth_fail;
+    state->ctx = state->ipad;
 
     return srtp_err_status_ok;
 }
@@ -159,10 +137,47 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
                                         const uint8_t *key,
                                         int key_len)
 {
-    HMAC_CTX *state = (HMAC_CTX *)statev;
+    srtp_hmac_ossl_ctx_t *state = (srtp_hmac_ossl_ctx_t *)statev;
+    uint8_t ipad[SHA1_BLOCK_SIZE];
+    uint8_t opad[SHA1_BLOCK_SIZE];
+    uint8_t hashed_key[SHA1_DIGEST_SIZE];
+    int i;
+
+    if (key_len < 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* keys longer than a block are hashed first, as HMAC specifies */
+    if (key_len > SHA1_BLOCK_SIZE) {
+        if (!SHA1(key, key_len, hashed_key)) {
+            return srtp_err_status_auth_fail;
+        }
+        key = hashed_key;
+        key_len = SHA1_DIGEST_SIZE;
+    }
 
-    if (HMAC_Init_ex(state, key, key_len, EVP_sha1(), NULL) == 0)
+    for (i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+
+    for (; i < SHA1_BLOCK_SIZE; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
+    }
+
+    if (!SHA1_Init(&state->ipad) ||
+        !SHA1_Update(&state->ipad, ipad, SHA1_BLOCK_SIZE) ||
+        !SHA1_Init(&state->opad) ||
+        !SHA1_Update(&state->opad, opad, SHA1_BLOCK_SIZE)) {
         return srtp_err_status_auth_fail;
+    }
+
+    state->ctx = state->ipad;
+
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+    octet_string_set_to_zero(hashed_key, sizeof(hashed_key));
 
     return srtp_err_status_ok;
 }
@@ -171,12 +186,12 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
                                           const uint8_t *message,
                                           int msg_octets)
 {
-    HMAC_CTX *state = (HMAC_CTX *)statev;
+    srtp_hmac_ossl_ctx_t *state = (srtp_hmac_ossl_ctx_t *)statev;
 
     debug_print(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
-    if (HMAC_Update(state, message, msg_octets) == 0)
+    if (SHA1_Update(&state->ctx, message, msg_octets) == 0)
         return srtp_err_status_auth_fail;
 
     return srtp_err_status_ok;
@@ -188,10 +203,10 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
                                            int tag_len,
                                            uint8_t *result)
 {
-    HMAC_CTX *state = (HMAC_CTX *)statev;
+    srtp_hmac_ossl_ctx_t *state = (srtp_hmac_ossl_ctx_t *)statev;
     uint8_t hash_value[SHA1_DIGEST_SIZE];
+    SHA_CTX outer;
     int i;
-    unsigned int len;
 
     debug_print(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
@@ -202,13 +217,16 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
     }
 
     /* hash message, copy output into H */
-    if (HMAC_Update(state, message, msg_octets) == 0)
+    if (SHA1_Update(&state->ctx, message, msg_octets) == 0)
         return srtp_err_status_auth_fail;
 
-    if (HMAC_Final(state, hash_value, &len) == 0)
+    if (SHA1_Final(hash_value, &state->ctx) == 0)
         return srtp_err_status_auth_fail;
 
-    if (len < tag_len)
+    outer = state->opad;
+
+    if (SHA1_Update(&outer, hash_value, SHA1_DIGEST_SIZE) == 0 ||
+        SHA1_Final(hash_value, &outer) == 0)
         return srtp_err_status_auth_fail;
 
     /* copy hash_value to *result */
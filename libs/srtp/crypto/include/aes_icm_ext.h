@@ -55,10 +55,12 @@
 #include <openssl/aes.h>
 
 typedef struct {
-    v128_t counter; /* holds the counter value          */
-    v128_t offset;  /* initial offset value             */
+    v128_t counter;          /* holds the counter value          */
+    v128_t offset;           /* initial offset value             */
+    v128_t keystream_buffer; /* buffers bytes of keystream       */
+    int bytes_in_buffer;     /* number of unused bytes in buffer */
     int key_size;
-    EVP_CIPHER_CTX *ctx;
+    EVP_CIPHER_CTX *ctx;     /* AES-ECB, keystream is built here */
 } srtp_aes_icm_ctx_t;
 
 #endif /* OPENSSL */
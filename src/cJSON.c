@@ -40,6 +40,15 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <ctype.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CJSON_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CJSON_SIMD_NEON
+#endif
 
 #ifdef ENABLE_LOCALES
 #include <locale.h>
@@ -217,30 +226,247 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+/* Backing store of a document returned by cJSON_ParseReadOnly: one allocation
+ * holding the header, every node and a private copy of the input text that the
+ * strings are decoded into. The root is node[0] and carries cJSON_IsArena. */
+typedef struct
+{
+    size_t size; /* bytes of the whole allocation */
+    size_t capacity; /* number of nodes */
+    size_t used;
+    unsigned char *text;
+    cJSON node[1];
+} parse_arena;
+
+#define arena_of(item) ((parse_arena*)(void*)((unsigned char*)(item) - offsetof(parse_arena, node)))
+
+static cJSON_bool arena_owns(const parse_arena * const arena, const void * const pointer)
+{
+    return (arena != NULL) && ((const unsigned char*)pointer >= (const unsigned char*)arena) && ((const unsigned char*)pointer < ((const unsigned char*)arena + arena->size));
+}
+
+static void delete_items(cJSON *item, const parse_arena * const arena)
 {
     cJSON *next = NULL;
     while (item != NULL)
     {
         next = item->next;
+        if ((item->type & cJSON_IsArena) && (arena_of(item) != arena))
+        {
+            /* a read-only document, possibly attached to a heap tree */
+            parse_arena *owner = arena_of(item);
+            item->next = NULL;
+            delete_items(item, owner);
+            global_hooks.deallocate(owner);
+            item = next;
+            continue;
+        }
         if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
-            cJSON_Delete(item->child);
+            delete_items(item->child, arena);
         }
-        if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
+        if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL) && !arena_owns(arena, item->valuestring))
         {
             global_hooks.deallocate(item->valuestring);
         }
-        if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
+        if (!(item->type & cJSON_StringIsConst) && (item->string != NULL) && !arena_owns(arena, item->string))
         {
             global_hooks.deallocate(item->string);
         }
-        global_hooks.deallocate(item);
+        if (!arena_owns(arena, item))
+        {
+            global_hooks.deallocate(item);
+        }
         item = next;
     }
 }
 
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+{
+    delete_items(item, NULL);
+}
+
+#if defined(__GNUC__) && (defined(CJSON_SIMD_SSE2) || defined(CJSON_SIMD_NEON))
+/* the vector loads may read past the terminating NUL, but never across a page */
+#define CJSON_NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define CJSON_NO_SANITIZE
+#endif
+
+#define CJSON_PAGE_SAFE(pointer) ((((size_t)(pointer)) & 4095) <= (4096 - 16))
+
+/* Length of the leading run of a NUL terminated string that can be printed
+ * verbatim: stops at '\"', '\\', control characters and the terminator. */
+CJSON_NO_SANITIZE static size_t plain_run(const unsigned char * const input)
+{
+    const unsigned char *pointer = input;
+#if defined(CJSON_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+
+    while (CJSON_PAGE_SAFE(pointer))
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)pointer);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        int mask = 0;
+
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return (size_t)(pointer - input) + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+        pointer += 16;
+    }
+#elif defined(CJSON_SIMD_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control = vdupq_n_u8(0x20);
+
+    while (CJSON_PAGE_SAFE(pointer))
+    {
+        uint8x16_t chunk = vld1q_u8(pointer);
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)), vcltq_u8(chunk, control));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+
+        if (mask != 0)
+        {
+            return (size_t)(pointer - input) + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+        pointer += 16;
+    }
+#endif
+    while ((*pointer > 31) && (*pointer != '\"') && (*pointer != '\\'))
+    {
+        pointer++;
+    }
+
+    return (size_t)(pointer - input);
+}
+
+/* Length of the leading run of [input, end) holding neither '\"' nor '\\'. */
+static size_t string_run(const unsigned char * const input, const unsigned char * const end)
+{
+    const unsigned char *pointer = input;
+#if defined(CJSON_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    while ((end - pointer) >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)pointer);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+
+        if (mask != 0)
+        {
+            return (size_t)(pointer - input) + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+        pointer += 16;
+    }
+#elif defined(CJSON_SIMD_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+
+    while ((end - pointer) >= 16)
+    {
+        uint8x16_t chunk = vld1q_u8(pointer);
+        uint8x16_t hit = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+
+        if (mask != 0)
+        {
+            return (size_t)(pointer - input) + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+        pointer += 16;
+    }
+#endif
+    while ((pointer < end) && (*pointer != '\"') && (*pointer != '\\'))
+    {
+        pointer++;
+    }
+
+    return (size_t)(pointer - input);
+}
+
+/* Number of ',', '[' and '{' bytes in [input, end). */
+static size_t structural_count(const unsigned char * const input, const unsigned char * const end)
+{
+    const unsigned char *pointer = input;
+    size_t count = 0;
+#if defined(CJSON_SIMD_SSE2)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i bracket = _mm_set1_epi8('[');
+    const __m128i brace = _mm_set1_epi8('{');
+
+    while ((end - pointer) >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)pointer);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_or_si128(_mm_cmpeq_epi8(chunk, bracket), _mm_cmpeq_epi8(chunk, brace)));
+
+        count += (size_t)__builtin_popcount((unsigned int)_mm_movemask_epi8(hit));
+        pointer += 16;
+    }
+#elif defined(CJSON_SIMD_NEON)
+    const uint8x16_t comma = vdupq_n_u8(',');
+    const uint8x16_t bracket = vdupq_n_u8('[');
+    const uint8x16_t brace = vdupq_n_u8('{');
+
+    while ((end - pointer) >= 16)
+    {
+        uint8x16_t chunk = vld1q_u8(pointer);
+        uint8x16_t hit = vorrq_u8(vceqq_u8(chunk, comma), vorrq_u8(vceqq_u8(chunk, bracket), vceqq_u8(chunk, brace)));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+
+        count += (size_t)(__builtin_popcountll(mask) >> 2);
+        pointer += 16;
+    }
+#endif
+    for (; pointer < end; pointer++)
+    {
+        if ((*pointer == ',') || (*pointer == '[') || (*pointer == '{'))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Escaped length of a NUL terminated string, without the quotes. */
+static size_t escaped_length(const unsigned char * const input, size_t * const escape_characters)
+{
+    const unsigned char *input_pointer = input;
+    size_t escapes = 0;
+
+    for (;;)
+    {
+        input_pointer += plain_run(input_pointer);
+        switch (*input_pointer)
+        {
+            case '\0':
+                *escape_characters = escapes;
+                return (size_t)(input_pointer - input) + escapes;
+            case '\"':
+            case '\\':
+            case '\b':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+                /* one character escape sequence */
+                escapes++;
+                break;
+            default:
+                /* UTF-16 escape sequence uXXXX */
+                escapes += 5;
+                break;
+        }
+        input_pointer++;
+    }
+}
+
 /* get the decimal point character of the current locale */
 static unsigned char get_decimal_point(void)
 {
@@ -259,6 +485,7 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    parse_arena *arena; /* set when parsing in place for cJSON_ParseReadOnly */
 } parse_buffer;
 
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
@@ -269,6 +496,28 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+/* allocate the next node, from the document arena when parsing in place */
+static cJSON *parse_new_item(parse_buffer * const input_buffer)
+{
+    parse_arena *arena = input_buffer->arena;
+    cJSON *node = NULL;
+
+    if (arena == NULL)
+    {
+        return cJSON_New_Item(&(input_buffer->hooks));
+    }
+
+    if (arena->used >= arena->capacity)
+    {
+        return NULL;
+    }
+
+    node = &arena->node[arena->used++];
+    memset(node, '\0', sizeof(cJSON));
+
+    return node;
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -717,34 +966,44 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 
     {
         /* calculate approximate size of the output (overestimate) */
+        const unsigned char *content_end = input_buffer->content + input_buffer->length;
         size_t allocation_length = 0;
         size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        while (input_end < content_end)
         {
-            /* is escape sequence */
-            if (input_end[0] == '\\')
+            input_end += string_run(input_end, content_end);
+            if ((input_end >= content_end) || (*input_end == '\"'))
             {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
-                    goto fail;
-                }
-                skipped_bytes++;
-                input_end++;
+                break;
             }
-            input_end++;
+            /* escape sequence */
+            if ((input_end + 1) >= content_end)
+            {
+                /* prevent buffer overflow when last input character is a backslash */
+                goto fail;
+            }
+            skipped_bytes++;
+            input_end += 2;
         }
-        if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
+        if ((input_end >= content_end) || (*input_end != '\"'))
         {
             goto fail; /* string ended unexpectedly */
         }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
-        if (output == NULL)
+        if (input_buffer->arena != NULL)
         {
-            goto fail; /* allocation failure */
+            /* decode in place, the output never outgrows the literal */
+            output = (unsigned char*)input_pointer;
+        }
+        else
+        {
+            /* This is at most how much we need for the output */
+            allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+            output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
         }
     }
 
@@ -754,7 +1013,13 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     {
         if (*input_pointer != '\\')
         {
-            *output_pointer++ = *input_pointer++;
+            size_t run = string_run(input_pointer, input_end);
+            if (output_pointer != input_pointer)
+            {
+                memmove(output_pointer, input_pointer, run);
+            }
+            output_pointer += run;
+            input_pointer += run;
         }
         /* escape sequence */
         else
@@ -817,7 +1082,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && (input_buffer->arena == NULL))
     {
         input_buffer->hooks.deallocate(output);
     }
@@ -858,31 +1123,7 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
         return true;
     }
 
-    /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
-    {
-        switch (*input_pointer)
-        {
-            case '\"':
-            case '\\':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* one character escape sequence */
-                escape_characters++;
-                break;
-            default:
-                if (*input_pointer < 32)
-                {
-                    /* UTF-16 escape sequence uXXXX */
-                    escape_characters += 5;
-                }
-                break;
-        }
-    }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
+    output_length = escaped_length(input, &escape_characters);
 
     output = ensure(output_buffer, output_length + sizeof("\"\""));
     if (output == NULL)
@@ -906,45 +1147,49 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
     /* copy the string */
     for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
     {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
-        {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
-        }
-        else
+        size_t run = plain_run(input_pointer);
+        if (run > 0)
         {
-            /* character needs to be escaped */
-            *output_pointer++ = '\\';
-            switch (*input_pointer)
+            /* normal characters, copy */
+            memcpy(output_pointer, input_pointer, run);
+            output_pointer += run;
+            input_pointer += run;
+            if (*input_pointer == '\0')
             {
-                case '\\':
-                    *output_pointer = '\\';
-                    break;
-                case '\"':
-                    *output_pointer = '\"';
-                    break;
-                case '\b':
-                    *output_pointer = 'b';
-                    break;
-                case '\f':
-                    *output_pointer = 'f';
-                    break;
-                case '\n':
-                    *output_pointer = 'n';
-                    break;
-                case '\r':
-                    *output_pointer = 'r';
-                    break;
-                case '\t':
-                    *output_pointer = 't';
-                    break;
-                default:
-                    /* escape and print as unicode codepoint */
-                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
-                    output_pointer += 4;
-                    break;
+                break;
             }
         }
+        /* character needs to be escaped */
+        *output_pointer++ = '\\';
+        switch (*input_pointer)
+        {
+            case '\\':
+                *output_pointer = '\\';
+                break;
+            case '\"':
+                *output_pointer = '\"';
+                break;
+            case '\b':
+                *output_pointer = 'b';
+                break;
+            case '\f':
+                *output_pointer = 'f';
+                break;
+            case '\n':
+                *output_pointer = 'n';
+                break;
+            case '\r':
+                *output_pointer = 'r';
+                break;
+            case '\t':
+                *output_pointer = 't';
+                break;
+            default:
+                /* escape and print as unicode codepoint */
+                sprintf((char*)output_pointer, "u%04x", *input_pointer);
+                output_pointer += 4;
+                break;
+        }
     }
     output[output_length + 1] = '\"';
     output[output_length + 2] = '\0';
@@ -1006,7 +1251,7 @@ static parse_buffer *skip_utf8_bom(parse_buffer * const buffer)
 /* Parse an object - create a new root, and populate. */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, NULL };
     cJSON *item = NULL;
 
     /* reset error position */
@@ -1089,19 +1334,151 @@ CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
     return cJSON_ParseWithOpts(value, 0, 0);
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseReadOnly(const char *value)
+{
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, NULL };
+    parse_arena *arena = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    size_t header = 0;
+    cJSON *item = NULL;
+
+    /* reset error position */
+    global_error.json = NULL;
+    global_error.position = 0;
+
+    if (value == NULL)
+    {
+        return NULL;
+    }
+
+    length = strlen(value) + sizeof("");
+    /* every node past the root follows a ',', '[' or '{', so this bounds the node count */
+    capacity = structural_count((const unsigned char*)value, (const unsigned char*)value + length) + 1;
+
+    header = offsetof(parse_arena, node) + (capacity * sizeof(cJSON));
+    arena = (parse_arena*)global_hooks.allocate(header + length);
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    arena->size = header + length;
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->text = (unsigned char*)arena + header;
+    memcpy(arena->text, value, length);
+
+    buffer.content = arena->text;
+    buffer.length = length;
+    buffer.offset = 0;
+    buffer.hooks = global_hooks;
+    buffer.arena = arena;
+
+    item = parse_new_item(&buffer);
+    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    {
+        error local_error;
+        local_error.json = (const unsigned char*)value;
+        local_error.position = 0;
+
+        if (buffer.offset < buffer.length)
+        {
+            local_error.position = buffer.offset;
+        }
+        else if (buffer.length > 0)
+        {
+            local_error.position = buffer.length - 1;
+        }
+        global_error = local_error;
+
+        global_hooks.deallocate(arena);
+        return NULL;
+    }
+
+    item->type |= cJSON_IsArena;
+
+    return item;
+}
+
 #define cjson_min(a, b) ((a < b) ? a : b)
 
+/* Size of the rendered text of item, exact except for numbers which are
+ * bounded by the width of print_number's scratch buffer. */
+static size_t print_measure(const cJSON * const item, cJSON_bool format, size_t depth)
+{
+    const cJSON *current_item = NULL;
+    size_t escapes = 0;
+    size_t length = 0;
+
+    switch ((item->type) & 0xFF)
+    {
+        case cJSON_NULL:
+        case cJSON_True:
+            return 4;
+
+        case cJSON_False:
+            return 5;
+
+        case cJSON_Number:
+            return 26;
+
+        case cJSON_Raw:
+            return (item->valuestring != NULL) ? strlen(item->valuestring) : 0;
+
+        case cJSON_String:
+            return ((item->valuestring != NULL) ? escaped_length((const unsigned char*)item->valuestring, &escapes) : 0) + 2;
+
+        case cJSON_Array:
+            length = 2;
+            for (current_item = item->child; current_item != NULL; current_item = current_item->next)
+            {
+                length += print_measure(current_item, format, depth + 1);
+                if (current_item->next != NULL)
+                {
+                    length += format ? 2 : 1;
+                }
+            }
+            return length;
+
+        case cJSON_Object:
+            length = format ? (2 + depth + 1) : 2;
+            for (current_item = item->child; current_item != NULL; current_item = current_item->next)
+            {
+                length += ((current_item->string != NULL) ? escaped_length((const unsigned char*)current_item->string, &escapes) : 0) + 2;
+                length += print_measure(current_item, format, depth + 1);
+                length += format ? (depth + 1 + 2 + 1) : 1;
+                if (current_item->next != NULL)
+                {
+                    length++;
+                }
+            }
+            return length;
+
+        default:
+            return 0;
+    }
+}
+
 static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
 {
-    static const size_t default_buffer_size = 256;
     printbuffer buffer[1];
     unsigned char *printed = NULL;
+    size_t buffer_size = 0;
 
     memset(buffer, 0, sizeof(buffer));
 
+    if (item == NULL)
+    {
+        return NULL;
+    }
+
+    /* size the buffer up front so that rendering never has to grow it,
+     * ensure() still reallocates should the estimate ever fall short */
+    buffer_size = print_measure(item, format, 0) + 8;
+
     /* create buffer */
-    buffer->buffer = (unsigned char*) hooks->allocate(default_buffer_size);
-    buffer->length = default_buffer_size;
+    buffer->buffer = (unsigned char*) hooks->allocate(buffer_size);
+    buffer->length = buffer_size;
     buffer->format = format;
     buffer->hooks = *hooks;
 
@@ -1375,7 +1752,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1422,7 +1799,7 @@ success:
     return true;
 
 fail:
-    if (head != NULL)
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_Delete(head);
     }
@@ -1529,7 +1906,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1593,7 +1970,7 @@ success:
     return true;
 
 fail:
-    if (head != NULL)
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_Delete(head);
     }
@@ -2577,7 +2954,7 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
         goto fail;
     }
     /* Copy over all vars */
-    newitem->type = item->type & (~cJSON_IsReference);
+    newitem->type = item->type & (~(cJSON_IsReference | cJSON_IsArena));
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
     if (item->valuestring)
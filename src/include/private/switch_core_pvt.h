@@ -83,6 +83,8 @@ typedef enum {
 	SSF_MEDIA_BUG_TAP_ONLY = (1 << 10)
 } switch_session_flag_t;
 
+typedef struct switch_media_bug_ring switch_media_bug_ring_t;
+
 struct switch_core_session {
 	switch_memory_pool_t *pool;
 	switch_thread_t *thread;
@@ -133,6 +135,7 @@ struct switch_core_session {
 	switch_queue_t *private_event_queue_pri;
 	switch_thread_rwlock_t *bug_rwlock;
 	switch_media_bug_t *bugs;
+	switch_media_bug_ring_t *bug_ring;
 	switch_app_log_t *app_log;
 	uint32_t stack_count;
 
@@ -142,6 +145,13 @@ struct switch_core_session {
 	uint8_t raw_write_buf[SWITCH_RECOMMENDED_BUFFER_SIZE];
 	uint8_t enc_write_buf[SWITCH_RECOMMENDED_BUFFER_SIZE];
 
+	/* written frames translated without decoding, see switch_core_codec_find_translator() */
+	const switch_codec_implementation_t *translate_from;
+	const switch_codec_implementation_t *translate_to;
+	switch_core_codec_translate_func_t translate_func;
+	switch_bool_t translate;
+	switch_buffer_t *translate_buffer;
+
 	switch_buffer_t *raw_read_buffer;
 	switch_frame_t raw_read_frame;
 	switch_frame_t enc_read_frame;
@@ -213,6 +223,19 @@ struct switch_media_bug {
 	char *text_framedata;
 	uint32_t text_framesize;
 	switch_mm_t mm;
+
+	/* SMBF_FANOUT: position in the session's frame ring and the worker handoff */
+	uint32_t fanout_bit;
+	uint64_t fanout_cursor;
+	uint32_t fanout_overruns;
+	uint8_t fanout_busy;
+	uint8_t fanout_closing;
+	switch_mutex_t *fanout_mutex;
+	switch_thread_cond_t *fanout_cond;
+	uint8_t *fanout_data;
+	uint32_t fanout_datalen;
+	switch_abc_type_t fanout_type;
+
 	struct switch_media_bug *next;
 };
 
@@ -288,6 +311,13 @@ struct switch_runtime {
 	uint32_t max_audio_channels;
 	switch_call_cause_t shutdown_cause;
 	uint32_t uuid_version;
+	switch_size_t file_cache_size;
+	switch_size_t file_cache_max_file_size;
+	switch_bool_t file_async_io;
+	uint32_t file_async_io_threads;
+	uint32_t codec_pool_size;
+	uint32_t media_bug_worker_threads;
+	uint32_t dtls_handshake_threads;
 };
 
 extern struct switch_runtime runtime;
@@ -318,4 +348,17 @@ void switch_core_session_init(switch_memory_pool_t *pool);
 void switch_core_session_uninit(void);
 void switch_core_state_machine_init(switch_memory_pool_t *pool);
 switch_memory_pool_t *switch_core_memory_init(void);
+void switch_core_file_cache_init(switch_memory_pool_t *pool);
+void switch_core_file_cache_destroy(void);
+void switch_core_file_async_io_init(switch_memory_pool_t *pool);
+void switch_core_file_async_io_destroy(void);
+void switch_core_codec_pool_init(switch_memory_pool_t *pool);
+void switch_core_codec_pool_destroy(void);
+void switch_core_media_bug_workers_init(switch_memory_pool_t *pool);
+void switch_core_media_bug_workers_destroy(void);
+void switch_core_g711_init(void);
+void switch_core_resample_init(switch_memory_pool_t *pool);
+void switch_core_resample_destroy(void);
+void switch_core_media_bug_fanout(switch_core_session_t *session, switch_frame_t *frame, switch_abc_type_t type, uint32_t mask);
+void switch_core_media_bug_ring_destroy(switch_core_session_t *session);
 void switch_core_memory_stop(void);
@@ -129,6 +129,7 @@
 #include "switch_buffer.h"
 #include "switch_event.h"
 #include "switch_resample.h"
+#include "switch_g711.h"
 #include "switch_ivr.h"
 #include "switch_rtp.h"
 #include "switch_log.h"
@@ -90,6 +90,7 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_IsArena 1024 /* root of a cJSON_ParseReadOnly document */
 
 /* The cJSON structure: */
 typedef struct cJSON
@@ -141,6 +142,9 @@ CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value);
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Parse for read-only use: the nodes and the decoded strings share a single allocation owned by the root,
+ * which cJSON_Delete releases in one go. Items of such a document must not be detached, replaced or deleted on their own. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseReadOnly(const char *value);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -321,6 +321,13 @@ SWITCH_DECLARE(void) switch_core_media_bug_resume(switch_core_session_t *session
 
 SWITCH_DECLARE(void) switch_core_media_bug_inuse(switch_media_bug_t *bug, switch_size_t *readp, switch_size_t *writep);
 
+/*!
+  \brief Get the number of frames a SMBF_FANOUT bug lost because its callback fell behind the session's frame ring
+  \param bug the bug
+  \return the number of frames overwritten before the bug got to them
+*/
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_get_overruns(switch_media_bug_t *bug);
+
 /*!
   \brief Obtain private data from a media bug
   \param bug the bug to get the data from
@@ -1722,6 +1729,49 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_copy(switch_codec_t *codec, sw
 SWITCH_DECLARE(switch_status_t) switch_core_codec_parse_fmtp(const char *codec_name, const char *fmtp, uint32_t rate, switch_codec_fmtp_t *codec_fmtp);
 SWITCH_DECLARE(switch_status_t) switch_core_codec_reset(switch_codec_t *codec);
 
+/*!
+  \brief Destroy the idle handles the core keeps for reuse
+  \param codec_interface only flush handles of this interface (NULL for all)
+
+  Implementations with a reset function are not destroyed when their handle is;
+  the handle is reset and kept until an init asks for the same implementation,
+  flags, fmtp and settings again.
+*/
+SWITCH_DECLARE(void) switch_core_codec_pool_flush(const switch_codec_interface_t *codec_interface);
+
+/*!
+  \brief Get codec handle pool counters
+  \param idle number of handles waiting for reuse
+  \param hits number of inits served from the pool
+  \param misses number of inits of poolable codecs that had to create a handle
+*/
+SWITCH_DECLARE(void) switch_core_codec_pool_stats(uint32_t *idle, uint64_t *hits, uint64_t *misses);
+
+/*!
+  \brief Register a direct translation between two codecs that skips decoding to linear
+  \param from_iananame the codec the frames arrive in
+  \param to_iananame the codec they are written in
+  \param rate the sample rate both share
+  \param func maps each encoded byte of from to one byte of to, NULL when the encodings are identical
+  \return SWITCH_STATUS_SUCCESS if the translator was registered
+
+  Only for codecs that encode every sample on its own into the same number of
+  bytes (G.711 and friends), so packets can be cut at any sample boundary.
+  The translation must give the same bytes as decoding and encoding again.
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_add_translator(const char *from_iananame, const char *to_iananame, uint32_t rate,
+																 switch_core_codec_translate_func_t func);
+
+/*!
+  \brief Find a direct translation between two implementations
+  \param from the implementation the frames arrive in
+  \param to the implementation they are written in
+  \param func the translation, NULL when the bytes only need repacketizing
+  \return SWITCH_TRUE if frames from can be written as to without decoding
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_codec_find_translator(const switch_codec_implementation_t *from, const switch_codec_implementation_t *to,
+															   switch_core_codec_translate_func_t *func);
+
 /*!
   \brief Encode data using a codec handle
   \param codec the codec handle to use
@@ -2069,6 +2119,24 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(_In_ switch_file_handle_t
 
 SWITCH_DECLARE(switch_status_t) switch_core_file_command(switch_file_handle_t *fh, switch_file_command_t command);
 
+/*!
+  \brief Configure the shared cache of decoded audio files
+  \param max_bytes the total amount of decoded audio to keep resident (0 disables the cache)
+  \param max_file_bytes the largest single file to consider for caching (0 keeps the current value)
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_set_limits(switch_size_t max_bytes, switch_size_t max_file_bytes);
+
+/*!
+  \brief Drop every entry from the shared decoded audio cache, open handles keep their data until closed
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void);
+
+/*!
+  \brief Fetch statistics of the shared decoded audio cache
+  \return SWITCH_STATUS_SUCCESS if the cache is enabled
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_stats(uint32_t *entries, switch_size_t *bytes, uint64_t *hits, uint64_t *misses);
+
 SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *fh, int64_t offset);
 SWITCH_DECLARE(switch_bool_t) switch_core_file_has_video(switch_file_handle_t *fh, switch_bool_t CHECK_OPEN);
 
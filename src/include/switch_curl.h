@@ -58,6 +58,123 @@ SWITCH_DECLARE(void) switch_curl_mime_free(switch_curl_mime **mimep);
 SWITCH_DECLARE(switch_CURLcode) switch_curl_easy_setopt_mime(switch_CURL *curl_handle, switch_curl_mime *mime);
 #define switch_curl_easy_setopt curl_easy_setopt
 
+/*!
+  \defgroup curl_queue Queued HTTP delivery
+  \ingroup core1
+  \{
+*/
+
+typedef struct switch_curl_queue_s switch_curl_queue_t;
+
+/*! \brief Set request options (auth, TLS, timeouts) on a handle before it is sent to url */
+typedef void (*switch_curl_queue_setup_func_t)(switch_CURL *curl_handle, const char *url, void *user_data);
+/*! \brief Take an item that could not be delivered, called from the delivery thread */
+typedef void (*switch_curl_queue_failed_func_t)(const char *id, const char *data, switch_size_t len, void *user_data);
+
+typedef struct switch_curl_queue_settings_s {
+	/*! used in logs and to name the spool files */
+	const char *name;
+	/*! tried in turn, moving to the next one on failure */
+	const char **urls;
+	int url_count;
+	/*! NULL terminated list of headers sent with every request */
+	const char **headers;
+	/*! the items in a request are joined as prefix item [separator item ...] suffix */
+	const char *batch_prefix;
+	const char *batch_separator;
+	const char *batch_suffix;
+	/*! a request holding a single item gets ?<id_param>=<id> on its url */
+	const char *id_param;
+	/*! items per request */
+	uint32_t batch_size;
+	/*! requests in flight at once */
+	uint32_t max_concurrent;
+	/*! items held in memory, waiting or in flight */
+	uint32_t capacity;
+	/*! directory items are written to until delivered, NULL to keep them in memory only */
+	const char *spool_dir;
+	/*! attempts per request before its items are handed to failed */
+	uint32_t attempts;
+	/*! first retry delay, doubled on each attempt up to max_retry_delay */
+	uint32_t retry_delay_ms;
+	uint32_t max_retry_delay_ms;
+	switch_curl_queue_setup_func_t setup;
+	switch_curl_queue_failed_func_t failed;
+	void *user_data;
+} switch_curl_queue_settings_t;
+
+typedef struct switch_curl_queue_stats_s {
+	/*! items in memory, waiting or in flight */
+	uint32_t depth;
+	uint32_t max_depth;
+	/*! items on disk waiting for room in memory */
+	uint32_t spooled;
+	/*! requests in flight */
+	uint32_t in_flight;
+	uint64_t pushed;
+	uint64_t delivered;
+	uint64_t failed;
+	/*! items refused because the queue was full and there is no spool */
+	uint64_t rejected;
+	uint64_t requests;
+	uint64_t retries;
+	/*! time from push to delivery of the last request */
+	switch_time_t last_latency;
+} switch_curl_queue_stats_t;
+
+/*!
+  \brief Create a queue and start its delivery thread
+  \param queuep the new queue
+  \param settings how to deliver, copied
+  \return SWITCH_STATUS_SUCCESS if the queue was created
+
+  Items left in the spool directory by a previous run are delivered first.
+*/
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_create(switch_curl_queue_t **queuep, const switch_curl_queue_settings_t *settings);
+
+/*!
+  \brief Queue an item for delivery
+  \param queue the queue
+  \param id identifies the item in logs, spool file and url
+  \param data the item, copied
+  \param len length of data
+  \return SWITCH_STATUS_SUCCESS if the item was taken, SWITCH_STATUS_FALSE if the queue is full
+
+  Never blocks on the network.  When the queue is full and there is a spool
+  directory the item waits on disk instead of in memory.
+*/
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_push(switch_curl_queue_t *queue, const char *id, const char *data, switch_size_t len);
+
+/*!
+  \brief Queue an item for delivery, giving the failed callback a name other than its id
+  \param queue the queue
+  \param id identifies the item in logs, spool file and url
+  \param name what the failed callback gets instead of the id, NULL for the id
+  \param data the item, copied
+  \param len length of data
+  \return SWITCH_STATUS_SUCCESS if the item was taken, SWITCH_STATUS_FALSE if the queue is full
+
+  Neither id nor name may contain spaces or newlines.
+*/
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_push_named(switch_curl_queue_t *queue, const char *id, const char *name,
+															 const char *data, switch_size_t len);
+
+SWITCH_DECLARE(void) switch_curl_queue_stats(switch_curl_queue_t *queue, switch_curl_queue_stats_t *stats);
+
+/*! \brief Write the stats of a queue to stream, as shown by the status api of its users */
+SWITCH_DECLARE(void) switch_curl_queue_status(switch_curl_queue_t *queue, switch_stream_handle_t *stream);
+
+/*!
+  \brief Stop a queue
+  \param queuep the queue
+
+  Requests in flight are allowed to finish.  Items not delivered stay in the
+  spool directory for the next run, or go to the failed callback without one.
+*/
+SWITCH_DECLARE(void) switch_curl_queue_destroy(switch_curl_queue_t **queuep);
+
+/*! \} */
+
 SWITCH_END_EXTERN_C
 
 #endif
@@ -0,0 +1,77 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_g711.h -- G.711 encode and decode over whole frames
+ *
+ */
+/*! \file switch_g711.h
+    \brief G.711 frame conversion
+
+	The kernels are picked for the cpu once when the core starts.
+*/
+#ifndef SWITCH_G711_H
+#define SWITCH_G711_H
+
+#include <switch.h>
+
+SWITCH_BEGIN_EXTERN_C
+/*!
+  \defgroup g711 G.711 Functions
+  \ingroup core1
+  \{
+*/
+/*!
+  \brief G.711 over whole frames, the same as linear_to_ulaw() and friends in g711.h sample by sample
+  \param out the encoded or decoded samples
+  \param in the samples to convert
+  \param samples the number of samples
+
+  Uses SIMD when the cpu has it, see switch_g711_kernel_name().
+ */
+SWITCH_DECLARE(void) switch_g711_ulaw_encode(uint8_t *out, const int16_t *in, switch_size_t samples);
+SWITCH_DECLARE(void) switch_g711_ulaw_decode(int16_t *out, const uint8_t *in, switch_size_t samples);
+SWITCH_DECLARE(void) switch_g711_alaw_encode(uint8_t *out, const int16_t *in, switch_size_t samples);
+SWITCH_DECLARE(void) switch_g711_alaw_decode(int16_t *out, const uint8_t *in, switch_size_t samples);
+
+/*!
+  \brief The name of the kernels in use
+  \return "scalar", "sse4.1", "avx2" or "neon"
+ */
+SWITCH_DECLARE(const char *) switch_g711_kernel_name(void);
+///\}
+
+SWITCH_END_EXTERN_C
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -300,6 +300,13 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs(const switch_codec_impleme
 */
 SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN], int arraylen, char **prefs, int preflen);
 
+/*!
+  \brief Retrieve the version of the loaded codec catalog
+  \return a number that changes every time a module adds or removes codec implementations
+  \note results of switch_loadable_module_get_codecs_sorted() are memoized per codec string until the version changes.
+*/
+SWITCH_DECLARE(uint32_t) switch_loadable_module_codec_catalog_version(void);
+
 /*!
   \brief Execute a registered API command
   \param cmd the name of the API command to execute
@@ -607,6 +614,20 @@ static inline void switch_core_codec_add_video_implementation(switch_memory_pool
     codec_interface->implementations = impl;
 }
 
+/*!
+  \brief Let the core pool and reuse handles of every implementation of a codec
+  \param codec_interface the codec interface
+  \param reset function that returns a handle to the state its init left it in
+*/
+static inline void switch_core_codec_set_reset_func(switch_codec_interface_t *codec_interface, switch_core_codec_reset_func_t reset)
+{
+	switch_codec_implementation_t *impl;
+
+	for (impl = codec_interface->implementations; impl; impl = impl->next) {
+		impl->reset = reset;
+	}
+}
+
 #define SWITCH_DECLARE_STATIC_MODULE(init, load, run, shut) void init(void) { \
 		switch_loadable_module_build_dynamic(__FILE__, load, run, shut, SWITCH_FALSE); \
 	}
@@ -384,6 +384,15 @@ struct switch_file_handle {
 	int64_t vpos;
 	void *muxbuf;
 	switch_size_t muxlen;
+	/*! shared decoded audio when the handle is served from the file cache */
+	struct switch_file_cache_entry *cache_entry;
+	switch_size_t cache_pos;
+	/*! read-ahead / write-behind state when the handle does its storage I/O off the media thread */
+	struct switch_file_async_io *async_io;
+	/*! reads that found the read-ahead buffer empty and returned silence */
+	uint32_t async_underruns;
+	/*! writes dropped because the write-behind buffer was full */
+	uint32_t async_overruns;
 };
 
 /*! \brief Abstract interface to an asr module */
@@ -765,6 +774,8 @@ struct switch_codec_implementation {
 	uint32_t impl_id;
 	char *modname;
 	struct switch_codec_implementation *next;
+	/*! optional: return a handle to the state init left it in so the core can reuse it instead of destroying it */
+	switch_core_codec_reset_func_t reset;
 };
 
 /*! \brief Top level module interface to implement a series of codec implementations */
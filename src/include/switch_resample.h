@@ -45,6 +45,8 @@
 #ifndef SWITCH_RESAMPLE_H
 #define SWITCH_RESAMPLE_H
 #define SWITCH_RESAMPLE_QUALITY 2
+/* or'd into the quality to keep speex even for whole number ratios */
+#define SWITCH_RESAMPLE_GENERIC (1 << 8)
 #include <switch.h>
 SWITCH_BEGIN_EXTERN_C
 /*!
@@ -70,6 +72,8 @@ SWITCH_BEGIN_EXTERN_C
 	uint32_t to_size;
 	/*! the number of channels */
 	int channels;
+	/*! the polyphase filter state used in place of resampler for whole number ratios */
+	void *polyphase;
 
 } switch_audio_resampler_t;
 
@@ -78,7 +82,7 @@ SWITCH_BEGIN_EXTERN_C
   \param new_resampler NULL pointer to aim at the new handle
   \param from_rate the rate to transfer from in hz
   \param to_rate the rate to transfer to in hz
-  \param quality the quality desired
+  \param quality the quality desired, whole number ratios up to 12 use a shared polyphase filter sized by it
   \return SWITCH_STATUS_SUCCESS if the handle was created
  */
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
@@ -103,6 +107,13 @@ SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resample
  */
 SWITCH_DECLARE(uint32_t) switch_resample_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen);
 
+/*!
+  \brief Name the code path a resampler runs, "speex" or the polyphase kernel picked for this cpu
+  \param resampler the resample handle
+  \return the name
+ */
+SWITCH_DECLARE(const char *) switch_resample_kernel_name(switch_audio_resampler_t *resampler);
+
 
 /*!
   \brief Convert an array of floats to an array of shorts
@@ -593,6 +593,27 @@ SWITCH_DECLARE(dtls_state_t) switch_rtp_dtls_state(switch_rtp_t *rtp_session, dt
 
 SWITCH_DECLARE(int) switch_rtp_has_dtls(void);
 
+#define SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS 10
+
+/*! DTLS handshake counters since startup; latency runs from the first handshake flight to the fingerprint check. */
+typedef struct {
+	uint64_t handshakes;		/*!< handshakes that completed */
+	uint64_t failures;			/*!< handshakes that failed */
+	uint64_t resumed;			/*!< completed handshakes that resumed an earlier session */
+	uint64_t offloaded;			/*!< handshake flights run on the crypto threads */
+	uint64_t inline_flights;	/*!< handshake flights run on the media thread (no threads or queue full) */
+	uint64_t ctx_builds;		/*!< SSL contexts built (certificate and key loads) */
+	uint64_t latency_total_ms;	/*!< sum of completed handshake latencies */
+	uint32_t bucket_ms[SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS];	/*!< upper bound of each bucket, 0 for the open ended last one */
+	uint64_t bucket[SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS];		/*!< completed handshakes per latency bucket */
+} switch_rtp_dtls_stats_t;
+
+/*!
+  \brief Snapshot the DTLS handshake counters and latency histogram
+  \param stats filled with the counters
+*/
+SWITCH_DECLARE(void) switch_rtp_get_dtls_stats(switch_rtp_dtls_stats_t *stats);
+
 SWITCH_DECLARE(switch_status_t) switch_rtp_req_bitrate(switch_rtp_t *rtp_session, uint32_t bps);
 SWITCH_DECLARE(switch_status_t) switch_rtp_ack_bitrate(switch_rtp_t *rtp_session, uint32_t bps);
 SWITCH_DECLARE(void) switch_rtp_video_refresh(switch_rtp_t *rtp_session);
@@ -234,6 +234,11 @@ SWITCH_BEGIN_EXTERN_C
 #define SWITCH_UUID_BRIDGE "uuid_bridge"
 #define SWITCH_BITS_PER_BYTE 8
 #define SWITCH_DEFAULT_FILE_BUFFER_LEN 65536
+#define SWITCH_DEFAULT_FILE_CACHE_MAX_FILE_SIZE (4 * 1024 * 1024)
+#define SWITCH_DEFAULT_FILE_ASYNC_IO_THREADS 2
+#define SWITCH_DEFAULT_CODEC_POOL_SIZE 32
+#define SWITCH_DEFAULT_MEDIA_BUG_WORKER_THREADS 2
+#define SWITCH_DEFAULT_DTLS_HANDSHAKE_THREADS 2
 #define SWITCH_DTMF_LOG_LEN 1000
 #define SWITCH_MAX_TRANS 2000
 #define SWITCH_CORE_SESSION_MAX_PRIVATES 2
@@ -725,6 +730,9 @@ typedef struct {
 	double R;
 	double mos;
 	struct error_period *error_log;
+	/* SRTP cost, packets run through srtp_protect/srtp_unprotect and the total nanoseconds spent there */
+	switch_size_t srtp_packet_count;
+	switch_size_t srtp_ns;
 } switch_rtp_numbers_t;
 
 typedef struct {
@@ -1888,6 +1896,7 @@ SMBF_THREAD_LOCK - Only let the same thread who created the bug remove it.
 SMBF_PRUNE -
 SMBF_NO_PAUSE -
 SMBF_STEREO_SWAP - Record in stereo: Write Stream - left channel, Read Stream - right channel
+SMBF_FANOUT - Take the streams from the session's shared frame ring and run the callback on a media bug worker thread
 </pre>
 */
 typedef enum {
@@ -1919,7 +1928,8 @@ typedef enum {
 	SMBF_READ_VIDEO_PATCH = (1 << 24),
 	SMBF_READ_TEXT_STREAM = (1 << 25),
 	SMBF_FIRST = (1 << 26),
-	SMBF_PAUSE = (1 << 27)
+	SMBF_PAUSE = (1 << 27),
+	SMBF_FANOUT = (1 << 28)
 } switch_media_bug_flag_enum_t;
 typedef uint32_t switch_media_bug_flag_t;
 
@@ -1939,6 +1949,7 @@ SWITCH_FILE_PAUSE =             (1 <<  8) - Pause
 SWITCH_FILE_NATIVE =            (1 <<  9) - File is in native format (no transcoding)
 SWITCH_FILE_SEEK = 				(1 << 10) - File has done a seek
 SWITCH_FILE_OPEN =              (1 << 11) - File is open
+SWITCH_FILE_FLAG_ASYNC =        (1 << 22) - Do storage reads/writes on the file I/O threads
 </pre>
  */
 typedef enum {
@@ -1963,7 +1974,8 @@ typedef enum {
 	SWITCH_FILE_BREAK_ON_CHANGE = (1 << 18),
 	SWITCH_FILE_FLAG_VIDEO = (1 << 19),
 	SWITCH_FILE_FLAG_VIDEO_EOF = (1 << 20),
-	SWITCH_FILE_PRE_CLOSED = (1 << 21)
+	SWITCH_FILE_PRE_CLOSED = (1 << 21),
+	SWITCH_FILE_FLAG_ASYNC = (1 << 22)
 } switch_file_flag_enum_t;
 typedef uint32_t switch_file_flag_t;
 
@@ -2469,6 +2481,8 @@ typedef switch_status_t (*switch_core_codec_control_func_t) (switch_codec_t *cod
 typedef switch_status_t (*switch_core_codec_init_func_t) (switch_codec_t *, switch_codec_flag_t, const switch_codec_settings_t *codec_settings);
 typedef switch_status_t (*switch_core_codec_fmtp_parse_func_t) (const char *fmtp, switch_codec_fmtp_t *codec_fmtp);
 typedef switch_status_t (*switch_core_codec_destroy_func_t) (switch_codec_t *);
+typedef switch_status_t (*switch_core_codec_reset_func_t) (switch_codec_t *);
+typedef void (*switch_core_codec_translate_func_t) (const uint8_t *in, uint8_t *out, uint32_t len);
 
 
 typedef switch_status_t (*switch_chat_application_function_t) (switch_event_t *, const char *);
@@ -40,6 +40,9 @@
 #define CC_SQLITE_DB_NAME "callcenter"
 #define CC_APP_KEY "mod_callcenter"
 
+/* How often in us the tables are reread when other boxes share them through odbc-dsn */
+#define CC_SHARED_REFRESH 1000000
+
 
 /* Prototypes */
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown);
@@ -431,12 +434,21 @@ static struct {
 	switch_bool_t truncate_tiers;
 	switch_bool_t truncate_agents;
 	switch_bool_t global_database_lock;
+	switch_bool_t shared_db;
 	int32_t threads;
 	int32_t running;
 	switch_mutex_t *mutex;
 	switch_memory_pool_t *pool;
 	switch_event_node_t *node;
 	int agent_originate_timeout;
+	switch_sql_queue_manager_t *qm;
+	switch_mutex_t *acd_mutex;
+	switch_hash_t *agent_hash;
+	switch_hash_t *member_hash;
+	switch_hash_t *roster_hash;
+	switch_mutex_t *dispatch_mutex;
+	switch_thread_cond_t *dispatch_cond;
+	int dispatch_pending;
 } globals;
 
 #define CC_QUEUE_CONFIGITEM_COUNT 100
@@ -484,7 +496,133 @@ struct cc_queue {
 };
 typedef struct cc_queue cc_queue_t;
 
+/* Agents, tiers and members are held in memory under globals.acd_mutex, the
+   tables are only written behind through globals.qm so they can be inspected
+   from outside and survive a restart.  With odbc-dsn the tables may be shared
+   with other boxes: they are written through instead and reread every
+   CC_SHARED_REFRESH for what the others changed, see cc_shared_refresh(). */
+
+typedef enum {
+	CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER,
+	CC_STRATEGY_RING_ALL,
+	CC_STRATEGY_RING_PROGRESSIVELY,
+	CC_STRATEGY_LONGEST_IDLE_AGENT,
+	CC_STRATEGY_ROUND_ROBIN,
+	CC_STRATEGY_TOP_DOWN,
+	CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME,
+	CC_STRATEGY_AGENT_WITH_FEWEST_CALLS,
+	CC_STRATEGY_RANDOM
+} cc_strategy_t;
+
+static struct cc_state_table STRATEGY_CHART[] = {
+	{"sequentially-by-agent-order", CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER},
+	{"ring-all", CC_STRATEGY_RING_ALL},
+	{"ring-progressively", CC_STRATEGY_RING_PROGRESSIVELY},
+	{"longest-idle-agent", CC_STRATEGY_LONGEST_IDLE_AGENT},
+	{"round-robin", CC_STRATEGY_ROUND_ROBIN},
+	{"top-down", CC_STRATEGY_TOP_DOWN},
+	{"agent-with-least-talk-time", CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME},
+	{"agent-with-fewest-calls", CC_STRATEGY_AGENT_WITH_FEWEST_CALLS},
+	{"random", CC_STRATEGY_RANDOM},
+	{NULL, 0}
+};
+
+/* A shared row as the last reread found it in the table.  Only the columns that
+   changed there since are taken over, what we hold of the others may be newer. */
+typedef struct {
+	char **cols;
+	int count;
+	uint32_t gen;
+} cc_seen_t;
+
+typedef struct cc_agent cc_agent_t;
+typedef struct cc_tier cc_tier_t;
+typedef struct cc_member cc_member_t;
+typedef struct cc_roster cc_roster_t;
+
+struct cc_agent {
+	char *name;
+	char *instance_id;
+	char *uuid;
+	char *type;
+	char *contact;
+	cc_agent_status_t status;
+	cc_agent_state_t state;
+	int max_no_answer;
+	int wrap_up_time;
+	int reject_delay_time;
+	int busy_delay_time;
+	int no_answer_delay_time;
+	switch_time_t last_bridge_start;
+	switch_time_t last_bridge_end;
+	switch_time_t last_offered_call;
+	switch_time_t last_status_change;
+	int no_answer_count;
+	int calls_answered;
+	switch_time_t talk_time;
+	switch_time_t ready_time;
+	int external_calls_count;
+	cc_tier_t *tiers;
+	cc_seen_t seen;
+};
+
+struct cc_tier {
+	cc_roster_t *roster;
+	cc_agent_t *agent;
+	cc_tier_state_t state;
+	int level;
+	int position;
+	uint32_t sort_key;
+	cc_tier_t *agent_next;
+	cc_seen_t seen;
+};
+
+struct cc_member {
+	cc_roster_t *roster;
+	char *instance_id;
+	char *uuid;
+	char *session_uuid;
+	char *cid_number;
+	char *cid_name;
+	switch_time_t system_epoch;
+	switch_time_t joined_epoch;
+	switch_time_t rejoined_epoch;
+	switch_time_t bridge_epoch;
+	switch_time_t abandoned_epoch;
+	int base_score;
+	int skill_score;
+	char *serving_agent;
+	char *serving_system;
+	cc_member_state_t state;
+	/* Where the last offer went, for ring-progressively and top-down */
+	switch_time_t last_originated_call;
+	int last_tier_level;
+	int last_tier_position;
+	/* Reread generation that last found a member of another box */
+	uint32_t refreshed;
+	cc_member_t *prev;
+	cc_member_t *next;
+};
+
+/* The tiers and members of a queue.  Kept apart from cc_queue_t so it survives a
+   queue reload; rosters are only freed on shutdown. */
+struct cc_roster {
+	char *name;
+	/* Ordered by level, position */
+	cc_tier_t **tiers;
+	int tier_count;
+	int tier_size;
+	/* Ordered by score, best first */
+	cc_member_t *members;
+	cc_member_t *members_tail;
+	/* Tier of the agent last offered a call, for round-robin */
+	int rr_level;
+	int rr_position;
+	switch_time_t rr_offered;
+};
+
 static void cc_send_presence(const char *queue_name);
+static void cc_dispatch_wake(void);
 
 static void free_queue(cc_queue_t *queue)
 {
@@ -829,6 +967,345 @@ static cc_queue_t *get_queue(const char *queue_name)
 	return queue;
 }
 
+/* Queue a statement for the write-behind thread, sql is freed once executed.  Shared
+   tables are written right away so the others and our own reread see it. */
+static void cc_persist_sql(char *sql)
+{
+	if (globals.qm) {
+		switch_sql_queue_manager_push(globals.qm, sql, 0, SWITCH_FALSE);
+	} else {
+		cc_execute_sql(NULL, sql, globals.acd_mutex);
+		switch_safe_free(sql);
+	}
+}
+
+static void cc_str_set(char **str, const char *val)
+{
+	switch_safe_free(*str);
+	*str = strdup(switch_str_nil(val));
+}
+
+/* Whether column col of the row changed in the table since the last reread, a row
+   we never read before has nothing to compare to */
+static switch_bool_t cc_seen_changed(cc_seen_t *seen, int col, const char *val)
+{
+	return seen->cols && col < seen->count && strcmp(seen->cols[col], switch_str_nil(val)) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void cc_seen_set(cc_seen_t *seen, int argc, char **argv, uint32_t gen)
+{
+	int i;
+
+	if (!seen->cols) {
+		switch_zmalloc(seen->cols, argc * sizeof(*seen->cols));
+		seen->count = argc;
+	}
+
+	for (i = 0; i < seen->count && i < argc; i++) {
+		if (!seen->cols[i] || strcmp(seen->cols[i], switch_str_nil(argv[i]))) {
+			cc_str_set(&seen->cols[i], argv[i]);
+		}
+	}
+
+	seen->gen = gen;
+}
+
+static void cc_seen_free(cc_seen_t *seen)
+{
+	int i;
+
+	for (i = 0; i < seen->count; i++) {
+		switch_safe_free(seen->cols[i]);
+	}
+	switch_safe_free(seen->cols);
+	seen->count = 0;
+}
+
+static cc_strategy_t cc_str2strategy(const char *str)
+{
+	uint8_t x;
+
+	for (x = 0; STRATEGY_CHART[x].name; x++) {
+		if (!strcasecmp(STRATEGY_CHART[x].name, str)) {
+			return STRATEGY_CHART[x].state;
+		}
+	}
+
+	/* Unknown strategies get the sequentially-by-agent-order ordering */
+	return CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER;
+}
+
+/* Members are served highest first, the score shown in lists is this plus the current epoch */
+static switch_time_t cc_member_priority(cc_member_t *member)
+{
+	return member->base_score + member->skill_score - member->joined_epoch;
+}
+
+static cc_roster_t *cc_roster_get(const char *queue_name, switch_bool_t create)
+{
+	cc_roster_t *roster;
+
+	if (!(roster = switch_core_hash_find(globals.roster_hash, queue_name)) && create) {
+		switch_zmalloc(roster, sizeof(*roster));
+		roster->name = strdup(queue_name);
+		switch_core_hash_insert(globals.roster_hash, roster->name, roster);
+	}
+
+	return roster;
+}
+
+static void cc_roster_link_member(cc_roster_t *roster, cc_member_t *member)
+{
+	switch_time_t priority = cc_member_priority(member);
+	cc_member_t *np;
+
+	/* New callers mostly go last, equal scores keep their arrival order */
+	for (np = roster->members_tail; np && cc_member_priority(np) < priority; np = np->prev);
+
+	member->roster = roster;
+	member->prev = np;
+	if (np) {
+		member->next = np->next;
+		np->next = member;
+	} else {
+		member->next = roster->members;
+		roster->members = member;
+	}
+	if (member->next) {
+		member->next->prev = member;
+	} else {
+		roster->members_tail = member;
+	}
+}
+
+static void cc_roster_unlink_member(cc_member_t *member)
+{
+	cc_roster_t *roster = member->roster;
+
+	if (member->prev) {
+		member->prev->next = member->next;
+	} else {
+		roster->members = member->next;
+	}
+	if (member->next) {
+		member->next->prev = member->prev;
+	} else {
+		roster->members_tail = member->prev;
+	}
+	member->prev = member->next = NULL;
+}
+
+static int cc_tier_cmp_level(const cc_tier_t *a, const cc_tier_t *b)
+{
+	if (a->level != b->level) {
+		return a->level < b->level ? -1 : 1;
+	}
+	if (a->position != b->position) {
+		return a->position < b->position ? -1 : 1;
+	}
+	return 0;
+}
+
+static void cc_roster_link_tier(cc_roster_t *roster, cc_tier_t *tier)
+{
+	int i;
+
+	if (roster->tier_count == roster->tier_size) {
+		roster->tier_size = roster->tier_size ? roster->tier_size * 2 : 16;
+		roster->tiers = realloc(roster->tiers, roster->tier_size * sizeof(*roster->tiers));
+		switch_assert(roster->tiers);
+	}
+
+	for (i = roster->tier_count; i > 0 && cc_tier_cmp_level(roster->tiers[i - 1], tier) > 0; i--) {
+		roster->tiers[i] = roster->tiers[i - 1];
+	}
+	roster->tiers[i] = tier;
+	roster->tier_count++;
+	tier->roster = roster;
+}
+
+static void cc_roster_unlink_tier(cc_tier_t *tier)
+{
+	cc_roster_t *roster = tier->roster;
+	int i;
+
+	for (i = 0; i < roster->tier_count && roster->tiers[i] != tier; i++);
+
+	if (i < roster->tier_count) {
+		memmove(&roster->tiers[i], &roster->tiers[i + 1], (roster->tier_count - i - 1) * sizeof(*roster->tiers));
+		roster->tier_count--;
+	}
+}
+
+static cc_agent_t *cc_agent_find(const char *agent_name)
+{
+	return switch_core_hash_find(globals.agent_hash, agent_name);
+}
+
+static cc_agent_t *cc_agent_create(const char *agent_name, const char *instance_id, const char *type)
+{
+	cc_agent_t *agent;
+
+	switch_zmalloc(agent, sizeof(*agent));
+	agent->name = strdup(agent_name);
+	cc_str_set(&agent->instance_id, instance_id);
+	cc_str_set(&agent->uuid, NULL);
+	cc_str_set(&agent->type, type);
+	cc_str_set(&agent->contact, NULL);
+	agent->status = CC_AGENT_STATUS_LOGGED_OUT;
+	agent->state = CC_AGENT_STATE_WAITING;
+	switch_core_hash_insert(globals.agent_hash, agent->name, agent);
+
+	return agent;
+}
+
+static cc_tier_t *cc_tier_find(const char *queue_name, const char *agent_name)
+{
+	cc_agent_t *agent;
+	cc_tier_t *tier = NULL;
+
+	if ((agent = cc_agent_find(agent_name))) {
+		for (tier = agent->tiers; tier && strcmp(tier->roster->name, queue_name); tier = tier->agent_next);
+	}
+
+	return tier;
+}
+
+static cc_tier_t *cc_tier_create(cc_roster_t *roster, cc_agent_t *agent, cc_tier_state_t state, int level, int position)
+{
+	cc_tier_t *tier;
+
+	switch_zmalloc(tier, sizeof(*tier));
+	tier->agent = agent;
+	tier->state = state;
+	tier->level = level;
+	tier->position = position;
+	tier->agent_next = agent->tiers;
+	agent->tiers = tier;
+	cc_roster_link_tier(roster, tier);
+
+	if (agent->last_offered_call > roster->rr_offered) {
+		roster->rr_offered = agent->last_offered_call;
+		roster->rr_level = level;
+		roster->rr_position = position;
+	}
+
+	return tier;
+}
+
+static void cc_tier_destroy(cc_tier_t *tier)
+{
+	cc_tier_t **tp;
+
+	for (tp = &tier->agent->tiers; *tp && *tp != tier; tp = &(*tp)->agent_next);
+	if (*tp) {
+		*tp = tier->agent_next;
+	}
+	cc_roster_unlink_tier(tier);
+	cc_seen_free(&tier->seen);
+	free(tier);
+}
+
+static void cc_agent_destroy(cc_agent_t *agent)
+{
+	while (agent->tiers) {
+		cc_tier_destroy(agent->tiers);
+	}
+	switch_core_hash_delete(globals.agent_hash, agent->name);
+	switch_safe_free(agent->instance_id);
+	switch_safe_free(agent->uuid);
+	switch_safe_free(agent->type);
+	switch_safe_free(agent->contact);
+	switch_safe_free(agent->name);
+	cc_seen_free(&agent->seen);
+	free(agent);
+}
+
+/* Remember the tier of the agent offered last for every queue it serves, round-robin continues from there */
+static void cc_agent_offered(cc_agent_t *agent, switch_time_t now)
+{
+	cc_tier_t *tier;
+
+	agent->last_offered_call = now;
+	for (tier = agent->tiers; tier; tier = tier->agent_next) {
+		tier->roster->rr_offered = now;
+		tier->roster->rr_level = tier->level;
+		tier->roster->rr_position = tier->position;
+	}
+}
+
+static cc_member_t *cc_member_find(const char *member_uuid)
+{
+	return switch_core_hash_find(globals.member_hash, member_uuid);
+}
+
+/* The caller fills in the scores, then links it into its roster */
+static cc_member_t *cc_member_create(const char *member_uuid)
+{
+	cc_member_t *member;
+
+	switch_zmalloc(member, sizeof(*member));
+	member->uuid = strdup(member_uuid);
+	cc_str_set(&member->instance_id, globals.cc_instance_id);
+	cc_str_set(&member->session_uuid, NULL);
+	cc_str_set(&member->cid_number, NULL);
+	cc_str_set(&member->cid_name, NULL);
+	cc_str_set(&member->serving_agent, NULL);
+	cc_str_set(&member->serving_system, NULL);
+	switch_core_hash_insert(globals.member_hash, member->uuid, member);
+
+	return member;
+}
+
+static void cc_member_destroy(cc_member_t *member)
+{
+	if (member->roster) {
+		cc_roster_unlink_member(member);
+	}
+	switch_core_hash_delete(globals.member_hash, member->uuid);
+	switch_safe_free(member->instance_id);
+	switch_safe_free(member->session_uuid);
+	switch_safe_free(member->cid_number);
+	switch_safe_free(member->cid_name);
+	switch_safe_free(member->serving_agent);
+	switch_safe_free(member->serving_system);
+	switch_safe_free(member->uuid);
+	free(member);
+}
+
+static cc_member_t *cc_member_find_served(const char *agent_name)
+{
+	switch_hash_index_t *hi;
+
+	for (hi = switch_core_hash_first(globals.member_hash); hi; hi = switch_core_hash_next(&hi)) {
+		void *val;
+		cc_member_t *member;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		member = (cc_member_t *) val;
+
+		if (member->state != CC_MEMBER_STATE_ANSWERED && !strcmp(member->serving_agent, agent_name) && !strcmp(member->serving_system, "single_box")) {
+			switch_safe_free(hi);
+			return member;
+		}
+	}
+
+	return NULL;
+}
+
+static switch_event_t *cc_agent_event(const char *agent_name, const char *action, const char *header, const char *value)
+{
+	switch_event_t *event = NULL;
+
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent_name);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", action);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, header, value);
+	}
+
+	return event;
+}
+
 struct call_helper {
 	const char *member_uuid;
 	const char *member_session_uuid;
@@ -849,31 +1326,56 @@ struct call_helper {
 	int reject_delay_time;
 	int busy_delay_time;
 	int no_answer_delay_time;
+	int agent_tier_level;
+	int agent_tier_position;
 	cc_agent_status_t agent_no_answer_status;
 
+	struct call_helper *next;
 	switch_memory_pool_t *pool;
 };
 
+/* Members of a roster in either state, call with acd_mutex held */
+static int cc_roster_count(cc_roster_t *roster, cc_member_state_t state_a, cc_member_state_t state_b)
+{
+	cc_member_t *member;
+	int count = 0;
+
+	for (member = roster->members; member; member = member->next) {
+		if (member->state == state_a || member->state == state_b) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
 int cc_queue_count(const char *queue)
 {
-	char *sql;
 	int count = 0;
 	char res[256] = "0";
 	const char *event_name = "Single-Queue";
 	switch_event_t *event;
 
 	if (!switch_strlen_zero(queue)) {
+		cc_roster_t *roster;
+
+		switch_mutex_lock(globals.acd_mutex);
 		if (queue[0] == '*') {
+			switch_hash_index_t *hi;
+
 			event_name = "All-Queues";
-			sql = switch_mprintf("SELECT count(*) FROM members WHERE state = '%q' OR state = '%q'",
-					cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_TRYING));
-		} else {
-			sql = switch_mprintf("SELECT count(*) FROM members WHERE queue = '%q' AND (state = '%q' OR state = '%q')",
-					queue, cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_TRYING));
+			for (hi = switch_core_hash_first(globals.roster_hash); hi; hi = switch_core_hash_next(&hi)) {
+				void *val;
+
+				switch_core_hash_this(hi, NULL, NULL, &val);
+				roster = (cc_roster_t *) val;
+				count += cc_roster_count(roster, CC_MEMBER_STATE_WAITING, CC_MEMBER_STATE_TRYING);
+			}
+		} else if ((roster = cc_roster_get(queue, SWITCH_FALSE))) {
+			count = cc_roster_count(roster, CC_MEMBER_STATE_WAITING, CC_MEMBER_STATE_TRYING);
 		}
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		count = atoi(res);
+		switch_mutex_unlock(globals.acd_mutex);
+		switch_snprintf(res, sizeof(res), "%d", count);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Queue", queue);
@@ -894,23 +1396,21 @@ cc_status_t cc_agent_add(const char *agent, const char *type)
 	char *sql;
 
 	if (!strcasecmp(type, CC_AGENT_TYPE_CALLBACK) || !strcasecmp(type, CC_AGENT_TYPE_UUID_STANDBY)) {
-		char res[256] = "";
+		switch_mutex_lock(globals.acd_mutex);
 		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		if (cc_agent_find(agent)) {
+			switch_mutex_unlock(globals.acd_mutex);
 			result = CC_STATUS_AGENT_ALREADY_EXIST;
 			goto done;
 		}
 		/* Add Agent */
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding Agent %s with type %s with default status %s\n",
 				agent, type, cc_agent_status2str(CC_AGENT_STATUS_LOGGED_OUT));
+		cc_agent_create(agent, "single_box", type);
 		sql = switch_mprintf("INSERT INTO agents (name, instance_id, type, status, state) VALUES('%q', 'single_box', '%q', '%q', '%q');",
 				agent, type, cc_agent_status2str(CC_AGENT_STATUS_LOGGED_OUT), cc_agent_state2str(CC_AGENT_STATE_WAITING));
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist_sql(sql);
+		switch_mutex_unlock(globals.acd_mutex);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
@@ -930,42 +1430,50 @@ done:
 cc_status_t cc_agent_del(const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-
+	cc_agent_t *ap;
 	char *sql;
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted Agent %s\n", agent);
+	switch_mutex_lock(globals.acd_mutex);
+	if ((ap = cc_agent_find(agent))) {
+		cc_agent_destroy(ap);
+	}
 	sql = switch_mprintf("DELETE FROM agents WHERE name = '%q';"
 			"DELETE FROM tiers WHERE agent = '%q';",
 			agent, agent);
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
 	return result;
 }
 
 cc_status_t cc_agent_get(const char *key, const char *agent, char *ret_result, size_t ret_result_size)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
 	switch_event_t *event;
-	char res[256];
+	cc_agent_t *ap;
+	char res[256] = "";
 
+	switch_mutex_lock(globals.acd_mutex);
 	/* Check to see if agent already exists */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
+	if (!(ap = cc_agent_find(agent))) {
+		switch_mutex_unlock(globals.acd_mutex);
 		result = CC_STATUS_AGENT_NOT_FOUND;
 		goto done;
 	}
 
-	if (!strcasecmp(key, "status") || !strcasecmp(key, "state") || !strcasecmp(key, "uuid") ) {
-		/* Check to see if agent already exists */
-		sql = switch_mprintf("SELECT %q FROM agents WHERE name = '%q'", key, agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+	if (!strcasecmp(key, "status")) {
+		switch_copy_string(res, cc_agent_status2str(ap->status), sizeof(res));
+	} else if (!strcasecmp(key, "state")) {
+		switch_copy_string(res, cc_agent_state2str(ap->state), sizeof(res));
+	} else if (!strcasecmp(key, "uuid")) {
+		switch_copy_string(res, ap->uuid, sizeof(res));
+	} else {
+		result = CC_STATUS_INVALID_KEY;
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	if (result == CC_STATUS_SUCCESS) {
 		switch_snprintf(ret_result, ret_result_size, "%s", res);
-		result = CC_STATUS_SUCCESS;
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			char tmpname[256];
@@ -979,11 +1487,6 @@ cc_status_t cc_agent_get(const char *key, const char *agent, char *ret_result, s
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, tmpname, res);
 			switch_event_fire(&event);
 		}
-
-	} else {
-		result = CC_STATUS_INVALID_KEY;
-		goto done;
-
 	}
 
 done:
@@ -994,190 +1497,174 @@ done:
 	return result;
 }
 
-cc_status_t cc_agent_update(const char *key, const char *value, const char *agent)
+/* Call with acd_mutex held.  The event is handed back to be fired once the lock is released,
+   hangup_uuid is set when a pending callback to the agent has to be cancelled. */
+static cc_status_t cc_agent_update_locked(const char *key, const char *value, const char *agent, switch_event_t **event, char **hangup_uuid)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
-	char res[256] = "";
-	switch_event_t *event;
-
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_agent_t *ap;
+	char *sql = NULL;
 
-	if (atoi(res) == 0) {
-		result = CC_STATUS_AGENT_NOT_FOUND;
-		goto done;
+	if (!(ap = cc_agent_find(agent))) {
+		return CC_STATUS_AGENT_NOT_FOUND;
 	}
 
 	if (!strcasecmp(key, "status")) {
-		if (cc_agent_str2status(value) != CC_AGENT_STATUS_UNKNOWN) {
-			/* Reset values on available only */
-			if (cc_agent_str2status(value) == CC_AGENT_STATUS_AVAILABLE) {
-				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "', talk_time = 0, calls_answered = 0, no_answer_count = 0"
-						" WHERE name = '%q' AND NOT status = '%q'",
-						value, local_epoch_time_now(NULL),
-						agent, value);
-			} else {
-				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
-						value, local_epoch_time_now(NULL), agent);
-			}
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+		cc_agent_status_t status = cc_agent_str2status(value);
 
+		if (status == CC_AGENT_STATUS_UNKNOWN) {
+			return CC_STATUS_AGENT_INVALID_STATUS;
+		}
 
-			/* Used to stop any active callback */
-			if (cc_agent_str2status(value) != CC_AGENT_STATUS_AVAILABLE) {
-				sql = switch_mprintf("SELECT uuid FROM members WHERE serving_agent = '%q' AND serving_system = 'single_box' AND NOT state = 'Answered'", agent);
-				cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-				switch_safe_free(sql);
-				if (!switch_strlen_zero(res)) {
-					switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", res, SWITCH_CAUSE_ORIGINATOR_CANCEL);
-				}
+		/* Reset values on available only */
+		if (status == CC_AGENT_STATUS_AVAILABLE) {
+			if (ap->status != status) {
+				ap->status = status;
+				ap->last_status_change = now;
+				ap->talk_time = 0;
+				ap->calls_answered = 0;
+				ap->no_answer_count = 0;
 			}
+			sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "', talk_time = 0, calls_answered = 0, no_answer_count = 0"
+					" WHERE name = '%q' AND NOT status = '%q'",
+					value, now, agent, value);
+		} else {
+			cc_member_t *member;
 
+			ap->status = status;
+			ap->last_status_change = now;
+			sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
+					value, now, agent);
 
-			result = CC_STATUS_SUCCESS;
-
-			if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-status-change");
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-Status", value);
-				switch_event_fire(&event);
+			/* Used to stop any active callback */
+			if (hangup_uuid && (member = cc_member_find_served(agent))) {
+				*hangup_uuid = strdup(member->uuid);
 			}
-
-		} else {
-			result = CC_STATUS_AGENT_INVALID_STATUS;
-			goto done;
 		}
-	} else if (!strcasecmp(key, "state")) {
-		if (cc_agent_str2state(value) != CC_AGENT_STATE_UNKNOWN) {
-			if (cc_agent_str2state(value) != CC_AGENT_STATE_RECEIVING) {
-				sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q'", value, agent);
-			} else {
-				sql = switch_mprintf("UPDATE agents SET state = '%q', last_offered_call = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
-						value, local_epoch_time_now(NULL), agent);
-			}
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
 
-			result = CC_STATUS_SUCCESS;
+		*event = cc_agent_event(agent, "agent-status-change", "CC-Agent-Status", value);
+	} else if (!strcasecmp(key, "state")) {
+		cc_agent_state_t state = cc_agent_str2state(value);
 
-			if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-state-change");
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-State", value);
-				switch_event_fire(&event);
-			}
+		if (state == CC_AGENT_STATE_UNKNOWN) {
+			return CC_STATUS_AGENT_INVALID_STATE;
+		}
 
+		ap->state = state;
+		if (state != CC_AGENT_STATE_RECEIVING) {
+			sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q'", value, agent);
 		} else {
-			result = CC_STATUS_AGENT_INVALID_STATE;
-			goto done;
+			cc_agent_offered(ap, now);
+			sql = switch_mprintf("UPDATE agents SET state = '%q', last_offered_call = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
+					value, now, agent);
 		}
+
+		*event = cc_agent_event(agent, "agent-state-change", "CC-Agent-State", value);
 	} else if (!strcasecmp(key, "uuid")) {
+		cc_str_set(&ap->uuid, value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET uuid = '%q', instance_id = 'single_box' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "contact")) {
+		cc_str_set(&ap->contact, value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET contact = '%q', instance_id = 'single_box' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 
-		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-contact-change");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-Contact", value);
-			switch_event_fire(&event);
-		}
+		*event = cc_agent_event(agent, "agent-contact-change", "CC-Agent-Contact", value);
 	} else if (!strcasecmp(key, "ready_time")) {
+		ap->ready_time = atol(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET ready_time = '%ld', instance_id = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "busy_delay_time")) {
+		ap->busy_delay_time = atol(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET busy_delay_time = '%ld', instance_id = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "reject_delay_time")) {
+		ap->reject_delay_time = atol(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET reject_delay_time = '%ld', instance_id = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "no_answer_delay_time")) {
+		ap->no_answer_delay_time = atol(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET no_answer_delay_time = '%ld', instance_id = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "type")) {
 		if (strcasecmp(value, CC_AGENT_TYPE_CALLBACK) && strcasecmp(value, CC_AGENT_TYPE_UUID_STANDBY)) {
-			result = CC_STATUS_AGENT_INVALID_TYPE;
-			goto done;
+			return CC_STATUS_AGENT_INVALID_TYPE;
 		}
 
+		cc_str_set(&ap->type, value);
 		sql = switch_mprintf("UPDATE agents SET type = '%q' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
-
 	} else if (!strcasecmp(key, "max_no_answer")) {
+		ap->max_no_answer = atoi(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET max_no_answer = '%d', instance_id = 'single_box' WHERE name = '%q'", atoi(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
-
 	} else if (!strcasecmp(key, "wrap_up_time")) {
+		ap->wrap_up_time = atoi(value);
+		cc_str_set(&ap->instance_id, "single_box");
 		sql = switch_mprintf("UPDATE agents SET wrap_up_time = '%d', instance_id = 'single_box' WHERE name = '%q'", atoi(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+	} else if (!strcasecmp(key, "state_if_waiting")) {
+		cc_agent_state_t state = cc_agent_str2state(value);
 
-		result = CC_STATUS_SUCCESS;
+		if (state == CC_AGENT_STATE_UNKNOWN) {
+			return CC_STATUS_AGENT_INVALID_STATE;
+		}
+
+		if (ap->state != CC_AGENT_STATE_WAITING || (ap->status != CC_AGENT_STATUS_AVAILABLE && ap->status != CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)) {
+			return CC_STATUS_AGENT_NOT_FOUND;
+		}
+
+		sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q' AND state = '%q' AND status IN ('%q', '%q')",
+				value, agent,
+				cc_agent_state2str(CC_AGENT_STATE_WAITING),
+				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE),
+				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND));
+
+		/* Another box may have taken the agent since our last reread, the table decides */
+		if (globals.shared_db) {
+			int rows = cc_execute_sql_affected_rows(sql);
 
-	} else if (!strcasecmp(key, "state_if_waiting")) {
-		if (cc_agent_str2state(value) == CC_AGENT_STATE_UNKNOWN) {
-			result = CC_STATUS_AGENT_INVALID_STATE;
-			goto done;
-		} else {
-			sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q' AND state = '%q' AND status IN ('%q', '%q')",
-					value, agent,
-					cc_agent_state2str(CC_AGENT_STATE_WAITING),
-					cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE),
-					cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND));
-
-			if (cc_execute_sql_affected_rows(sql) > 0) {
-				result = CC_STATUS_SUCCESS;
-				if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-state-change");
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-State", value);
-					switch_event_fire(&event);
-				}
-			} else {
-				result = CC_STATUS_AGENT_NOT_FOUND;
-			}
 			switch_safe_free(sql);
+			if (rows < 1) {
+				return CC_STATUS_AGENT_NOT_FOUND;
+			}
 		}
 
+		ap->state = state;
+
+		*event = cc_agent_event(agent, "agent-state-change", "CC-Agent-State", value);
 	} else {
 		result = CC_STATUS_INVALID_KEY;
-		goto done;
+	}
 
+	if (sql) {
+		cc_persist_sql(sql);
+	}
+
+	return result;
+}
+
+cc_status_t cc_agent_update(const char *key, const char *value, const char *agent)
+{
+	cc_status_t result;
+	switch_event_t *event = NULL;
+	char *hangup_uuid = NULL;
+
+	switch_mutex_lock(globals.acd_mutex);
+	result = cc_agent_update_locked(key, value, agent, &event, &hangup_uuid);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	if (hangup_uuid) {
+		switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", hangup_uuid, SWITCH_CAUSE_ORIGINATOR_CANCEL);
+		free(hangup_uuid);
+	}
+
+	if (event) {
+		switch_event_fire(&event);
 	}
 
-done:
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated Agent %s set %s = %s\n", agent, key, value);
+		cc_dispatch_wake();
 	}
 
 	return result;
@@ -1196,34 +1683,32 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 	}
 
 	if (cc_tier_str2state(state) != CC_TIER_STATE_UNKNOWN) {
-		char res[256] = "";
-		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+		cc_agent_t *ap;
 
-		if (atoi(res) == 0) {
+		switch_mutex_lock(globals.acd_mutex);
+		/* Check to see if agent already exist */
+		if (!(ap = cc_agent_find(agent))) {
+			switch_mutex_unlock(globals.acd_mutex);
 			result = CC_STATUS_AGENT_NOT_FOUND;
 			goto done;
 		}
 
 		/* Check to see if tier already exist */
-		sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		if (cc_tier_find(queue_name, agent)) {
+			switch_mutex_unlock(globals.acd_mutex);
 			result = CC_STATUS_TIER_ALREADY_EXIST;
 			goto done;
 		}
 
 		/* Add Agent in tier */
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding Tier on Queue %s for Agent %s, level %d, position %d\n", queue_name, agent, level, position);
+		cc_tier_create(cc_roster_get(queue_name, SWITCH_TRUE), ap, cc_tier_str2state(state), level, position);
 		sql = switch_mprintf("INSERT INTO tiers (queue, agent, state, level, position) VALUES('%q', '%q', '%q', '%d', '%d');",
 				queue_name, agent, state, level, position);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist_sql(sql);
+		switch_mutex_unlock(globals.acd_mutex);
 
+		cc_dispatch_wake();
 		result = CC_STATUS_SUCCESS;
 	} else {
 		result = CC_STATUS_TIER_INVALID_STATE;
@@ -1238,27 +1723,18 @@ done:
 cc_status_t cc_tier_update(const char *key, const char *value, const char *queue_name, const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
-	char res[256];
+	char *sql = NULL;
 	cc_queue_t *queue = NULL;
+	cc_tier_t *tier;
 
+	switch_mutex_lock(globals.acd_mutex);
 	/* Check to see if tier already exist */
-	sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
+	if (!cc_tier_find(queue_name, agent)) {
 		result = CC_STATUS_TIER_NOT_FOUND;
-		goto done;
 	}
+	switch_mutex_unlock(globals.acd_mutex);
 
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
-		result = CC_STATUS_AGENT_NOT_FOUND;
+	if (result != CC_STATUS_SUCCESS) {
 		goto done;
 	}
 
@@ -1270,52 +1746,388 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 	}
 
 	if (!strcasecmp(key, "state")) {
-		if (cc_tier_str2state(value) != CC_TIER_STATE_UNKNOWN) {
-			sql = switch_mprintf("UPDATE tiers SET state = '%q' WHERE queue = '%q' AND agent = '%q'", value, queue_name, agent);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
-			result = CC_STATUS_SUCCESS;
-		} else {
+		if (cc_tier_str2state(value) == CC_TIER_STATE_UNKNOWN) {
 			result = CC_STATUS_TIER_INVALID_STATE;
 			goto done;
 		}
+		sql = switch_mprintf("UPDATE tiers SET state = '%q' WHERE queue = '%q' AND agent = '%q'", value, queue_name, agent);
 	} else if (!strcasecmp(key, "level")) {
 		sql = switch_mprintf("UPDATE tiers SET level = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
-
 	} else if (!strcasecmp(key, "position")) {
 		sql = switch_mprintf("UPDATE tiers SET position = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		result = CC_STATUS_SUCCESS;
 	} else {
 		result = CC_STATUS_INVALID_KEY;
 		goto done;
 	}
+
+	switch_mutex_lock(globals.acd_mutex);
+	/* It may have been deleted while we checked the queue */
+	if ((tier = cc_tier_find(queue_name, agent))) {
+		if (!strcasecmp(key, "state")) {
+			tier->state = cc_tier_str2state(value);
+		} else {
+			cc_roster_unlink_tier(tier);
+			if (!strcasecmp(key, "level")) {
+				tier->level = atoi(value);
+			} else {
+				tier->position = atoi(value);
+			}
+			cc_roster_link_tier(tier->roster, tier);
+		}
+	}
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	cc_dispatch_wake();
 done:
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated tier: Agent %s in Queue %s set %s = %s\n", agent, queue_name, key, value);
 	}
-	return result;
+	return result;
+}
+
+cc_status_t cc_tier_del(const char *queue_name, const char *agent)
+{
+	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_tier_t *tier;
+	char *sql;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted tier Agent %s in Queue %s\n", agent, queue_name);
+	switch_mutex_lock(globals.acd_mutex);
+	if ((tier = cc_tier_find(queue_name, agent))) {
+		cc_tier_destroy(tier);
+	}
+	sql = switch_mprintf("DELETE FROM tiers WHERE queue = '%q' AND agent = '%q';", queue_name, agent);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	result = CC_STATUS_SUCCESS;
+
+	return result;
+}
+
+/* Tier states while an agent is offered a call from queue_name, call with acd_mutex held */
+static void cc_tier_offer_locked(cc_agent_t *agent, const char *queue_name)
+{
+	cc_tier_t *tier;
+	char *sql;
+
+	for (tier = agent->tiers; tier; tier = tier->agent_next) {
+		if (!strcmp(tier->roster->name, queue_name)) {
+			tier->state = CC_TIER_STATE_OFFERING;
+		} else if (tier->state == CC_TIER_STATE_READY) {
+			tier->state = CC_TIER_STATE_STANDBY;
+		}
+	}
+
+	sql = switch_mprintf(
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
+			cc_tier_state2str(CC_TIER_STATE_OFFERING), agent->name, queue_name,
+			cc_tier_state2str(CC_TIER_STATE_STANDBY), agent->name, queue_name, cc_tier_state2str(CC_TIER_STATE_READY));
+	cc_persist_sql(sql);
+}
+
+/* Make the agent available again in its tiers once done with a call from queue_name */
+static void cc_tier_release(const char *agent_name, const char *queue_name, cc_tier_state_t tiers_state)
+{
+	cc_agent_t *agent;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((agent = cc_agent_find(agent_name))) {
+		cc_tier_t *tier;
+
+		for (tier = agent->tiers; tier; tier = tier->agent_next) {
+			if (!strcmp(tier->roster->name, queue_name)) {
+				if (tier->state == CC_TIER_STATE_ACTIVE_INBOUND || tier->state == CC_TIER_STATE_STANDBY || tier->state == CC_TIER_STATE_OFFERING) {
+					tier->state = tiers_state;
+				}
+			} else if (tier->state == CC_TIER_STATE_STANDBY) {
+				tier->state = CC_TIER_STATE_READY;
+			}
+		}
+	}
+
+	sql = switch_mprintf(
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
+			, cc_tier_state2str(tiers_state), agent_name, queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
+			cc_tier_state2str(CC_TIER_STATE_READY), agent_name, queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+}
+
+/* An agent picked up a member's call */
+static void cc_agent_bridge_start(const char *agent_name, const char *agent_system, const char *agent_uuid)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_agent_t *agent;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((agent = cc_agent_find(agent_name)) && !strcmp(agent->instance_id, agent_system)) {
+		cc_str_set(&agent->uuid, agent_uuid);
+		agent->last_bridge_start = now;
+		agent->calls_answered++;
+		agent->no_answer_count = 0;
+	}
+	sql = switch_mprintf("UPDATE agents SET uuid = '%q', last_bridge_start = '%" SWITCH_TIME_T_FMT "', calls_answered = calls_answered + 1, no_answer_count = 0"
+			" WHERE name = '%q' AND instance_id = '%q'",
+			agent_uuid, now, agent_name, agent_system);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+}
+
+static void cc_agent_bridge_end(const char *agent_name, const char *agent_system, switch_bool_t keep_uuid)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_agent_t *agent;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((agent = cc_agent_find(agent_name)) && !strcmp(agent->instance_id, agent_system)) {
+		if (!keep_uuid) {
+			cc_str_set(&agent->uuid, NULL);
+		}
+		agent->last_bridge_end = now;
+		agent->talk_time += now - agent->last_bridge_start;
+	}
+	sql = switch_mprintf("UPDATE agents SET %s last_bridge_end = %" SWITCH_TIME_T_FMT ", talk_time = talk_time + (%" SWITCH_TIME_T_FMT "-last_bridge_start) WHERE name = '%q' AND instance_id = '%q';"
+			, (keep_uuid ? "" : "uuid = '',"), now, now, agent_name, agent_system);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+}
+
+static void cc_agent_no_answer(const char *agent_name, const char *agent_system)
+{
+	cc_agent_t *agent;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((agent = cc_agent_find(agent_name)) && !strcmp(agent->instance_id, agent_system)) {
+		agent->no_answer_count++;
+	}
+	sql = switch_mprintf("UPDATE agents SET no_answer_count = no_answer_count + 1 WHERE name = '%q' AND instance_id = '%q';",
+			agent_name, agent_system);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+}
+
+static void cc_agent_external_call(const char *agent_name, int delta)
+{
+	cc_agent_t *agent;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((agent = cc_agent_find(agent_name))) {
+		agent->external_calls_count += delta;
+	}
+	sql = switch_mprintf("UPDATE agents SET external_calls_count = external_calls_count %c 1 WHERE name = '%q'", delta > 0 ? '+' : '-', agent_name);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	if (delta < 0) {
+		cc_dispatch_wake();
+	}
+}
+
+static void cc_member_add(const char *queue_name, const char *member_uuid, const char *session_uuid, const char *cid_number, const char *cid_name,
+						  const char *system_epoch, int base_score, const char *serving_agent)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_member_t *member;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	member = cc_member_create(member_uuid);
+	cc_str_set(&member->session_uuid, session_uuid);
+	cc_str_set(&member->cid_number, cid_number);
+	cc_str_set(&member->cid_name, cid_name);
+	cc_str_set(&member->serving_agent, serving_agent);
+	member->system_epoch = atoll(system_epoch);
+	member->joined_epoch = now;
+	member->base_score = base_score;
+	member->state = CC_MEMBER_STATE_WAITING;
+	cc_roster_link_member(cc_roster_get(queue_name, SWITCH_TRUE), member);
+
+	sql = switch_mprintf("INSERT INTO members"
+			" (queue,instance_id,uuid,session_uuid,system_epoch,joined_epoch,base_score,skill_score,cid_number,cid_name,serving_agent,serving_system,state)"
+			" VALUES('%q','%q','%q','%q','%q','%" SWITCH_TIME_T_FMT "','%d','%d','%q','%q','%q','','%q')",
+			queue_name,
+			globals.cc_instance_id,
+			member_uuid,
+			session_uuid,
+			system_epoch,
+			now,
+			base_score,
+			0 /*TODO SKILL score*/,
+			cid_number,
+			cid_name,
+			serving_agent,
+			cc_member_state2str(CC_MEMBER_STATE_WAITING));
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	cc_dispatch_wake();
+}
+
+/* Take back the most recently abandoned place of this caller in the queue.  Returns its abandoned_epoch, 0 if none */
+static switch_time_t cc_member_resume(const char *queue_name, const char *cid_number, const char *session_uuid, char *member_uuid, size_t len)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	switch_time_t abandoned_epoch = 0;
+	cc_roster_t *roster;
+	cc_member_t *member, *found = NULL;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((roster = cc_roster_get(queue_name, SWITCH_FALSE))) {
+		for (member = roster->members; member; member = member->next) {
+			if (member->state == CC_MEMBER_STATE_ABANDONED && !strcmp(member->cid_number, cid_number) &&
+				(!found || member->abandoned_epoch > found->abandoned_epoch)) {
+				found = member;
+			}
+		}
+	}
+
+	if (found) {
+		abandoned_epoch = found->abandoned_epoch;
+		switch_copy_string(member_uuid, found->uuid, len);
+		cc_str_set(&found->session_uuid, session_uuid);
+		cc_str_set(&found->instance_id, globals.cc_instance_id);
+		found->state = CC_MEMBER_STATE_WAITING;
+		found->rejoined_epoch = now;
+
+		sql = switch_mprintf("UPDATE members SET session_uuid = '%q', state = '%q', rejoined_epoch = '%" SWITCH_TIME_T_FMT "', instance_id = '%q' WHERE uuid = '%q' AND state = '%q'",
+				session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), now, globals.cc_instance_id, found->uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
+		cc_persist_sql(sql);
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	if (found) {
+		cc_dispatch_wake();
+	}
+
+	return abandoned_epoch;
+}
+
+/* The member left the queue without an agent, if_not_abandoned keeps an earlier abandoned_epoch */
+static void cc_member_abandon(const char *member_uuid, switch_bool_t if_not_abandoned)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_member_t *member;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((member = cc_member_find(member_uuid)) && !(if_not_abandoned && member->state == CC_MEMBER_STATE_ABANDONED)) {
+		member->state = CC_MEMBER_STATE_ABANDONED;
+		member->abandoned_epoch = now;
+		cc_str_set(&member->session_uuid, NULL);
+	}
+
+	if (if_not_abandoned) {
+		sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q' AND state != '%q'",
+				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), now, member_uuid, globals.cc_instance_id, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
+	} else {
+		sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q'",
+				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), now, member_uuid, globals.cc_instance_id);
+	}
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+}
+
+/* Waiting when the agent went away before the bridge, Answered once bridged */
+static void cc_member_set_state(const char *member_uuid, cc_member_state_t state)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	cc_member_t *member;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((member = cc_member_find(member_uuid))) {
+		member->state = state;
+		if (state == CC_MEMBER_STATE_ANSWERED) {
+			member->bridge_epoch = now;
+		}
+	}
+
+	if (state == CC_MEMBER_STATE_ANSWERED) {
+		sql = switch_mprintf("UPDATE members SET state = '%q', bridge_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q'",
+				cc_member_state2str(state), now, member_uuid, globals.cc_instance_id);
+	} else {
+		sql = switch_mprintf("UPDATE members SET state = '%q' WHERE uuid = '%q' AND instance_id = '%q'", cc_member_state2str(state), member_uuid, globals.cc_instance_id);
+	}
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	if (state == CC_MEMBER_STATE_WAITING) {
+		cc_dispatch_wake();
+	}
+}
+
+/* First agent to answer a ring-all or ring-progressively member gets it */
+static switch_bool_t cc_member_claim(const char *member_uuid, const char *agent_name, const char *strategy)
+{
+	switch_bool_t won = SWITCH_FALSE;
+	cc_member_t *member;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((member = cc_member_find(member_uuid)) && member->state == CC_MEMBER_STATE_TRYING && !strcmp(member->serving_agent, strategy)) {
+		cc_str_set(&member->serving_agent, agent_name);
+		cc_str_set(&member->serving_system, "single_box");
+		won = SWITCH_TRUE;
+
+		sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = 'single_box', state = '%q'"
+				" WHERE state = '%q' AND uuid = '%q' AND instance_id = '%q' AND serving_agent = '%q'",
+				agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
+				cc_member_state2str(CC_MEMBER_STATE_TRYING), member_uuid, globals.cc_instance_id, strategy);
+		cc_persist_sql(sql);
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	return won;
 }
 
-cc_status_t cc_tier_del(const char *queue_name, const char *agent)
+/* The agent didn't get the member, put it back in line unless it was abandoned meanwhile */
+static void cc_member_release(const char *member_uuid, const char *agent_name, const char *agent_system)
 {
-	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_member_t *member;
 	char *sql;
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted tier Agent %s in Queue %s\n", agent, queue_name);
-	sql = switch_mprintf("DELETE FROM tiers WHERE queue = '%q' AND agent = '%q';", queue_name, agent);
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	switch_mutex_lock(globals.acd_mutex);
+	if ((member = cc_member_find(member_uuid)) && !strcmp(member->serving_agent, agent_name) && !strcmp(member->serving_system, agent_system)) {
+		if (member->state == CC_MEMBER_STATE_TRYING) {
+			member->state = CC_MEMBER_STATE_WAITING;
+		}
+		cc_str_set(&member->serving_agent, NULL);
+		cc_str_set(&member->serving_system, NULL);
+	}
 
-	result = CC_STATUS_SUCCESS;
+	sql = switch_mprintf("UPDATE members SET state = case state when '%q' then '%q' else state end, serving_agent = '', serving_system = ''"
+			" WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND instance_id = '%q'",
+			cc_member_state2str(CC_MEMBER_STATE_TRYING),	/* Only switch to Waiting from Trying (state may be set to Abandoned in callcenter_function()) */
+			cc_member_state2str(CC_MEMBER_STATE_WAITING),
+			agent_name, agent_system, member_uuid, globals.cc_instance_id);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
 
-	return result;
+	cc_dispatch_wake();
+}
+
+static void cc_member_del(const char *member_uuid)
+{
+	cc_member_t *member;
+	char *sql;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((member = cc_member_find(member_uuid))) {
+		cc_member_destroy(member);
+	}
+	sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q'", member_uuid, globals.cc_instance_id);
+	cc_persist_sql(sql);
+	switch_mutex_unlock(globals.acd_mutex);
 }
 
 static switch_status_t load_agent(const char *agent_name, switch_event_t *params, switch_xml_t x_agents_cfg)
@@ -1501,6 +2313,339 @@ static int sqlite_column_rename_callback(void *pArg, const char *errmsg)
 	return 0;
 }
 
+#define CC_AGENT_COLUMNS "name, instance_id, uuid, type, contact, status, state, max_no_answer, wrap_up_time, reject_delay_time," \
+	" busy_delay_time, no_answer_delay_time, last_bridge_start, last_bridge_end, last_offered_call, last_status_change," \
+	" no_answer_count, calls_answered, talk_time, ready_time, external_calls_count"
+#define CC_AGENT_COLUMN_COUNT 21
+#define CC_TIER_COLUMNS "queue, agent, state, level, position"
+#define CC_TIER_COLUMN_COUNT 5
+#define CC_MEMBER_COLUMNS "queue, instance_id, uuid, session_uuid, cid_number, cid_name, system_epoch, joined_epoch, rejoined_epoch, bridge_epoch," \
+	" abandoned_epoch, base_score, skill_score, serving_agent, serving_system, state"
+#define CC_MEMBER_COLUMN_COUNT 16
+
+/* Take over a column of CC_AGENT_COLUMNS, the name is the key */
+static void cc_agent_set_column(cc_agent_t *agent, int col, const char *val)
+{
+	switch (col) {
+	case 1:
+		cc_str_set(&agent->instance_id, val);
+		break;
+	case 2:
+		cc_str_set(&agent->uuid, val);
+		break;
+	case 3:
+		cc_str_set(&agent->type, val);
+		break;
+	case 4:
+		cc_str_set(&agent->contact, val);
+		break;
+	case 5:
+		agent->status = cc_agent_str2status(switch_str_nil(val));
+		break;
+	case 6:
+		agent->state = cc_agent_str2state(switch_str_nil(val));
+		break;
+	case 7:
+		agent->max_no_answer = atoi(switch_str_nil(val));
+		break;
+	case 8:
+		agent->wrap_up_time = atoi(switch_str_nil(val));
+		break;
+	case 9:
+		agent->reject_delay_time = atoi(switch_str_nil(val));
+		break;
+	case 10:
+		agent->busy_delay_time = atoi(switch_str_nil(val));
+		break;
+	case 11:
+		agent->no_answer_delay_time = atoi(switch_str_nil(val));
+		break;
+	case 12:
+		agent->last_bridge_start = atoll(switch_str_nil(val));
+		break;
+	case 13:
+		agent->last_bridge_end = atoll(switch_str_nil(val));
+		break;
+	case 14:
+		agent->last_offered_call = atoll(switch_str_nil(val));
+		break;
+	case 15:
+		agent->last_status_change = atoll(switch_str_nil(val));
+		break;
+	case 16:
+		agent->no_answer_count = atoi(switch_str_nil(val));
+		break;
+	case 17:
+		agent->calls_answered = atoi(switch_str_nil(val));
+		break;
+	case 18:
+		agent->talk_time = atoll(switch_str_nil(val));
+		break;
+	case 19:
+		agent->ready_time = atoll(switch_str_nil(val));
+		break;
+	case 20:
+		agent->external_calls_count = atoi(switch_str_nil(val));
+		break;
+	default:
+		break;
+	}
+}
+
+/* Take over a row of CC_MEMBER_COLUMNS but the queue, the caller links it into its roster */
+static void cc_member_set_row(cc_member_t *member, char **argv)
+{
+	cc_str_set(&member->instance_id, argv[1]);
+	cc_str_set(&member->session_uuid, argv[3]);
+	cc_str_set(&member->cid_number, argv[4]);
+	cc_str_set(&member->cid_name, argv[5]);
+	member->system_epoch = atoll(switch_str_nil(argv[6]));
+	member->joined_epoch = atoll(switch_str_nil(argv[7]));
+	member->rejoined_epoch = atoll(switch_str_nil(argv[8]));
+	member->bridge_epoch = atoll(switch_str_nil(argv[9]));
+	member->abandoned_epoch = atoll(switch_str_nil(argv[10]));
+	member->base_score = atoi(switch_str_nil(argv[11]));
+	member->skill_score = atoi(switch_str_nil(argv[12]));
+	cc_str_set(&member->serving_agent, argv[13]);
+	cc_str_set(&member->serving_system, argv[14]);
+	member->state = cc_member_str2state(switch_str_nil(argv[15]));
+}
+
+/* Rebuild the in-memory store from what the tables held before we started */
+static int load_agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_agent_t *agent;
+	int i;
+
+	if (argc < CC_AGENT_COLUMN_COUNT || zstr(argv[0]) || cc_agent_find(argv[0])) {
+		return 0;
+	}
+
+	agent = cc_agent_create(argv[0], argv[1], argv[3]);
+	for (i = 1; i < CC_AGENT_COLUMN_COUNT; i++) {
+		cc_agent_set_column(agent, i, argv[i]);
+	}
+	if (globals.shared_db) {
+		cc_seen_set(&agent->seen, CC_AGENT_COLUMN_COUNT, argv, 0);
+	}
+
+	return 0;
+}
+
+static int load_tiers_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_agent_t *agent;
+	cc_tier_t *tier;
+
+	if (argc < CC_TIER_COLUMN_COUNT || zstr(argv[0]) || zstr(argv[1]) || !(agent = cc_agent_find(argv[1])) || cc_tier_find(argv[0], argv[1])) {
+		return 0;
+	}
+
+	tier = cc_tier_create(cc_roster_get(argv[0], SWITCH_TRUE), agent, cc_tier_str2state(argv[2]), atoi(switch_str_nil(argv[3])), atoi(switch_str_nil(argv[4])));
+	if (globals.shared_db) {
+		cc_seen_set(&tier->seen, CC_TIER_COLUMN_COUNT, argv, 0);
+	}
+
+	return 0;
+}
+
+static int load_members_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_member_t *member;
+
+	if (argc < CC_MEMBER_COLUMN_COUNT || zstr(argv[0]) || zstr(argv[2]) || cc_member_find(argv[2])) {
+		return 0;
+	}
+
+	member = cc_member_create(argv[2]);
+	cc_member_set_row(member, argv);
+	cc_roster_link_member(cc_roster_get(argv[0], SWITCH_TRUE), member);
+
+	return 0;
+}
+
+struct cc_refresh {
+	uint32_t gen;
+	switch_bool_t changed;
+};
+
+static int refresh_agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	struct cc_refresh *refresh = (struct cc_refresh *) pArg;
+	cc_agent_t *agent;
+	int i;
+
+	if (argc < CC_AGENT_COLUMN_COUNT || zstr(argv[0])) {
+		return 0;
+	}
+
+	if (!(agent = cc_agent_find(argv[0]))) {
+		agent = cc_agent_create(argv[0], argv[1], argv[3]);
+		for (i = 1; i < CC_AGENT_COLUMN_COUNT; i++) {
+			cc_agent_set_column(agent, i, argv[i]);
+		}
+		refresh->changed = SWITCH_TRUE;
+	} else {
+		for (i = 1; i < CC_AGENT_COLUMN_COUNT; i++) {
+			if (cc_seen_changed(&agent->seen, i, argv[i])) {
+				cc_agent_set_column(agent, i, argv[i]);
+				refresh->changed = SWITCH_TRUE;
+			}
+		}
+	}
+	cc_seen_set(&agent->seen, CC_AGENT_COLUMN_COUNT, argv, refresh->gen);
+
+	return 0;
+}
+
+static int refresh_tiers_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	struct cc_refresh *refresh = (struct cc_refresh *) pArg;
+	cc_agent_t *agent;
+	cc_tier_t *tier;
+
+	if (argc < CC_TIER_COLUMN_COUNT || zstr(argv[0]) || zstr(argv[1]) || !(agent = cc_agent_find(argv[1]))) {
+		return 0;
+	}
+
+	if (!(tier = cc_tier_find(argv[0], argv[1]))) {
+		tier = cc_tier_create(cc_roster_get(argv[0], SWITCH_TRUE), agent, cc_tier_str2state(argv[2]), atoi(switch_str_nil(argv[3])), atoi(switch_str_nil(argv[4])));
+		refresh->changed = SWITCH_TRUE;
+	} else {
+		if (cc_seen_changed(&tier->seen, 2, argv[2])) {
+			tier->state = cc_tier_str2state(argv[2]);
+			refresh->changed = SWITCH_TRUE;
+		}
+		if (cc_seen_changed(&tier->seen, 3, argv[3]) || cc_seen_changed(&tier->seen, 4, argv[4])) {
+			if (cc_seen_changed(&tier->seen, 3, argv[3])) {
+				tier->level = atoi(switch_str_nil(argv[3]));
+			}
+			if (cc_seen_changed(&tier->seen, 4, argv[4])) {
+				tier->position = atoi(switch_str_nil(argv[4]));
+			}
+			cc_roster_unlink_tier(tier);
+			cc_roster_link_tier(tier->roster, tier);
+			refresh->changed = SWITCH_TRUE;
+		}
+	}
+	cc_seen_set(&tier->seen, CC_TIER_COLUMN_COUNT, argv, refresh->gen);
+
+	return 0;
+}
+
+/* Members of other boxes are never ours to change, their rows are taken as they are */
+static int refresh_members_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	struct cc_refresh *refresh = (struct cc_refresh *) pArg;
+	cc_roster_t *roster;
+	cc_member_t *member;
+
+	if (argc < CC_MEMBER_COLUMN_COUNT || zstr(argv[0]) || zstr(argv[2])) {
+		return 0;
+	}
+
+	roster = cc_roster_get(argv[0], SWITCH_TRUE);
+	if (!(member = cc_member_find(argv[2]))) {
+		member = cc_member_create(argv[2]);
+		cc_member_set_row(member, argv);
+		cc_roster_link_member(roster, member);
+	} else {
+		switch_time_t priority = cc_member_priority(member);
+
+		cc_member_set_row(member, argv);
+		if (member->roster != roster || cc_member_priority(member) != priority) {
+			cc_roster_unlink_member(member);
+			cc_roster_link_member(roster, member);
+		}
+	}
+	member->refreshed = refresh->gen;
+
+	return 0;
+}
+
+/* Bring in what the other boxes sharing the tables changed since the last reread.
+   Rows we read before and no longer find were deleted over there. */
+static void cc_shared_refresh(void)
+{
+	static uint32_t gen = 0;
+	struct cc_refresh refresh = { 0 };
+	switch_hash_index_t *hi;
+	cc_agent_t **agents = NULL;
+	cc_member_t **members = NULL;
+	int agent_count = 0, member_count = 0, size;
+	char *sql;
+	void *val;
+	int i;
+
+	refresh.gen = ++gen;
+
+	switch_mutex_lock(globals.acd_mutex);
+	cc_execute_sql_callback(NULL, globals.acd_mutex, "SELECT " CC_AGENT_COLUMNS " FROM agents", refresh_agents_callback, &refresh);
+	cc_execute_sql_callback(NULL, globals.acd_mutex, "SELECT " CC_TIER_COLUMNS " FROM tiers", refresh_tiers_callback, &refresh);
+	sql = switch_mprintf("SELECT " CC_MEMBER_COLUMNS " FROM members WHERE instance_id <> '%q'", globals.cc_instance_id);
+	cc_execute_sql_callback(NULL, globals.acd_mutex, sql, refresh_members_callback, &refresh);
+	switch_safe_free(sql);
+
+	size = 0;
+	for (hi = switch_core_hash_first(globals.agent_hash); hi; hi = switch_core_hash_next(&hi)) {
+		cc_agent_t *agent;
+		cc_tier_t *tier, *next;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		agent = (cc_agent_t *) val;
+
+		if (agent->seen.cols && agent->seen.gen != refresh.gen) {
+			if (agent_count == size) {
+				size = size ? size * 2 : 16;
+				agents = realloc(agents, size * sizeof(*agents));
+				switch_assert(agents);
+			}
+			agents[agent_count++] = agent;
+			continue;
+		}
+
+		for (tier = agent->tiers; tier; tier = next) {
+			next = tier->agent_next;
+			if (tier->seen.cols && tier->seen.gen != refresh.gen) {
+				cc_tier_destroy(tier);
+				refresh.changed = SWITCH_TRUE;
+			}
+		}
+	}
+	for (i = 0; i < agent_count; i++) {
+		cc_agent_destroy(agents[i]);
+		refresh.changed = SWITCH_TRUE;
+	}
+	switch_safe_free(agents);
+
+	size = 0;
+	for (hi = switch_core_hash_first(globals.member_hash); hi; hi = switch_core_hash_next(&hi)) {
+		cc_member_t *member;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		member = (cc_member_t *) val;
+
+		if (strcmp(member->instance_id, globals.cc_instance_id) && member->refreshed != refresh.gen) {
+			if (member_count == size) {
+				size = size ? size * 2 : 16;
+				members = realloc(members, size * sizeof(*members));
+				switch_assert(members);
+			}
+			members[member_count++] = member;
+		}
+	}
+	for (i = 0; i < member_count; i++) {
+		cc_member_destroy(members[i]);
+	}
+	switch_safe_free(members);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	/* Agents or tiers that became available to our members */
+	if (refresh.changed) {
+		cc_dispatch_wake();
+	}
+}
+
 static switch_status_t load_config(switch_memory_pool_t *pool)
 {
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
@@ -1545,6 +2690,7 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 	if (zstr(globals.dbname)) {
 		globals.dbname = strdup(CC_SQLITE_DB_NAME);
 	}
+	globals.shared_db = !zstr(globals.odbc_dsn);
 	if (zstr(globals.cc_instance_id)) {
 		globals.cc_instance_id = switch_core_strdup(pool, "single_box");
 	}
@@ -1618,6 +2764,21 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 		switch_safe_free(sql);
 	}
 
+	/* Whatever is left is ours to serve from memory from now on */
+	switch_mutex_lock(globals.acd_mutex);
+	cc_execute_sql_callback(NULL, NULL, "SELECT " CC_AGENT_COLUMNS " FROM agents", load_agents_callback, NULL);
+	cc_execute_sql_callback(NULL, NULL, "SELECT " CC_TIER_COLUMNS " FROM tiers", load_tiers_callback, NULL);
+	sql = switch_mprintf("SELECT " CC_MEMBER_COLUMNS " FROM members WHERE instance_id = '%q'", globals.cc_instance_id);
+	cc_execute_sql_callback(NULL, NULL, sql, load_members_callback, NULL);
+	switch_safe_free(sql);
+	switch_mutex_unlock(globals.acd_mutex);
+
+	/* From here on the tables are only written behind, unless other boxes share them */
+	if (!globals.shared_db) {
+		switch_sql_queue_manager_init_name("callcenter", &globals.qm, 1, globals.dbname, SWITCH_MAX_TRANS, NULL, NULL, NULL, NULL);
+		switch_sql_queue_manager_start(globals.qm);
+	}
+
 	/* Loading queue into memory struct */
 	if ((x_queues = switch_xml_child(cfg, "queues"))) {
 		for (x_queue = switch_xml_child(x_queues, "queue"); x_queue; x_queue = x_queue->next) {
@@ -1685,7 +2846,6 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 	switch_core_session_t *agent_session = NULL;
 	switch_call_cause_t cause = SWITCH_CAUSE_NONE;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	char *sql = NULL;
 	char *dialstr = NULL;
 	cc_tier_state_t tiers_state = CC_TIER_STATE_READY;
 	switch_core_session_t *member_session = switch_core_session_locate(h->member_session_uuid);
@@ -1705,11 +2865,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Member %s <%s> with uuid %s in queue %s is gone just before we assigned an agent\n", h->member_cid_name, h->member_cid_number, h->member_session_uuid, h->queue_name);
 		bridged = 0;
 
-		 sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q' AND state != '%q'",
-				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), h->member_uuid, globals.cc_instance_id, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
-
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_member_abandon(h->member_uuid, SWITCH_TRUE);
 		goto done;
 	}
 
@@ -1904,24 +3060,8 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		switch_channel_set_variable(agent_channel, "cc_member_pre_answer_uuid", NULL);
 
 		if (!strcasecmp(h->queue_strategy,"ring-all") || !strcasecmp(h->queue_strategy,"ring-progressively")) {
-			char res[256];
-			/* Map the Agent to the member */
-			sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = 'single_box', state = '%q'"
-					" WHERE state = '%q' AND uuid = '%q' AND instance_id = '%q' AND serving_agent = '%q'",
-					h->agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
-					cc_member_state2str(CC_MEMBER_STATE_TRYING), h->member_uuid, globals.cc_instance_id, h->queue_strategy);
-			cc_execute_sql(NULL, sql, NULL);
-
-			switch_safe_free(sql);
-
-			/* Check if we won the race to get the member to our selected agent (Used for Multi system purposes) */
-			sql = switch_mprintf("SELECT count(*) FROM members"
-					" WHERE serving_agent = '%q' AND serving_system = 'single_box' AND uuid = '%q' AND instance_id = '%q'",
-					h->agent_name, h->member_uuid, globals.cc_instance_id);
-			cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-			switch_safe_free(sql);
-
-			if (atoi(res) == 0) {
+			/* Map the Agent to the member, only if we won the race to get the member to our selected agent */
+			if (!cc_member_claim(h->member_uuid, h->agent_name, h->queue_strategy)) {
 				goto done;
 			}
 			switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", h->member_uuid, SWITCH_CAUSE_LOSE_RACE);
@@ -1992,10 +3132,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 			switch_channel_set_variable(member_channel, "cc_agent_bridged", "false");
 
 			/* Set member to Abandoned state, previous Trying */
-			sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q'",
-				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), h->member_uuid, globals.cc_instance_id);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_member_abandon(h->member_uuid, SWITCH_FALSE);
 
 			if ((o_announce = switch_channel_get_variable(member_channel, "cc_bridge_failed_outbound_announce"))) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Playing bridge failed audio to agent %s, audio: %s\n", h->agent_name, o_announce);
@@ -2008,9 +3145,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		} else if (!bridged && !switch_channel_up(agent_channel)) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Failed to bridge, agent %s has no session\n", h->agent_name);
 			/* Put back member on Waiting state, previous Trying */
-			sql = switch_mprintf("UPDATE members SET state = 'Waiting' WHERE uuid = '%q' AND instance_id = '%q'", h->member_uuid, globals.cc_instance_id);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_member_set_state(h->member_uuid, CC_MEMBER_STATE_WAITING);
 		} else {
 			bridged = 1;
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member \"%s\" %s is bridged to agent %s\n",
@@ -2020,10 +3155,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 			switch_channel_set_variable(agent_channel, "cc_agent_bridged", "true");
 
 			/* Update member to Answered state, previous Trying */
-			sql = switch_mprintf("UPDATE members SET state = '%q', bridge_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q'",
-					cc_member_state2str(CC_MEMBER_STATE_ANSWERED), local_epoch_time_now(NULL), h->member_uuid, globals.cc_instance_id);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_member_set_state(h->member_uuid, CC_MEMBER_STATE_ANSWERED);
 		}
 
 		if (bridged) {
@@ -2031,12 +3163,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 			switch_channel_set_variable(member_channel, "cc_agent", h->agent_name);
 			switch_channel_set_variable_printf(member_channel, "cc_queue_answered_epoch", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL));
 			/* Set UUID of the Agent channel */
-			sql = switch_mprintf("UPDATE agents SET uuid = '%q', last_bridge_start = '%" SWITCH_TIME_T_FMT "', calls_answered = calls_answered + 1, no_answer_count = 0"
-										 " WHERE name = '%q' AND instance_id = '%q'",
-								 agent_uuid, local_epoch_time_now(NULL),
-								 h->agent_name, h->agent_system);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_agent_bridge_start(h->agent_name, h->agent_system, agent_uuid);
 			/* Change the agents Status in the tiers */
 			cc_tier_update("state", cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), h->queue_name, h->agent_name);
 			cc_agent_update("state", cc_agent_state2str(CC_AGENT_STATE_IN_A_QUEUE_CALL), h->agent_name);
@@ -2084,15 +3211,10 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 			/* Update Agents Items */
 			/* Do not remove uuid of the agent if we are a standby agent */
-			sql = switch_mprintf("UPDATE agents SET %s last_bridge_end = %" SWITCH_TIME_T_FMT ", talk_time = talk_time + (%" SWITCH_TIME_T_FMT "-last_bridge_start) WHERE name = '%q' AND instance_id = '%q';"
-					, (strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY)?"uuid = '',":""), local_epoch_time_now(NULL), local_epoch_time_now(NULL), h->agent_name, h->agent_system);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_agent_bridge_end(h->agent_name, h->agent_system, !strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY));
 
 			/* Remove the member entry from the db (Could become optional to support latter processing) */
-			sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q'", h->member_uuid, globals.cc_instance_id);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_member_del(h->member_uuid);
 
 			/* Caller off event */
 			if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -2128,13 +3250,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		int delay_next_agent_call = 0;
 		switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
 		switch_channel_clear_app_flag_key(CC_APP_KEY, member_channel, CC_APP_AGENT_CONNECTING);
-		sql = switch_mprintf("UPDATE members SET state = case state when '%q' then '%q' else state end, serving_agent = '', serving_system = ''"
-				" WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND instance_id = '%q'",
-				cc_member_state2str(CC_MEMBER_STATE_TRYING),	/* Only switch to Waiting from Trying (state may be set to Abandoned in callcenter_function()) */
-				cc_member_state2str(CC_MEMBER_STATE_WAITING),
-				h->agent_name, h->agent_system, h->member_uuid, globals.cc_instance_id);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_member_release(h->member_uuid, h->agent_name, h->agent_system);
 		bridged = 0;
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Agent %s Origination Canceled : %s\n", h->agent_name, switch_channel_cause2str(cause));
 
@@ -2163,10 +3279,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 				tiers_state = CC_TIER_STATE_NO_ANSWER;
 
 				/* Update Agent NO Answer count */
-				sql = switch_mprintf("UPDATE agents SET no_answer_count = no_answer_count + 1 WHERE name = '%q' AND instance_id = '%q';",
-						h->agent_name, h->agent_system);
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
+				cc_agent_no_answer(h->agent_name, h->agent_system);
 
 				/* Change Agent Status because he didn't answer often */
 				if (h->max_no_answer > 0 && (h->no_answer_count + 1) >= h->max_no_answer) {
@@ -2216,13 +3329,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 done:
 	/* Make Agent Available Again */
-	sql = switch_mprintf(
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
-			, cc_tier_state2str(tiers_state), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
-			cc_tier_state2str(CC_TIER_STATE_READY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_tier_release(h->agent_name, h->queue_name, tiers_state);
 
 	/* If we are in Status Available On Demand, set state to Idle so we do not receive another call until state manually changed to Waiting */
 	if (!strcasecmp(cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND), h->agent_status) && bridged) {
@@ -2247,99 +3354,209 @@ done:
 	return NULL;
 }
 
-struct agent_callback {
-	const char *queue_name;
-	const char *system;
-	const char *member_uuid;
-	const char *member_session_uuid;
-	const char *member_cid_number;
-	const char *member_cid_name;
-	const char *member_joined_epoch;
-	const char *member_score;
-	const char *member_system;
-	const char *strategy;
-	const char *record_template;
+/* A queue with members waiting, its settings and the agents it may offer calls to as of this dispatch pass */
+struct cc_dispatch_queue {
+	cc_roster_t *roster;
+	cc_member_t *next;
+	switch_bool_t found;
+	char *strategy;
+	cc_strategy_t strategy_id;
+	char *record_template;
+	uint32_t ring_progressively_delay;
 	switch_bool_t tier_rules_apply;
 	uint32_t tier_rule_wait_second;
 	switch_bool_t tier_rule_wait_multiply_level;
 	switch_bool_t tier_rule_no_agent_no_wait;
-	switch_bool_t agent_found;
+	uint32_t discard_abandoned_after;
 	switch_bool_t skip_agents_with_external_calls;
 	cc_agent_status_t agent_no_answer_status;
+	/* Tiers of agents logged into the queue, in the order the strategy offers them */
+	cc_tier_t **tiers;
+	int tier_count;
+	switch_bool_t checked;
+	switch_bool_t agent_exist;
+};
+typedef struct cc_dispatch_queue cc_dispatch_queue_t;
+
+/* What a pass decided, acted upon once acd_mutex is released */
+struct cc_dispatch_pass {
+	struct call_helper *offers;
+	switch_event_t **events;
+	int event_count;
+	int event_size;
+};
+typedef struct cc_dispatch_pass cc_dispatch_pass_t;
 
+/* One member going through the agents of its queue */
+struct cc_dispatch_walk {
+	cc_dispatch_queue_t *dq;
+	cc_member_t *member;
 	int tier;
 	int tier_agent_available;
+	switch_bool_t agent_found;
 };
-typedef struct agent_callback agent_callback_t;
 
-static int agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+static void cc_dispatch_defer_event(cc_dispatch_pass_t *pass, switch_event_t **event)
 {
-	agent_callback_t *cbt = (agent_callback_t *) pArg;
-	char *sql = NULL;
-	char res[256];
-	const char *agent_system = argv[0];
-	const char *agent_name = argv[1];
-	const char *agent_status = argv[2];
-	const char *agent_originate_string = argv[3];
-	const char *agent_no_answer_count = argv[4];
-	const char *agent_max_no_answer = argv[5];
-	const char *agent_reject_delay_time = argv[6];
-	const char *agent_busy_delay_time = argv[7];
-	const char *agent_no_answer_delay_time = argv[8];
-	const char *agent_tier_state = argv[9];
-	const char *agent_last_bridge_end = argv[10];
-	const char *agent_wrap_up_time = argv[11];
-	const char *agent_state = argv[12];
-	const char *agent_ready_time = argv[13];
-	const char *agent_tier_position = argv[14];
-	const char *agent_tier_level = argv[15];
-	const char *agent_type = argv[16];
-	const char *agent_uuid = argv[17];
-	const char *agent_external_calls_count = argv[18];
+	if (!*event) {
+		return;
+	}
+
+	if (pass->event_count == pass->event_size) {
+		pass->event_size = pass->event_size ? pass->event_size * 2 : 16;
+		pass->events = realloc(pass->events, pass->event_size * sizeof(*pass->events));
+		switch_assert(pass->events);
+	}
+
+	pass->events[pass->event_count++] = *event;
+	*event = NULL;
+}
+
+static int cc_dispatch_cmp_position(const void *a, const void *b)
+{
+	const cc_tier_t *ta = *(cc_tier_t * const *) a;
+	const cc_tier_t *tb = *(cc_tier_t * const *) b;
+	int r;
+
+	if ((r = cc_tier_cmp_level(ta, tb))) {
+		return r;
+	}
+	if (ta->agent->last_offered_call != tb->agent->last_offered_call) {
+		return ta->agent->last_offered_call < tb->agent->last_offered_call ? -1 : 1;
+	}
+	return 0;
+}
+
+/* level, then the given agent counter, then position */
+#define CC_DISPATCH_CMP_BY(_name, _field)								\
+	static int cc_dispatch_cmp_##_name(const void *a, const void *b)	\
+	{																	\
+		const cc_tier_t *ta = *(cc_tier_t * const *) a;					\
+		const cc_tier_t *tb = *(cc_tier_t * const *) b;					\
+		if (ta->level != tb->level) {									\
+			return ta->level < tb->level ? -1 : 1;						\
+		}																\
+		if (ta->agent->_field != tb->agent->_field) {					\
+			return ta->agent->_field < tb->agent->_field ? -1 : 1;		\
+		}																\
+		if (ta->position != tb->position) {								\
+			return ta->position < tb->position ? -1 : 1;				\
+		}																\
+		return 0;														\
+	}
+
+CC_DISPATCH_CMP_BY(idle, last_bridge_end)
+CC_DISPATCH_CMP_BY(talk, talk_time)
+CC_DISPATCH_CMP_BY(calls, calls_answered)
+
+static int cc_dispatch_cmp_random(const void *a, const void *b)
+{
+	const cc_tier_t *ta = *(cc_tier_t * const *) a;
+	const cc_tier_t *tb = *(cc_tier_t * const *) b;
+
+	if (ta->level != tb->level) {
+		return ta->level < tb->level ? -1 : 1;
+	}
+	if (ta->sort_key != tb->sort_key) {
+		return ta->sort_key < tb->sort_key ? -1 : 1;
+	}
+	return 0;
+}
+
+/* Call with acd_mutex held */
+static void cc_dispatch_sort_tiers(cc_dispatch_queue_t *dq)
+{
+	cc_roster_t *roster = dq->roster;
+	int i;
+
+	dq->tier_count = 0;
+	if (!roster->tier_count) {
+		return;
+	}
+
+	dq->tiers = malloc(roster->tier_count * sizeof(*dq->tiers));
+	switch_assert(dq->tiers);
+
+	for (i = 0; i < roster->tier_count; i++) {
+		cc_tier_t *tier = roster->tiers[i];
+		cc_agent_status_t status = tier->agent->status;
+
+		if (status == CC_AGENT_STATUS_AVAILABLE || status == CC_AGENT_STATUS_ON_BREAK || status == CC_AGENT_STATUS_AVAILABLE_ON_DEMAND) {
+			tier->sort_key = rand();
+			dq->tiers[dq->tier_count++] = tier;
+		}
+	}
+
+	switch (dq->strategy_id) {
+	case CC_STRATEGY_LONGEST_IDLE_AGENT:
+		qsort(dq->tiers, dq->tier_count, sizeof(*dq->tiers), cc_dispatch_cmp_idle);
+		break;
+	case CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME:
+		qsort(dq->tiers, dq->tier_count, sizeof(*dq->tiers), cc_dispatch_cmp_talk);
+		break;
+	case CC_STRATEGY_AGENT_WITH_FEWEST_CALLS:
+		qsort(dq->tiers, dq->tier_count, sizeof(*dq->tiers), cc_dispatch_cmp_calls);
+		break;
+	case CC_STRATEGY_RANDOM:
+		qsort(dq->tiers, dq->tier_count, sizeof(*dq->tiers), cc_dispatch_cmp_random);
+		break;
+	default:
+		/* Default to last_offered_call, let add new strategy if needing it differently */
+		qsort(dq->tiers, dq->tier_count, sizeof(*dq->tiers), cc_dispatch_cmp_position);
+		break;
+	}
+}
 
+/* Offer the member to the agent of this tier if it can take it.  Returns non zero to stop looking for more agents */
+static int cc_dispatch_offer(cc_dispatch_pass_t *pass, struct cc_dispatch_walk *walk, cc_tier_t *tier, switch_time_t now)
+{
+	cc_dispatch_queue_t *dq = walk->dq;
+	cc_member_t *member = walk->member;
+	cc_agent_t *agent = tier->agent;
 	switch_bool_t contact_agent = SWITCH_TRUE;
+	switch_event_t *event = NULL;
+	switch_memory_pool_t *pool;
+	struct call_helper *h;
 
-	cbt->agent_found = SWITCH_TRUE;
+	walk->agent_found = SWITCH_TRUE;
 
 	/* Check if we switch to a different tier, if so, check if we should continue further for that member */
-
-	if (cbt->tier_rules_apply == SWITCH_TRUE && atoi(agent_tier_level) > cbt->tier) {
+	if (dq->tier_rules_apply == SWITCH_TRUE && tier->level > walk->tier) {
 		/* Continue if no agent was logged in in the previous tier and noagent = true */
-		if (cbt->tier_rule_no_agent_no_wait == SWITCH_TRUE && cbt->tier_agent_available == 0) {
-			cbt->tier = atoi(agent_tier_level);
+		if (dq->tier_rule_no_agent_no_wait == SWITCH_TRUE && walk->tier_agent_available == 0) {
+			walk->tier = tier->level;
 			/* Multiple the tier level by the tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_TRUE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= atoi(agent_tier_level) * (int)cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
-			cbt->tier_agent_available = 0;
+		} else if (dq->tier_rule_wait_multiply_level == SWITCH_TRUE && now - member->joined_epoch >= tier->level * (int) dq->tier_rule_wait_second) {
+			walk->tier = tier->level;
+			walk->tier_agent_available = 0;
 			/* Just check if joined is bigger than next tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_FALSE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= (int)cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
-			cbt->tier_agent_available = 0;
+		} else if (dq->tier_rule_wait_multiply_level == SWITCH_FALSE && now - member->joined_epoch >= (int) dq->tier_rule_wait_second) {
+			walk->tier = tier->level;
+			walk->tier_agent_available = 0;
 		} else {
 			/* We are not allowed to continue to the next tier of agent */
 			return 1;
 		}
 	}
-	cbt->tier_agent_available++;
+	walk->tier_agent_available++;
 
 	/* If Agent is not in a acceptable tier state, continue */
-	if (! (!strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_NO_ANSWER)) || !strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_READY)))) {
+	if (!(tier->state == CC_TIER_STATE_NO_ANSWER || tier->state == CC_TIER_STATE_READY)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (!strcasecmp(agent_state, cc_agent_state2str(CC_AGENT_STATE_WAITING)))) {
+	if (agent->state != CC_AGENT_STATE_WAITING) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (atol(agent_last_bridge_end) < ((long) local_epoch_time_now(NULL) - atol(agent_wrap_up_time)))) {
+	if (!(agent->last_bridge_end < now - agent->wrap_up_time)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (atol(agent_ready_time) <= (long) local_epoch_time_now(NULL))) {
+	if (!(agent->ready_time <= now)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (strcasecmp(agent_status, cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK)))) {
+	if (agent->status == CC_AGENT_STATUS_ON_BREAK) {
 		contact_agent = SWITCH_FALSE;
 	}
-	/* XXX callcenter_track app can update this counter after we selected this agent on database */
-	if (cbt->skip_agents_with_external_calls && atoi(agent_external_calls_count) > 0) {
+	if (dq->skip_agents_with_external_calls && agent->external_calls_count > 0) {
 		contact_agent = SWITCH_FALSE;
 	}
 	if (contact_agent == SWITCH_FALSE) {
@@ -2347,8 +3564,8 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 	}
 
 	/* If agent isn't on this box */
-	if (strcasecmp(agent_system,"single_box" /* SELF */)) {
-		if (!strcasecmp(cbt->strategy, "ring-all")) {
+	if (strcasecmp(agent->instance_id, "single_box" /* SELF */)) {
+		if (dq->strategy_id == CC_STRATEGY_RING_ALL) {
 			return 1; /* Abort finding agent for member if we found a match but for a different Server */
 		} else {
 			return 0; /* Skip this Agents only, so we can ring the other one */
@@ -2356,402 +3573,430 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 	}
 
 	if (globals.reserve_agents) {
-		/* Updating agent state to Reserved only if it was Waiting previously, this is done to avoid race conditions
-		   when updating agents table with external applications */
-		if (cc_agent_update("state_if_waiting", cc_agent_state2str(CC_AGENT_STATE_RESERVED), agent_name) == CC_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Reserved Agent %s\n", agent_name);
+		/* Updating agent state to Reserved only if it was Waiting previously */
+		if (cc_agent_update_locked("state_if_waiting", cc_agent_state2str(CC_AGENT_STATE_RESERVED), agent->name, &event, NULL) == CC_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Reserved Agent %s\n", agent->name);
+			cc_dispatch_defer_event(pass, &event);
 		} else {
-			/* Agent changed state just before we tried to update his state to Reserved. */
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Failed to Reserve Agent: %s. Skipping...\n", agent_name);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Failed to Reserve Agent: %s. Skipping...\n", agent->name);
 			return 0;
 		}
 	}
 
-	if (!strcasecmp(cbt->strategy,"ring-all") || !strcasecmp(cbt->strategy,"ring-progressively")) {
+	if (dq->strategy_id == CC_STRATEGY_RING_ALL || dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY) {
 		/* Check if member is a ring-all mode */
-		sql = switch_mprintf("SELECT count(*) FROM members WHERE serving_agent = '%q' AND uuid = '%q' AND instance_id = '%q'", cbt->strategy, cbt->member_uuid, globals.cc_instance_id);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-
-		switch_safe_free(sql);
+		if (strcmp(member->serving_agent, dq->strategy)) {
+			return 1;
+		}
 	} else {
+		char *sql;
+
+		/* Someone else took it, or user hanged up already */
+		if (member->state != CC_MEMBER_STATE_WAITING) {
+			return 1;
+		}
+
 		/* Map the Agent to the member */
+		cc_str_set(&member->serving_agent, agent->name);
+		cc_str_set(&member->serving_system, agent->instance_id);
+		member->state = CC_MEMBER_STATE_TRYING;
 		sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = '%q', state = '%q'"
 				" WHERE state = '%q' AND uuid = '%q' AND instance_id = '%q'",
-				agent_name, agent_system, cc_member_state2str(CC_MEMBER_STATE_TRYING),
-				cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt->member_uuid, globals.cc_instance_id);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		/* Check if we won the race to get the member to our selected agent (Used for Multi system purposes) */
-		sql = switch_mprintf("SELECT count(*) FROM members WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND instance_id = '%q'",
-				agent_name, agent_system, cbt->member_uuid, globals.cc_instance_id);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+				agent->name, agent->instance_id, cc_member_state2str(CC_MEMBER_STATE_TRYING),
+				cc_member_state2str(CC_MEMBER_STATE_WAITING), member->uuid, globals.cc_instance_id);
+		cc_persist_sql(sql);
 	}
 
-	switch (atoi(res)) {
-		case 0: /* Ok, someone else took it, or user hanged up already */
-			return 1;
-			/* We default to default even if more entry is returned... Should never happen	anyway */
-		default: /* Go ahead, start thread to try to bridge these 2 caller */
-			{
-				switch_thread_t *thread;
-				switch_threadattr_t *thd_attr = NULL;
-				switch_memory_pool_t *pool;
-				struct call_helper *h;
-
-				switch_core_new_memory_pool(&pool);
-				h = switch_core_alloc(pool, sizeof(*h));
-				h->pool = pool;
-				h->member_uuid = switch_core_strdup(h->pool, cbt->member_uuid);
-				h->member_session_uuid = switch_core_strdup(h->pool, cbt->member_session_uuid);
-				h->queue_strategy = switch_core_strdup(h->pool, cbt->strategy);
-				h->originate_string = switch_core_strdup(h->pool, agent_originate_string);
-				h->agent_name = switch_core_strdup(h->pool, agent_name);
-				h->agent_system = switch_core_strdup(h->pool, agent_system);
-				h->agent_status = switch_core_strdup(h->pool, agent_status);
-				h->agent_type = switch_core_strdup(h->pool, agent_type);
-				h->agent_uuid = switch_core_strdup(h->pool, agent_uuid);
-				h->member_joined_epoch = switch_core_strdup(h->pool, cbt->member_joined_epoch);
-				h->member_cid_name = switch_core_strdup(h->pool, cbt->member_cid_name);
-				h->member_cid_number = switch_core_strdup(h->pool, cbt->member_cid_number);
-				h->queue_name = switch_core_strdup(h->pool, cbt->queue_name);
-				h->record_template = switch_core_strdup(h->pool, cbt->record_template);
-				h->no_answer_count = atoi(agent_no_answer_count);
-				h->max_no_answer = atoi(agent_max_no_answer);
-				h->reject_delay_time = atoi(agent_reject_delay_time);
-				h->busy_delay_time = atoi(agent_busy_delay_time);
-				h->no_answer_delay_time = atoi(agent_no_answer_delay_time);
-				h->agent_no_answer_status = cbt->agent_no_answer_status;
-
-				if (!strcasecmp(cbt->strategy, "ring-progressively")) {
-					switch_core_session_t *member_session = switch_core_session_locate(cbt->member_session_uuid);
-					if (member_session) {
-						switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-						switch_channel_set_variable_printf(member_channel, "cc_last_originated_call", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL));
-						switch_core_session_rwunlock(member_session);
-					}
-				}
+	/* Go ahead, start thread to try to bridge these 2 caller once the pass is over */
+	switch_core_new_memory_pool(&pool);
+	h = switch_core_alloc(pool, sizeof(*h));
+	h->pool = pool;
+	h->member_uuid = switch_core_strdup(h->pool, member->uuid);
+	h->member_session_uuid = switch_core_strdup(h->pool, member->session_uuid);
+	h->queue_strategy = switch_core_strdup(h->pool, dq->strategy);
+	h->originate_string = switch_core_strdup(h->pool, agent->contact);
+	h->agent_name = switch_core_strdup(h->pool, agent->name);
+	h->agent_system = switch_core_strdup(h->pool, agent->instance_id);
+	h->agent_status = switch_core_strdup(h->pool, cc_agent_status2str(agent->status));
+	h->agent_type = switch_core_strdup(h->pool, agent->type);
+	h->agent_uuid = switch_core_strdup(h->pool, agent->uuid);
+	h->member_joined_epoch = switch_core_sprintf(h->pool, "%" SWITCH_TIME_T_FMT, member->joined_epoch);
+	h->member_cid_name = switch_core_strdup(h->pool, member->cid_name);
+	h->member_cid_number = switch_core_strdup(h->pool, member->cid_number);
+	h->queue_name = switch_core_strdup(h->pool, dq->roster->name);
+	h->record_template = dq->record_template ? switch_core_strdup(h->pool, dq->record_template) : NULL;
+	h->no_answer_count = agent->no_answer_count;
+	h->max_no_answer = agent->max_no_answer;
+	h->reject_delay_time = agent->reject_delay_time;
+	h->busy_delay_time = agent->busy_delay_time;
+	h->no_answer_delay_time = agent->no_answer_delay_time;
+	h->agent_tier_level = tier->level;
+	h->agent_tier_position = tier->position;
+	h->agent_no_answer_status = dq->agent_no_answer_status;
+
+	if (dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY) {
+		member->last_originated_call = now;
+	} else if (dq->strategy_id == CC_STRATEGY_TOP_DOWN) {
+		member->last_tier_level = tier->level;
+		member->last_tier_position = tier->position;
+	}
+
+	cc_agent_update_locked("state", cc_agent_state2str(CC_AGENT_STATE_RECEIVING), agent->name, &event, NULL);
+	cc_dispatch_defer_event(pass, &event);
+	cc_tier_offer_locked(agent, dq->roster->name);
+
+	h->next = pass->offers;
+	pass->offers = h;
+
+	if (dq->strategy_id == CC_STRATEGY_RING_ALL) {
+		return 0;
+	}
+
+	return 1;
+}
 
-				if (!strcasecmp(cbt->strategy, "top-down")) {
-					switch_core_session_t *member_session = switch_core_session_locate(cbt->member_session_uuid);
-					if (member_session) {
-						switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_position", agent_tier_position);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_level", agent_tier_level);
-						switch_core_session_rwunlock(member_session);
-					}
-				}
-				cc_agent_update("state", cc_agent_state2str(CC_AGENT_STATE_RECEIVING), h->agent_name);
-
-				sql = switch_mprintf(
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
-						cc_tier_state2str(CC_TIER_STATE_OFFERING), h->agent_name, h->queue_name,
-						cc_tier_state2str(CC_TIER_STATE_STANDBY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_READY));
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
-
-				switch_threadattr_create(&thd_attr, h->pool);
-				switch_threadattr_detach_set(thd_attr, 1);
-				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				switch_thread_create(&thread, thd_attr, outbound_agent_thread_run, h, h->pool);
-			}
+/* The member follows the queue to a different ring strategy */
+static void cc_member_retarget(cc_member_t *member, const char *from_agent, cc_member_state_t from_state, const char *to_agent, cc_member_state_t to_state)
+{
+	char *sql;
 
-			if (!strcasecmp(cbt->strategy,"ring-all")) {
-				return 0;
-			} else if (!strcasecmp(cbt->strategy,"ring-progressively")) {
-				return 1;
-			} else {
-				return 1;
-			}
+	if (member->state == from_state && !strcmp(member->serving_agent, from_agent)) {
+		cc_str_set(&member->serving_agent, to_agent);
+		member->state = to_state;
 	}
+
+	sql = switch_mprintf("UPDATE members SET serving_agent = '%q', state = '%q' WHERE uuid = '%q' AND state = '%q' AND serving_agent = '%q'",
+			to_agent, cc_member_state2str(to_state), member->uuid, cc_member_state2str(from_state), from_agent);
+	cc_persist_sql(sql);
 }
 
-static int members_callback(void *pArg, int argc, char **argv, char **columnNames)
+/* Find an agent for one member, call with acd_mutex held.  The member may be gone when this returns */
+static void cc_dispatch_member(cc_dispatch_pass_t *pass, cc_dispatch_queue_t *dq, cc_member_t *member, switch_time_t now)
 {
-	cc_queue_t *queue = NULL;
-	char *sql = NULL;
-	char *sql_order_by = NULL;
-	char *queue_name = NULL;
-	char *queue_strategy = NULL;
-	char *queue_record_template = NULL;
-	uint32_t ring_progressively_delay = 10; /* default ring-progressively-delay set to 10 seconds */
-	switch_bool_t tier_rules_apply;
-	uint32_t tier_rule_wait_second;
-	switch_bool_t tier_rule_wait_multiply_level;
-	switch_bool_t tier_rule_no_agent_no_wait;
-	uint32_t discard_abandoned_after;
-	agent_callback_t cbt;
-	const char *member_state = NULL;
-	const char *member_abandoned_epoch = NULL;
-	const char *serving_agent = NULL;
-	const char *last_originated_call = NULL;
-	memset(&cbt, 0, sizeof(cbt));
-
-	cbt.queue_name = argv[0];
-	cbt.member_uuid = argv[1];
-	cbt.member_session_uuid = argv[2];
-	cbt.member_cid_number = argv[3];
-	cbt.member_cid_name = argv[4];
-	cbt.member_joined_epoch = argv[5];
-	cbt.member_score = argv[6];
-	member_state = argv[7];
-	member_abandoned_epoch = argv[8];
-	serving_agent = argv[9];
-	cbt.member_system = argv[10];
-
-	if (!cbt.queue_name || !(queue = get_queue(cbt.queue_name))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Queue %s not found locally, delete this member\n", cbt.queue_name);
-		sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q'", cbt.member_uuid, cbt.member_system);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-		goto end;
-	} else {
-		queue_name = strdup(queue->name);
-		queue_strategy = strdup(queue->strategy);
-		tier_rules_apply = queue->tier_rules_apply;
-		tier_rule_wait_second = queue->tier_rule_wait_second;
-		tier_rule_wait_multiply_level = queue->tier_rule_wait_multiply_level;
-		tier_rule_no_agent_no_wait = queue->tier_rule_no_agent_no_wait;
-		discard_abandoned_after = queue->discard_abandoned_after;
-		if (queue->ring_progressively_delay) {
-			ring_progressively_delay = queue->ring_progressively_delay;
-		}
-
-		if (queue->record_template) {
-			queue_record_template = strdup(queue->record_template);
-		}
-
-		cbt.skip_agents_with_external_calls = queue->skip_agents_with_external_calls;
-		cbt.agent_no_answer_status = cc_agent_str2status(queue->agent_no_answer_status);
+	struct cc_dispatch_walk walk = { 0 };
+	char *sql;
+	int i;
 
-		queue_rwunlock(queue);
+	if (!dq->found) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Queue %s not found locally, delete this member\n", dq->roster->name);
+		sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q'", member->uuid, member->instance_id);
+		cc_persist_sql(sql);
+		cc_member_destroy(member);
+		return;
 	}
 
-	/* Checking for cleanup Abandonded calls from the db */
-	if (!strcasecmp(member_state, cc_member_state2str(CC_MEMBER_STATE_ABANDONED))) {
-		switch_time_t abandoned_epoch = atoll(member_abandoned_epoch);
+	/* Checking for cleanup Abandonded calls */
+	if (member->state == CC_MEMBER_STATE_ABANDONED) {
+		switch_time_t abandoned_epoch = member->abandoned_epoch;
 		if (abandoned_epoch == 0) {
-			abandoned_epoch = atoll(cbt.member_joined_epoch);
+			abandoned_epoch = member->joined_epoch;
 		}
 		/* Once we pass a certain point, we want to get rid of the abandoned call */
-		if (abandoned_epoch + discard_abandoned_after < local_epoch_time_now(NULL)) {
-			sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q' AND (abandoned_epoch = '%" SWITCH_TIME_T_FMT "' OR joined_epoch = '%q')", cbt.member_uuid, cbt.member_system, abandoned_epoch, cbt.member_joined_epoch);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+		if (abandoned_epoch + dq->discard_abandoned_after < now) {
+			sql = switch_mprintf("DELETE FROM members WHERE uuid = '%q' AND instance_id = '%q' AND (abandoned_epoch = '%" SWITCH_TIME_T_FMT "' OR joined_epoch = '%" SWITCH_TIME_T_FMT "')",
+					member->uuid, member->instance_id, abandoned_epoch, member->joined_epoch);
+			cc_persist_sql(sql);
+			cc_member_destroy(member);
 		}
 		/* Skip this member */
-		goto end;
+		return;
 	}
 
 	/* Tracking queue strategy changes */
 	/* member is ring-all but not the queue */
-	if (!strcasecmp(serving_agent, "ring-all") && (strcasecmp(queue_strategy, "ring-all") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
+	if (!strcmp(member->serving_agent, "ring-all") && dq->strategy_id != CC_STRATEGY_RING_ALL) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", dq->roster->name);
 		/* member was ring-all, becomes ring-progressively (no state change because of strategy similarities) */
-		if (!strcasecmp(queue_strategy, "ring-progressively")) {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-progressively' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-all'", cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+		if (dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY) {
+			cc_member_retarget(member, "ring-all", CC_MEMBER_STATE_TRYING, "ring-progressively", CC_MEMBER_STATE_TRYING);
 		} else {
-			sql = switch_mprintf("UPDATE members SET serving_agent = '', state = '%q' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-all'", cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+			cc_member_retarget(member, "ring-all", CC_MEMBER_STATE_TRYING, "", CC_MEMBER_STATE_WAITING);
 		}
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
 	}
 	/* member is ring-progressively but not the queue */
-	else if (!strcasecmp(serving_agent, "ring-progressively") && (strcasecmp(queue_strategy, "ring-progressively") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
+	else if (!strcmp(member->serving_agent, "ring-progressively") && dq->strategy_id != CC_STRATEGY_RING_PROGRESSIVELY) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", dq->roster->name);
 		/* member was ring-progressively, becomes ring-all (no state change because of strategy similarities) */
-		if (!strcasecmp(queue_strategy, "ring-all")) {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-all' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-progressively'", cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+		if (dq->strategy_id == CC_STRATEGY_RING_ALL) {
+			cc_member_retarget(member, "ring-progressively", CC_MEMBER_STATE_TRYING, "ring-all", CC_MEMBER_STATE_TRYING);
 		} else {
-			sql = switch_mprintf("UPDATE members SET serving_agent = '', state = '%q' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-progressively'", cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+			cc_member_retarget(member, "ring-progressively", CC_MEMBER_STATE_TRYING, "", CC_MEMBER_STATE_WAITING);
 		}
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
 	}
 	/* Queue is now ring-all and not the member */
-	else if (!strcasecmp(queue_strategy, "ring-all") && (strcasecmp(serving_agent, "ring-all") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
+	else if (dq->strategy_id == CC_STRATEGY_RING_ALL && strcmp(member->serving_agent, "ring-all")) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", dq->roster->name);
 		/* member was ring-progressively, its state is already set to TRYING */
-		if (!strcasecmp(serving_agent, "ring-progressively")) {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-all' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-progressively'", cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+		if (!strcmp(member->serving_agent, "ring-progressively")) {
+			cc_member_retarget(member, "ring-progressively", CC_MEMBER_STATE_TRYING, "ring-all", CC_MEMBER_STATE_TRYING);
 		} else {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-all', state = '%q' WHERE uuid = '%q' AND state = '%q' AND serving_agent = ''", cc_member_state2str(CC_MEMBER_STATE_TRYING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING));
-		}
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+			cc_member_retarget(member, "", CC_MEMBER_STATE_WAITING, "ring-all", CC_MEMBER_STATE_TRYING);
+		}
 	}
 	/* Queue is now ring-progressively and not the member */
-	else if (!strcasecmp(queue_strategy, "ring-progressively") && (strcasecmp(serving_agent, "ring-progressively") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
+	else if (dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY && strcmp(member->serving_agent, "ring-progressively")) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", dq->roster->name);
 		/* member was ring-all, its state is already set to TRYING */
-		if (!strcasecmp(serving_agent, "ring-all")) {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-progressively' WHERE uuid = '%q' AND state = '%q' AND serving_agent = 'ring-all'", cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
+		if (!strcmp(member->serving_agent, "ring-all")) {
+			cc_member_retarget(member, "ring-all", CC_MEMBER_STATE_TRYING, "ring-progressively", CC_MEMBER_STATE_TRYING);
 		} else {
-			sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-progressively', state = '%q' WHERE uuid = '%q' AND state = '%q' AND serving_agent = ''", cc_member_state2str(CC_MEMBER_STATE_TRYING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING));
+			cc_member_retarget(member, "", CC_MEMBER_STATE_WAITING, "ring-progressively", CC_MEMBER_STATE_TRYING);
 		}
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
 	}
 
 	/* Check if member is in the queue waiting */
-	if (zstr(cbt.member_session_uuid)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Member %s <%s> in Queue %s have no session uuid, skip this member\n", cbt.member_cid_name, cbt.member_cid_number, cbt.queue_name);
+	if (zstr(member->session_uuid)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Member %s <%s> in Queue %s have no session uuid, skip this member\n", member->cid_name, member->cid_number, dq->roster->name);
 	}
 
-	cbt.tier = 0;
-	cbt.tier_agent_available = 0;
+	walk.dq = dq;
+	walk.member = member;
 
-	cbt.tier_rules_apply = tier_rules_apply;
-	cbt.tier_rule_wait_second = tier_rule_wait_second;
-	cbt.tier_rule_wait_multiply_level = tier_rule_wait_multiply_level;
-	cbt.tier_rule_no_agent_no_wait = tier_rule_no_agent_no_wait;
+	if (dq->strategy_id == CC_STRATEGY_RING_ALL || dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY) {
+		if (member->state == CC_MEMBER_STATE_WAITING) {
+			member->state = CC_MEMBER_STATE_TRYING;
+			sql = switch_mprintf("UPDATE members SET state = '%q' WHERE state = '%q' AND uuid = '%q' AND instance_id = '%q'",
+					cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_WAITING), member->uuid, member->instance_id);
+			cc_persist_sql(sql);
+		}
 
-	cbt.strategy = queue_strategy;
-	cbt.record_template = queue_record_template;
-	cbt.agent_found = SWITCH_FALSE;
+		/* Give the agent rung last some time before ringing the next one */
+		if (dq->strategy_id == CC_STRATEGY_RING_PROGRESSIVELY && member->last_originated_call && now < member->last_originated_call + dq->ring_progressively_delay) {
+			return;
+		}
+	}
 
-	if (!strcasecmp(queue->strategy, "top-down")) {
-		/* WARNING this use channel variable to help dispatch... might need to be reviewed to save it in DB to make this multi server prooft in the future */
-		switch_core_session_t *member_session = switch_core_session_locate(cbt.member_session_uuid);
-		int position = 0, level = 0;
-		const char *last_agent_tier_position, *last_agent_tier_level;
-		if (member_session) {
-			switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
+	if (dq->strategy_id == CC_STRATEGY_TOP_DOWN) {
+		int level = member->last_tier_level, position = member->last_tier_position;
 
-			if ((last_agent_tier_position = switch_channel_get_variable(member_channel, "cc_last_agent_tier_position"))) {
-				position = atoi(last_agent_tier_position);
+		/* The rest of the level we stopped at, then the levels after it */
+		for (i = 0; i < dq->tier_count; i++) {
+			if (dq->tiers[i]->level == level && dq->tiers[i]->position > position && cc_dispatch_offer(pass, &walk, dq->tiers[i], now)) {
+				goto walked;
 			}
-			if ((last_agent_tier_level = switch_channel_get_variable(member_channel, "cc_last_agent_tier_level"))) {
-				level = atoi(last_agent_tier_level);
+		}
+		for (i = 0; i < dq->tier_count; i++) {
+			if (dq->tiers[i]->level > level && cc_dispatch_offer(pass, &walk, dq->tiers[i], now)) {
+				goto walked;
 			}
-			switch_core_session_rwunlock(member_session);
-		}
-
-		sql = switch_mprintf("SELECT instance_id, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, external_calls_count, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > %d"
-				" AND tiers.level = %d"
-				" UNION "
-				"SELECT instance_id, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, external_calls_count, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.level > %d"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				position,
-				level,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				level
-				);
-	} else if (!strcasecmp(queue->strategy, "round-robin")) {
-		sql = switch_mprintf("SELECT instance_id, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, external_calls_count, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > (SELECT tiers.position FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" AND tiers.level = (SELECT tiers.level FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" UNION "
-				"SELECT instance_id, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, external_calls_count, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				queue_name,
-				queue_name,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)
-				);
-
+		}
+	} else if (dq->strategy_id == CC_STRATEGY_ROUND_ROBIN) {
+		cc_roster_t *roster = dq->roster;
+		int level = roster->rr_level, position = roster->rr_position;
+
+		/* The agents after the one offered last, then everyone from the top */
+		if (roster->rr_offered > 0) {
+			for (i = 0; i < dq->tier_count; i++) {
+				if (dq->tiers[i]->level == level && dq->tiers[i]->position > position && cc_dispatch_offer(pass, &walk, dq->tiers[i], now)) {
+					goto walked;
+				}
+			}
+		}
+		for (i = 0; i < dq->tier_count; i++) {
+			if (cc_dispatch_offer(pass, &walk, dq->tiers[i], now)) {
+				goto walked;
+			}
+		}
 	} else {
+		for (i = 0; i < dq->tier_count; i++) {
+			if (cc_dispatch_offer(pass, &walk, dq->tiers[i], now)) {
+				goto walked;
+			}
+		}
+	}
 
-		if (!strcasecmp(queue->strategy, "longest-idle-agent")) {
-			sql_order_by = switch_mprintf("level, agents.last_bridge_end, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-least-talk-time")) {
-			sql_order_by = switch_mprintf("level, agents.talk_time, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-fewest-calls")) {
-			sql_order_by = switch_mprintf("level, agents.calls_answered, position");
-		} else if (!strcasecmp(queue_strategy, "ring-all") || !strcasecmp(queue_strategy, "ring-progressively")) {
-			sql = switch_mprintf("UPDATE members SET state = '%q' WHERE state = '%q' AND uuid = '%q' AND instance_id = '%q'",
-					cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid, cbt.member_system);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
-			sql_order_by = switch_mprintf("level, position");
-		} else if(!strcasecmp(queue_strategy, "random")) {
-			sql_order_by = switch_mprintf("level, random()");
-		} else if(!strcasecmp(queue_strategy, "sequentially-by-agent-order")) {
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call"); /* Default to last_offered_call, let add new strategy if needing it differently */
-		} else {
-			/* If the strategy doesn't exist, just fallback to the following */
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call");
+walked:
+	/* We update a field in the queue struct so we can kick caller out if waiting for too long with no agent */
+	dq->checked = SWITCH_TRUE;
+	if (walk.agent_found) {
+		dq->agent_exist = SWITCH_TRUE;
+	} else if (dq->strategy_id == CC_STRATEGY_TOP_DOWN) {
+		/* If no agent found in top-down mode, restart to the begining */
+		member->last_tier_level = 0;
+		member->last_tier_position = 0;
+	}
+}
+
+static switch_bool_t cc_member_dispatchable(cc_member_t *member)
+{
+	/* Members of other boxes sharing the tables are theirs to serve */
+	if (strcmp(member->instance_id, globals.cc_instance_id)) {
+		return SWITCH_FALSE;
+	}
+
+	switch (member->state) {
+	case CC_MEMBER_STATE_WAITING:
+	case CC_MEMBER_STATE_ABANDONED:
+		return SWITCH_TRUE;
+	case CC_MEMBER_STATE_TRYING:
+		return !strcmp(member->serving_agent, "ring-all") || !strcmp(member->serving_agent, "ring-progressively");
+	default:
+		return SWITCH_FALSE;
+	}
+}
+
+/* Go through every waiting member, best score first across all queues, and offer it to agents */
+static void cc_dispatch_pass(void)
+{
+	cc_dispatch_pass_t pass = { 0 };
+	cc_dispatch_queue_t *dqs = NULL;
+	switch_hash_index_t *hi;
+	switch_time_t now;
+	struct call_helper *h;
+	int dq_count = 0, dq_size = 0;
+	int i;
+
+	/* Queues that have members */
+	switch_mutex_lock(globals.acd_mutex);
+	for (hi = switch_core_hash_first(globals.roster_hash); hi; hi = switch_core_hash_next(&hi)) {
+		void *val;
+		cc_roster_t *roster;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		roster = (cc_roster_t *) val;
+
+		if (!roster->members) {
+			continue;
 		}
 
-		sql = switch_mprintf("SELECT instance_id, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position, tiers.level, agents.type, agents.uuid, external_calls_count FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY %q",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				sql_order_by);
-		switch_safe_free(sql_order_by);
+		if (dq_count == dq_size) {
+			dq_size = dq_size ? dq_size * 2 : 16;
+			dqs = realloc(dqs, dq_size * sizeof(*dqs));
+			switch_assert(dqs);
+		}
+		memset(&dqs[dq_count], 0, sizeof(*dqs));
+		dqs[dq_count++].roster = roster;
+	}
+	switch_mutex_unlock(globals.acd_mutex);
 
+	if (!dq_count) {
+		return;
 	}
 
-	if (!strcasecmp(queue->strategy, "ring-progressively")) {
-		switch_core_session_t *member_session = switch_core_session_locate(cbt.member_session_uuid);
+	/* Their settings, get_queue may load them so this can't be done under acd_mutex */
+	for (i = 0; i < dq_count; i++) {
+		cc_dispatch_queue_t *dq = &dqs[i];
+		cc_queue_t *queue;
 
-		if (member_session) {
-			switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-			last_originated_call = switch_channel_get_variable(member_channel, "cc_last_originated_call");
+		if (!(queue = get_queue(dq->roster->name))) {
+			continue;
+		}
 
-			if (last_originated_call && switch_channel_ready(member_channel) && ((long) local_epoch_time_now(NULL) < atoi(last_originated_call) + ring_progressively_delay) && !switch_true(switch_channel_get_variable(member_channel, "cc_agent_found"))) {
-				/* We wait for 500 ms here */
-				switch_yield(500000);
-				switch_core_session_rwunlock(member_session);
-				goto end;
+		dq->found = SWITCH_TRUE;
+		dq->strategy = strdup(queue->strategy);
+		dq->strategy_id = cc_str2strategy(queue->strategy);
+		dq->record_template = queue->record_template ? strdup(queue->record_template) : NULL;
+		/* default ring-progressively-delay set to 10 seconds */
+		dq->ring_progressively_delay = queue->ring_progressively_delay ? queue->ring_progressively_delay : 10;
+		dq->tier_rules_apply = queue->tier_rules_apply;
+		dq->tier_rule_wait_second = queue->tier_rule_wait_second;
+		dq->tier_rule_wait_multiply_level = queue->tier_rule_wait_multiply_level;
+		dq->tier_rule_no_agent_no_wait = queue->tier_rule_no_agent_no_wait;
+		dq->discard_abandoned_after = queue->discard_abandoned_after;
+		dq->skip_agents_with_external_calls = queue->skip_agents_with_external_calls;
+		dq->agent_no_answer_status = cc_agent_str2status(queue->agent_no_answer_status);
+		queue_rwunlock(queue);
+	}
+
+	switch_mutex_lock(globals.acd_mutex);
+	now = local_epoch_time_now(NULL);
+
+	for (i = 0; i < dq_count; i++) {
+		if (dqs[i].found) {
+			cc_dispatch_sort_tiers(&dqs[i]);
+		}
+		dqs[i].next = dqs[i].roster->members;
+	}
+
+	/* Each roster is already ordered, merge them */
+	for (;;) {
+		cc_dispatch_queue_t *best = NULL;
+		cc_member_t *member;
+
+		for (i = 0; i < dq_count; i++) {
+			cc_dispatch_queue_t *dq = &dqs[i];
+
+			while (dq->next && !cc_member_dispatchable(dq->next)) {
+				dq->next = dq->next->next;
 			}
 
-			switch_core_session_rwunlock(member_session);
+			if (dq->next && (!best || cc_member_priority(dq->next) > cc_member_priority(best->next))) {
+				best = dq;
+			}
+		}
+
+		if (!best) {
+			break;
 		}
+
+		member = best->next;
+		best->next = member->next;
+		cc_dispatch_member(&pass, best, member, now);
 	}
+	switch_mutex_unlock(globals.acd_mutex);
 
-	cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, agents_callback, &cbt /* Call back variables */);
+	for (i = 0; i < dq_count; i++) {
+		cc_dispatch_queue_t *dq = &dqs[i];
+		cc_queue_t *queue;
 
-	switch_safe_free(sql);
+		if (dq->checked && (queue = get_queue(dq->roster->name))) {
+			queue->last_agent_exist_check = now;
+			if (dq->agent_exist) {
+				queue->last_agent_exist = now;
+			}
+			queue_rwunlock(queue);
+		}
 
-	/* We update a field in the queue struct so we can kick caller out if waiting for too long with no agent */
-	if (!cbt.queue_name || !(queue = get_queue(cbt.queue_name))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Queue %s not found locally, skip this member\n", cbt.queue_name);
-		goto end;
-	} else {
-		queue->last_agent_exist_check = local_epoch_time_now(NULL);
-		if (cbt.agent_found) {
-			queue->last_agent_exist = queue->last_agent_exist_check;
-		} else {
-			/* If no agent found in top-down mode, restart to the begining */
-			if (!strcasecmp(queue->strategy, "top-down")) {
-				switch_core_session_t *member_session = switch_core_session_locate(cbt.member_session_uuid);
-				if (member_session) {
-					switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-					switch_channel_set_variable(member_channel, "cc_last_agent_tier_position", NULL);
-					switch_channel_set_variable(member_channel, "cc_last_agent_tier_level", NULL);
-					switch_core_session_rwunlock(member_session);
+		switch_safe_free(dq->strategy);
+		switch_safe_free(dq->record_template);
+		switch_safe_free(dq->tiers);
+	}
+	switch_safe_free(dqs);
+
+	for (i = 0; i < pass.event_count; i++) {
+		switch_event_fire(&pass.events[i]);
+	}
+	switch_safe_free(pass.events);
+
+	while ((h = pass.offers)) {
+		switch_thread_t *thread;
+		switch_threadattr_t *thd_attr = NULL;
+
+		pass.offers = h->next;
+
+		if (!strcasecmp(h->queue_strategy, "ring-progressively") || !strcasecmp(h->queue_strategy, "top-down")) {
+			switch_core_session_t *member_session = switch_core_session_locate(h->member_session_uuid);
+
+			if (member_session) {
+				switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
+
+				if (!strcasecmp(h->queue_strategy, "ring-progressively")) {
+					switch_channel_set_variable_printf(member_channel, "cc_last_originated_call", "%" SWITCH_TIME_T_FMT, now);
+				} else {
+					switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_position", "%d", h->agent_tier_position);
+					switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_level", "%d", h->agent_tier_level);
 				}
+				switch_core_session_rwunlock(member_session);
 			}
 		}
-		queue_rwunlock(queue);
+
+		switch_threadattr_create(&thd_attr, h->pool);
+		switch_threadattr_detach_set(thd_attr, 1);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&thread, thd_attr, outbound_agent_thread_run, h, h->pool);
 	}
+}
 
-end:
-	switch_safe_free(queue_name);
-	switch_safe_free(queue_strategy);
-	switch_safe_free(queue_record_template);
+static void cc_dispatch_wake(void)
+{
+	if (!globals.dispatch_cond) {
+		return;
+	}
 
-	return 0;
+	switch_mutex_lock(globals.dispatch_mutex);
+	globals.dispatch_pending = 1;
+	switch_thread_cond_signal(globals.dispatch_cond);
+	switch_mutex_unlock(globals.dispatch_mutex);
 }
 
 static int AGENT_DISPATCH_THREAD_RUNNING = 0;
@@ -2759,6 +4004,7 @@ static int AGENT_DISPATCH_THREAD_STARTED = 0;
 
 void *SWITCH_THREAD_FUNC cc_agent_dispatch_thread_run(switch_thread_t *thread, void *obj)
 {
+	switch_time_t next_refresh = 0;
 	int done = 0;
 
 	switch_mutex_lock(globals.mutex);
@@ -2777,15 +4023,21 @@ void *SWITCH_THREAD_FUNC cc_agent_dispatch_thread_run(switch_thread_t *thread, v
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Agent Dispatch Thread Started\n");
 
 	while (globals.running == 1) {
-		char *sql = NULL;
-		sql = switch_mprintf("SELECT queue,uuid,session_uuid,cid_number,cid_name,joined_epoch,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score, state, abandoned_epoch, serving_agent, instance_id FROM members"
-				" WHERE (state = '%q' OR state = '%q' OR (serving_agent = 'ring-all' AND state = '%q') OR (serving_agent = 'ring-progressively' AND state = '%q')) AND instance_id = '%q' ORDER BY score DESC",
-				local_epoch_time_now(NULL),
-				cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_ABANDONED), cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_TRYING), globals.cc_instance_id);
+		if (globals.shared_db && switch_micro_time_now() >= next_refresh) {
+			cc_shared_refresh();
+			next_refresh = switch_micro_time_now() + CC_SHARED_REFRESH;
+		}
 
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, members_callback, NULL /* Call back variables */);
-		switch_safe_free(sql);
-		switch_yield(100000);
+		cc_dispatch_pass();
+
+		/* Woken up by any change to members, agents or tiers.  Wrap-up, ready and tier wait times
+		   expire on their own, they are counted in seconds so that's how often we look anyway */
+		switch_mutex_lock(globals.dispatch_mutex);
+		if (!globals.dispatch_pending && globals.running == 1) {
+			switch_thread_cond_timedwait(globals.dispatch_cond, globals.dispatch_mutex, 1000000);
+		}
+		globals.dispatch_pending = 0;
+		switch_mutex_unlock(globals.dispatch_mutex);
 	}
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Agent Dispatch Thread Ended\n");
@@ -2990,7 +4242,6 @@ SWITCH_STANDARD_APP(callcenter_function)
 	const char *queue_name = NULL;
 	switch_core_session_t *member_session = session;
 	switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-	char *sql = NULL;
 	char *member_session_uuid = switch_core_session_get_uuid(member_session);
 	struct member_thread_helper *h = NULL;
 	switch_thread_t *thread;
@@ -3038,21 +4289,9 @@ SWITCH_STANDARD_APP(callcenter_function)
 
 	/* Check if we support and have a queued abandoned member we can resume from */
 	if (queue->abandoned_resume_allowed == SWITCH_TRUE) {
-		char res[256];
-
-		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT uuid FROM members WHERE queue = '%q' AND cid_number = '%q' AND state = '%q' ORDER BY abandoned_epoch DESC",
-				queue_name, switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		strncpy(member_uuid, res, sizeof(member_uuid));
-
-		if (!zstr(member_uuid)) {
-			sql = switch_mprintf("SELECT abandoned_epoch FROM members WHERE uuid = '%q'", member_uuid);
-			cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-			switch_safe_free(sql);
-			abandoned_epoch = atol(res);
-		}
+		/* Takes the member back in right away, so two calls can't resume the same one */
+		abandoned_epoch = (long) cc_member_resume(queue_name, switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")),
+												  member_session_uuid, member_uuid, sizeof(member_uuid));
 	}
 
 	/* If no existing uuid is restored, let create a new one */
@@ -3082,32 +4321,9 @@ SWITCH_STANDARD_APP(callcenter_function)
 	switch_channel_set_variable_printf(member_channel, "cc_queue_joined_epoch", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL));
 	switch_channel_set_variable(member_channel, "cc_queue", queue_name);
 
-	/* We have a previous abandoned user, let's try to recover his place */
+	/* We have a previous abandoned user, we recovered his place */
 	if (abandoned_epoch > 0) {
-		char res[256];
-
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> restoring it previous position in queue %s\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
-
-		/* Update abandoned member */
-		sql = switch_mprintf("UPDATE members SET session_uuid = '%q', state = '%q', rejoined_epoch = '%" SWITCH_TIME_T_FMT "', instance_id = '%q' WHERE uuid = '%q' AND state = '%q'",
-				member_session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), local_epoch_time_now(NULL), globals.cc_instance_id, member_uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
-		cc_execute_sql(queue, sql, NULL);
-		switch_safe_free(sql);
-
-		/* Confirm we took that member in */
-		sql = switch_mprintf("SELECT abandoned_epoch FROM members WHERE uuid = '%q' AND session_uuid = '%q' AND state = '%q' AND queue = '%q'", member_uuid, member_session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), queue_name);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		abandoned_epoch = atol(res);
-
-		if (abandoned_epoch == 0) {
-			/* Failed to get the member !!! */
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_ERROR, "Member %s <%s> restoring action failed in queue %s, joining again\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
-			//queue_rwunlock(queue);
-		} else {
-
-		}
-
 	}
 
 	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -3134,23 +4350,10 @@ SWITCH_STANDARD_APP(callcenter_function)
 		} else {
 			strategy_str = "";
 		}
-		sql = switch_mprintf("INSERT INTO members"
-				" (queue,instance_id,uuid,session_uuid,system_epoch,joined_epoch,base_score,skill_score,cid_number,cid_name,serving_agent,serving_system,state)"
-				" VALUES('%q','%q','%q','%q','%q','%" SWITCH_TIME_T_FMT "','%d','%d','%q','%q','%q','','%q')",
-				queue_name,
-				globals.cc_instance_id,
-				member_uuid,
-				member_session_uuid,
-				start_epoch,
-				local_epoch_time_now(NULL),
-				cc_base_score_int,
-				0 /*TODO SKILL score*/,
-				switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")),
-				switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")),
-				strategy_str,
-				cc_member_state2str(CC_MEMBER_STATE_WAITING));
-		cc_execute_sql(queue, sql, NULL);
-		switch_safe_free(sql);
+		cc_member_add(queue_name, member_uuid, member_session_uuid,
+					  switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")),
+					  switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")),
+					  start_epoch, cc_base_score_int, strategy_str);
 	}
 
 	/* Send Event with queue count */
@@ -3262,10 +4465,7 @@ SWITCH_STANDARD_APP(callcenter_function)
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> abandoned waiting in queue %s\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
 
 		/* Update member state */
-		sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND instance_id = '%q'",
-				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), member_uuid, globals.cc_instance_id);
-				cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_member_abandon(member_uuid, SWITCH_FALSE);
 
 		/* Hangup any callback agents  */
 		switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", member_uuid, SWITCH_CAUSE_ORIGINATOR_CANCEL);
@@ -3328,16 +4528,13 @@ static switch_status_t cc_hook_state_run(switch_core_session_t *session)
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	switch_channel_state_t state = switch_channel_get_state(channel);
 	const char *agent_name = NULL;
-	char *sql = NULL;
 
 	agent_name = switch_channel_get_variable(channel, "cc_tracked_agent");
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Called cc_hook_hanguphook channel %s with state %s", switch_channel_get_name(channel), switch_channel_state_name(state));
 
 	if (state == CS_HANGUP) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Tracked call for agent %s ended, decreasing external_calls_count", agent_name);
-		sql = switch_mprintf("UPDATE agents SET external_calls_count = external_calls_count - 1 WHERE name = '%q'", agent_name);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_agent_external_call(agent_name, -1);
 		switch_core_event_hook_remove_state_run(session, cc_hook_state_run);
 		UNPROTECT_INTERFACE(app_interface);
 	}
@@ -3350,7 +4547,6 @@ SWITCH_STANDARD_APP(callcenter_track)
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	char agent_status[255];
 	char *agent_name = NULL;
-	char *sql = NULL;
 
 	if (zstr(data)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Missing agent name\n");
@@ -3366,9 +4562,7 @@ SWITCH_STANDARD_APP(callcenter_track)
 
 	switch_channel_set_variable(channel, "cc_tracked_agent", agent_name);
 
-	sql = switch_mprintf("UPDATE agents SET external_calls_count = external_calls_count + 1 WHERE name = '%q'", agent_name);
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_agent_external_call(agent_name, 1);
 
 	switch_core_event_hook_add_state_run(session, cc_hook_state_run);
 	PROTECT_INTERFACE(app_interface);
@@ -3379,14 +4573,15 @@ SWITCH_STANDARD_APP(callcenter_track)
 }
 
 static void cc_send_presence(const char *queue_name) {
-	char *sql;
-	char res[256] = "";
+	cc_roster_t *roster;
 	int count = 0;
 	switch_event_t *send_event;
 
-	sql = switch_mprintf("SELECT COUNT(*) FROM members WHERE queue = '%q' AND state = '%q'", queue_name, cc_member_state2str(CC_MEMBER_STATE_WAITING));
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	count = atoi(res);
+	switch_mutex_lock(globals.acd_mutex);
+	if ((roster = cc_roster_get(queue_name, SWITCH_FALSE))) {
+		count = cc_roster_count(roster, CC_MEMBER_STATE_WAITING, CC_MEMBER_STATE_WAITING);
+	}
+	switch_mutex_unlock(globals.acd_mutex);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue has %d waiting calls.\n", count);
 
 	if (switch_event_create(&send_event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
@@ -3414,7 +4609,6 @@ static void cc_send_presence(const char *queue_name) {
 	} else {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Failed to create presence in event\n");
 	}
-	switch_safe_free(sql);
 }
 
 static void cc_presence_event_handler(switch_event_t *event) {
@@ -3503,6 +4697,268 @@ static int list_result_json_callback(void *pArg, int argc, char **argv, char **c
 	return 0;
 }
 
+/* A row of a listing, laid out as the tables would return it */
+#define CC_ROW_MAX 24
+
+typedef struct {
+	int argc;
+	char *argv[CC_ROW_MAX];
+	char *names[CC_ROW_MAX];
+	char num[CC_ROW_MAX][24];
+} cc_row_t;
+
+static void cc_row_add_str(cc_row_t *row, const char *name, const char *value)
+{
+	switch_assert(row->argc < CC_ROW_MAX);
+	row->names[row->argc] = (char *) name;
+	row->argv[row->argc++] = (char *) switch_str_nil(value);
+}
+
+static void cc_row_add_int(cc_row_t *row, const char *name, int64_t value)
+{
+	switch_assert(row->argc < CC_ROW_MAX);
+	switch_snprintf(row->num[row->argc], sizeof(row->num[row->argc]), "%" SWITCH_INT64_T_FMT, value);
+	row->names[row->argc] = (char *) name;
+	row->argv[row->argc] = row->num[row->argc];
+	row->argc++;
+}
+
+static int cc_list_agent(cc_agent_t *agent, switch_core_db_callback_func_t callback, void *pArg)
+{
+	cc_row_t row = { 0 };
+
+	if (callback) {
+		cc_row_add_str(&row, "name", agent->name);
+		cc_row_add_str(&row, "instance_id", agent->instance_id);
+		cc_row_add_str(&row, "uuid", agent->uuid);
+		cc_row_add_str(&row, "type", agent->type);
+		cc_row_add_str(&row, "contact", agent->contact);
+		cc_row_add_str(&row, "status", cc_agent_status2str(agent->status));
+		cc_row_add_str(&row, "state", cc_agent_state2str(agent->state));
+		cc_row_add_int(&row, "max_no_answer", agent->max_no_answer);
+		cc_row_add_int(&row, "wrap_up_time", agent->wrap_up_time);
+		cc_row_add_int(&row, "reject_delay_time", agent->reject_delay_time);
+		cc_row_add_int(&row, "busy_delay_time", agent->busy_delay_time);
+		cc_row_add_int(&row, "no_answer_delay_time", agent->no_answer_delay_time);
+		cc_row_add_int(&row, "last_bridge_start", agent->last_bridge_start);
+		cc_row_add_int(&row, "last_bridge_end", agent->last_bridge_end);
+		cc_row_add_int(&row, "last_offered_call", agent->last_offered_call);
+		cc_row_add_int(&row, "last_status_change", agent->last_status_change);
+		cc_row_add_int(&row, "no_answer_count", agent->no_answer_count);
+		cc_row_add_int(&row, "calls_answered", agent->calls_answered);
+		cc_row_add_int(&row, "talk_time", agent->talk_time);
+		cc_row_add_int(&row, "ready_time", agent->ready_time);
+		cc_row_add_int(&row, "external_calls_count", agent->external_calls_count);
+		callback(pArg, row.argc, row.argv, row.names);
+	}
+
+	return 1;
+}
+
+static int cc_list_tier(cc_tier_t *tier, switch_core_db_callback_func_t callback, void *pArg)
+{
+	cc_row_t row = { 0 };
+
+	if (callback) {
+		cc_row_add_str(&row, "queue", tier->roster->name);
+		cc_row_add_str(&row, "agent", tier->agent->name);
+		cc_row_add_str(&row, "state", cc_tier_state2str(tier->state));
+		cc_row_add_int(&row, "level", tier->level);
+		cc_row_add_int(&row, "position", tier->position);
+		callback(pArg, row.argc, row.argv, row.names);
+	}
+
+	return 1;
+}
+
+static int cc_list_member(cc_member_t *member, switch_time_t now, switch_core_db_callback_func_t callback, void *pArg)
+{
+	cc_row_t row = { 0 };
+
+	if (callback) {
+		cc_row_add_str(&row, "queue", member->roster->name);
+		cc_row_add_str(&row, "instance_id", member->instance_id);
+		cc_row_add_str(&row, "uuid", member->uuid);
+		cc_row_add_str(&row, "session_uuid", member->session_uuid);
+		cc_row_add_str(&row, "cid_number", member->cid_number);
+		cc_row_add_str(&row, "cid_name", member->cid_name);
+		cc_row_add_int(&row, "system_epoch", member->system_epoch);
+		cc_row_add_int(&row, "joined_epoch", member->joined_epoch);
+		cc_row_add_int(&row, "rejoined_epoch", member->rejoined_epoch);
+		cc_row_add_int(&row, "bridge_epoch", member->bridge_epoch);
+		cc_row_add_int(&row, "abandoned_epoch", member->abandoned_epoch);
+		cc_row_add_int(&row, "base_score", member->base_score);
+		cc_row_add_int(&row, "skill_score", member->skill_score);
+		cc_row_add_str(&row, "serving_agent", member->serving_agent);
+		cc_row_add_str(&row, "serving_system", member->serving_system);
+		cc_row_add_str(&row, "state", cc_member_state2str(member->state));
+		cc_row_add_int(&row, "score", now + cc_member_priority(member));
+		callback(pArg, row.argc, row.argv, row.names);
+	}
+
+	return 1;
+}
+
+/* The listings below walk the store the way the old queries did; a NULL callback just counts */
+static int cc_list_agents(const char *name, switch_core_db_callback_func_t callback, void *pArg)
+{
+	switch_hash_index_t *hi;
+	int count = 0;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if (name) {
+		cc_agent_t *agent = cc_agent_find(name);
+
+		if (agent) {
+			count += cc_list_agent(agent, callback, pArg);
+		}
+	} else {
+		for (hi = switch_core_hash_first(globals.agent_hash); hi; hi = switch_core_hash_next(&hi)) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+
+			switch_core_hash_this(hi, &key, &keylen, &val);
+			count += cc_list_agent((cc_agent_t *) val, callback, pArg);
+		}
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	return count;
+}
+
+static int cc_list_queue_agents(const char *queue_name, const char *status, const char *state, switch_core_db_callback_func_t callback, void *pArg)
+{
+	cc_roster_t *roster;
+	int count = 0;
+	int i;
+
+	if (!queue_name) {
+		return 0;
+	}
+
+	switch_mutex_lock(globals.acd_mutex);
+	if ((roster = cc_roster_get(queue_name, SWITCH_FALSE))) {
+		for (i = 0; i < roster->tier_count; i++) {
+			cc_agent_t *agent = roster->tiers[i]->agent;
+
+			if ((status && strcmp(status, cc_agent_status2str(agent->status))) || (state && strcmp(state, cc_agent_state2str(agent->state)))) {
+				continue;
+			}
+			count += cc_list_agent(agent, callback, pArg);
+		}
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	return count;
+}
+
+static int cc_tier_qsort_level(const void *a, const void *b)
+{
+	return cc_tier_cmp_level(*(cc_tier_t * const *) a, *(cc_tier_t * const *) b);
+}
+
+static int cc_list_tiers(const char *queue_name, switch_core_db_callback_func_t callback, void *pArg)
+{
+	switch_hash_index_t *hi;
+	cc_roster_t *roster;
+	int count = 0;
+	int i;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if (queue_name) {
+		if ((roster = cc_roster_get(queue_name, SWITCH_FALSE))) {
+			for (i = 0; i < roster->tier_count; i++) {
+				count += cc_list_tier(roster->tiers[i], callback, pArg);
+			}
+		}
+	} else {
+		cc_tier_t **tiers = NULL;
+		int total = 0, size = 0;
+
+		for (hi = switch_core_hash_first(globals.roster_hash); hi; hi = switch_core_hash_next(&hi)) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+
+			switch_core_hash_this(hi, &key, &keylen, &val);
+			roster = (cc_roster_t *) val;
+			if (total + roster->tier_count > size) {
+				size = total + roster->tier_count;
+				tiers = realloc(tiers, size * sizeof(*tiers));
+				switch_assert(tiers);
+			}
+			memcpy(tiers + total, roster->tiers, roster->tier_count * sizeof(*tiers));
+			total += roster->tier_count;
+		}
+
+		if (total) {
+			qsort(tiers, total, sizeof(*tiers), cc_tier_qsort_level);
+		}
+		for (i = 0; i < total; i++) {
+			count += cc_list_tier(tiers[i], callback, pArg);
+		}
+		switch_safe_free(tiers);
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	return count;
+}
+
+static int cc_roster_qsort_name(const void *a, const void *b)
+{
+	return strcmp((*(cc_roster_t * const *) a)->name, (*(cc_roster_t * const *) b)->name);
+}
+
+static int cc_list_members(const char *queue_name, switch_core_db_callback_func_t callback, void *pArg)
+{
+	switch_time_t now = local_epoch_time_now(NULL);
+	switch_hash_index_t *hi;
+	cc_roster_t **rosters = NULL;
+	cc_roster_t *roster;
+	cc_member_t *member;
+	int total = 0, size = 0;
+	int count = 0;
+	int i;
+
+	switch_mutex_lock(globals.acd_mutex);
+	if (queue_name) {
+		if ((roster = cc_roster_get(queue_name, SWITCH_FALSE))) {
+			for (member = roster->members; member; member = member->next) {
+				count += cc_list_member(member, now, callback, pArg);
+			}
+		}
+	} else {
+		/* By queue, then by score */
+		for (hi = switch_core_hash_first(globals.roster_hash); hi; hi = switch_core_hash_next(&hi)) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+
+			switch_core_hash_this(hi, &key, &keylen, &val);
+			if (total == size) {
+				size = size ? size * 2 : 16;
+				rosters = realloc(rosters, size * sizeof(*rosters));
+				switch_assert(rosters);
+			}
+			rosters[total++] = (cc_roster_t *) val;
+		}
+
+		if (total) {
+			qsort(rosters, total, sizeof(*rosters), cc_roster_qsort_name);
+		}
+		for (i = 0; i < total; i++) {
+			for (member = rosters[i]->members; member; member = member->next) {
+				count += cc_list_member(member, now, callback, pArg);
+			}
+		}
+		switch_safe_free(rosters);
+	}
+	switch_mutex_unlock(globals.acd_mutex);
+
+	return count;
+}
+
 #define CC_CONFIG_API_SYNTAX "callcenter_config <target> <args>,\n"\
 "\tcallcenter_config agent add [name] [type] | \n" \
 "\tcallcenter_config agent del [name] | \n" \
@@ -3542,7 +4998,6 @@ SWITCH_STANDARD_API(cc_config_api_function)
 	char *mydata = NULL, *argv[8] = { 0 };
 	const char *section = NULL;
 	const char *action = NULL;
-	char *sql;
 	int initial_argc = 2;
 
 	int argc;
@@ -3693,13 +5148,8 @@ SWITCH_STANDARD_API(cc_config_api_function)
 			if ( argc-initial_argc > 1 ) {
 				stream->write_function(stream, "%s", "-ERR Invalid!\n");
 				goto done;
-			} else if ( argc-initial_argc == 1 ) {
-				sql = switch_mprintf("SELECT * FROM agents WHERE name='%q'", argv[0 + initial_argc]);
-			} else {
-				sql = switch_mprintf("SELECT * FROM agents");
 			}
-			cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-			switch_safe_free(sql);
+			cc_list_agents(argc-initial_argc == 1 ? argv[0 + initial_argc] : NULL, list_result_callback, &cbt);
 			stream->write_function(stream, "%s", "+OK\n");
 		}
 
@@ -3823,9 +5273,7 @@ SWITCH_STANDARD_API(cc_config_api_function)
 			struct list_result cbt;
 			cbt.row_process = 0;
 			cbt.stream = stream;
-			sql = switch_mprintf("SELECT * FROM tiers ORDER BY level, position");
-			cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-			switch_safe_free(sql);
+			cc_list_tiers(NULL, list_result_callback, &cbt);
 			stream->write_function(stream, "%s", "+OK\n");
 		}
 	} else if (section && !strcasecmp(section, "queue")) {
@@ -3925,33 +5373,26 @@ SWITCH_STANDARD_API(cc_config_api_function)
 					if (argc-initial_argc > 3) {
 						state = argv[3 + initial_argc];
 					}
-					if (state)	{
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q' AND agents.state = '%q'", queue_name, status, state);
-					}
-					else if (status)	{
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q'", queue_name, status);
-					} else {
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q'", queue_name);
-					}
+					cbt.row_process = 0;
+					cbt.stream = stream;
+					cc_list_queue_agents(queue_name, status, state, list_result_callback, &cbt);
 				/* queue list members */
 				} else if (sub_action && !strcasecmp(sub_action, "members")) {
-					if (queue_name){
-						sql = switch_mprintf("SELECT  *,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score FROM members WHERE queue = '%q' ORDER BY score DESC;", local_epoch_time_now(NULL), queue_name);
-					} else {
-						sql = switch_mprintf("SELECT  *,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score FROM members ORDER BY queue, score DESC;", local_epoch_time_now(NULL));
-					}
+					cbt.row_process = 0;
+					cbt.stream = stream;
+					cc_list_members(queue_name, list_result_callback, &cbt);
 				/* queue list tiers */
 				} else if (sub_action && !strcasecmp(sub_action, "tiers")) {
-					sql = switch_mprintf("SELECT * FROM tiers WHERE queue = '%q';", queue_name);
+					cbt.row_process = 0;
+					cbt.stream = stream;
+					if (queue_name) {
+						cc_list_tiers(queue_name, list_result_callback, &cbt);
+					}
 				} else {
 					stream->write_function(stream, "%s", "-ERR Invalid!\n");
 					goto done;
 				}
 
-				cbt.row_process = 0;
-				cbt.stream = stream;
-				cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-				switch_safe_free(sql);
 				stream->write_function(stream, "%s", "+OK\n");
 			}
 
@@ -3972,7 +5413,7 @@ SWITCH_STANDARD_API(cc_config_api_function)
 				const char *queue_name = argv[1 + initial_argc];
 				const char *status = NULL;
 				const char *state = NULL;
-				char res[256] = "";
+				int count = 0;
 
 				/* queue count agents */
 				if (sub_action && !strcasecmp(sub_action, "agents")) {
@@ -3982,28 +5423,23 @@ SWITCH_STANDARD_API(cc_config_api_function)
 					if (argc-initial_argc > 3) {
 						state = argv[3 + initial_argc];
 					}
-					if (state)	{
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q' AND agents.state = '%q'", queue_name, status, state);
-					}
-					else if (status)	{
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q'", queue_name, status);
-					} else {
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q'", queue_name);
-					}
+					count = cc_list_queue_agents(queue_name, status, state, NULL, NULL);
 				/* queue count members */
 				} else if (sub_action && !strcasecmp(sub_action, "members")) {
-					sql = switch_mprintf("SELECT count(*) FROM members WHERE queue = '%q';", queue_name);
+					if (queue_name) {
+						count = cc_list_members(queue_name, NULL, NULL);
+					}
 				/* queue count tiers */
 				} else if (sub_action && !strcasecmp(sub_action, "tiers")) {
-					sql = switch_mprintf("SELECT count(*) FROM tiers WHERE queue = '%q';", queue_name);
+					if (queue_name) {
+						count = cc_list_tiers(queue_name, NULL, NULL);
+					}
 				} else {
 					stream->write_function(stream, "%s", "-ERR Invalid!\n");
 					goto done;
 				}
 
-				cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-				switch_safe_free(sql);
-				stream->write_function(stream, "%d\n", atoi(res));
+				stream->write_function(stream, "%d\n", count);
 			}
 		}
 	}
@@ -4069,12 +5505,9 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	/* Prepare the JSON for list of agents */
 	if(!strcasecmp(arguments, "agent list")){
 		struct list_result_json cbt;
-		char *sql;
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT * FROM agents");
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_agents(NULL, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4121,7 +5554,6 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	if(!strcasecmp(arguments, "queue list agents")){
 		struct list_result_json cbt;
 		const char *queue_name = cJSON_GetObjectCstr(data, "queue_name");
-		char *sql;
 		cJSON *error_reply = cJSON_CreateObject();
 
 		if (zstr(queue_name)) {
@@ -4132,9 +5564,7 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 		}
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q'", queue_name);
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_queue_agents(queue_name, NULL, NULL, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4143,7 +5573,6 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	if(!strcasecmp(arguments, "queue list members")){
 		struct list_result_json cbt;
 		const char *queue_name = cJSON_GetObjectCstr(data, "queue_name");
-		char *sql;
 		cJSON *error_reply = cJSON_CreateObject();
 
 		if (zstr(queue_name)) {
@@ -4154,9 +5583,7 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 		}
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT  *,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score FROM members WHERE queue = '%q' ORDER BY score DESC;", local_epoch_time_now(NULL), queue_name);
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_members(queue_name, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4165,7 +5592,6 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	if(!strcasecmp(arguments, "queue list tiers")){
 		struct list_result_json cbt;
 		const char *queue_name = cJSON_GetObjectCstr(data, "queue_name");
-		char *sql;
 		cJSON *error_reply = cJSON_CreateObject();
 
 		if (zstr(queue_name)) {
@@ -4176,9 +5602,7 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 		}
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT * FROM tiers WHERE queue = '%q';", queue_name);
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_tiers(queue_name, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4186,12 +5610,9 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	/* Prepare the JSON for list of all callers */
 	if(!strcasecmp(arguments, "member list")){
 		struct list_result_json cbt;
-		char *sql;
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT  *,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score FROM members ORDER BY score DESC;", local_epoch_time_now(NULL));
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_members(NULL, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4199,12 +5620,9 @@ SWITCH_STANDARD_JSON_API(json_callcenter_config_function)
 	/* Prepare the JSON for list of all tiers */
 	if(!strcasecmp(arguments, "tier list")){
 		struct list_result_json cbt;
-		char *sql;
 		cbt.row_process = 0;
 		cbt.json_reply = cJSON_CreateArray();
-		sql = switch_mprintf("SELECT * FROM tiers ORDER BY level, position");
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_json_callback, &cbt /* Call back variables */);
-		switch_safe_free(sql);
+		cc_list_tiers(NULL, list_result_json_callback, &cbt);
 		*json_reply = cbt.json_reply;
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -4241,10 +5659,20 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_callcenter_load)
 	switch_core_hash_init(&globals.queue_hash);
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
+	switch_core_hash_init(&globals.agent_hash);
+	switch_core_hash_init(&globals.member_hash);
+	switch_core_hash_init(&globals.roster_hash);
+	switch_mutex_init(&globals.acd_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+	switch_mutex_init(&globals.dispatch_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+	switch_thread_cond_create(&globals.dispatch_cond, globals.pool);
+
 	if ((status = load_config(pool)) != SWITCH_STATUS_SUCCESS) {
 		switch_event_unbind(&globals.node);
 		switch_event_free_subclass(CALLCENTER_EVENT);
 		switch_core_hash_destroy(&globals.queue_hash);
+		switch_core_hash_destroy(&globals.agent_hash);
+		switch_core_hash_destroy(&globals.member_hash);
+		switch_core_hash_destroy(&globals.roster_hash);
 		return status;
 	}
 
@@ -4328,6 +5756,8 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown)
 	}
 	switch_mutex_unlock(globals.mutex);
 
+	cc_dispatch_wake();
+
 	while (globals.threads) {
 		switch_cond_next();
 		if (++sanity >= 60000) {
@@ -4335,6 +5765,41 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown)
 		}
 	}
 
+	/* Everything still waiting was written behind, flush it and drop the store */
+	if (globals.qm) {
+		switch_sql_queue_manager_destroy(&globals.qm);
+	}
+
+	switch_mutex_lock(globals.acd_mutex);
+	while ((hi = switch_core_hash_first(globals.agent_hash))) {
+		switch_core_hash_this(hi, &key, &keylen, &val);
+		switch_safe_free(hi);
+		cc_agent_destroy((cc_agent_t *) val);
+	}
+
+	while ((hi = switch_core_hash_first(globals.member_hash))) {
+		switch_core_hash_this(hi, &key, &keylen, &val);
+		switch_safe_free(hi);
+		cc_member_destroy((cc_member_t *) val);
+	}
+
+	while ((hi = switch_core_hash_first(globals.roster_hash))) {
+		cc_roster_t *roster;
+
+		switch_core_hash_this(hi, &key, &keylen, &val);
+		switch_safe_free(hi);
+		roster = (cc_roster_t *) val;
+		switch_core_hash_delete(globals.roster_hash, roster->name);
+		switch_safe_free(roster->tiers);
+		switch_safe_free(roster->name);
+		free(roster);
+	}
+
+	switch_core_hash_destroy(&globals.agent_hash);
+	switch_core_hash_destroy(&globals.member_hash);
+	switch_core_hash_destroy(&globals.roster_hash);
+	switch_mutex_unlock(globals.acd_mutex);
+
 	switch_mutex_lock(globals.mutex);
 	while ((hi = switch_core_hash_first_iter( globals.queue_hash, hi))) {
 		switch_core_hash_this(hi, &key, &keylen, &val);
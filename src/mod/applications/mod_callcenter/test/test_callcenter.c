@@ -0,0 +1,206 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * test_callcenter.c - Tests members going through a queue and the rows of other boxes sharing the tables
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// Run test
+// make && libtool --mode=execute ./test/test_callcenter
+
+/**
+ * Run SQL against the callcenter tables as another box would
+ */
+static switch_bool_t cc_db_exec(const char *sql)
+{
+	switch_cache_db_handle_t *dbh = NULL;
+	char *err = NULL;
+
+	if (switch_cache_db_get_db_handle_dsn(&dbh, "sqlite://callcenter_test") != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_FALSE;
+	}
+
+	switch_cache_db_execute_sql(dbh, (char *) sql, &err);
+	switch_cache_db_release_db_handle(&dbh);
+
+	if (err) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: %s\n", sql, err);
+		free(err);
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+/**
+ * Read a single value from the callcenter tables
+ */
+static char *cc_db_str(const char *sql, char *buf, size_t len)
+{
+	switch_cache_db_handle_t *dbh = NULL;
+	char *ret;
+
+	*buf = '\0';
+	if (switch_cache_db_get_db_handle_dsn(&dbh, "sqlite://callcenter_test") != SWITCH_STATUS_SUCCESS) {
+		return buf;
+	}
+
+	ret = switch_cache_db_execute_sql2str(dbh, (char *) sql, buf, len, NULL);
+	switch_cache_db_release_db_handle(&dbh);
+
+	return ret ? ret : buf;
+}
+
+/**
+ * Wait for the output of a callcenter_config command to contain some text, or not to
+ */
+static switch_bool_t wait_api(const char *cmd, const char *text, switch_bool_t present)
+{
+	switch_time_t deadline = switch_micro_time_now() + 10000000;
+	switch_bool_t found = !present;
+
+	while (switch_micro_time_now() < deadline) {
+		switch_stream_handle_t stream = { 0 };
+
+		SWITCH_STANDARD_STREAM(stream);
+		switch_api_execute("callcenter_config", cmd, NULL, &stream);
+		found = strstr((char *) stream.data, text) != NULL;
+		switch_safe_free(stream.data);
+
+		if (found == present) {
+			break;
+		}
+
+		switch_sleep(100000);
+	}
+
+	return found == present;
+}
+
+/**
+ * Call into the queue, the session returned is the caller's side
+ */
+static switch_core_session_t *member_call(const char *cid_number)
+{
+	switch_core_session_t *session = NULL;
+	switch_call_cause_t cause;
+
+	if (switch_ivr_originate(NULL, &session, &cause, "loopback/member/default", 5, NULL, "member", cid_number, NULL, NULL, SOF_NONE, NULL, NULL) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	return session;
+}
+
+static void member_hangup(switch_core_session_t *session)
+{
+	switch_channel_hangup(switch_core_session_get_channel(session), SWITCH_CAUSE_NORMAL_CLEARING);
+	switch_core_session_rwunlock(session);
+}
+
+FST_CORE_BEGIN("conf")
+{
+	FST_MODULE_BEGIN(mod_callcenter, callcenter)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_loopback");
+			fst_requires_module("mod_dptools");
+			fst_requires_module("mod_dialplan_xml");
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+			cc_db_exec("delete from members where instance_id='otherbox'");
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(member_served_then_abandoned)
+		{
+			switch_core_session_t *served, *waiting;
+
+			fst_check(wait_api("agent list", "1000@default|single_box|", SWITCH_TRUE));
+			fst_check(wait_api("agent get status 1000@default", "Available", SWITCH_TRUE));
+			fst_check(wait_api("tier list", "support@default|1000@default|Ready|1|1", SWITCH_TRUE));
+			fst_check(wait_api("queue count members support@default", "0", SWITCH_TRUE));
+
+			/* the first caller goes to the agent */
+			fst_requires((served = member_call("1001")));
+			fst_check(wait_api("agent get state 1000@default", "In a queue call", SWITCH_TRUE));
+			fst_check(wait_api("queue list members support@default", "|1001|member|", SWITCH_TRUE));
+			fst_check(wait_api("queue list members support@default", "|1000@default|single_box|Answered|", SWITCH_TRUE));
+			fst_check(wait_api("queue count members support@default", "1", SWITCH_TRUE));
+
+			/* the second one waits for the busy agent, then gives up */
+			fst_requires((waiting = member_call("1002")));
+			fst_check(wait_api("queue count members support@default", "2", SWITCH_TRUE));
+			fst_check(wait_api("queue list members support@default", "|Waiting|", SWITCH_TRUE));
+			member_hangup(waiting);
+			fst_check(wait_api("queue list members support@default", "|Abandoned|", SWITCH_TRUE));
+
+			/* the agent is free again once the first caller is done */
+			member_hangup(served);
+			fst_check(wait_api("agent get state 1000@default", "Waiting", SWITCH_TRUE));
+			fst_check(wait_api("queue list members support@default", "|1001|", SWITCH_FALSE));
+			fst_check(wait_api("queue count members support@default", "1", SWITCH_TRUE));
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(shared_rows_follow_database)
+		{
+			char buf[256];
+
+			/* another box queues a caller of its own */
+			fst_requires(cc_db_exec("insert into members (queue, instance_id, uuid, session_uuid, cid_number, cid_name, system_epoch, joined_epoch, "
+									"base_score, skill_score, serving_agent, serving_system, state) values ('support@default', 'otherbox', 'foreign-1', "
+									"'foreign-session-1', '2001', 'foreign', 0, 0, 0, 0, '', '', 'Waiting')"));
+			fst_check(wait_api("queue list members support@default", "support@default|otherbox|foreign-1|", SWITCH_TRUE));
+			fst_check(wait_api("queue count members support@default", "2", SWITCH_TRUE));
+
+			/* it is theirs to serve, our agent is left alone */
+			switch_sleep(2000000);
+			fst_check(wait_api("agent get state 1000@default", "Waiting", SWITCH_TRUE));
+			fst_check(wait_api("queue list members support@default", "|2001|foreign|", SWITCH_TRUE));
+
+			/* and an agent they put on a break shows here */
+			fst_requires(cc_db_exec("update agents set status='On Break' where name='1000@default'"));
+			fst_check(wait_api("agent get status 1000@default", "On Break", SWITCH_TRUE));
+
+			/* our own changes reach the table right away */
+			fst_check(wait_api("agent set status 1000@default Available", "+OK", SWITCH_TRUE));
+			fst_check_string_equals(cc_db_str("select status from agents where name='1000@default'", buf, sizeof(buf)), "Available");
+
+			fst_requires(cc_db_exec("delete from members where uuid='foreign-1'"));
+			fst_check(wait_api("queue list members support@default", "foreign-1", SWITCH_FALSE));
+		}
+		FST_TEST_END()
+	}
+	FST_MODULE_END()
+}
+FST_CORE_END()
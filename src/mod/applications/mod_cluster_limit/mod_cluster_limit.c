@@ -0,0 +1,1059 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * mod_cluster_limit.c -- In-memory limit backend replicated between nodes
+ *
+ * Every node keeps, for each resource, the number of increments (P) and
+ * decrements (N) each node of the cluster has made.  A node only ever
+ * changes its own counters and those only grow, so a peer's update is
+ * merged by taking the larger value of each field and the usage of a
+ * resource is the sum of P - N over all nodes.  Updates are pushed to the
+ * peers over UDP in batches; losing or reordering a datagram is harmless
+ * and the periodic full sync repairs whatever was lost.
+ *
+ */
+
+#include <switch.h>
+
+#define CLUSTER_LIMIT_MAX_NODES 32
+#define CLUSTER_LIMIT_MAX_KEY 512
+#define CLUSTER_LIMIT_PACKET_SIZE 1400
+#define CLUSTER_LIMIT_MAGIC "PNC1"
+#define CLUSTER_LIMIT_SYNTAX "status | usage <realm> <resource>"
+
+SWITCH_MODULE_LOAD_FUNCTION(mod_cluster_limit_load);
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_cluster_limit_shutdown);
+SWITCH_MODULE_DEFINITION(mod_cluster_limit, mod_cluster_limit_load, mod_cluster_limit_shutdown, NULL);
+
+/* One node's share of a resource.  For a given incarnation of a node every
+ * field only grows, the rate count restarting with each new window. */
+typedef struct {
+	uint64_t p;
+	uint64_t n;
+	uint64_t window;
+	uint32_t window_count;
+} cluster_counter_t;
+
+typedef struct cluster_item_s {
+	cluster_counter_t counters[CLUSTER_LIMIT_MAX_NODES];
+	/* sum of p - n over all the nodes, kept up to date by every merge */
+	int64_t usage;
+	int interval;
+	switch_bool_t dirty;
+	struct cluster_item_s *next_dirty;
+	char key[1];
+} cluster_item_t;
+
+typedef struct {
+	int id;
+	char *host;
+	switch_port_t port;
+	switch_sockaddr_t *addr;
+	switch_time_t incarnation;
+	uint64_t last_seq;
+	uint64_t packets;
+	uint64_t deltas;
+	uint64_t gaps;
+	uint64_t reordered;
+	uint64_t stale;
+	/* totals of what we merged from the node against what it says it has */
+	uint64_t view_p;
+	uint64_t view_n;
+	uint64_t reported_p;
+	uint64_t reported_n;
+	switch_time_t last_heard;
+	/* went silent for longer than peer-timeout and had its usage dropped */
+	switch_bool_t timed_out;
+	switch_time_t lag_last;
+	switch_time_t lag_avg;
+	switch_time_t lag_max;
+} cluster_node_t;
+
+typedef struct {
+	switch_hash_t *hash;
+} limit_cluster_private_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_hash_t *items;
+	int item_count;
+	cluster_item_t *dirty;
+	cluster_node_t nodes[CLUSTER_LIMIT_MAX_NODES];
+	int self;
+	switch_time_t incarnation;
+	uint64_t seq;
+	char *listen_ip;
+	switch_port_t listen_port;
+	int flush_interval;
+	int sync_interval;
+	int peer_timeout;
+	switch_socket_t *socket;
+	switch_thread_t *send_thread;
+	switch_thread_t *recv_thread;
+	switch_bool_t running;
+	uint64_t packets_out;
+	uint64_t bytes_out;
+	uint64_t send_errors;
+	uint64_t packets_in;
+	uint64_t bad_packets;
+	uint64_t foreign_packets;
+} globals;
+
+/* !\brief Finds an item, creating it if asked to.  Call with globals.mutex held.
+ * Items live until shutdown: forgetting our own counters would make peers
+ * ignore everything we send about that resource afterwards. */
+static cluster_item_t *cluster_item_locate(const char *key, switch_bool_t create)
+{
+	cluster_item_t *item;
+	size_t len;
+
+	if ((item = switch_core_hash_find(globals.items, key)) || !create) {
+		return item;
+	}
+
+	len = strlen(key);
+	switch_zmalloc(item, sizeof(*item) + len);
+	memcpy(item->key, key, len + 1);
+	switch_core_hash_insert(globals.items, item->key, item);
+	globals.item_count++;
+
+	return item;
+}
+
+/* !\brief Queues an item whose local counters changed for replication */
+static void cluster_item_touch(cluster_item_t *item)
+{
+	if (!item->dirty) {
+		item->dirty = SWITCH_TRUE;
+		item->next_dirty = globals.dirty;
+		globals.dirty = item;
+		switch_thread_cond_signal(globals.cond);
+	}
+}
+
+/* !\brief Cluster-wide count for the current rate window of an item */
+static uint32_t cluster_item_rate(cluster_item_t *item, switch_time_t now)
+{
+	uint64_t window;
+	uint32_t count = 0;
+	int i;
+
+	if (item->interval <= 0) {
+		return 0;
+	}
+
+	window = (uint64_t) now / item->interval;
+
+	for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+		if (item->counters[i].window == window) {
+			count += item->counters[i].window_count;
+		}
+	}
+
+	return count;
+}
+
+/* !\brief Merges a node's counters for a resource.  Call with globals.mutex held. */
+static void cluster_merge(cluster_node_t *node, const char *key, uint64_t p, uint64_t n, int interval, uint64_t window, uint32_t window_count)
+{
+	cluster_item_t *item = cluster_item_locate(key, SWITCH_TRUE);
+	cluster_counter_t *counter = &item->counters[node->id - 1];
+
+	if (p > counter->p) {
+		item->usage += p - counter->p;
+		node->view_p += p - counter->p;
+		counter->p = p;
+	}
+
+	if (n > counter->n) {
+		item->usage -= n - counter->n;
+		node->view_n += n - counter->n;
+		counter->n = n;
+	}
+
+	if (window > counter->window) {
+		counter->window = window;
+		counter->window_count = window_count;
+	} else if (window == counter->window && window_count > counter->window_count) {
+		counter->window_count = window_count;
+	}
+
+	if (interval > 0) {
+		item->interval = interval;
+	}
+
+	node->deltas++;
+}
+
+/* !\brief Forgets everything a restarted node had, its calls went away with it */
+static void cluster_node_reset(cluster_node_t *node)
+{
+	switch_hash_index_t *hi;
+
+	for (hi = switch_core_hash_first(globals.items); hi; hi = switch_core_hash_next(&hi)) {
+		void *val;
+		cluster_item_t *item;
+		cluster_counter_t *counter;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		item = (cluster_item_t *) val;
+		counter = &item->counters[node->id - 1];
+		item->usage -= (int64_t) (counter->p - counter->n);
+		memset(counter, 0, sizeof(*counter));
+	}
+
+	node->view_p = node->view_n = 0;
+	node->reported_p = node->reported_n = 0;
+	node->last_seq = 0;
+}
+
+static switch_bool_t cluster_node_converged(cluster_node_t *node)
+{
+	if (node->id == globals.self + 1) {
+		return SWITCH_TRUE;
+	}
+
+	return node->last_heard && !node->timed_out && node->view_p == node->reported_p && node->view_n == node->reported_n;
+}
+
+/* !\brief Serializes our own counters for an item.  Call with globals.mutex held. */
+static void cluster_item_serialize(switch_buffer_t *buffer, cluster_item_t *item)
+{
+	cluster_counter_t *counter = &item->counters[globals.self];
+	char line[CLUSTER_LIMIT_MAX_KEY + 128];
+	size_t len;
+
+	if (strlen(item->key) > CLUSTER_LIMIT_MAX_KEY) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Not replicating %s, the key is too long\n", item->key);
+		return;
+	}
+
+	switch_snprintf(line, sizeof(line), "%" SWITCH_UINT64_T_FMT " %" SWITCH_UINT64_T_FMT " %d %" SWITCH_UINT64_T_FMT " %u %s\n",
+					counter->p, counter->n, item->interval, counter->window, counter->window_count, item->key);
+	len = strlen(line);
+	switch_buffer_write(buffer, line, len);
+}
+
+/* !\brief Splits serialized counters into datagrams and sends them to every peer.
+ * An empty buffer still sends the header, which doubles as the heartbeat.
+ * Called without globals.mutex, the statistics are added under it at the end. */
+static void cluster_send_buffer(switch_buffer_t *buffer, uint64_t total_p, uint64_t total_n)
+{
+	const void *ptr = NULL;
+	const char *data, *end;
+	switch_size_t inuse = switch_buffer_peek_zerocopy(buffer, &ptr);
+	uint64_t packets = 0, bytes = 0, errors = 0;
+
+	data = (const char *) ptr;
+	end = data + inuse;
+
+	do {
+		char packet[CLUSTER_LIMIT_PACKET_SIZE];
+		size_t len;
+		int i;
+
+		switch_snprintf(packet, sizeof(packet), CLUSTER_LIMIT_MAGIC " %d %" SWITCH_TIME_T_FMT " %" SWITCH_UINT64_T_FMT " %" SWITCH_TIME_T_FMT
+						" %" SWITCH_UINT64_T_FMT " %" SWITCH_UINT64_T_FMT "\n",
+						globals.self + 1, globals.incarnation, ++globals.seq, switch_micro_time_now(), total_p, total_n);
+		len = strlen(packet);
+
+		/* whole lines only */
+		while (data && data < end) {
+			const char *eol = memchr(data, '\n', end - data);
+			size_t line_len = eol - data + 1;
+
+			if (len + line_len > sizeof(packet)) {
+				break;
+			}
+
+			memcpy(packet + len, data, line_len);
+			len += line_len;
+			data += line_len;
+		}
+
+		for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+			cluster_node_t *node = &globals.nodes[i];
+			switch_size_t send_len = len;
+
+			if (!node->addr) {
+				continue;
+			}
+
+			if (switch_socket_sendto(globals.socket, node->addr, 0, packet, &send_len) != SWITCH_STATUS_SUCCESS) {
+				errors++;
+			} else {
+				packets++;
+				bytes += send_len;
+			}
+		}
+	} while (data && data < end);
+
+	switch_mutex_lock(globals.mutex);
+	globals.packets_out += packets;
+	globals.bytes_out += bytes;
+	globals.send_errors += errors;
+	switch_mutex_unlock(globals.mutex);
+}
+
+/* !\brief Drops the usage of peers that went silent, their calls can't be
+ * told apart from calls that are gone.  Call with globals.mutex held. */
+static void cluster_node_expire(switch_time_t now)
+{
+	int i;
+
+	for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+		cluster_node_t *node = &globals.nodes[i];
+
+		if (i == globals.self || !node->last_heard || node->timed_out || now - node->last_heard < (switch_time_t) globals.peer_timeout * 1000) {
+			continue;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cluster node %d not heard for %" SWITCH_TIME_T_FMT "ms, dropping its usage\n",
+						  node->id, (now - node->last_heard) / 1000);
+		cluster_node_reset(node);
+		node->timed_out = SWITCH_TRUE;
+	}
+}
+
+static void *SWITCH_THREAD_FUNC cluster_send_thread(switch_thread_t *thread, void *obj)
+{
+	switch_buffer_t *buffer = NULL;
+	switch_time_t next_sync = 0;
+
+	switch_buffer_create_dynamic(&buffer, 4096, 4096, 0);
+
+	switch_mutex_lock(globals.mutex);
+
+	while (globals.running) {
+		switch_time_t now = switch_micro_time_now();
+		switch_bool_t sync = now >= next_sync;
+		uint64_t total_p, total_n;
+
+		if (globals.peer_timeout > 0) {
+			cluster_node_expire(now);
+		}
+
+		if (!globals.dirty && !sync) {
+			switch_thread_cond_timedwait(globals.cond, globals.mutex, next_sync - now);
+			continue;
+		}
+
+		/* everything goes out on a sync, otherwise only what changed */
+		while (globals.dirty) {
+			cluster_item_t *item = globals.dirty;
+
+			globals.dirty = item->next_dirty;
+			item->next_dirty = NULL;
+			item->dirty = SWITCH_FALSE;
+
+			if (!sync) {
+				cluster_item_serialize(buffer, item);
+			}
+		}
+
+		if (sync) {
+			switch_hash_index_t *hi;
+
+			for (hi = switch_core_hash_first(globals.items); hi; hi = switch_core_hash_next(&hi)) {
+				void *val;
+				cluster_item_t *item;
+
+				switch_core_hash_this(hi, NULL, NULL, &val);
+				item = (cluster_item_t *) val;
+
+				if (item->counters[globals.self].p || item->counters[globals.self].window_count) {
+					cluster_item_serialize(buffer, item);
+				}
+			}
+
+			next_sync = now + globals.sync_interval * 1000;
+		}
+
+		total_p = globals.nodes[globals.self].view_p;
+		total_n = globals.nodes[globals.self].view_n;
+		switch_mutex_unlock(globals.mutex);
+
+		cluster_send_buffer(buffer, total_p, total_n);
+		switch_buffer_zero(buffer);
+
+		/* let changes pile up a little so they share datagrams */
+		if (globals.flush_interval > 0) {
+			switch_yield(globals.flush_interval * 1000);
+		}
+
+		switch_mutex_lock(globals.mutex);
+	}
+
+	switch_mutex_unlock(globals.mutex);
+
+	switch_buffer_destroy(&buffer);
+
+	return NULL;
+}
+
+/* !\brief Applies one datagram from a peer */
+static void cluster_receive(switch_sockaddr_t *from, char *packet)
+{
+	char *header = packet, *body, *argv[8] = { 0 };
+	cluster_node_t *node;
+	switch_time_t incarnation, sent, now;
+	uint64_t seq, total_p, total_n;
+	int argc, id;
+
+	if ((body = strchr(packet, '\n'))) {
+		*body++ = '\0';
+	}
+
+	argc = switch_separate_string(header, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+
+	if (argc != 7 || strcmp(argv[0], CLUSTER_LIMIT_MAGIC)) {
+		globals.bad_packets++;
+		return;
+	}
+
+	id = atoi(argv[1]);
+
+	if (id < 1 || id > CLUSTER_LIMIT_MAX_NODES || id == globals.self + 1) {
+		globals.bad_packets++;
+		return;
+	}
+
+	node = &globals.nodes[id - 1];
+
+	/* only a configured peer may speak for its node id */
+	if (!node->addr || !switch_cmp_addr(from, node->addr, SWITCH_FALSE)) {
+		switch_mutex_lock(globals.mutex);
+		globals.foreign_packets++;
+		switch_mutex_unlock(globals.mutex);
+		return;
+	}
+
+	incarnation = (switch_time_t) strtoll(argv[2], NULL, 10);
+	seq = strtoull(argv[3], NULL, 10);
+	sent = (switch_time_t) strtoll(argv[4], NULL, 10);
+	total_p = strtoull(argv[5], NULL, 10);
+	total_n = strtoull(argv[6], NULL, 10);
+	now = switch_micro_time_now();
+
+	switch_mutex_lock(globals.mutex);
+
+	globals.packets_in++;
+
+	if (incarnation < node->incarnation) {
+		/* left over from before the node restarted */
+		node->stale++;
+		goto end;
+	}
+
+	if (incarnation > node->incarnation) {
+		if (node->incarnation) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Cluster node %d restarted, dropping its usage\n", id);
+			cluster_node_reset(node);
+		}
+		node->incarnation = incarnation;
+	}
+
+	if (node->timed_out) {
+		/* its next full sync brings the usage back */
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Cluster node %d is back\n", id);
+		node->timed_out = SWITCH_FALSE;
+	}
+
+	node->packets++;
+	node->last_heard = now;
+
+	/* sent times are only comparable with synchronized clocks */
+	node->lag_last = now > sent ? now - sent : 0;
+	node->lag_avg = node->lag_avg ? node->lag_avg + (node->lag_last - node->lag_avg) / 8 : node->lag_last;
+	if (node->lag_last > node->lag_max) {
+		node->lag_max = node->lag_last;
+	}
+
+	if (seq > node->last_seq) {
+		if (node->last_seq && seq > node->last_seq + 1) {
+			node->gaps += seq - node->last_seq - 1;
+		}
+		node->last_seq = seq;
+		node->reported_p = total_p;
+		node->reported_n = total_n;
+	} else {
+		node->reordered++;
+	}
+
+	while (body && *body) {
+		char *line = body, *p, *key;
+		uint64_t cp, cn, window;
+		uint32_t window_count;
+		int interval;
+
+		if ((body = strchr(line, '\n'))) {
+			*body++ = '\0';
+		}
+
+		cp = strtoull(line, &p, 10);
+		cn = strtoull(p, &p, 10);
+		interval = (int) strtol(p, &p, 10);
+		window = strtoull(p, &p, 10);
+		window_count = (uint32_t) strtoul(p, &p, 10);
+
+		if (*p != ' ' || zstr((key = p + 1))) {
+			globals.bad_packets++;
+			continue;
+		}
+
+		cluster_merge(node, key, cp, cn, interval, window, window_count);
+	}
+
+  end:
+	switch_mutex_unlock(globals.mutex);
+}
+
+static void *SWITCH_THREAD_FUNC cluster_recv_thread(switch_thread_t *thread, void *obj)
+{
+	switch_sockaddr_t *from = NULL;
+	char packet[CLUSTER_LIMIT_PACKET_SIZE + 1];
+
+	switch_sockaddr_create(&from, globals.pool);
+
+	while (globals.running) {
+		size_t len = CLUSTER_LIMIT_PACKET_SIZE;
+
+		if (switch_socket_recvfrom(from, globals.socket, 0, packet, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			continue;
+		}
+
+		packet[len] = '\0';
+		cluster_receive(from, packet);
+	}
+
+	return NULL;
+}
+
+/* \brief Enforces cluster-wide limits
+ * \param session current session
+ * \param realm limit realm
+ * \param id limit id
+ * \param max maximum count
+ * \param interval interval for rate limiting
+ * \return SWITCH_TRUE if the access is allowed, SWITCH_FALSE if it isnt
+ */
+SWITCH_LIMIT_INCR(limit_incr_cluster)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	char *hashkey = NULL;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	limit_cluster_private_t *pvt = NULL;
+	cluster_item_t *item = NULL;
+	cluster_counter_t *counter;
+	uint8_t increment = 1;
+	int64_t total_usage;
+	uint32_t rate_usage = 0;
+
+	hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
+
+	if (!(pvt = switch_channel_get_private(channel, "limit_cluster"))) {
+		pvt = (limit_cluster_private_t *) switch_core_session_alloc(session, sizeof(limit_cluster_private_t));
+		switch_channel_set_private(channel, "limit_cluster", pvt);
+	}
+	if (!(pvt->hash)) {
+		switch_core_hash_init(&pvt->hash);
+	}
+	increment = !switch_core_hash_find(pvt->hash, hashkey);
+
+	switch_mutex_lock(globals.mutex);
+
+	item = cluster_item_locate(hashkey, SWITCH_TRUE);
+	counter = &item->counters[globals.self];
+
+	if (interval > 0) {
+		uint64_t window = (uint64_t) switch_epoch_time_now(NULL) / interval;
+
+		item->interval = interval;
+
+		if (counter->window < window) {
+			counter->window = window;
+			counter->window_count = 0;
+		}
+
+		rate_usage = cluster_item_rate(item, switch_epoch_time_now(NULL));
+
+		if ((max >= 0) && (rate_usage + 1 > (uint32_t) max)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s exceeds maximum rate of %d/%ds, now at %d\n",
+							  hashkey, max, interval, rate_usage);
+			status = SWITCH_STATUS_GENERR;
+		} else {
+			/* Always increment rate when its checked as it doesnt depend on the channel */
+			counter->window_count++;
+			rate_usage++;
+			cluster_item_touch(item);
+		}
+	} else if ((max >= 0) && (item->usage + increment > max)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, (int) item->usage);
+		status = SWITCH_STATUS_GENERR;
+	}
+
+	if (status == SWITCH_STATUS_SUCCESS && increment) {
+		counter->p++;
+		item->usage++;
+		globals.nodes[globals.self].view_p++;
+		cluster_item_touch(item);
+	}
+
+	total_usage = item->usage;
+
+	switch_mutex_unlock(globals.mutex);
+
+	if (status != SWITCH_STATUS_SUCCESS) {
+		return status;
+	}
+
+	if (increment) {
+		switch_core_hash_insert(pvt->hash, hashkey, item);
+
+		if (max == -1) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, (int) total_usage);
+		} else if (interval == 0) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d\n", hashkey, (int) total_usage, max);
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d for the last %d seconds\n", hashkey,
+							  rate_usage, max, interval);
+		}
+
+		switch_limit_fire_event("cluster", realm, resource, (uint32_t) total_usage, rate_usage, max, max >= 0 ? (uint32_t) max : 0);
+	}
+
+	/* Save current usage & rate into channel variables so it can be used later in the dialplan, or added to CDR records */
+	{
+		const char *susage = switch_core_session_sprintf(session, "%d", (int) total_usage);
+		const char *srate = switch_core_session_sprintf(session, "%d", rate_usage);
+
+		switch_channel_set_variable(channel, "limit_usage", susage);
+		switch_channel_set_variable(channel, switch_core_session_sprintf(session, "limit_usage_%s", hashkey), susage);
+
+		switch_channel_set_variable(channel, "limit_rate", srate);
+		switch_channel_set_variable(channel, switch_core_session_sprintf(session, "limit_rate_%s", hashkey), srate);
+	}
+
+	return status;
+}
+
+/* !\brief Gives back one channel's use of a resource */
+static void cluster_item_release(switch_core_session_t *session, const char *hashkey)
+{
+	cluster_item_t *item;
+
+	switch_mutex_lock(globals.mutex);
+	if ((item = cluster_item_locate(hashkey, SWITCH_FALSE))) {
+		item->counters[globals.self].n++;
+		item->usage--;
+		globals.nodes[globals.self].view_n++;
+		cluster_item_touch(item);
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, (int) item->usage);
+	}
+	switch_mutex_unlock(globals.mutex);
+}
+
+/* !\brief Releases usage of a cluster-controlled resource  */
+SWITCH_LIMIT_RELEASE(limit_release_cluster)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	limit_cluster_private_t *pvt = switch_channel_get_private(channel, "limit_cluster");
+
+	if (!pvt || !pvt->hash) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	/* clear for uuid */
+	if (realm == NULL && resource == NULL) {
+		switch_hash_index_t *hi = NULL;
+
+		while ((hi = switch_core_hash_first_iter(pvt->hash, hi))) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+
+			switch_core_hash_this(hi, &key, &keylen, &val);
+
+			cluster_item_release(session, (const char *) key);
+
+			switch_core_hash_delete(pvt->hash, (const char *) key);
+		}
+		switch_core_hash_destroy(&pvt->hash);
+	} else {
+		char *hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
+
+		if (switch_core_hash_find(pvt->hash, hashkey)) {
+			cluster_item_release(session, hashkey);
+			switch_core_hash_delete(pvt->hash, hashkey);
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_LIMIT_USAGE(limit_usage_cluster)
+{
+	char *hash_key = switch_mprintf("%s_%s", realm, resource);
+	cluster_item_t *item;
+	int count = 0;
+
+	*rcount = 0;
+
+	switch_mutex_lock(globals.mutex);
+	if ((item = cluster_item_locate(hash_key, SWITCH_FALSE))) {
+		count = item->usage > 0 ? (int) item->usage : 0;
+		*rcount = cluster_item_rate(item, switch_epoch_time_now(NULL));
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(hash_key);
+
+	return count;
+}
+
+SWITCH_LIMIT_RESET(limit_reset_cluster)
+{
+	return SWITCH_STATUS_GENERR;
+}
+
+/* Peers only accept counts that grow, so one node can't rewind a window for everyone */
+SWITCH_LIMIT_INTERVAL_RESET(limit_interval_reset_cluster)
+{
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Rate windows of the cluster backend can't be reset, %s_%s will clear with the next window\n",
+					  realm, resource);
+	return SWITCH_STATUS_GENERR;
+}
+
+SWITCH_LIMIT_STATUS(limit_status_cluster)
+{
+	int count, peers = 0, converged = 0;
+	int i;
+
+	switch_mutex_lock(globals.mutex);
+	count = globals.item_count;
+	for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+		cluster_node_t *node = &globals.nodes[i];
+
+		if (i == globals.self || (!node->addr && !node->incarnation)) {
+			continue;
+		}
+
+		peers++;
+		if (cluster_node_converged(node)) {
+			converged++;
+		}
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	return switch_mprintf("There are %d elements being tracked, %d of %d peers converged.", count, converged, peers);
+}
+
+SWITCH_STANDARD_API(cluster_limit_function)
+{
+	char *mydata = NULL, *argv[3] = { 0 };
+	int argc = 0, i;
+	switch_time_t now = switch_micro_time_now();
+
+	if (!zstr(cmd)) {
+		mydata = strdup(cmd);
+		switch_assert(mydata);
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc == 1 && !strcasecmp(argv[0], "status")) {
+		cluster_node_t *self = &globals.nodes[globals.self];
+
+		switch_mutex_lock(globals.mutex);
+
+		stream->write_function(stream, "node %d (self) %s:%d items %d p %" SWITCH_UINT64_T_FMT " n %" SWITCH_UINT64_T_FMT
+							   " packets out %" SWITCH_UINT64_T_FMT " bytes out %" SWITCH_UINT64_T_FMT " send errors %" SWITCH_UINT64_T_FMT
+							   " packets in %" SWITCH_UINT64_T_FMT " bad %" SWITCH_UINT64_T_FMT " foreign %" SWITCH_UINT64_T_FMT "\n",
+							   self->id, globals.listen_ip, globals.listen_port, globals.item_count, self->view_p, self->view_n,
+							   globals.packets_out, globals.bytes_out, globals.send_errors, globals.packets_in, globals.bad_packets, globals.foreign_packets);
+
+		for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+			cluster_node_t *node = &globals.nodes[i];
+
+			if (i == globals.self || (!node->addr && !node->incarnation)) {
+				continue;
+			}
+
+			stream->write_function(stream, "node %d %s:%d", node->id, node->host ? node->host : "unknown", node->port);
+
+			if (!node->last_heard) {
+				stream->write_function(stream, " never heard converged no\n");
+				continue;
+			}
+
+			stream->write_function(stream, " heard %" SWITCH_TIME_T_FMT "ms ago%s packets %" SWITCH_UINT64_T_FMT " deltas %" SWITCH_UINT64_T_FMT
+								   " gaps %" SWITCH_UINT64_T_FMT " reordered %" SWITCH_UINT64_T_FMT " stale %" SWITCH_UINT64_T_FMT
+								   " lag last/avg/max %.2f/%.2f/%.2fms p %" SWITCH_UINT64_T_FMT "/%" SWITCH_UINT64_T_FMT
+								   " n %" SWITCH_UINT64_T_FMT "/%" SWITCH_UINT64_T_FMT " converged %s\n",
+								   (now - node->last_heard) / 1000, node->timed_out ? " timed out" : "", node->packets, node->deltas, node->gaps, node->reordered, node->stale,
+								   node->lag_last / 1000.0, node->lag_avg / 1000.0, node->lag_max / 1000.0,
+								   node->view_p, node->reported_p, node->view_n, node->reported_n,
+								   cluster_node_converged(node) ? "yes" : "no");
+		}
+
+		switch_mutex_unlock(globals.mutex);
+	} else if (argc == 3 && !strcasecmp(argv[0], "usage")) {
+		char *hash_key = switch_mprintf("%s_%s", argv[1], argv[2]);
+		cluster_item_t *item;
+
+		switch_mutex_lock(globals.mutex);
+		if ((item = cluster_item_locate(hash_key, SWITCH_FALSE))) {
+			stream->write_function(stream, "%s usage %d rate %u\n", hash_key, (int) item->usage, cluster_item_rate(item, switch_epoch_time_now(NULL)));
+			for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+				cluster_counter_t *counter = &item->counters[i];
+
+				if (counter->p || counter->n || counter->window_count) {
+					stream->write_function(stream, "node %d p %" SWITCH_UINT64_T_FMT " n %" SWITCH_UINT64_T_FMT " window %" SWITCH_UINT64_T_FMT " count %u\n",
+										   i + 1, counter->p, counter->n, counter->window, counter->window_count);
+				}
+			}
+		} else {
+			stream->write_function(stream, "-ERR %s is not tracked\n", hash_key);
+		}
+		switch_mutex_unlock(globals.mutex);
+
+		switch_safe_free(hash_key);
+	} else {
+		stream->write_function(stream, "-USAGE: %s\n", CLUSTER_LIMIT_SYNTAX);
+	}
+
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t do_config(void)
+{
+	switch_xml_t xml = NULL, cfg = NULL, settings, param, nodes, x_node;
+	int node_id = 1;
+
+	globals.listen_ip = "127.0.0.1";
+	globals.flush_interval = 5;
+	globals.sync_interval = 1000;
+	globals.peer_timeout = 10000;
+
+	if (!(xml = switch_xml_open_cfg("cluster_limit.conf", &cfg, NULL))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Open of cluster_limit.conf failed, running standalone\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if ((settings = switch_xml_child(cfg, "settings"))) {
+		for (param = switch_xml_child(settings, "param"); param; param = param->next) {
+			char *var = (char *) switch_xml_attr_soft(param, "name");
+			char *val = (char *) switch_xml_attr_soft(param, "value");
+
+			if (!strcasecmp(var, "node-id")) {
+				node_id = atoi(val);
+			} else if (!strcasecmp(var, "listen-ip")) {
+				globals.listen_ip = switch_core_strdup(globals.pool, val);
+			} else if (!strcasecmp(var, "listen-port")) {
+				globals.listen_port = (switch_port_t) atoi(val);
+			} else if (!strcasecmp(var, "flush-interval")) {
+				globals.flush_interval = atoi(val);
+			} else if (!strcasecmp(var, "sync-interval")) {
+				globals.sync_interval = atoi(val);
+			} else if (!strcasecmp(var, "peer-timeout")) {
+				globals.peer_timeout = atoi(val);
+			}
+		}
+	}
+
+	if (node_id < 1 || node_id > CLUSTER_LIMIT_MAX_NODES) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "node-id must be between 1 and %d\n", CLUSTER_LIMIT_MAX_NODES);
+		switch_xml_free(xml);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (globals.sync_interval < 100) {
+		globals.sync_interval = 100;
+	}
+
+	/* a peer must get to miss a few syncs */
+	if (globals.peer_timeout > 0 && globals.peer_timeout < globals.sync_interval * 3) {
+		globals.peer_timeout = globals.sync_interval * 3;
+	}
+
+	globals.self = node_id - 1;
+
+	if ((nodes = switch_xml_child(cfg, "nodes"))) {
+		for (x_node = switch_xml_child(nodes, "node"); x_node; x_node = x_node->next) {
+			const char *id = switch_xml_attr(x_node, "id");
+			const char *host = switch_xml_attr(x_node, "host");
+			const char *port = switch_xml_attr(x_node, "port");
+			int i = id ? atoi(id) : 0;
+			cluster_node_t *node;
+
+			if (i < 1 || i > CLUSTER_LIMIT_MAX_NODES || zstr(host) || zstr(port)) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Ignoring node with invalid id, host or port\n");
+				continue;
+			}
+
+			if (i == node_id) {
+				continue;
+			}
+
+			node = &globals.nodes[i - 1];
+			node->host = switch_core_strdup(globals.pool, host);
+			node->port = (switch_port_t) atoi(port);
+
+			if (switch_sockaddr_info_get(&node->addr, node->host, SWITCH_UNSPEC, node->port, 0, globals.pool) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't resolve cluster node %d at %s\n", i, host);
+				node->addr = NULL;
+			}
+		}
+	}
+
+	switch_xml_free(xml);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* INIT/DEINIT STUFF */
+SWITCH_MODULE_LOAD_FUNCTION(mod_cluster_limit_load)
+{
+	switch_api_interface_t *api_interface;
+	switch_limit_interface_t *limit_interface;
+	switch_status_t status;
+	int i;
+
+	memset(&globals, 0, sizeof(globals));
+	globals.pool = pool;
+	globals.incarnation = switch_micro_time_now();
+
+	for (i = 0; i < CLUSTER_LIMIT_MAX_NODES; i++) {
+		globals.nodes[i].id = i + 1;
+	}
+
+	if (do_config() != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	status = switch_event_reserve_subclass(LIMIT_EVENT_USAGE);
+	if (status != SWITCH_STATUS_SUCCESS && status != SWITCH_STATUS_INUSE) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register event subclass \"%s\" (%d)\n", LIMIT_EVENT_USAGE, status);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_UNNESTED, globals.pool);
+	switch_thread_cond_create(&globals.cond, globals.pool);
+	switch_core_hash_init(&globals.items);
+
+	if (globals.listen_port) {
+		switch_sockaddr_t *addr = NULL;
+		switch_threadattr_t *thd_attr = NULL;
+
+		if (switch_sockaddr_info_get(&addr, globals.listen_ip, SWITCH_UNSPEC, globals.listen_port, 0, globals.pool) != SWITCH_STATUS_SUCCESS ||
+			switch_socket_create(&globals.socket, switch_sockaddr_get_family(addr), SOCK_DGRAM, 0, globals.pool) != SWITCH_STATUS_SUCCESS ||
+			switch_socket_opt_set(globals.socket, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS ||
+			switch_socket_bind(globals.socket, addr) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to bind %s:%d\n", globals.listen_ip, globals.listen_port);
+			switch_core_hash_destroy(&globals.items);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		/* wake up periodically to check if we're done */
+		switch_socket_timeout_set(globals.socket, 100000);
+
+		globals.running = SWITCH_TRUE;
+
+		switch_threadattr_create(&thd_attr, globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&globals.recv_thread, thd_attr, cluster_recv_thread, NULL, globals.pool);
+		switch_thread_create(&globals.send_thread, thd_attr, cluster_send_thread, NULL, globals.pool);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Cluster limit node %d listening on %s:%d\n", globals.self + 1, globals.listen_ip, globals.listen_port);
+	}
+
+	/* connect my internal structure to the blank pointer passed to me */
+	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
+
+	/* register limit interfaces */
+	SWITCH_ADD_LIMIT(limit_interface, "cluster", limit_incr_cluster, limit_release_cluster, limit_usage_cluster, limit_reset_cluster, limit_status_cluster, limit_interval_reset_cluster);
+
+	SWITCH_ADD_API(api_interface, "cluster_limit", "cluster limit status", cluster_limit_function, CLUSTER_LIMIT_SYNTAX);
+
+	switch_console_set_complete("add cluster_limit status");
+	switch_console_set_complete("add cluster_limit usage");
+
+	/* indicate that the module should continue to be loaded */
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_cluster_limit_shutdown)
+{
+	switch_hash_index_t *hi = NULL;
+	switch_status_t st;
+
+	switch_mutex_lock(globals.mutex);
+	globals.running = SWITCH_FALSE;
+	switch_thread_cond_signal(globals.cond);
+	switch_mutex_unlock(globals.mutex);
+
+	if (globals.send_thread) {
+		switch_thread_join(&st, globals.send_thread);
+	}
+
+	if (globals.recv_thread) {
+		switch_thread_join(&st, globals.recv_thread);
+	}
+
+	if (globals.socket) {
+		switch_socket_close(globals.socket);
+	}
+
+	while ((hi = switch_core_hash_first_iter(globals.items, hi))) {
+		void *val = NULL;
+		const void *key;
+		switch_ssize_t keylen;
+
+		switch_core_hash_this(hi, &key, &keylen, &val);
+		switch_core_hash_delete(globals.items, key);
+		free(val);
+	}
+	switch_core_hash_destroy(&globals.items);
+
+	switch_thread_cond_destroy(globals.cond);
+	switch_mutex_destroy(globals.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
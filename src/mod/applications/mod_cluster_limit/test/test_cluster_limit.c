@@ -0,0 +1,339 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * test_cluster_limit.c - Tests the cluster limit backend against a peer on loopback
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// Run test
+// make && libtool --mode=execute ./test/test_cluster_limit
+
+#define NODE1_PORT 28431
+#define NODE2_PORT 28432
+#define STRANGER_PORT 28433
+#define NODE2_INCARNATION 1000
+#define PACKET_SIZE 1400
+
+/**
+ * Node 2 of the cluster, played by the test over the wire protocol.
+ * The socket lives in each test's pool, the sequence carries on.
+ */
+struct peer {
+	switch_socket_t *sock;
+	switch_sockaddr_t *node1;
+	switch_sockaddr_t *from;
+	switch_time_t incarnation;
+	uint64_t seq;
+};
+
+static struct peer peer = { 0 };
+
+static switch_status_t peer_open(struct peer *peer, switch_memory_pool_t *pool)
+{
+	switch_sockaddr_t *addr = NULL;
+
+	if (!peer->incarnation) {
+		peer->incarnation = NODE2_INCARNATION;
+	}
+
+	if (switch_sockaddr_info_get(&addr, "127.0.0.1", SWITCH_INET, NODE2_PORT, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_sockaddr_info_get(&peer->node1, "127.0.0.1", SWITCH_INET, NODE1_PORT, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_sockaddr_create(&peer->from, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&peer->sock, AF_INET, SOCK_DGRAM, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_opt_set(peer->sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_bind(peer->sock, addr) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_socket_timeout_set(peer->sock, 100000);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/**
+ * Send node 2's counters, one "p n interval window count key" line each
+ */
+static void peer_send(struct peer *peer, uint64_t total_p, uint64_t total_n, const char *lines)
+{
+	char packet[PACKET_SIZE];
+	switch_size_t len;
+
+	switch_snprintf(packet, sizeof(packet), "PNC1 2 %" SWITCH_TIME_T_FMT " %" SWITCH_UINT64_T_FMT " %" SWITCH_TIME_T_FMT " %" SWITCH_UINT64_T_FMT " %" SWITCH_UINT64_T_FMT "\n%s",
+					peer->incarnation, ++peer->seq, switch_micro_time_now(), total_p, total_n, lines ? lines : "");
+	len = strlen(packet);
+	switch_socket_sendto(peer->sock, peer->node1, 0, packet, &len);
+}
+
+/**
+ * Wait for node 1 to send the given counters for a key
+ */
+static switch_bool_t peer_expect(struct peer *peer, const char *key, uint64_t p, uint64_t n)
+{
+	switch_time_t deadline = switch_micro_time_now() + 2000000;
+
+	while (switch_micro_time_now() < deadline) {
+		char packet[PACKET_SIZE + 1];
+		char *line;
+		size_t len = PACKET_SIZE;
+
+		if (switch_socket_recvfrom(peer->from, peer->sock, 0, packet, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			continue;
+		}
+
+		packet[len] = '\0';
+
+		/* skip the header */
+		for (line = strchr(packet, '\n'); line && *++line; line = strchr(line, '\n')) {
+			char *end;
+			uint64_t lp = strtoull(line, &end, 10);
+			uint64_t ln = strtoull(end, &end, 10);
+
+			strtol(end, &end, 10);
+			strtoull(end, &end, 10);
+			strtoul(end, &end, 10);
+
+			if (*end == ' ' && !strncmp(end + 1, key, strlen(key)) && end[strlen(key) + 1] == '\n' && lp == p && ln == n) {
+				return SWITCH_TRUE;
+			}
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+/**
+ * Wait for a resource's usage to reach a value
+ */
+static int wait_usage(const char *realm, const char *resource, int expected)
+{
+	switch_time_t deadline = switch_micro_time_now() + 2000000;
+	uint32_t rcount = 0;
+	int usage;
+
+	while ((usage = switch_limit_usage("cluster", realm, resource, &rcount)) != expected && switch_micro_time_now() < deadline) {
+		switch_sleep(10000);
+	}
+
+	return usage;
+}
+
+static switch_core_session_t *new_session(void)
+{
+	switch_core_session_t *session = NULL;
+	switch_call_cause_t cause;
+
+	switch_ivr_originate(NULL, &session, &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+
+	return session;
+}
+
+static void end_session(switch_core_session_t *session)
+{
+	switch_limit_release("cluster", session, NULL, NULL);
+	switch_channel_hangup(switch_core_session_get_channel(session), SWITCH_CAUSE_NORMAL_CLEARING);
+	switch_core_session_rwunlock(session);
+}
+
+FST_CORE_BEGIN("conf")
+{
+	FST_MODULE_BEGIN(mod_cluster_limit, cluster_limit)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_loopback");
+			fst_requires_module("mod_cluster_limit");
+			fst_requires(peer_open(&peer, fst_pool) == SWITCH_STATUS_SUCCESS);
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(local_changes_replicate)
+		{
+			switch_core_session_t *session = new_session();
+
+			fst_requires(session);
+
+			fst_check(switch_limit_incr("cluster", session, "test", "local", 10, 0) == SWITCH_STATUS_SUCCESS);
+			fst_check(peer_expect(&peer, "test_local", 1, 0));
+
+			switch_limit_release("cluster", session, "test", "local");
+			fst_check(peer_expect(&peer, "test_local", 1, 1));
+
+			end_session(session);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(remote_counts_merge)
+		{
+			switch_core_session_t *session_a = new_session();
+			switch_core_session_t *session_b = new_session();
+			switch_stream_handle_t stream = { 0 };
+
+			fst_requires(session_a);
+			fst_requires(session_b);
+
+			/* node 2 has 3 calls up */
+			peer_send(&peer, 3, 0, "3 0 0 0 0 test_remote\n");
+			fst_check_int_equals(wait_usage("test", "remote", 3), 3);
+
+			fst_check(switch_limit_incr("cluster", session_a, "test", "remote", 4, 0) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_limit_incr("cluster", session_b, "test", "remote", 4, 0) != SWITCH_STATUS_SUCCESS);
+
+			/* the same counts again change nothing */
+			peer_send(&peer, 3, 0, "3 0 0 0 0 test_remote\n");
+			switch_sleep(100000);
+			fst_check_int_equals(wait_usage("test", "remote", 4), 4);
+
+			/* one of node 2's calls ends */
+			peer_send(&peer, 3, 1, "3 1 0 0 0 test_remote\n");
+			fst_check_int_equals(wait_usage("test", "remote", 3), 3);
+			fst_check(switch_limit_incr("cluster", session_b, "test", "remote", 4, 0) == SWITCH_STATUS_SUCCESS);
+
+			SWITCH_STANDARD_STREAM(stream);
+			switch_api_execute("cluster_limit", "status", NULL, &stream);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "cluster_limit status:\n%s", (char *) stream.data);
+			fst_check(strstr((char *) stream.data, "node 2 127.0.0.1:28432") != NULL);
+			fst_check(strstr((char *) stream.data, "converged yes") != NULL);
+			switch_safe_free(stream.data);
+
+			end_session(session_a);
+			end_session(session_b);
+			fst_check(peer_expect(&peer, "test_remote", 2, 2));
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(remote_rate_counts)
+		{
+			switch_core_session_t *session = new_session();
+			char lines[128];
+			uint32_t rcount = 0;
+
+			fst_requires(session);
+
+			/* node 2 let 3 calls through in the current hour */
+			switch_snprintf(lines, sizeof(lines), "0 0 3600 %" SWITCH_UINT64_T_FMT " 3 test_rate\n", (uint64_t) switch_epoch_time_now(NULL) / 3600);
+			peer_send(&peer, 3, 1, lines);
+			switch_sleep(100000);
+
+			fst_check(switch_limit_incr("cluster", session, "test", "rate", 4, 3600) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_limit_incr("cluster", session, "test", "rate", 4, 3600) != SWITCH_STATUS_SUCCESS);
+			switch_limit_usage("cluster", "test", "rate", &rcount);
+			fst_check_int_equals(rcount, 4);
+
+			end_session(session);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(unknown_sender_is_dropped)
+		{
+			switch_stream_handle_t stream = { 0 };
+			switch_sockaddr_t *addr = NULL;
+			switch_socket_t *sock = NULL;
+			char packet[PACKET_SIZE];
+			switch_size_t len;
+
+			/* claims to be node 2 but isn't sent from node 2's address */
+			fst_requires(switch_sockaddr_info_get(&addr, "127.0.0.1", SWITCH_INET, STRANGER_PORT, 0, fst_pool) == SWITCH_STATUS_SUCCESS);
+			fst_requires(switch_socket_create(&sock, AF_INET, SOCK_DGRAM, 0, fst_pool) == SWITCH_STATUS_SUCCESS);
+			fst_requires(switch_socket_bind(sock, addr) == SWITCH_STATUS_SUCCESS);
+
+			switch_snprintf(packet, sizeof(packet), "PNC1 2 %" SWITCH_TIME_T_FMT " %" SWITCH_UINT64_T_FMT " %" SWITCH_TIME_T_FMT " 4 0\n4 0 0 0 0 test_stranger\n",
+							peer.incarnation, peer.seq + 1, switch_micro_time_now());
+			len = strlen(packet);
+			switch_socket_sendto(sock, peer.node1, 0, packet, &len);
+			switch_socket_close(sock);
+
+			switch_sleep(100000);
+			fst_check_int_equals(wait_usage("test", "stranger", 0), 0);
+
+			SWITCH_STANDARD_STREAM(stream);
+			switch_api_execute("cluster_limit", "status", NULL, &stream);
+			fst_check(strstr((char *) stream.data, "foreign 1") != NULL);
+			switch_safe_free(stream.data);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(restarted_node_is_dropped)
+		{
+			switch_stream_handle_t stream = { 0 };
+
+			peer_send(&peer, 8, 1, "5 0 0 0 0 test_restart\n");
+			fst_check_int_equals(wait_usage("test", "restart", 5), 5);
+
+			/* node 2 comes back with nothing */
+			peer.incarnation++;
+			peer_send(&peer, 0, 0, NULL);
+			fst_check_int_equals(wait_usage("test", "restart", 0), 0);
+
+			/* a late datagram from before the restart is ignored */
+			peer.incarnation--;
+			peer_send(&peer, 9, 0, "9 0 0 0 0 test_restart\n");
+			switch_sleep(100000);
+			fst_check_int_equals(wait_usage("test", "restart", 0), 0);
+
+			SWITCH_STANDARD_STREAM(stream);
+			switch_api_execute("cluster_limit", "status", NULL, &stream);
+			fst_check(strstr((char *) stream.data, "stale 1") != NULL);
+			switch_safe_free(stream.data);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(silent_node_is_dropped)
+		{
+			switch_stream_handle_t stream = { 0 };
+			switch_time_t deadline;
+			int usage;
+
+			peer.incarnation++;
+			peer_send(&peer, 2, 0, "2 0 0 0 0 test_silent\n");
+			fst_check_int_equals(wait_usage("test", "silent", 2), 2);
+
+			/* node 2 stops talking for longer than peer-timeout */
+			deadline = switch_micro_time_now() + 3000000;
+			while ((usage = wait_usage("test", "silent", 0)) && switch_micro_time_now() < deadline);
+			fst_check_int_equals(usage, 0);
+
+			SWITCH_STANDARD_STREAM(stream);
+			switch_api_execute("cluster_limit", "status", NULL, &stream);
+			fst_check(strstr((char *) stream.data, "timed out") != NULL);
+			fst_check(strstr((char *) stream.data, "converged no") != NULL);
+			switch_safe_free(stream.data);
+
+			/* and its usage is back once it talks again */
+			peer_send(&peer, 2, 0, "2 0 0 0 0 test_silent\n");
+			fst_check_int_equals(wait_usage("test", "silent", 2), 2);
+		}
+		FST_TEST_END()
+	}
+	FST_MODULE_END()
+}
+FST_CORE_END()
@@ -691,6 +691,33 @@ SWITCH_STANDARD_API(pool_stats_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_STANDARD_API(dtls_stats_function)
+{
+	switch_rtp_dtls_stats_t stats;
+	uint32_t lower = 0;
+	int i;
+
+	switch_rtp_get_dtls_stats(&stats);
+
+	stream->write_function(stream, "handshakes: %" SWITCH_UINT64_T_FMT " done, %" SWITCH_UINT64_T_FMT " failed, %" SWITCH_UINT64_T_FMT " resumed\n",
+						   stats.handshakes, stats.failures, stats.resumed);
+	stream->write_function(stream, "flights: %" SWITCH_UINT64_T_FMT " on crypto threads, %" SWITCH_UINT64_T_FMT " on media threads\n",
+						   stats.offloaded, stats.inline_flights);
+	stream->write_function(stream, "contexts built: %" SWITCH_UINT64_T_FMT "\n", stats.ctx_builds);
+	stream->write_function(stream, "average latency: %" SWITCH_UINT64_T_FMT "ms\n", stats.handshakes ? stats.latency_total_ms / stats.handshakes : 0);
+
+	for (i = 0; i < SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS; i++) {
+		if (stats.bucket_ms[i]) {
+			stream->write_function(stream, "%5ums - %5ums: %" SWITCH_UINT64_T_FMT "\n", lower, stats.bucket_ms[i], stats.bucket[i]);
+			lower = stats.bucket_ms[i];
+		} else {
+			stream->write_function(stream, "%5ums +       : %" SWITCH_UINT64_T_FMT "\n", lower, stats.bucket[i]);
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(db_cache_function)
 {
 	int argc;
@@ -2327,6 +2354,9 @@ SWITCH_STANDARD_API(status_function)
 	char *nl;						/* shortcut to format.nl	*/
 	stream_format format = { 0 };
 	switch_size_t cur = 0, max = 0;
+	uint32_t cache_entries = 0;
+	switch_size_t cache_bytes = 0;
+	uint64_t cache_hits = 0, cache_misses = 0;
 
 	set_format(&format, stream);
 
@@ -2377,6 +2407,11 @@ SWITCH_STANDARD_API(status_function)
 	stream->write_function(stream, "%d session(s) max%s", switch_core_session_limit(0), nl);
 	stream->write_function(stream, "min idle cpu %0.2f/%0.2f%s", switch_core_min_idle_cpu(-1.0), switch_core_idle_cpu(), nl);
 
+	if (switch_core_file_cache_stats(&cache_entries, &cache_bytes, &cache_hits, &cache_misses) == SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "file cache %u file(s), %" SWITCH_SIZE_T_FMT "K resident, hit ratio %0.2f%%%s", cache_entries, cache_bytes / 1024,
+							   (cache_hits + cache_misses) ? (double) cache_hits * 100 / (double) (cache_hits + cache_misses) : 0.0, nl);
+	}
+
 	if (switch_core_get_stacksizes(&cur, &max) == SWITCH_STATUS_SUCCESS) {		stream->write_function(stream, "Current Stack Size/Max %ldK/%ldK\n", cur / 1024, max / 1024);
 	}
 	return SWITCH_STATUS_SUCCESS;
@@ -3504,6 +3539,9 @@ static void jsonify_stats(cJSON *json, const char *name, switch_rtp_stats_t *sta
 	add_stat (stats->inbound.R, "in_quality_percentage");
 	add_stat (stats->inbound.mos, "in_mos");
 
+	add_stat(stats->inbound.srtp_packet_count, "in_srtp_packet_count");
+	add_stat(stats->inbound.srtp_packet_count ? stats->inbound.srtp_ns / stats->inbound.srtp_packet_count : 0, "in_srtp_avg_ns");
+
 
 	add_stat(stats->outbound.raw_bytes, "out_raw_bytes");
 	add_stat(stats->outbound.media_bytes, "out_media_bytes");
@@ -3512,6 +3550,8 @@ static void jsonify_stats(cJSON *json, const char *name, switch_rtp_stats_t *sta
 	add_stat(stats->outbound.skip_packet_count, "out_skip_packet_count");
 	add_stat(stats->outbound.dtmf_packet_count, "out_dtmf_packet_count");
 	add_stat(stats->outbound.cng_packet_count, "out_cng_packet_count");
+	add_stat(stats->outbound.srtp_packet_count, "out_srtp_packet_count");
+	add_stat(stats->outbound.srtp_packet_count ? stats->outbound.srtp_ns / stats->outbound.srtp_packet_count : 0, "out_srtp_avg_ns");
 
 	add_stat(stats->rtcp.packet_count, "rtcp_packet_count");
 	add_stat(stats->rtcp.octet_count, "rtcp_octet_count");
@@ -7489,6 +7529,9 @@ SWITCH_STANDARD_JSON_API(json_status_function)
 	int sps = 0, last_sps = 0, max_sps = 0, max_sps_fivemin = 0;
 	int sessions_peak = 0, sessions_peak_fivemin = 0; /* Max Concurrent Sessions buffers */
 	switch_size_t cur = 0, max = 0;
+	uint32_t cache_entries = 0;
+	switch_size_t cache_bytes = 0;
+	uint64_t cache_hits = 0, cache_misses = 0;
 
 	switch_core_measure_time(switch_core_uptime(), &duration);
 
@@ -7550,6 +7593,16 @@ SWITCH_STANDARD_JSON_API(json_status_function)
 		cJSON_AddItemToObject(o, "max", cJSON_CreateNumber((double)(max / 1024)));
 	}
 
+	if (switch_core_file_cache_stats(&cache_entries, &cache_bytes, &cache_hits, &cache_misses) == SWITCH_STATUS_SUCCESS) {
+		o = cJSON_CreateObject();
+		cJSON_AddItemToObject(reply, "fileCache", o);
+
+		cJSON_AddItemToObject(o, "files", cJSON_CreateNumber(cache_entries));
+		cJSON_AddItemToObject(o, "bytes", cJSON_CreateNumber((double) cache_bytes));
+		cJSON_AddItemToObject(o, "hits", cJSON_CreateNumber((double) cache_hits));
+		cJSON_AddItemToObject(o, "misses", cJSON_CreateNumber((double) cache_misses));
+	}
+
 
 	*json_reply = reply;
 
@@ -7654,6 +7707,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "db_cache", "Manage db cache", db_cache_function, "status");
 	SWITCH_ADD_API(commands_api_interface, "domain_data", "Find domain data", domain_data_function, "<domain> [var|param|attr] <name>");
 	SWITCH_ADD_API(commands_api_interface, "domain_exists", "Check if a domain exists", domain_exists_function, "<domain>");
+	SWITCH_ADD_API(commands_api_interface, "dtls_stats", "DTLS handshake statistics", dtls_stats_function, "");
 	SWITCH_ADD_API(commands_api_interface, "echo", "Echo", echo_function, "<data>");
 	SWITCH_ADD_API(commands_api_interface, "event_channel_broadcast", "Broadcast", event_channel_broadcast_api_function, "<channel> <json>");
 	SWITCH_ADD_API(commands_api_interface, "escape", "Escape a string", escape_function, "<data>");
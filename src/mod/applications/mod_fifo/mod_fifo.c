@@ -117,6 +117,13 @@ SWITCH_MODULE_DEFINITION(mod_fifo, mod_fifo_load, mod_fifo_shutdown, NULL);
 static switch_status_t load_config(int reload, int del_all);
 #define MAX_PRI 10
 
+/* How often in us the members other hosts keep in a shared database are reread */
+#define FIFO_FOREIGN_REFRESH 1000000
+
+/* Upper bounds in ms of the dispatch latency buckets, the last bucket takes the rest */
+#define FIFO_LATENCY_BUCKETS 9
+static const int fifo_latency_bounds[FIFO_LATENCY_BUCKETS - 1] = { 1, 5, 10, 50, 100, 500, 1000, 5000 };
+
 typedef enum {
 	NODE_STRATEGY_INVALID = -1,
 	NODE_STRATEGY_RINGALL = 0,
@@ -407,20 +414,87 @@ struct fifo_node {
 	int default_lag;
 	char *domain_name;
 	int retry_delay;
+	uint32_t dispatch_latency[FIFO_LATENCY_BUCKETS];
+	switch_time_t dispatch_latency_max;
 	struct fifo_node *next;
 };
 
 typedef struct fifo_node fifo_node_t;
 
-static void fifo_caller_add(fifo_node_t *node, switch_core_session_t *session);
-static void fifo_caller_del(const char *uuid);
+/*!\struct fifo_outbound
+ * \brief An outbound member of a fifo
+ *
+ * Mirrors the fifo_outbound row the dispatcher used to select on.
+ * The members of a fifo are kept ordered by next_avail,
+ * outbound_fail_count and outbound_call_count so the dispatcher can
+ * take them from the head and stop at the first one still resting.
+ * Rows of the same member in other fifos or on other hosts are
+ * chained through `uuid_next`, as the use and ring counts are per
+ * member.  Rows of other hosts sharing the database are reread every
+ * FIFO_FOREIGN_REFRESH; `local_ring` and `local_use` are what this
+ * host holds of their counts so a reread can't drop them before they
+ * reach the database.
+ */
+typedef struct fifo_outbound fifo_outbound_t;
+
+typedef struct {
+	fifo_outbound_t *head;
+	fifo_outbound_t *tail;
+	int count;
+} fifo_outbound_list_t;
+
+struct fifo_outbound {
+	char *uuid;
+	char *fifo_name;
+	char *originate_string;
+	char *hostname;
+	int simo_count;
+	int timeout;
+	int lag;
+	int taking_calls;
+	int is_static;
+	int use_count;
+	int ring_count;
+	long next_avail;
+	int outbound_call_count;
+	int outbound_fail_count;
+	int local_ring;
+	int local_use;
+	uint32_t refreshed;
+	fifo_outbound_list_t *list;
+	fifo_outbound_t *prev;
+	fifo_outbound_t *next;
+	fifo_outbound_t *uuid_next;
+};
 
-struct callback {
-	char *buf;
-	size_t len;
-	int matches;
+typedef enum {
+	OUTBOUND_RING,
+	OUTBOUND_RING_DONE,
+	OUTBOUND_RING_FAIL,
+	OUTBOUND_USE,
+	OUTBOUND_USE_DONE,
+	OUTBOUND_CALL_DONE
+} outbound_update_t;
+
+/*!\struct fifo_dispatch
+ * \brief A fifo node waiting for the dispatcher
+ *
+ * `since` is when the node first had work for the dispatcher, `due`
+ * when it should be looked at, which is later than now only while all
+ * of its members are resting.
+ */
+typedef struct fifo_dispatch fifo_dispatch_t;
+
+struct fifo_dispatch {
+	char *name;
+	switch_time_t since;
+	switch_time_t due;
+	int priority;
+	fifo_dispatch_t *next;
 };
-typedef struct callback callback_t;
+
+static void fifo_caller_add(fifo_node_t *node, switch_core_session_t *session);
+static void fifo_caller_del(const char *uuid);
 
 static const char *print_strategy(outbound_strategy_t s)
 {
@@ -449,15 +523,6 @@ static outbound_strategy_t parse_strategy(const char *name)
 	return NODE_STRATEGY_INVALID;
 }
 
-static int sql2str_callback(void *pArg, int argc, char **argv, char **columnNames)
-{
-	callback_t *cbt = (callback_t *) pArg;
-
-	switch_copy_string(cbt->buf, argv[0], cbt->len);
-	cbt->matches++;
-	return 0;
-}
-
 /*!\brief Handler for caller DTMF
  *
  * The channel variable `fifo_caller_exit_key` can be set to one or
@@ -668,6 +733,13 @@ static struct {
 	switch_bool_t delete_all_members_on_startup;
 	outbound_strategy_t default_strategy;
 	int disable_dtmf_moh_key;
+	switch_mutex_t *outbound_mutex;
+	switch_hash_t *outbound_hash;
+	switch_hash_t *outbound_fifo_hash;
+	switch_mutex_t *dispatch_mutex;
+	switch_thread_cond_t *dispatch_cond;
+	switch_hash_t *dispatch_hash;
+	int nodes_removed;
 } globals;
 
 
@@ -1005,14 +1077,470 @@ static switch_bool_t fifo_execute_sql_callback(switch_mutex_t *mutex, char *sql,
 	return ret;
 }
 
+/*!\brief Wake the dispatcher for a fifo node
+ *
+ * Pending nodes are keyed by name so a node can be woken without
+ * holding any of its locks.  Waking a node already pending keeps its
+ * oldest `since` and its earliest `due`.
+ */
+static void fifo_dispatch_schedule(const char *node_name, switch_time_t since, switch_time_t due)
+{
+	fifo_dispatch_t *d;
+
+	switch_mutex_lock(globals.dispatch_mutex);
+	if (globals.dispatch_hash) {
+		if ((d = switch_core_hash_find(globals.dispatch_hash, node_name))) {
+			if (since < d->since) {
+				d->since = since;
+			}
+			if (due < d->due) {
+				d->due = due;
+			}
+		} else {
+			switch_zmalloc(d, sizeof(*d));
+			d->name = strdup(node_name);
+			d->since = since;
+			d->due = due;
+			switch_core_hash_insert(globals.dispatch_hash, d->name, d);
+		}
+		switch_thread_cond_signal(globals.dispatch_cond);
+	}
+	switch_mutex_unlock(globals.dispatch_mutex);
+}
+
+static void fifo_dispatch_wake(const char *node_name)
+{
+	switch_time_t now = switch_micro_time_now();
+
+	fifo_dispatch_schedule(node_name, now, now);
+}
+
+static void node_record_latency(fifo_node_t *node, switch_time_t latency)
+{
+	int ms = (int) (latency / 1000);
+	int x;
+
+	for (x = 0; x < FIFO_LATENCY_BUCKETS - 1 && ms >= fifo_latency_bounds[x]; x++);
+
+	switch_mutex_lock(node->update_mutex);
+	node->dispatch_latency[x]++;
+	if (latency > node->dispatch_latency_max) {
+		node->dispatch_latency_max = latency;
+	}
+	switch_mutex_unlock(node->update_mutex);
+}
+
+static int outbound_cmp(fifo_outbound_t *a, fifo_outbound_t *b)
+{
+	if (a->next_avail != b->next_avail) {
+		return a->next_avail < b->next_avail ? -1 : 1;
+	}
+	if (a->outbound_fail_count != b->outbound_fail_count) {
+		return a->outbound_fail_count < b->outbound_fail_count ? -1 : 1;
+	}
+	if (a->outbound_call_count != b->outbound_call_count) {
+		return a->outbound_call_count < b->outbound_call_count ? -1 : 1;
+	}
+	return 0;
+}
+
+static void outbound_list_unlink(fifo_outbound_t *row)
+{
+	fifo_outbound_list_t *list = row->list;
+
+	if (row->prev) {
+		row->prev->next = row->next;
+	} else {
+		list->head = row->next;
+	}
+	if (row->next) {
+		row->next->prev = row->prev;
+	} else {
+		list->tail = row->prev;
+	}
+	row->prev = row->next = NULL;
+	list->count--;
+}
+
+static void outbound_list_link(fifo_outbound_t *row)
+{
+	fifo_outbound_list_t *list = row->list;
+	fifo_outbound_t *np;
+
+	/* Members coming back from a call usually go last */
+	for (np = list->tail; np && outbound_cmp(np, row) > 0; np = np->prev);
+
+	row->prev = np;
+	if (np) {
+		row->next = np->next;
+		np->next = row;
+	} else {
+		row->next = list->head;
+		list->head = row;
+	}
+	if (row->next) {
+		row->next->prev = row;
+	} else {
+		list->tail = row;
+	}
+	list->count++;
+}
+
+static void outbound_index_free(fifo_outbound_t *row)
+{
+	fifo_outbound_t *head, **rp;
+
+	outbound_list_unlink(row);
+
+	head = switch_core_hash_find(globals.outbound_hash, row->uuid);
+	if (head == row) {
+		if (row->uuid_next) {
+			switch_core_hash_insert(globals.outbound_hash, row->uuid, row->uuid_next);
+		} else {
+			switch_core_hash_delete(globals.outbound_hash, row->uuid);
+		}
+	} else if (head) {
+		for (rp = &head->uuid_next; *rp && *rp != row; rp = &(*rp)->uuid_next);
+		if (*rp) {
+			*rp = row->uuid_next;
+		}
+	}
+
+	switch_safe_free(row->uuid);
+	switch_safe_free(row->fifo_name);
+	switch_safe_free(row->originate_string);
+	switch_safe_free(row->hostname);
+	free(row);
+}
+
+/*!\brief Remove a member from a fifo, from any host when hostname is NULL
+ *
+ * Expects globals.outbound_mutex to be held.
+ */
+static void outbound_index_del(const char *fifo_name, const char *uuid, const char *hostname)
+{
+	fifo_outbound_t *row, *next;
+
+	for (row = switch_core_hash_find(globals.outbound_hash, uuid); row; row = next) {
+		next = row->uuid_next;
+		if (!strcmp(row->fifo_name, fifo_name) && (!hostname || !strcmp(row->hostname, hostname))) {
+			outbound_index_free(row);
+		}
+	}
+}
+
+/*!\brief Add a member to a fifo, replacing any previous row for it
+ *
+ * Expects globals.outbound_mutex to be held.
+ */
+static fifo_outbound_t *outbound_index_add(const char *uuid, const char *fifo_name, const char *originate_string, const char *hostname,
+										   int simo_count, int timeout, int lag, int taking_calls, int is_static)
+{
+	fifo_outbound_list_t *list;
+	fifo_outbound_t *row;
+
+	outbound_index_del(fifo_name, uuid, hostname);
+
+	if (!(list = switch_core_hash_find(globals.outbound_fifo_hash, fifo_name))) {
+		switch_zmalloc(list, sizeof(*list));
+		switch_core_hash_insert(globals.outbound_fifo_hash, fifo_name, list);
+	}
+
+	switch_zmalloc(row, sizeof(*row));
+	row->uuid = strdup(uuid);
+	row->fifo_name = strdup(fifo_name);
+	row->originate_string = strdup(originate_string);
+	row->hostname = strdup(switch_str_nil(hostname));
+	row->simo_count = simo_count;
+	row->timeout = timeout;
+	row->lag = lag;
+	row->taking_calls = taking_calls;
+	row->is_static = is_static;
+	row->list = list;
+
+	row->uuid_next = switch_core_hash_find(globals.outbound_hash, uuid);
+	switch_core_hash_insert(globals.outbound_hash, row->uuid, row);
+	outbound_list_link(row);
+
+	return row;
+}
+
+/*!\brief Drop the members of a host, or only its static ones
+ *
+ * Expects globals.outbound_mutex to be held.
+ */
+static void outbound_index_del_host(const char *hostname, switch_bool_t static_only)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	for (hi = switch_core_hash_first(globals.outbound_fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+		fifo_outbound_list_t *list;
+		fifo_outbound_t *row, *next;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		list = (fifo_outbound_list_t *) val;
+
+		for (row = list->head; row; row = next) {
+			next = row->next;
+			if (!strcmp(row->hostname, hostname) && (!static_only || row->is_static)) {
+				outbound_index_free(row);
+			}
+		}
+	}
+}
+
+static int outbound_index_count(const char *fifo_name)
+{
+	fifo_outbound_list_t *list;
+	int count = 0;
+
+	switch_mutex_lock(globals.outbound_mutex);
+	if ((list = switch_core_hash_find(globals.outbound_fifo_hash, fifo_name))) {
+		count = list->count;
+	}
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	return count;
+}
+
+static void outbound_index_update_locked(const char *uuid, outbound_update_t what, int retry_delay)
+{
+	fifo_outbound_t *row;
+	long now = (long) switch_epoch_time_now(NULL);
+
+	for (row = switch_core_hash_find(globals.outbound_hash, uuid); row; row = row->uuid_next) {
+		switch_bool_t moved = SWITCH_FALSE;
+
+		switch (what) {
+		case OUTBOUND_RING:
+			row->ring_count++;
+			row->local_ring++;
+			break;
+		case OUTBOUND_RING_DONE:
+			if (row->ring_count > 0) {
+				row->ring_count--;
+			}
+			if (row->local_ring > 0) {
+				row->local_ring--;
+			}
+			break;
+		case OUTBOUND_RING_FAIL:
+			if (row->ring_count > 0) {
+				row->ring_count--;
+			}
+			if (row->local_ring > 0) {
+				row->local_ring--;
+			}
+			row->outbound_fail_count++;
+			row->next_avail = now + retry_delay + row->lag + 1;
+			moved = SWITCH_TRUE;
+			break;
+		case OUTBOUND_USE:
+			row->use_count++;
+			row->local_use++;
+			row->outbound_fail_count = 0;
+			moved = SWITCH_TRUE;
+			break;
+		case OUTBOUND_USE_DONE:
+		case OUTBOUND_CALL_DONE:
+			if (row->local_use > 0) {
+				row->local_use--;
+			}
+			if (row->use_count > 0) {
+				row->use_count--;
+				row->next_avail = now + row->lag + 1;
+				if (what == OUTBOUND_CALL_DONE) {
+					row->outbound_call_count++;
+				}
+				moved = SWITCH_TRUE;
+			}
+			break;
+		}
+
+		if (moved) {
+			outbound_list_unlink(row);
+			outbound_list_link(row);
+		}
+
+		/* A member freeing up may be what a fifo was waiting for */
+		if (what != OUTBOUND_RING && what != OUTBOUND_USE) {
+			fifo_dispatch_wake(row->fifo_name);
+		}
+	}
+}
+
+/*!\brief Apply one of the per-member updates of fifo_outbound to the index */
+static void outbound_index_update(const char *uuid, outbound_update_t what, int retry_delay)
+{
+	if (zstr(uuid)) {
+		return;
+	}
+
+	switch_mutex_lock(globals.outbound_mutex);
+	outbound_index_update_locked(uuid, what, retry_delay);
+	switch_mutex_unlock(globals.outbound_mutex);
+}
+
+static int outbound_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	fifo_outbound_t *row;
+
+	if (argc < 14 || zstr(argv[0]) || zstr(argv[1])) {
+		return 0;
+	}
+
+	row = outbound_index_add(argv[0], argv[1], switch_str_nil(argv[2]), argv[3],
+							 atoi(switch_str_nil(argv[4])), atoi(switch_str_nil(argv[5])), atoi(switch_str_nil(argv[6])),
+							 atoi(switch_str_nil(argv[7])), atoi(switch_str_nil(argv[8])));
+	row->use_count = atoi(switch_str_nil(argv[9]));
+	row->ring_count = atoi(switch_str_nil(argv[10]));
+	row->next_avail = atol(switch_str_nil(argv[11]));
+	row->outbound_call_count = atoi(switch_str_nil(argv[12]));
+	row->outbound_fail_count = atoi(switch_str_nil(argv[13]));
+	outbound_list_unlink(row);
+	outbound_list_link(row);
+
+	return 0;
+}
+
+static int outbound_refresh_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	fifo_outbound_t **rows = (fifo_outbound_t **) pArg, *row;
+
+	if (argc < 14 || zstr(argv[0]) || zstr(argv[1])) {
+		return 0;
+	}
+
+	switch_zmalloc(row, sizeof(*row));
+	row->uuid = strdup(argv[0]);
+	row->fifo_name = strdup(argv[1]);
+	row->originate_string = strdup(switch_str_nil(argv[2]));
+	row->hostname = strdup(switch_str_nil(argv[3]));
+	row->simo_count = atoi(switch_str_nil(argv[4]));
+	row->timeout = atoi(switch_str_nil(argv[5]));
+	row->lag = atoi(switch_str_nil(argv[6]));
+	row->taking_calls = atoi(switch_str_nil(argv[7]));
+	row->is_static = atoi(switch_str_nil(argv[8]));
+	row->use_count = atoi(switch_str_nil(argv[9]));
+	row->ring_count = atoi(switch_str_nil(argv[10]));
+	row->next_avail = atol(switch_str_nil(argv[11]));
+	row->outbound_call_count = atoi(switch_str_nil(argv[12]));
+	row->outbound_fail_count = atoi(switch_str_nil(argv[13]));
+	row->next = *rows;
+	*rows = row;
+
+	return 0;
+}
+
+/*!\brief Bring the members of other hosts sharing the database up to date
+ *
+ * Their rows only change in the database, so we reread them and
+ * apply what was added, removed or changed to the index, waking the
+ * fifos concerned.  Returns true when members came or went, so the
+ * nodes' member counts need redoing.
+ */
+static switch_bool_t outbound_index_refresh(void)
+{
+	static uint32_t gen = 0;
+	fifo_outbound_t *rows = NULL, *tmp, *row;
+	switch_hash_index_t *hi;
+	switch_bool_t membership = SWITCH_FALSE;
+	char *sql;
+	void *val;
+
+	sql = switch_mprintf("select uuid, fifo_name, originate_string, hostname, simo_count, timeout, lag, taking_calls, "
+						 "static, use_count, ring_count, next_avail, outbound_call_count, outbound_fail_count from fifo_outbound "
+						 "where hostname <> '%q'", globals.hostname);
+	fifo_execute_sql_callback(globals.sql_mutex, sql, outbound_refresh_callback, &rows);
+	switch_safe_free(sql);
+
+	switch_mutex_lock(globals.outbound_mutex);
+
+	gen++;
+
+	while ((tmp = rows)) {
+		rows = tmp->next;
+
+		for (row = switch_core_hash_find(globals.outbound_hash, tmp->uuid); row; row = row->uuid_next) {
+			if (!strcmp(row->fifo_name, tmp->fifo_name) && !strcmp(row->hostname, tmp->hostname)) {
+				break;
+			}
+		}
+
+		if (!row) {
+			row = outbound_index_add(tmp->uuid, tmp->fifo_name, tmp->originate_string, tmp->hostname,
+									 tmp->simo_count, tmp->timeout, tmp->lag, tmp->taking_calls, tmp->is_static);
+			membership = SWITCH_TRUE;
+			fifo_dispatch_wake(row->fifo_name);
+		} else if (strcmp(row->originate_string, tmp->originate_string)) {
+			free(row->originate_string);
+			row->originate_string = tmp->originate_string;
+			tmp->originate_string = NULL;
+		}
+
+		/* what we hold ourselves may not be written back yet */
+		if (tmp->use_count < row->local_use) {
+			tmp->use_count = row->local_use;
+		}
+		if (tmp->ring_count < row->local_ring) {
+			tmp->ring_count = row->local_ring;
+		}
+
+		if (row->use_count != tmp->use_count || row->ring_count != tmp->ring_count || row->simo_count != tmp->simo_count ||
+			row->taking_calls != tmp->taking_calls || row->next_avail != tmp->next_avail ||
+			row->outbound_call_count != tmp->outbound_call_count || row->outbound_fail_count != tmp->outbound_fail_count) {
+			row->simo_count = tmp->simo_count;
+			row->timeout = tmp->timeout;
+			row->lag = tmp->lag;
+			row->taking_calls = tmp->taking_calls;
+			row->use_count = tmp->use_count;
+			row->ring_count = tmp->ring_count;
+			row->next_avail = tmp->next_avail;
+			row->outbound_call_count = tmp->outbound_call_count;
+			row->outbound_fail_count = tmp->outbound_fail_count;
+			outbound_list_unlink(row);
+			outbound_list_link(row);
+			fifo_dispatch_wake(row->fifo_name);
+		}
+
+		row->refreshed = gen;
+
+		switch_safe_free(tmp->uuid);
+		switch_safe_free(tmp->fifo_name);
+		switch_safe_free(tmp->originate_string);
+		switch_safe_free(tmp->hostname);
+		free(tmp);
+	}
+
+	/* whatever we didn't see again was removed on its host */
+	for (hi = switch_core_hash_first(globals.outbound_fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+		fifo_outbound_list_t *list;
+		fifo_outbound_t *next;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		list = (fifo_outbound_list_t *) val;
+
+		for (row = list->head; row; row = next) {
+			next = row->next;
+			if (row->refreshed != gen && strcmp(row->hostname, globals.hostname)) {
+				outbound_index_free(row);
+				membership = SWITCH_TRUE;
+			}
+		}
+	}
+
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	return membership;
+}
+
 static fifo_node_t *create_node(const char *name, uint32_t importance, switch_mutex_t *mutex)
 {
 	fifo_node_t *node;
 	int x = 0;
 	switch_memory_pool_t *pool;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
-	char *sql = NULL;
+
 	if (!globals.running) {
 		return NULL;
 	}
@@ -1037,13 +1565,8 @@ static fifo_node_t *create_node(const char *name, uint32_t importance, switch_mu
 	switch_thread_rwlock_create(&node->rwlock, node->pool);
 	switch_mutex_init(&node->mutex, SWITCH_MUTEX_NESTED, node->pool);
 	switch_mutex_init(&node->update_mutex, SWITCH_MUTEX_NESTED, node->pool);
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", name);
-	fifo_execute_sql_callback(mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	node->member_count = outbound_index_count(name);
 	node->has_outbound = (node->member_count > 0) ? 1 : 0;
-	switch_safe_free(sql);
 
 	node->importance = importance;
 
@@ -1090,7 +1613,6 @@ struct call_helper {
 
 #define MAX_ROWS 250
 struct callback_helper {
-	int need;
 	switch_memory_pool_t *pool;
 	struct call_helper *rows[MAX_ROWS];
 	int rowcount;
@@ -1418,6 +1940,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 	int rowcount = 0;
 	switch_memory_pool_t *pool;
 	char *export = NULL;
+	switch_bool_t failed = SWITCH_FALSE;
 
 	switch_mutex_lock(globals.mutex);
 	globals.threads++;
@@ -1448,6 +1971,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 		struct call_helper *h = cbh->rows[i];
 
 		if (check_consumer_outbound_call(h->uuid) || check_bridge_call(h->uuid)) {
+			outbound_index_update(h->uuid, OUTBOUND_RING_DONE, 0);
 			continue;
 		}
 
@@ -1471,7 +1995,6 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 
 	switch_mutex_lock(node->update_mutex);
 	node->busy = 0;
-	node->ring_consumer_count++;
 	switch_mutex_unlock(node->update_mutex);
 
 	SWITCH_STANDARD_STREAM(stream);
@@ -1620,7 +2143,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 		struct call_helper *h = cbh->rows[i];
 		char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count+1 where uuid='%q'", h->uuid);
 
-		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 	}
 
 	if (!globals.allow_transcoding && !switch_true(switch_event_get_header(pop, "variable_fifo_allow_transcoding")) &&
@@ -1659,12 +2182,14 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 					struct call_helper *h = cbh->rows[i];
 					char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 "
 											   "where uuid='%q' and ring_count > 0", h->uuid);
-					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 				}
 			}
 			break;
 		default:
 			{
+				failed = SWITCH_TRUE;
+
 				for (i = 0; i < cbh->rowcount; i++) {
 					struct call_helper *h = cbh->rows[i];
 					char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1, "
@@ -1672,7 +2197,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 											   "outbound_fail_total_count = outbound_fail_total_count+1, "
 											   "next_avail=%ld + lag + 1 where uuid='%q' and ring_count > 0",
 											   (long) switch_epoch_time_now(NULL) + node->retry_delay, h->uuid);
-					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 				}
 			}
 		}
@@ -1724,13 +2249,18 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 	for (i = 0; i < cbh->rowcount; i++) {
 		struct call_helper *h = cbh->rows[i];
 		char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 where uuid='%q' and ring_count > 0",  h->uuid);
-		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 	}
 
   end:
 
 	cbh->ready = 1;
 
+	/* Give back the ring slots find_consumers() took for us */
+	for (i = 0; i < cbh->rowcount; i++) {
+		outbound_index_update(cbh->rows[i]->uuid, failed ? OUTBOUND_RING_FAIL : OUTBOUND_RING_DONE, node ? node->retry_delay : 0);
+	}
+
 	if (node) {
 		switch_mutex_lock(node->update_mutex);
 		if (--node->ring_consumer_count < 0) {
@@ -1738,6 +2268,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 		}
 		node->busy = 0;
 		switch_mutex_unlock(node->update_mutex);
+		fifo_dispatch_wake(node->name);
 		switch_thread_rwlock_unlock(node->rwlock);
 	}
 
@@ -1808,7 +2339,6 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 
 	if (node) {
 		switch_mutex_lock(node->update_mutex);
-		node->ring_consumer_count++;
 		node->busy = 0;
 		switch_mutex_unlock(node->update_mutex);
 	}
@@ -1844,7 +2374,7 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	}
 
 	sql = switch_mprintf("update fifo_outbound set ring_count=ring_count+1 where uuid='%q'", h->uuid);
-	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 
 	status = switch_ivr_originate(NULL, &session, &cause, originate_string, h->timeout, NULL, NULL, NULL, NULL, ovars, SOF_NONE, NULL, NULL);
 
@@ -1852,7 +2382,7 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 		sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1, "
 							 "outbound_fail_count=outbound_fail_count+1, next_avail=%ld + lag + 1 where uuid='%q'",
 							 (long) switch_epoch_time_now(NULL) + (node ? node->retry_delay : 0), h->uuid);
-		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FIFO-Name", node ? node->name : "");
@@ -1897,10 +2427,12 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	switch_core_session_rwunlock(session);
 
 	sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 where uuid='%q' and ring_count > 0", h->uuid);
-	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 
   end:
 
+	outbound_index_update(h->uuid, status != SWITCH_STATUS_SUCCESS ? OUTBOUND_RING_FAIL : OUTBOUND_RING_DONE, node ? node->retry_delay : 0);
+
 	if ( originate_string ){
 		switch_safe_free(originate_string);
 	}
@@ -1917,6 +2449,7 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 		}
 		node->busy = 0;
 		switch_mutex_unlock(node->update_mutex);
+		fifo_dispatch_wake(node->name);
 		switch_thread_rwlock_unlock(node->rwlock);
 	}
 	switch_core_destroy_memory_pool(&h->pool);
@@ -1928,74 +2461,21 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	return NULL;
 }
 
-/*!\brief Extract the outbound member results and accumulate them for
- * the ringall strategy handler
- */
-static int place_call_ringall_callback(void *pArg, int argc, char **argv, char **columnNames)
-{
-	struct callback_helper *cbh = (struct callback_helper *) pArg;
-	struct call_helper *h;
-
-	h = switch_core_alloc(cbh->pool, sizeof(*h));
-	h->pool = cbh->pool;
-	h->uuid = switch_core_strdup(h->pool, argv[0]);
-	h->node_name = switch_core_strdup(h->pool, argv[1]);
-	h->originate_string = switch_core_strdup(h->pool, argv[2]);
-	h->timeout = atoi(argv[5]);
-
-	cbh->rows[cbh->rowcount++] = h;
-
-	if (cbh->rowcount == MAX_ROWS) return -1;
-
-	if (cbh->need) {
-		cbh->need--;
-		return cbh->need ? 0 : -1;
-	}
-
-	return 0;
-}
-
-/*!\brief Extract the outbound member results and invoke the
- * enterprise strategy handler
- */
-static int place_call_enterprise_callback(void *pArg, int argc, char **argv, char **columnNames)
-{
-	int *need = (int *) pArg;
-
-	switch_thread_t *thread;
-	switch_threadattr_t *thd_attr = NULL;
-	switch_memory_pool_t *pool;
-	struct call_helper *h;
-
-	switch_core_new_memory_pool(&pool);
-	h = switch_core_alloc(pool, sizeof(*h));
-	h->pool = pool;
-	h->uuid = switch_core_strdup(h->pool, argv[0]);
-	h->node_name = switch_core_strdup(h->pool, argv[1]);
-	h->originate_string = switch_core_strdup(h->pool, argv[2]);
-	h->timeout = atoi(argv[5]);
-
-	switch_threadattr_create(&thd_attr, h->pool);
-	switch_threadattr_detach_set(thd_attr, 1);
-	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_thread_create(&thread, thd_attr, outbound_enterprise_thread_run, h, h->pool);
-
-	(*need)--;
-
-	return *need ? 0 : -1;
-}
-
 /*!\brief Find outbound members to call for a given fifo node
  *
  * We're given a fifo node that has callers to be delivered to agents.
  * Our job is to find available outbound members and pass them to the
  * appropriate outbound strategy handler.
  *
+ * Members are taken from the head of the node's outbound index, which
+ * keeps them in the order the dispatcher wants them.  Each member we
+ * take gets a ring slot and the node a ringing consumer right away,
+ * so the next pass doesn't pick them again before the outbound
+ * threads get going; the threads give them back when they're done.
+ *
  * The ringall strategy handler needs the full list of members to do
- * its job, so we first let `place_call_ringall_callback` accumulate
- * the results.  The enterprise strategy handler can simply take each
- * member one at a time, so the `place_call_enterprise_callback` takes
- * care of invoking the handler.
+ * its job, so they're all handed to a single thread.  The enterprise
+ * strategy handler takes one member per thread.
  *
  * Within the ringall call strategy outbound_per_cycle is used to define
  * how many agents exactly are assigned to the caller. With ringall if
@@ -2011,177 +2491,341 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
  * will be rung by an incoming caller through fifo, which can give a ringall
  * effect. outbound_per_cycle and outbound_per_cycle_min both default to 1.
  *
+ * When we come up short because members are still resting after
+ * their last call, `retry` is set to when the first of them is back.
  */
-static int find_consumers(fifo_node_t *node)
+static int find_consumers(fifo_node_t *node, switch_time_t *retry)
 {
-	char *sql;
-	int ret = 0;
-
-	sql = switch_mprintf("select uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
-						 "next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname "
-						 "from fifo_outbound "
-						 "where taking_calls = 1 and (fifo_name = '%q') and ((use_count+ring_count) < simo_count) and (next_avail = 0 or next_avail <= %ld) "
-						 "order by next_avail, outbound_fail_count, outbound_call_count",
-						 node->name, (long) switch_epoch_time_now(NULL)
-						 );
+	fifo_outbound_list_t *list;
+	fifo_outbound_t *row;
+	struct callback_helper *cbh = NULL;
+	switch_memory_pool_t *pool = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+	switch_thread_t *thread;
+	long now = (long) switch_epoch_time_now(NULL);
+	int need, i;
 
 	switch(node->outbound_strategy) {
 	case NODE_STRATEGY_ENTERPRISE:
-		{
-			int need = node_caller_count(node);
-			int count;
+		need = node_caller_count(node);
 
-			if (node->outbound_per_cycle && node->outbound_per_cycle < need) {
-				need = node->outbound_per_cycle;
-			} else if (node->outbound_per_cycle_min && node->outbound_per_cycle_min > need) {
-				need = node->outbound_per_cycle_min;
-			}
-
-			count = need;
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_enterprise_callback, &need);
-			ret = count - need;
+		if (node->outbound_per_cycle && node->outbound_per_cycle < need) {
+			need = node->outbound_per_cycle;
+		} else if (node->outbound_per_cycle_min && node->outbound_per_cycle_min > need) {
+			need = node->outbound_per_cycle_min;
 		}
 		break;
 	case NODE_STRATEGY_RINGALL:
-		{
-			switch_thread_t *thread;
-			switch_threadattr_t *thd_attr = NULL;
-			struct callback_helper *cbh = NULL;
-			switch_memory_pool_t *pool = NULL;
-
-			switch_core_new_memory_pool(&pool);
-			cbh = switch_core_alloc(pool, sizeof(*cbh));
-			cbh->pool = pool;
-			cbh->need = 1;
-
-			if (node->outbound_per_cycle != cbh->need) {
-				cbh->need = node->outbound_per_cycle;
+		need = node->outbound_per_cycle;
+		break;
+	default:
+		return 0;
+	}
+
+	if (need <= 0 || need > MAX_ROWS) {
+		need = MAX_ROWS;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	cbh = switch_core_alloc(pool, sizeof(*cbh));
+	cbh->pool = pool;
+
+	switch_mutex_lock(globals.outbound_mutex);
+	if ((list = switch_core_hash_find(globals.outbound_fifo_hash, node->name))) {
+		for (row = list->head; row && cbh->rowcount < need; row = row->next) {
+			struct call_helper *h;
+
+			if (row->next_avail && row->next_avail > now) {
+				/* everyone from here on is resting too */
+				*retry = (switch_time_t) row->next_avail * 1000000;
+				break;
 			}
 
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_ringall_callback, cbh);
+			if (row->taking_calls != 1 || row->use_count + row->ring_count >= row->simo_count) {
+				continue;
+			}
 
-			if (cbh->rowcount) {
-				ret = cbh->rowcount;
-				switch_threadattr_create(&thd_attr, cbh->pool);
-				switch_threadattr_detach_set(thd_attr, 1);
-				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				switch_thread_create(&thread, thd_attr, outbound_ringall_thread_run, cbh, cbh->pool);
+			outbound_index_update_locked(row->uuid, OUTBOUND_RING, 0);
+
+			if (node->outbound_strategy == NODE_STRATEGY_ENTERPRISE) {
+				switch_memory_pool_t *h_pool;
+
+				switch_core_new_memory_pool(&h_pool);
+				h = switch_core_alloc(h_pool, sizeof(*h));
+				h->pool = h_pool;
 			} else {
-				switch_core_destroy_memory_pool(&pool);
+				h = switch_core_alloc(cbh->pool, sizeof(*h));
+				h->pool = cbh->pool;
 			}
+
+			h->uuid = switch_core_strdup(h->pool, row->uuid);
+			h->node_name = switch_core_strdup(h->pool, row->fifo_name);
+			h->originate_string = switch_core_strdup(h->pool, row->originate_string);
+			h->timeout = row->timeout;
+			cbh->rows[cbh->rowcount++] = h;
 		}
-		break;
-	default:
-		break;
 	}
+	switch_mutex_unlock(globals.outbound_mutex);
 
-	switch_safe_free(sql);
-	return ret;
+	if (!cbh->rowcount) {
+		switch_core_destroy_memory_pool(&pool);
+		return 0;
+	}
+
+	switch_mutex_lock(node->update_mutex);
+	node->ring_consumer_count += (node->outbound_strategy == NODE_STRATEGY_ENTERPRISE) ? cbh->rowcount : 1;
+	switch_mutex_unlock(node->update_mutex);
+
+	if (node->outbound_strategy == NODE_STRATEGY_ENTERPRISE) {
+		int count = cbh->rowcount;
+
+		for (i = 0; i < count; i++) {
+			struct call_helper *h = cbh->rows[i];
+
+			switch_threadattr_create(&thd_attr, h->pool);
+			switch_threadattr_detach_set(thd_attr, 1);
+			switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+			switch_thread_create(&thread, thd_attr, outbound_enterprise_thread_run, h, h->pool);
+		}
+
+		switch_core_destroy_memory_pool(&pool);
+		return count;
+	}
+
+	switch_threadattr_create(&thd_attr, cbh->pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&thread, thd_attr, outbound_ringall_thread_run, cbh, cbh->pool);
+
+	return cbh->rowcount;
 }
 
-/*\brief Continuously attempt to deliver calls to outbound members
- *
- * For each outbound priority level 1-10, find fifo nodes with a
- * matching priority.  For each of those nodes with outbound members,
- * run `find_consumers()` if the fifo node has calls needing to be
- * delivered and not enough ready and waiting inbound consumers.
+/*!\brief Remove the nodes queued for deletion
  *
- * In the event of nothing needing to be done, each cycle starts at
- * priority 1 and ends at priority 10, yielding for one second
- * afterward.  We also yield after initiating outbound calls, starting
- * again where we left off on the next node.
+ * Expects globals.mutex to be held.  Nodes still in use are left for
+ * the next try.
+ */
+static void reap_nodes(void)
+{
+	fifo_node_t *node, *last = NULL, *this_node;
+	int busy = 0;
+
+	globals.nodes_removed = 0;
+	node = globals.nodes;
+
+	while(node) {
+		int x = 0;
+		switch_event_t *pop = NULL;
+
+		this_node = node;
+		node = node->next;
+
+		if (this_node->ready == 0) {
+			for (x = 0; x < MAX_PRI; x++) {
+				while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
+					const char *caller_uuid = switch_event_get_header(pop, "unique-id");
+					switch_ivr_kill_uuid(caller_uuid, SWITCH_CAUSE_MANAGER_REQUEST);
+					switch_event_destroy(&pop);
+				}
+			}
+
+			if (switch_thread_rwlock_trywrlock(this_node->rwlock) != SWITCH_STATUS_SUCCESS) {
+				busy++;
+				last = this_node;
+				continue;
+			}
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s removed.\n", this_node->name);
+
+			for (x = 0; x < MAX_PRI; x++) {
+				while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
+					switch_event_destroy(&pop);
+				}
+			}
+
+			if (last) {
+				last->next = this_node->next;
+			} else {
+				globals.nodes = this_node->next;
+			}
+
+			switch_core_hash_destroy(&this_node->consumer_hash);
+			switch_mutex_unlock(this_node->mutex);
+			switch_mutex_unlock(this_node->update_mutex);
+			switch_thread_rwlock_unlock(this_node->rwlock);
+			switch_core_destroy_memory_pool(&this_node->pool);
+			continue;
+		}
+
+		last = this_node;
+	}
+
+	if (busy) {
+		globals.nodes_removed = 1;
+	}
+}
+
+/*!\brief Look at a node the dispatcher was woken for
  *
- * We also take care of cleaning up after nodes queued for deletion.
+ * Expects globals.mutex to be held.  If the node has calls needing to
+ * be delivered and not enough ready and waiting inbound consumers, we
+ * run `find_consumers()`.  A node still short of members afterwards is
+ * looked at again right away, or once its first resting member is
+ * back.
  */
-static void *SWITCH_THREAD_FUNC node_thread_run(switch_thread_t *thread, void *obj)
+static void dispatch_node(fifo_dispatch_t *d)
 {
-	fifo_node_t *node, *last, *this_node;
-	int cur_priority = 1;
+	fifo_node_t *node;
+	int ppl_waiting, consumer_total, idle_consumers, placed;
+	switch_time_t retry = 0;
 
-	globals.node_thread_running = 1;
+	if (!(node = switch_core_hash_find(globals.fifo_hash, d->name)) || node->ready == 0 || !node->has_outbound || node->busy) {
+		return;
+	}
 
-	while (globals.node_thread_running == 1) {
-		int ppl_waiting, consumer_total, idle_consumers, need_sleep = 0;
+	ppl_waiting = node_caller_count(node);
+	consumer_total = node->consumer_count;
+	idle_consumers = node_idle_consumers(node);
 
-		switch_mutex_lock(globals.mutex);
+	if (globals.debug) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+						  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
+						  node->name, ppl_waiting, consumer_total, idle_consumers, node->ring_consumer_count, node->outbound_priority);
+	}
 
-		if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trying priority: %d\n", cur_priority);
+	if (!((ppl_waiting - node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers))) {
+		return;
+	}
 
-		last = NULL;
-		node = globals.nodes;
+	if ((placed = find_consumers(node, &retry))) {
+		node_record_latency(node, switch_micro_time_now() - d->since);
 
-		while(node) {
-			int x = 0;
-			switch_event_t *pop = NULL;
+		if (ppl_waiting - node->ring_consumer_count > 0) {
+			fifo_dispatch_schedule(node->name, switch_micro_time_now(), switch_micro_time_now());
+		}
+	} else if (retry) {
+		fifo_dispatch_schedule(node->name, d->since, retry);
+	}
+}
+
+static int dispatch_cmp(const void *a, const void *b)
+{
+	const fifo_dispatch_t *da = *(fifo_dispatch_t * const *) a;
+	const fifo_dispatch_t *db = *(fifo_dispatch_t * const *) b;
+
+	if (da->priority != db->priority) {
+		return da->priority < db->priority ? -1 : 1;
+	}
+
+	return da->since < db->since ? -1 : (da->since > db->since);
+}
+
+/*\brief Deliver calls to outbound members as the nodes need them
+ *
+ * The thread sleeps until a node is woken: a caller entering, a
+ * member or an outbound call freeing up, a member being added.  The
+ * nodes that are due are looked at in outbound priority order, 1 to
+ * 10, oldest first within a priority.
+ *
+ * We also take care of cleaning up after nodes queued for deletion.
+ */
+static void *SWITCH_THREAD_FUNC node_thread_run(switch_thread_t *thread, void *obj)
+{
+	switch_time_t next_refresh = 0;
 
-			this_node = node;
-			node = node->next;
+	globals.node_thread_running = 1;
 
-			if (this_node->ready == 0) {
-				for (x = 0; x < MAX_PRI; x++) {
-					while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
-						const char *caller_uuid = switch_event_get_header(pop, "unique-id");
-						switch_ivr_kill_uuid(caller_uuid, SWITCH_CAUSE_MANAGER_REQUEST);
-						switch_event_destroy(&pop);
+	while (globals.node_thread_running == 1) {
+		switch_time_t now = switch_micro_time_now(), next_due;
+		fifo_dispatch_t *ready = NULL, *d, **due = NULL;
+		switch_hash_index_t *hi;
+		void *val;
+		int count = 0, i;
+
+		if (now >= next_refresh) {
+			if (outbound_index_refresh()) {
+				switch_mutex_lock(globals.mutex);
+				for (hi = switch_core_hash_first(globals.fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+					fifo_node_t *node;
+
+					switch_core_hash_this(hi, NULL, NULL, &val);
+					node = (fifo_node_t *) val;
+					/* has_outbound may also come from the node's settings, leave it be */
+					if ((node->member_count = outbound_index_count(node->name)) > 0) {
+						node->has_outbound = 1;
 					}
 				}
+				switch_mutex_unlock(globals.mutex);
 			}
+			next_refresh = now + FIFO_FOREIGN_REFRESH;
+		}
 
-			if (this_node->ready == 0 && switch_thread_rwlock_trywrlock(this_node->rwlock) == SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s removed.\n", this_node->name);
+		next_due = next_refresh;
 
-				for (x = 0; x < MAX_PRI; x++) {
-					while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
-						switch_event_destroy(&pop);
-					}
-				}
+		switch_mutex_lock(globals.dispatch_mutex);
+		for (hi = switch_core_hash_first(globals.dispatch_hash); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			d = (fifo_dispatch_t *) val;
+			if (d->due <= now) {
+				d->next = ready;
+				ready = d;
+				count++;
+			} else if (d->due < next_due) {
+				next_due = d->due;
+			}
+		}
 
-				if (last) {
-					last->next = this_node->next;
-				} else {
-					globals.nodes = this_node->next;
-				}
+		for (d = ready; d; d = d->next) {
+			switch_core_hash_delete(globals.dispatch_hash, d->name);
+		}
 
-				switch_core_hash_destroy(&this_node->consumer_hash);
-				switch_mutex_unlock(this_node->mutex);
-				switch_mutex_unlock(this_node->update_mutex);
-				switch_thread_rwlock_unlock(this_node->rwlock);
-				switch_core_destroy_memory_pool(&this_node->pool);
-				continue;
+		if (!ready) {
+			/* the timeout also retries nodes queued for deletion that were still busy */
+			switch_thread_cond_timedwait(globals.dispatch_cond, globals.dispatch_mutex, next_due - now);
+		}
+		switch_mutex_unlock(globals.dispatch_mutex);
+
+		if (globals.node_thread_running != 1) {
+			while ((d = ready)) {
+				ready = d->next;
+				free(d->name);
+				free(d);
 			}
+			break;
+		}
 
-			last = this_node;
+		switch_mutex_lock(globals.mutex);
 
-			if (this_node->outbound_priority == 0) this_node->outbound_priority = 5;
+		if (globals.nodes_removed) {
+			reap_nodes();
+		}
 
-			if (this_node->has_outbound && !this_node->busy && this_node->outbound_priority == cur_priority) {
-				ppl_waiting = node_caller_count(this_node);
-				consumer_total = this_node->consumer_count;
-				idle_consumers = node_idle_consumers(this_node);
+		if (count) {
+			fifo_node_t *node;
 
-				if (globals.debug) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-									  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
-									  this_node->name, ppl_waiting, consumer_total, idle_consumers, this_node->ring_consumer_count, this_node->outbound_priority);
+			switch_zmalloc(due, count * sizeof(*due));
+			for (i = 0, d = ready; d; d = d->next) {
+				if ((node = switch_core_hash_find(globals.fifo_hash, d->name))) {
+					if (node->outbound_priority == 0) node->outbound_priority = 5;
+					d->priority = node->outbound_priority;
 				}
+				due[i++] = d;
+			}
 
-				if ((ppl_waiting - this_node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers)) {
-					if (find_consumers(this_node)) {
-						need_sleep++;
-					}
-				}
+			qsort(due, count, sizeof(*due), dispatch_cmp);
+
+			if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Dispatching %d node(s)\n", count);
+
+			for (i = 0; i < count; i++) {
+				dispatch_node(due[i]);
+				free(due[i]->name);
+				free(due[i]);
 			}
-		}
 
-		if (++cur_priority > 10) {
-			cur_priority = 1;
+			free(due);
 		}
 
 		switch_mutex_unlock(globals.mutex);
-
-		if (cur_priority == 1 || need_sleep) {
-			switch_yield(1000000);
-		}
 	}
 
 	globals.node_thread_running = 0;
@@ -2203,7 +2847,10 @@ static int stop_node_thread(void)
 {
 	switch_status_t st = SWITCH_STATUS_SUCCESS;
 
+	switch_mutex_lock(globals.dispatch_mutex);
 	globals.node_thread_running = -1;
+	switch_thread_cond_signal(globals.dispatch_cond);
+	switch_mutex_unlock(globals.dispatch_mutex);
 	switch_thread_join(&st, globals.node_thread);
 
 	return 0;
@@ -2337,6 +2984,7 @@ static uint32_t fifo_add_outbound(const char *node_name, const char *url, uint32
 	call_event = NULL;
 
 	i = fifo_queue_size(node->fifo_list[priority]);
+	fifo_dispatch_wake(node->name);
 
 	switch_thread_rwlock_unlock(node->rwlock);
 
@@ -2401,8 +3049,9 @@ static void dec_use_count(switch_core_session_t *session, const char *type)
 		del_bridge_call(outbound_id);
 		sql = switch_mprintf("update fifo_outbound set use_count=use_count-1, stop_time=%ld, next_avail=%ld + lag + 1 where use_count > 0 and uuid='%q'",
 							 now, now, outbound_id);
-		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 		fifo_dec_use_count(outbound_id);
+		outbound_index_update(outbound_id, OUTBOUND_USE_DONE, 0);
 	}
 
 	do_unbridge(session, NULL);
@@ -2491,8 +3140,9 @@ SWITCH_STANDARD_APP(fifo_track_call_function)
 
 	sql = switch_mprintf("update fifo_outbound set stop_time=0,start_time=%ld,outbound_fail_count=0,use_count=use_count+1,%s=%s+1,%s=%s+1 where uuid='%q'",
 						 (long) switch_epoch_time_now(NULL), col1, col1, col2, col2, data);
-	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 	fifo_inc_use_count(data);
+	outbound_index_update(data, OUTBOUND_USE, 0);
 
 	if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_INBOUND) {
 		cid_name = switch_channel_get_variable(channel, "destination_number");
@@ -2754,6 +3404,7 @@ SWITCH_STANDARD_APP(fifo_function)
 		fifo_queue_push(node->fifo_list[p], call_event);
 		fifo_caller_add(node, session);
 		in_table = 1;
+		fifo_dispatch_wake(node->name);
 
 		call_event = NULL;
 		switch_snprintf(tmp, sizeof(tmp), "%d", fifo_queue_size(node->fifo_list[p]));
@@ -3371,8 +4022,9 @@ SWITCH_STANDARD_APP(fifo_function)
 					sql = switch_mprintf("update fifo_outbound set stop_time=0,start_time=%ld,use_count=use_count+1,outbound_fail_count=0 where uuid='%q'",
 										 switch_epoch_time_now(NULL), outbound_id);
 
-					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 					fifo_inc_use_count(outbound_id);
+					outbound_index_update(outbound_id, OUTBOUND_USE, 0);
 				}
 
 				if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -3452,10 +4104,11 @@ SWITCH_STANDARD_APP(fifo_function)
 										 "outbound_call_count=outbound_call_count+1, next_avail=%ld + lag + 1 where uuid='%q' and use_count > 0",
 										 now, now, outbound_id);
 
-					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
 
 					del_bridge_call(outbound_id);
 					fifo_dec_use_count(outbound_id);
+					outbound_index_update(outbound_id, OUTBOUND_CALL_DONE, 0);
 				}
 
 				if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -3645,6 +4298,7 @@ SWITCH_STANDARD_APP(fifo_function)
 				switch_core_hash_delete(node->consumer_hash, switch_core_session_get_uuid(session));
 				node->consumer_count--;
 				switch_mutex_unlock(node->mutex);
+				fifo_dispatch_wake(node->name);
 			}
 		}
 
@@ -3674,6 +4328,7 @@ SWITCH_STANDARD_APP(fifo_function)
 		if (node->ready == 1 && do_destroy && node_caller_count(node) == 0 && node->consumer_count == 0) {
 			switch_core_hash_delete(globals.fifo_hash, node->name);
 			node->ready = 0;
+			globals.nodes_removed = 1;
 		}
 	}
 	switch_mutex_unlock(globals.mutex);
@@ -4168,7 +4823,48 @@ void node_dump(switch_stream_handle_t *stream)
 	switch_mutex_unlock(globals.mutex);
 }
 
-#define FIFO_API_SYNTAX "list|list_verbose|count|debug|status|has_outbound|importance [<fifo name>]|reparse [del_all]"
+#define FIFO_API_SYNTAX "list|list_verbose|count|debug|status|has_outbound|importance|latency|members [<fifo name>]|reparse [del_all]"
+/*!\brief Print how long a node's callers waited for outbound calls to be placed
+ *
+ * One line per node: the count for each bucket, then the worst seen.
+ */
+static void node_latency_dump(fifo_node_t *node, switch_stream_handle_t *stream)
+{
+	int i;
+
+	switch_mutex_lock(node->update_mutex);
+	stream->write_function(stream, "%s:", node->name);
+	for (i = 0; i < FIFO_LATENCY_BUCKETS - 1; i++) {
+		stream->write_function(stream, " <%dms:%u", fifo_latency_bounds[i], node->dispatch_latency[i]);
+	}
+	stream->write_function(stream, " >=%dms:%u max:%" SWITCH_TIME_T_FMT "ms\n", fifo_latency_bounds[FIFO_LATENCY_BUCKETS - 2],
+						   node->dispatch_latency[FIFO_LATENCY_BUCKETS - 1], node->dispatch_latency_max / 1000);
+	switch_mutex_unlock(node->update_mutex);
+}
+
+/*!\brief Print the outbound members of a fifo as the dispatcher sees them
+ *
+ * One line per member, in the order they would be rung.
+ */
+static int outbound_index_dump(const char *fifo_name, switch_stream_handle_t *stream)
+{
+	fifo_outbound_list_t *list;
+	fifo_outbound_t *row;
+	int x = 0;
+
+	switch_mutex_lock(globals.outbound_mutex);
+	if ((list = switch_core_hash_find(globals.outbound_fifo_hash, fifo_name))) {
+		for (row = list->head; row; row = row->next) {
+			stream->write_function(stream, "%s:%s:%s:%d:%d:%d:%d:%ld:%s\n", row->fifo_name, row->uuid, row->hostname, row->taking_calls,
+								   row->use_count, row->ring_count, row->simo_count, row->next_avail, row->originate_string);
+			x++;
+		}
+	}
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	return x;
+}
+
 SWITCH_STANDARD_API(fifo_api_function)
 {
 	fifo_node_t *node;
@@ -4301,6 +4997,38 @@ SWITCH_STANDARD_API(fifo_api_function)
 		} else {
 			stream->write_function(stream, "none\n");
 		}
+	} else if (!strcasecmp(argv[0], "latency")) {
+		if (argc < 2) {
+			for (hi = switch_core_hash_first(globals.fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+				switch_core_hash_this(hi, &var, NULL, &val);
+				node = (fifo_node_t *) val;
+				if (node->has_outbound) {
+					node_latency_dump(node, stream);
+					x++;
+				}
+			}
+
+			if (!x) {
+				stream->write_function(stream, "none\n");
+			}
+		} else if ((node = switch_core_hash_find(globals.fifo_hash, argv[1]))) {
+			node_latency_dump(node, stream);
+		} else {
+			stream->write_function(stream, "none\n");
+		}
+	} else if (!strcasecmp(argv[0], "members")) {
+		if (argc < 2) {
+			for (hi = switch_core_hash_first(globals.fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+				switch_core_hash_this(hi, &var, NULL, &val);
+				x += outbound_index_dump((char *) var, stream);
+			}
+		} else {
+			x = outbound_index_dump(argv[1], stream);
+		}
+
+		if (!x) {
+			stream->write_function(stream, "none\n");
+		}
 	} else {
 		stream->write_function(stream, "-ERR Usage: %s\n", FIFO_API_SYNTAX);
 	}
@@ -4508,6 +5236,16 @@ static switch_status_t load_config(int reload, int del_all)
 
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
 
+	switch_mutex_lock(globals.outbound_mutex);
+	if (reload) {
+		outbound_index_del_host(globals.hostname, !del_all);
+	} else {
+		fifo_execute_sql_callback(globals.sql_mutex, "select uuid, fifo_name, originate_string, hostname, simo_count, timeout, lag, taking_calls, "
+								  "static, use_count, ring_count, next_avail, outbound_call_count, outbound_fail_count from fifo_outbound",
+								  outbound_load_callback, NULL);
+	}
+	switch_mutex_unlock(globals.outbound_mutex);
+
 	if (!switch_core_hash_find(globals.fifo_hash, MANUAL_QUEUE_NAME)) {
 		node = create_node(MANUAL_QUEUE_NAME, 0, globals.sql_mutex);
 		node->ready = 2;
@@ -4638,12 +5376,18 @@ static switch_status_t load_config(int reload, int del_all)
 									 (long) switch_epoch_time_now(NULL));
 				switch_assert(sql);
 				fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
+
+				switch_mutex_lock(globals.outbound_mutex);
+				outbound_index_add(digest, node->name, member->txt, globals.hostname, simo_i, timeout_i, lag_i, taking_calls_i, 1);
+				switch_mutex_unlock(globals.outbound_mutex);
+
 				node->has_outbound = 1;
 				node->member_count++;
 			}
 			node->ready = 1;
 			node->is_static = 1;
 			switch_mutex_unlock(node->mutex);
+			fifo_dispatch_wake(node->name);
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s configured\n", node->name);
 		}
 	}
@@ -4659,6 +5403,7 @@ static switch_status_t load_config(int reload, int del_all)
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s queued for removal\n", node->name);
 				switch_core_hash_delete(globals.fifo_hash, node->name);
 				node->ready = 0;
+				globals.nodes_removed = 1;
 			}
 		}
 		switch_mutex_unlock(globals.mutex);
@@ -4671,8 +5416,6 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 {
 	char digest[SWITCH_MD5_DIGEST_STRING_SIZE] = { 0 };
 	char *sql, *name_dup, *p;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
 	fifo_node_t *node = NULL;
 
 	if (!fifo_name) return;
@@ -4709,25 +5452,24 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
 	free(name_dup);
 
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", fifo_name);
-	fifo_execute_sql_callback(globals.sql_mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	switch_mutex_lock(globals.outbound_mutex);
+	outbound_index_add(digest, fifo_name, originate_string, globals.hostname, simo_count, timeout, lag, taking_calls, 0);
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	node->member_count = outbound_index_count(fifo_name);
 	if (node->member_count > 0) {
 		node->has_outbound = 1;
 	} else {
 		node->has_outbound = 0;
 	}
-	switch_safe_free(sql);
+
+	fifo_dispatch_wake(node->name);
 }
 
 static void fifo_member_del(char *fifo_name, char *originate_string)
 {
 	char digest[SWITCH_MD5_DIGEST_STRING_SIZE] = { 0 };
 	char *sql;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
 	fifo_node_t *node = NULL;
 
 	if (!fifo_name) return;
@@ -4749,17 +5491,16 @@ static void fifo_member_del(char *fifo_name, char *originate_string)
 	}
 	switch_mutex_unlock(globals.mutex);
 
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", node->name);
-	fifo_execute_sql_callback(globals.sql_mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	switch_mutex_lock(globals.outbound_mutex);
+	outbound_index_del(fifo_name, digest, globals.hostname);
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	node->member_count = outbound_index_count(node->name);
 	if (node->member_count > 0) {
 		node->has_outbound = 1;
 	} else {
 		node->has_outbound = 0;
 	}
-	switch_safe_free(sql);
 }
 
 #define FIFO_MEMBER_API_SYNTAX "[add <fifo_name> <originate_string> [<simo_count>] [<timeout>] [<lag>] [<expires>] [<taking_calls>] | del <fifo_name> <originate_string>]"
@@ -4879,6 +5620,13 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_fifo_load)
 	switch_mutex_init(&globals.use_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 	switch_mutex_init(&globals.sql_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
+	switch_core_hash_init(&globals.outbound_hash);
+	switch_core_hash_init(&globals.outbound_fifo_hash);
+	switch_core_hash_init(&globals.dispatch_hash);
+	switch_mutex_init(&globals.outbound_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+	switch_mutex_init(&globals.dispatch_mutex, SWITCH_MUTEX_UNNESTED, globals.pool);
+	switch_thread_cond_create(&globals.dispatch_cond, globals.pool);
+
 	globals.running = 1;
 
 	if ((status = load_config(0, 1)) != SWITCH_STATUS_SUCCESS) {
@@ -4904,6 +5652,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_fifo_load)
 	switch_console_set_complete("add fifo status");
 	switch_console_set_complete("add fifo has_outbound");
 	switch_console_set_complete("add fifo importance");
+	switch_console_set_complete("add fifo latency");
+	switch_console_set_complete("add fifo members");
 	switch_console_set_complete("add fifo reparse");
 	switch_console_set_complete("add fifo_check_bridge ::console::list_uuid");
 
@@ -4920,6 +5670,8 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_fifo_shutdown)
 	switch_event_t *pop = NULL;
 	fifo_node_t *node, *this_node;
 	switch_mutex_t *mutex = globals.mutex;
+	switch_hash_index_t *hi;
+	void *val;
 
 	switch_sql_queue_manager_destroy(&globals.qm);
 
@@ -4964,6 +5716,34 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_fifo_shutdown)
 	switch_core_hash_destroy(&globals.consumer_orig_hash);
 	switch_core_hash_destroy(&globals.bridge_hash);
 	switch_core_hash_destroy(&globals.use_hash);
+
+	switch_mutex_lock(globals.dispatch_mutex);
+	for (hi = switch_core_hash_first(globals.dispatch_hash); hi; hi = switch_core_hash_next(&hi)) {
+		fifo_dispatch_t *d;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		d = (fifo_dispatch_t *) val;
+		switch_safe_free(d->name);
+		free(d);
+	}
+	switch_core_hash_destroy(&globals.dispatch_hash);
+	switch_mutex_unlock(globals.dispatch_mutex);
+
+	switch_mutex_lock(globals.outbound_mutex);
+	for (hi = switch_core_hash_first(globals.outbound_fifo_hash); hi; hi = switch_core_hash_next(&hi)) {
+		fifo_outbound_list_t *list;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		list = (fifo_outbound_list_t *) val;
+		while (list->head) {
+			outbound_index_free(list->head);
+		}
+		free(list);
+	}
+	switch_core_hash_destroy(&globals.outbound_fifo_hash);
+	switch_core_hash_destroy(&globals.outbound_hash);
+	switch_mutex_unlock(globals.outbound_mutex);
+
 	memset(&globals, 0, sizeof(globals));
 	switch_mutex_unlock(mutex);
 
@@ -0,0 +1,125 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * test_fifo.c - Tests fifo members kept by other hosts sharing the database
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// Run test
+// make && libtool --mode=execute ./test/test_fifo
+
+/**
+ * Run SQL against the fifo database as another host would
+ */
+static switch_bool_t fifo_db_exec(const char *sql)
+{
+	switch_cache_db_handle_t *dbh = NULL;
+	char *err = NULL;
+
+	if (switch_cache_db_get_db_handle_dsn(&dbh, "fifo") != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_FALSE;
+	}
+
+	switch_cache_db_execute_sql(dbh, (char *) sql, &err);
+	switch_cache_db_release_db_handle(&dbh);
+
+	if (err) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: %s\n", sql, err);
+		free(err);
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+/**
+ * Wait for the output of a fifo API command to contain some text, or not to
+ */
+static switch_bool_t wait_api(const char *cmd, const char *text, switch_bool_t present)
+{
+	switch_time_t deadline = switch_micro_time_now() + 5000000;
+	switch_bool_t found = !present;
+
+	while (switch_micro_time_now() < deadline) {
+		switch_stream_handle_t stream = { 0 };
+
+		SWITCH_STANDARD_STREAM(stream);
+		switch_api_execute("fifo", cmd, NULL, &stream);
+		found = strstr((char *) stream.data, text) != NULL;
+		switch_safe_free(stream.data);
+
+		if (found == present) {
+			break;
+		}
+
+		switch_sleep(100000);
+	}
+
+	return found == present;
+}
+
+FST_CORE_BEGIN("conf")
+{
+	FST_MODULE_BEGIN(mod_fifo, fifo)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires(fifo_db_exec("delete from fifo_outbound where hostname='otherhost'"));
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+			fifo_db_exec("delete from fifo_outbound where hostname='otherhost'");
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(foreign_members_follow_database)
+		{
+			/* another host adds a member */
+			fst_requires(fifo_db_exec("insert into fifo_outbound (uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
+									  "next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname, taking_calls) "
+									  "values ('foreign-1', 'test_fifo', 'null/1000', 1, 0, 60, 0, 0, 0, 0, 0, 0, 'otherhost', 1)"));
+			fst_check(wait_api("members test_fifo", "test_fifo:foreign-1:otherhost:1:0:0:1:", SWITCH_TRUE));
+			fst_check(wait_api("count test_fifo", "test_fifo:0:0:1:", SWITCH_TRUE));
+			fst_check(wait_api("has_outbound test_fifo", "test_fifo:1", SWITCH_TRUE));
+
+			/* puts it on a call */
+			fst_requires(fifo_db_exec("update fifo_outbound set use_count=1 where uuid='foreign-1' and hostname='otherhost'"));
+			fst_check(wait_api("members test_fifo", "test_fifo:foreign-1:otherhost:1:1:0:1:", SWITCH_TRUE));
+
+			/* and takes it away */
+			fst_requires(fifo_db_exec("delete from fifo_outbound where uuid='foreign-1' and hostname='otherhost'"));
+			fst_check(wait_api("members test_fifo", "foreign-1", SWITCH_FALSE));
+			fst_check(wait_api("count test_fifo", "test_fifo:0:0:0:", SWITCH_TRUE));
+		}
+		FST_TEST_END()
+	}
+	FST_MODULE_END()
+}
+FST_CORE_END()
@@ -37,16 +37,37 @@
 #include "esl.h"
 
 #define LIMIT_HASH_CLEANUP_INTERVAL 900
+#define LIMIT_HASH_SHARDS 64
+
+#if defined(_MSC_VER)
+#define limit_hash_barrier() MemoryBarrier()
+#elif defined(__GNUC__)
+#define limit_hash_barrier() __sync_synchronize()
+#else
+#define limit_hash_barrier()
+#endif
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown);
 SWITCH_MODULE_DEFINITION(mod_hash, mod_hash_load, mod_hash_shutdown, NULL);
 
 /* CORE STUFF */
+
+/* Limit items are spread over shards so unrelated resources don't contend.
+ * The rwlock protects the shard's hash, counters are updated atomically
+ * under the read lock and the mutex serializes checks against a maximum.
+ * Readers of the rate window take no lock, it is published through a
+ * sequence count (see limit_hash_rate_snapshot). */
+typedef struct {
+	switch_thread_rwlock_t *rwlock;
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+} limit_hash_shard_t;
+
 static struct {
 	switch_memory_pool_t *pool;
-	switch_thread_rwlock_t *limit_hash_rwlock;
-	switch_hash_t *limit_hash;
+	limit_hash_shard_t limit_shards[LIMIT_HASH_SHARDS];
+	switch_bool_t limit_running;
 	switch_thread_rwlock_t *db_hash_rwlock;
 	switch_hash_t *db_hash;
 	switch_thread_rwlock_t *remote_hash_rwlock;
@@ -54,11 +75,14 @@ static struct {
 } globals;
 
 typedef struct {
-	uint32_t total_usage;	/* < Total */
-	uint32_t rate_usage;	/* < Current rate usage */
-	time_t last_check;		/* < Last rate check */
+	switch_atomic_t total_usage;	/* < Total */
+	uint32_t rate_usage;	/* < Rate usage in the current window */
+	uint32_t rate_prev;		/* < Rate usage in the previous window */
+	time_t last_check;		/* < Start of the current window */
 	uint32_t interval;		/* < Interval used on last rate check */
+	switch_time_t window_start;	/* < Start of the current window, in microseconds */
 	switch_time_t last_update;	/* < Last updated timestamp (rate or total) */
+	switch_atomic_t rate_seq;	/* < Odd while the rate window is being changed */
 } limit_hash_item_t;
 
 struct callback {
@@ -118,6 +142,161 @@ void limit_remote_destroy(limit_remote_t **r);
 static void do_config(switch_bool_t reload);
 
 
+static limit_hash_shard_t *limit_hash_shard(const char *key)
+{
+	switch_ssize_t klen = -1;
+
+	return &globals.limit_shards[switch_hashfunc_default(key, &klen) % LIMIT_HASH_SHARDS];
+}
+
+/* !\brief Finds the item for a key, creating it if asked to.  Returns with the shard read locked. */
+static limit_hash_item_t *limit_hash_item_rdlock(limit_hash_shard_t *shard, const char *key, switch_bool_t create)
+{
+	limit_hash_item_t *item;
+
+	for (;;) {
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		if ((item = switch_core_hash_find(shard->hash, key)) || !create) {
+			return item;
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
+
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		if (!switch_core_hash_find(shard->hash, key)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG10, "Creating new limit structure: key: %s\n", key);
+			switch_core_hash_insert_alloc(shard->hash, key, sizeof(limit_hash_item_t));
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
+	}
+}
+
+/* !\brief Estimates usage over the last interval seconds by weighting the previous window
+ * with how much of it still overlaps.  Needs a consistent window: the shard mutex, its write
+ * lock, or a copy from limit_hash_rate_snapshot().
+ */
+static uint32_t limit_hash_rate_estimate(const limit_hash_item_t *item, switch_time_t now)
+{
+	switch_time_t span = (switch_time_t) item->interval * 1000000;
+	switch_time_t elapsed = now - item->window_start;
+	uint32_t cur = item->rate_usage;
+	uint32_t prev = item->rate_prev;
+
+	if (!span) {
+		return cur;
+	}
+
+	if (elapsed >= 2 * span) {
+		return 0;
+	}
+
+	if (elapsed >= span) {
+		prev = cur;
+		cur = 0;
+		elapsed -= span;
+	}
+
+	if (elapsed < 0) {
+		elapsed = 0;
+	}
+
+	return cur + (uint32_t) ((prev * (span - elapsed) + span - 1) / span);
+}
+
+/* !\brief Starts a change of the rate window.  Caller must hold the shard mutex. */
+static void limit_hash_rate_write_begin(limit_hash_item_t *item)
+{
+	switch_atomic_inc(&item->rate_seq);
+	limit_hash_barrier();
+}
+
+static void limit_hash_rate_write_end(limit_hash_item_t *item)
+{
+	limit_hash_barrier();
+	switch_atomic_inc(&item->rate_seq);
+}
+
+/* !\brief Copies the rate window without taking a lock, retrying while a writer is in it */
+static void limit_hash_rate_snapshot(const limit_hash_item_t *item, limit_hash_item_t *snap)
+{
+	const volatile limit_hash_item_t *v = item;
+	uint32_t seq;
+
+	for (;;) {
+		seq = switch_atomic_read((volatile switch_atomic_t *) &item->rate_seq);
+
+		if (seq & 1) {
+			switch_cond_next();
+			continue;
+		}
+
+		limit_hash_barrier();
+		snap->rate_usage = v->rate_usage;
+		snap->rate_prev = v->rate_prev;
+		snap->interval = v->interval;
+		snap->window_start = v->window_start;
+		snap->last_check = v->last_check;
+		limit_hash_barrier();
+
+		if (switch_atomic_read((volatile switch_atomic_t *) &item->rate_seq) == seq) {
+			break;
+		}
+	}
+}
+
+/* !\brief Moves the rate window forward to now.  Caller must hold the shard mutex. */
+static uint32_t limit_hash_rate_roll(limit_hash_item_t *item, uint32_t interval, switch_time_t now)
+{
+	switch_time_t span = (switch_time_t) interval * 1000000;
+
+	limit_hash_rate_write_begin(item);
+
+	if (item->interval != interval || !item->window_start || now - item->window_start >= 2 * span) {
+		item->interval = interval;
+		item->window_start = now;
+		item->rate_usage = 0;
+		item->rate_prev = 0;
+	} else if (now - item->window_start >= span) {
+		item->rate_prev = item->rate_usage;
+		item->rate_usage = 0;
+		item->window_start += span;
+	}
+
+	item->last_check = (time_t) (item->window_start / 1000000);
+
+	limit_hash_rate_write_end(item);
+
+	return limit_hash_rate_estimate(item, now);
+}
+
+/* !\brief Estimates the rate usage of an item found under the shard read lock, without waiting on its mutex */
+static uint32_t limit_hash_rate_read(const limit_hash_item_t *item, switch_time_t now)
+{
+	limit_hash_item_t snap;
+
+	limit_hash_rate_snapshot(item, &snap);
+
+	return limit_hash_rate_estimate(&snap, now);
+}
+
+/* !\brief Determines whether a given entry is ready to be removed.  Caller must hold the shard write lock. */
+static switch_bool_t limit_hash_item_idle(limit_hash_item_t *item, switch_time_t now)
+{
+	return switch_atomic_read(&item->total_usage) == 0 && limit_hash_rate_estimate(item, now) == 0;
+}
+
+/* !\brief Frees an item if nobody is using it anymore */
+static void limit_hash_item_reap(limit_hash_shard_t *shard, const char *key)
+{
+	limit_hash_item_t *item;
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	if ((item = switch_core_hash_find(shard->hash, key)) && limit_hash_item_idle(item, switch_micro_time_now())) {
+		switch_core_hash_delete(shard->hash, key);
+		free(item);
+	}
+	switch_thread_rwlock_unlock(shard->rwlock);
+}
+
 /* \brief Enforces limit_hash restrictions
  * \param session current session
  * \param realm limit realm
@@ -132,20 +311,14 @@ SWITCH_LIMIT_INCR(limit_incr_hash)
 	char *hashkey = NULL;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	limit_hash_item_t *item = NULL;
-	time_t now = switch_epoch_time_now(NULL);
+	limit_hash_shard_t *shard = NULL;
 	limit_hash_private_t *pvt = NULL;
 	uint8_t increment = 1;
+	uint32_t total_usage, rate_usage = 0;
 	limit_hash_item_t remote_usage;
 
 	hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
-
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	/* Check if that realm+resource has ever been checked */
-	if (!(item = (limit_hash_item_t *) switch_core_hash_find(globals.limit_hash, hashkey))) {
-		/* No, create an empty structure and add it, then continue like as if it existed */
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG10, "Creating new limit structure: key: %s\n", hashkey);
-		item = (limit_hash_item_t *)switch_core_hash_insert_alloc(globals.limit_hash, hashkey, sizeof(limit_hash_item_t));
-	}
+	shard = limit_hash_shard(hashkey);
 
 	if (!(pvt = switch_channel_get_private(channel, "limit_hash"))) {
 		pvt = (limit_hash_private_t *) switch_core_session_alloc(session, sizeof(limit_hash_private_t));
@@ -158,51 +331,68 @@ SWITCH_LIMIT_INCR(limit_incr_hash)
 	increment = !switch_core_hash_find(pvt->hash, hashkey);
  	remote_usage = get_remote_usage(hashkey);
 
+	/* Check if that realm+resource has ever been checked, create it if not */
+	item = limit_hash_item_rdlock(shard, hashkey, SWITCH_TRUE);
+
+	if (interval > 0 || max >= 0) {
+		switch_mutex_lock(shard->mutex);
+	}
+
 	if (interval > 0) {
-		item->interval = interval;
-		if (item->last_check <= (now - interval)) {
-			item->rate_usage = 1;
-			item->last_check = now;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG10, "Usage for %s reset to 1\n",
-							  hashkey);
+		rate_usage = limit_hash_rate_roll(item, interval, switch_micro_time_now());
+
+		if ((max >= 0) && (rate_usage + 1 > (uint32_t) max)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s exceeds maximum rate of %d/%ds, now at %d\n",
+							  hashkey, max, interval, rate_usage);
+			status = SWITCH_STATUS_GENERR;
 		} else {
 			/* Always increment rate when its checked as it doesnt depend on the channel */
+			limit_hash_rate_write_begin(item);
 			item->rate_usage++;
-
-			if ((max >= 0) && (item->rate_usage > (uint32_t) max)) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s exceeds maximum rate of %d/%ds, now at %d\n",
-								  hashkey, max, interval, item->rate_usage);
-				status = SWITCH_STATUS_GENERR;
-				goto end;
-			}
+			limit_hash_rate_write_end(item);
+			rate_usage++;
 		}
-	} else if ((max >= 0) && (item->total_usage + increment + remote_usage.total_usage > (uint32_t) max)) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, item->total_usage);
+	} else if ((max >= 0) && (switch_atomic_read(&item->total_usage) + increment + remote_usage.total_usage > (uint32_t) max)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, switch_atomic_read(&item->total_usage));
 		status = SWITCH_STATUS_GENERR;
-		goto end;
 	}
 
-	if (increment) {
-		item->total_usage++;
+	if (status == SWITCH_STATUS_SUCCESS && increment) {
+		switch_atomic_inc(&item->total_usage);
+	}
+
+	if (interval > 0 || max >= 0) {
+		switch_mutex_unlock(shard->mutex);
+	}
+
+	total_usage = switch_atomic_read(&item->total_usage);
+
+	switch_thread_rwlock_unlock(shard->rwlock);
 
+	if (status != SWITCH_STATUS_SUCCESS) {
+		return status;
+	}
+
+	if (increment) {
+		/* the channel's reference keeps the item from being freed */
 		switch_core_hash_insert(pvt->hash, hashkey, item);
 
 		if (max == -1) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, item->total_usage + remote_usage.total_usage);
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, total_usage + remote_usage.total_usage);
 		} else if (interval == 0) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d\n", hashkey, item->total_usage + remote_usage.total_usage, max);
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d\n", hashkey, total_usage + remote_usage.total_usage, max);
 		} else {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d for the last %d seconds\n", hashkey,
-							  item->rate_usage, max, interval);
+							  rate_usage, max, interval);
 		}
 
-		switch_limit_fire_event("hash", realm, resource, item->total_usage, item->rate_usage, max, max >= 0 ? (uint32_t) max : 0);
+		switch_limit_fire_event("hash", realm, resource, total_usage, rate_usage, max, max >= 0 ? (uint32_t) max : 0);
 	}
 
 	/* Save current usage & rate into channel variables so it can be used later in the dialplan, or added to CDR records */
 	{
-		const char *susage = switch_core_session_sprintf(session, "%d", item->total_usage);
-		const char *srate = switch_core_session_sprintf(session, "%d", item->rate_usage);
+		const char *susage = switch_core_session_sprintf(session, "%d", total_usage);
+		const char *srate = switch_core_session_sprintf(session, "%d", rate_usage);
 
 		switch_channel_set_variable(channel, "limit_usage", susage);
 		switch_channel_set_variable(channel, switch_core_session_sprintf(session, "limit_usage_%s", hashkey), susage);
@@ -211,22 +401,14 @@ SWITCH_LIMIT_INCR(limit_incr_hash)
 		switch_channel_set_variable(channel, switch_core_session_sprintf(session, "limit_rate_%s", hashkey), srate);
 	}
 
-  end:
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	return status;
 }
 
 /* !\brief Determines whether a given entry is ready to be removed. */
 SWITCH_HASH_DELETE_FUNC(limit_hash_cleanup_delete_callback) {
 	limit_hash_item_t *item = (limit_hash_item_t *) val;
-	time_t now = switch_epoch_time_now(NULL);
 
-	/* reset to 0 if window has passed so we can clean it up */
-	if (item->rate_usage > 0 && (item->last_check <= (now - item->interval))) {
-		item->rate_usage = 0;
-	}
-
-	if (item->total_usage == 0 && item->rate_usage == 0) {
+	if (limit_hash_item_idle(item, switch_micro_time_now())) {
 		/* Noone is using this item anymore */
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Freeing limit item: %s\n", (const char *) key);
 
@@ -252,14 +434,39 @@ SWITCH_HASH_DELETE_FUNC(limit_hash_remote_cleanup_callback)
 /* !\brief Periodically checks for unused limit entries and frees them */
 SWITCH_STANDARD_SCHED_FUNC(limit_hash_cleanup_callback)
 {
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	if (globals.limit_hash) {
-		switch_core_hash_delete_multi(globals.limit_hash, limit_hash_cleanup_delete_callback, NULL);
+	int i;
+
+	if (!globals.limit_running) {
+		return;
+	}
+
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		limit_hash_shard_t *shard = &globals.limit_shards[i];
+
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		switch_core_hash_delete_multi(shard->hash, limit_hash_cleanup_delete_callback, NULL);
+		switch_thread_rwlock_unlock(shard->rwlock);
+	}
+
+	task->runtime = switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL;
+}
+
+/* !\brief Drops one channel reference from an item, freeing it when unused */
+static void limit_hash_item_release(switch_core_session_t *session, const char *hashkey)
+{
+	limit_hash_shard_t *shard = limit_hash_shard(hashkey);
+	limit_hash_item_t *item;
+	switch_bool_t idle = SWITCH_FALSE;
+
+	if ((item = limit_hash_item_rdlock(shard, hashkey, SWITCH_FALSE))) {
+		switch_atomic_dec(&item->total_usage);
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, switch_atomic_read(&item->total_usage));
+		idle = switch_atomic_read(&item->total_usage) == 0 && limit_hash_rate_read(item, switch_micro_time_now()) == 0;
 	}
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
+	switch_thread_rwlock_unlock(shard->rwlock);
 
-	if (globals.limit_hash) {
-		task->runtime = switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL;
+	if (idle) {
+		limit_hash_item_reap(shard, hashkey);
 	}
 }
 
@@ -268,12 +475,8 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	limit_hash_private_t *pvt = switch_channel_get_private(channel, "limit_hash");
-	limit_hash_item_t *item = NULL;
-
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
 
 	if (!pvt || !pvt->hash) {
-		switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -288,15 +491,7 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 
 			switch_core_hash_this(hi, &key, &keylen, &val);
 
-			item = (limit_hash_item_t *) val;
-			item->total_usage--;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", (const char *) key, item->total_usage);
-
-			if (item->total_usage == 0 && item->rate_usage == 0) {
-				/* Noone is using this item anymore */
-				switch_core_hash_delete(globals.limit_hash, (const char *) key);
-				free(item);
-			}
+			limit_hash_item_release(session, (const char *) key);
 
 			switch_core_hash_delete(pvt->hash, (const char *) key);
 		}
@@ -304,22 +499,12 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 	} else {
 		char *hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
 
-		if ((item = (limit_hash_item_t *) switch_core_hash_find(pvt->hash, hashkey))) {
-			item->total_usage--;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", (const char *) hashkey, item->total_usage);
-
+		if (switch_core_hash_find(pvt->hash, hashkey)) {
+			limit_hash_item_release(session, hashkey);
 			switch_core_hash_delete(pvt->hash, hashkey);
-
-			if (item->total_usage == 0 && item->rate_usage == 0) {
-				/* Noone is using this item anymore */
-				switch_core_hash_delete(globals.limit_hash, (const char *) hashkey);
-				free(item);
-			}
 		}
 	}
 
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
-
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -327,24 +512,24 @@ SWITCH_LIMIT_USAGE(limit_usage_hash)
 {
 	char *hash_key = NULL;
 	limit_hash_item_t *item = NULL;
+	limit_hash_shard_t *shard = NULL;
 	int count = 0;
 	limit_hash_item_t remote_usage;
 
-	switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
-
 	hash_key = switch_mprintf("%s_%s", realm, resource);
+	shard = limit_hash_shard(hash_key);
 	remote_usage = get_remote_usage(hash_key);
 
 	count = remote_usage.total_usage;
 	*rcount = remote_usage.rate_usage;
 
-	if ((item = switch_core_hash_find(globals.limit_hash, hash_key))) {
-		count += item->total_usage;
-		*rcount += item->rate_usage;
+	if ((item = limit_hash_item_rdlock(shard, hash_key, SWITCH_FALSE))) {
+		count += switch_atomic_read(&item->total_usage);
+		*rcount += limit_hash_rate_read(item, switch_micro_time_now());
 	}
+	switch_thread_rwlock_unlock(shard->rwlock);
 
  	switch_safe_free(hash_key);
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 
 	return count;
 }
@@ -358,39 +543,44 @@ SWITCH_LIMIT_INTERVAL_RESET(limit_interval_reset_hash)
 {
 	char *hash_key = NULL;
 	limit_hash_item_t *item = NULL;
-
-	switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
+	limit_hash_shard_t *shard = NULL;
 
 	hash_key = switch_mprintf("%s_%s", realm, resource);
-	if ((item = switch_core_hash_find(globals.limit_hash, hash_key))) {
+	shard = limit_hash_shard(hash_key);
+
+	if ((item = limit_hash_item_rdlock(shard, hash_key, SWITCH_FALSE))) {
+		switch_mutex_lock(shard->mutex);
+		limit_hash_rate_write_begin(item);
 		item->rate_usage = 0;
+		item->rate_prev = 0;
+		item->window_start = switch_micro_time_now();
 		item->last_check = switch_epoch_time_now(NULL);
+		limit_hash_rate_write_end(item);
+		switch_mutex_unlock(shard->mutex);
 	}
+	switch_thread_rwlock_unlock(shard->rwlock);
 
  	switch_safe_free(hash_key);
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	return SWITCH_STATUS_SUCCESS;
 }
 
 SWITCH_LIMIT_STATUS(limit_status_hash)
 {
-	/*
-	switch_hash_index_t *hi = NULL;
 	int count = 0;
-	char *ret = NULL;
+	int i;
 
-	switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		limit_hash_shard_t *shard = &globals.limit_shards[i];
+		switch_hash_index_t *hi = NULL;
 
-	for (hi = switch_core_hash_first(globals.limit_hash); hi; switch_core_hash_next(hi)) {
-		count++;
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		for (hi = switch_core_hash_first(shard->hash); hi; hi = switch_core_hash_next(&hi)) {
+			count++;
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
-
-	ret = switch_mprintf("There are %d elements being tracked.", count);
-	return ret;
-	*/
-	return strdup("-ERR not supported yet (locking problems).");
+	return switch_mprintf("There are %d elements being tracked.", count);
 }
 
 /* APP/API STUFF */
@@ -602,19 +792,28 @@ SWITCH_STANDARD_API(hash_dump_function)
 	}
 
 	if (mode & 1) {
-		switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
-		for (hi = switch_core_hash_first(globals.limit_hash); hi; hi = switch_core_hash_next(&hi)) {
-			void *val = NULL;
-			const void *key;
-			switch_ssize_t keylen;
-			limit_hash_item_t *item;
-			switch_core_hash_this(hi, &key, &keylen, &val);
+		switch_time_t now = switch_micro_time_now();
+		int i;
+
+		for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+			limit_hash_shard_t *shard = &globals.limit_shards[i];
+
+			switch_thread_rwlock_rdlock(shard->rwlock);
+			for (hi = switch_core_hash_first(shard->hash); hi; hi = switch_core_hash_next(&hi)) {
+				void *val = NULL;
+				const void *key;
+				switch_ssize_t keylen;
+				limit_hash_item_t *item, snap;
+				switch_core_hash_this(hi, &key, &keylen, &val);
 
-			item = (limit_hash_item_t *)val;
+				item = (limit_hash_item_t *)val;
+				limit_hash_rate_snapshot(item, &snap);
 
-			stream->write_function(stream, "L/%s/%d/%d/%d/%d\n", key, item->total_usage, item->rate_usage, item->interval, item->last_check);
+				stream->write_function(stream, "L/%s/%d/%d/%d/%d\n", key, switch_atomic_read(&item->total_usage), limit_hash_rate_estimate(&snap, now),
+									   snap.interval, (int) snap.last_check);
+			}
+			switch_thread_rwlock_unlock(shard->rwlock);
 		}
-		switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	}
 
 	if (mode & 2) {
@@ -944,6 +1143,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load)
 	switch_api_interface_t *commands_api_interface;
 	switch_limit_interface_t *limit_interface;
 	switch_status_t status;
+	int i;
 
 	memset(&globals, 0, sizeof(globals));
 	globals.pool = pool;
@@ -954,10 +1154,17 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load)
 		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_thread_rwlock_create(&globals.limit_hash_rwlock, globals.pool);
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		limit_hash_shard_t *shard = &globals.limit_shards[i];
+
+		switch_thread_rwlock_create(&shard->rwlock, globals.pool);
+		switch_mutex_init(&shard->mutex, SWITCH_MUTEX_UNNESTED, globals.pool);
+		switch_core_hash_init(&shard->hash);
+	}
+	globals.limit_running = SWITCH_TRUE;
+
 	switch_thread_rwlock_create(&globals.db_hash_rwlock, globals.pool);
 	switch_thread_rwlock_create(&globals.remote_hash_rwlock, globals.pool);
-	switch_core_hash_init(&globals.limit_hash);
 	switch_core_hash_init(&globals.db_hash);
 	switch_core_hash_init(&globals.remote_hash);
 
@@ -994,7 +1201,9 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 {
 	switch_hash_index_t *hi = NULL;
 	switch_bool_t remote_clean = SWITCH_TRUE;
+	int i;
 
+	globals.limit_running = SWITCH_FALSE;
 	switch_scheduler_del_task_group("mod_hash");
 
 	/* Kill remote connections, destroy needs a wrlock so we unlock after finding a pointer */
@@ -1021,18 +1230,26 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 		}
 	}
 
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	switch_thread_rwlock_wrlock(globals.db_hash_rwlock);
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		limit_hash_shard_t *shard = &globals.limit_shards[i];
 
-	while ((hi = switch_core_hash_first_iter( globals.limit_hash, hi))) {
-		void *val = NULL;
-		const void *key;
-		switch_ssize_t keylen;
-		switch_core_hash_this(hi, &key, &keylen, &val);
-		free(val);
-		switch_core_hash_delete(globals.limit_hash, key);
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		while ((hi = switch_core_hash_first_iter(shard->hash, hi))) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+			switch_core_hash_this(hi, &key, &keylen, &val);
+			free(val);
+			switch_core_hash_delete(shard->hash, key);
+		}
+		switch_core_hash_destroy(&shard->hash);
+		switch_thread_rwlock_unlock(shard->rwlock);
+		switch_thread_rwlock_destroy(shard->rwlock);
+		switch_mutex_destroy(shard->mutex);
 	}
 
+	switch_thread_rwlock_wrlock(globals.db_hash_rwlock);
+
 	while ((hi = switch_core_hash_first_iter( globals.db_hash, hi))) {
 		void *val = NULL;
 		const void *key;
@@ -1042,15 +1259,12 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 		switch_core_hash_delete(globals.db_hash, key);
 	}
 
-	switch_core_hash_destroy(&globals.limit_hash);
 	switch_core_hash_destroy(&globals.db_hash);
 	switch_core_hash_destroy(&globals.remote_hash);
 
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	switch_thread_rwlock_unlock(globals.db_hash_rwlock);
 
 	switch_thread_rwlock_destroy(globals.db_hash_rwlock);
-	switch_thread_rwlock_destroy(globals.limit_hash_rwlock);
 	switch_thread_rwlock_destroy(globals.remote_hash_rwlock);
 
 
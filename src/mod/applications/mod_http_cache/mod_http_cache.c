@@ -95,6 +95,7 @@ SWITCH_STANDARD_API(http_cache_prefetch);
 #define DOWNLOAD_NEEDED "download"
 #define DOWNLOAD 1
 #define PREFETCH 2
+#define STREAM 3
 
 typedef struct url_cache url_cache_t;
 
@@ -137,8 +138,12 @@ struct cached_url {
 	int used;
 	/** Status of this entry */
 	cached_url_status_t status;
-	/** Number of sessions waiting for this URL */
+	/** Number of sessions waiting for this URL (or playing it while it downloads) */
 	int waiters;
+	/** True if this URL may be played before its download completes */
+	int streamable;
+	/** True once enough of this URL has arrived to start playing it */
+	int stream_ready;
 	/** time when downloaded */
 	switch_time_t download_time;
 	/** nanoseconds until stale */
@@ -153,6 +158,8 @@ static void cached_url_destroy(cached_url_t *url, switch_memory_pool_t *pool);
  * Data for write_file_callback()
  */
 struct http_get_data {
+	/** The cache */
+	url_cache_t *cache;
 	/** File descriptor for the cached URL */
 	int fd;
 	/** The cached URL data */
@@ -209,6 +216,8 @@ struct url_cache {
 	simple_queue_t queue;
 	/** Synchronizes access to cache */
 	switch_mutex_t *mutex;
+	/** Signaled when a download completes or becomes playable */
+	switch_thread_cond_t *cond;
 	/** Memory pool */
 	switch_memory_pool_t *pool;
 	/** Number of cache hits */
@@ -217,6 +226,8 @@ struct url_cache {
 	int misses;
 	/** Number of cache errors */
 	int errors;
+	/** Number of playbacks started before their download completed */
+	int streams;
 	/** The prefetch queue */
 	switch_queue_t *prefetch_queue;
 	/** Max size of prefetch queue */
@@ -239,10 +250,14 @@ struct url_cache {
 	long connect_timeout;
 	/** How long to wait, in seconds, for download of file.  If 0, use default value of 300 seconds */
 	long download_timeout;
+	/** Bytes that must be downloaded before playback may start.  If 0, wait for the whole file */
+	size_t stream_prebuffer;
+	/** File extensions that can be played while downloading */
+	switch_hash_t *stream_extensions;
 };
 static url_cache_t gcache;
 
-static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_core_session_t *session, const char *url, int download, int refresh, switch_memory_pool_t *pool);
+static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_core_session_t *session, const char *url, int download, int refresh, switch_memory_pool_t *pool, cached_url_t **partial);
 static switch_status_t url_cache_add(url_cache_t *cache, switch_core_session_t *session, cached_url_t *url);
 static void url_cache_remove(url_cache_t *cache, switch_core_session_t *session, cached_url_t *url);
 static void url_cache_remove_soft(url_cache_t *cache, switch_core_session_t *session, cached_url_t *url);
@@ -498,8 +513,18 @@ static size_t get_file_callback(void *ptr, size_t size, size_t nmemb, void *get)
 		if (bytes_written != realsize) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "write(): short write!\n");
 		}
-		get_data->url->size += bytes_written;
 		result = bytes_written;
+
+		/* players of a stream read the size under the cache mutex */
+		switch_mutex_lock(get_data->cache->mutex);
+		get_data->url->size += bytes_written;
+
+		/* wake up anyone waiting to play this URL once there is enough of it */
+		if (get_data->url->streamable && !get_data->url->stream_ready && get_data->url->size >= get_data->cache->stream_prebuffer) {
+			get_data->url->stream_ready = 1;
+			switch_thread_cond_broadcast(get_data->cache->cond);
+		}
+		switch_mutex_unlock(get_data->cache->mutex);
 	}
 
 	return result;
@@ -704,6 +729,104 @@ static void url_cache_clear(url_cache_t *cache, switch_core_session_t *session)
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Emptied cache\n");
 }
 
+/**
+ * Finish a download started by url_cache_get().  The caller must lock the cache.
+ * @param cache The cache
+ * @param session the (optional) session
+ * @param u The downloaded URL
+ * @param status result of the download
+ */
+static void url_cache_download_done(url_cache_t *cache, switch_core_session_t *session, cached_url_t *u, switch_status_t status)
+{
+	if (u->status != CACHED_URL_RX_IN_PROGRESS) {
+		/* entry was abandoned while downloading, it will be deleted upon replacement */
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Discarding late download of URL %s\n", u->url);
+	} else if (status == SWITCH_STATUS_SUCCESS) {
+		/* Got the file, let the waiters know it is available */
+		u->status = CACHED_URL_AVAILABLE;
+		cache->size += u->size;
+	} else {
+		/* Did not get the file, flag for replacement */
+		url_cache_remove_soft(cache, session, u);
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Failed to download URL %s\n", u->url);
+		cache->errors++;
+	}
+
+	/* release the downloader's reference */
+	u->waiters--;
+	switch_thread_cond_broadcast(cache->cond);
+}
+
+/**
+ * Background download of a URL that is being played while it arrives
+ */
+struct url_cache_download {
+	/** The cache */
+	url_cache_t *cache;
+	/** HTTP profile */
+	http_profile_t *profile;
+	/** The URL to download */
+	cached_url_t *url;
+};
+
+/**
+ * Thread to download a URL that is played while it arrives
+ * @param thread the thread
+ * @param obj the download
+ * @return NULL
+ */
+static void *SWITCH_THREAD_FUNC url_cache_download_thread(switch_thread_t *thread, void *obj)
+{
+	struct url_cache_download *dl = obj;
+	url_cache_t *cache = dl->cache;
+	switch_status_t status = http_get(cache, dl->profile, dl->url, NULL);
+
+	url_cache_lock(cache, NULL);
+	url_cache_download_done(cache, NULL, dl->url, status);
+	url_cache_unlock(cache, NULL);
+
+	switch_thread_rwlock_unlock(cache->shutdown_lock);
+	free(dl);
+
+	return NULL;
+}
+
+/**
+ * Start downloading a URL in the background.  The caller must lock the cache.
+ * @param cache The cache
+ * @param profile optional profile
+ * @param u The URL to download
+ * @return SWITCH_STATUS_SUCCESS if the download thread was started
+ */
+static switch_status_t url_cache_download_start(url_cache_t *cache, http_profile_t *profile, cached_url_t *u)
+{
+	struct url_cache_download *dl;
+	switch_thread_data_t *td;
+
+	if (switch_thread_rwlock_tryrdlock(cache->shutdown_lock) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_zmalloc(dl, sizeof(*dl));
+	dl->cache = cache;
+	dl->profile = profile;
+	dl->url = u;
+
+	switch_zmalloc(td, sizeof(*td));
+	td->alloc = 1;
+	td->func = url_cache_download_thread;
+	td->obj = dl;
+
+	if (switch_thread_pool_launch_thread(&td) != SWITCH_STATUS_SUCCESS) {
+		switch_safe_free(td);
+		free(dl);
+		switch_thread_rwlock_unlock(cache->shutdown_lock);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 /**
  * Get a URL from the cache, add it if it does not exist
  * @param cache The cache
@@ -711,15 +834,23 @@ static void url_cache_clear(url_cache_t *cache, switch_core_session_t *session)
  * @param session the (optional) session requesting the URL
  * @param url The URL
  * @param download If DOWNLOAD, the file will be downloaded if it does not exist in the cache.  If PREFETCH, the file will be downloaded if not in cache and not being downloaded by another thread.
+ *                 If STREAM, same as DOWNLOAD but return as soon as enough of the file has arrived to start playing it.
  * @param refresh If true, existing cache entry is invalidated
  * @param pool The pool to use for allocating the filename
+ * @param partial If STREAM and the download is still in progress, this is set to the entry being downloaded.  Release with url_cache_release().
  * @return The filename or NULL if there is an error
  */
-static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_core_session_t *session, const char *url, int download, int refresh, switch_memory_pool_t *pool)
+static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_core_session_t *session, const char *url, int download, int refresh, switch_memory_pool_t *pool, cached_url_t **partial)
 {
 	switch_time_t download_timeout_ns = cache->download_timeout * 1000 * 1000;
 	char *filename = NULL;
 	cached_url_t *u = NULL;
+	int miss = 0;
+
+	if (partial) {
+		*partial = NULL;
+	}
+
 	if (zstr(url)) {
 		return NULL;
 	}
@@ -740,17 +871,19 @@ static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_c
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Cached URL manually expired.\n");
 			url_cache_remove_soft(cache, session, u); /* will get permanently deleted upon replacement */
 			u = NULL;
-		} else if (u->status == CACHED_URL_RX_IN_PROGRESS && switch_time_now() >= (u->download_time + download_timeout_ns)) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Download of URL has timed out.\n");
-			u = NULL;
 		}
+	} else if (u && u->status == CACHED_URL_RX_IN_PROGRESS && switch_time_now() >= (u->download_time + download_timeout_ns)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Download of URL has timed out.\n");
+		url_cache_remove_soft(cache, session, u); /* will get permanently deleted once the download gives up */
+		u = NULL;
 	}
 
 	if (!u && download) {
 		/* URL is not cached, let's add it.*/
 		/* Set up URL entry and add to map to prevent simultaneous downloads */
 		cache->misses++;
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Cache MISS: size = %zu (%zu MB), hit ratio = %d/%d\n", cache->queue.size, cache->size / 1000000, cache->hits, cache->hits + cache->misses);
+		miss = 1;
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Cache MISS: size = %zu (%zu MB), hit ratio = %d/%d, streamed = %d\n", cache->queue.size, cache->size / 1000000, cache->hits, cache->hits + cache->misses, cache->streams);
 		u = cached_url_create(cache, url, NULL);
 		if (url_cache_add(cache, session, u) != SWITCH_STATUS_SUCCESS) {
 			/* This error should never happen */
@@ -760,48 +893,69 @@ static char *url_cache_get(url_cache_t *cache, http_profile_t *profile, switch_c
 			return NULL;
 		}
 
-		/* download the file */
-		url_cache_unlock(cache, session);
-		if (http_get(cache, profile, u, session) == SWITCH_STATUS_SUCCESS) {
-			/* Got the file, let the waiters know it is available */
-			url_cache_lock(cache, session);
-			u->status = CACHED_URL_AVAILABLE;
-			filename = switch_core_strdup(pool, u->filename);
-			cache->size += u->size;
+		/* the downloader holds a reference so the entry can't be replaced under it */
+		u->waiters++;
+
+		if (download == STREAM && partial && u->streamable && url_cache_download_start(cache, profile, u) == SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Downloading URL %s in the background\n", url);
 		} else {
-			/* Did not get the file, flag for replacement */
+			/* download the file */
+			switch_status_t status;
+
+			url_cache_unlock(cache, session);
+			status = http_get(cache, profile, u, session);
 			url_cache_lock(cache, session);
-			url_cache_remove_soft(cache, session, u);
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Failed to download URL %s\n", url);
-			cache->errors++;
+			url_cache_download_done(cache, session, u, status);
 		}
-	} else if (!u || (u->status == CACHED_URL_RX_IN_PROGRESS && download != DOWNLOAD)) {
+	} else if (!u || (u->status == CACHED_URL_RX_IN_PROGRESS && download != DOWNLOAD && download != STREAM)) {
 		filename = DOWNLOAD_NEEDED;
-	} else {
-		/* Wait until file is downloaded */
-		if (u->status == CACHED_URL_RX_IN_PROGRESS) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Waiting for URL %s to be available\n", url);
-			u->waiters++;
-			url_cache_unlock(cache, session);
-			while(!gcache.shutdown && u->status == CACHED_URL_RX_IN_PROGRESS && switch_time_now() < (u->download_time + download_timeout_ns)) {
-				switch_sleep(10 * 1000); /* 10 ms */
-			}
-			url_cache_lock(cache, session);
-			u->waiters--;
+		goto done;
+	}
+
+	/* Wait until file is downloaded, or until enough has arrived to play it */
+	if (u->status == CACHED_URL_RX_IN_PROGRESS && !(download == STREAM && partial && u->stream_ready)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Waiting for URL %s to be available\n", url);
+		u->waiters++;
+		while (!cache->shutdown && u->status == CACHED_URL_RX_IN_PROGRESS && !(download == STREAM && partial && u->stream_ready) &&
+			   switch_time_now() < (u->download_time + download_timeout_ns)) {
+			switch_thread_cond_timedwait(cache->cond, cache->mutex, 1000 * 1000);
 		}
+		u->waiters--;
+	}
 
-		/* grab filename if everything is OK */
-		if (u->status == CACHED_URL_AVAILABLE) {
-			filename = switch_core_strdup(pool, u->filename);
+	/* grab filename if everything is OK */
+	if (u->status == CACHED_URL_AVAILABLE || (u->status == CACHED_URL_RX_IN_PROGRESS && download == STREAM && partial && u->stream_ready)) {
+		filename = switch_core_strdup(pool, u->filename);
+		u->used = 1;
+		if (!miss) {
 			cache->hits++;
-			u->used = 1;
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Cache HIT: size = %zu (%zu MB), hit ratio = %d/%d\n", cache->queue.size, cache->size / 1000000, cache->hits, cache->hits + cache->misses);
 		}
+		if (u->status == CACHED_URL_RX_IN_PROGRESS) {
+			/* caller plays the file while it downloads, hold a reference until it is done */
+			cache->streams++;
+			u->waiters++;
+			*partial = u;
+		}
 	}
+
+done:
 	url_cache_unlock(cache, session);
 	return filename;
 }
 
+/**
+ * Release a URL returned as partial by url_cache_get()
+ * @param cache The cache
+ * @param u The URL
+ */
+static void url_cache_release(url_cache_t *cache, cached_url_t *u)
+{
+	switch_mutex_lock(cache->mutex);
+	u->waiters--;
+	switch_mutex_unlock(cache->mutex);
+}
+
 /**
  * Add a URL to the cache.  The caller must lock the cache.
  * @param cache the cache
@@ -1062,6 +1216,8 @@ static cached_url_t *cached_url_create(url_cache_t *cache, const char *url, cons
 	u->used = 1;
 	u->status = CACHED_URL_RX_IN_PROGRESS;
 	u->waiters = 0;
+	u->streamable = cache->stream_prebuffer > 0 && u->extension && switch_core_hash_find(cache->stream_extensions, u->extension);
+	u->stream_ready = 0;
 	u->download_time = switch_time_now();
 	u->max_age = cache->default_max_age;
 
@@ -1105,6 +1261,7 @@ static switch_status_t http_get(url_cache_t *cache, http_profile_t *profile, cac
 	char *full_url = NULL;
 
 	/* set up HTTP GET */
+	get_data.cache = cache;
 	get_data.fd = 0;
 	get_data.url = url;
 
@@ -1186,7 +1343,9 @@ static switch_status_t http_get(url_cache_t *cache, http_profile_t *profile, cac
 			cached_url_set_extension_from_content_type(url, session);
 		}
 	} else {
+		switch_mutex_lock(cache->mutex);
 		url->size = 0; // nothing downloaded or download interrupted
+		switch_mutex_unlock(cache->mutex);
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Received curl error %d HTTP error code %ld trying to fetch %s\n", curl_status, httpRes, url->url);
 		status = SWITCH_STATUS_GENERR;
 		goto done;
@@ -1298,7 +1457,7 @@ SWITCH_STANDARD_API(http_cache_get)
 		refresh = switch_true(switch_event_get_header(params, "refresh"));
 	}
 
-	filename = url_cache_get(&gcache, profile, session, url, download, refresh, pool);
+	filename = url_cache_get(&gcache, profile, session, url, download, refresh, pool, NULL);
 	if (filename) {
 		stream->write_function(stream, "%s", filename);
 
@@ -1349,7 +1508,7 @@ SWITCH_STANDARD_API(http_cache_tryget)
 		switch_event_create_brackets(url, '{', '}', ',', &params, &url, SWITCH_FALSE);
 	}
 
-	filename = url_cache_get(&gcache, NULL, session, url, 0, params ? switch_true(switch_event_get_header(params, "refresh")) : SWITCH_FALSE, pool);
+	filename = url_cache_get(&gcache, NULL, session, url, 0, params ? switch_true(switch_event_get_header(params, "refresh")) : SWITCH_FALSE, pool, NULL);
 	if (filename) {
 		if (!strcmp(DOWNLOAD_NEEDED, filename)) {
 			stream->write_function(stream, "-ERR %s\n", DOWNLOAD_NEEDED);
@@ -1484,7 +1643,7 @@ SWITCH_STANDARD_API(http_cache_remove)
 		switch_event_create_brackets(url, '{', '}', ',', &params, &url, SWITCH_FALSE);
 	}
 
-	url_cache_get(&gcache, NULL, session, url, 0, 1, pool);
+	url_cache_get(&gcache, NULL, session, url, 0, 1, pool, NULL);
 	stream->write_function(stream, "+OK\n");
 
 	if (lpool) {
@@ -1592,6 +1751,7 @@ static switch_status_t do_config(url_cache_t *cache)
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	int max_urls;
 	switch_time_t default_max_age_sec;
+	const char *stream_extensions = "wav";
 
 	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "open of %s failed\n", cf);
@@ -1610,6 +1770,7 @@ static switch_status_t do_config(url_cache_t *cache)
 	cache->enable_file_formats = 0;
 	cache->connect_timeout = 300;
 	cache->download_timeout = 300;
+	cache->stream_prebuffer = 32768;
 
 	/* get params */
 	settings = switch_xml_child(cfg, "settings");
@@ -1658,6 +1819,15 @@ static switch_status_t do_config(url_cache_t *cache)
 					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Setting download-timeout to %s\n", val);
 					cache->download_timeout = int_val;
 				}
+			} else if (!strcasecmp(var, "stream-prebuffer")) {
+				int int_val = atoi(val);
+				if (int_val >= 0) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Setting stream-prebuffer to %s\n", val);
+					cache->stream_prebuffer = int_val;
+				}
+			} else if (!strcasecmp(var, "stream-extensions")) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Setting stream-extensions to %s\n", val);
+				stream_extensions = switch_core_strdup(cache->pool, val);
 			} else {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unsupported param: %s\n", var);
 			}
@@ -1758,6 +1928,19 @@ static switch_status_t do_config(url_cache_t *cache)
 
 	cache->max_url = max_urls;
 	cache->default_max_age = (default_max_age_sec * 1000 * 1000); /* convert from seconds to nanoseconds */
+
+	if (!zstr(stream_extensions)) {
+		char *extensions = switch_core_strdup(cache->pool, stream_extensions);
+		char *argv[64] = { 0 };
+		int argc = switch_separate_string(extensions, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+		int i;
+
+		for (i = 0; i < argc; i++) {
+			if (!zstr(argv[i])) {
+				switch_core_hash_insert(cache->stream_extensions, argv[i], cache);
+			}
+		}
+	}
 done:
 	switch_xml_free(xml);
 
@@ -1772,8 +1955,101 @@ struct http_context {
 	http_profile_t *profile;
 	char *local_path;
 	const char *write_url;
+	/** flags fh was opened with */
+	unsigned int file_flags;
+	/** download being played while it arrives, NULL once fully downloaded */
+	cached_url_t *stream_url;
+	/** bytes of the download that were present when fh was opened */
+	size_t stream_size;
+	/** sample offset of fh in the file */
+	int64_t stream_offset;
+	/** number of times playback caught up with the download */
+	uint32_t stream_underruns;
 };
 
+/**
+ * Open the local copy of a URL that is still downloading.  The decoded file cache
+ * and read-ahead are bypassed since the file is going to grow under us.
+ */
+static switch_status_t http_stream_open(switch_file_handle_t *handle, struct http_context *context, switch_file_handle_t *fh)
+{
+	char *path = switch_core_sprintf(handle->memory_pool, "{file_cache=false,async_io=false}%s", context->local_path);
+
+	return switch_core_file_open(fh, path, handle->channels, handle->samplerate, context->file_flags, NULL);
+}
+
+/**
+ * Stop tracking the download of a URL being played
+ */
+static void http_stream_done(struct http_context *context)
+{
+	if (context->stream_url) {
+		if (context->stream_underruns) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Playback of %s was starved by its download for %u read(s)\n",
+							  context->stream_url->url, context->stream_underruns);
+		}
+		url_cache_release(&gcache, context->stream_url);
+		context->stream_url = NULL;
+	}
+}
+
+/**
+ * Called when playback has read everything downloaded so far.  Reopens the file to pick
+ * up more of it, once enough has arrived, and resumes where playback left off.
+ * @param handle
+ * @param context
+ * @return SWITCH_STATUS_SUCCESS if reopened, SWITCH_STATUS_BREAK if still waiting, SWITCH_STATUS_FALSE if the download failed
+ */
+static switch_status_t http_stream_refresh(switch_file_handle_t *handle, struct http_context *context)
+{
+	cached_url_status_t url_status;
+	size_t size;
+	unsigned int pos = 0;
+	int64_t offset = context->stream_offset + context->fh.samples_in;
+
+	switch_mutex_lock(gcache.mutex);
+	url_status = context->stream_url->status;
+	size = context->stream_url->size;
+	switch_mutex_unlock(gcache.mutex);
+
+	if (url_status == CACHED_URL_REMOVE) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Download of %s failed during playback\n", context->stream_url->url);
+		http_stream_done(context);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (url_status == CACHED_URL_RX_IN_PROGRESS && size < context->stream_size + gcache.stream_prebuffer) {
+		/* not enough new data to bother */
+		return SWITCH_STATUS_BREAK;
+	}
+
+	switch_core_file_close(&context->fh);
+	memset(&context->fh, 0, sizeof(context->fh));
+
+	if (http_stream_open(handle, context, &context->fh) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Failed to reopen HTTP cache file: %s\n", context->local_path);
+		http_stream_done(context);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (offset > 0 && switch_core_file_seek(&context->fh, &pos, offset, SEEK_SET) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Failed to resume HTTP cache file: %s\n", context->local_path);
+		http_stream_done(context);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	context->stream_size = size;
+	context->stream_offset = offset;
+	handle->samples = context->fh.samples;
+
+	if (url_status == CACHED_URL_AVAILABLE) {
+		/* this is the whole file */
+		http_stream_done(context);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 /**
  * Open URL
  * @param handle
@@ -1785,6 +2061,7 @@ static switch_status_t http_cache_file_open(switch_file_handle_t *handle, const
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	struct http_context *context = switch_core_alloc(handle->memory_pool, sizeof(*context));
 	int file_flags = SWITCH_FILE_DATA_SHORT | (switch_test_flag(handle, SWITCH_FILE_FLAG_VIDEO) ? SWITCH_FILE_FLAG_VIDEO : 0);
+	int download = DOWNLOAD;
 
 	if (handle->params) {
 		context->profile = url_cache_http_profile_find(&gcache, switch_event_get_header(handle->params, "profile"));
@@ -1799,22 +2076,39 @@ static switch_status_t http_cache_file_open(switch_file_handle_t *handle, const
 	} else {
 		/* READ = HTTP GET */
 		file_flags |= SWITCH_FILE_FLAG_READ;
-		context->local_path = url_cache_get(&gcache, context->profile, NULL, path, 1, handle->params ? switch_true(switch_event_get_header(handle->params, "refresh")) : 0, handle->memory_pool);
+		/* play audio while it downloads unless told not to */
+		if (!switch_test_flag(handle, SWITCH_FILE_FLAG_VIDEO) && !(handle->params && switch_false(switch_event_get_header(handle->params, "stream")))) {
+			download = STREAM;
+		}
+		context->local_path = url_cache_get(&gcache, context->profile, NULL, path, download, handle->params ? switch_true(switch_event_get_header(handle->params, "refresh")) : 0, handle->memory_pool, &context->stream_url);
 		if (!context->local_path) {
 			return SWITCH_STATUS_FALSE;
 		}
 	}
 
-	context->fh.pre_buffer_datalen = handle->pre_buffer_datalen;
-	if ((status = switch_core_file_open(&context->fh,
-			context->local_path,
-			handle->channels,
-			handle->samplerate,
-			file_flags, NULL)) != SWITCH_STATUS_SUCCESS) {
+	context->file_flags = file_flags;
+
+	if (context->stream_url) {
+		switch_mutex_lock(gcache.mutex);
+		context->stream_size = context->stream_url->size;
+		switch_mutex_unlock(gcache.mutex);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Playing %s after %zu bytes downloaded\n", path, context->stream_size);
+		status = http_stream_open(handle, context, &context->fh);
+	} else {
+		context->fh.pre_buffer_datalen = handle->pre_buffer_datalen;
+		status = switch_core_file_open(&context->fh,
+				context->local_path,
+				handle->channels,
+				handle->samplerate,
+				file_flags, NULL);
+	}
+
+	if (status != SWITCH_STATUS_SUCCESS) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Failed to open HTTP cache file: %s, %s\n", context->local_path, path);
 			if (switch_test_flag(handle, SWITCH_FILE_FLAG_WRITE)) {
 				switch_safe_free(context->local_path);
 			}
+			http_stream_done(context);
 			return status;
 	}
 
@@ -1877,7 +2171,26 @@ static switch_status_t https_file_open(switch_file_handle_t *handle, const char
 static switch_status_t http_file_read(switch_file_handle_t *handle, void *data, size_t *len)
 {
 	struct http_context *context = (struct http_context *)handle->private_info;
-	return switch_core_file_read(&context->fh, data, len);
+	size_t want = *len;
+	switch_status_t status = switch_core_file_read(&context->fh, data, len);
+
+	if (context->stream_url && (status != SWITCH_STATUS_SUCCESS || !*len)) {
+		/* caught up with the download, pick up whatever has arrived since */
+		if ((status = http_stream_refresh(handle, context)) == SWITCH_STATUS_SUCCESS) {
+			*len = want;
+			status = switch_core_file_read(&context->fh, data, len);
+		}
+
+		if (context->stream_url && (status != SWITCH_STATUS_SUCCESS || !*len)) {
+			/* nothing to play until more arrives, most callers take anything but success as the end so play silence */
+			context->stream_underruns++;
+			*len = want;
+			memset(data, 0, switch_test_flag(handle, SWITCH_FILE_NATIVE) ? want : want * 2 * (handle->real_channels ? handle->real_channels : 1));
+			status = SWITCH_STATUS_SUCCESS;
+		}
+	}
+
+	return status;
 }
 
 /**
@@ -1928,6 +2241,8 @@ static switch_status_t http_file_close(switch_file_handle_t *handle)
 	switch_status_t status = switch_core_file_close(&context->fh);
 	long httpRes = 0;
 
+	http_stream_done(context);
+
 	if (status == SWITCH_STATUS_SUCCESS && !zstr(context->write_url)) {
 		status = http_put(&gcache, context->profile, NULL, context->write_url, context->local_path, 1, &httpRes);
 	}
@@ -1948,6 +2263,11 @@ static switch_status_t http_cache_file_seek(switch_file_handle_t *handle, unsign
 	}
 
 	if ((status = switch_core_file_seek(&context->fh, cur_sample, samples, whence)) == SWITCH_STATUS_SUCCESS) {
+		if (context->stream_url) {
+			/* track the new position in case the file has to be reopened */
+			context->stream_offset = *cur_sample;
+			context->fh.samples_in = 0;
+		}
 		handle->pos = context->fh.pos;
 		handle->offset_pos = context->fh.offset_pos;
 		handle->samples_in = context->fh.samples_in;
@@ -1984,7 +2304,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_http_cache_load)
 	switch_core_hash_init(&gcache.map);
 	switch_core_hash_init(&gcache.profiles);
 	switch_core_hash_init_nocase(&gcache.fqdn_profiles);
+	switch_core_hash_init_nocase(&gcache.stream_extensions);
 	switch_mutex_init(&gcache.mutex, SWITCH_MUTEX_UNNESTED, gcache.pool);
+	switch_thread_cond_create(&gcache.cond, gcache.pool);
 	switch_thread_rwlock_create(&gcache.shutdown_lock, gcache.pool);
 
 	if (do_config(&gcache) != SWITCH_STATUS_SUCCESS) {
@@ -2060,6 +2382,9 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_http_cache_shutdown)
 {
 	gcache.shutdown = 1;
 	switch_queue_interrupt_all(gcache.prefetch_queue);
+	switch_mutex_lock(gcache.mutex);
+	switch_thread_cond_broadcast(gcache.cond);
+	switch_mutex_unlock(gcache.mutex);
 	switch_thread_rwlock_wrlock(gcache.shutdown_lock);
 	switch_thread_rwlock_unlock(gcache.shutdown_lock);
 
@@ -2067,6 +2392,8 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_http_cache_shutdown)
 	switch_core_hash_destroy(&gcache.map);
 	switch_core_hash_destroy(&gcache.profiles);
 	switch_core_hash_destroy(&gcache.fqdn_profiles);
+	switch_core_hash_destroy(&gcache.stream_extensions);
+	switch_thread_cond_destroy(gcache.cond);
 	switch_mutex_destroy(gcache.mutex);
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -0,0 +1,309 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2021, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * test_http_cache_stream.c - Tests playback of URLs while they download
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// Run test
+// make && libtool --mode=execute ./test/test_http_cache_stream
+
+#define TEST_RATE 8000
+#define TEST_SECONDS 3
+#define TEST_SAMPLES (TEST_RATE * TEST_SECONDS)
+#define TEST_WAV_HEADER_LEN 44
+/* 100ms of audio every 50ms, so the whole file takes 1.5 seconds to arrive */
+#define TEST_CHUNK_BYTES 1600
+#define TEST_CHUNK_INTERVAL 50000
+
+/**
+ * Local stand-in for a slow HTTP server
+ */
+struct slow_server {
+	switch_socket_t *listener;
+	switch_port_t port;
+	volatile int running;
+	int requests;
+	switch_time_t done_time;
+	uint8_t wav[TEST_WAV_HEADER_LEN + TEST_SAMPLES * 2];
+};
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v & 0xffff);
+	put_le16(p + 2, v >> 16);
+}
+
+static void slow_server_build_wav(struct slow_server *server)
+{
+	uint8_t *p = server->wav;
+	uint32_t data_len = TEST_SAMPLES * 2;
+	int i;
+
+	memcpy(p, "RIFF", 4);
+	put_le32(p + 4, 36 + data_len);
+	memcpy(p + 8, "WAVEfmt ", 8);
+	put_le32(p + 16, 16);
+	put_le16(p + 20, 1);
+	put_le16(p + 22, 1);
+	put_le32(p + 24, TEST_RATE);
+	put_le32(p + 28, TEST_RATE * 2);
+	put_le16(p + 32, 2);
+	put_le16(p + 34, 16);
+	memcpy(p + 36, "data", 4);
+	put_le32(p + 40, data_len);
+
+	/* non-silent ramp so we know real audio came back */
+	for (i = 0; i < TEST_SAMPLES; i++) {
+		put_le16(p + TEST_WAV_HEADER_LEN + i * 2, (uint16_t)((i % 200) * 100 + 1));
+	}
+}
+
+static void *SWITCH_THREAD_FUNC slow_server_thread(switch_thread_t *thread, void *obj)
+{
+	struct slow_server *server = (struct slow_server *)obj;
+	switch_memory_pool_t *pool = NULL;
+
+	switch_core_new_memory_pool(&pool);
+
+	while (server->running) {
+		switch_socket_t *sock = NULL;
+		char buf[1024];
+		char header[256];
+		switch_size_t len = sizeof(buf);
+		switch_size_t pos = 0;
+
+		if (switch_socket_accept(&sock, server->listener, pool) != SWITCH_STATUS_SUCCESS) {
+			continue;
+		}
+
+		server->requests++;
+
+		/* a GET from curl fits in one read, its content doesn't matter */
+		switch_socket_recv(sock, buf, &len);
+
+		switch_snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: audio/wav\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", (int)sizeof(server->wav));
+		len = strlen(header);
+		switch_socket_send(sock, header, &len);
+
+		while (server->running && pos < sizeof(server->wav)) {
+			len = sizeof(server->wav) - pos;
+			if (len > TEST_CHUNK_BYTES) {
+				len = TEST_CHUNK_BYTES;
+			}
+			if (switch_socket_send(sock, (char *)server->wav + pos, &len) != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+			pos += len;
+			switch_sleep(TEST_CHUNK_INTERVAL);
+		}
+
+		if (!server->done_time) {
+			server->done_time = switch_time_now();
+		}
+
+		switch_socket_close(sock);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return NULL;
+}
+
+static switch_status_t slow_server_start(struct slow_server *server, switch_memory_pool_t *pool, switch_thread_t **thread)
+{
+	switch_sockaddr_t *addr = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+
+	slow_server_build_wav(server);
+
+	if (switch_sockaddr_info_get(&addr, "127.0.0.1", SWITCH_UNSPEC, 0, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&server->listener, switch_sockaddr_get_family(addr), SOCK_STREAM, SWITCH_PROTO_TCP, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_bind(server->listener, addr) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_listen(server->listener, 5) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_addr_get(&addr, SWITCH_FALSE, server->listener) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* wake up periodically to check if we're done */
+	switch_socket_timeout_set(server->listener, 100000);
+	server->port = switch_sockaddr_get_port(addr);
+	server->running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	return switch_thread_create(thread, thd_attr, slow_server_thread, server, pool);
+}
+
+static void slow_server_stop(struct slow_server *server, switch_thread_t *thread)
+{
+	switch_status_t st;
+
+	server->running = 0;
+	switch_thread_join(&st, thread);
+	switch_socket_close(server->listener);
+}
+
+/**
+ * Read everything from fh, waiting out underruns.  Returns the number of samples read.
+ * The test audio has no zero samples, so a frame of nothing but silence is an underrun.
+ */
+static switch_size_t read_all(switch_file_handle_t *fh, switch_time_t *first_audio, int *silent)
+{
+	int16_t buf[160];
+	switch_size_t total = 0;
+	switch_size_t i;
+
+	for (;;) {
+		switch_size_t len = sizeof(buf) / sizeof(buf[0]);
+		switch_status_t status = switch_core_file_read(fh, buf, &len);
+
+		if (status != SWITCH_STATUS_SUCCESS || !len) {
+			break;
+		}
+
+		for (i = 0; i < len && !buf[i]; i++);
+
+		if (i == len) {
+			switch_sleep(10000);
+			continue;
+		}
+
+		if (first_audio && !*first_audio) {
+			*first_audio = switch_time_now();
+		}
+
+		for (i = 0; i < len; i++) {
+			if (!buf[i]) {
+				(*silent)++;
+			}
+		}
+
+		total += len;
+	}
+
+	return total;
+}
+
+FST_CORE_BEGIN("conf_stream")
+{
+	FST_MODULE_BEGIN(mod_http_cache, http_cache_stream)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_sndfile");
+			fst_requires_module("mod_http_cache");
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(time_to_first_audio)
+		{
+			struct slow_server *server = switch_core_alloc(fst_pool, sizeof(*server));
+			switch_thread_t *thread = NULL;
+			switch_file_handle_t fh = { 0 };
+			switch_file_handle_t fh2 = { 0 };
+			switch_time_t start, first_audio = 0;
+			switch_size_t samples, samples2;
+			int silent = 0;
+			char *url;
+
+			fst_requires(slow_server_start(server, fst_pool, &thread) == SWITCH_STATUS_SUCCESS);
+			url = switch_core_sprintf(fst_pool, "http://127.0.0.1:%d/slow.wav", server->port);
+
+			start = switch_time_now();
+			fst_requires(switch_core_file_open(&fh, url, 1, TEST_RATE, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL) == SWITCH_STATUS_SUCCESS);
+
+			/* a second player joins the download in progress instead of starting another */
+			fst_requires(switch_core_file_open(&fh2, url, 1, TEST_RATE, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL) == SWITCH_STATUS_SUCCESS);
+
+			samples = read_all(&fh, &first_audio, &silent);
+			samples2 = read_all(&fh2, NULL, &silent);
+
+			switch_core_file_close(&fh);
+			switch_core_file_close(&fh2);
+			slow_server_stop(server, thread);
+
+			fst_requires(first_audio);
+			fst_requires(server->done_time);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "time to first audio %" SWITCH_TIME_T_FMT " ms, download %" SWITCH_TIME_T_FMT " ms\n",
+							  (first_audio - start) / 1000, (server->done_time - start) / 1000);
+
+			/* playback starts long before the download completes */
+			fst_check((first_audio - start) < (server->done_time - start) / 4);
+			fst_check_int_equals(samples, TEST_SAMPLES);
+			fst_check_int_equals(samples2, TEST_SAMPLES);
+			fst_check_int_equals(silent, 0);
+			fst_check_int_equals(server->requests, 1);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(cached_after_download)
+		{
+			struct slow_server *server = switch_core_alloc(fst_pool, sizeof(*server));
+			switch_thread_t *thread = NULL;
+			switch_file_handle_t fh = { 0 };
+			switch_stream_handle_t stream = { 0 };
+			switch_size_t samples;
+			int silent = 0;
+			char *url;
+
+			fst_requires(slow_server_start(server, fst_pool, &thread) == SWITCH_STATUS_SUCCESS);
+			url = switch_core_sprintf(fst_pool, "http://127.0.0.1:%d/cached.wav", server->port);
+
+			/* waits for the whole file */
+			SWITCH_STANDARD_STREAM(stream);
+			fst_check(switch_api_execute("http_get", url, NULL, &stream) == SWITCH_STATUS_SUCCESS);
+			fst_check(stream.data && strncmp((char *)stream.data, "-ERR", 4));
+			switch_safe_free(stream.data);
+
+			/* and playback is served from the cache */
+			fst_requires(switch_core_file_open(&fh, url, 1, TEST_RATE, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL) == SWITCH_STATUS_SUCCESS);
+			samples = read_all(&fh, NULL, &silent);
+			switch_core_file_close(&fh);
+			slow_server_stop(server, thread);
+
+			fst_check_int_equals(samples, TEST_SAMPLES);
+			fst_check_int_equals(silent, 0);
+			fst_check_int_equals(server->requests, 1);
+		}
+		FST_TEST_END()
+	}
+	FST_MODULE_END()
+}
+FST_CORE_END()
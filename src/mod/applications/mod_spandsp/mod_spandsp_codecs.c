@@ -236,18 +236,10 @@ static switch_status_t switch_g711u_encode(switch_codec_t *codec,
 										   uint32_t decoded_rate, void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
+	uint32_t samples = decoded_data_len / sizeof(short);
 
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_ulaw(dbuf[i]);
-	}
-
-	*encoded_data_len = i;
+	switch_g711_ulaw_encode(encoded_data, decoded_data, samples);
+	*encoded_data_len = samples;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -259,22 +251,12 @@ static switch_status_t switch_g711u_decode(switch_codec_t *codec,
 										   uint32_t encoded_rate, void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
-
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
 	if (*flag & SWITCH_CODEC_FLAG_SILENCE) {
-		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
+		memset(decoded_data, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = ulaw_to_linear(ebuf[i]);
-		}
-
-		*decoded_data_len = i * 2;
+		switch_g711_ulaw_decode(decoded_data, encoded_data, encoded_data_len);
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -307,18 +289,10 @@ static switch_status_t switch_g711a_encode(switch_codec_t *codec,
 										   uint32_t decoded_rate, void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
+	uint32_t samples = decoded_data_len / sizeof(short);
 
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_alaw(dbuf[i]);
-	}
-
-	*encoded_data_len = i;
+	switch_g711_alaw_encode(encoded_data, decoded_data, samples);
+	*encoded_data_len = samples;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -330,22 +304,12 @@ static switch_status_t switch_g711a_decode(switch_codec_t *codec,
 										   uint32_t encoded_rate, void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
-
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
 	if (*flag & SWITCH_CODEC_FLAG_SILENCE) {
-		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
+		memset(decoded_data, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = alaw_to_linear(ebuf[i]);
-		}
-
-		*decoded_data_len = i * 2;
+		switch_g711_alaw_decode(decoded_data, encoded_data, encoded_data_len);
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -144,6 +144,12 @@ struct opus_context {
 	enc_stats_t encoder_stats;
 	codec_control_state_t control_state;
 	switch_bool_t recreate_decoder;
+	/* encoder settings the call may change, as init left them */
+	opus_int32 init_bitrate;
+	opus_int32 init_plpct;
+	opus_int32 init_fec;
+	/* copy of the context right after init, see switch_opus_reset() */
+	struct opus_context *initial;
 };
 
 struct {
@@ -719,43 +725,96 @@ static switch_status_t switch_opus_init(switch_codec_t *codec, switch_codec_flag
 	}
 
 	context->codec_settings = opus_codec_settings;
+
+	if (context->encoder_object) {
+		opus_encoder_ctl(context->encoder_object, OPUS_GET_BITRATE(&context->init_bitrate));
+		opus_encoder_ctl(context->encoder_object, OPUS_GET_PACKET_LOSS_PERC(&context->init_plpct));
+		opus_encoder_ctl(context->encoder_object, OPUS_GET_INBAND_FEC(&context->init_fec));
+	}
+
+	if ((context->initial = switch_core_alloc(codec->memory_pool, sizeof(*context)))) {
+		*context->initial = *context;
+	}
+
 	codec->private_info = context;
 
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static void switch_opus_log_stats(switch_codec_t *codec, struct opus_context *context)
+{
+	switch_core_session_t *session = codec->session;
+
+	if (!session) {
+		return;
+	}
+
+	if (context->decoder_object) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,"Opus decoder stats: Frames[%d] PLC[%d] FEC[%d]\n",
+								context->decoder_stats.frame_counter, context->decoder_stats.plc_counter-context->decoder_stats.fec_counter, context->decoder_stats.fec_counter);
+	}
+
+	if (context->encoder_object) {
+		int avg_encoded_bitrate = 0;
+
+		if (context->encoder_stats.encoded_bytes > 0 && (context->encoder_stats.encoded_msec > 1000)) {
+			avg_encoded_bitrate = (context->encoder_stats.encoded_bytes * 8) / (context->encoder_stats.encoded_msec / 1000);
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+				"Opus encoder stats: Frames[%d] Bytes encoded[%d] Encoded length ms[%d] Average encoded bitrate bps[%d]\n",
+				context->encoder_stats.frame_counter, context->encoder_stats.encoded_bytes, context->encoder_stats.encoded_msec, avg_encoded_bitrate);
+
+		if (globals.debug || context->debug > 1) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+					"Opus encoder stats: FEC frames (only for debug mode) [%d]\n", context->encoder_stats.fec_counter);
+		}
+	}
+}
+
+/* Bring the handle back to where init left it so the core can hand it to the next call leg
+   without creating a new encoder and decoder. */
+static switch_status_t switch_opus_reset(switch_codec_t *codec)
+{
+	struct opus_context *context = codec->private_info;
+	struct opus_context *initial;
+
+	if (!context || !(initial = context->initial)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_opus_log_stats(codec, context);
+
+	if (context->encoder_object) {
+		/* OPUS_RESET_STATE keeps the ctl settings, put back the ones the call may have moved */
+		opus_encoder_ctl(context->encoder_object, OPUS_RESET_STATE);
+		opus_encoder_ctl(context->encoder_object, OPUS_SET_BITRATE(initial->init_bitrate));
+		opus_encoder_ctl(context->encoder_object, OPUS_SET_PACKET_LOSS_PERC(initial->init_plpct));
+		opus_encoder_ctl(context->encoder_object, OPUS_SET_INBAND_FEC(initial->init_fec));
+	}
+
+	if (context->decoder_object) {
+		opus_decoder_ctl(context->decoder_object, OPUS_RESET_STATE);
+	}
+
+	*context = *initial;
+	context->initial = initial;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_status_t switch_opus_destroy(switch_codec_t *codec)
 {
 	struct opus_context *context = codec->private_info;
 
 	if (context) {
+		switch_opus_log_stats(codec, context);
+
 		if (context->decoder_object) {
-			switch_core_session_t *session = codec->session;
-			if (session) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,"Opus decoder stats: Frames[%d] PLC[%d] FEC[%d]\n",
-										context->decoder_stats.frame_counter, context->decoder_stats.plc_counter-context->decoder_stats.fec_counter, context->decoder_stats.fec_counter);
-			}
 			opus_decoder_destroy(context->decoder_object);
 			context->decoder_object = NULL;
 		}
 		if (context->encoder_object) {
-			switch_core_session_t *session = codec->session;
-			int avg_encoded_bitrate = 0;
-			if (session) {
-
-				if (context->encoder_stats.encoded_bytes > 0 && (context->encoder_stats.encoded_msec > 1000)) {
-					avg_encoded_bitrate = (context->encoder_stats.encoded_bytes * 8) / (context->encoder_stats.encoded_msec / 1000);
-				}
-
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
-						"Opus encoder stats: Frames[%d] Bytes encoded[%d] Encoded length ms[%d] Average encoded bitrate bps[%d]\n",
-						context->encoder_stats.frame_counter, context->encoder_stats.encoded_bytes, context->encoder_stats.encoded_msec, avg_encoded_bitrate);
-
-				if (globals.debug || context->debug > 1) {
-					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
-							"Opus encoder stats: FEC frames (only for debug mode) [%d]\n", context->encoder_stats.fec_counter);
-				}
-			}
 			opus_encoder_destroy(context->encoder_object);
 			context->encoder_object = NULL;
 		}
@@ -1708,7 +1767,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_opus_load)
 		mss *= 2;
 	}
 
-
+	switch_core_codec_set_reset_func(codec_interface, switch_opus_reset);
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -38,7 +38,17 @@
 #include <math.h>
 #include <string.h>
 
-#define FRAME_QUEUE_LEN 3
+/* frames one half writes and the other half reads, the writer only moves head and the reader only moves tail */
+#define FRAME_RING_LEN 4
+#define BOWOUT_DELAY_MS 200
+
+#if defined(_MSC_VER)
+#define loopback_ring_barrier() MemoryBarrier()
+#elif defined(__GNUC__)
+#define loopback_ring_barrier() __sync_synchronize()
+#else
+#define loopback_ring_barrier()
+#endif
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_loopback_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_loopback_shutdown);
@@ -62,6 +72,25 @@ typedef enum {
 	TFLAG_CLEAR = (1 << 10)
 } TFLAGS;
 
+typedef struct {
+	switch_frame_t frame;
+	unsigned char data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+} loopback_slot_t;
+
+typedef struct {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	/* the writer found it full, the reader keeps only the newest frame */
+	volatile uint32_t overrun;
+	/* the reader is asleep on cond waiting for the writer */
+	volatile uint32_t waiting;
+	/* the slot the last read handed out, it goes back on the next read */
+	int held;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	loopback_slot_t slots[FRAME_RING_LEN];
+} loopback_ring_t;
+
 struct loopback_private_object {
 	unsigned int flags;
 	switch_mutex_t *flag_mutex;
@@ -77,7 +106,6 @@ struct loopback_private_object {
 	unsigned char databuf[SWITCH_RECOMMENDED_BUFFER_SIZE];
 
 	switch_frame_t *x_write_frame;
-	switch_frame_t *write_frame;
 	unsigned char write_databuf[SWITCH_RECOMMENDED_BUFFER_SIZE];
 
 	switch_frame_t cng_frame;
@@ -86,9 +114,10 @@ struct loopback_private_object {
 	switch_caller_profile_t *caller_profile;
 	int32_t bowout_frame_count;
 	char *other_uuid;
-	switch_queue_t *frame_queue;
+	loopback_ring_t *ring;
 	int64_t packet_count;
 	int first_cng;
+	int peer_paced;
 };
 
 typedef struct loopback_private_object loopback_private_t;
@@ -102,6 +131,8 @@ static struct {
 	int bowout_controlled_hangup;
 	int bowout_transfer_recordings;
 	int bowout_disable_on_inner_bridge;
+	int bowout_delay;
+	int pace_from_peer;
 } loopback_globals;
 
 static switch_status_t channel_on_init(switch_core_session_t *session);
@@ -119,15 +150,106 @@ static switch_status_t channel_write_frame(switch_core_session_t *session, switc
 static switch_status_t channel_kill_channel(switch_core_session_t *session, int sig);
 
 
+static void ring_release(loopback_ring_t *ring)
+{
+	if (ring->held) {
+		loopback_ring_barrier();
+		ring->tail++;
+		ring->held = 0;
+	}
+}
+
+/* reader side only */
 static void clear_queue(loopback_private_t *tech_pvt)
 {
-	void *pop;
+	ring_release(tech_pvt->ring);
+	tech_pvt->ring->tail = tech_pvt->ring->head;
+}
+
+/* the next frame the other half wrote, it stays ours until the next call */
+static loopback_slot_t *ring_pop(loopback_ring_t *ring)
+{
+	uint32_t head;
+
+	ring_release(ring);
+
+	head = ring->head;
+	loopback_ring_barrier();
+
+	if (ring->overrun) {
+		ring->overrun = 0;
+		if (head - ring->tail > 1) {
+			ring->tail = head - 1;
+		}
+	}
 
-	while (switch_queue_trypop(tech_pvt->frame_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		switch_frame_t *frame = (switch_frame_t *) pop;
-		switch_frame_free(&frame);
+	if (ring->tail == head) {
+		return NULL;
 	}
 
+	ring->held = 1;
+
+	return &ring->slots[ring->tail % FRAME_RING_LEN];
+}
+
+/* writer side only, the frame is copied into the slot once and read in place */
+static switch_status_t ring_push(loopback_ring_t *ring, switch_frame_t *frame)
+{
+	uint32_t head = ring->head;
+	loopback_slot_t *slot;
+
+	if (head - ring->tail >= FRAME_RING_LEN) {
+		ring->overrun = 1;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	loopback_ring_barrier();
+
+	slot = &ring->slots[head % FRAME_RING_LEN];
+	slot->frame = *frame;
+	slot->frame.data = slot->data;
+	slot->frame.buflen = sizeof(slot->data);
+	slot->frame.packet = NULL;
+	slot->frame.packetlen = 0;
+	slot->frame.img = NULL;
+	if (slot->frame.datalen > sizeof(slot->data)) {
+		slot->frame.datalen = sizeof(slot->data);
+	}
+	switch_clear_flag((&slot->frame), SFF_DYNAMIC);
+	memcpy(slot->data, frame->data, slot->frame.datalen);
+
+	loopback_ring_barrier();
+	ring->head = head + 1;
+
+	/* publish head before looking at waiting, ring_wait() does the opposite,
+	   so at least one of us sees the other's store and no wakeup is lost */
+	loopback_ring_barrier();
+
+	if (ring->waiting) {
+		switch_mutex_lock(ring->mutex);
+		switch_thread_cond_signal(ring->cond);
+		switch_mutex_unlock(ring->mutex);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* wait up to timeout for the writer to have something for us */
+static void ring_wait(loopback_ring_t *ring, switch_interval_time_t timeout)
+{
+	if (ring->head - ring->tail > (uint32_t) ring->held) {
+		return;
+	}
+
+	switch_mutex_lock(ring->mutex);
+	ring->waiting = 1;
+	/* pairs with the barrier between the head store and the waiting check in ring_push() */
+	loopback_ring_barrier();
+	if (ring->head - ring->tail <= (uint32_t) ring->held) {
+		switch_thread_cond_timedwait(ring->cond, ring->mutex, timeout);
+	}
+	ring->waiting = 0;
+	switch_mutex_unlock(ring->mutex);
 }
 
 static switch_status_t tech_init(loopback_private_t *tech_pvt, switch_core_session_t *session, switch_codec_t *codec)
@@ -198,8 +320,10 @@ static switch_status_t tech_init(loopback_private_t *tech_pvt, switch_core_sessi
 
 	tech_pvt->cng_frame.datalen = 2;
 
-	tech_pvt->bowout_frame_count = (tech_pvt->read_codec.implementation->actual_samples_per_second /
-									tech_pvt->read_codec.implementation->samples_per_packet) * 2;
+	tech_pvt->bowout_frame_count = (loopback_globals.bowout_delay * 1000) / tech_pvt->read_codec.implementation->microseconds_per_packet;
+	if (tech_pvt->bowout_frame_count < 1) {
+		tech_pvt->bowout_frame_count = 1;
+	}
 
 	switch_core_session_set_read_codec(session, &tech_pvt->read_codec);
 	switch_core_session_set_write_codec(session, &tech_pvt->write_codec);
@@ -218,7 +342,9 @@ static switch_status_t tech_init(loopback_private_t *tech_pvt, switch_core_sessi
 		switch_mutex_init(&tech_pvt->flag_mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
 		switch_mutex_init(&tech_pvt->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
 		switch_core_session_set_private(session, tech_pvt);
-		switch_queue_create(&tech_pvt->frame_queue, FRAME_QUEUE_LEN, switch_core_session_get_pool(session));
+		tech_pvt->ring = switch_core_session_alloc(session, sizeof(*tech_pvt->ring));
+		switch_mutex_init(&tech_pvt->ring->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
+		switch_thread_cond_create(&tech_pvt->ring->cond, switch_core_session_get_pool(session));
 		tech_pvt->session = session;
 		tech_pvt->channel = switch_core_session_get_channel(session);
 	}
@@ -543,11 +669,6 @@ static switch_status_t channel_on_destroy(switch_core_session_t *session)
 			switch_core_codec_destroy(&tech_pvt->write_codec);
 		}
 
-		if (tech_pvt->write_frame) {
-			switch_frame_free(&tech_pvt->write_frame);
-		}
-
-		clear_queue(tech_pvt);
 	}
 
 
@@ -703,7 +824,7 @@ static switch_status_t channel_read_frame(switch_core_session_t *session, switch
 	loopback_private_t *tech_pvt = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	switch_mutex_t *mutex = NULL;
-	void *pop = NULL;
+	loopback_slot_t *slot;
 
 	channel = switch_core_session_get_channel(session);
 	switch_assert(channel != NULL);
@@ -726,7 +847,18 @@ static switch_status_t channel_read_frame(switch_core_session_t *session, switch
 		}
 	}
 
-	switch_core_timer_next(&tech_pvt->timer);
+	/* when the other half is bridged its writes come at the far end's pace so we take ours from them,
+	   the timer is only needed when nothing else is clocking the frames */
+	if (loopback_globals.pace_from_peer && tech_pvt->other_tech_pvt && switch_test_flag(tech_pvt->other_tech_pvt, TFLAG_BRIDGE)) {
+		tech_pvt->peer_paced = 1;
+		ring_wait(tech_pvt->ring, tech_pvt->read_codec.implementation->microseconds_per_packet);
+	} else {
+		if (tech_pvt->peer_paced) {
+			tech_pvt->peer_paced = 0;
+			switch_core_timer_sync(&tech_pvt->timer);
+		}
+		switch_core_timer_next(&tech_pvt->timer);
+	}
 
 	mutex = tech_pvt->mutex;
 	switch_mutex_lock(mutex);
@@ -737,27 +869,21 @@ static switch_status_t channel_read_frame(switch_core_session_t *session, switch
 		switch_clear_flag(tech_pvt, TFLAG_CLEAR);
 	}
 
-	if (switch_queue_trypop(tech_pvt->frame_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		if (tech_pvt->write_frame) {
-			switch_frame_free(&tech_pvt->write_frame);
-		}
-
-		tech_pvt->write_frame = (switch_frame_t *) pop;
+	if ((slot = ring_pop(tech_pvt->ring))) {
+		switch_clear_flag((&slot->frame), SFF_RAW_RTP);
+		slot->frame.timestamp = 0;
 
-        switch_clear_flag(tech_pvt->write_frame, SFF_RAW_RTP);
-		tech_pvt->write_frame->timestamp = 0;
-
-		tech_pvt->write_frame->codec = &tech_pvt->read_codec;
-		*frame = tech_pvt->write_frame;
+		slot->frame.codec = &tech_pvt->read_codec;
+		*frame = &slot->frame;
 		tech_pvt->packet_count++;
-		switch_clear_flag(tech_pvt->write_frame, SFF_CNG);
+		switch_clear_flag((&slot->frame), SFF_CNG);
 		tech_pvt->first_cng = 0;
 	} else {
 		*frame = &tech_pvt->cng_frame;
 		tech_pvt->cng_frame.codec = &tech_pvt->read_codec;
 		tech_pvt->cng_frame.datalen = tech_pvt->read_codec.implementation->decoded_bytes_per_packet;
 		switch_set_flag((&tech_pvt->cng_frame), SFF_CNG);
-		if (!tech_pvt->first_cng) {
+		if (!tech_pvt->first_cng && !tech_pvt->peer_paced) {
 			switch_yield(tech_pvt->read_codec.implementation->samples_per_packet);
 			tech_pvt->first_cng = 1;
 		}
@@ -970,8 +1096,6 @@ static switch_status_t channel_write_frame(switch_core_session_t *session, switc
 	}
 
 	if (switch_test_flag(tech_pvt, TFLAG_LINKED) && tech_pvt->other_tech_pvt) {
-		switch_frame_t *clone;
-
 		if (frame->codec->implementation != tech_pvt->write_codec.implementation) {
 			/* change codecs to match */
 			tech_init(tech_pvt, session, frame->codec);
@@ -979,19 +1103,8 @@ static switch_status_t channel_write_frame(switch_core_session_t *session, switc
 		}
 
 
-		if (switch_frame_dup(frame, &clone) != SWITCH_STATUS_SUCCESS) {
-			abort();
-		}
-
-		if ((status = switch_queue_trypush(tech_pvt->other_tech_pvt->frame_queue, clone)) != SWITCH_STATUS_SUCCESS) {
-			clear_queue(tech_pvt->other_tech_pvt);
-			status = switch_queue_trypush(tech_pvt->other_tech_pvt->frame_queue, clone);
-		}
-
-		if (status == SWITCH_STATUS_SUCCESS) {
+		if (ring_push(tech_pvt->other_tech_pvt->ring, frame) == SWITCH_STATUS_SUCCESS) {
 			switch_set_flag_locked(tech_pvt->other_tech_pvt, TFLAG_WRITE);
-		} else {
-			switch_frame_free(&clone);
 		}
 
 		status = SWITCH_STATUS_SUCCESS;
@@ -1881,6 +1994,8 @@ switch_status_t load_loopback_configuration(switch_bool_t reload)
 	memset(&loopback_globals, 0, sizeof(loopback_globals));
 
 	loopback_globals.bowout_hangup_cause = SWITCH_CAUSE_NORMAL_UNSPECIFIED;
+	loopback_globals.bowout_delay = BOWOUT_DELAY_MS;
+	loopback_globals.pace_from_peer = 1;
 
 	if ((xml = switch_xml_open_cfg("loopback.conf", &cfg, NULL))) {
 		status = SWITCH_STATUS_SUCCESS;
@@ -1914,6 +2029,14 @@ switch_status_t load_loopback_configuration(switch_bool_t reload)
 					loopback_globals.bowout_transfer_recordings = switch_true(value);
 				} else if (!strcmp(name, "bowout-disable-on-inner-bridge")) {
 					loopback_globals.bowout_disable_on_inner_bridge = switch_true(value);
+				} else if (!strcmp(name, "bowout-delay")) {
+					int tmp = atoi(value);
+
+					if (tmp >= 0) {
+						loopback_globals.bowout_delay = tmp;
+					}
+				} else if (!strcmp(name, "pace-from-peer")) {
+					loopback_globals.pace_from_peer = switch_true(value);
 				}
 
 			}
@@ -6748,7 +6748,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 		return SWITCH_STATUS_GENERR;
 	}
 
-	sofia_msg_thread_start(0);
+	if (mod_sofia_globals.msg_queue_shards) {
+		/* the shard count has to stay put or dialogs would move between threads */
+		sofia_msg_thread_start(mod_sofia_globals.msg_queue_shards - 1);
+	} else {
+		sofia_msg_thread_start(0);
+	}
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Waiting for profiles to start\n");
 	switch_yield(1500000);
@@ -6960,8 +6965,10 @@ void mod_sofia_shutdown_cleanup(void) {
 	}
 
 	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
-		switch_queue_push(mod_sofia_globals.msg_queue, NULL);
-		switch_queue_interrupt_all(mod_sofia_globals.msg_queue);
+		switch_queue_t *q = mod_sofia_globals.msg_queue_shards ? mod_sofia_globals.msg_shard_queue[i] : mod_sofia_globals.msg_queue;
+
+		switch_queue_push(q, NULL);
+		switch_queue_interrupt_all(q);
 	}
 
 	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
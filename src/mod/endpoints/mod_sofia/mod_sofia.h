@@ -76,6 +76,9 @@ typedef struct sofia_profile sofia_profile_t;
 
 typedef struct sofia_private sofia_private_t;
 
+struct sofia_reg_wheel_s;
+typedef struct sofia_reg_wheel_s sofia_reg_wheel_t;
+
 struct private_object;
 typedef struct private_object private_object_t;
 #define NUA_HMAGIC_T sofia_private_t
@@ -311,6 +314,7 @@ typedef enum {
 	PFLAG_AUTH_REQUIRE_USER,
 	PFLAG_AUTH_CALLS_ACL_ONLY,
 	PFLAG_USE_PORT_FOR_ACL_CHECK,
+	PFLAG_REG_TIMER_WHEEL,
 
 	/* No new flags below this line */
 	PFLAG_MAX
@@ -391,6 +395,9 @@ struct mod_sofia_globals {
 	switch_queue_t *general_event_queue;
 	switch_thread_t *msg_queue_thread[SOFIA_MAX_MSG_QUEUE];
 	int msg_queue_len;
+	/* with message-thread-shards every thread has its own queue, picked by Call-ID */
+	switch_queue_t *msg_shard_queue[SOFIA_MAX_MSG_QUEUE];
+	int msg_queue_shards;
 	struct sofia_private destroy_private;
 	struct sofia_private keep_private;
 	int guess_mask;
@@ -792,6 +799,8 @@ struct sofia_profile {
 	int ireg_seconds;
 	int iping_seconds;
 	int iping_freq;
+	uint32_t ping_rate;
+	sofia_reg_wheel_t *reg_wheel;
 	sofia_paid_type_t paid_type;
 	uint32_t rtp_digit_delay;
 	switch_queue_t *event_queue;
@@ -1077,6 +1086,10 @@ void sofia_glue_execute_sql_now(sofia_profile_t *profile, char **sqlp, switch_bo
 void sofia_glue_execute_sql_soon(sofia_profile_t *profile, char **sqlp, switch_bool_t sql_already_dynamic);
 void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot);
 void sofia_reg_check_ping_expire(sofia_profile_t *profile, time_t now, int interval);
+void sofia_reg_wheel_create(sofia_profile_t *profile);
+void sofia_reg_wheel_destroy(sofia_profile_t *profile);
+void sofia_reg_wheel_schedule(sofia_profile_t *profile, const char *call_id, time_t expires, time_t ping);
+void sofia_reg_wheel_run(sofia_profile_t *profile, time_t now);
 void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now);
 void sofia_sub_check_gateway(sofia_profile_t *profile, time_t now);
 void sofia_reg_unregister(sofia_profile_t *profile);
@@ -2320,6 +2320,11 @@ void sofia_msg_thread_start(int idx)
 		for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
 			if (!mod_sofia_globals.msg_queue_thread[i]) {
 				switch_threadattr_t *thd_attr = NULL;
+				switch_queue_t *q = mod_sofia_globals.msg_queue;
+
+				if (mod_sofia_globals.msg_queue_shards) {
+					q = mod_sofia_globals.msg_shard_queue[i];
+				}
 
 				switch_threadattr_create(&thd_attr, mod_sofia_globals.pool);
 				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
@@ -2327,7 +2332,7 @@ void sofia_msg_thread_start(int idx)
 				switch_thread_create(&mod_sofia_globals.msg_queue_thread[i],
 									 thd_attr,
 									 sofia_msg_thread_run,
-									 mod_sofia_globals.msg_queue,
+									 q,
 									 mod_sofia_globals.pool);
 			}
 		}
@@ -2336,6 +2341,77 @@ void sofia_msg_thread_start(int idx)
 	switch_mutex_unlock(mod_sofia_globals.mutex);
 }
 
+/* events of one dialog always land on the same thread and stay in order, so events
+   without a message (timeouts, state changes) are hashed on the Call-ID of their handle too */
+static int sofia_msg_shard(sofia_dispatch_event_t *de)
+{
+	sofia_private_t *sofia_private = de->nh ? nua_handle_magic(de->nh) : NULL;
+	switch_core_session_t *session = NULL;
+	const char *call_id = NULL;
+	unsigned int hash;
+
+	if (de->sip && de->sip->sip_call_id && de->sip->sip_call_id->i_id) {
+		call_id = de->sip->sip_call_id->i_id;
+	} else if (sofia_private && sofia_private != &mod_sofia_globals.destroy_private &&
+			   sofia_private != &mod_sofia_globals.keep_private) {
+		if (sofia_private->call_id) {
+			call_id = sofia_private->call_id;
+		} else if (!zstr(sofia_private->uuid) && (session = switch_core_session_locate(sofia_private->uuid))) {
+			private_object_t *tech_pvt = switch_core_session_get_private(session);
+
+			if (tech_pvt) {
+				call_id = tech_pvt->call_id;
+			}
+		}
+	}
+
+	if (call_id) {
+		switch_ssize_t klen = -1;
+
+		hash = switch_hashfunc_default(call_id, &klen);
+	} else {
+		hash = (unsigned int) ((uintptr_t) de->nh >> 4);
+	}
+
+	if (session) {
+		switch_core_session_rwunlock(session);
+	}
+
+	return (int) (hash % mod_sofia_globals.msg_queue_shards);
+}
+
+/* an event only ever goes to its own shard, a full shard holds up the stack thread
+   the same as the single queue does rather than let a dialog's events pass each other */
+static void sofia_msg_shard_push(sofia_dispatch_event_t *de)
+{
+	int shard = sofia_msg_shard(de);
+
+	if (switch_queue_trypush(mod_sofia_globals.msg_shard_queue[shard], de) == SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG queue %d is full, waiting for room\n", shard);
+	switch_queue_push(mod_sofia_globals.msg_shard_queue[shard], de);
+}
+
+static unsigned int sofia_msg_queue_size(void)
+{
+	unsigned int size = 0;
+	int i;
+
+	if (!mod_sofia_globals.msg_queue_shards) {
+		return switch_queue_size(mod_sofia_globals.msg_queue);
+	}
+
+	for (i = 0; i < mod_sofia_globals.msg_queue_shards; i++) {
+		if (mod_sofia_globals.msg_shard_queue[i]) {
+			size += switch_queue_size(mod_sofia_globals.msg_shard_queue[i]);
+		}
+	}
+
+	return size;
+}
+
 //static int foo = 0;
 void sofia_queue_message(sofia_dispatch_event_t *de)
 {
@@ -2355,6 +2431,11 @@ void sofia_queue_message(sofia_dispatch_event_t *de)
 	}
 
 
+	if (mod_sofia_globals.msg_queue_shards) {
+		sofia_msg_shard_push(de);
+		return;
+	}
+
 	if ((switch_queue_size(mod_sofia_globals.msg_queue) > (SOFIA_MSG_QUEUE_SIZE * (unsigned int)msg_queue_threads))) {
 		launch++;
 	}
@@ -2458,7 +2539,7 @@ void sofia_event_callback(nua_event_t event,
 				goto end;
 			}
 
-			if (switch_queue_size(mod_sofia_globals.msg_queue) > (unsigned int)critical) {
+			if (sofia_msg_queue_size() > (unsigned int)critical) {
 				nua_respond(nh, 503, "System Busy", SIPTAG_RETRY_AFTER_STR("300"), NUTAG_WITH_THIS(nua), TAG_END());
 				nua_handle_destroy(nh);
 				goto end;
@@ -2851,6 +2932,7 @@ void event_handler(switch_event_t *event)
 
 		if (sql) {
 			sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+			sofia_reg_wheel_schedule(profile, call_id, expires, 0);
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Propagating registration for %s@%s->%s\n", from_user, from_host, contact_str);
 		}
 
@@ -2943,6 +3025,10 @@ void *SWITCH_THREAD_FUNC sofia_profile_worker_thread_run(switch_thread_t *thread
 
 	sofia_set_pflag_locked(profile, PFLAG_WORKER_RUNNING);
 
+	if (sofia_test_pflag(profile, PFLAG_REG_TIMER_WHEEL)) {
+		sofia_reg_wheel_create(profile);
+	}
+
 	/* Seed PRNG for functions within worker thread */
 	srand((unsigned)((intptr_t) switch_thread_self() + switch_micro_time_now()));
 
@@ -2988,7 +3074,9 @@ void *SWITCH_THREAD_FUNC sofia_profile_worker_thread_run(switch_thread_t *thread
 					ireg_loops = 0;
 				}
 
-				if(++iping_loops >= (uint32_t)profile->iping_freq) {
+				if (profile->reg_wheel) {
+					sofia_reg_wheel_run(profile, switch_epoch_time_now(NULL));
+				} else if (++iping_loops >= (uint32_t)profile->iping_freq) {
 					time_t now = switch_epoch_time_now(NULL);
 					sofia_reg_check_ping_expire(profile, now, profile->iping_seconds);
 					iping_loops = 0;
@@ -3026,6 +3114,8 @@ void *SWITCH_THREAD_FUNC sofia_profile_worker_thread_run(switch_thread_t *thread
 
 	}
 
+	sofia_reg_wheel_destroy(profile);
+
 	sofia_clear_pflag_locked(profile, PFLAG_WORKER_RUNNING);
 
 	return NULL;
@@ -4521,6 +4611,30 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 					mod_sofia_globals.max_reg_threads = x;
 				}
 
+			} else if (!strcasecmp(var, "message-thread-shards") && val) {
+				int x = !strcasecmp(val, "auto") ? mod_sofia_globals.max_msg_queues : atoi(val);
+
+				if (mod_sofia_globals.msg_queue_len) {
+					if (x != mod_sofia_globals.msg_queue_shards) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "message-thread-shards only changes on module load\n");
+					}
+				} else if (x > 1) {
+					int i;
+
+					if (x > SOFIA_MAX_MSG_QUEUE) {
+						x = SOFIA_MAX_MSG_QUEUE;
+					}
+
+					/* profiles may queue events before the threads are up */
+					for (i = 0; i < x; i++) {
+						if (!mod_sofia_globals.msg_shard_queue[i]) {
+							switch_queue_create(&mod_sofia_globals.msg_shard_queue[i], SOFIA_MSG_QUEUE_SIZE, mod_sofia_globals.pool);
+						}
+					}
+					mod_sofia_globals.msg_queue_shards = mod_sofia_globals.max_msg_queues = x;
+				} else {
+					mod_sofia_globals.msg_queue_shards = 0;
+				}
 			} else if (!strcasecmp(var, "auto-restart")) {
 				mod_sofia_globals.auto_restart = switch_true(val);
 			} else if (!strcasecmp(var, "reg-deny-binding-fetch-and-no-lookup")) {          /* backwards compatibility */
@@ -4823,6 +4937,16 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 						if (profile->iping_freq < 0) {
 							profile->iping_freq = IPING_FREQUENCY;
 						}
+					} else if (!strcasecmp(var, "registration-timer-wheel")) {
+						if (switch_true(val)) {
+							sofia_set_pflag(profile, PFLAG_REG_TIMER_WHEEL);
+						} else {
+							sofia_clear_pflag(profile, PFLAG_REG_TIMER_WHEEL);
+						}
+					} else if (!strcasecmp(var, "ping-rate-limit") && !zstr(val)) {
+						int x = atoi(val);
+
+						profile->ping_rate = x > 0 ? (uint32_t) x : 0;
 					} else if (!strcasecmp(var, "user-agent-string")) {
 						profile->user_agent = switch_core_strdup(profile->pool, val);
 					} else if (!strcasecmp(var, "auto-restart")) {
@@ -6551,6 +6675,7 @@ static void sofia_handle_sip_r_options(switch_core_session_t *session, int statu
 											 (long) now, ping_time, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
 						sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
 						switch_safe_free(sql);
+						sofia_reg_wheel_schedule(profile, call_id, now, 0);
 					}
 				}
 			}
@@ -807,6 +807,11 @@ void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot)
 {
 	char *sql;
 
+	/* with the timer wheel registrations expire one by one in sofia_reg_wheel_run */
+	if (now && profile->reg_wheel) {
+		goto others;
+	}
+
 	if (now) {
 		sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
 						",user_agent,server_user,server_host,profile_name,network_ip, network_port"
@@ -827,6 +832,8 @@ void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot)
 	}
 	sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
 
+ others:
+
 
 
 
@@ -890,55 +897,42 @@ long sofia_reg_uniform_distribution(int max)
 	return (long) result;
 }
 
+/* the registrations this profile keeps pinging, as a where clause */
+static char *sofia_reg_ping_filter(sofia_profile_t *profile)
+{
+	if (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING)) {
+		return switch_mprintf("hostname='%q' and profile_name='%q' and orig_hostname='%q'",
+							  mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname);
+	} else if (sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING)) {
+		return switch_mprintf("(status like '%%UDP-NAT%%' or force_ping=1) and hostname='%q' and profile_name='%q'",
+							  mod_sofia_globals.hostname, profile->name);
+	} else if (sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING)) {
+		return switch_mprintf("(status like '%%NAT%%' or contact like '%%fs_nat=yes%%' or force_ping=1) and hostname='%q' "
+							  "and profile_name='%q' and orig_hostname='%q'",
+							  mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname);
+	}
+
+	return switch_mprintf("force_ping=1 and hostname='%q' and profile_name='%q' and orig_hostname='%q'",
+						  mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname);
+}
+
 void sofia_reg_check_ping_expire(sofia_profile_t *profile, time_t now, int interval)
 {
-	char *sql;
+	char *sql, *filter;
 	long next;
 	char buf[32] = "";
 	int count;
 
 	if (now) {
-		if (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING)) {
-			sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
-								 "expires,user_agent,server_user,server_host,profile_name "
-								 "from sip_registrations where hostname='%q' and "
-								 "profile_name='%q' and orig_hostname='%q' and "
-								 "ping_expires > 0 and ping_expires <= %ld",
-								 mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname, (long) now);
-
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		} else if (sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING)) {
-			sql = switch_mprintf(" select call_id,sip_user,sip_host,contact,status,rpid, "
-								 " expires,user_agent,server_user,server_host,profile_name "
-								 " from sip_registrations where (status like '%%UDP-NAT%%' or force_ping=1)"
-								 " and hostname='%q' and profile_name='%q' and ping_expires > 0 and ping_expires <= %ld ",
-								 mod_sofia_globals.hostname, profile->name, (long) now);
-
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		} else if (sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING)) {
-			sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
-								 "expires,user_agent,server_user,server_host,profile_name "
-								 "from sip_registrations where (status like '%%NAT%%' "
-								 "or contact like '%%fs_nat=yes%%' or force_ping=1) and hostname='%q' "
-								 "and profile_name='%q' and orig_hostname='%q' and "
-								 "ping_expires > 0 and ping_expires <= %ld",
-								 mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname, (long) now);
-
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		} else {
-			sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
-								 "expires,user_agent,server_user,server_host,profile_name "
-								 "from sip_registrations where force_ping=1 and hostname='%q' "
-								 "and profile_name='%q' and orig_hostname='%q' and "
-								 "ping_expires > 0 and ping_expires <= %ld",
-								 mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname, (long) now);
-
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		}
+		filter = sofia_reg_ping_filter(profile);
+		sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
+							 "expires,user_agent,server_user,server_host,profile_name "
+							 "from sip_registrations where %s and ping_expires > 0 and ping_expires <= %ld",
+							 filter, (long) now);
+
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
+		switch_safe_free(sql);
+		switch_safe_free(filter);
 
 		sql = switch_mprintf("select count(*) from sip_registrations where hostname='%q' and profile_name='%q' and ping_expires <= %ld",
 							 mod_sofia_globals.hostname, profile->name, (long) now);
@@ -959,6 +953,409 @@ void sofia_reg_check_ping_expire(sofia_profile_t *profile, time_t now, int inter
 	}
 }
 
+/*
+ * Registration timer wheel.
+ *
+ * One timer per registration call-id holds its expiry and its next ping and
+ * sits in the slot of whichever comes first. Every second the worker thread
+ * takes the due timers of the slots that passed and deals with just those
+ * registrations, by call-id, instead of scanning sip_registrations. Timers
+ * further out than one turn of the wheel stay in their slot until their turn.
+ */
+
+#define SOFIA_REG_WHEEL_SLOTS 4096
+#define SOFIA_REG_WHEEL_BATCH 64
+
+typedef struct sofia_reg_timer_s {
+	char *call_id;
+	time_t expires;
+	time_t ping;
+	int slot;
+	int parked;
+	int fire;
+	struct sofia_reg_timer_s *next;
+} sofia_reg_timer_t;
+
+#define SOFIA_REG_FIRE_EXPIRE 1
+#define SOFIA_REG_FIRE_PING 2
+
+struct sofia_reg_wheel_s {
+	switch_mutex_t *mutex;
+	switch_hash_t *timers;
+	sofia_reg_timer_t *slots[SOFIA_REG_WHEEL_SLOTS];
+	time_t last;
+	uint32_t count;
+	int running;
+	int seeded;
+};
+
+static time_t sofia_reg_timer_when(sofia_reg_timer_t *timer)
+{
+	if (timer->expires && timer->ping) {
+		return timer->expires < timer->ping ? timer->expires : timer->ping;
+	}
+
+	return timer->expires ? timer->expires : timer->ping;
+}
+
+/* call with the wheel locked */
+static void sofia_reg_wheel_place(sofia_reg_wheel_t *wheel, sofia_reg_timer_t *timer)
+{
+	time_t when = sofia_reg_timer_when(timer);
+
+	if (when <= wheel->last) {
+		when = wheel->last + 1;
+	}
+
+	timer->slot = (int) (when % SOFIA_REG_WHEEL_SLOTS);
+	timer->next = wheel->slots[timer->slot];
+	wheel->slots[timer->slot] = timer;
+}
+
+/* call with the wheel locked */
+static void sofia_reg_wheel_unlink(sofia_reg_wheel_t *wheel, sofia_reg_timer_t *timer)
+{
+	sofia_reg_timer_t **tp;
+
+	if (timer->slot < 0) {
+		return;
+	}
+
+	for (tp = &wheel->slots[timer->slot]; *tp; tp = &(*tp)->next) {
+		if (*tp == timer) {
+			*tp = timer->next;
+			break;
+		}
+	}
+
+	timer->slot = -1;
+	timer->next = NULL;
+}
+
+/* call with the wheel locked */
+static void sofia_reg_timer_free(sofia_reg_wheel_t *wheel, sofia_reg_timer_t *timer)
+{
+	switch_core_hash_delete(wheel->timers, timer->call_id);
+	wheel->count--;
+	switch_safe_free(timer->call_id);
+	free(timer);
+}
+
+void sofia_reg_wheel_create(sofia_profile_t *profile)
+{
+	sofia_reg_wheel_t *wheel = profile->reg_wheel;
+
+	if (!wheel) {
+		wheel = switch_core_alloc(profile->pool, sizeof(*wheel));
+		switch_mutex_init(&wheel->mutex, SWITCH_MUTEX_NESTED, profile->pool);
+	}
+
+	switch_mutex_lock(wheel->mutex);
+	switch_core_hash_init(&wheel->timers);
+	memset(wheel->slots, 0, sizeof(wheel->slots));
+	wheel->last = switch_epoch_time_now(NULL);
+	wheel->count = 0;
+	wheel->seeded = 0;
+	wheel->running = 1;
+	switch_mutex_unlock(wheel->mutex);
+
+	profile->reg_wheel = wheel;
+}
+
+void sofia_reg_wheel_destroy(sofia_profile_t *profile)
+{
+	sofia_reg_wheel_t *wheel = profile->reg_wheel;
+	int i;
+
+	if (!wheel) {
+		return;
+	}
+
+	/* the wheel itself lives in the profile pool, registrations arriving late find it stopped */
+	switch_mutex_lock(wheel->mutex);
+	wheel->running = 0;
+
+	for (i = 0; i < SOFIA_REG_WHEEL_SLOTS; i++) {
+		sofia_reg_timer_t *timer, *next;
+
+		for (timer = wheel->slots[i]; timer; timer = next) {
+			next = timer->next;
+			switch_safe_free(timer->call_id);
+			free(timer);
+		}
+		wheel->slots[i] = NULL;
+	}
+
+	switch_core_hash_destroy(&wheel->timers);
+	wheel->count = 0;
+	switch_mutex_unlock(wheel->mutex);
+}
+
+void sofia_reg_wheel_schedule(sofia_profile_t *profile, const char *call_id, time_t expires, time_t ping)
+{
+	sofia_reg_wheel_t *wheel = profile->reg_wheel;
+	sofia_reg_timer_t *timer;
+
+	if (!wheel || zstr(call_id)) {
+		return;
+	}
+
+	switch_mutex_lock(wheel->mutex);
+
+	if (!wheel->running) {
+		goto end;
+	}
+
+	if ((timer = switch_core_hash_find(wheel->timers, call_id))) {
+		if (timer->parked) {
+			/* sofia_reg_wheel_run is busy with it and puts it back */
+			timer->expires = expires > 0 ? expires : 0;
+			timer->ping = ping > 0 ? ping : 0;
+			goto end;
+		}
+		sofia_reg_wheel_unlink(wheel, timer);
+	} else if (expires > 0 || ping > 0) {
+		switch_zmalloc(timer, sizeof(*timer));
+		timer->call_id = strdup(call_id);
+		timer->slot = -1;
+		switch_core_hash_insert(wheel->timers, call_id, timer);
+		wheel->count++;
+	} else {
+		goto end;
+	}
+
+	timer->expires = expires > 0 ? expires : 0;
+	timer->ping = ping > 0 ? ping : 0;
+
+	if (!timer->expires && !timer->ping) {
+		sofia_reg_timer_free(wheel, timer);
+	} else {
+		sofia_reg_wheel_place(wheel, timer);
+	}
+
+ end:
+	switch_mutex_unlock(wheel->mutex);
+}
+
+static int sofia_reg_wheel_unschedule_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	sofia_profile_t *profile = (sofia_profile_t *) pArg;
+
+	sofia_reg_wheel_schedule(profile, argv[0], 0, 0);
+
+	return 0;
+}
+
+static int sofia_reg_wheel_seed_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	sofia_profile_t *profile = (sofia_profile_t *) pArg;
+	time_t now = switch_epoch_time_now(NULL);
+	time_t ping = argv[2] ? (time_t) atol(argv[2]) : 0;
+
+	/* stale ping times would all fire at once, spread them over the interval again */
+	if (ping > 0 && ping <= now) {
+		ping = now + 1 + sofia_reg_uniform_distribution(profile->iping_seconds);
+	}
+
+	sofia_reg_wheel_schedule(profile, argv[0], argv[1] ? (time_t) atol(argv[1]) : 0, ping);
+
+	return 0;
+}
+
+static void sofia_reg_wheel_expire_batch(sofia_profile_t *profile, const char *ids, time_t now)
+{
+	char *sql;
+
+	sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
+						 ",user_agent,server_user,server_host,profile_name,network_ip, network_port"
+						 ",0,sip_realm from sip_registrations where expires > 0 and expires <= %ld and hostname='%q' and call_id in (%s)",
+						 (long) now, mod_sofia_globals.hostname, ids);
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_del_callback, profile);
+	switch_safe_free(sql);
+
+	sql = switch_mprintf("delete from sip_registrations where expires > 0 and expires <= %ld and hostname='%q' and call_id in (%s)",
+						 (long) now, mod_sofia_globals.hostname, ids);
+	sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+}
+
+static void sofia_reg_wheel_ping_batch(sofia_profile_t *profile, const char *ids, const char *filter)
+{
+	char *sql;
+
+	sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
+						 "expires,user_agent,server_user,server_host,profile_name "
+						 "from sip_registrations where %s and call_id in (%s)", filter, ids);
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
+	switch_safe_free(sql);
+}
+
+/* runs the statement for every SOFIA_REG_WHEEL_BATCH due timers of one kind */
+static void sofia_reg_wheel_flush(sofia_profile_t *profile, sofia_reg_timer_t *due, int fire, time_t now, const char *filter)
+{
+	switch_stream_handle_t ids = { 0 };
+	sofia_reg_timer_t *timer;
+	int n = 0;
+
+	SWITCH_STANDARD_STREAM(ids);
+
+	for (timer = due; timer; timer = timer->next) {
+		char *q;
+
+		if (timer->fire != fire) {
+			continue;
+		}
+
+		q = switch_mprintf("%s'%q'", n ? "," : "", timer->call_id);
+		ids.write_function(&ids, "%s", q);
+		switch_safe_free(q);
+
+		if (++n == SOFIA_REG_WHEEL_BATCH) {
+			if (fire == SOFIA_REG_FIRE_EXPIRE) {
+				sofia_reg_wheel_expire_batch(profile, (char *) ids.data, now);
+			} else {
+				sofia_reg_wheel_ping_batch(profile, (char *) ids.data, filter);
+			}
+			n = 0;
+			ids.end = ids.data;
+			*(char *) ids.data = '\0';
+			ids.data_len = 0;
+		}
+	}
+
+	if (n) {
+		if (fire == SOFIA_REG_FIRE_EXPIRE) {
+			sofia_reg_wheel_expire_batch(profile, (char *) ids.data, now);
+		} else {
+			sofia_reg_wheel_ping_batch(profile, (char *) ids.data, filter);
+		}
+	}
+
+	switch_safe_free(ids.data);
+}
+
+void sofia_reg_wheel_run(sofia_profile_t *profile, time_t now)
+{
+	sofia_reg_wheel_t *wheel = profile->reg_wheel;
+	sofia_reg_timer_t *due = NULL, *timer, *next;
+	int expires = 0, pings = 0, deferred = 0;
+	int turns = 0;
+	time_t sec;
+
+	if (!wheel || !wheel->running) {
+		return;
+	}
+
+	if (!wheel->seeded) {
+		char *sql = switch_mprintf("select call_id,expires,ping_expires from sip_registrations where hostname='%q' and profile_name='%q'",
+								   mod_sofia_globals.hostname, profile->name);
+
+		wheel->seeded = 1;
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_wheel_seed_callback, profile);
+		switch_safe_free(sql);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Profile %s registration timer wheel holds %u registrations\n",
+						  profile->name, wheel->count);
+	}
+
+	/* take out what is due, the timers stay parked until the sql is done */
+	switch_mutex_lock(wheel->mutex);
+
+	for (sec = wheel->last + 1; sec <= now && turns < SOFIA_REG_WHEEL_SLOTS; sec++, turns++) {
+		sofia_reg_timer_t **tp = &wheel->slots[sec % SOFIA_REG_WHEEL_SLOTS];
+
+		while ((timer = *tp)) {
+			if (sofia_reg_timer_when(timer) > now) {
+				tp = &timer->next;
+				continue;
+			}
+
+			*tp = timer->next;
+			timer->slot = -1;
+			timer->fire = 0;
+
+			if (timer->expires && timer->expires <= now) {
+				timer->fire = SOFIA_REG_FIRE_EXPIRE;
+				expires++;
+			} else if (profile->ping_rate && (uint32_t) pings >= profile->ping_rate) {
+				/* over the per second limit, it waits for the next round */
+				timer->ping = now + 1;
+				deferred++;
+				sofia_reg_wheel_place(wheel, timer);
+				continue;
+			} else {
+				timer->fire = SOFIA_REG_FIRE_PING;
+				pings++;
+			}
+
+			timer->parked = 1;
+			timer->next = due;
+			due = timer;
+		}
+	}
+
+	if (now > wheel->last) {
+		wheel->last = now;
+	}
+
+	switch_mutex_unlock(wheel->mutex);
+
+	if (!due) {
+		return;
+	}
+
+	if (expires) {
+		sofia_reg_wheel_flush(profile, due, SOFIA_REG_FIRE_EXPIRE, now, NULL);
+	}
+
+	if (pings) {
+		char *filter = sofia_reg_ping_filter(profile);
+
+		sofia_reg_wheel_flush(profile, due, SOFIA_REG_FIRE_PING, now, filter);
+		switch_safe_free(filter);
+	}
+
+	if (deferred || profile->debug) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Profile %s expired %d, pinged %d and deferred %d registrations\n",
+						  profile->name, expires, pings, deferred);
+	}
+
+	/* put back what is still registered, refreshes that came in meanwhile already updated the times */
+	switch_mutex_lock(wheel->mutex);
+
+	for (timer = due; timer; timer = next) {
+		next = timer->next;
+		timer->parked = 0;
+		timer->next = NULL;
+
+		if (!wheel->running) {
+			switch_safe_free(timer->call_id);
+			free(timer);
+			continue;
+		}
+
+		if (timer->expires && timer->expires <= now) {
+			sofia_reg_timer_free(wheel, timer);
+			continue;
+		}
+
+		if (timer->fire == SOFIA_REG_FIRE_PING && timer->ping && timer->ping <= now) {
+			/* keep the spread the registrations got when they came in */
+			timer->ping += profile->iping_seconds > 0 ? profile->iping_seconds : IPING_SECONDS;
+			if (timer->ping <= now) {
+				timer->ping = now + 1 + sofia_reg_uniform_distribution(profile->iping_seconds);
+			}
+		}
+
+		if (!timer->expires && !timer->ping) {
+			sofia_reg_timer_free(wheel, timer);
+		} else {
+			sofia_reg_wheel_place(wheel, timer);
+		}
+	}
+
+	switch_mutex_unlock(wheel->mutex);
+}
+
 
 int sofia_reg_check_callback(void *pArg, int argc, char **argv, char **columnNames)
 {
@@ -1346,6 +1743,7 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 	int send_pres = 0;
 	int send_message_query = 0;
 	int force_ping = 0;
+	long ping_expires = 0;
 	int is_tls = 0, is_tcp = 0, is_ws = 0, is_wss = 0;
 	char expbuf[35] = "";
 	time_t reg_time = switch_epoch_time_now(NULL);
@@ -2005,6 +2403,8 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		}
 
 
+		ping_expires = (long) switch_epoch_time_now(NULL) + sofia_reg_uniform_distribution(profile->iping_seconds);
+
 		if (!update_registration) {
 			sql = switch_mprintf("insert into sip_registrations "
 					"(call_id,sip_user,sip_host,presence_hosts,contact,status,rpid,expires,"
@@ -2015,8 +2415,17 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 					contact_str, reg_desc, rpid, (long) reg_time + (long) exptime + profile->sip_expires_late_margin,
 					agent, from_user, guess_ip4, profile->name, mod_sofia_globals.hostname, network_ip, network_port_c, username, realm,
 								 mwi_user, mwi_host, guess_ip4, mod_sofia_globals.hostname, sub_host, "Reachable", 0,
-								 (long) switch_epoch_time_now(NULL) + sofia_reg_uniform_distribution(profile->iping_seconds), force_ping);
+								 ping_expires, force_ping);
 		} else {
+			if (profile->reg_wheel) {
+				/* the update moves the row to this Call-ID, the timer of the old one has to go */
+				sql = switch_mprintf("select call_id from sip_registrations where call_id <> '%q' and "
+									 "sip_user='%q' and sip_username='%q' and sip_host='%q' and contact='%q'",
+									 call_id, to_user, username, reg_host, contact_str);
+				sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_wheel_unschedule_callback, profile);
+				switch_safe_free(sql);
+			}
+
 			sql = switch_mprintf("update sip_registrations set call_id='%q',"
 								 "sub_host='%q', network_ip='%q',network_port='%q',"
 								 "presence_hosts='%q', server_host='%q', orig_server_host='%q',"
@@ -2027,7 +2436,7 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 								 profile->presence_hosts ? profile->presence_hosts : "", guess_ip4, guess_ip4,
                                                                  mod_sofia_globals.hostname, mod_sofia_globals.hostname,
 								 (long) reg_time + (long) exptime + profile->sip_expires_late_margin,
-								 (long) switch_epoch_time_now(NULL) + sofia_reg_uniform_distribution(profile->iping_seconds),
+								 ping_expires,
 								 force_ping, to_user, username, reg_host, contact_str);
 		}
 
@@ -2035,6 +2444,8 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
 		}
 
+		sofia_reg_wheel_schedule(profile, call_id, reg_time + exptime + profile->sip_expires_late_margin, ping_expires);
+
 		if (!update_registration && sofia_reg_reg_count(profile, to_user, reg_host) == 1) {
 			sql = switch_mprintf("delete from sip_presence where sip_user='%q' and sip_host='%q' and profile_name='%q' and open_closed='closed'",
 								 to_user, reg_host, profile->name);
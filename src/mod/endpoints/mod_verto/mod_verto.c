@@ -58,6 +58,11 @@ SWITCH_MODULE_DEFINITION(mod_verto, mod_verto_load, mod_verto_shutdown, mod_vert
 #endif
 #include <ctype.h>
 #include <sys/stat.h>
+#ifdef VERTO_REACTOR
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#endif
 
 #ifdef WIN32
 #define strerror_r(errno, buf, len) strerror_s(buf, len, errno)
@@ -70,6 +75,30 @@ SWITCH_MODULE_DEFINITION(mod_verto, mod_verto_load, mod_verto_shutdown, mod_vert
 
 static struct globals_s verto_globals;
 
+/* an event serialized once and shared by every subscriber it fans out to */
+typedef struct verto_event_text_s {
+	switch_atomic_t refs;
+	switch_size_t len;
+	char data[];
+} verto_event_text_t;
+
+/* an entry of jsock->event_queue, either a json message or a reference to shared event text */
+typedef struct jsock_event_s {
+	cJSON *json;
+	verto_event_text_t *text;
+	uint32_t id;
+	uint32_t serno;
+} jsock_event_t;
+
+#ifdef VERTO_REACTOR
+static switch_ssize_t verto_reactor_write(jsock_t *jsock, kws_opcode_t oc, const void *data, switch_size_t bytes);
+static switch_ssize_t verto_reactor_write_parts(jsock_t *jsock, const void *head, switch_size_t hlen,
+												verto_event_text_t *text, const void *tail, switch_size_t tlen);
+static void verto_reactor_schedule(jsock_t *jsock);
+static switch_status_t verto_reactor_attach(jsock_t *jsock);
+static switch_bool_t verto_reactor_enabled(void);
+#endif
+
 
 static struct {
 	switch_mutex_t *store_mutex;
@@ -636,6 +665,17 @@ static void jrpc_add_result(cJSON *obj, cJSON *result)
 	}
 }
 
+static switch_ssize_t jsock_write_frame(jsock_t *jsock, kws_opcode_t oc, const void *data, switch_size_t bytes)
+{
+#ifdef VERTO_REACTOR
+	if (jsock->reactor) {
+		return verto_reactor_write(jsock, oc, data, bytes);
+	}
+#endif
+
+	return kws_write_frame(jsock->ws, oc, data, bytes);
+}
+
 static switch_ssize_t ws_write_json(jsock_t *jsock, cJSON **json, switch_bool_t destroy)
 {
 	char *json_text;
@@ -663,7 +703,7 @@ static switch_ssize_t ws_write_json(jsock_t *jsock, cJSON **json, switch_bool_t
 			//free(log_text);
 		}
 		switch_mutex_lock(jsock->write_mutex);
-		r = kws_write_frame(jsock->ws, WSOC_TEXT, json_text, strlen(json_text));
+		r = jsock_write_frame(jsock, WSOC_TEXT, json_text, strlen(json_text));
 		switch_mutex_unlock(jsock->write_mutex);
 		switch_safe_free(json_text);
 	}
@@ -682,18 +722,73 @@ static switch_ssize_t ws_write_json(jsock_t *jsock, cJSON **json, switch_bool_t
 	return r;
 }
 
-static switch_status_t jsock_queue_event(jsock_t *jsock, cJSON **json, switch_bool_t destroy)
+static verto_event_text_t *verto_event_text_create(const char *event_text, const char *event_channel)
 {
-	switch_status_t status = SWITCH_STATUS_FALSE;
-	cJSON *jp;
+	verto_event_text_t *text;
+	cJSON *item = cJSON_CreateString(event_channel);
+	char *channel = cJSON_PrintUnformatted(item);
+	const char *sub = ",\"subscribedChannel\":";
+	switch_size_t elen = strlen(event_text), len;
+	char *p;
 
-	if (destroy) {
-		jp = *json;
-	} else {
-		jp = cJSON_Duplicate(*json, 1);
+	cJSON_Delete(item);
+
+	if (!channel || elen < 2 || event_text[0] != '{') {
+		switch_safe_free(channel);
+		return NULL;
+	}
+
+	/* everything after "params":{"eventSerno":N, the per subscriber head is spliced in front */
+	len = strlen(sub) + strlen(channel) + (elen > 2 ? elen - 1 : 0) + 1;
+
+	switch_malloc(text, sizeof(*text) + len + 1);
+	switch_atomic_set(&text->refs, 1);
+	text->len = len;
+
+	p = text->data;
+	p += sprintf(p, "%s%s", sub, channel);
+	if (elen > 2) {
+		*p++ = ',';
+		memcpy(p, event_text + 1, elen - 2);
+		p += elen - 2;
+	}
+	*p++ = '}';
+	*p = '\0';
+
+	free(channel);
+
+	return text;
+}
+
+static void verto_event_text_release(verto_event_text_t **textP)
+{
+	verto_event_text_t *text = *textP;
+
+	*textP = NULL;
+
+	if (text && !switch_atomic_dec(&text->refs)) {
+		free(text);
 	}
+}
+
+static void jsock_event_destroy(jsock_event_t **evP)
+{
+	jsock_event_t *ev = *evP;
+
+	*evP = NULL;
+
+	if (ev->json) {
+		cJSON_Delete(ev->json);
+	}
+	verto_event_text_release(&ev->text);
+	free(ev);
+}
+
+static switch_status_t jsock_push_event(jsock_t *jsock, jsock_event_t *ev)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
 
-	if (switch_queue_trypush(jsock->event_queue, jp) == SWITCH_STATUS_SUCCESS) {
+	if (switch_queue_trypush(jsock->event_queue, ev) == SWITCH_STATUS_SUCCESS) {
 		status = SWITCH_STATUS_SUCCESS;
 
 		if (jsock->lost_events) {
@@ -701,35 +796,116 @@ static switch_status_t jsock_queue_event(jsock_t *jsock, cJSON **json, switch_bo
 			jsock->lost_events = 0;
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Lost %d json events!\n", le);
 		}
+
+#ifdef VERTO_REACTOR
+		if (jsock->reactor) {
+			verto_reactor_schedule(jsock);
+		}
+#endif
 	} else {
 		if (++jsock->lost_events > MAX_MISSED) {
 			jsock->drop++;
 		}
-
-		if (!destroy) {
-			cJSON_Delete(jp);
-			jp = NULL;
-		}
 	}
 
+	return status;
+}
+
+static switch_status_t jsock_queue_event(jsock_t *jsock, cJSON **json, switch_bool_t destroy)
+{
+	switch_status_t status;
+	jsock_event_t *ev;
+
+	switch_zmalloc(ev, sizeof(*ev));
+
 	if (destroy) {
+		ev->json = *json;
 		*json = NULL;
+	} else {
+		ev->json = cJSON_Duplicate(*json, 1);
+	}
+
+	if ((status = jsock_push_event(jsock, ev)) != SWITCH_STATUS_SUCCESS) {
+		jsock_event_destroy(&ev);
+	}
+
+	return status;
+}
+
+static switch_status_t jsock_queue_event_text(jsock_t *jsock, verto_event_text_t *text, uint32_t serno)
+{
+	switch_status_t status;
+	jsock_event_t *ev;
+
+	switch_zmalloc(ev, sizeof(*ev));
+	switch_atomic_inc(&text->refs);
+	ev->text = text;
+	ev->serno = serno;
+	ev->id = next_id();
+
+	if ((status = jsock_push_event(jsock, ev)) != SWITCH_STATUS_SUCCESS) {
+		jsock_event_destroy(&ev);
 	}
 
 	return status;
 }
 
+/* splice the per subscriber id and eventSerno in front of the shared text instead of reserializing */
+static switch_ssize_t jsock_write_event_text(jsock_t *jsock, jsock_event_t *ev)
+{
+	char head[128];
+	switch_size_t hlen;
+	switch_ssize_t r;
+
+	hlen = switch_snprintf(head, sizeof(head), "{\"jsonrpc\":\"2.0\",\"id\":%u,\"method\":\"verto.event\",\"params\":{\"eventSerno\":%u",
+						   ev->id, ev->serno);
+
+	if (jsock->profile->debug || verto_globals.debug) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, verto_globals.debug_level, "WRITE %s [%s%s}]\n", jsock->name, head, ev->text->data);
+	}
+
+	switch_mutex_lock(jsock->write_mutex);
+#ifdef VERTO_REACTOR
+	if (jsock->reactor) {
+		r = verto_reactor_write_parts(jsock, head, hlen, ev->text, "}", 1);
+		goto end;
+	}
+#endif
+	{
+		switch_size_t len = hlen + ev->text->len + 1;
+		char *buf;
+
+		switch_malloc(buf, len);
+		memcpy(buf, head, hlen);
+		memcpy(buf + hlen, ev->text->data, ev->text->len);
+		buf[len - 1] = '}';
+		r = kws_write_frame(jsock->ws, WSOC_TEXT, buf, len);
+		free(buf);
+	}
+#ifdef VERTO_REACTOR
+ end:
+#endif
+	switch_mutex_unlock(jsock->write_mutex);
+
+	if (r <= 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ALERT, "WRITE RETURNED ERROR %" SWITCH_SIZE_T_FMT " \n", r);
+		jsock->drop = 1;
+		jsock->ready = 0;
+	}
+
+	return r;
+}
+
 static switch_bool_t event_channel_check_auth(jsock_t *jsock, const char *event_channel);
-static void write_event(const char *event_channel, const char *super_channel, jsock_t *use_jsock, cJSON *event)
+static void write_event(const char *event_channel, const char *super_channel, jsock_t *use_jsock, cJSON *event, char **event_text)
 {
 	jsock_sub_node_head_t *head;
+	verto_event_text_t *text = NULL;
 
 	if ((head = switch_core_hash_find(verto_globals.event_channel_hash, event_channel))) {
 		jsock_sub_node_t *np;
 
 		for(np = head->node; np; np = np->next) {
-			cJSON *msg = NULL, *params;
-			
 			if (!use_jsock || use_jsock == np->jsock) {
 				const char *visibility;
 				//char *tmp;
@@ -757,19 +933,23 @@ static void write_event(const char *event_channel, const char *super_channel, js
 						}
 					}
 				}
-				//tmp = cJSON_Print(event);
-				//printf("%s\n", tmp);
-				//free(tmp);
-				
-				params = cJSON_Duplicate(event, 1);
-				cJSON_AddItemToObject(params, "eventSerno", cJSON_CreateNumber(np->serno++));
-				cJSON_AddItemToObject(params, "subscribedChannel", cJSON_CreateString(head->event_channel));
-				msg = jrpc_new_req("verto.event", NULL, &params);
+				if (!text) {
+					if (!*event_text && !(*event_text = cJSON_PrintUnformatted(event))) {
+						break;
+					}
+
+					if (!(text = verto_event_text_create(*event_text, head->event_channel))) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot serialize event for %s\n", head->event_channel);
+						break;
+					}
+				}
 
-				jsock_queue_event(np->jsock, &msg, SWITCH_TRUE);
+				jsock_queue_event_text(np->jsock, text, np->serno++);
 			}
 		}
 	}
+
+	verto_event_text_release(&text);
 }
 
 static void jsock_send_event(cJSON *event)
@@ -778,6 +958,7 @@ static void jsock_send_event(cJSON *event)
 	const char *event_channel, *session_uuid = NULL, *direct_id = NULL;
 	jsock_t *use_jsock = NULL;
 	switch_core_session_t *session = NULL;
+	char *event_text = NULL;
 
 	if (!(event_channel = cJSON_GetObjectCstr(event, "eventChannel"))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "NO EVENT CHANNEL SPECIFIED\n");
@@ -815,18 +996,20 @@ static void jsock_send_event(cJSON *event)
 	}
 
 	switch_thread_rwlock_rdlock(verto_globals.event_channel_rwlock);
-	write_event(event_channel, NULL, use_jsock, event);
+	write_event(event_channel, NULL, use_jsock, event, &event_text);
 	if (strchr(event_channel, '.')) {
 		char *main_channel = strdup(event_channel);
 		char *p;
 		switch_assert(main_channel);
 		p = strchr(main_channel, '.');
 		if (p) *p = '\0';
-		write_event(main_channel, event_channel, use_jsock, event);
+		write_event(main_channel, event_channel, use_jsock, event, &event_text);
 		free(main_channel);
 	}
 	switch_thread_rwlock_unlock(verto_globals.event_channel_rwlock);
 
+	switch_safe_free(event_text);
+
 }
 
 static jrpc_func_t jrpc_get_func(jsock_t *jsock, const char *method)
@@ -1666,8 +1849,15 @@ static void jsock_check_event_queue(jsock_t *jsock)
 
 	switch_mutex_lock(jsock->write_mutex);
 	while(this_pass-- > 0 && switch_queue_trypop(jsock->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-		cJSON *json = (cJSON *) pop;
-		ws_write_json(jsock, &json, SWITCH_TRUE);
+		jsock_event_t *ev = (jsock_event_t *) pop;
+
+		if (ev->json) {
+			ws_write_json(jsock, &ev->json, SWITCH_TRUE);
+		} else {
+			jsock_write_event_text(jsock, ev);
+		}
+
+		jsock_event_destroy(&ev);
 	}
 	switch_mutex_unlock(jsock->write_mutex);
 }
@@ -2044,258 +2234,1337 @@ err:
 		"Content-Length: 0\r\n\r\n";
 	kws_raw_write(jsock->ws, err, strlen(err));
 
-error:
-	return;
+error:
+	return;
+}
+
+static switch_status_t client_run(jsock_t *jsock)
+{
+	int flags = KWS_BLOCK;
+	int idle = 0;
+	ks_json_t *params = NULL;
+	
+	if (jsock->profile->vhosts) {
+		flags |= KWS_STAY_OPEN;
+		flags |= KWS_HTTP;
+	}
+
+	ks_pool_open(&jsock->kpool);
+
+	switch_thread_rwlock_rdlock(jsock->profile->rwlock);
+#if defined(KS_VERSION_NUM) && KS_VERSION_NUM >= 20000
+	params = ks_json_create_object();
+	ks_json_add_number_to_object(params, "payload_size_max", 1000000);
+	if (kws_init_ex(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, flags, jsock->kpool, params) != KS_STATUS_SUCCESS) {
+#else
+	if (kws_init(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, flags, jsock->kpool) != KS_STATUS_SUCCESS) {
+#endif
+		switch_thread_rwlock_unlock(jsock->profile->rwlock);
+		log_and_exit(SWITCH_LOG_NOTICE, "%s WS SETUP FAILED\n", jsock->name);
+	}
+	switch_thread_rwlock_unlock(jsock->profile->rwlock);
+
+	if (kws_test_flag(jsock->ws, KWS_HTTP)) {
+		http_run(jsock);
+		kws_close(jsock->ws, WS_NONE);
+		goto end;
+	}
+
+#ifdef VERTO_REACTOR
+	if (jsock->rmode) {
+		ks_json_delete(&params);
+
+		if (verto_reactor_attach(jsock) == SWITCH_STATUS_SUCCESS) {
+			/* the reactor owns the connection from here on, jsock may already be gone */
+			return SWITCH_STATUS_BREAK;
+		}
+
+		die("%s Reactor attach failed\n", jsock->name);
+	}
+#endif
+
+	while(jsock->profile->running) {
+		int pflags, poll_time = 50;
+		time_t now;
+
+		if (!jsock->ws) { die("%s Setup Error\n", jsock->name); }
+		
+		pflags = kws_wait_sock(jsock->ws, poll_time, KS_POLL_READ);
+
+		if (jsock->exptime) {
+			now = switch_epoch_time_now(NULL);
+
+			if (now >= jsock->exptime) {
+				switch_set_flag(jsock, JPFLAG_AUTH_EXPIRED);
+				die("%s Authentication Expired [%"TIME_T_FMT"] >= [%"TIME_T_FMT"]\n", jsock->uid, now, jsock->exptime);
+			}
+
+		}
+
+		if (jsock->drop) { die("%s Dropping Connection\n", jsock->name); }
+		if (pflags < 0 && (errno != EINTR)) { die_errnof("%s POLL FAILED with %d", jsock->name, pflags); }
+		if (pflags == 0) {/* socket poll timeout */ jsock_check_event_queue(jsock); idle += poll_time;} else {idle = 0;}
+
+		if (idle >= 30000) {
+			cJSON *params = NULL;
+			cJSON *msg = jrpc_new_req("verto.ping", 0, &params);
+
+			if (jsock->exptime) {
+				cJSON_AddItemToObject(params, "auth-expires", cJSON_CreateNumber(jsock->exptime));
+			}
+			
+			cJSON_AddItemToObject(params, "serno", cJSON_CreateNumber(switch_epoch_time_now(NULL)));
+			jsock_queue_event(jsock, &msg, SWITCH_TRUE);
+			idle = 0;
+		}
+		
+		if ((!switch_test_flag(jsock, JPFLAG_CHECK_ATTACH) || (jsock->attach_timer > 0 && jsock->attach_timer-- == 0)) &&
+			switch_test_flag(jsock, JPFLAG_AUTHED)) {
+			attach_calls(jsock);
+			switch_set_flag(jsock, JPFLAG_CHECK_ATTACH);
+		}
+
+		if (pflags > 0 && (pflags & KS_POLL_HUP)) { log_and_exit(SWITCH_LOG_INFO, "%s POLL HANGUP DETECTED (peer closed its end of socket)\n", jsock->name); }
+		if (pflags > 0 && (pflags & KS_POLL_ERROR)) { die("%s POLL ERROR\n", jsock->name); }
+		if (pflags > 0 && (pflags & KS_POLL_INVALID)) { die("%s POLL INVALID SOCKET (not opened or already closed)\n", jsock->name); }
+		if (pflags > 0 && (pflags & KS_POLL_READ)) {
+			switch_ssize_t bytes;
+			kws_opcode_t oc;
+			uint8_t *data;
+
+			bytes = kws_read_frame(jsock->ws, &oc, &data);
+
+			if (bytes < 0) {
+				if (bytes == -1000) {
+					log_and_exit(SWITCH_LOG_INFO, "%s Client sent close request\n", jsock->name);
+				} else {
+					die("%s BAD READ %" SWITCH_SSIZE_T_FMT "\n", jsock->name, bytes);
+				}
+			}
+
+			if (bytes) {
+				char *s = (char *) data;
+
+				if (*s == '#') {
+					char repl[2048] = "";
+					switch_time_t a, b;
+
+					if (!switch_test_flag(jsock, JPFLAG_AUTHED)) {
+						die("%s Speed-test request before authentication\n", jsock->name);
+					}
+
+					if (bytes < 4) {
+						continue;
+					}
+
+					if (s[1] == 'S' && s[2] == 'P') {
+
+						if (s[3] == 'U') {
+							int i;
+							long size;
+							char *p = s+4;
+							int loops = 0;
+							int rem = 0;
+							int dur = 0, j = 0;
+
+							size = strtol(p, NULL, 10);
+							if (size <= 0 || size > VERTO_SPEED_TEST_MAX_SIZE) {
+								continue;
+							}
+
+							a = switch_time_now();
+							do {
+								bytes = kws_read_frame(jsock->ws, &oc, &data);
+								s = (char *) data;
+							} while (bytes >= 4 && data && s[0] == '#' && s[3] == 'B');
+							b = switch_time_now();
+
+							if (!bytes || !data) continue;
+
+							if (s[0] != '#') goto nm;
+
+							switch_snprintf(repl, sizeof(repl), "#SPU %ld", (long)((b - a) / 1000));
+							kws_write_frame(jsock->ws, WSOC_TEXT, repl, strlen(repl));
+							loops = size / 1024;
+							rem = size % 1024;
+							switch_snprintf(repl, sizeof(repl), "#SPB ");
+							memset(repl+4, '.', 1024);
+
+							for (j = 0; j < 10 ; j++) {
+								int ddur = 0;
+								a = switch_time_now();
+								for (i = 0; i < loops; i++) {
+									kws_write_frame(jsock->ws, WSOC_TEXT, repl, 1024);
+								}
+								if (rem) {
+									kws_write_frame(jsock->ws, WSOC_TEXT, repl, rem);
+								}
+								b = switch_time_now();
+								ddur += (int)((b - a) / 1000);
+								dur += ddur;
+
+							}
+
+							dur /= j+1;
+
+							switch_snprintf(repl, sizeof(repl), "#SPD %d", dur);
+							kws_write_frame(jsock->ws, WSOC_TEXT, repl, strlen(repl));
+						}
+					}
+
+					continue;
+				}
+
+			nm:
+
+				if (process_input(jsock, data, bytes) != SWITCH_STATUS_SUCCESS) {
+					die("%s Input Error\n", jsock->name);
+				}
+			}
+		}
+	}
+
+ error:
+ end:
+	detach_jsock(jsock);
+	kws_destroy(&jsock->ws);
+	ks_pool_close(&jsock->kpool);
+	ks_json_delete(&params);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void jsock_flush(jsock_t *jsock)
+{
+	void *pop;
+
+	switch_mutex_lock(jsock->write_mutex);
+	while(switch_queue_trypop(jsock->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		jsock_event_t *ev = (jsock_event_t *) pop;
+		jsock_event_destroy(&ev);
+	}
+	switch_mutex_unlock(jsock->write_mutex);
+}
+
+static void client_cleanup(jsock_t *jsock)
+{
+	switch_event_t *s_event;
+
+	detach_calls(jsock);
+
+	del_jsock(jsock);
+
+	switch_event_destroy(&jsock->params);
+	switch_event_destroy(&jsock->vars);
+	switch_event_destroy(&jsock->user_vars);
+
+	if (jsock->client_socket != KS_SOCK_INVALID) {
+		close_socket(&jsock->client_socket);
+	}
+
+	switch_event_destroy(&jsock->allowed_methods);
+	switch_event_destroy(&jsock->allowed_fsapi);
+	switch_event_destroy(&jsock->allowed_jsapi);
+	switch_event_destroy(&jsock->allowed_event_channels);
+
+	jsock_flush(jsock);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Ending client thread.\n", jsock->name);
+	if (switch_event_create_subclass(&s_event, SWITCH_EVENT_CUSTOM, MY_EVENT_CLIENT_DISCONNECT) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_profile_name", jsock->profile->name);
+		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_client_address", jsock->name);
+		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_login", switch_str_nil(jsock->uid));
+		switch_event_fire(&s_event);
+	}
+	switch_thread_rwlock_wrlock(jsock->rwlock);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Thread ended\n", jsock->name);
+	switch_thread_rwlock_unlock(jsock->rwlock);
+}
+
+static void *SWITCH_THREAD_FUNC client_thread(switch_thread_t *thread, void *obj)
+{
+	jsock_t *jsock = (jsock_t *) obj;
+
+	switch_event_create(&jsock->params, SWITCH_EVENT_CHANNEL_DATA);
+	switch_event_create(&jsock->vars, SWITCH_EVENT_CHANNEL_DATA);
+	switch_event_create(&jsock->user_vars, SWITCH_EVENT_CHANNEL_DATA);
+
+
+	add_jsock(jsock);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Starting client thread.\n", jsock->name);
+
+	if ((jsock->ptype & PTYPE_CLIENT) || (jsock->ptype & PTYPE_CLIENT_SSL)) {
+		if (client_run(jsock) == SWITCH_STATUS_BREAK) {
+			return NULL;
+		}
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s Ending client thread.\n", jsock->name);
+	}
+
+	client_cleanup(jsock);
+
+	if (jsock->rmode) {
+		/* reactor mode connections own their pool, see start_jsock() */
+		switch_memory_pool_t *pool = jsock->pool;
+		switch_core_destroy_memory_pool(&pool);
+	}
+
+	return NULL;
+}
+
+#ifdef VERTO_REACTOR
+/*
+ * Reactor mode: instead of a thread parked in kws_wait_sock() per client, a few epoll
+ * threads own every established websocket.  They read whatever the socket has, cut
+ * complete messages out of the stream and hand them to a small worker pool that runs
+ * them through process_input() in order.  Outbound frames are queued on the jsock and
+ * flushed with writev() (or packed into TLS records) once per worker pass.
+ * The handshake and plain HTTP requests still run on the thread that accepted them.
+ */
+
+#define VERTO_REACTOR_READ_SIZE 65536
+#define VERTO_REACTOR_EVENTS 256
+#define VERTO_REACTOR_INBOX_LEN 1024
+#define VERTO_REACTOR_BATCH 64
+#define VERTO_REACTOR_SWEEP_MS 100
+#define VERTO_REACTOR_PING_MS 30000
+#define VERTO_REACTOR_IOV_MAX 64
+#define VERTO_REACTOR_TLS_RECORD 16384
+#define VERTO_REACTOR_WQ_MAX (16 * 1024 * 1024)
+#define VERTO_WS_PAYLOAD_MAX 1000000
+
+/* a queued frame is buf[0, hlen) + shared text + buf[hlen, hlen + tlen) */
+typedef struct verto_wmsg_s {
+	struct verto_wmsg_s *next;
+	switch_size_t len;
+	switch_size_t off;
+	verto_event_text_t *shared;
+	switch_size_t hlen;
+	switch_size_t tlen;
+	uint8_t buf[];
+} verto_wmsg_t;
+
+typedef struct verto_reactor_s {
+	int efd;
+	int wfd;
+	uint32_t count;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	jsock_t *pending;
+	jsock_t *head;
+	uint8_t scratch[VERTO_REACTOR_READ_SIZE];
+} verto_reactor_t;
+
+static struct {
+	verto_reactor_t *reactors;
+	int reactor_count;
+	switch_thread_t **workers;
+	int worker_count;
+	switch_queue_t *work;
+	volatile int running;
+} verto_reactor;
+
+/* set while a worker runs a jsock so its replies are batched into one flush */
+static __thread jsock_t *verto_servicing = NULL;
+
+static switch_bool_t verto_reactor_enabled(void)
+{
+	return verto_reactor.running ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void verto_reactor_wake(verto_reactor_t *r)
+{
+	uint64_t one = 1;
+
+	if (write(r->wfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Reactor wakeup failed: %s\n", strerror(errno));
+	}
+}
+
+static void verto_reactor_schedule(jsock_t *jsock)
+{
+	switch_mutex_lock(jsock->reactor_mutex);
+	if (jsock->rscheduled) {
+		jsock->rpending = 1;
+	} else {
+		jsock->rscheduled = 1;
+		switch_queue_push(verto_reactor.work, jsock);
+	}
+	switch_mutex_unlock(jsock->reactor_mutex);
+}
+
+/* call with write_mutex held */
+static void verto_reactor_arm(jsock_t *jsock, uint8_t out)
+{
+	struct epoll_event ev = { 0 };
+
+	if (jsock->warmed == out) {
+		return;
+	}
+
+	jsock->warmed = out;
+
+	if (!jsock->rregistered || jsock->client_socket == KS_SOCK_INVALID) {
+		return;
+	}
+
+	ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+	ev.data.ptr = jsock;
+	epoll_ctl(jsock->reactor->efd, EPOLL_CTL_MOD, jsock->client_socket, &ev);
+}
+
+/* the unwritten parts of a frame, returns the number of iovecs used */
+static int verto_wmsg_iov(verto_wmsg_t *m, struct iovec *iov, int max)
+{
+	struct iovec seg[3];
+	switch_size_t skip = m->off;
+	int i, n = 0;
+
+	seg[0].iov_base = m->buf;
+	seg[0].iov_len = m->hlen;
+	seg[1].iov_base = m->shared ? m->shared->data : NULL;
+	seg[1].iov_len = m->shared ? m->shared->len : 0;
+	seg[2].iov_base = m->buf + m->hlen;
+	seg[2].iov_len = m->tlen;
+
+	for (i = 0; i < 3 && n < max; i++) {
+		if (skip >= seg[i].iov_len) {
+			skip -= seg[i].iov_len;
+			continue;
+		}
+
+		iov[n].iov_base = (uint8_t *) seg[i].iov_base + skip;
+		iov[n].iov_len = seg[i].iov_len - skip;
+		skip = 0;
+		n++;
+	}
+
+	return n;
+}
+
+/* call with write_mutex held */
+static void verto_reactor_consume(jsock_t *jsock, switch_size_t bytes)
+{
+	verto_wmsg_t *m;
+
+	while (bytes && (m = jsock->wq_head)) {
+		switch_size_t left = m->len - m->off;
+
+		if (bytes < left) {
+			m->off += bytes;
+			break;
+		}
+
+		bytes -= left;
+		jsock->wq_bytes -= m->len;
+		if (!(jsock->wq_head = m->next)) {
+			jsock->wq_tail = NULL;
+		}
+		verto_event_text_release(&m->shared);
+		free(m);
+	}
+}
+
+/* call with write_mutex held, returns 0 when drained, 1 when the socket is full and -1 on error */
+static int verto_reactor_flush(jsock_t *jsock)
+{
+	verto_wmsg_t *m;
+
+	if (jsock->rclosed || !jsock->ws || jsock->client_socket == KS_SOCK_INVALID) {
+		return jsock->wq_head ? -1 : 0;
+	}
+
+	if ((jsock->ptype & PTYPE_CLIENT_SSL)) {
+		/* no writev() through SSL, pack small frames into full records instead and
+		   retry a blocked write with the very same buffer as SSL_write() requires */
+		for (;;) {
+			struct iovec iov[3];
+			const uint8_t *ptr;
+			switch_size_t len;
+			switch_ssize_t r;
+			int direct = 0, i, n;
+
+			if (!jsock->wrec_len) {
+				if (!(m = jsock->wq_head)) {
+					break;
+				}
+
+				if (m->len - m->off > VERTO_REACTOR_TLS_RECORD) {
+					direct = 1;
+				} else {
+					if (!jsock->wrec) {
+						switch_malloc(jsock->wrec, VERTO_REACTOR_TLS_RECORD);
+					}
+
+					while ((m = jsock->wq_head) && jsock->wrec_len + m->len - m->off <= VERTO_REACTOR_TLS_RECORD) {
+						switch_size_t left = m->len - m->off;
+
+						n = verto_wmsg_iov(m, iov, 3);
+						for (i = 0; i < n; i++) {
+							memcpy(jsock->wrec + jsock->wrec_len, iov[i].iov_base, iov[i].iov_len);
+							jsock->wrec_len += iov[i].iov_len;
+						}
+						verto_reactor_consume(jsock, left);
+					}
+				}
+			}
+
+			if (direct) {
+				/* one part at a time, each stays put until fully written */
+				verto_wmsg_iov(jsock->wq_head, iov, 1);
+				ptr = iov[0].iov_base;
+				len = iov[0].iov_len;
+			} else {
+				ptr = jsock->wrec;
+				len = jsock->wrec_len;
+			}
+
+			r = kws_raw_write(jsock->ws, (void *) ptr, len);
+
+			if (r == -2) {
+				return 1;
+			}
+
+			if (r <= 0) {
+				return -1;
+			}
+
+			if (direct) {
+				verto_reactor_consume(jsock, r);
+			} else if ((switch_size_t) r < jsock->wrec_len) {
+				memmove(jsock->wrec, jsock->wrec + r, jsock->wrec_len - r);
+				jsock->wrec_len -= r;
+			} else {
+				jsock->wrec_len = 0;
+			}
+		}
+
+		switch_safe_free(jsock->wrec);
+		return 0;
+	}
+
+	while (jsock->wq_head) {
+		struct iovec iov[VERTO_REACTOR_IOV_MAX];
+		int n = 0;
+		ssize_t r;
+
+		for (m = jsock->wq_head; m && n < VERTO_REACTOR_IOV_MAX; m = m->next) {
+			n += verto_wmsg_iov(m, iov + n, VERTO_REACTOR_IOV_MAX - n);
+		}
+
+		if ((r = writev(jsock->client_socket, iov, n)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 1;
+			}
+
+			return -1;
+		}
+
+		verto_reactor_consume(jsock, r);
+	}
+
+	return 0;
+}
+
+/* call with write_mutex held */
+static int verto_reactor_flush_arm(jsock_t *jsock)
+{
+	int r = verto_reactor_flush(jsock);
+
+	if (r >= 0) {
+		verto_reactor_arm(jsock, (uint8_t) r);
+	}
+
+	return r;
+}
+
+static switch_ssize_t verto_reactor_frame(jsock_t *jsock, kws_opcode_t oc, const void *head, switch_size_t hlen,
+										  verto_event_text_t *text, const void *tail, switch_size_t tlen)
+{
+	verto_wmsg_t *m;
+	uint8_t *p;
+	switch_size_t bytes = hlen + (text ? text->len : 0) + tlen;
+	switch_size_t flen = bytes < 126 ? 2 : bytes <= 0xffff ? 4 : 10;
+	switch_ssize_t r = -1;
+	int i;
+
+	switch_mutex_lock(jsock->write_mutex);
+
+	if (jsock->rclosed) {
+		goto end;
+	}
+
+	if (jsock->wq_bytes + bytes > VERTO_REACTOR_WQ_MAX) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Outbound queue full (%" SWITCH_SIZE_T_FMT " bytes)\n", jsock->name, jsock->wq_bytes);
+		goto end;
+	}
+
+	switch_malloc(m, sizeof(*m) + flen + hlen + tlen);
+	m->next = NULL;
+	m->off = 0;
+	m->len = flen + bytes;
+	m->hlen = flen + hlen;
+	m->tlen = tlen;
+	m->shared = NULL;
+
+	if (text) {
+		switch_atomic_inc(&text->refs);
+		m->shared = text;
+	}
+
+	/* server frames are never masked */
+	p = m->buf;
+	p[0] = 0x80 | (oc & 0x0f);
+	if (flen == 2) {
+		p[1] = (uint8_t) bytes;
+	} else if (flen == 4) {
+		p[1] = 126;
+		p[2] = (uint8_t) (bytes >> 8);
+		p[3] = (uint8_t) bytes;
+	} else {
+		p[1] = 127;
+		for (i = 0; i < 8; i++) {
+			p[2 + i] = (uint8_t) ((uint64_t) bytes >> (56 - 8 * i));
+		}
+	}
+	if (hlen) {
+		memcpy(p + flen, head, hlen);
+	}
+	if (tlen) {
+		memcpy(p + flen + hlen, tail, tlen);
+	}
+
+	if (jsock->wq_tail) {
+		jsock->wq_tail->next = m;
+	} else {
+		jsock->wq_head = m;
+	}
+	jsock->wq_tail = m;
+	jsock->wq_bytes += m->len;
+
+	if (verto_servicing == jsock || verto_reactor_flush_arm(jsock) >= 0) {
+		r = (switch_ssize_t) m->len;
+	}
+
+ end:
+	switch_mutex_unlock(jsock->write_mutex);
+
+	return r;
+}
+
+static switch_ssize_t verto_reactor_write(jsock_t *jsock, kws_opcode_t oc, const void *data, switch_size_t bytes)
+{
+	return verto_reactor_frame(jsock, oc, data, bytes, NULL, NULL, 0);
+}
+
+/* the shared text is referenced by the queued frame, never copied */
+static switch_ssize_t verto_reactor_write_parts(jsock_t *jsock, const void *head, switch_size_t hlen,
+												verto_event_text_t *text, const void *tail, switch_size_t tlen)
+{
+	return verto_reactor_frame(jsock, WSOC_TEXT, head, hlen, text, tail, tlen);
+}
+
+/* hand one complete message to the worker pool, called from the reactor thread */
+static int verto_reactor_deliver(jsock_t *jsock, const uint8_t *data, switch_size_t len)
+{
+	char *s;
+
+	/* the upload half of the speed test is timed here so the filler never reaches the workers */
+	if (jsock->speed_start) {
+		if (len >= 4 && data[0] == '#' && data[3] == 'B') {
+			return 0;
+		}
+
+		if (len && data[0] == '#') {
+			s = switch_mprintf("#SP! %ld %ld", jsock->speed_size, (long) ((switch_micro_time_now() - jsock->speed_start) / 1000));
+			jsock->speed_start = 0;
+			goto push;
+		}
+
+		jsock->speed_start = 0;
+	} else if (len > 4 && !memcmp(data, "#SPU", 4)) {
+		char num[32] = "";
+		long size;
+
+		switch_copy_string(num, (const char *) data + 4, len - 4 < sizeof(num) ? len - 4 + 1 : sizeof(num));
+		size = strtol(num, NULL, 10);
+
+		if (size > 0 && size <= VERTO_SPEED_TEST_MAX_SIZE) {
+			jsock->speed_size = size;
+			jsock->speed_start = switch_micro_time_now();
+		}
+	}
+
+	switch_malloc(s, len + 1);
+	memcpy(s, data, len);
+	s[len] = '\0';
+
+ push:
+
+	if (switch_queue_trypush(jsock->inbox, s) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Inbound queue full, dropping connection\n", jsock->name);
+		free(s);
+		return -1;
+	}
+
+	verto_reactor_schedule(jsock);
+
+	return 0;
+}
+
+/* parse as many complete frames as the buffer holds, returns the bytes consumed or -1 to close */
+static switch_ssize_t verto_reactor_parse(jsock_t *jsock, uint8_t *data, switch_size_t len)
+{
+	switch_size_t used = 0;
+
+	while (len - used >= 2) {
+		uint8_t *p = data + used, *payload;
+		switch_size_t avail = len - used, hlen = 2;
+		uint64_t plen = p[1] & 0x7f;
+		int fin = p[0] & 0x80, oc = p[0] & 0x0f, masked = p[1] & 0x80;
+		int i;
+
+		if (plen == 126) {
+			if (avail < (hlen += 2)) break;
+			plen = ((uint64_t) p[2] << 8) | p[3];
+		} else if (plen == 127) {
+			if (avail < (hlen += 8)) break;
+			for (plen = 0, i = 0; i < 8; i++) {
+				plen = (plen << 8) | p[2 + i];
+			}
+		}
+
+		if (masked) {
+			hlen += 4;
+		}
+
+		if (plen > VERTO_WS_PAYLOAD_MAX || jsock->msg_len + plen > VERTO_WS_PAYLOAD_MAX) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Frame too large (%" SWITCH_SIZE_T_FMT " bytes)\n", jsock->name, (switch_size_t) plen);
+			return -1;
+		}
+
+		if (avail < hlen + plen) {
+			break;
+		}
+
+		payload = p + hlen;
+
+		if (masked) {
+			uint8_t *mask = payload - 4;
+
+			for (i = 0; (uint64_t) i < plen; i++) {
+				payload[i] ^= mask[i & 3];
+			}
+		}
+
+		switch (oc) {
+		case WSOC_CONTINUATION:
+			if (!jsock->msg) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Unexpected continuation frame\n", jsock->name);
+				return -1;
+			}
+			/* fall through */
+		case WSOC_TEXT:
+		case WSOC_BINARY:
+			if (oc != WSOC_CONTINUATION && jsock->msg) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Interleaved data frame\n", jsock->name);
+				return -1;
+			}
+
+			if (fin && !jsock->msg) {
+				if (verto_reactor_deliver(jsock, payload, (switch_size_t) plen) < 0) {
+					return -1;
+				}
+				break;
+			}
+
+			jsock->msg = realloc(jsock->msg, jsock->msg_len + (switch_size_t) plen + 1);
+			switch_assert(jsock->msg);
+			memcpy(jsock->msg + jsock->msg_len, payload, (switch_size_t) plen);
+			jsock->msg_len += (switch_size_t) plen;
+
+			if (fin) {
+				int r = verto_reactor_deliver(jsock, jsock->msg, jsock->msg_len);
+
+				switch_safe_free(jsock->msg);
+				jsock->msg_len = 0;
+
+				if (r < 0) {
+					return -1;
+				}
+			}
+			break;
+		case WSOC_CLOSE:
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s Client sent close request\n", jsock->name);
+			return -1;
+		case WSOC_PING:
+			verto_reactor_write(jsock, WSOC_PONG, payload, (switch_size_t) plen);
+			break;
+		case WSOC_PONG:
+			break;
+		default:
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Unknown opcode %d\n", jsock->name, oc);
+			return -1;
+		}
+
+		used += hlen + (switch_size_t) plen;
+	}
+
+	return (switch_ssize_t) used;
+}
+
+/* only a partial frame survives a read, idle connections hold no buffer at all */
+static int verto_reactor_feed(jsock_t *jsock, uint8_t *data, switch_size_t len)
+{
+	switch_ssize_t used;
+
+	if (jsock->rlen) {
+		if (jsock->rlen + len > jsock->rsize) {
+			while (jsock->rsize < jsock->rlen + len) {
+				jsock->rsize *= 2;
+			}
+			jsock->rbuf = realloc(jsock->rbuf, jsock->rsize);
+			switch_assert(jsock->rbuf);
+		}
+
+		memcpy(jsock->rbuf + jsock->rlen, data, len);
+		data = jsock->rbuf;
+		len += jsock->rlen;
+	}
+
+	if ((used = verto_reactor_parse(jsock, data, len)) < 0) {
+		return -1;
+	}
+
+	len -= used;
+
+	if (!len) {
+		switch_safe_free(jsock->rbuf);
+		jsock->rlen = jsock->rsize = 0;
+	} else if (data == jsock->rbuf) {
+		memmove(jsock->rbuf, jsock->rbuf + used, len);
+		jsock->rlen = len;
+	} else {
+		jsock->rsize = len < 4096 ? 4096 : len;
+		switch_malloc(jsock->rbuf, jsock->rsize);
+		memcpy(jsock->rbuf, data + used, len);
+		jsock->rlen = len;
+	}
+
+	return 0;
+}
+
+static int verto_reactor_read(verto_reactor_t *r, jsock_t *jsock)
+{
+	int loops = 16;
+
+	while (loops-- > 0) {
+		switch_ssize_t bytes;
+
+		if ((jsock->ptype & PTYPE_CLIENT_SSL)) {
+			/* SSL_read and SSL_write must not run concurrently on one connection */
+			switch_mutex_lock(jsock->write_mutex);
+			bytes = kws_raw_read(jsock->ws, r->scratch, sizeof(r->scratch), 0);
+			switch_mutex_unlock(jsock->write_mutex);
+
+			if (bytes == -2) {
+				return 0;
+			}
+
+			/* decrypted data can sit in the SSL buffer where epoll can't see it */
+			loops = 16;
+		} else {
+			bytes = recv(jsock->client_socket, r->scratch, sizeof(r->scratch), 0);
+
+			if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				return 0;
+			}
+		}
+
+		if (bytes == 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s POLL HANGUP DETECTED (peer closed its end of socket)\n", jsock->name);
+			return -1;
+		}
+
+		if (bytes < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s BAD READ %" SWITCH_SSIZE_T_FMT "\n", jsock->name, bytes);
+			return -1;
+		}
+
+		jsock->rlast = switch_micro_time_now();
+
+		if (verto_reactor_feed(jsock, r->scratch, (switch_size_t) bytes) < 0) {
+			return -1;
+		}
+
+		if (!(jsock->ptype & PTYPE_CLIENT_SSL) && (switch_size_t) bytes < sizeof(r->scratch)) {
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+static void verto_reactor_close(verto_reactor_t *r, jsock_t *jsock)
+{
+	jsock_t *jp, *last = NULL;
+
+	for (jp = r->head; jp; jp = jp->rnext) {
+		if (jp == jsock) {
+			if (last) {
+				last->rnext = jp->rnext;
+			} else {
+				r->head = jp->rnext;
+			}
+			break;
+		}
+		last = jp;
+	}
+
+	switch_mutex_lock(r->mutex);
+	r->count--;
+	switch_mutex_unlock(r->mutex);
+
+	switch_mutex_lock(jsock->write_mutex);
+	if (jsock->rregistered && jsock->client_socket != KS_SOCK_INVALID) {
+		epoll_ctl(r->efd, EPOLL_CTL_DEL, jsock->client_socket, NULL);
+	}
+	jsock->rregistered = 0;
+	jsock->rclosed = 1;
+	switch_mutex_unlock(jsock->write_mutex);
+
+	switch_safe_free(jsock->rbuf);
+	switch_safe_free(jsock->msg);
+	jsock->rlen = jsock->rsize = jsock->msg_len = 0;
+
+	/* the worker tears the connection down just like client_thread() would */
+	verto_reactor_schedule(jsock);
+}
+
+static void verto_reactor_adopt(verto_reactor_t *r)
+{
+	jsock_t *jsock, *next;
+
+	switch_mutex_lock(r->mutex);
+	jsock = r->pending;
+	r->pending = NULL;
+	switch_mutex_unlock(r->mutex);
+
+	for (; jsock; jsock = next) {
+		struct epoll_event ev = { 0 };
+		int ok;
+
+		next = jsock->rnext;
+		jsock->rnext = r->head;
+		r->head = jsock;
+
+		switch_mutex_lock(jsock->write_mutex);
+		ev.events = EPOLLIN | (jsock->warmed ? EPOLLOUT : 0);
+		ev.data.ptr = jsock;
+		if ((ok = epoll_ctl(r->efd, EPOLL_CTL_ADD, jsock->client_socket, &ev) == 0)) {
+			jsock->rregistered = 1;
+		}
+		switch_mutex_unlock(jsock->write_mutex);
+
+		if (!ok) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s epoll add failed: %s\n", jsock->name, strerror(errno));
+			verto_reactor_close(r, jsock);
+			continue;
+		}
+
+		if (verto_reactor_read(r, jsock) < 0) {
+			verto_reactor_close(r, jsock);
+		}
+	}
+}
+
+/* the timed part of the old client loop: expiry, drops, keepalive pings */
+static void verto_reactor_sweep(verto_reactor_t *r)
+{
+	jsock_t *jsock, *next;
+	switch_time_t now = switch_micro_time_now();
+	time_t epoch = switch_epoch_time_now(NULL);
+
+	for (jsock = r->head; jsock; jsock = next) {
+		next = jsock->rnext;
+
+		if (!jsock->profile->running || !verto_reactor.running) {
+			verto_reactor_close(r, jsock);
+		} else if (jsock->drop) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Dropping Connection\n", jsock->name);
+			verto_reactor_close(r, jsock);
+		} else if (jsock->exptime && epoch >= jsock->exptime) {
+			switch_set_flag(jsock, JPFLAG_AUTH_EXPIRED);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Authentication Expired [%"TIME_T_FMT"] >= [%"TIME_T_FMT"]\n",
+							  jsock->uid, epoch, jsock->exptime);
+			verto_reactor_close(r, jsock);
+		} else if (now - jsock->rlast >= VERTO_REACTOR_PING_MS * 1000) {
+			cJSON *params = NULL;
+			cJSON *msg = jrpc_new_req("verto.ping", 0, &params);
+
+			if (jsock->exptime) {
+				cJSON_AddItemToObject(params, "auth-expires", cJSON_CreateNumber(jsock->exptime));
+			}
+
+			cJSON_AddItemToObject(params, "serno", cJSON_CreateNumber(epoch));
+			jsock_queue_event(jsock, &msg, SWITCH_TRUE);
+			jsock->rlast = now;
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC verto_reactor_thread(switch_thread_t *thread, void *obj)
+{
+	verto_reactor_t *r = (verto_reactor_t *) obj;
+	struct epoll_event events[VERTO_REACTOR_EVENTS];
+	switch_time_t last_sweep = switch_micro_time_now();
+
+	while (verto_reactor.running) {
+		int i, n = epoll_wait(r->efd, events, VERTO_REACTOR_EVENTS, VERTO_REACTOR_SWEEP_MS);
+		switch_time_t now;
+
+		if (n < 0 && errno != EINTR) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "epoll_wait failed: %s\n", strerror(errno));
+			switch_yield(100000);
+		}
+
+		for (i = 0; i < n; i++) {
+			jsock_t *jsock = (jsock_t *) events[i].data.ptr;
+
+			if (!jsock) {
+				uint64_t val;
+
+				while (read(r->wfd, &val, sizeof(val)) > 0);
+				verto_reactor_adopt(r);
+				continue;
+			}
+
+			if ((events[i].events & EPOLLOUT)) {
+				switch_mutex_lock(jsock->write_mutex);
+				if (verto_reactor_flush_arm(jsock) < 0) {
+					jsock->drop = 1;
+				}
+				switch_mutex_unlock(jsock->write_mutex);
+			}
+
+			if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+				if (verto_reactor_read(r, jsock) < 0) {
+					verto_reactor_close(r, jsock);
+				}
+			}
+		}
+
+		now = switch_micro_time_now();
+		if (now - last_sweep >= VERTO_REACTOR_SWEEP_MS * 1000) {
+			verto_reactor_sweep(r);
+			last_sweep = now;
+		}
+	}
+
+	verto_reactor_adopt(r);
+	while (r->head) {
+		verto_reactor_close(r, r->head);
+	}
+
+	return NULL;
+}
+
+static void verto_reactor_teardown(jsock_t *jsock)
+{
+	switch_memory_pool_t *pool = jsock->pool;
+	void *pop;
+
+	detach_jsock(jsock);
+
+	switch_mutex_lock(jsock->write_mutex);
+	verto_reactor_consume(jsock, jsock->wq_bytes);
+	switch_safe_free(jsock->wrec);
+	jsock->wrec_len = 0;
+	kws_destroy(&jsock->ws);
+	switch_mutex_unlock(jsock->write_mutex);
+	ks_pool_close(&jsock->kpool);
+
+	client_cleanup(jsock);
+
+	while (switch_queue_trypop(jsock->inbox, &pop) == SWITCH_STATUS_SUCCESS) {
+		free(pop);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+static void verto_reactor_speed_test(jsock_t *jsock, long size, long up_ms)
+{
+	char repl[2048] = "";
+	int loops = size / 1024, rem = size % 1024, dur = 0, i, j;
+
+	switch_snprintf(repl, sizeof(repl), "#SPU %ld", up_ms);
+	jsock_write_frame(jsock, WSOC_TEXT, repl, strlen(repl));
+	switch_snprintf(repl, sizeof(repl), "#SPB ");
+	memset(repl+4, '.', 1024);
+
+	for (j = 0; j < 10 ; j++) {
+		switch_time_t a = switch_time_now(), b;
+		int r, ms = 30000;
+
+		for (i = 0; i < loops; i++) {
+			jsock_write_frame(jsock, WSOC_TEXT, repl, 1024);
+		}
+		if (rem) {
+			jsock_write_frame(jsock, WSOC_TEXT, repl, rem);
+		}
+
+		/* the download half measures until the kernel has taken every byte */
+		switch_mutex_lock(jsock->write_mutex);
+		while ((r = verto_reactor_flush(jsock)) == 1 && ms > 0) {
+			struct pollfd pfd = { 0 };
+
+			pfd.fd = jsock->client_socket;
+			pfd.events = POLLOUT;
+			switch_mutex_unlock(jsock->write_mutex);
+			poll(&pfd, 1, 100);
+			ms -= 100;
+			switch_mutex_lock(jsock->write_mutex);
+		}
+		switch_mutex_unlock(jsock->write_mutex);
+
+		if (r != 0) {
+			jsock->drop = 1;
+			return;
+		}
+
+		b = switch_time_now();
+		dur += (int)((b - a) / 1000);
+	}
+
+	dur /= j+1;
+
+	switch_snprintf(repl, sizeof(repl), "#SPD %d", dur);
+	jsock_write_frame(jsock, WSOC_TEXT, repl, strlen(repl));
 }
 
-static void client_run(jsock_t *jsock)
+static switch_status_t verto_reactor_input(jsock_t *jsock, char *s)
 {
-	int flags = KWS_BLOCK;
-	int idle = 0;
-	ks_json_t *params = NULL;
-	
-	if (jsock->profile->vhosts) {
-		flags |= KWS_STAY_OPEN;
-		flags |= KWS_HTTP;
-	}
+	if (*s == '#') {
+		long size = 0, up_ms = 0;
 
-	ks_pool_open(&jsock->kpool);
+		if (!switch_test_flag(jsock, JPFLAG_AUTHED)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Speed-test request before authentication\n", jsock->name);
+			return SWITCH_STATUS_FALSE;
+		}
 
-	switch_thread_rwlock_rdlock(jsock->profile->rwlock);
-#if defined(KS_VERSION_NUM) && KS_VERSION_NUM >= 20000
-	params = ks_json_create_object();
-	ks_json_add_number_to_object(params, "payload_size_max", 1000000);
-	if (kws_init_ex(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, flags, jsock->kpool, params) != KS_STATUS_SUCCESS) {
-#else
-	if (kws_init(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, flags, jsock->kpool) != KS_STATUS_SUCCESS) {
-#endif
-		switch_thread_rwlock_unlock(jsock->profile->rwlock);
-		log_and_exit(SWITCH_LOG_NOTICE, "%s WS SETUP FAILED\n", jsock->name);
-	}
-	switch_thread_rwlock_unlock(jsock->profile->rwlock);
+		if (!strncmp(s, "#SP! ", 5) && sscanf(s + 5, "%ld %ld", &size, &up_ms) == 2 && size > 0 && size <= VERTO_SPEED_TEST_MAX_SIZE) {
+			verto_reactor_speed_test(jsock, size, up_ms);
+		}
 
-	if (kws_test_flag(jsock->ws, KWS_HTTP)) {
-		http_run(jsock);
-		kws_close(jsock->ws, WS_NONE);
-		goto end;
+		return SWITCH_STATUS_SUCCESS;
 	}
 
-	while(jsock->profile->running) {
-		int pflags, poll_time = 50;
-		time_t now;
+	return process_input(jsock, (uint8_t *) s, strlen(s));
+}
 
-		if (!jsock->ws) { die("%s Setup Error\n", jsock->name); }
-		
-		pflags = kws_wait_sock(jsock->ws, poll_time, KS_POLL_READ);
+static void verto_reactor_service(jsock_t *jsock)
+{
+	void *pop;
+	int batch = VERTO_REACTOR_BATCH;
 
-		if (jsock->exptime) {
-			now = switch_epoch_time_now(NULL);
+	if (jsock->rclosed) {
+		verto_reactor_teardown(jsock);
+		return;
+	}
 
-			if (now >= jsock->exptime) {
-				switch_set_flag(jsock, JPFLAG_AUTH_EXPIRED);
-				die("%s Authentication Expired [%"TIME_T_FMT"] >= [%"TIME_T_FMT"]\n", jsock->uid, now, jsock->exptime);
-			}
+	verto_servicing = jsock;
 
+	while (batch-- > 0 && !jsock->drop && switch_queue_trypop(jsock->inbox, &pop) == SWITCH_STATUS_SUCCESS) {
+		char *s = (char *) pop;
+
+		if (verto_reactor_input(jsock, s) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s Input Error\n", jsock->name);
+			jsock->drop = 1;
 		}
 
-		if (jsock->drop) { die("%s Dropping Connection\n", jsock->name); }
-		if (pflags < 0 && (errno != EINTR)) { die_errnof("%s POLL FAILED with %d", jsock->name, pflags); }
-		if (pflags == 0) {/* socket poll timeout */ jsock_check_event_queue(jsock); idle += poll_time;} else {idle = 0;}
+		free(s);
+	}
 
-		if (idle >= 30000) {
-			cJSON *params = NULL;
-			cJSON *msg = jrpc_new_req("verto.ping", 0, &params);
+	if (!jsock->drop) {
+		jsock_check_event_queue(jsock);
 
-			if (jsock->exptime) {
-				cJSON_AddItemToObject(params, "auth-expires", cJSON_CreateNumber(jsock->exptime));
-			}
-			
-			cJSON_AddItemToObject(params, "serno", cJSON_CreateNumber(switch_epoch_time_now(NULL)));
-			jsock_queue_event(jsock, &msg, SWITCH_TRUE);
-			idle = 0;
-		}
-		
-		if ((!switch_test_flag(jsock, JPFLAG_CHECK_ATTACH) || (jsock->attach_timer > 0 && jsock->attach_timer-- == 0)) &&
-			switch_test_flag(jsock, JPFLAG_AUTHED)) {
+		if (!switch_test_flag(jsock, JPFLAG_CHECK_ATTACH) && switch_test_flag(jsock, JPFLAG_AUTHED)) {
 			attach_calls(jsock);
 			switch_set_flag(jsock, JPFLAG_CHECK_ATTACH);
 		}
+	}
 
-		if (pflags > 0 && (pflags & KS_POLL_HUP)) { log_and_exit(SWITCH_LOG_INFO, "%s POLL HANGUP DETECTED (peer closed its end of socket)\n", jsock->name); }
-		if (pflags > 0 && (pflags & KS_POLL_ERROR)) { die("%s POLL ERROR\n", jsock->name); }
-		if (pflags > 0 && (pflags & KS_POLL_INVALID)) { die("%s POLL INVALID SOCKET (not opened or already closed)\n", jsock->name); }
-		if (pflags > 0 && (pflags & KS_POLL_READ)) {
-			switch_ssize_t bytes;
-			kws_opcode_t oc;
-			uint8_t *data;
+	verto_servicing = NULL;
 
-			bytes = kws_read_frame(jsock->ws, &oc, &data);
+	switch_mutex_lock(jsock->write_mutex);
+	if (verto_reactor_flush_arm(jsock) < 0) {
+		jsock->drop = 1;
+	}
+	switch_mutex_unlock(jsock->write_mutex);
 
-			if (bytes < 0) {
-				if (bytes == -1000) {
-					log_and_exit(SWITCH_LOG_INFO, "%s Client sent close request\n", jsock->name);
-				} else {
-					die("%s BAD READ %" SWITCH_SSIZE_T_FMT "\n", jsock->name, bytes);
-				}
-			}
+	switch_mutex_lock(jsock->reactor_mutex);
+	if (jsock->rpending || jsock->rclosed || (!jsock->drop && switch_queue_size(jsock->inbox))) {
+		jsock->rpending = 0;
+		switch_queue_push(verto_reactor.work, jsock);
+	} else {
+		jsock->rscheduled = 0;
+	}
+	switch_mutex_unlock(jsock->reactor_mutex);
+}
 
-			if (bytes) {
-				char *s = (char *) data;
+static void *SWITCH_THREAD_FUNC verto_reactor_worker(switch_thread_t *thread, void *obj)
+{
+	void *pop;
 
-				if (*s == '#') {
-					char repl[2048] = "";
-					switch_time_t a, b;
+	while (switch_queue_pop(verto_reactor.work, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		verto_reactor_service((jsock_t *) pop);
+	}
 
-					if (!switch_test_flag(jsock, JPFLAG_AUTHED)) {
-						die("%s Speed-test request before authentication\n", jsock->name);
-					}
+	return NULL;
+}
 
-					if (bytes < 4) {
-						continue;
-					}
+static switch_status_t verto_reactor_attach(jsock_t *jsock)
+{
+	verto_reactor_t *r = NULL;
+	int i, flags;
 
-					if (s[1] == 'S' && s[2] == 'P') {
+	if (!verto_reactor.running) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-						if (s[3] == 'U') {
-							int i;
-							long size;
-							char *p = s+4;
-							int loops = 0;
-							int rem = 0;
-							int dur = 0, j = 0;
+	if ((flags = fcntl(jsock->client_socket, F_GETFL, 0)) < 0 || fcntl(jsock->client_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-							size = strtol(p, NULL, 10);
-							if (size <= 0 || size > VERTO_SPEED_TEST_MAX_SIZE) {
-								continue;
-							}
+	for (i = 0; i < verto_reactor.reactor_count; i++) {
+		if (!r || verto_reactor.reactors[i].count < r->count) {
+			r = &verto_reactor.reactors[i];
+		}
+	}
 
-							a = switch_time_now();
-							do {
-								bytes = kws_read_frame(jsock->ws, &oc, &data);
-								s = (char *) data;
-							} while (bytes >= 4 && data && s[0] == '#' && s[3] == 'B');
-							b = switch_time_now();
+	switch_queue_create(&jsock->inbox, VERTO_REACTOR_INBOX_LEN, jsock->pool);
+	switch_mutex_init(&jsock->reactor_mutex, SWITCH_MUTEX_NESTED, jsock->pool);
+	jsock->rlast = switch_micro_time_now();
 
-							if (!bytes || !data) continue;
+	switch_mutex_lock(jsock->write_mutex);
+	jsock->reactor = r;
+	switch_mutex_unlock(jsock->write_mutex);
 
-							if (s[0] != '#') goto nm;
+	switch_mutex_lock(r->mutex);
+	jsock->rnext = r->pending;
+	r->pending = jsock;
+	r->count++;
+	switch_mutex_unlock(r->mutex);
 
-							switch_snprintf(repl, sizeof(repl), "#SPU %ld", (long)((b - a) / 1000));
-							kws_write_frame(jsock->ws, WSOC_TEXT, repl, strlen(repl));
-							loops = size / 1024;
-							rem = size % 1024;
-							switch_snprintf(repl, sizeof(repl), "#SPB ");
-							memset(repl+4, '.', 1024);
+	/* pick up anything queued for the client during the handshake */
+	verto_reactor_schedule(jsock);
+	verto_reactor_wake(r);
 
-							for (j = 0; j < 10 ; j++) {
-								int ddur = 0;
-								a = switch_time_now();
-								for (i = 0; i < loops; i++) {
-									kws_write_frame(jsock->ws, WSOC_TEXT, repl, 1024);
-								}
-								if (rem) {
-									kws_write_frame(jsock->ws, WSOC_TEXT, repl, rem);
-								}
-								b = switch_time_now();
-								ddur += (int)((b - a) / 1000);
-								dur += ddur;
+	return SWITCH_STATUS_SUCCESS;
+}
 
-							}
+static switch_status_t verto_reactor_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	struct epoll_event ev = { 0 };
+	int i;
 
-							dur /= j+1;
+	if (verto_globals.reactor_threads <= 0) {
+		return SWITCH_STATUS_SUCCESS;
+	}
 
-							switch_snprintf(repl, sizeof(repl), "#SPD %d", dur);
-							kws_write_frame(jsock->ws, WSOC_TEXT, repl, strlen(repl));
-						}
-					}
+	verto_reactor.reactor_count = verto_globals.reactor_threads;
+	verto_reactor.worker_count = verto_globals.reactor_workers > 0 ? verto_globals.reactor_workers : (int) switch_core_cpu_count();
+	verto_reactor.reactors = switch_core_alloc(verto_globals.pool, sizeof(verto_reactor_t) * verto_reactor.reactor_count);
+	verto_reactor.workers = switch_core_alloc(verto_globals.pool, sizeof(switch_thread_t *) * verto_reactor.worker_count);
+	switch_queue_create(&verto_reactor.work, MAX_QUEUE_LEN, verto_globals.pool);
 
-					continue;
-				}
+	/* a NULL pointer marks the wakeup eventfd */
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
 
-			nm:
+	for (i = 0; i < verto_reactor.reactor_count; i++) {
+		verto_reactor_t *r = &verto_reactor.reactors[i];
 
-				if (process_input(jsock, data, bytes) != SWITCH_STATUS_SUCCESS) {
-					die("%s Input Error\n", jsock->name);
-				}
+		switch_mutex_init(&r->mutex, SWITCH_MUTEX_NESTED, verto_globals.pool);
+		r->wfd = -1;
+
+		if ((r->efd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (r->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+			epoll_ctl(r->efd, EPOLL_CTL_ADD, r->wfd, &ev) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Reactor setup failed: %s, using a thread per client\n", strerror(errno));
+			for (; i >= 0; i--) {
+				if (verto_reactor.reactors[i].efd >= 0) close(verto_reactor.reactors[i].efd);
+				if (verto_reactor.reactors[i].wfd >= 0) close(verto_reactor.reactors[i].wfd);
 			}
+			verto_reactor.reactor_count = 0;
+			return SWITCH_STATUS_FALSE;
 		}
 	}
 
- error:
- end:
-	detach_jsock(jsock);
-	kws_destroy(&jsock->ws);
-	ks_pool_close(&jsock->kpool);
-	ks_json_delete(&params);
-
-	return;
-}
+	verto_reactor.running = 1;
 
-static void jsock_flush(jsock_t *jsock)
-{
-	void *pop;
+	switch_threadattr_create(&thd_attr, verto_globals.pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 
-	switch_mutex_lock(jsock->write_mutex);
-	while(switch_queue_trypop(jsock->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-		cJSON *json = (cJSON *) pop;
-		cJSON_Delete(json);
+	for (i = 0; i < verto_reactor.reactor_count; i++) {
+		switch_thread_create(&verto_reactor.reactors[i].thread, thd_attr, verto_reactor_thread, &verto_reactor.reactors[i], verto_globals.pool);
 	}
-	switch_mutex_unlock(jsock->write_mutex);
-}
-
-static void *SWITCH_THREAD_FUNC client_thread(switch_thread_t *thread, void *obj)
-{
-	switch_event_t *s_event;
-
-	jsock_t *jsock = (jsock_t *) obj;
 
-	switch_event_create(&jsock->params, SWITCH_EVENT_CHANNEL_DATA);
-	switch_event_create(&jsock->vars, SWITCH_EVENT_CHANNEL_DATA);
-	switch_event_create(&jsock->user_vars, SWITCH_EVENT_CHANNEL_DATA);
+	for (i = 0; i < verto_reactor.worker_count; i++) {
+		switch_thread_create(&verto_reactor.workers[i], thd_attr, verto_reactor_worker, NULL, verto_globals.pool);
+	}
 
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Websocket reactor started with %d epoll threads and %d workers\n",
+					  verto_reactor.reactor_count, verto_reactor.worker_count);
 
-	add_jsock(jsock);
+	return SWITCH_STATUS_SUCCESS;
+}
 
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Starting client thread.\n", jsock->name);
+static void verto_reactor_stop(void)
+{
+	switch_status_t st;
+	void *pop;
+	int i;
 
-	if ((jsock->ptype & PTYPE_CLIENT) || (jsock->ptype & PTYPE_CLIENT_SSL)) {
-		client_run(jsock);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s Ending client thread.\n", jsock->name);
+	if (!verto_reactor.running) {
+		return;
 	}
 
-	detach_calls(jsock);
-
-	del_jsock(jsock);
-
-	switch_event_destroy(&jsock->params);
-	switch_event_destroy(&jsock->vars);
-	switch_event_destroy(&jsock->user_vars);
+	verto_reactor.running = 0;
 
-	if (jsock->client_socket != KS_SOCK_INVALID) {
-		close_socket(&jsock->client_socket);
+	for (i = 0; i < verto_reactor.reactor_count; i++) {
+		verto_reactor_wake(&verto_reactor.reactors[i]);
+		switch_thread_join(&st, verto_reactor.reactors[i].thread);
 	}
 
-	switch_event_destroy(&jsock->allowed_methods);
-	switch_event_destroy(&jsock->allowed_fsapi);
-	switch_event_destroy(&jsock->allowed_jsapi);
-	switch_event_destroy(&jsock->allowed_event_channels);
+	for (i = 0; i < verto_reactor.worker_count; i++) {
+		switch_queue_push(verto_reactor.work, NULL);
+	}
 
-	jsock_flush(jsock);
+	for (i = 0; i < verto_reactor.worker_count; i++) {
+		switch_thread_join(&st, verto_reactor.workers[i]);
+	}
 
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Ending client thread.\n", jsock->name);
-	if (switch_event_create_subclass(&s_event, SWITCH_EVENT_CUSTOM, MY_EVENT_CLIENT_DISCONNECT) == SWITCH_STATUS_SUCCESS) {
-		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_profile_name", jsock->profile->name);
-		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_client_address", jsock->name);
-		switch_event_add_header_string(s_event, SWITCH_STACK_BOTTOM, "verto_login", switch_str_nil(jsock->uid));
-		switch_event_fire(&s_event);
+	/* whatever got requeued behind the stop markers is finished here */
+	while (switch_queue_trypop(verto_reactor.work, &pop) == SWITCH_STATUS_SUCCESS) {
+		if (pop) {
+			verto_reactor_service((jsock_t *) pop);
+		}
 	}
-	switch_thread_rwlock_wrlock(jsock->rwlock);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s Thread ended\n", jsock->name);
-	switch_thread_rwlock_unlock(jsock->rwlock);
 
-	return NULL;
+	for (i = 0; i < verto_reactor.reactor_count; i++) {
+		close(verto_reactor.reactors[i].efd);
+		close(verto_reactor.reactors[i].wfd);
+	}
 }
+#endif
+
 
 
 static switch_bool_t auth_api_command(jsock_t *jsock, const char *api_cmd, const char *arg)
@@ -4546,7 +5815,10 @@ static switch_bool_t verto__broadcast_func(const char *method, cJSON *params, js
 	broadcast = cJSON_GetObjectItem(params, "localBroadcast");
 
 	if (broadcast && broadcast->type == cJSON_True) {
-		write_event(event_channel, NULL, NULL, jevent);
+		char *event_text = NULL;
+
+		write_event(event_channel, NULL, NULL, jevent, &event_text);
+		switch_safe_free(event_text);
 	} else {
 		switch_event_channel_broadcast(event_channel, &jevent, modname, verto_globals.event_channel_id);
 	}
@@ -4848,12 +6120,22 @@ static int start_jsock(verto_profile_t *profile, ks_socket_t sock, int family)
 	setsockopt(jsock->client_socket, IPPROTO_TCP, TCP_KEEPINTVL, (void *)&flag, sizeof(flag));
 #endif
 
-	td = switch_core_alloc(jsock->pool, sizeof(*td));
+#ifdef VERTO_REACTOR
+	jsock->rmode = verto_reactor_enabled();
+#endif
+
+	if (jsock->rmode) {
+		/* the handshake thread hands the connection to the reactor and returns, so the pool must outlive it */
+		switch_zmalloc(td, sizeof(*td));
+		td->alloc = 1;
+	} else {
+		td = switch_core_alloc(jsock->pool, sizeof(*td));
+		td->alloc = 0;
+		td->pool = pool;
+	}
 
-	td->alloc = 0;
 	td->func = client_thread;
 	td->obj = jsock;
-	td->pool = pool;
 
 	switch_mutex_init(&jsock->write_mutex, SWITCH_MUTEX_NESTED, jsock->pool);
 	switch_mutex_init(&jsock->filter_mutex, SWITCH_MUTEX_NESTED, jsock->pool);
@@ -5131,6 +6413,10 @@ static void do_shutdown(void)
 
 	kill_profiles();
 
+#ifdef VERTO_REACTOR
+	verto_reactor_stop();
+#endif
+
 	unsub_all_jsock();
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Done\n");
@@ -5559,6 +6845,14 @@ static switch_status_t parse_config(const char *cf)
 				if (val) {
 					verto_globals.kslog_on = switch_true(val);
 				}
+			} else if (!strcasecmp(var, "reactor-threads") && val) {
+#ifdef VERTO_REACTOR
+				verto_globals.reactor_threads = atoi(val);
+#else
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "reactor-threads needs epoll, using a thread per client\n");
+#endif
+			} else if (!strcasecmp(var, "reactor-workers") && val) {
+				verto_globals.reactor_workers = atoi(val);
 			}
 		}
 	}
@@ -6966,6 +8260,10 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_verto_load)
 
 	jrpc_init();
 
+#ifdef VERTO_REACTOR
+	verto_reactor_start();
+#endif
+
 	/* connect my internal structure to the blank pointer passed to me */
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
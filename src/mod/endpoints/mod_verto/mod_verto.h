@@ -70,6 +70,11 @@
 #define MAXPENDING 10000
 #define STACK_SIZE 80 * 1024
 
+/* epoll based websocket reactor, enabled with reactor-threads in verto.conf */
+#if defined(__linux__)
+#define VERTO_REACTOR 1
+#endif
+
 #define VERTO_CHAT_PROTO "verto"
 
 #define copy_string(x,y,z) strncpy(x, y, z - 1)
@@ -107,7 +112,6 @@ struct jsock_s {
 	switch_thread_t *thread;
 	ks_pool_t *kpool;
 	kws_t *ws;
-	unsigned char buf[65535];
 	char *name;
 	jsock_type_t ptype;
 	struct sockaddr_in remote_addr;
@@ -159,6 +163,31 @@ struct jsock_s {
 	int lost_events;
 	int ready;
 
+	/* reactor mode (reactor-threads > 0), see verto_reactor_* */
+	struct verto_reactor_s *reactor;
+	switch_mutex_t *reactor_mutex;
+	switch_queue_t *inbox;
+	struct verto_wmsg_s *wq_head;
+	struct verto_wmsg_s *wq_tail;
+	switch_size_t wq_bytes;
+	uint8_t *wrec;
+	switch_size_t wrec_len;
+	uint8_t *rbuf;
+	switch_size_t rlen;
+	switch_size_t rsize;
+	uint8_t *msg;
+	switch_size_t msg_len;
+	switch_time_t rlast;
+	switch_time_t speed_start;
+	long speed_size;
+	uint8_t rmode;
+	uint8_t rregistered;
+	uint8_t rscheduled;
+	uint8_t rpending;
+	uint8_t rclosed;
+	uint8_t warmed;
+	struct jsock_s *rnext;
+
 	struct jsock_s *next;
 };
 
@@ -319,6 +348,8 @@ struct globals_s {
 	int enable_presence;
 	int enable_fs_events;
 	switch_bool_t kslog_on;
+	int reactor_threads;
+	int reactor_workers;
 
 	switch_hash_t *jsock_hash;
 	switch_mutex_t *jsock_mutex;
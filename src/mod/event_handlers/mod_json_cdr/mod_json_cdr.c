@@ -45,7 +45,6 @@ static struct {
 	char *cred;
 	char *urls[MAX_URLS];
 	int url_count;
-	int url_index;
 	switch_thread_rwlock_t *log_path_lock;
 	char *base_log_dir;
 	char *base_err_log_dir[MAX_ERR_DIRS];
@@ -76,6 +75,12 @@ static struct {
 	int encode_values;
 	switch_queue_t *queue;
 	switch_thread_t *thread;
+	char *spool_dir;
+	uint32_t batch_size;
+	uint32_t max_concurrent;
+	uint32_t queue_capacity;
+	uint32_t max_delay;
+	switch_curl_queue_t *post_queue;
 } globals;
 
 typedef struct {
@@ -90,15 +95,6 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_json_cdr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_json_cdr, mod_json_cdr_load, mod_json_cdr_shutdown, NULL);
 
-/* this function would have access to the HTML returned by the webserver, we don't need it
- * and the default curl activity is to print to stdout, something not as desirable
- * so we have a dummy function here
- */
-static size_t httpCallBack(char *buffer, size_t size, size_t nitems, void *outstream)
-{
-	return size * nitems;
-}
-
 static switch_status_t set_json_cdr_log_dirs()
 {
 	switch_time_exp_t tm;
@@ -194,19 +190,18 @@ static switch_status_t set_json_cdr_log_dirs()
 	return status;
 }
 
-static void backup_cdr(cdr_data_t *data)
+static void backup_cdr_text(const char *uuid, const char *filename, const char *json_text)
 {
 	if (globals.log_errors_to_disk) {
 		int fd = -1, err_dir_index;
 		char *path = NULL;
-		const char *json_text = data->json_text_escaped ? data->json_text_escaped : data->json_text;
 
 		for (err_dir_index = 0; err_dir_index < globals.err_dir_count; err_dir_index++) {
 			switch_thread_rwlock_rdlock(globals.log_path_lock);
-			path = switch_mprintf("%s%s%s", globals.err_log_dir[err_dir_index], SWITCH_PATH_SEPARATOR, data->filename);
+			path = switch_mprintf("%s%s%s", globals.err_log_dir[err_dir_index], SWITCH_PATH_SEPARATOR, filename);
 			switch_thread_rwlock_unlock(globals.log_path_lock);
 
-			switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_INFO, "Backup file %s\n", path);
+			switch_log_printf(SWITCH_CHANNEL_UUID_LOG(uuid), SWITCH_LOG_INFO, "Backup file %s\n", path);
 			if (path) {
 #ifdef _MSC_VER
 				mode_t mode = S_IRUSR | S_IWUSR;
@@ -222,15 +217,15 @@ static void backup_cdr(cdr_data_t *data)
 						} while (!(x<0) && x<1);
 					close(fd);
 					if (x < 0) {
-						switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Error writing [%s]\n",path);
+						switch_log_printf(SWITCH_CHANNEL_UUID_LOG(uuid), SWITCH_LOG_ERROR, "Error writing [%s]\n",path);
 						if (0 > unlink(path))
-							switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Error unlinking [%s]\n",path);
+							switch_log_printf(SWITCH_CHANNEL_UUID_LOG(uuid), SWITCH_LOG_ERROR, "Error unlinking [%s]\n",path);
 					}
 					switch_safe_free(path);
 					break;
 				} else {
 					char ebuf[512] = { 0 };
-					switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Can't open %s! [%s]\n",
+					switch_log_printf(SWITCH_CHANNEL_UUID_LOG(uuid), SWITCH_LOG_ERROR, "Can't open %s! [%s]\n",
 									  path, switch_strerror_r(errno, ebuf, sizeof(ebuf)));
 
 				}
@@ -238,8 +233,122 @@ static void backup_cdr(cdr_data_t *data)
 			}
 		}
 	} else {
-		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_NOTICE, "Not writing to file\n");
+		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(uuid), SWITCH_LOG_NOTICE, "Not writing to file\n");
+	}
+}
+
+static void backup_cdr(cdr_data_t *data)
+{
+	backup_cdr_text(data->uuid, data->filename, data->json_text_escaped ? data->json_text_escaped : data->json_text);
+}
+
+/* called by the delivery queue for CDRs it gave up on, name is the file name without its extension */
+static void post_failed(const char *name, const char *data, switch_size_t len, void *user_data)
+{
+	char *filename = switch_mprintf("%s.cdr.json", name);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post %s to web server\n", name);
+	backup_cdr_text(name, filename, data);
+	switch_safe_free(filename);
+}
+
+/* called by the delivery queue for each request, on its own thread */
+static void post_setup(switch_CURL *curl_handle, const char *url, void *user_data)
+{
+	if (!zstr(globals.cred)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
+	}
+
+	switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-json/1.0");
+
+	if (!zstr(globals.ssl_cert_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
+	}
+
+	if (!zstr(globals.ssl_key_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
+	}
+
+	if (!zstr(globals.ssl_key_password)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
+	}
+
+	if (!zstr(globals.ssl_version)) {
+		if (!strcasecmp(globals.ssl_version, "SSLv3")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+		}
+	}
+
+	if (!zstr(globals.ssl_cacert_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
+	}
+
+	// tcp timeout
+	switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
+
+	/* these were used for testing, optionally they may be enabled if someone desires
+	   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
+	 */
+
+	if (!strncasecmp(url, "https", 5)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
+	}
+
+	if (globals.enable_cacert_check) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+	}
+
+	if (globals.enable_ssl_verifyhost) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+	}
+}
+
+static switch_status_t start_post_queue(void)
+{
+	switch_curl_queue_settings_t settings = { 0 };
+	const char *headers[3] = { 0 };
+
+	if (globals.encode) {
+		if (globals.encode == ENCODING_DEFAULT) {
+			headers[0] = "Content-Type: application/x-www-form-urlencoded";
+		} else {
+			headers[0] = "Content-Type: application/x-www-form-base64-encoded";
+		}
+		settings.batch_prefix = "cdr=";
+		settings.batch_separator = "&cdr=";
+	} else {
+		headers[0] = "Content-Type: application/json";
+		if (globals.batch_size > 1) {
+			settings.batch_prefix = "[";
+			settings.batch_separator = ",";
+			settings.batch_suffix = "]";
+		}
+	}
+
+	if (globals.disable100continue) {
+		headers[1] = "Expect:";
 	}
+
+	settings.name = "json_cdr";
+	settings.urls = (const char **) globals.urls;
+	settings.url_count = globals.url_count;
+	settings.headers = headers;
+	settings.id_param = "uuid";
+	settings.batch_size = globals.batch_size;
+	settings.max_concurrent = globals.max_concurrent;
+	settings.capacity = globals.queue_capacity;
+	settings.spool_dir = globals.spool_dir;
+	settings.attempts = globals.retries;
+	settings.retry_delay_ms = globals.delay * 1000;
+	settings.max_retry_delay_ms = globals.max_delay * 1000;
+	settings.setup = post_setup;
+	settings.failed = post_failed;
+
+	return switch_curl_queue_create(&globals.post_queue, &settings);
 }
 
 
@@ -255,13 +364,7 @@ void destroy_cdr_data(cdr_data_t *data)
 
 static void process_cdr(cdr_data_t *data)
 {
-	char *curl_json_text = NULL;
-	long httpRes;
-	CURL *curl_handle = NULL;
-	switch_curl_slist_t *headers = NULL;
-	switch_curl_slist_t *slist = NULL;
 	int fd = -1;
-	uint32_t cur_try;
 
 	switch_assert(data != NULL);
 
@@ -301,138 +404,21 @@ static void process_cdr(cdr_data_t *data)
 		}
 	}
 
-	/* try to post it to the web server */
-	if (globals.url_count) {
-		char *destUrl = NULL;
-		curl_handle = switch_curl_easy_init();
-
-		if (globals.encode) {
-			if (globals.encode == ENCODING_DEFAULT) {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
-			} else {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-base64-encoded");
-			}
-
-			curl_json_text = switch_mprintf("cdr=%s", data->json_text_escaped);
-			switch_assert(curl_json_text != NULL);
-
-		} else {
-			headers = switch_curl_slist_append(headers, "Content-Type: application/json");
-			curl_json_text = (char *)data->json_text;
-		}
-
-		if (!zstr(globals.cred)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
-		}
-
-		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, curl_json_text);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-json/1.0");
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, httpCallBack);
-
-		if (globals.disable100continue) {
-			slist = switch_curl_slist_append(slist, "Expect:");
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
-		}
-
-		if (!zstr(globals.ssl_cert_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
-		}
-
-		if (!zstr(globals.ssl_key_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
-		}
-
-		if (!zstr(globals.ssl_key_password)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
-		}
-
-		if (!zstr(globals.ssl_version)) {
-			if (!strcasecmp(globals.ssl_version, "SSLv3")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
-			}
-		}
-
-		if (!zstr(globals.ssl_cacert_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
-		}
-
-		// tcp timeout
-		switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
-
-		/* these were used for testing, optionally they may be enabled if someone desires
-		   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
-		 */
-
-		for (cur_try = 0; cur_try < globals.retries; cur_try++) {
-			if (cur_try > 0) {
-				switch_yield(globals.delay * 1000000);
-			}
-
-			destUrl = switch_mprintf("%s?uuid=%s", globals.urls[globals.url_index], data->uuid);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_URL, destUrl);
-
-			if (!strncasecmp(destUrl, "https", 5)) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
-			}
-
-			if (globals.enable_cacert_check) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
-			}
-
-			if (globals.enable_ssl_verifyhost) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-			}
+	/* hand it to the delivery queue, it's posted from there */
+	if (globals.post_queue) {
+		const char *json_text = data->json_text_escaped ? data->json_text_escaped : data->json_text;
+		/* the url gets the bare uuid, a backup gets the a_ prefixed file name */
+		char *name = switch_mprintf("%.*s", (int) (strlen(data->filename) - strlen(".cdr.json")), data->filename);
 
-			switch_curl_easy_perform(curl_handle);
-			switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-			switch_safe_free(destUrl);
-			if (httpRes >= 200 && httpRes < 300) {
-				goto end;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Got error [%ld] posting to web server [%s]\n",
-								  httpRes, globals.urls[globals.url_index]);
-				globals.url_index++;
-				switch_assert(globals.url_count <= MAX_URLS);
-				if (globals.url_index >= globals.url_count) {
-					globals.url_index = 0;
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Retry will be with url [%s]\n", globals.urls[globals.url_index]);
-					}
-			}
+		if (switch_curl_queue_push_named(globals.post_queue, data->uuid, name, json_text, strlen(json_text)) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_WARNING, "CDR delivery queue is full\n");
+			backup_cdr(data);
 		}
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		slist = NULL;
-		headers = NULL;
-		curl_handle = NULL;
 
-		/* if we are here the web post failed for some reason */
-		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Unable to post to web server\n");
-		backup_cdr(data);
+		switch_safe_free(name);
 	}
 
 	end:
-	if (curl_handle) {
-		switch_curl_easy_cleanup(curl_handle);
-	}
-	if (headers) {
-		switch_curl_slist_free_all(headers);
-	}
-	if (slist) {
-		switch_curl_slist_free_all(slist);
-	}
-	if (curl_json_text != data->json_text) {
-		switch_safe_free(curl_json_text);
-	}
-
 	destroy_cdr_data(data);
 }
 
@@ -555,6 +541,24 @@ static void event_handler(switch_event_t *event)
 	}
 }
 
+#define JSON_CDR_SYNTAX "status"
+SWITCH_STANDARD_API(json_cdr_api_function)
+{
+	if (zstr(cmd) || strcasecmp(cmd, "status")) {
+		stream->write_function(stream, "-USAGE: %s\n", JSON_CDR_SYNTAX);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!globals.post_queue) {
+		stream->write_function(stream, "-ERR no urls configured\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_curl_queue_status(globals.post_queue, stream);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_state_handler_table_t state_handlers = {
 	/*.on_init */ NULL,
 	/*.on_routing */ NULL,
@@ -574,6 +578,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 	char *cf = "json_cdr.conf";
 	switch_xml_t cfg, xml, settings, param;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_api_interface_t *api_interface;
 
 	memset(&globals, 0, sizeof(globals));
 
@@ -584,6 +589,10 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 	globals.pool = pool;
 	globals.auth_scheme = CURLAUTH_BASIC;
 	globals.encode_values = ENCODING_DEFAULT;
+	globals.batch_size = 1;
+	globals.max_concurrent = 1;
+	globals.queue_capacity = 1000;
+	globals.max_delay = 300;
 
 	switch_thread_rwlock_create(&globals.log_path_lock, pool);
 
@@ -705,7 +714,21 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 					switch_threadattr_create(&thd_attr, globals.pool);
 					switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 					switch_thread_create(&globals.thread, thd_attr, cdr_thread, NULL, globals.pool);
+
+					globals.queue_capacity = capacity;
+				}
+			} else if (!strcasecmp(var, "spool-dir") && !zstr(val)) {
+				if (switch_is_file_path(val)) {
+					globals.spool_dir = switch_core_strdup(globals.pool, val);
+				} else {
+					globals.spool_dir = switch_core_sprintf(globals.pool, "%s%s%s", SWITCH_GLOBAL_dirs.storage_dir, SWITCH_PATH_SEPARATOR, val);
 				}
+			} else if (!strcasecmp(var, "batch-size") && !zstr(val)) {
+				globals.batch_size = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "max-concurrent-posts") && !zstr(val)) {
+				globals.max_concurrent = (uint32_t) atoi(val);
+			} else if (!strcasecmp(var, "max-delay") && !zstr(val)) {
+				globals.max_delay = (uint32_t) atoi(val);
 			}
 		}
 
@@ -727,6 +750,10 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 
 	set_json_cdr_log_dirs();
 
+	if (globals.url_count && start_post_queue() != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't start the CDR delivery queue, CDRs will only be written to disk\n");
+	}
+
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_TRAP, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL, &globals.node) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind!\n");
 		return SWITCH_STATUS_GENERR;
@@ -737,6 +764,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
+	SWITCH_ADD_API(api_interface, "json_cdr", "JSON CDR delivery status", json_cdr_api_function, JSON_CDR_SYNTAX);
+	switch_console_set_complete("add json_cdr status");
+
 	switch_xml_free(xml);
 	return status;
 }
@@ -749,20 +779,23 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_json_cdr_shutdown)
 
 	globals.shutdown = 1;
 
+	/* no more CDRs may be queued once the queues are gone */
+	switch_core_remove_state_handler(&state_handlers);
+	switch_event_unbind(&globals.node);
+
 	if (globals.queue) {
 		switch_queue_push(globals.queue, NULL);
 		switch_thread_join(&status, globals.thread);
 	}
 
+	switch_curl_queue_destroy(&globals.post_queue);
+
 	switch_safe_free(globals.log_dir);
 
 	for (;err_dir_index < globals.err_dir_count; err_dir_index++) {
 		switch_safe_free(globals.err_log_dir[err_dir_index]);
 	}
 
-	switch_event_unbind(&globals.node);
-	switch_core_remove_state_handler(&state_handlers);
-
 	switch_thread_rwlock_destroy(globals.log_path_lock);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -45,9 +45,7 @@ static struct {
 	char *cred;
 	char *urls[MAX_URLS + 1];
 	int url_count;
-	int url_index;
 	switch_thread_rwlock_t *log_path_lock;
-	switch_mutex_t *url_index_mutex;
 	char *base_log_dir;
 	char *base_err_log_dir;
 	char *log_dir;
@@ -73,21 +71,20 @@ static struct {
 	switch_memory_pool_t *pool;
 	switch_event_node_t *node;
 	char *cookie_file;
+	char *spool_dir;
+	uint32_t batch_size;
+	uint32_t max_concurrent;
+	uint32_t queue_capacity;
+	uint32_t max_delay;
+	switch_curl_queue_t *queue;
+	/* CDRs are built without their xml header, the batch carries it */
+	switch_bool_t headerless;
 } globals;
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_xml_cdr, mod_xml_cdr_load, mod_xml_cdr_shutdown, NULL);
 
-/* this function would have access to the HTML returned by the webserver, we don't need it
- * and the default curl activity is to print to stdout, something not as desirable
- * so we have a dummy function here
- */
-static size_t httpCallBack(char *buffer, size_t size, size_t nitems, void *outstream)
-{
-	return size * nitems;
-}
-
 static switch_status_t set_xml_cdr_log_dirs(void)
 {
 	switch_time_exp_t tm;
@@ -182,27 +179,185 @@ static switch_status_t set_xml_cdr_log_dirs(void)
 	return status;
 }
 
+/* a file stands alone even when the posts are batched */
+static void write_cdr_text(int fd, const char *data, switch_size_t len, switch_bool_t header)
+{
+	static const char xml_header[] = "<?xml version=\"1.0\"?>\n";
+	int wrote;
+
+	if (!header) {
+		wrote = write(fd, xml_header, (unsigned) strlen(xml_header));
+		(void)wrote;
+	}
+	wrote = write(fd, data, (unsigned) len);
+	(void)wrote;
+}
+
+static void write_err_cdr(const char *id, const char *data, switch_size_t len)
+{
+	char *path = NULL;
+	int fd = -1;
+
+	switch_thread_rwlock_rdlock(globals.log_path_lock);
+	path = switch_mprintf("%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, id);
+	switch_thread_rwlock_unlock(globals.log_path_lock);
+	if (path) {
+#ifdef _MSC_VER
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+#else
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
+#endif
+			write_cdr_text(fd, data, len, !globals.headerless);
+			close(fd);
+		} else {
+			char ebuf[512] = { 0 };
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error![%s]\n",
+					switch_strerror_r(errno, ebuf, sizeof(ebuf)));
+		}
+		switch_safe_free(path);
+	}
+}
+
+/* called by the delivery queue for CDRs it gave up on */
+static void post_failed(const char *id, const char *data, switch_size_t len, void *user_data)
+{
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post %s to web server, writing to file\n", id);
+	write_err_cdr(id, data, len);
+}
+
+/* called by the delivery queue for each request, on its own thread */
+static void post_setup(switch_CURL *curl_handle, const char *url, void *user_data)
+{
+	if (!zstr(globals.cred)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
+	}
+
+	switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
+
+	if (globals.ssl_cert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
+	}
+
+	if (globals.ssl_key_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
+	}
+
+	if (globals.ssl_key_password) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
+	}
+
+	if (globals.ssl_version) {
+		if (!strcasecmp(globals.ssl_version, "SSLv3")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+		}
+	}
+
+	if (globals.ssl_cacert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
+	}
+
+	if (globals.cookie_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, globals.cookie_file);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, globals.cookie_file);
+	}
+
+	switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
+
+	/* these were used for testing, optionally they may be enabled if someone desires
+	   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
+	 */
+
+	if (!strncasecmp(url, "https", 5)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
+	}
+
+	if (globals.enable_cacert_check) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+	}
+
+	if (globals.enable_ssl_verifyhost) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+	}
+
+	/* overrides default 300s timeout, could be usefull if the current web server is down to prevent long time waiting for nothing */
+	/* connection_timeout = retry_timeout  */
+	switch_curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, !globals.delay ? 5 : (long)globals.delay);
+}
+
+static switch_status_t start_queue(void)
+{
+	switch_curl_queue_settings_t settings = { 0 };
+	const char *headers[3] = { 0 };
+	int batched = globals.batch_size > 1;
+
+	if (globals.encode == ENCODING_TEXTXML) {
+		headers[0] = "Content-Type: text/xml";
+		if (batched) {
+			settings.batch_prefix = "<?xml version=\"1.0\"?>\n<cdrs>\n";
+			settings.batch_separator = "\n";
+			settings.batch_suffix = "\n</cdrs>\n";
+		}
+	} else {
+		if (globals.encode == ENCODING_DEFAULT) {
+			headers[0] = "Content-Type: application/x-www-form-urlencoded";
+		} else if (globals.encode == ENCODING_BASE64) {
+			headers[0] = "Content-Type: application/x-www-form-base64-encoded";
+		} else {
+			headers[0] = "Content-Type: application/x-www-form-plaintext";
+		}
+		settings.batch_prefix = "cdr=";
+		settings.batch_separator = "&cdr=";
+	}
+
+	if (globals.disable100continue) {
+		headers[1] = "Expect:";
+	}
+
+	settings.name = "xml_cdr";
+	settings.urls = (const char **) globals.urls;
+	settings.url_count = globals.url_count;
+	settings.headers = headers;
+	settings.id_param = "uuid";
+	settings.batch_size = globals.batch_size;
+	settings.max_concurrent = globals.max_concurrent;
+	settings.capacity = globals.queue_capacity;
+	settings.spool_dir = globals.spool_dir;
+	settings.attempts = globals.retries;
+	settings.retry_delay_ms = globals.delay * 1000;
+	settings.max_retry_delay_ms = globals.max_delay * 1000;
+	settings.setup = post_setup;
+	settings.failed = post_failed;
+
+	/* set first, items spooled by the last run may fail as soon as the queue starts */
+	globals.headerless = globals.encode == ENCODING_TEXTXML && batched;
+
+	if (switch_curl_queue_create(&globals.queue, &settings) != SWITCH_STATUS_SUCCESS) {
+		globals.headerless = SWITCH_FALSE;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_status_t my_on_reporting(switch_core_session_t *session)
 {
 	switch_xml_t cdr = NULL;
 	char *xml_text = NULL;
 	char *path = NULL;
-	char *curl_xml_text = NULL;
 	const char *logdir = NULL;
 	char *xml_text_escaped = NULL;
 	int fd = -1;
-	uint32_t cur_try;
-	long httpRes;
-	switch_CURL *curl_handle = NULL;
-	switch_curl_slist_t *headers = NULL;
-	switch_curl_slist_t *slist = NULL;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	int is_b;
 	const char *a_prefix = "";
-	char url_joiner = '?';
 	int prefix_a;
 	const char *prefix_a_var = NULL;
+	switch_bool_t header;
 
 	if (globals.shutdown) {
 		return SWITCH_STATUS_SUCCESS;
@@ -230,8 +385,8 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		return SWITCH_STATUS_FALSE;
 	}
 
-	/* build the XML */
-	xml_text = switch_xml_toxml(cdr, SWITCH_TRUE);
+	header = !globals.headerless;
+	xml_text = switch_xml_toxml(cdr, header);
 	if (!xml_text) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error!\n");
 		goto error;
@@ -252,9 +407,7 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 #else
 			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
 #endif
-				int wrote;
-				wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
-				(void)wrote;
+				write_cdr_text(fd, xml_text, strlen(xml_text), header);
 				close(fd);
 			} else {
 				char ebuf[512] = { 0 };
@@ -267,192 +420,36 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		switch_thread_rwlock_unlock(globals.log_path_lock);
 	}
 
-	/* try to post it to the web server */
-	if (globals.url_count) {
-		char *destUrl = NULL;
-		int g_url_index = -1;
-
-		switch_mutex_lock(globals.url_index_mutex);
-		g_url_index = globals.url_index;
-		switch_mutex_unlock(globals.url_index_mutex);
-
-		curl_handle = switch_curl_easy_init();
+	/* hand it to the delivery queue, it's posted from there */
+	if (globals.queue) {
+		char *id = switch_mprintf("%s%s", a_prefix, switch_core_session_get_uuid(session));
 
-		if (globals.encode == ENCODING_TEXTXML) {
-			headers = switch_curl_slist_append(headers, "Content-Type: text/xml");
-		} else if (globals.encode) {
+		if (globals.encode && globals.encode != ENCODING_TEXTXML) {
 			switch_size_t need_bytes = strlen(xml_text) * 3 + 1;
 
 			xml_text_escaped = malloc(need_bytes);
 			switch_assert(xml_text_escaped);
 			memset(xml_text_escaped, 0, need_bytes);
 			if (globals.encode == ENCODING_DEFAULT) {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
 				switch_url_encode_opt(xml_text, xml_text_escaped, need_bytes, SWITCH_TRUE);
 			} else {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-base64-encoded");
 				switch_b64_encode((unsigned char *) xml_text, need_bytes / 3, (unsigned char *) xml_text_escaped, need_bytes);
 			}
 			switch_safe_free(xml_text);
 			xml_text = xml_text_escaped;
-		} else {
-			headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-plaintext");
-		}
-
-		if (globals.encode == ENCODING_TEXTXML) {
-			curl_xml_text = xml_text;
-		} else if (!(curl_xml_text = switch_mprintf("cdr=%s", xml_text))) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error!\n");
-			goto error;
 		}
 
-		if (!zstr(globals.cred)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
+		if (switch_curl_queue_push(globals.queue, id, xml_text, strlen(xml_text)) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "CDR delivery queue is full, writing to file\n");
+			write_err_cdr(id, xml_text, strlen(xml_text));
 		}
 
-		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, curl_xml_text);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, httpCallBack);
-
-		if (globals.disable100continue) {
-			slist = switch_curl_slist_append(slist, "Expect:");
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
-		}
-
-		if (globals.ssl_cert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
-		}
-
-		if (globals.ssl_key_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
-		}
-
-		if (globals.ssl_key_password) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
-		}
-
-		if (globals.ssl_version) {
-			if (!strcasecmp(globals.ssl_version, "SSLv3")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
-			}
-		}
-
-		if (globals.ssl_cacert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
-		}
-
-		if (globals.cookie_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, globals.cookie_file);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, globals.cookie_file);
-		}
-
-		switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
-
-		/* these were used for testing, optionally they may be enabled if someone desires
-		   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
-		 */
-
-		for (cur_try = 0; cur_try < globals.retries; cur_try++) {
-			if (cur_try > 0) {
-				switch_yield(globals.delay * 1000000);
-			}
-
-			if( strchr(globals.urls[g_url_index], '?') != NULL ) {
-				url_joiner = '&';
-			}
-			destUrl = switch_mprintf("%s%cuuid=%s%s", globals.urls[g_url_index], url_joiner, a_prefix, switch_core_session_get_uuid(session));
-			switch_curl_easy_setopt(curl_handle, CURLOPT_URL, destUrl);
-
-			if (!strncasecmp(destUrl, "https", 5)) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
-			}
-
-			if (globals.enable_cacert_check) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
-			}
-
-			if (globals.enable_ssl_verifyhost) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-			}
-
-			/* overrides default 300s timeout, could be usefull if the current web server is down to prevent long time waiting for nothing */
-			/* connection_timeout = retry_timeout  */
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, !globals.delay ? 5 : (long)globals.delay);
-			switch_curl_easy_perform(curl_handle);
-			switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-			switch_safe_free(destUrl);
-			if (httpRes >= 200 && httpRes <= 299) {
-				goto success;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Got error [%ld] posting to web server [%s]\n",
-								  httpRes, globals.urls[g_url_index]);
-				g_url_index++;
-				switch_assert(globals.url_count <= MAX_URLS);
-				if (g_url_index >= globals.url_count) {
-					g_url_index = 0;
-				}
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Retry will be with url [%s]\n", globals.urls[g_url_index]);
-				switch_mutex_lock(globals.url_index_mutex);
-				if (globals.url_index != g_url_index) {
-					globals.url_index = g_url_index;
-				}
-				switch_mutex_unlock(globals.url_index_mutex);
-			}
-		}
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		slist = NULL;
-		headers = NULL;
-		curl_handle = NULL;
-
-		/* if we are here the web post failed for some reason */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post to web server, writing to file\n");
-
-		switch_thread_rwlock_rdlock(globals.log_path_lock);
-		path = switch_mprintf("%s%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, a_prefix, switch_core_session_get_uuid(session));
-		switch_thread_rwlock_unlock(globals.log_path_lock);
-		if (path) {
-#ifdef _MSC_VER
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
-#else
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
-#endif
-				int wrote;
-				wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
-				(void)wrote;
-				close(fd);
-			} else {
-				char ebuf[512] = { 0 };
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error![%s]\n",
-						switch_strerror_r(errno, ebuf, sizeof(ebuf)));
-			}
-		}
+		switch_safe_free(id);
 	}
 
-  success:
 	status = SWITCH_STATUS_SUCCESS;
 
   error:
-	if (curl_handle) {
-		switch_curl_easy_cleanup(curl_handle);
-	}
-	if (headers) {
-		switch_curl_slist_free_all(headers);
-	}
-	if (slist) {
-		switch_curl_slist_free_all(slist);
-	}
-	if (curl_xml_text != xml_text) {
-		switch_safe_free(curl_xml_text);
-	}
 	switch_safe_free(xml_text);
 	switch_safe_free(path);
 	switch_xml_free(cdr);
@@ -471,6 +468,24 @@ static void event_handler(switch_event_t *event)
 	}
 }
 
+#define XML_CDR_SYNTAX "status"
+SWITCH_STANDARD_API(xml_cdr_api_function)
+{
+	if (zstr(cmd) || strcasecmp(cmd, "status")) {
+		stream->write_function(stream, "-USAGE: %s\n", XML_CDR_SYNTAX);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!globals.queue) {
+		stream->write_function(stream, "-ERR no urls configured\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_curl_queue_status(globals.queue, stream);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_state_handler_table_t state_handlers = {
 	/*.on_init */ NULL,
 	/*.on_routing */ NULL,
@@ -490,6 +505,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 	char *cf = "xml_cdr.conf";
 	switch_xml_t cfg, xml, settings, param;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_api_interface_t *api_interface;
 
 	/* test global state handlers */
 	switch_core_add_state_handler(&state_handlers);
@@ -510,8 +526,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 	globals.pool = pool;
 	globals.auth_scheme = CURLAUTH_BASIC;
 
+	globals.batch_size = 1;
+	globals.max_concurrent = 1;
+	globals.queue_capacity = 1000;
+	globals.max_delay = 300;
+
 	switch_thread_rwlock_create(&globals.log_path_lock, pool);
-	switch_mutex_init(&globals.url_index_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
 	/* parse the config */
 	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
@@ -618,6 +638,20 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 				}
 			} else if (!strcasecmp(var, "cookie-file")) {
 				globals.cookie_file = switch_core_strdup(globals.pool, val);
+			} else if (!strcasecmp(var, "spool-dir") && !zstr(val)) {
+				if (switch_is_file_path(val)) {
+					globals.spool_dir = switch_core_strdup(globals.pool, val);
+				} else {
+					globals.spool_dir = switch_core_sprintf(globals.pool, "%s%s%s", SWITCH_GLOBAL_dirs.storage_dir, SWITCH_PATH_SEPARATOR, val);
+				}
+			} else if (!strcasecmp(var, "batch-size") && !zstr(val)) {
+				globals.batch_size = switch_atoui(val);
+			} else if (!strcasecmp(var, "max-concurrent-posts") && !zstr(val)) {
+				globals.max_concurrent = switch_atoui(val);
+			} else if (!strcasecmp(var, "queue-capacity") && !zstr(val)) {
+				globals.queue_capacity = switch_atoui(val);
+			} else if (!strcasecmp(var, "max-delay") && !zstr(val)) {
+				globals.max_delay = switch_atoui(val);
 			}
 		}
 
@@ -642,6 +676,13 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 
 	switch_xml_free(xml);
 
+	if (globals.url_count && start_queue() != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't start the CDR delivery queue, CDRs will only be written to disk\n");
+	}
+
+	SWITCH_ADD_API(api_interface, "xml_cdr", "XML CDR delivery status", xml_cdr_api_function, XML_CDR_SYNTAX);
+	switch_console_set_complete("add xml_cdr status");
+
 	return status;
 }
 
@@ -650,12 +691,15 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown)
 
 	globals.shutdown = 1;
 
+	/* no more CDRs may be pushed once the queue is gone */
+	switch_core_remove_state_handler(&state_handlers);
+	switch_event_unbind(&globals.node);
+
+	switch_curl_queue_destroy(&globals.queue);
+
 	switch_safe_free(globals.log_dir);
 	switch_safe_free(globals.err_log_dir);
 
-	switch_event_unbind(&globals.node);
-	switch_core_remove_state_handler(&state_handlers);
-
 	switch_thread_rwlock_destroy(globals.log_path_lock);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -1814,6 +1814,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	runtime.max_db_handles = 50;
 	runtime.db_handle_timeout = 5000000;
 	runtime.event_heartbeat_interval = 20;
+	runtime.file_async_io_threads = SWITCH_DEFAULT_FILE_ASYNC_IO_THREADS;
+	runtime.codec_pool_size = SWITCH_DEFAULT_CODEC_POOL_SIZE;
+	runtime.media_bug_worker_threads = SWITCH_DEFAULT_MEDIA_BUG_WORKER_THREADS;
+	runtime.dtls_handshake_threads = SWITCH_DEFAULT_DTLS_HANDSHAKE_THREADS;
 
 	runtime.runlevel++;
 	runtime.dummy_cng_frame.data = runtime.dummy_data;
@@ -1897,6 +1901,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_thread_rwlock_create(&runtime.global_var_rwlock, runtime.memory_pool);
 	switch_core_set_globals();
 	switch_core_session_init(runtime.memory_pool);
+	switch_core_file_cache_init(runtime.memory_pool);
+	switch_core_file_async_io_init(runtime.memory_pool);
+	switch_core_codec_pool_init(runtime.memory_pool);
+	switch_core_media_bug_workers_init(runtime.memory_pool);
+	switch_core_g711_init();
+	switch_core_resample_init(runtime.memory_pool);
 	switch_event_create_plain(&runtime.global_vars, SWITCH_EVENT_CHANNEL_DATA);
 	switch_core_hash_init_case(&runtime.mime_types, SWITCH_FALSE);
 	switch_core_hash_init_case(&runtime.mime_type_exts, SWITCH_FALSE);
@@ -2381,8 +2391,60 @@ static void switch_load_core_config(const char *file)
 					}
 				} else if (!strcasecmp(var, "max-audio-channels") && !zstr(val)) {
 					switch_core_max_audio_channels(atoi(val));
+				} else if (!strcasecmp(var, "file-cache-size") && !zstr(val)) {
+					long tmp = atol(val);
+
+					if (tmp >= 0) {
+						runtime.file_cache_size = (switch_size_t) tmp * 1024 * 1024;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "file-cache-size must be a number of megabytes\n");
+					}
+				} else if (!strcasecmp(var, "file-cache-max-file-size") && !zstr(val)) {
+					long tmp = atol(val);
+
+					if (tmp > 0) {
+						runtime.file_cache_max_file_size = (switch_size_t) tmp * 1024;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "file-cache-max-file-size must be a positive number of kilobytes\n");
+					}
+				} else if (!strcasecmp(var, "file-async-io")) {
+					runtime.file_async_io = switch_true(val);
+				} else if (!strcasecmp(var, "file-async-io-threads") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp > 0 && tmp < 65) {
+						runtime.file_async_io_threads = (uint32_t) tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "file-async-io-threads must be between 1 and 64\n");
+					}
+				} else if (!strcasecmp(var, "codec-pool-size") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp >= 0) {
+						runtime.codec_pool_size = (uint32_t) tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "codec-pool-size must be 0 or more\n");
+					}
+				} else if (!strcasecmp(var, "media-bug-worker-threads") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp > 0 && tmp < 65) {
+						runtime.media_bug_worker_threads = (uint32_t) tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "media-bug-worker-threads must be between 1 and 64\n");
+					}
+				} else if (!strcasecmp(var, "dtls-handshake-threads") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp >= 0 && tmp < 65) {
+						runtime.dtls_handshake_threads = (uint32_t) tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dtls-handshake-threads must be between 0 and 64\n");
+					}
 				}
 			}
+
+			switch_core_file_cache_set_limits(runtime.file_cache_size, runtime.file_cache_max_file_size);
 		}
 
 		if (runtime.event_channel_key_separator == NULL) {
@@ -3043,6 +3105,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Clean up modules.\n");
 
 	switch_loadable_module_shutdown();
+	switch_core_file_cache_destroy();
+	switch_core_file_async_io_destroy();
+	switch_core_codec_pool_destroy();
+	switch_core_media_bug_workers_destroy();
+	switch_core_resample_destroy();
 
 	switch_curl_destroy();
 
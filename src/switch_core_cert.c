@@ -36,6 +36,24 @@ static switch_mutex_t **ssl_mutexes;
 static switch_memory_pool_t *ssl_pool = NULL;
 static int ssl_count = 0;
 
+/* Local certificate fingerprints, so each new media leg does not re-read and re-hash the PEM.
+ * An entry is only used while the file keeps the modification time and size it was hashed at. */
+#define FP_CACHE_SIZE 8
+
+typedef struct fp_cache_entry_s {
+	char path[1024];
+	char type[32];
+	time_t mtime;
+	off_t size;
+	dtls_fingerprint_t fp;
+} fp_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	fp_cache_entry_t entries[FP_CACHE_SIZE];
+	int next;
+} fp_cache;
+
 #if OPENSSL_VERSION_NUMBER <= 0x10100000
 
 static inline void switch_ssl_ssl_lock_callback(int mode, int type, char *file, int line)
@@ -73,6 +91,9 @@ SWITCH_DECLARE(void) switch_ssl_init_ssl_locks(void)
 			switch_assert(ssl_mutexes[i] != NULL);
 		}
 
+		memset(&fp_cache, 0, sizeof(fp_cache));
+		switch_mutex_init(&fp_cache.mutex, SWITCH_MUTEX_NESTED, ssl_pool);
+
 #if OPENSSL_VERSION_NUMBER <= 0x10100000
 		CRYPTO_THREADID_set_callback(switch_ssl_ssl_thread_id);
 		CRYPTO_set_locking_callback((void (*)(int, int, const char*, int))switch_ssl_ssl_lock_callback);
@@ -99,6 +120,7 @@ SWITCH_DECLARE(void) switch_ssl_destroy_ssl_locks(void)
 	}
 
 	if (ssl_pool) {
+		fp_cache.mutex = NULL;
 		switch_core_destroy_memory_pool(&ssl_pool);
 	}
 }
@@ -205,12 +227,76 @@ SWITCH_DECLARE(int) switch_core_cert_extract_fingerprint(X509* x509, dtls_finger
 
 }
 
+static int fp_cache_find(const char *path, struct stat *st, dtls_fingerprint_t *fp)
+{
+	int i, r = 0;
+
+	if (!fp_cache.mutex || zstr(fp->type)) {
+		return 0;
+	}
+
+	switch_mutex_lock(fp_cache.mutex);
+
+	for (i = 0; i < FP_CACHE_SIZE; i++) {
+		fp_cache_entry_t *entry = &fp_cache.entries[i];
+
+		if (entry->fp.len && entry->mtime == st->st_mtime && entry->size == st->st_size &&
+			!strcmp(entry->path, path) && !strcmp(entry->type, fp->type)) {
+			fp->len = entry->fp.len;
+			memcpy(fp->data, entry->fp.data, sizeof(fp->data));
+			memcpy(fp->str, entry->fp.str, sizeof(fp->str));
+			r = 1;
+			break;
+		}
+	}
+
+	switch_mutex_unlock(fp_cache.mutex);
+
+	return r;
+}
+
+static void fp_cache_add(const char *path, struct stat *st, dtls_fingerprint_t *fp)
+{
+	fp_cache_entry_t *entry;
+	int i;
+
+	if (!fp_cache.mutex || zstr(fp->type) || !fp->len || strlen(path) >= sizeof(entry->path) || strlen(fp->type) >= sizeof(entry->type)) {
+		return;
+	}
+
+	switch_mutex_lock(fp_cache.mutex);
+
+	/* Reuse the slot of an older version of the same file before evicting round robin. */
+	for (i = 0; i < FP_CACHE_SIZE; i++) {
+		if (!strcmp(fp_cache.entries[i].path, path) && !strcmp(fp_cache.entries[i].type, fp->type)) {
+			break;
+		}
+	}
+
+	if (i == FP_CACHE_SIZE) {
+		i = fp_cache.next;
+		fp_cache.next = (fp_cache.next + 1) % FP_CACHE_SIZE;
+	}
+
+	entry = &fp_cache.entries[i];
+	switch_copy_string(entry->path, path, sizeof(entry->path));
+	switch_copy_string(entry->type, fp->type, sizeof(entry->type));
+	entry->mtime = st->st_mtime;
+	entry->size = st->st_size;
+	entry->fp = *fp;
+	entry->fp.type = NULL;
+
+	switch_mutex_unlock(fp_cache.mutex);
+}
+
 SWITCH_DECLARE(int) switch_core_cert_gen_fingerprint(const char *prefix, dtls_fingerprint_t *fp)
 {
 	X509* x509 = NULL;
 	BIO* bio = NULL;
 	int ret = 0;
 	char *rsa;
+	struct stat st;
+	int have_stat;
 
 	rsa = switch_mprintf("%s%s%s.pem", SWITCH_GLOBAL_dirs.certs_dir, SWITCH_PATH_SEPARATOR, prefix);
 
@@ -219,6 +305,11 @@ SWITCH_DECLARE(int) switch_core_cert_gen_fingerprint(const char *prefix, dtls_fi
 		rsa = switch_mprintf("%s%s%s.crt", SWITCH_GLOBAL_dirs.certs_dir, SWITCH_PATH_SEPARATOR, prefix);
 	}
 
+	if ((have_stat = !stat(rsa, &st)) && fp_cache_find(rsa, &st, fp)) {
+		free(rsa);
+		return 1;
+	}
+
 	if (!(bio = BIO_new(BIO_s_file()))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "FP BIO ERR!\n");
 		goto end;
@@ -234,7 +325,9 @@ SWITCH_DECLARE(int) switch_core_cert_gen_fingerprint(const char *prefix, dtls_fi
 		goto end;
 	}
 
-	switch_core_cert_extract_fingerprint(x509, fp);
+	if (!switch_core_cert_extract_fingerprint(x509, fp) && have_stat) {
+		fp_cache_add(rsa, &st, fp);
+	}
 
 	ret = 1;
 
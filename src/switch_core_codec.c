@@ -38,6 +38,58 @@
 
 static uint32_t CODEC_ID = 1;
 
+#define MAX_CODEC_TRANSLATORS 32
+
+typedef struct {
+	char from[32];
+	char to[32];
+	uint32_t rate;
+	switch_core_codec_translate_func_t func;
+} codec_translator_t;
+
+static codec_translator_t TRANSLATORS[MAX_CODEC_TRANSLATORS];
+static int TRANSLATOR_COUNT = 0;
+
+#define CODEC_POOL_ENTRY_KEY "__codec_pool_entry"
+
+/* Handles of implementations with a reset function live in their own memory pool.
+   On destroy the handle is reset and parked here instead, keyed by what its init was given. */
+typedef struct codec_pool_entry_s {
+	const switch_codec_interface_t *codec_interface;
+	const switch_codec_implementation_t *implementation;
+	uint32_t init_flags;
+	char *key_fmtp;
+	switch_codec_settings_t settings;
+	uint32_t flags;
+	char *fmtp_in;
+	char *fmtp_out;
+	void *private_info;
+	switch_mutex_t *mutex;
+	switch_memory_pool_t *pool;
+	struct codec_pool_entry_s *next;
+} codec_pool_entry_t;
+
+typedef struct codec_pool_bucket_s {
+	const switch_codec_implementation_t *implementation;
+	uint32_t init_flags;
+	char *key_fmtp;
+	switch_codec_settings_t settings;
+	codec_pool_entry_t *head;
+	uint32_t count;
+	struct codec_pool_bucket_s *next;
+} codec_pool_bucket_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	codec_pool_bucket_t *buckets;
+	uint32_t idle;
+	uint64_t hits;
+	uint64_t misses;
+} CODEC_POOL;
+
+/* flags the core manages itself, they don't change what init builds */
+#define CODEC_POOL_KEY_FLAGS(_flags) ((_flags) & ~(SWITCH_CODEC_FLAG_FREE_POOL | SWITCH_CODEC_FLAG_READY))
+
 SWITCH_DECLARE(uint32_t) switch_core_codec_next_id(void)
 {
 	return CODEC_ID++;
@@ -631,12 +683,284 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_reset(switch_codec_t *codec)
 {
 	switch_assert(codec != NULL);
 
+	if (codec->implementation->reset && codec->implementation->reset(codec) == SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
 	codec->implementation->destroy(codec);
 	codec->implementation->init(codec, codec->flags, NULL);
 
 	return SWITCH_STATUS_SUCCESS;
 }
 
+void switch_core_codec_pool_init(switch_memory_pool_t *pool)
+{
+	memset(&CODEC_POOL, 0, sizeof(CODEC_POOL));
+	switch_mutex_init(&CODEC_POOL.mutex, SWITCH_MUTEX_NESTED, pool);
+}
+
+void switch_core_codec_pool_destroy(void)
+{
+	if (CODEC_POOL.mutex) {
+		switch_core_codec_pool_flush(NULL);
+		CODEC_POOL.mutex = NULL;
+	}
+}
+
+static switch_bool_t codec_pool_key_match(const switch_codec_implementation_t *implementation, uint32_t init_flags, const char *fmtp,
+										  const switch_codec_settings_t *settings, const codec_pool_bucket_t *bucket)
+{
+	return (bucket->implementation == implementation && bucket->init_flags == init_flags &&
+			!strcmp(switch_str_nil(bucket->key_fmtp), switch_str_nil(fmtp)) &&
+			!memcmp(&bucket->settings, settings, sizeof(*settings))) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void codec_pool_destroy_entry(codec_pool_entry_t *entry)
+{
+	switch_codec_t codec = { 0 };
+	switch_memory_pool_t *pool = entry->pool;
+
+	codec.codec_interface = (switch_codec_interface_t *) entry->codec_interface;
+	codec.implementation = entry->implementation;
+	codec.fmtp_in = entry->fmtp_in;
+	codec.fmtp_out = entry->fmtp_out;
+	codec.flags = entry->flags;
+	codec.memory_pool = pool;
+	codec.private_info = entry->private_info;
+	codec.mutex = entry->mutex;
+
+	entry->implementation->destroy(&codec);
+
+	/* the entry lives in this pool too */
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* Hand a parked handle matching the init arguments to codec, already reset. */
+static switch_status_t codec_pool_take(switch_codec_t *codec, const switch_codec_implementation_t *implementation, uint32_t flags,
+									   const char *fmtp, const switch_codec_settings_t *settings)
+{
+	codec_pool_bucket_t *bucket, *last = NULL;
+	codec_pool_entry_t *entry = NULL;
+	uint32_t init_flags = CODEC_POOL_KEY_FLAGS(flags);
+
+	if (!CODEC_POOL.mutex) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(CODEC_POOL.mutex);
+	for (bucket = CODEC_POOL.buckets; bucket; bucket = bucket->next) {
+		if (codec_pool_key_match(implementation, init_flags, fmtp, settings, bucket)) {
+			if ((entry = bucket->head)) {
+				bucket->head = entry->next;
+				entry->next = NULL;
+				bucket->count--;
+				CODEC_POOL.idle--;
+			}
+
+			if (!bucket->count) {
+				if (last) {
+					last->next = bucket->next;
+				} else {
+					CODEC_POOL.buckets = bucket->next;
+				}
+				switch_safe_free(bucket->key_fmtp);
+				free(bucket);
+			}
+			break;
+		}
+		last = bucket;
+	}
+
+	if (entry) {
+		CODEC_POOL.hits++;
+	} else {
+		CODEC_POOL.misses++;
+	}
+	switch_mutex_unlock(CODEC_POOL.mutex);
+
+	if (!entry) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	codec->memory_pool = entry->pool;
+	codec->flags = entry->flags;
+	codec->fmtp_in = entry->fmtp_in;
+	codec->fmtp_out = entry->fmtp_out;
+	codec->private_info = entry->private_info;
+	codec->mutex = entry->mutex;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Park a reset handle, SWITCH_STATUS_FALSE when its key is full and it has to be destroyed. */
+static switch_status_t codec_pool_park(switch_codec_t *codec, codec_pool_entry_t *entry)
+{
+	codec_pool_bucket_t *bucket;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	if (!CODEC_POOL.mutex) {
+		return status;
+	}
+
+	entry->flags = codec->flags;
+	entry->fmtp_in = codec->fmtp_in;
+	entry->fmtp_out = codec->fmtp_out;
+	entry->private_info = codec->private_info;
+	entry->mutex = codec->mutex;
+
+	switch_mutex_lock(CODEC_POOL.mutex);
+	for (bucket = CODEC_POOL.buckets; bucket; bucket = bucket->next) {
+		if (codec_pool_key_match(entry->implementation, entry->init_flags, entry->key_fmtp, &entry->settings, bucket)) {
+			break;
+		}
+	}
+
+	if (!bucket) {
+		switch_zmalloc(bucket, sizeof(*bucket));
+		bucket->implementation = entry->implementation;
+		bucket->init_flags = entry->init_flags;
+		bucket->key_fmtp = entry->key_fmtp ? strdup(entry->key_fmtp) : NULL;
+		bucket->settings = entry->settings;
+		bucket->next = CODEC_POOL.buckets;
+		CODEC_POOL.buckets = bucket;
+	}
+
+	if (bucket->count < runtime.codec_pool_size) {
+		entry->next = bucket->head;
+		bucket->head = entry;
+		bucket->count++;
+		CODEC_POOL.idle++;
+		status = SWITCH_STATUS_SUCCESS;
+	}
+	switch_mutex_unlock(CODEC_POOL.mutex);
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_core_codec_pool_flush(const switch_codec_interface_t *codec_interface)
+{
+	codec_pool_bucket_t *bucket, *next_bucket, *last = NULL;
+	codec_pool_entry_t *entry, *next_entry, *doomed = NULL;
+
+	if (!CODEC_POOL.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(CODEC_POOL.mutex);
+	for (bucket = CODEC_POOL.buckets; bucket; bucket = next_bucket) {
+		next_bucket = bucket->next;
+
+		if (bucket->head && codec_interface && bucket->head->codec_interface != codec_interface) {
+			last = bucket;
+			continue;
+		}
+
+		for (entry = bucket->head; entry; entry = next_entry) {
+			next_entry = entry->next;
+			entry->next = doomed;
+			doomed = entry;
+			CODEC_POOL.idle--;
+		}
+
+		if (last) {
+			last->next = next_bucket;
+		} else {
+			CODEC_POOL.buckets = next_bucket;
+		}
+		switch_safe_free(bucket->key_fmtp);
+		free(bucket);
+	}
+	switch_mutex_unlock(CODEC_POOL.mutex);
+
+	for (entry = doomed; entry; entry = next_entry) {
+		next_entry = entry->next;
+		codec_pool_destroy_entry(entry);
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_codec_pool_stats(uint32_t *idle, uint64_t *hits, uint64_t *misses)
+{
+	if (!CODEC_POOL.mutex) {
+		if (idle) *idle = 0;
+		if (hits) *hits = 0;
+		if (misses) *misses = 0;
+		return;
+	}
+
+	switch_mutex_lock(CODEC_POOL.mutex);
+	if (idle) *idle = CODEC_POOL.idle;
+	if (hits) *hits = CODEC_POOL.hits;
+	if (misses) *misses = CODEC_POOL.misses;
+	switch_mutex_unlock(CODEC_POOL.mutex);
+}
+
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_add_translator(const char *from_iananame, const char *to_iananame, uint32_t rate,
+																 switch_core_codec_translate_func_t func)
+{
+	codec_translator_t *translator;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	int i;
+
+	switch_assert(from_iananame && to_iananame);
+
+	switch_mutex_lock(runtime.global_mutex);
+
+	for (i = 0; i < TRANSLATOR_COUNT; i++) {
+		translator = &TRANSLATORS[i];
+		if (translator->rate == rate && !strcasecmp(translator->from, from_iananame) && !strcasecmp(translator->to, to_iananame)) {
+			translator->func = func;
+			status = SWITCH_STATUS_SUCCESS;
+			goto end;
+		}
+	}
+
+	if (TRANSLATOR_COUNT == MAX_CODEC_TRANSLATORS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Too many codec translators, can't add %s->%s\n", from_iananame, to_iananame);
+		goto end;
+	}
+
+	translator = &TRANSLATORS[TRANSLATOR_COUNT];
+	switch_copy_string(translator->from, from_iananame, sizeof(translator->from));
+	switch_copy_string(translator->to, to_iananame, sizeof(translator->to));
+	translator->rate = rate;
+	translator->func = func;
+	TRANSLATOR_COUNT++;
+	status = SWITCH_STATUS_SUCCESS;
+
+  end:
+	switch_mutex_unlock(runtime.global_mutex);
+
+	return status;
+}
+
+SWITCH_DECLARE(switch_bool_t) switch_core_codec_find_translator(const switch_codec_implementation_t *from, const switch_codec_implementation_t *to,
+															   switch_core_codec_translate_func_t *func)
+{
+	switch_bool_t found = SWITCH_FALSE;
+	int i;
+
+	if (!from || !to || from->codec_type != SWITCH_CODEC_TYPE_AUDIO || to->codec_type != SWITCH_CODEC_TYPE_AUDIO ||
+		from->actual_samples_per_second != to->actual_samples_per_second || from->number_of_channels != to->number_of_channels ||
+		!from->samples_per_packet || !to->samples_per_packet ||
+		from->encoded_bytes_per_packet / from->samples_per_packet != to->encoded_bytes_per_packet / to->samples_per_packet) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(runtime.global_mutex);
+	for (i = 0; i < TRANSLATOR_COUNT; i++) {
+		const codec_translator_t *translator = &TRANSLATORS[i];
+
+		if (translator->rate == to->actual_samples_per_second && !strcasecmp(translator->from, from->iananame) && !strcasecmp(translator->to, to->iananame)) {
+			*func = translator->func;
+			found = SWITCH_TRUE;
+			break;
+		}
+	}
+	switch_mutex_unlock(runtime.global_mutex);
+
+	return found;
+}
 
 SWITCH_DECLARE(switch_status_t) switch_core_codec_copy(switch_codec_t *codec, switch_codec_t *new_codec,
 													   const switch_codec_settings_t *codec_settings, switch_memory_pool_t *pool)
@@ -729,14 +1053,39 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_init_with_bitrate(switch_codec
 
 	if (implementation) {
 		switch_status_t status;
+		switch_codec_settings_t settings = { { 0 } };
+		switch_bool_t poolable = (implementation->reset && runtime.codec_pool_size) ? SWITCH_TRUE : SWITCH_FALSE;
+
 		codec->codec_interface = codec_interface;
 		codec->implementation = implementation;
+
+		if (poolable) {
+			if (codec_settings) {
+				settings = *codec_settings;
+			}
+
+			if (codec_pool_take(codec, implementation, flags, fmtp, &settings) == SWITCH_STATUS_SUCCESS) {
+				if (implementation->reset(codec) == SWITCH_STATUS_SUCCESS) {
+					switch_set_flag(codec, SWITCH_CODEC_FLAG_READY);
+					return SWITCH_STATUS_SUCCESS;
+				}
+
+				implementation->destroy(codec);
+				switch_core_destroy_memory_pool(&codec->memory_pool);
+				codec->private_info = NULL;
+				codec->fmtp_in = codec->fmtp_out = NULL;
+				codec->mutex = NULL;
+			}
+		}
+
 		codec->flags = flags;
 
-		if (pool) {
+		/* a handle that may outlive this init in the pool can't borrow the caller's pool */
+		if (pool && !poolable) {
 			codec->memory_pool = pool;
 		} else {
 			if ((status = switch_core_new_memory_pool(&codec->memory_pool)) != SWITCH_STATUS_SUCCESS) {
+				UNPROTECT_INTERFACE(codec_interface);
 				return status;
 			}
 			switch_set_flag(codec, SWITCH_CODEC_FLAG_FREE_POOL);
@@ -748,6 +1097,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_init_with_bitrate(switch_codec
 
 		implementation->init(codec, flags, codec_settings);
 		switch_mutex_init(&codec->mutex, SWITCH_MUTEX_NESTED, codec->memory_pool);
+
+		if (poolable) {
+			codec_pool_entry_t *entry = switch_core_alloc(codec->memory_pool, sizeof(*entry));
+
+			entry->codec_interface = codec_interface;
+			entry->implementation = implementation;
+			entry->init_flags = CODEC_POOL_KEY_FLAGS(flags);
+			entry->key_fmtp = codec->fmtp_in ? switch_core_strdup(codec->memory_pool, codec->fmtp_in) : NULL;
+			entry->settings = settings;
+			entry->pool = codec->memory_pool;
+			switch_core_memory_pool_set_data(codec->memory_pool, CODEC_POOL_ENTRY_KEY, entry);
+		}
+
 		switch_set_flag(codec, SWITCH_CODEC_FLAG_READY);
 		return SWITCH_STATUS_SUCCESS;
 	} else {
@@ -939,6 +1301,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_destroy(switch_codec_t *codec)
 {
 	switch_mutex_t *mutex = NULL;
 	switch_memory_pool_t *pool = NULL;
+	codec_pool_entry_t *entry = NULL;
 	int free_pool = 0;
 
 	switch_assert(codec != NULL);
@@ -957,14 +1320,32 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_destroy(switch_codec_t *codec)
 
 	if (switch_test_flag(codec, SWITCH_CODEC_FLAG_FREE_POOL)) {
 		free_pool = 1;
+
+		if (codec->implementation->reset && runtime.codec_pool_size) {
+			entry = switch_core_memory_pool_get_data(pool, CODEC_POOL_ENTRY_KEY);
+		}
 	}
 
-	codec->implementation->destroy(codec);
+	if (entry && codec->implementation->reset(codec) != SWITCH_STATUS_SUCCESS) {
+		entry = NULL;
+	}
+
+	if (!entry) {
+		codec->implementation->destroy(codec);
+	}
 
 	UNPROTECT_INTERFACE(codec->codec_interface);
 
 	if (mutex) switch_mutex_unlock(mutex);
 
+	if (entry) {
+		if (codec_pool_park(codec, entry) == SWITCH_STATUS_SUCCESS) {
+			free_pool = 0;
+		} else {
+			codec->implementation->destroy(codec);
+		}
+	}
+
 	if (free_pool) {
 		switch_core_destroy_memory_pool(&pool);
 	}
@@ -62,6 +62,786 @@ static switch_status_t get_file_size(switch_file_handle_t *fh, const char **stri
 	return status;
 }
 
+/* Process wide cache of fully decoded (and resampled) audio files.
+   Entries are immutable once inserted and shared between handles by refcount. */
+
+struct switch_file_cache_entry {
+	char *key;
+	int16_t *data;
+	switch_size_t samples;
+	switch_size_t bytes;
+	uint32_t rate;
+	uint32_t channels;
+	int refs;
+	int evicted;
+	struct switch_file_cache_entry *prev;
+	struct switch_file_cache_entry *next;
+};
+
+typedef struct switch_file_cache_entry switch_file_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	/* keys somebody is decoding right now */
+	switch_hash_t *loading;
+	switch_file_cache_entry_t *head;
+	switch_file_cache_entry_t *tail;
+	switch_size_t bytes;
+	switch_size_t max_bytes;
+	switch_size_t max_file_bytes;
+	uint32_t entries;
+	uint64_t hits;
+	uint64_t misses;
+} file_cache;
+
+static void file_cache_entry_free(switch_file_cache_entry_t *entry)
+{
+	switch_safe_free(entry->data);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+static void file_cache_unlink(switch_file_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		file_cache.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		file_cache.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void file_cache_link_head(switch_file_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = file_cache.head;
+
+	if (file_cache.head) {
+		file_cache.head->prev = entry;
+	}
+
+	file_cache.head = entry;
+
+	if (!file_cache.tail) {
+		file_cache.tail = entry;
+	}
+}
+
+/* must be called with file_cache.mutex held */
+static void file_cache_evict(switch_file_cache_entry_t *entry)
+{
+	switch_core_hash_delete(file_cache.hash, entry->key);
+	file_cache_unlink(entry);
+	file_cache.bytes -= entry->bytes;
+	file_cache.entries--;
+	entry->evicted = 1;
+
+	if (!entry->refs) {
+		file_cache_entry_free(entry);
+	}
+}
+
+static switch_bool_t file_cache_key(switch_file_handle_t *fh, const char *path, uint32_t channels, uint32_t rate, int force_channels, char *buf, switch_size_t len)
+{
+	struct stat st;
+	const char *val;
+
+	if (!file_cache.mutex || !file_cache.max_bytes) {
+		return SWITCH_FALSE;
+	}
+
+	if (fh->params && (val = switch_event_get_header(fh->params, "file_cache")) && switch_false(val)) {
+		return SWITCH_FALSE;
+	}
+
+	if (stat(path, &st) || (switch_size_t)st.st_size > file_cache.max_file_bytes) {
+		return SWITCH_FALSE;
+	}
+
+	switch_snprintf(buf, len, "%s;%" SWITCH_INT64_T_FMT ";%" SWITCH_INT64_T_FMT ";%u;%u;%d",
+					path, (int64_t) st.st_mtime, (int64_t) st.st_size, rate, channels, force_channels);
+
+	return SWITCH_TRUE;
+}
+
+/* On a miss the caller either gets to decode the file (SWITCH_STATUS_NOTFOUND) and must end with
+   file_cache_populate() or file_cache_unclaim(), or somebody else already is (SWITCH_STATUS_INUSE)
+   and the caller should just read the file itself rather than decode it a second time. */
+static switch_status_t file_cache_attach(switch_file_handle_t *fh, const char *key)
+{
+	switch_file_cache_entry_t *entry;
+	switch_status_t status = SWITCH_STATUS_NOTFOUND;
+
+	switch_mutex_lock(file_cache.mutex);
+	if ((entry = switch_core_hash_find(file_cache.hash, key))) {
+		entry->refs++;
+		file_cache.hits++;
+
+		if (entry != file_cache.head) {
+			file_cache_unlink(entry);
+			file_cache_link_head(entry);
+		}
+	} else {
+		file_cache.misses++;
+
+		if (switch_core_hash_find(file_cache.loading, key)) {
+			status = SWITCH_STATUS_INUSE;
+		} else {
+			switch_core_hash_insert(file_cache.loading, key, &file_cache);
+		}
+	}
+	switch_mutex_unlock(file_cache.mutex);
+
+	if (!entry) {
+		return status;
+	}
+
+	fh->cache_entry = entry;
+	fh->cache_pos = 0;
+	fh->samplerate = fh->native_rate = entry->rate;
+	fh->channels = fh->real_channels = entry->channels;
+	fh->samples = (unsigned int) entry->samples;
+	fh->seekable = 1;
+	fh->pre_buffer_datalen = 0;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void file_cache_unclaim(const char *key)
+{
+	switch_mutex_lock(file_cache.mutex);
+	switch_core_hash_delete(file_cache.loading, key);
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+static void file_cache_release(switch_file_handle_t *fh)
+{
+	switch_file_cache_entry_t *entry = fh->cache_entry;
+
+	if (!entry) {
+		return;
+	}
+
+	fh->cache_entry = NULL;
+
+	switch_mutex_lock(file_cache.mutex);
+	if (!--entry->refs && entry->evicted) {
+		file_cache_entry_free(entry);
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+/* Decode the whole file through the normal read path, publish it and switch the handle over to it.
+   On any failure the handle is rewound and keeps reading from the format module. */
+static void file_cache_populate(switch_file_handle_t *fh, const char *key)
+{
+	switch_file_cache_entry_t *entry, *existing;
+	int16_t *data = NULL;
+	switch_size_t used = 0, alloced, want, max_samples;
+	uint32_t channels = fh->channels;
+	unsigned int pos = 0;
+
+	if (!fh->samples || !fh->native_rate || !fh->file_interface->file_seek || switch_test_flag(fh, SWITCH_FILE_NATIVE) || fh->max_samples) {
+		file_cache_unclaim(key);
+		return;
+	}
+
+	max_samples = file_cache.max_file_bytes / 2 / channels;
+	alloced = (switch_size_t)((uint64_t) fh->samples * fh->samplerate / fh->native_rate) + 1024;
+
+	if (alloced > max_samples) {
+		file_cache_unclaim(key);
+		return;
+	}
+
+	switch_zmalloc(data, alloced * 2 * channels);
+
+	for (;;) {
+		if (alloced - used < 1024) {
+			int16_t *tmp;
+
+			if (alloced >= max_samples) {
+				goto fail;
+			}
+
+			alloced = alloced * 2 > max_samples ? max_samples : alloced * 2;
+			tmp = realloc(data, alloced * 2 * channels);
+			switch_assert(tmp);
+			data = tmp;
+		}
+
+		want = 1024;
+
+		if (switch_core_file_read(fh, data + (used * channels), &want) != SWITCH_STATUS_SUCCESS || !want) {
+			break;
+		}
+
+		used += want;
+	}
+
+	if (!used) {
+		goto fail;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->key = strdup(key);
+	entry->data = data;
+	entry->samples = used;
+	entry->bytes = used * 2 * channels;
+	entry->rate = fh->samplerate;
+	entry->channels = channels;
+	entry->refs = 1;
+
+	switch_mutex_lock(file_cache.mutex);
+	switch_core_hash_delete(file_cache.loading, key);
+
+	if ((existing = switch_core_hash_find(file_cache.hash, key))) {
+		/* somebody else decoded the same file meanwhile */
+		existing->refs++;
+		switch_mutex_unlock(file_cache.mutex);
+		file_cache_entry_free(entry);
+		entry = existing;
+	} else if (entry->bytes > file_cache.max_bytes) {
+		/* not worth evicting the whole cache for, serve it privately */
+		entry->evicted = 1;
+		switch_mutex_unlock(file_cache.mutex);
+	} else {
+		while (file_cache.tail && file_cache.bytes + entry->bytes > file_cache.max_bytes) {
+			file_cache_evict(file_cache.tail);
+		}
+
+		switch_core_hash_insert(file_cache.hash, entry->key, entry);
+		file_cache_link_head(entry);
+		file_cache.bytes += entry->bytes;
+		file_cache.entries++;
+		switch_mutex_unlock(file_cache.mutex);
+	}
+
+	fh->file_interface->file_close(fh);
+
+	if (fh->pre_buffer) {
+		switch_buffer_destroy(&fh->pre_buffer);
+	}
+
+	if (fh->buffer) {
+		switch_buffer_destroy(&fh->buffer);
+	}
+
+	switch_resample_destroy(&fh->resampler);
+	switch_clear_flag_locked(fh, SWITCH_FILE_DONE);
+	switch_clear_flag_locked(fh, SWITCH_FILE_BUFFER_DONE);
+
+	fh->samples_in = 0;
+	fh->cache_entry = entry;
+	fh->cache_pos = 0;
+	fh->native_rate = entry->rate;
+	fh->real_channels = entry->channels;
+	fh->cur_channels = 0;
+	fh->samples = (unsigned int) entry->samples;
+	fh->seekable = 1;
+
+	return;
+
+  fail:
+
+	file_cache_unclaim(key);
+	switch_safe_free(data);
+	switch_core_file_seek(fh, &pos, 0, SEEK_SET);
+	switch_clear_flag_locked(fh, SWITCH_FILE_DONE);
+	switch_clear_flag_locked(fh, SWITCH_FILE_BUFFER_DONE);
+	fh->samples_in = 0;
+}
+
+static switch_status_t file_cache_read(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_file_cache_entry_t *entry = fh->cache_entry;
+	switch_size_t want = *len;
+
+	if (fh->max_samples > 0 && fh->samples_in + want > (switch_size_t)fh->max_samples) {
+		want = fh->samples_in < (switch_size_t)fh->max_samples ? fh->max_samples - fh->samples_in : 0;
+	}
+
+	if (fh->cache_pos + want > entry->samples) {
+		want = entry->samples - fh->cache_pos;
+	}
+
+	if (!want) {
+		*len = 0;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(data, entry->data + (fh->cache_pos * entry->channels), want * 2 * entry->channels);
+	fh->cache_pos += want;
+	fh->samples_in += want;
+	*len = want;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t file_cache_seek(switch_file_handle_t *fh, unsigned int *cur_pos, int64_t samples, int whence)
+{
+	int64_t pos;
+
+	switch (whence) {
+	case SEEK_CUR:
+		pos = (int64_t) fh->cache_pos + samples;
+		break;
+	case SEEK_END:
+		pos = (int64_t) fh->cache_entry->samples + samples;
+		break;
+	default:
+		pos = samples;
+		break;
+	}
+
+	if (pos < 0) {
+		pos = 0;
+	} else if (pos > (int64_t) fh->cache_entry->samples) {
+		pos = (int64_t) fh->cache_entry->samples;
+	}
+
+	fh->cache_pos = (switch_size_t) pos;
+	fh->pos = pos;
+	*cur_pos = (unsigned int) pos;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_core_file_cache_init(switch_memory_pool_t *pool)
+{
+	memset(&file_cache, 0, sizeof(file_cache));
+	switch_mutex_init(&file_cache.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&file_cache.hash);
+	switch_core_hash_init(&file_cache.loading);
+	file_cache.max_file_bytes = SWITCH_DEFAULT_FILE_CACHE_MAX_FILE_SIZE;
+}
+
+void switch_core_file_cache_destroy(void)
+{
+	if (!file_cache.mutex) {
+		return;
+	}
+
+	switch_core_file_cache_flush();
+	switch_core_hash_destroy(&file_cache.hash);
+	switch_core_hash_destroy(&file_cache.loading);
+	file_cache.mutex = NULL;
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_set_limits(switch_size_t max_bytes, switch_size_t max_file_bytes)
+{
+	if (!file_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+	file_cache.max_bytes = max_bytes;
+
+	if (max_file_bytes) {
+		file_cache.max_file_bytes = max_file_bytes;
+	}
+
+	while (file_cache.tail && file_cache.bytes > file_cache.max_bytes) {
+		file_cache_evict(file_cache.tail);
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void)
+{
+	if (!file_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+	while (file_cache.tail) {
+		file_cache_evict(file_cache.tail);
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_stats(uint32_t *entries, switch_size_t *bytes, uint64_t *hits, uint64_t *misses)
+{
+	if (!file_cache.mutex || !file_cache.max_bytes) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+	if (entries) *entries = file_cache.entries;
+	if (bytes) *bytes = file_cache.bytes;
+	if (hits) *hits = file_cache.hits;
+	if (misses) *misses = file_cache.misses;
+	switch_mutex_unlock(file_cache.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Read-ahead / write-behind of file handles on a small shared pool of I/O threads.
+   The media thread only touches the in-memory buffer; a handle is queued to the pool
+   whenever its buffer needs refilling (read) or flushing (write). */
+
+#define FILE_ASYNC_CHUNK_SAMPLES 1024
+#define FILE_ASYNC_READ_CHUNKS 4
+#define FILE_ASYNC_WRITE_SECONDS 10
+
+struct switch_file_async_io {
+	switch_file_handle_t *fh;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_buffer_t *buffer;
+	unsigned char *chunk;
+	switch_size_t chunk_samples;
+	switch_size_t sample_bytes;
+	switch_size_t high_water;
+	switch_size_t max_bytes;
+	int write;
+	int busy;
+	int eof;
+	int error;
+};
+
+typedef struct switch_file_async_io switch_file_async_io_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_memory_pool_t *pool;
+	switch_queue_t *queue;
+	switch_thread_t **threads;
+	uint32_t thread_count;
+} file_io;
+
+static void file_async_do_read(switch_file_async_io_t *aio)
+{
+	switch_file_handle_t *fh = aio->fh;
+	switch_status_t status;
+	switch_size_t rlen;
+
+	for (;;) {
+		switch_mutex_lock(aio->mutex);
+		if (aio->eof || switch_buffer_inuse(aio->buffer) >= aio->high_water) {
+			switch_mutex_unlock(aio->mutex);
+			break;
+		}
+		switch_mutex_unlock(aio->mutex);
+
+		rlen = aio->chunk_samples;
+
+		if ((status = fh->file_interface->file_read(fh, aio->chunk, &rlen)) == SWITCH_STATUS_BREAK) {
+			/* nothing available yet, try again on the next refill */
+			break;
+		}
+
+		switch_mutex_lock(aio->mutex);
+		if (status != SWITCH_STATUS_SUCCESS || !rlen) {
+			aio->eof = 1;
+		} else {
+			switch_buffer_write(aio->buffer, aio->chunk, rlen * aio->sample_bytes);
+		}
+		switch_mutex_unlock(aio->mutex);
+	}
+}
+
+static void file_async_do_write(switch_file_async_io_t *aio)
+{
+	switch_file_handle_t *fh = aio->fh;
+	switch_size_t blen;
+
+	for (;;) {
+		switch_mutex_lock(aio->mutex);
+		blen = switch_buffer_read(aio->buffer, aio->chunk, aio->chunk_samples * aio->sample_bytes);
+		switch_mutex_unlock(aio->mutex);
+
+		if (!blen) {
+			break;
+		}
+
+		blen /= aio->sample_bytes;
+
+		if (fh->file_interface->file_write(fh, aio->chunk, &blen) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_lock(aio->mutex);
+			aio->error = 1;
+			switch_buffer_zero(aio->buffer);
+			switch_mutex_unlock(aio->mutex);
+			break;
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC file_async_io_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop = NULL;
+
+	while (switch_queue_pop(file_io.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		switch_file_async_io_t *aio = (switch_file_async_io_t *) pop;
+
+		if (aio->write) {
+			file_async_do_write(aio);
+		} else {
+			file_async_do_read(aio);
+		}
+
+		switch_mutex_lock(aio->mutex);
+		aio->busy = 0;
+		switch_thread_cond_broadcast(aio->cond);
+		switch_mutex_unlock(aio->mutex);
+	}
+
+	return NULL;
+}
+
+static switch_status_t file_async_io_threads_start(void)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t i, count;
+
+	if (!file_io.mutex) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(file_io.mutex);
+
+	if (file_io.thread_count) {
+		goto end;
+	}
+
+	if (!(count = runtime.file_async_io_threads)) {
+		count = SWITCH_DEFAULT_FILE_ASYNC_IO_THREADS;
+	}
+
+	switch_queue_create(&file_io.queue, SWITCH_CORE_QUEUE_LEN, file_io.pool);
+	file_io.threads = switch_core_alloc(file_io.pool, sizeof(switch_thread_t *) * count);
+
+	for (i = 0; i < count; i++) {
+		switch_threadattr_t *thd_attr = NULL;
+
+		switch_threadattr_create(&thd_attr, file_io.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_IMPORTANT);
+
+		if (switch_thread_create(&file_io.threads[file_io.thread_count], thd_attr, file_async_io_thread, NULL, file_io.pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+
+		file_io.thread_count++;
+	}
+
+	if (!file_io.thread_count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to start file I/O threads\n");
+		status = SWITCH_STATUS_FALSE;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %u file I/O thread%s\n", file_io.thread_count, file_io.thread_count == 1 ? "" : "s");
+	}
+
+  end:
+
+	switch_mutex_unlock(file_io.mutex);
+
+	return status;
+}
+
+/* must be called with aio->mutex held */
+static void file_async_kick(switch_file_async_io_t *aio)
+{
+	if (aio->busy) {
+		return;
+	}
+
+	aio->busy = 1;
+
+	if (switch_queue_trypush(file_io.queue, aio) != SWITCH_STATUS_SUCCESS) {
+		aio->busy = 0;
+	}
+}
+
+static void file_async_quiesce(switch_file_handle_t *fh)
+{
+	switch_file_async_io_t *aio = fh->async_io;
+
+	if (!aio) {
+		return;
+	}
+
+	switch_mutex_lock(aio->mutex);
+	while (aio->busy) {
+		switch_thread_cond_wait(aio->cond, aio->mutex);
+	}
+	switch_mutex_unlock(aio->mutex);
+}
+
+static void file_async_start(switch_file_handle_t *fh)
+{
+	switch_file_async_io_t *aio;
+	switch_size_t chunk_bytes;
+	uint32_t channels = fh->real_channels > fh->channels ? fh->real_channels : fh->channels;
+	int asis = switch_test_flag(fh, SWITCH_FILE_NATIVE);
+
+	if (file_async_io_threads_start() != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	aio = switch_core_alloc(fh->memory_pool, sizeof(*aio));
+	aio->fh = fh;
+	aio->write = switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE) ? 1 : 0;
+	switch_mutex_init(&aio->mutex, SWITCH_MUTEX_NESTED, fh->memory_pool);
+	switch_thread_cond_create(&aio->cond, fh->memory_pool);
+
+	chunk_bytes = FILE_ASYNC_CHUNK_SAMPLES * 2 * (channels ? channels : 1);
+	aio->chunk = switch_core_alloc(fh->memory_pool, chunk_bytes);
+
+	if (asis) {
+		aio->sample_bytes = 1;
+		aio->chunk_samples = chunk_bytes;
+	} else {
+		aio->sample_bytes = 2 * (aio->write ? fh->channels : fh->real_channels);
+		aio->chunk_samples = FILE_ASYNC_CHUNK_SAMPLES;
+	}
+
+	if (aio->write) {
+		aio->high_water = aio->chunk_samples * aio->sample_bytes;
+		aio->max_bytes = (switch_size_t) (fh->native_rate ? fh->native_rate : 8000) * aio->sample_bytes * FILE_ASYNC_WRITE_SECONDS;
+	} else {
+		aio->high_water = aio->chunk_samples * aio->sample_bytes * FILE_ASYNC_READ_CHUNKS;
+	}
+
+	switch_buffer_create_dynamic(&aio->buffer, chunk_bytes, aio->high_water + chunk_bytes, 0);
+	fh->async_io = aio;
+	fh->async_underruns = 0;
+	fh->async_overruns = 0;
+
+	if (!aio->write) {
+		/* prime the read-ahead on the opening thread, the open itself already touched storage */
+		file_async_do_read(aio);
+	}
+}
+
+static void file_async_stop(switch_file_handle_t *fh)
+{
+	switch_file_async_io_t *aio = fh->async_io;
+
+	if (!aio) {
+		return;
+	}
+
+	file_async_quiesce(fh);
+
+	if (aio->write) {
+		file_async_do_write(aio);
+	}
+
+	switch_buffer_destroy(&aio->buffer);
+	fh->async_io = NULL;
+
+	if (fh->async_underruns || fh->async_overruns) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "File [%s] storage could not keep up: %u underrun%s, %u overrun%s\n",
+						  fh->file_path, fh->async_underruns, fh->async_underruns == 1 ? "" : "s", fh->async_overruns, fh->async_overruns == 1 ? "" : "s");
+	}
+}
+
+static switch_status_t file_read_source(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_file_async_io_t *aio = fh->async_io;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_size_t bytes;
+
+	if (!aio) {
+		return fh->file_interface->file_read(fh, data, len);
+	}
+
+	switch_mutex_lock(aio->mutex);
+
+	if ((bytes = switch_buffer_read(aio->buffer, data, *len * aio->sample_bytes))) {
+		*len = bytes / aio->sample_bytes;
+	} else if (aio->eof) {
+		*len = 0;
+		status = SWITCH_STATUS_FALSE;
+	} else {
+		/* storage is behind, play silence rather than end the file early for callers that only know success or eof */
+		fh->async_underruns++;
+		memset(data, 0, *len * aio->sample_bytes);
+	}
+
+	if (!aio->eof && switch_buffer_inuse(aio->buffer) < aio->high_water) {
+		file_async_kick(aio);
+	}
+
+	switch_mutex_unlock(aio->mutex);
+
+	return status;
+}
+
+static switch_status_t file_write_sink(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_file_async_io_t *aio = fh->async_io;
+	switch_size_t bytes;
+
+	if (!aio) {
+		return fh->file_interface->file_write(fh, data, len);
+	}
+
+	bytes = *len * aio->sample_bytes;
+
+	switch_mutex_lock(aio->mutex);
+
+	if (aio->error) {
+		switch_mutex_unlock(aio->mutex);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (switch_buffer_inuse(aio->buffer) + bytes > aio->max_bytes) {
+		/* storage is hopelessly behind, lose the frame rather than block the media thread on it */
+		fh->async_overruns++;
+	} else {
+		switch_buffer_write(aio->buffer, data, bytes);
+	}
+
+	if (switch_buffer_inuse(aio->buffer) >= aio->high_water) {
+		file_async_kick(aio);
+	}
+
+	switch_mutex_unlock(aio->mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_core_file_async_io_init(switch_memory_pool_t *pool)
+{
+	memset(&file_io, 0, sizeof(file_io));
+	file_io.pool = pool;
+	switch_mutex_init(&file_io.mutex, SWITCH_MUTEX_NESTED, pool);
+}
+
+void switch_core_file_async_io_destroy(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	if (!file_io.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(file_io.mutex);
+
+	for (i = 0; i < file_io.thread_count; i++) {
+		switch_queue_push(file_io.queue, NULL);
+	}
+
+	for (i = 0; i < file_io.thread_count; i++) {
+		switch_thread_join(&st, file_io.threads[i]);
+	}
+
+	file_io.thread_count = 0;
+
+	switch_mutex_unlock(file_io.mutex);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file, const char *func, int line,
 															  switch_file_handle_t *fh,
 															  const char *file_path,
@@ -77,6 +857,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 	int to = 0;
 	int force_channels = 0;
 	uint32_t core_channel_limit;
+	char cache_key[1024] = "";
+	switch_bool_t use_cache = SWITCH_FALSE;
 
 	if (switch_test_flag(fh, SWITCH_FILE_OPEN)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Handle already open\n");
@@ -393,6 +1175,26 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 
 	file_path = fh->spool_path ? fh->spool_path : fh->file_path;
 
+	if (!is_stream && (flags & SWITCH_FILE_FLAG_READ) && !(flags & SWITCH_FILE_FLAG_WRITE) && !switch_test_flag(fh, SWITCH_FILE_FLAG_VIDEO) &&
+		file_cache_key(fh, file_path, channels, fh->samplerate, force_channels, cache_key, sizeof(cache_key))) {
+
+		switch (file_cache_attach(fh, cache_key)) {
+		case SWITCH_STATUS_SUCCESS:
+			if (to) {
+				fh->max_samples = (fh->samplerate / 1000) * to;
+			}
+
+			switch_set_flag_locked(fh, SWITCH_FILE_OPEN);
+			return SWITCH_STATUS_SUCCESS;
+		case SWITCH_STATUS_NOTFOUND:
+			use_cache = SWITCH_TRUE;
+			break;
+		default:
+			/* being decoded by another handle, read it directly meanwhile */
+			break;
+		}
+	}
+
 	if ((status = fh->file_interface->file_open(fh, file_path)) != SWITCH_STATUS_SUCCESS) {
 		if (fh->spool_path) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Spool dir is set.  Make sure [%s] is also a valid path\n", fh->spool_path);
@@ -464,10 +1266,27 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 	}
 
 	switch_set_flag_locked(fh, SWITCH_FILE_OPEN);
+
+	if (use_cache) {
+		file_cache_populate(fh, cache_key);
+	}
+
+	if (!is_stream && !fh->cache_entry && !switch_test_flag(fh, SWITCH_FILE_FLAG_VIDEO)) {
+		const char *val = fh->params ? switch_event_get_header(fh->params, "async_io") : NULL;
+
+		if (val ? switch_true(val) : (switch_test_flag(fh, SWITCH_FILE_FLAG_ASYNC) || runtime.file_async_io)) {
+			file_async_start(fh);
+		}
+	}
+
 	return status;
 
   fail:
 
+	if (use_cache) {
+		file_cache_unclaim(cache_key);
+	}
+
 	switch_clear_flag_locked(fh, SWITCH_FILE_OPEN);
 
 	if (fh->params) {
@@ -496,6 +1315,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->cache_entry) {
+		return file_cache_read(fh, data, len);
+	}
+
   top:
 
 	if (fh->max_samples > 0 && fh->samples_in >= (switch_size_t)fh->max_samples) {
@@ -527,7 +1350,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 			rlen = asis ? fh->pre_buffer_datalen : fh->pre_buffer_datalen / 2 / fh->real_channels;
 
 			if (switch_buffer_inuse(fh->pre_buffer) < rlen * 2 * fh->channels) {
-				if ((status = fh->file_interface->file_read(fh, fh->pre_buffer_data, &rlen)) == SWITCH_STATUS_BREAK) {
+				if ((status = file_read_source(fh, fh->pre_buffer_data, &rlen)) == SWITCH_STATUS_BREAK) {
 					return SWITCH_STATUS_BREAK;
 				}
 
@@ -556,7 +1379,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 
 	} else {
 
-		if ((status = fh->file_interface->file_read(fh, data, len)) == SWITCH_STATUS_BREAK) {
+		if ((status = file_read_source(fh, data, len)) == SWITCH_STATUS_BREAK) {
 			return SWITCH_STATUS_BREAK;
 		}
 
@@ -715,7 +1538,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 					blen /= 2;
 				if (fh->channels > 1)
 					blen /= fh->channels;
-				if ((status = fh->file_interface->file_write(fh, fh->pre_buffer_data, &blen)) != SWITCH_STATUS_SUCCESS) {
+				if ((status = file_write_sink(fh, fh->pre_buffer_data, &blen)) != SWITCH_STATUS_SUCCESS) {
 					*len = 0;
 				}
 			}
@@ -724,7 +1547,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 		return status;
 	} else {
 		switch_status_t status;
-		if ((status = fh->file_interface->file_write(fh, data, len)) == SWITCH_STATUS_SUCCESS) {
+		if ((status = file_write_sink(fh, data, len)) == SWITCH_STATUS_SUCCESS) {
 			fh->samples_out += orig_len;
 		}
 		return status;
@@ -793,10 +1616,27 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 		ok = 0;
 	}
 
+	if (fh->cache_entry && switch_test_flag(fh, SWITCH_FILE_OPEN)) {
+		status = file_cache_seek(fh, cur_pos, samples, whence);
+		fh->offset_pos = *cur_pos;
+		return status;
+	}
+
 	if (!ok) {
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async_io) {
+		file_async_quiesce(fh);
+
+		if (fh->async_io->write) {
+			file_async_do_write(fh->async_io);
+		} else {
+			switch_buffer_zero(fh->async_io->buffer);
+			fh->async_io->eof = 0;
+		}
+	}
+
 	if (fh->buffer) {
 		switch_buffer_zero(fh->buffer);
 	}
@@ -822,6 +1662,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 
 	if (switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE)) {
 		fh->samples_out = *cur_pos;
+	} else if (fh->async_io) {
+		switch_mutex_lock(fh->async_io->mutex);
+		file_async_kick(fh->async_io);
+		switch_mutex_unlock(fh->async_io->mutex);
 	}
 
 	return status;
@@ -836,10 +1680,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_set_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_set_string) {
+	if (fh->cache_entry || !fh->file_interface->file_set_string) {
 		return SWITCH_STATUS_FALSE;
 	}
 
+	file_async_quiesce(fh);
+
 	return fh->file_interface->file_set_string(fh, col, string);
 }
 
@@ -854,7 +1700,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_get_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_get_string) {
+	if (fh->cache_entry || !fh->file_interface->file_get_string) {
 		if (col == SWITCH_AUDIO_COL_STR_FILE_SIZE) {
 			return get_file_size(fh, string);
 		}
@@ -862,6 +1708,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_get_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
+	file_async_quiesce(fh);
 	status = fh->file_interface->file_get_string(fh, col, string);
 
 	if (status == SWITCH_STATUS_SUCCESS && string) return status;
@@ -888,6 +1735,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async_io) {
+		file_async_quiesce(fh);
+		switch_buffer_zero(fh->async_io->buffer);
+	}
+
 	if ((status = fh->file_interface->file_truncate(fh, offset)) == SWITCH_STATUS_SUCCESS) {
 		if (fh->buffer) {
 			switch_buffer_zero(fh->buffer);
@@ -924,7 +1776,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_command(switch_file_handle_t *f
 		break;
 	}
 
-	if (fh->file_interface->file_command) {
+	if (fh->file_interface->file_command && !fh->cache_entry) {
+		file_async_quiesce(fh);
 		switch_mutex_lock(fh->flag_mutex);
 		status = fh->file_interface->file_command(fh, command);
 		switch_mutex_unlock(fh->flag_mutex);
@@ -947,6 +1800,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_pre_close(switch_file_handle_t
 		return SWITCH_STATUS_SUCCESS;
 	}
 
+	file_async_stop(fh);
+
 	if (fh->pre_buffer) {
 		if (switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE)) {
 			switch_size_t blen;
@@ -972,7 +1827,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_pre_close(switch_file_handle_t
 	switch_clear_flag_locked(fh, SWITCH_FILE_OPEN);
 	switch_set_flag_locked(fh, SWITCH_FILE_PRE_CLOSED);
 
-	if (fh->file_interface->file_pre_close) {
+	if (fh->file_interface->file_pre_close && !fh->cache_entry) {
 		status = fh->file_interface->file_pre_close(fh);
 	}
 
@@ -1000,7 +1855,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_handle_dup(switch_file_handle_t
 		switch_goto_status(SWITCH_STATUS_MEMERR, err);
 	}
 
+	file_async_quiesce(oldfh);
 	memcpy(fh, oldfh, sizeof(switch_file_handle_t));
+	fh->async_io = NULL;
 
 	if (!destroy_pool) {
 		switch_clear_flag(fh, SWITCH_FILE_FLAG_FREE_POOL);
@@ -1036,6 +1893,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_handle_dup(switch_file_handle_t
 		}
 	}
 
+	if (fh->cache_entry) {
+		switch_mutex_lock(file_cache.mutex);
+		fh->cache_entry->refs++;
+		switch_mutex_unlock(file_cache.mutex);
+	}
+
 	*newfh = fh;
 
 	return SWITCH_STATUS_SUCCESS;
@@ -1060,7 +1923,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(switch_file_handle_t *fh)
 
 	switch_clear_flag_locked(fh, SWITCH_FILE_PRE_CLOSED);
 
-	fh->file_interface->file_close(fh);
+	if (fh->cache_entry) {
+		file_cache_release(fh);
+	} else {
+		fh->file_interface->file_close(fh);
+	}
 
 	if (fh->params) {
 		switch_event_destroy(&fh->params);
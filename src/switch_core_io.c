@@ -698,6 +698,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 			switch_media_bug_t *bp;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
+			uint32_t fanout = 0;
 			switch_thread_rwlock_rdlock(session->bug_rwlock);
 
 			for (bp = session->bugs; bp; bp = bp->next) {
@@ -720,7 +721,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					continue;
 				}
 
-				if (bp->ready && switch_test_flag(bp, SMBF_READ_STREAM)) {
+				if (bp->ready && switch_test_flag(bp, SMBF_READ_STREAM) && bp->fanout_bit) {
+					fanout |= bp->fanout_bit;
+				} else if (bp->ready && switch_test_flag(bp, SMBF_READ_STREAM)) {
 					switch_mutex_lock(bp->read_mutex);
 					if (bp->read_demux_frame) {
 						uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
@@ -749,6 +752,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					prune++;
 				}
 			}
+
+			if (fanout) {
+				switch_core_media_bug_fanout(session, read_frame, SWITCH_ABC_TYPE_READ, fanout);
+			}
 			switch_thread_rwlock_unlock(session->bug_rwlock);
 			if (prune) {
 				switch_core_media_bug_prune(session);
@@ -208,6 +208,14 @@ struct switch_rtp_engine_s {
 
 #define MAX_REJ_STREAMS 10
 
+/* A remote SDP parsed once and shared by every pass over the same text */
+typedef struct parsed_sdp_s {
+	sdp_parser_t *parser;
+	sdp_session_t *sdp;
+	char *text;
+	int refs;
+} parsed_sdp_t;
+
 struct switch_media_handle_s {
 	switch_core_session_t *session;
 	switch_channel_t *channel;
@@ -272,6 +280,7 @@ struct switch_media_handle_s {
 
 	switch_time_t last_text_frame;
 
+	parsed_sdp_t *r_parsed;
 };
 
 switch_srtp_crypto_suite_t SUITES[CRYPTO_INVALID] = {
@@ -534,12 +543,49 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_get_vid_params(switch_core_ses
 	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_DECLARE(switch_t38_options_t *) switch_core_media_extract_t38_options(switch_core_session_t *session, const char *r_sdp)
+static void parsed_sdp_release(switch_media_handle_t *smh, parsed_sdp_t **parsedp)
 {
-	sdp_media_t *m;
-	sdp_parser_t *parser = NULL;
+	parsed_sdp_t *parsed = *parsedp;
+	int refs;
+
+	if (!parsed) {
+		return;
+	}
+
+	*parsedp = NULL;
+
+	switch_mutex_lock(smh->sdp_mutex);
+	refs = --parsed->refs;
+	switch_mutex_unlock(smh->sdp_mutex);
+
+	if (!refs) {
+		sdp_parser_free(parsed->parser);
+		switch_safe_free(parsed->text);
+		free(parsed);
+	}
+}
+
+/* Returns the parsed form of r_sdp, reusing the tree of the last remote SDP seen on this
+ * handle when the text is the same. The tree is read only, hand it back with parsed_sdp_release(). */
+static sdp_session_t *parsed_sdp_get(switch_media_handle_t *smh, const char *r_sdp, parsed_sdp_t **parsedp)
+{
+	parsed_sdp_t *parsed = NULL, *old = NULL;
+	sdp_parser_t *parser;
 	sdp_session_t *sdp;
-	switch_t38_options_t *t38_options = NULL;
+
+	*parsedp = NULL;
+
+	switch_mutex_lock(smh->sdp_mutex);
+	if (smh->r_parsed && !strcmp(smh->r_parsed->text, r_sdp)) {
+		parsed = smh->r_parsed;
+		parsed->refs++;
+	}
+	switch_mutex_unlock(smh->sdp_mutex);
+
+	if (parsed) {
+		*parsedp = parsed;
+		return parsed->sdp;
+	}
 
 	if (!(parser = sdp_parse(NULL, r_sdp, (int) strlen(r_sdp), 0))) {
 		return NULL;
@@ -550,6 +596,39 @@ SWITCH_DECLARE(switch_t38_options_t *) switch_core_media_extract_t38_options(swi
 		return NULL;
 	}
 
+	switch_zmalloc(parsed, sizeof(*parsed));
+	parsed->parser = parser;
+	parsed->sdp = sdp;
+	parsed->text = strdup(r_sdp);
+	/* one for the caller, one for the handle */
+	parsed->refs = 2;
+
+	switch_mutex_lock(smh->sdp_mutex);
+	old = smh->r_parsed;
+	smh->r_parsed = parsed;
+	switch_mutex_unlock(smh->sdp_mutex);
+
+	parsed_sdp_release(smh, &old);
+
+	*parsedp = parsed;
+	return sdp;
+}
+
+SWITCH_DECLARE(switch_t38_options_t *) switch_core_media_extract_t38_options(switch_core_session_t *session, const char *r_sdp)
+{
+	sdp_media_t *m;
+	parsed_sdp_t *parsed = NULL;
+	sdp_session_t *sdp;
+	switch_t38_options_t *t38_options = NULL;
+
+	if (!session->media_handle) {
+		return NULL;
+	}
+
+	if (!(sdp = parsed_sdp_get(session->media_handle, r_sdp, &parsed))) {
+		return NULL;
+	}
+
 	for (m = sdp->sdp_media; m; m = m->m_next) {
 		if (m->m_proto == sdp_proto_udptl && m->m_type == sdp_media_image && m->m_port) {
 			t38_options = switch_core_media_process_udptl(session, sdp, m);
@@ -557,7 +636,7 @@ SWITCH_DECLARE(switch_t38_options_t *) switch_core_media_extract_t38_options(swi
 		}
 	}
 
-	sdp_parser_free(parser);
+	parsed_sdp_release(session->media_handle, &parsed);
 
 	return t38_options;
 
@@ -1896,6 +1975,8 @@ static void set_stats(switch_core_session_t *session, switch_media_type_t type,
 		add_stat(stats->inbound.flaws, "in_flaw_total");
 		add_stat_double(stats->inbound.R, "in_quality_percentage");
 		add_stat_double(stats->inbound.mos, "in_mos");
+		add_stat(stats->inbound.srtp_packet_count, "in_srtp_packet_count");
+		add_stat(stats->inbound.srtp_packet_count ? stats->inbound.srtp_ns / stats->inbound.srtp_packet_count : 0, "in_srtp_avg_ns");
 
 
 		add_stat(stats->outbound.raw_bytes, "out_raw_bytes");
@@ -1905,6 +1986,8 @@ static void set_stats(switch_core_session_t *session, switch_media_type_t type,
 		add_stat(stats->outbound.skip_packet_count, "out_skip_packet_count");
 		add_stat(stats->outbound.dtmf_packet_count, "out_dtmf_packet_count");
 		add_stat(stats->outbound.cng_packet_count, "out_cng_packet_count");
+		add_stat(stats->outbound.srtp_packet_count, "out_srtp_packet_count");
+		add_stat(stats->outbound.srtp_packet_count ? stats->outbound.srtp_ns / stats->outbound.srtp_packet_count : 0, "out_srtp_avg_ns");
 
 		add_stat(stats->rtcp.packet_count, "rtcp_packet_count");
 		add_stat(stats->rtcp.octet_count, "rtcp_octet_count");
@@ -2000,6 +2083,8 @@ SWITCH_DECLARE(void) switch_media_handle_destroy(switch_core_session_t *session)
 	if (a_engine->write_fb) switch_frame_buffer_destroy(&a_engine->write_fb);
 
 	if (smh->msrp_session) switch_msrp_session_destroy(&smh->msrp_session);
+
+	parsed_sdp_release(smh, &smh->r_parsed);
 }
 
 
@@ -4800,7 +4885,7 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 	const char *crypto = NULL;
 	int got_crypto = 0, got_video_crypto = 0, got_audio = 0, saw_audio = 0, saw_video = 0, got_avp = 0, got_savp = 0, got_udptl = 0, got_webrtc = 0, got_text = 0, got_text_crypto = 0, got_msrp = 0;
 	int scrooge = 0;
-	sdp_parser_t *parser = NULL;
+	parsed_sdp_t *parsed = NULL;
 	sdp_session_t *sdp;
 	const switch_codec_implementation_t **codec_array;
 	int total_codecs;
@@ -4842,12 +4927,7 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 	codec_array = smh->codecs;
 	total_codecs = smh->mparams->num_codecs;
 
-	if (!(parser = sdp_parse(NULL, r_sdp, (int) strlen(r_sdp), 0))) {
-		return 0;
-	}
-
-	if (!(sdp = sdp_session(parser))) {
-		sdp_parser_free(parser);
+	if (!(sdp = parsed_sdp_get(smh, r_sdp, &parsed))) {
 		return 0;
 	}
 
@@ -6421,9 +6501,7 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 
  t38_done:
 
-	if (parser) {
-		sdp_parser_free(parser);
-	}
+	parsed_sdp_release(smh, &parsed);
 
 	smh->mparams->cng_pt = cng_pt;
 	smh->mparams->cng_rate = cng_rate;
@@ -9742,11 +9820,31 @@ static char *get_setup(switch_rtp_engine_t *engine, switch_core_session_t *sessi
 
 
 //?
+/* Append to an SDP buffer that only ever grows. *len remembers how much of it is already
+ * known, so each append only scans the text added since, including text written by others. */
+static void sdp_appendf(char *buf, switch_size_t buflen, switch_size_t *len, const char *fmt, ...)
+{
+	va_list ap;
+
+	*len += strlen(buf + *len);
+
+	if (*len + 1 >= buflen) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	switch_vsnprintf(buf + *len, buflen - *len, fmt, ap);
+	va_end(ap);
+
+	*len += strlen(buf + *len);
+}
+
 static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 					   switch_port_t port, const char *family, const char *ip,
 					   int cur_ptime, const char *append_audio, const char *sr, int use_cng, int cng_type, switch_event_t *map, int secure,
 					   switch_sdp_type_t sdp_type)
 {
+	switch_size_t sdp_len = 0;
 	int i = 0;
 	int rate;
 	int already_did[128] = { 0 };
@@ -9781,7 +9879,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 		}
 	}
 
-	switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "m=audio %d %s", port,
+	sdp_appendf(buf, buflen, &sdp_len, "m=audio %d %s", port,
 					get_media_profile_name(session, secure || a_engine->crypto_type != CRYPTO_INVALID, avp_secure));
 
 	include_external = switch_channel_var_true(session->channel, "include_external_ip");
@@ -9827,7 +9925,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 		
 		already_did[smh->ianacodes[i]] = 1;
 
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), " %d", smh->ianacodes[i]);
+		sdp_appendf(buf, buflen, &sdp_len, " %d", smh->ianacodes[i]);
 	}
 
 	if (smh->mparams->dtmf_type == DTMF_2833 && smh->mparams->te > 95) {
@@ -9841,7 +9939,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 					}
 
 					if (!strncasecmp(pmap->iananame, "telephone-event", 15)) {
-						switch_snprintf(buf + strlen(buf), buflen - strlen(buf), " %d", pmap->pt);
+						sdp_appendf(buf, buflen, &sdp_len, " %d", pmap->pt);
 						already_did[pmap->pt] = 1;
 					}
 				}
@@ -9851,11 +9949,11 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 
 			for (i = 0; i < smh->num_rates; i++) {
 				if (smh->dtmf_ianacodes[i] < 128 && !already_did[smh->dtmf_ianacodes[i]]) {
-					switch_snprintf(buf + strlen(buf), buflen - strlen(buf), " %d", smh->dtmf_ianacodes[i]);
+					sdp_appendf(buf, buflen, &sdp_len, " %d", smh->dtmf_ianacodes[i]);
 					already_did[smh->dtmf_ianacodes[i]] = 1;
 				}
 				if (smh->cng_ianacodes[i] < 128 && !already_did[smh->cng_ianacodes[i]] && !switch_media_handle_test_media_flag(smh, SCMF_SUPPRESS_CNG) && cng_type && use_cng) {
-					switch_snprintf(buf + strlen(buf), buflen - strlen(buf), " %d", smh->cng_ianacodes[i]);
+					sdp_appendf(buf, buflen, &sdp_len, " %d", smh->cng_ianacodes[i]);
 					already_did[smh->cng_ianacodes[i]] = 1;
 				}
 			}
@@ -9866,7 +9964,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 		//switch_snprintf(buf + strlen(buf), buflen - strlen(buf), " %d", cng_type);
 	//}
 
-	switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "\r\n");
+	sdp_appendf(buf, buflen, &sdp_len, "\r\n");
 
 
 	memset(already_did, 0, sizeof(already_did));
@@ -9923,15 +10021,15 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 			int channels = get_channels(imp->iananame, imp->number_of_channels);
 
 			if (channels > 1) {
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d %s/%d/%d\r\n", smh->ianacodes[i], imp->iananame, rate, channels);
+				sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d %s/%d/%d\r\n", smh->ianacodes[i], imp->iananame, rate, channels);
 
 			} else {
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d %s/%d\r\n", smh->ianacodes[i], imp->iananame, rate);
+				sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d %s/%d\r\n", smh->ianacodes[i], imp->iananame, rate);
 			}
 		}
 
 		if (fmtp) {
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=fmtp:%d %s\r\n", smh->ianacodes[i], fmtp);
+			sdp_appendf(buf, buflen, &sdp_len, "a=fmtp:%d %s\r\n", smh->ianacodes[i], fmtp);
 		}
 	}
 
@@ -9943,7 +10041,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 				payload_map_t *pmap;
 				for (pmap = a_engine->payload_map; pmap; pmap = pmap->next) {
 					if (!strncasecmp(pmap->iananame, "telephone-event", 15)) {
-						switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d telephone-event/%d\r\n",
+						sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d telephone-event/%d\r\n",
 							pmap->pt, pmap->rate);
 					}
 				}
@@ -9953,11 +10051,11 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 
 			for (i = 0; i < smh->num_rates; i++) {
 				if (switch_channel_test_flag(session->channel, CF_AVPF)) {
-					switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d telephone-event/%d\r\n",
+					sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d telephone-event/%d\r\n",
 						smh->dtmf_ianacodes[i], smh->rates[i]);
 				}
 				else {
-					switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d telephone-event/%d\r\na=fmtp:%d 0-%d\r\n",
+					sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d telephone-event/%d\r\na=fmtp:%d 0-%d\r\n",
 						smh->dtmf_ianacodes[i], smh->rates[i], smh->dtmf_ianacodes[i], (NDLB_line_flash_16 ? 16 : 15));
 				}
 			}
@@ -9965,16 +10063,16 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 	}
 
 	if (!zstr(a_engine->local_dtls_fingerprint.type) && secure) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=fingerprint:%s %s\r\na=setup:%s\r\n", a_engine->local_dtls_fingerprint.type,
+		sdp_appendf(buf, buflen, &sdp_len, "a=fingerprint:%s %s\r\na=setup:%s\r\n", a_engine->local_dtls_fingerprint.type,
 						a_engine->local_dtls_fingerprint.str, get_setup(a_engine, session, sdp_type));
 	}
 
 	if (smh->mparams->rtcp_audio_interval_msec) {
 		if (a_engine->rtcp_mux > 0) {
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp-mux\r\n");
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp:%d IN %s %s\r\n", port, family, ip);
+			sdp_appendf(buf, buflen, &sdp_len, "a=rtcp-mux\r\n");
+			sdp_appendf(buf, buflen, &sdp_len, "a=rtcp:%d IN %s %s\r\n", port, family, ip);
 		} else {
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp:%d IN %s %s\r\n", port + 1, family, ip);
+			sdp_appendf(buf, buflen, &sdp_len, "a=rtcp:%d IN %s %s\r\n", port + 1, family, ip);
 		}
 	}
 
@@ -9999,23 +10097,23 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 
 		ice_out = &a_engine->ice_out;
 
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ssrc:%u cname:%s\r\n", a_engine->ssrc, smh->cname);
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ssrc:%u msid:%s a0\r\n", a_engine->ssrc, smh->msid);
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ssrc:%u mslabel:%s\r\n", a_engine->ssrc, smh->msid);
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ssrc:%u label:%sa0\r\n", a_engine->ssrc, smh->msid);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ssrc:%u cname:%s\r\n", a_engine->ssrc, smh->cname);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ssrc:%u msid:%s a0\r\n", a_engine->ssrc, smh->msid);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ssrc:%u mslabel:%s\r\n", a_engine->ssrc, smh->msid);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ssrc:%u label:%sa0\r\n", a_engine->ssrc, smh->msid);
 
 
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ice-ufrag:%s\r\n", ice_out->ufrag);
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ice-pwd:%s\r\n", ice_out->pwd);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ice-ufrag:%s\r\n", ice_out->ufrag);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ice-pwd:%s\r\n", ice_out->pwd);
 
 
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+		sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 						tmp1, ice_out->cands[0][0].transport, c1,
 						ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port
 						);
 
 		if (include_external && !zstr(smh->mparams->extsipip)) {
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+			sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 				tmp3, ice_out->cands[0][0].transport, c1,
 				smh->mparams->extsipip, ice_out->cands[0][0].con_port
 				);
@@ -10025,7 +10123,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 			strcmp(a_engine->local_sdp_ip, ice_out->cands[0][0].con_addr)
 			&& a_engine->local_sdp_port != ice_out->cands[0][0].con_port) {
 
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+			sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 							tmp2, ice_out->cands[0][0].transport, c2,
 							ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port,
 							a_engine->local_sdp_ip, a_engine->local_sdp_port
@@ -10035,13 +10133,13 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 		if (a_engine->rtcp_mux < 1 || switch_channel_direction(session->channel) == SWITCH_CALL_DIRECTION_OUTBOUND || switch_channel_test_flag(session->channel, CF_RECOVERING)) {
 
 
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+			sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 							tmp1, ice_out->cands[0][0].transport, c1,
 							ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (a_engine->rtcp_mux > 0 ? 0 : 1)
 							);
 			
 			if (include_external && !zstr(smh->mparams->extsipip)) {
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+				sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 					tmp3, ice_out->cands[0][0].transport, c1,
 					smh->mparams->extsipip, ice_out->cands[0][0].con_port
 					);
@@ -10051,7 +10149,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 				strcmp(a_engine->local_sdp_ip, ice_out->cands[0][1].con_addr)
 				&& a_engine->local_sdp_port != ice_out->cands[0][1].con_port) {
 
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+				sdp_appendf(buf, buflen, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 								tmp2, ice_out->cands[0][0].transport, c2,
 								ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (a_engine->rtcp_mux > 0 ? 0 : 1),
 								a_engine->local_sdp_ip, a_engine->local_sdp_port + (a_engine->rtcp_mux > 0 ? 0 : 1)
@@ -10062,7 +10160,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 
 
 #ifdef GOOGLE_ICE
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ice-options:google-ice\r\n");
+		sdp_appendf(buf, buflen, &sdp_len, "a=ice-options:google-ice\r\n");
 #endif
 	}
 
@@ -10074,7 +10172,7 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 			switch_rtp_crypto_key_type_t j = SUITES[smh->crypto_suite_order[i]].type;
 
 			if ((a_engine->crypto_type == j || a_engine->crypto_type == CRYPTO_INVALID) && !zstr(a_engine->ssec[j].local_crypto_key)) {
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=crypto:%s\r\n", a_engine->ssec[j].local_crypto_key);
+				sdp_appendf(buf, buflen, &sdp_len, "a=crypto:%s\r\n", a_engine->ssec[j].local_crypto_key);
 			}
 		}
 		//switch_snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "a=encryption:optional\r\n");
@@ -10085,17 +10183,17 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 			//if (smh->rates[i] == 8000) {
 			//	switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d CN/%d\r\n", cng_type, smh->rates[i]);
 			//} else {
-				switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtpmap:%d CN/%d\r\n", smh->cng_ianacodes[i], smh->rates[i]);
+				sdp_appendf(buf, buflen, &sdp_len, "a=rtpmap:%d CN/%d\r\n", smh->cng_ianacodes[i], smh->rates[i]);
 				//}
 		}
 	} else {
 		if (switch_media_handle_test_media_flag(smh, SCMF_SUPPRESS_CNG)) {
-			switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=silenceSupp:off - - - -\r\n");
+			sdp_appendf(buf, buflen, &sdp_len, "a=silenceSupp:off - - - -\r\n");
 		}
 	}
 
 	if (append_audio) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "%s%s", append_audio, end_of(append_audio) == '\n' ? "" : "\r\n");
+		sdp_appendf(buf, buflen, &sdp_len, "%s%s", append_audio, end_of(append_audio) == '\n' ? "" : "\r\n");
 	}
 
 	if (!cur_ptime) {
@@ -10103,11 +10201,11 @@ static void generate_m(switch_core_session_t *session, char *buf, size_t buflen,
 	}
 
 	if (!noptime && cur_ptime) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=ptime:%d\r\n", cur_ptime);
+		sdp_appendf(buf, buflen, &sdp_len, "a=ptime:%d\r\n", cur_ptime);
 	}
 
 	if (!zstr(sr)) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=%s\r\n", sr);
+		sdp_appendf(buf, buflen, &sdp_len, "a=%s\r\n", sr);
 	}
 }
 
@@ -10212,20 +10310,22 @@ SWITCH_DECLARE(void)switch_core_media_set_local_sdp(switch_core_session_t *sessi
 
 static void add_fb(char *buf, uint32_t buflen, int pt, int fir, int nack, int pli, int tmmbr)
 {
+	switch_size_t sdp_len = 0;
+
 	if (fir) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp-fb:%d ccm fir\r\n", pt);
+		sdp_appendf(buf, buflen, &sdp_len, "a=rtcp-fb:%d ccm fir\r\n", pt);
 	}
 
 	if (tmmbr) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp-fb:%d ccm tmmbr\r\n", pt);
+		sdp_appendf(buf, buflen, &sdp_len, "a=rtcp-fb:%d ccm tmmbr\r\n", pt);
 	}
 
 	if (nack) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp-fb:%d nack\r\n", pt);
+		sdp_appendf(buf, buflen, &sdp_len, "a=rtcp-fb:%d nack\r\n", pt);
 	}
 
 	if (pli) {
-		switch_snprintf(buf + strlen(buf), buflen - strlen(buf), "a=rtcp-fb:%d nack pli\r\n", pt);
+		sdp_appendf(buf, buflen, &sdp_len, "a=rtcp-fb:%d nack pli\r\n", pt);
 	}
 
 }
@@ -10235,6 +10335,7 @@ static void add_fb(char *buf, uint32_t buflen, int pt, int fir, int nack, int pl
 SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *session, switch_sdp_type_t sdp_type, const char *ip, switch_port_t port, const char *sr, int force)
 {
 	char *buf;
+	switch_size_t sdp_len = 0;
 	int ptime = 0;
 	uint32_t rate = 0;
 	uint32_t v_port, t_port;
@@ -10580,7 +10681,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					username, smh->owner_id, smh->session_id, family, ip, username, family, ip, srbuf);
 
 	if (switch_channel_test_flag(smh->session->channel, CF_ICE) && switch_channel_var_true(session->channel, "ice_lite")) {
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-lite\r\n");
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-lite\r\n");
 	}
 
 	if (a_engine->rmode == SWITCH_MEDIA_FLOW_DISABLED) {
@@ -10589,37 +10690,37 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 	if (switch_channel_test_flag(smh->session->channel, CF_ICE)) {
 		gen_ice(session, SWITCH_MEDIA_TYPE_AUDIO, ip, port);
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=msid-semantic: WMS %s\r\n", smh->msid);
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=msid-semantic: WMS %s\r\n", smh->msid);
 	}
 
 	if (a_engine->codec_negotiated && !switch_channel_test_flag(session->channel, CF_NOSDP_REINVITE)) {
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=audio %d %s", port,
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=audio %d %s", port,
 						get_media_profile_name(session, !a_engine->no_crypto &&
 											   (switch_channel_test_flag(session->channel, CF_DTLS) || a_engine->crypto_type != CRYPTO_INVALID), AVP_UNDEFINED));
 
 
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", a_engine->cur_payload_map->pt);
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", a_engine->cur_payload_map->pt);
 
 
 		if (switch_media_handle_test_media_flag(smh, SCMF_MULTI_ANSWER_AUDIO)) {
 			switch_mutex_lock(smh->sdp_mutex);
 			for (pmap = a_engine->cur_payload_map; pmap && pmap->allocated; pmap = pmap->next) {
 				if (pmap->pt != a_engine->cur_payload_map->pt) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", pmap->pt);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", pmap->pt);
 				}
 			}
 			switch_mutex_unlock(smh->sdp_mutex);
 		}
 
 		if ((smh->mparams->dtmf_type == DTMF_2833 || switch_channel_test_flag(session->channel, CF_LIBERAL_DTMF)) && smh->mparams->te > 95) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", smh->mparams->te);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", smh->mparams->te);
 		}
 
 		if (!switch_media_handle_test_media_flag(smh, SCMF_SUPPRESS_CNG) && smh->mparams->cng_pt && use_cng) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", smh->mparams->cng_pt);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", smh->mparams->cng_pt);
 		}
 
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "\r\n");
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, "\r\n");
 
 
 		rate = a_engine->cur_payload_map->adv_rm_rate;
@@ -10629,22 +10730,22 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 		}
 
 		if (a_engine->cur_payload_map->adv_channels > 1) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%d/%d\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%d/%d\r\n",
 							a_engine->cur_payload_map->pt, a_engine->cur_payload_map->rm_encoding, rate, a_engine->cur_payload_map->adv_channels);
 		} else {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%d\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%d\r\n",
 							a_engine->cur_payload_map->pt, a_engine->cur_payload_map->rm_encoding, rate);
 		}
 
 		if (fmtp_out) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fmtp:%d %s\r\n", a_engine->cur_payload_map->pt, fmtp_out);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fmtp:%d %s\r\n", a_engine->cur_payload_map->pt, fmtp_out);
 		}
 
 		if (switch_media_handle_test_media_flag(smh, SCMF_MULTI_ANSWER_AUDIO)) {
 			switch_mutex_lock(smh->sdp_mutex);
 			for (pmap = a_engine->cur_payload_map; pmap && pmap->allocated; pmap = pmap->next) {
 				if (pmap->pt != a_engine->cur_payload_map->pt) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%ld\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%ld\r\n",
 									pmap->pt, pmap->iananame,
 									pmap->rate);
 				}
@@ -10662,18 +10763,18 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 			&& smh->mparams->te > 95) {
 
 			if (switch_channel_test_flag(session->channel, CF_AVPF)) {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d telephone-event/%d\r\n",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d telephone-event/%d\r\n",
 								smh->mparams->te, smh->mparams->te_rate);
 			} else {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d telephone-event/%d\r\na=fmtp:%d 0-%d\r\n",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d telephone-event/%d\r\na=fmtp:%d 0-%d\r\n",
 								smh->mparams->te, smh->mparams->te_rate, smh->mparams->te, (switch_channel_var_true(session->channel, "NDLB_line_flash_16") ? 16 : 15));
 			}
 		}
 
 		if (switch_media_handle_test_media_flag(smh, SCMF_SUPPRESS_CNG)) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=silenceSupp:off - - - -\r\n");
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=silenceSupp:off - - - -\r\n");
 		} else if (smh->mparams->cng_pt && use_cng) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d CN/%lu\r\n", smh->mparams->cng_pt, smh->mparams->cng_rate);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d CN/%lu\r\n", smh->mparams->cng_pt, smh->mparams->cng_rate);
 
 			if (!a_engine->codec_negotiated) {
 				smh->mparams->cng_pt = 0;
@@ -10681,31 +10782,31 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 		}
 
 		if (append_audio) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s%s", append_audio, end_of(append_audio) == '\n' ? "" : "\r\n");
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s%s", append_audio, end_of(append_audio) == '\n' ? "" : "\r\n");
 		}
 
 		if (ptime) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ptime:%d\r\n", ptime);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ptime:%d\r\n", ptime);
 		}
 
 
 		if (!zstr(sr)) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=%s\r\n", sr);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=%s\r\n", sr);
 		}
 
 
 		if (!zstr(a_engine->local_dtls_fingerprint.type)) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fingerprint:%s %s\r\na=setup:%s\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fingerprint:%s %s\r\na=setup:%s\r\n",
 							a_engine->local_dtls_fingerprint.type,
 							a_engine->local_dtls_fingerprint.str, get_setup(a_engine, session, sdp_type));
 		}
 
 		if (smh->mparams->rtcp_audio_interval_msec) {
 			if (a_engine->rtcp_mux > 0) {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp-mux\r\n");
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", port, family, ip);
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp-mux\r\n");
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", port, family, ip);
 			} else {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", port + 1, family, ip);
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", port + 1, family, ip);
 			}
 		}
 
@@ -10730,17 +10831,17 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 			ice_out = &a_engine->ice_out;
 
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-ufrag:%s\r\n", ice_out->ufrag);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-pwd:%s\r\n", ice_out->pwd);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-ufrag:%s\r\n", ice_out->ufrag);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-pwd:%s\r\n", ice_out->pwd);
 
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 							tmp1, ice_out->cands[0][0].transport, c1,
 							ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port
 							);
 
 			if (include_external && !zstr(smh->mparams->extsipip)) {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 					tmp3, ice_out->cands[0][0].transport, c1,
 					smh->mparams->extsipip, ice_out->cands[0][0].con_port
 					);
@@ -10750,7 +10851,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				strcmp(a_engine->local_sdp_ip, ice_out->cands[0][0].con_addr)
 				&& a_engine->local_sdp_port != ice_out->cands[0][0].con_port) {
 
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 								tmp2, ice_out->cands[0][0].transport, c3,
 								ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port,
 								a_engine->local_sdp_ip, a_engine->local_sdp_port
@@ -10760,13 +10861,13 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 			if (a_engine->rtcp_mux < 1 || is_outbound || switch_channel_test_flag(session->channel, CF_RECOVERING)) {
 
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 								tmp1, ice_out->cands[0][0].transport, c2,
 								ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (a_engine->rtcp_mux > 0 ? 0 : 1)
 								);
 
 				if (include_external && !zstr(smh->mparams->extsipip)) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 						tmp3, ice_out->cands[0][0].transport, c2,
 						smh->mparams->extsipip, ice_out->cands[0][0].con_port + (a_engine->rtcp_mux > 0 ? 0 : 1)
 						);
@@ -10778,7 +10879,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					strcmp(a_engine->local_sdp_ip, ice_out->cands[0][0].con_addr)
 					&& a_engine->local_sdp_port != ice_out->cands[0][0].con_port) {
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 									tmp2, ice_out->cands[0][0].transport, c4,
 									ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (a_engine->rtcp_mux > 0 ? 0 : 1),
 									a_engine->local_sdp_ip, a_engine->local_sdp_port + (a_engine->rtcp_mux > 0 ? 0 : 1)
@@ -10786,28 +10887,28 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				}
 			}
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=end-of-candidates\r\n");
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=end-of-candidates\r\n");
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u cname:%s\r\n", a_engine->ssrc, smh->cname);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u msid:%s a0\r\n", a_engine->ssrc, smh->msid);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u mslabel:%s\r\n", a_engine->ssrc, smh->msid);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u label:%sa0\r\n", a_engine->ssrc, smh->msid);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u cname:%s\r\n", a_engine->ssrc, smh->cname);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u msid:%s a0\r\n", a_engine->ssrc, smh->msid);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u mslabel:%s\r\n", a_engine->ssrc, smh->msid);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u label:%sa0\r\n", a_engine->ssrc, smh->msid);
 
 
 #ifdef GOOGLE_ICE
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-options:google-ice\r\n");
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-options:google-ice\r\n");
 #endif
 		}
 
 		if (a_engine->crypto_type != CRYPTO_INVALID && !switch_channel_test_flag(session->channel, CF_DTLS) &&
 			!zstr(a_engine->ssec[a_engine->crypto_type].local_crypto_key) && switch_channel_test_flag(session->channel, CF_SECURE)) {
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=crypto:%s\r\n", a_engine->ssec[a_engine->crypto_type].local_crypto_key);
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=crypto:%s\r\n", a_engine->ssec[a_engine->crypto_type].local_crypto_key);
 		//switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=encryption:optional\r\n");
 		}
 
 		if (a_engine->reject_avp) {
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=audio 0 RTP/AVP 19\r\n");
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=audio 0 RTP/AVP 19\r\n");
 		}
 
 	} else if (smh->mparams->num_codecs) {
@@ -10890,7 +10991,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 	}
 
 	if (switch_channel_test_flag(session->channel, CF_IMAGE_SDP)) {
-		switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=image 0 UDPTL T38\r\n", SWITCH_VA_NONE);
+		sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=image 0 UDPTL T38\r\n", SWITCH_VA_NONE);
 
 	}
 
@@ -10917,7 +11018,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 	if (!has_vid) {
 		if (switch_channel_test_flag(session->channel, CF_VIDEO_SDP_RECVD)) {
 			switch_channel_clear_flag(session->channel, CF_VIDEO_SDP_RECVD);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=video 0 %s 19\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=video 0 %s 19\r\n",
 							get_media_profile_name(session,
 												   (switch_channel_test_flag(session->channel, CF_SECURE)
 													&& switch_channel_direction(session->channel) == SWITCH_CALL_DIRECTION_OUTBOUND) ||
@@ -10950,7 +11051,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				}
 
 
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=video %d %s",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=video %d %s",
 								v_port,
 								get_media_profile_name(session,
 													   (loops == 0 && switch_channel_test_flag(session->channel, CF_SECURE)
@@ -10964,13 +11065,13 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				if (v_engine->codec_negotiated) {
 					payload_map_t *pmap;
 					switch_core_media_set_video_codec(session, 0);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", v_engine->cur_payload_map->pt);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", v_engine->cur_payload_map->pt);
 
 					if (switch_media_handle_test_media_flag(smh, SCMF_MULTI_ANSWER_VIDEO)) {
 						switch_mutex_lock(smh->sdp_mutex);
 						for (pmap = v_engine->cur_payload_map; pmap && pmap->allocated; pmap = pmap->next) {
 							if (pmap->pt != v_engine->cur_payload_map->pt && pmap->negotiated) {
-								switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", pmap->pt);
+								sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", pmap->pt);
 							}
 						}
 						switch_mutex_unlock(smh->sdp_mutex);
@@ -11006,7 +11107,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 		
 						already_did[smh->ianacodes[i]] = 1;
 						
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", smh->ianacodes[i]);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", smh->ianacodes[i]);
 
 						if (!ptime) {
 							ptime = imp->microseconds_per_packet / 1000;
@@ -11019,7 +11120,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					switch_core_media_set_smode(smh->session, SWITCH_MEDIA_TYPE_VIDEO, SWITCH_MEDIA_FLOW_SENDRECV, sdp_type);
 				}
 				
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "\r\n");
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "\r\n");
 
 
 				if (!(vbw = switch_channel_get_variable(smh->session->channel, "rtp_video_max_bandwidth"))) {
@@ -11033,7 +11134,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				bw = switch_parse_bandwidth_string(vbw);
 
 				if (bw > 0) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "b=AS:%d\r\n", bw);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "b=AS:%d\r\n", bw);
 					//switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "b=TIAS:%d\r\n", bw);
 				}
 
@@ -11051,7 +11152,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					//}
 
 					rate = v_engine->cur_payload_map->rm_rate;
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%ld\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%ld\r\n",
 									v_engine->cur_payload_map->pt, v_engine->cur_payload_map->rm_encoding,
 									v_engine->cur_payload_map->rm_rate);
 
@@ -11075,7 +11176,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 					if (pass_fmtp) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fmtp:%d %s\r\n", v_engine->cur_payload_map->pt, pass_fmtp);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fmtp:%d %s\r\n", v_engine->cur_payload_map->pt, pass_fmtp);
 					}
 
 
@@ -11083,7 +11184,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						switch_mutex_lock(smh->sdp_mutex);
 						for (pmap = v_engine->cur_payload_map; pmap && pmap->allocated; pmap = pmap->next) {
 							if (pmap->pt != v_engine->cur_payload_map->pt && pmap->negotiated) {
-								switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%ld\r\n",
+								sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%ld\r\n",
 												pmap->pt, pmap->iananame, pmap->rate);
 							}
 						}
@@ -11092,7 +11193,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 					if (append_video) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s%s", append_video, end_of(append_video) == '\n' ? "" : "\r\n");
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s%s", append_video, end_of(append_video) == '\n' ? "" : "\r\n");
 					}
 					
 				} else if (smh->mparams->num_codecs) {
@@ -11135,10 +11236,10 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						//}
 
 						if (channels > 1) {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%d/%d\r\n", ianacode, imp->iananame,
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%d/%d\r\n", ianacode, imp->iananame,
 											imp->samples_per_second, channels);
 						} else {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%d\r\n", ianacode, imp->iananame,
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%d\r\n", ianacode, imp->iananame,
 											imp->samples_per_second);
 						}
 
@@ -11164,20 +11265,20 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						}
 
 						if (!zstr(fmtp) && strcasecmp(fmtp, "_blank_")) {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fmtp:%d %s\r\n", ianacode, fmtp);
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fmtp:%d %s\r\n", ianacode, fmtp);
 						}
 					}
 
 				}
 				
 				if (v_engine->smode == SWITCH_MEDIA_FLOW_SENDRECV) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=sendrecv\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=sendrecv\r\n");
 				} else if (v_engine->smode == SWITCH_MEDIA_FLOW_SENDONLY) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=sendonly\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=sendonly\r\n");
 				} else if (v_engine->smode == SWITCH_MEDIA_FLOW_RECVONLY) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=recvonly\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=recvonly\r\n");
 				} else if (v_engine->smode == SWITCH_MEDIA_FLOW_INACTIVE) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=inactive\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=inactive\r\n");
 				}
 
 
@@ -11188,17 +11289,17 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 				if (!zstr(v_engine->local_dtls_fingerprint.type)) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fingerprint:%s %s\r\na=setup:%s\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fingerprint:%s %s\r\na=setup:%s\r\n",
 									v_engine->local_dtls_fingerprint.type, v_engine->local_dtls_fingerprint.str, get_setup(v_engine, session, sdp_type));
 				}
 
 
 				if (smh->mparams->rtcp_video_interval_msec) {
 					if (v_engine->rtcp_mux > 0) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp-mux\r\n");
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", v_port, family, ip);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp-mux\r\n");
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", v_port, family, ip);
 					} else {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", v_port + 1, family, ip);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", v_port + 1, family, ip);
 					}
 				}
 
@@ -11276,24 +11377,24 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					ice_out = &v_engine->ice_out;
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u cname:%s\r\n", v_engine->ssrc, smh->cname);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u msid:%s v0\r\n", v_engine->ssrc, smh->msid);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u mslabel:%s\r\n", v_engine->ssrc, smh->msid);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u label:%sv0\r\n", v_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u cname:%s\r\n", v_engine->ssrc, smh->cname);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u msid:%s v0\r\n", v_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u mslabel:%s\r\n", v_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u label:%sv0\r\n", v_engine->ssrc, smh->msid);
 
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-ufrag:%s\r\n", ice_out->ufrag);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-pwd:%s\r\n", ice_out->pwd);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-ufrag:%s\r\n", ice_out->ufrag);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-pwd:%s\r\n", ice_out->pwd);
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 									tmp1, ice_out->cands[0][0].transport, c1,
 									ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port
 									);
 
 					if (include_external && !zstr(smh->mparams->extsipip)) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 							tmp3, ice_out->cands[0][0].transport, c1,
 							smh->mparams->extsipip, ice_out->cands[0][0].con_port
 							);
@@ -11303,7 +11404,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						strcmp(v_engine->local_sdp_ip, ice_out->cands[0][0].con_addr)
 						&& v_engine->local_sdp_port != ice_out->cands[0][0].con_port) {
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 										tmp2, ice_out->cands[0][0].transport, c3,
 										ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port,
 										v_engine->local_sdp_ip, v_engine->local_sdp_port
@@ -11313,13 +11414,13 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 					if (v_engine->rtcp_mux < 1 || is_outbound || switch_channel_test_flag(session->channel, CF_RECOVERING)) {
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 										tmp1, ice_out->cands[0][0].transport, c2,
 										ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (v_engine->rtcp_mux > 0 ? 0 : 1)
 										);
 
 					if (include_external && !zstr(smh->mparams->extsipip)) {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 								tmp3, ice_out->cands[0][0].transport, c2,
 								smh->mparams->extsipip, ice_out->cands[0][0].con_port + (v_engine->rtcp_mux > 0 ? 0 : 1)
 								);
@@ -11330,7 +11431,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 							strcmp(v_engine->local_sdp_ip, ice_out->cands[0][1].con_addr)
 							&& v_engine->local_sdp_port != ice_out->cands[0][1].con_port) {
 
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ srflx generation 0\r\n",
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ srflx generation 0\r\n",
 											tmp2, ice_out->cands[0][0].transport, c4,
 											ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (v_engine->rtcp_mux > 0 ? 0 : 1),
 											v_engine->local_sdp_ip, v_engine->local_sdp_port + (v_engine->rtcp_mux > 0 ? 0 : 1)
@@ -11341,9 +11442,9 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 #ifdef GOOGLE_ICE
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-options:google-ice\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-options:google-ice\r\n");
 #endif
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=end-of-candidates\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=end-of-candidates\r\n");
 
 				}
 
@@ -11355,7 +11456,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						switch_rtp_crypto_key_type_t j = SUITES[smh->crypto_suite_order[i]].type;
 
 						if ((a_engine->crypto_type == j || a_engine->crypto_type == CRYPTO_INVALID) && !zstr(a_engine->ssec[j].local_crypto_key)) {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=crypto:%s\r\n", v_engine->ssec[j].local_crypto_key);
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=crypto:%s\r\n", v_engine->ssec[j].local_crypto_key);
 						}
 					}
 					//switch_snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "a=encryption:optional\r\n");
@@ -11414,7 +11515,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					ip, msrp_session->local_port, msrp_session->call_id);
 			}
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf),
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len,
 				"m=message %d TCP/%sMSRP *\r\n"
 				"a=path:%s\r\n"
 				"a=accept-types:%s\r\n"
@@ -11443,7 +11544,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					ip, msrp_session->local_port, uuid);
 			}
 
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf),
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len,
 				"m=message %d TCP/%sMSRP *\r\n"
 				"a=path:%s\r\n"
 				"a=accept-types:message/cpim text/* application/im-iscomposing+xml\r\n"
@@ -11455,7 +11556,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				msrp_session->active ? "active" : "passive");
 
 			if (!zstr(file_selector)) {
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf),
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len,
 					"a=sendonly\r\na=file-selector:%s\r\n", file_selector);
 			}
 		}
@@ -11466,7 +11567,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 	if (sdp_type == SDP_ANSWER && !switch_channel_test_flag(session->channel, CF_RTT)) {
 		if (switch_channel_test_flag(session->channel, CF_TEXT_SDP_RECVD)) {
 			switch_channel_clear_flag(session->channel, CF_TEXT_SDP_RECVD);
-			switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=text 0 %s 19\r\n",
+			sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=text 0 %s 19\r\n",
 							get_media_profile_name(session,
 												   (switch_channel_test_flag(session->channel, CF_SECURE)
 													&& switch_channel_direction(session->channel) == SWITCH_CALL_DIRECTION_OUTBOUND) ||
@@ -11530,7 +11631,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				}
 
 
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "m=text %d %s",
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "m=text %d %s",
 								t_port,
 								get_media_profile_name(session,
 													   (loops == 0 && switch_channel_test_flag(session->channel, CF_SECURE)
@@ -11548,7 +11649,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 							continue;
 						}
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), " %d", pmap->pt);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, " %d", pmap->pt);
 
 					}
 					switch_mutex_unlock(smh->sdp_mutex);
@@ -11556,7 +11657,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					switch_core_media_set_smode(smh->session, SWITCH_MEDIA_TYPE_TEXT, SWITCH_MEDIA_FLOW_SENDRECV, sdp_type);
 				}
 
-				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "\r\n");
+				sdp_appendf(buf, SDPBUFLEN, &sdp_len, "\r\n");
 
 				if (t_engine->codec_negotiated) {
 					switch_mutex_lock(smh->sdp_mutex);
@@ -11574,7 +11675,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 							t_engine->red_pt = pmap->pt;
 						}
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtpmap:%d %s/%ld\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtpmap:%d %s/%ld\r\n",
 										pmap->pt, pmap->iananame, pmap->rate);
 
 					}
@@ -11582,14 +11683,14 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 					if (t_engine->t140_pt && t_engine->red_pt) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fmtp:%d %d/%d/%d\r\n", t_engine->red_pt, t_engine->t140_pt, t_engine->t140_pt, t_engine->t140_pt);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fmtp:%d %d/%d/%d\r\n", t_engine->red_pt, t_engine->t140_pt, t_engine->t140_pt, t_engine->t140_pt);
 					}
 
 
 					if (t_engine->smode == SWITCH_MEDIA_FLOW_SENDONLY) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=sendonly\r\n");
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=sendonly\r\n");
 					} else if (t_engine->smode == SWITCH_MEDIA_FLOW_RECVONLY) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "%s", "a=recvonly\r\n");
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "%s", "a=recvonly\r\n");
 					}
 
 				}
@@ -11601,17 +11702,17 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 				if (!zstr(t_engine->local_dtls_fingerprint.type)) {
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=fingerprint:%s %s\r\na=setup:%s\r\n", t_engine->local_dtls_fingerprint.type,
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=fingerprint:%s %s\r\na=setup:%s\r\n", t_engine->local_dtls_fingerprint.type,
 									t_engine->local_dtls_fingerprint.str, get_setup(t_engine, session, sdp_type));
 				}
 
 
 				if (smh->mparams->rtcp_text_interval_msec) {
 					if (t_engine->rtcp_mux > 0) {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp-mux\r\n");
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", t_port, family, ip);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp-mux\r\n");
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", t_port, family, ip);
 					} else {
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=rtcp:%d IN %s %s\r\n", t_port + 1, family, ip);
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=rtcp:%d IN %s %s\r\n", t_port + 1, family, ip);
 					}
 				}
 
@@ -11633,18 +11734,18 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 					ice_out = &t_engine->ice_out;
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u cname:%s\r\n", t_engine->ssrc, smh->cname);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u msid:%s v0\r\n", t_engine->ssrc, smh->msid);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u mslabel:%s\r\n", t_engine->ssrc, smh->msid);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u label:%sv0\r\n", t_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u cname:%s\r\n", t_engine->ssrc, smh->cname);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u msid:%s v0\r\n", t_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u mslabel:%s\r\n", t_engine->ssrc, smh->msid);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ssrc:%u label:%sv0\r\n", t_engine->ssrc, smh->msid);
 
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-ufrag:%s\r\n", ice_out->ufrag);
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-pwd:%s\r\n", ice_out->pwd);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-ufrag:%s\r\n", ice_out->ufrag);
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-pwd:%s\r\n", ice_out->pwd);
 
 
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ host generation 0\r\n",
 									tmp1, ice_out->cands[0][0].transport, c1,
 									ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port
 									);
@@ -11653,7 +11754,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						strcmp(t_engine->local_sdp_ip, ice_out->cands[0][0].con_addr)
 						&& t_engine->local_sdp_port != ice_out->cands[0][0].con_port) {
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 1 %s %u %s %d typ srflx raddr %s rport %d generation 0\r\n",
 										tmp2, ice_out->cands[0][0].transport, c3,
 										ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port,
 										t_engine->local_sdp_ip, t_engine->local_sdp_port
@@ -11663,7 +11764,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 					if (t_engine->rtcp_mux < 1 || is_outbound || switch_channel_test_flag(session->channel, CF_RECOVERING)) {
 
-						switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
+						sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ host generation 0\r\n",
 										tmp1, ice_out->cands[0][0].transport, c2,
 										ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (t_engine->rtcp_mux > 0 ? 0 : 1)
 										);
@@ -11673,7 +11774,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 							strcmp(t_engine->local_sdp_ip, ice_out->cands[0][1].con_addr)
 							&& t_engine->local_sdp_port != ice_out->cands[0][1].con_port) {
 
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=candidate:%s 2 %s %u %s %d typ srflx generation 0\r\n",
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=candidate:%s 2 %s %u %s %d typ srflx generation 0\r\n",
 											tmp2, ice_out->cands[0][0].transport, c4,
 											ice_out->cands[0][0].con_addr, ice_out->cands[0][0].con_port + (t_engine->rtcp_mux > 0 ? 0 : 1),
 											t_engine->local_sdp_ip, t_engine->local_sdp_port + (t_engine->rtcp_mux > 0 ? 0 : 1)
@@ -11684,7 +11785,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 
 
 #ifdef GOOGLE_ICE
-					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ice-options:google-ice\r\n");
+					sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=ice-options:google-ice\r\n");
 #endif
 				}
 
@@ -11696,7 +11797,7 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 						switch_rtp_crypto_key_type_t j = SUITES[smh->crypto_suite_order[i]].type;
 
 						if ((t_engine->crypto_type == j || t_engine->crypto_type == CRYPTO_INVALID) && !zstr(t_engine->ssec[j].local_crypto_key)) {
-							switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=crypto:%s\r\n", t_engine->ssec[j].local_crypto_key);
+							sdp_appendf(buf, SDPBUFLEN, &sdp_len, "a=crypto:%s\r\n", t_engine->ssec[j].local_crypto_key);
 						}
 					}
 					//switch_snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "a=encryption:optional\r\n");
@@ -13466,7 +13567,7 @@ SWITCH_DECLARE(void) switch_core_media_set_sdp_codec_string(switch_core_session_
 SWITCH_DECLARE(void) switch_core_media_merge_sdp_codec_string(switch_core_session_t *session, const char *r_sdp,
 															  switch_sdp_type_t sdp_type, const char *codec_string)
 {
-	sdp_parser_t *parser;
+	parsed_sdp_t *parsed = NULL;
 	sdp_session_t *sdp;
 
 	switch_assert(session);
@@ -13483,14 +13584,10 @@ SWITCH_DECLARE(void) switch_core_media_merge_sdp_codec_string(switch_core_sessio
 	if (zstr(codec_string)) {
 		codec_string = switch_core_media_get_codec_string(session);
 	}
-	
-	if ((parser = sdp_parse(NULL, r_sdp, (int) strlen(r_sdp), 0))) {
-
-		if ((sdp = sdp_session(parser))) {
-			switch_core_media_set_r_sdp_codec_string(session, codec_string, sdp, sdp_type);
-		}
 
-		sdp_parser_free(parser);
+	if ((sdp = parsed_sdp_get(session->media_handle, r_sdp, &parsed))) {
+		switch_core_media_set_r_sdp_codec_string(session, codec_string, sdp, sdp_type);
+		parsed_sdp_release(session->media_handle, &parsed);
 	}
 }
 
@@ -15825,6 +15922,88 @@ SWITCH_DECLARE(switch_msrp_session_t *) switch_core_media_get_msrp_session(switc
 }
 
 
+/*!
+ * Write a frame in another codec by translating its bytes directly when
+ * the core has a translator for the pair, repacketizing when the ptimes
+ * differ.  Returns SWITCH_FALSE to fall back to decoding and encoding.
+ */
+static switch_bool_t write_translated_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags, int stream_id,
+											switch_status_t *status)
+{
+	const switch_codec_implementation_t *from = frame->codec->implementation;
+	const switch_codec_implementation_t *to = session->write_codec->implementation;
+	switch_frame_t *enc_frame = &session->enc_write_frame;
+	uint32_t packet_len = to->encoded_bytes_per_packet;
+
+	if (session->translate_from != from || session->translate_to != to) {
+		session->translate_from = from;
+		session->translate_to = to;
+		session->translate = switch_core_codec_find_translator(from, to, &session->translate_func);
+
+		if (session->translate_buffer) {
+			switch_buffer_zero(session->translate_buffer);
+		}
+
+		if (session->translate) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Writing %s %dms as %s %dms without transcoding\n",
+							  from->iananame, from->microseconds_per_packet / 1000, to->iananame, to->microseconds_per_packet / 1000);
+		}
+	}
+
+	if (!session->translate || (frame->flags & SFF_PLC) || !frame->datalen || frame->datalen > enc_frame->buflen) {
+		if (session->translate_buffer) {
+			switch_buffer_zero(session->translate_buffer);
+		}
+		return SWITCH_FALSE;
+	}
+
+	if (session->translate_func) {
+		session->translate_func(frame->data, enc_frame->data, frame->datalen);
+	} else {
+		memcpy(enc_frame->data, frame->data, frame->datalen);
+	}
+
+	enc_frame->codec = session->write_codec;
+	enc_frame->channels = to->number_of_channels;
+	enc_frame->payload = to->ianacode;
+	enc_frame->m = frame->m;
+	enc_frame->ssrc = frame->ssrc;
+	enc_frame->seq = frame->seq;
+	enc_frame->rate = to->actual_samples_per_second;
+	enc_frame->flags = 0;
+
+	if (frame->datalen == packet_len && (!session->translate_buffer || !switch_buffer_inuse(session->translate_buffer))) {
+		enc_frame->datalen = packet_len;
+		enc_frame->samples = to->samples_per_packet;
+		enc_frame->timestamp = from->samples_per_packet == to->samples_per_packet ? frame->timestamp : 0;
+		*status = perform_write(session, enc_frame, flags, stream_id);
+		return SWITCH_TRUE;
+	}
+
+	if (!session->translate_buffer &&
+		switch_buffer_create_dynamic(&session->translate_buffer, packet_len * SWITCH_BUFFER_BLOCK_FRAMES, packet_len * SWITCH_BUFFER_START_FRAMES, 0) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Write Buffer Failed!\n");
+		*status = SWITCH_STATUS_MEMERR;
+		return SWITCH_TRUE;
+	}
+
+	if (!switch_buffer_write(session->translate_buffer, enc_frame->data, frame->datalen)) {
+		*status = SWITCH_STATUS_MEMERR;
+		return SWITCH_TRUE;
+	}
+
+	*status = SWITCH_STATUS_SUCCESS;
+
+	while (*status == SWITCH_STATUS_SUCCESS && switch_buffer_inuse(session->translate_buffer) >= packet_len) {
+		enc_frame->datalen = (uint32_t) switch_buffer_read(session->translate_buffer, enc_frame->data, packet_len);
+		enc_frame->samples = to->samples_per_packet;
+		enc_frame->timestamp = 0;
+		*status = perform_write(session, enc_frame, flags, stream_id);
+	}
+
+	return SWITCH_TRUE;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags,
 																int stream_id)
 {
@@ -15974,6 +16153,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 		switch_set_flag(session, SSF_WARN_TRANSCODE);
 	}
 
+	/* bridged legs in G.711 and friends don't need to go through linear */
+	if (!do_resample && !session->bugs && !session->write_resampler && write_translated_frame(session, frame, flags, stream_id, &status)) {
+		goto error;
+	}
+
 	if (frame->codec) {
 		session->raw_write_frame.datalen = session->raw_write_frame.buflen;
 		frame->codec->cur_frame = frame;
@@ -16118,6 +16302,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 	if (session->bugs) {
 		switch_media_bug_t *bp;
 		int prune = 0;
+		uint32_t fanout = 0;
 
 		switch_thread_rwlock_rdlock(session->bug_rwlock);
 		for (bp = session->bugs; bp; bp = bp->next) {
@@ -16140,7 +16325,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				continue;
 			}
 
-			if (switch_test_flag(bp, SMBF_WRITE_STREAM)) {
+			if (switch_test_flag(bp, SMBF_WRITE_STREAM) && bp->fanout_bit) {
+				fanout |= bp->fanout_bit;
+			} else if (switch_test_flag(bp, SMBF_WRITE_STREAM)) {
 				switch_mutex_lock(bp->write_mutex);
 				switch_buffer_write(bp->raw_write_buffer, write_frame->data, write_frame->datalen);
 				switch_mutex_unlock(bp->write_mutex);
@@ -16171,6 +16358,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				prune++;
 			}
 		}
+
+		if (fanout) {
+			switch_core_media_bug_fanout(session, write_frame, SWITCH_ABC_TYPE_WRITE, fanout);
+		}
 		switch_thread_rwlock_unlock(session->bug_rwlock);
 		if (prune) {
 			switch_core_media_bug_prune(session);
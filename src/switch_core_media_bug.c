@@ -35,6 +35,400 @@
 #include "switch.h"
 #include "private/switch_core_pvt.h"
 
+/* Every frame a SMBF_FANOUT bug wants is copied once into the session's ring by the media thread.
+   Each such bug owns a bit in the frames meant for it and a cursor, its callback runs on a worker. */
+#define MEDIA_BUG_RING_FRAMES 64
+#define MEDIA_BUG_RING_MAX_BUGS 32
+/* frames a worker hands one bug before it lets the others have a turn */
+#define MEDIA_BUG_FANOUT_BATCH 8
+
+typedef struct {
+	uint64_t seq;
+	uint32_t mask;
+	switch_abc_type_t type;
+	uint8_t *data;
+	uint32_t datalen;
+	uint32_t size;
+} media_bug_ring_slot_t;
+
+struct switch_media_bug_ring {
+	switch_mutex_t *mutex;
+	uint64_t head;
+	switch_media_bug_t *bugs[MEDIA_BUG_RING_MAX_BUGS];
+	media_bug_ring_slot_t slots[MEDIA_BUG_RING_FRAMES];
+};
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_queue_t *queue;
+	switch_thread_t **threads;
+	uint32_t thread_count;
+} bug_workers;
+
+static void media_bug_fanout_kick(switch_media_bug_t *bp);
+
+/* copy the next frame meant for bp out of the ring, returns SWITCH_FALSE when it has seen them all */
+static switch_bool_t media_bug_fanout_next(switch_media_bug_t *bp)
+{
+	switch_media_bug_ring_t *ring = bp->session->bug_ring;
+	switch_bool_t found = SWITCH_FALSE;
+
+	switch_mutex_lock(ring->mutex);
+
+	if (ring->head > MEDIA_BUG_RING_FRAMES && bp->fanout_cursor < ring->head - MEDIA_BUG_RING_FRAMES) {
+		bp->fanout_cursor = ring->head - MEDIA_BUG_RING_FRAMES;
+	}
+
+	while (bp->fanout_cursor < ring->head) {
+		media_bug_ring_slot_t *slot = &ring->slots[bp->fanout_cursor % MEDIA_BUG_RING_FRAMES];
+
+		bp->fanout_cursor++;
+
+		if ((slot->mask & bp->fanout_bit)) {
+			bp->fanout_datalen = slot->datalen > SWITCH_RECOMMENDED_BUFFER_SIZE ? SWITCH_RECOMMENDED_BUFFER_SIZE : slot->datalen;
+			memcpy(bp->fanout_data, slot->data, bp->fanout_datalen);
+			bp->fanout_type = slot->type;
+			found = SWITCH_TRUE;
+			break;
+		}
+	}
+
+	switch_mutex_unlock(ring->mutex);
+
+	return found;
+}
+
+static switch_bool_t media_bug_fanout_pending(switch_media_bug_t *bp)
+{
+	switch_media_bug_ring_t *ring = bp->session->bug_ring;
+	switch_bool_t pending;
+
+	switch_mutex_lock(ring->mutex);
+	pending = bp->fanout_cursor < ring->head ? SWITCH_TRUE : SWITCH_FALSE;
+	switch_mutex_unlock(ring->mutex);
+
+	return pending;
+}
+
+/* the same thing the media thread does for the other bugs, see switch_core_session_read_frame() and write_frame() */
+static switch_bool_t media_bug_fanout_deliver(switch_media_bug_t *bp)
+{
+	switch_bool_t ok = SWITCH_TRUE;
+
+	if (bp->fanout_type == SWITCH_ABC_TYPE_READ) {
+		switch_mutex_lock(bp->read_mutex);
+		if (bp->read_demux_frame) {
+			uint32_t samples = bp->fanout_datalen / 2 / bp->read_demux_frame->channels;
+			uint32_t datalen = switch_unmerge_sln((int16_t *)bp->fanout_data, samples,
+												  bp->read_demux_frame->data, samples,
+												  bp->read_demux_frame->channels) * 2 * bp->read_demux_frame->channels;
+
+			switch_buffer_write(bp->raw_read_buffer, bp->fanout_data, datalen);
+		} else {
+			switch_buffer_write(bp->raw_read_buffer, bp->fanout_data, bp->fanout_datalen);
+		}
+
+		if (bp->callback) {
+			ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_READ);
+		}
+		switch_mutex_unlock(bp->read_mutex);
+	} else {
+		switch_mutex_lock(bp->write_mutex);
+		switch_buffer_write(bp->raw_write_buffer, bp->fanout_data, bp->fanout_datalen);
+		switch_mutex_unlock(bp->write_mutex);
+
+		if (bp->callback) {
+			ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_WRITE);
+		}
+	}
+
+	return ok;
+}
+
+static void media_bug_fanout_drain(switch_media_bug_t *bp, int max)
+{
+	int frames = 0;
+
+	while ((!max || frames++ < max) && !switch_test_flag(bp, SMBF_PRUNE) && media_bug_fanout_next(bp)) {
+		if (media_bug_fanout_deliver(bp) == SWITCH_FALSE) {
+			/* the media thread prunes it on its next frame */
+			switch_set_flag(bp, SMBF_PRUNE);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC media_bug_worker_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop = NULL;
+
+	while (switch_queue_pop(bug_workers.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		switch_media_bug_t *bp = (switch_media_bug_t *) pop;
+
+		media_bug_fanout_drain(bp, MEDIA_BUG_FANOUT_BATCH);
+
+		/* once busy is clear the bug may be gone, frames that came in meanwhile go around again */
+		switch_mutex_lock(bp->fanout_mutex);
+		if (bp->fanout_closing || !media_bug_fanout_pending(bp) || switch_queue_trypush(bug_workers.queue, bp) != SWITCH_STATUS_SUCCESS) {
+			bp->fanout_busy = 0;
+			switch_thread_cond_broadcast(bp->fanout_cond);
+		}
+		switch_mutex_unlock(bp->fanout_mutex);
+	}
+
+	return NULL;
+}
+
+static switch_status_t media_bug_workers_start(void)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t i, count;
+
+	if (!bug_workers.mutex) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(bug_workers.mutex);
+
+	if (bug_workers.thread_count) {
+		goto end;
+	}
+
+	if (!(count = runtime.media_bug_worker_threads)) {
+		count = SWITCH_DEFAULT_MEDIA_BUG_WORKER_THREADS;
+	}
+
+	switch_queue_create(&bug_workers.queue, SWITCH_CORE_QUEUE_LEN, bug_workers.pool);
+	bug_workers.threads = switch_core_alloc(bug_workers.pool, sizeof(switch_thread_t *) * count);
+
+	for (i = 0; i < count; i++) {
+		switch_threadattr_t *thd_attr = NULL;
+
+		switch_threadattr_create(&thd_attr, bug_workers.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_IMPORTANT);
+
+		if (switch_thread_create(&bug_workers.threads[bug_workers.thread_count], thd_attr, media_bug_worker_thread, NULL, bug_workers.pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+
+		bug_workers.thread_count++;
+	}
+
+	if (!bug_workers.thread_count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to start media bug worker threads\n");
+		status = SWITCH_STATUS_FALSE;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %u media bug worker thread%s\n", bug_workers.thread_count, bug_workers.thread_count == 1 ? "" : "s");
+	}
+
+  end:
+
+	switch_mutex_unlock(bug_workers.mutex);
+
+	return status;
+}
+
+void switch_core_media_bug_workers_init(switch_memory_pool_t *pool)
+{
+	memset(&bug_workers, 0, sizeof(bug_workers));
+	bug_workers.pool = pool;
+	switch_mutex_init(&bug_workers.mutex, SWITCH_MUTEX_NESTED, pool);
+}
+
+void switch_core_media_bug_workers_destroy(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	if (!bug_workers.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(bug_workers.mutex);
+
+	for (i = 0; i < bug_workers.thread_count; i++) {
+		switch_queue_push(bug_workers.queue, NULL);
+	}
+
+	for (i = 0; i < bug_workers.thread_count; i++) {
+		switch_thread_join(&st, bug_workers.threads[i]);
+	}
+
+	bug_workers.thread_count = 0;
+
+	switch_mutex_unlock(bug_workers.mutex);
+}
+
+static void media_bug_fanout_kick(switch_media_bug_t *bp)
+{
+	switch_mutex_lock(bp->fanout_mutex);
+	if (!bp->fanout_busy && !bp->fanout_closing) {
+		bp->fanout_busy = 1;
+
+		if (switch_queue_trypush(bug_workers.queue, bp) != SWITCH_STATUS_SUCCESS) {
+			bp->fanout_busy = 0;
+		}
+	}
+	switch_mutex_unlock(bp->fanout_mutex);
+}
+
+/* called on the media thread with the session's bug_rwlock read locked */
+void switch_core_media_bug_fanout(switch_core_session_t *session, switch_frame_t *frame, switch_abc_type_t type, uint32_t mask)
+{
+	switch_media_bug_ring_t *ring = session->bug_ring;
+	switch_media_bug_t *kick[MEDIA_BUG_RING_MAX_BUGS];
+	media_bug_ring_slot_t *slot;
+	int i, kicks = 0;
+
+	if (!ring || !mask || !frame->datalen) {
+		return;
+	}
+
+	switch_mutex_lock(ring->mutex);
+
+	slot = &ring->slots[ring->head % MEDIA_BUG_RING_FRAMES];
+
+	if (slot->seq) {
+		/* bugs that haven't got to the frame this one replaces lose it */
+		for (i = 0; i < MEDIA_BUG_RING_MAX_BUGS; i++) {
+			switch_media_bug_t *bp = ring->bugs[i];
+
+			if (bp && (slot->mask & bp->fanout_bit) && bp->fanout_cursor <= slot->seq) {
+				bp->fanout_overruns++;
+			}
+		}
+	}
+
+	if (slot->size < frame->datalen) {
+		uint8_t *data;
+
+		if (!(data = realloc(slot->data, frame->datalen))) {
+			switch_mutex_unlock(ring->mutex);
+			return;
+		}
+
+		slot->data = data;
+		slot->size = frame->datalen;
+	}
+
+	memcpy(slot->data, frame->data, frame->datalen);
+	slot->datalen = frame->datalen;
+	slot->type = type;
+	slot->mask = mask;
+	slot->seq = ring->head++;
+
+	for (i = 0; i < MEDIA_BUG_RING_MAX_BUGS; i++) {
+		if ((mask & (1U << i)) && ring->bugs[i]) {
+			kick[kicks++] = ring->bugs[i];
+		}
+	}
+
+	switch_mutex_unlock(ring->mutex);
+
+	for (i = 0; i < kicks; i++) {
+		media_bug_fanout_kick(kick[i]);
+	}
+}
+
+void switch_core_media_bug_ring_destroy(switch_core_session_t *session)
+{
+	switch_media_bug_ring_t *ring = session->bug_ring;
+	int i;
+
+	if (!ring) {
+		return;
+	}
+
+	session->bug_ring = NULL;
+
+	for (i = 0; i < MEDIA_BUG_RING_FRAMES; i++) {
+		switch_safe_free(ring->slots[i].data);
+	}
+}
+
+/* give the bug a bit in the session's ring, SWITCH_STATUS_FALSE leaves it on the media thread */
+static switch_status_t media_bug_fanout_start(switch_media_bug_t *bug)
+{
+	switch_core_session_t *session = bug->session;
+	switch_media_bug_ring_t *ring;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	int i;
+
+	if (media_bug_workers_start() != SWITCH_STATUS_SUCCESS) {
+		return status;
+	}
+
+	switch_thread_rwlock_wrlock(session->bug_rwlock);
+
+	if (!(ring = session->bug_ring)) {
+		ring = switch_core_session_alloc(session, sizeof(*ring));
+		switch_mutex_init(&ring->mutex, SWITCH_MUTEX_NESTED, session->pool);
+		ring->head = 1;
+		session->bug_ring = ring;
+	}
+
+	switch_mutex_lock(ring->mutex);
+	for (i = 0; i < MEDIA_BUG_RING_MAX_BUGS; i++) {
+		if (!ring->bugs[i]) {
+			ring->bugs[i] = bug;
+			bug->fanout_bit = 1U << i;
+			bug->fanout_cursor = ring->head;
+			status = SWITCH_STATUS_SUCCESS;
+			break;
+		}
+	}
+	switch_mutex_unlock(ring->mutex);
+
+	switch_thread_rwlock_unlock(session->bug_rwlock);
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		bug->fanout_data = switch_core_session_alloc(session, SWITCH_RECOMMENDED_BUFFER_SIZE);
+		switch_mutex_init(&bug->fanout_mutex, SWITCH_MUTEX_NESTED, session->pool);
+		switch_thread_cond_create(&bug->fanout_cond, session->pool);
+	}
+
+	return status;
+}
+
+/* wait for the worker, hand the bug what is left in the ring and give its bit back */
+static void media_bug_fanout_stop(switch_media_bug_t *bp)
+{
+	switch_media_bug_ring_t *ring = bp->session->bug_ring;
+	int i;
+
+	if (!ring) {
+		return;
+	}
+
+	switch_mutex_lock(bp->fanout_mutex);
+	bp->fanout_closing = 1;
+	while (bp->fanout_busy) {
+		switch_thread_cond_wait(bp->fanout_cond, bp->fanout_mutex);
+	}
+	switch_mutex_unlock(bp->fanout_mutex);
+
+	media_bug_fanout_drain(bp, 0);
+
+	switch_mutex_lock(ring->mutex);
+	for (i = 0; i < MEDIA_BUG_RING_MAX_BUGS; i++) {
+		if (ring->bugs[i] == bp) {
+			ring->bugs[i] = NULL;
+		}
+	}
+	switch_mutex_unlock(ring->mutex);
+
+	if (bp->fanout_overruns) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(bp->session), SWITCH_LOG_WARNING, "Media bug %s lost %u frame%s, its callback could not keep up\n",
+						  bp->function, bp->fanout_overruns, bp->fanout_overruns == 1 ? "" : "s");
+	}
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_get_overruns(switch_media_bug_t *bug)
+{
+	return bug->fanout_overruns;
+}
+
 static void switch_core_media_bug_destroy(switch_media_bug_t **bug)
 {
 	switch_event_t *event = NULL;
@@ -187,6 +581,12 @@ SWITCH_DECLARE(void) switch_core_media_bug_flush(switch_media_bug_t *bug)
 
 	bug->record_pre_buffer_count = 0;
 
+	if (bug->fanout_bit && bug->session->bug_ring) {
+		switch_mutex_lock(bug->session->bug_ring->mutex);
+		bug->fanout_cursor = bug->session->bug_ring->head;
+		switch_mutex_unlock(bug->session->bug_ring->mutex);
+	}
+
 	if (bug->raw_read_buffer) {
 		switch_mutex_lock(bug->read_mutex);
 		switch_buffer_zero(bug->raw_read_buffer);
@@ -894,8 +1294,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 		bytes = 320;
 	}
 	
-	if (!bug->flags) {
-		bug->flags = (SMBF_READ_STREAM | SMBF_WRITE_STREAM);
+	if (!(bug->flags & ~SMBF_FANOUT)) {
+		bug->flags |= (SMBF_READ_STREAM | SMBF_WRITE_STREAM);
+	}
+
+	if ((p = switch_channel_get_variable(session->channel, "media_bug_fanout")) && switch_true(p)) {
+		bug->flags |= SMBF_FANOUT;
+	}
+
+	/* only plain taps can leave the media thread, the others change or time the media */
+	if (switch_test_flag(bug, SMBF_FANOUT) &&
+		(!(bug->flags & (SMBF_READ_STREAM | SMBF_WRITE_STREAM)) ||
+		 (bug->flags & (SMBF_READ_REPLACE | SMBF_WRITE_REPLACE | SMBF_READ_PING | SMBF_TAP_NATIVE_READ | SMBF_TAP_NATIVE_WRITE)))) {
+		switch_clear_flag(bug, SMBF_FANOUT);
 	}
 
 	if (switch_test_flag(bug, SMBF_READ_STREAM) || switch_test_flag(bug, SMBF_READ_PING)) {
@@ -973,6 +1384,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 
 	}
 
+	if (switch_test_flag(bug, SMBF_FANOUT) && media_bug_fanout_start(bug) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "Media bug %s stays on the media thread\n", bug->function);
+		switch_clear_flag(bug, SMBF_FANOUT);
+	}
+
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Attaching BUG to %s\n", switch_channel_get_name(session->channel));
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
 
@@ -1222,8 +1638,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_enumerate(switch_core_sess
 								   "  <function>%s</function>\n"
 								   "  <target>%s</target>\n"
 								   "  <thread-locked>%d</thread-locked>\n"
+								   "  <fanout>%d</fanout>\n"
+								   "  <overruns>%u</overruns>\n"
 								   " </media-bug>\n",
-								   bp->function, bp->target, thread_locked);
+								   bp->function, bp->target, thread_locked, bp->fanout_bit ? 1 : 0, bp->fanout_overruns);
 
 		}
 		switch_thread_rwlock_unlock(session->bug_rwlock);
@@ -1297,6 +1715,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_close(switch_media_bug_t *
 			return SWITCH_STATUS_FALSE;
 		}
 
+		if (bp->fanout_bit) {
+			media_bug_fanout_stop(bp);
+		}
+
 		if (bp->callback) {
 			bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_CLOSE);
 		}
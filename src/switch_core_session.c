@@ -1412,6 +1412,8 @@ SWITCH_DECLARE(void) switch_core_session_reset(switch_core_session_t *session, s
 	/* wipe these, they will be recreated if need be */
 	switch_mutex_lock(session->codec_write_mutex);
 	switch_buffer_destroy(&session->raw_write_buffer);
+	switch_buffer_destroy(&session->translate_buffer);
+	session->translate_from = session->translate_to = NULL;
 	switch_mutex_unlock(session->codec_write_mutex);
 
 	switch_mutex_lock(session->codec_read_mutex);
@@ -1560,6 +1562,7 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 	switch_core_session_reset(*session, SWITCH_TRUE, SWITCH_TRUE);
 
 	switch_core_media_bug_remove_all(*session);
+	switch_core_media_bug_ring_destroy(*session);
 	switch_ivr_deactivate_unicast(*session);
 
 	switch_scheduler_del_task_group((*session)->uuid_str);
@@ -1594,6 +1597,7 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 
 	switch_buffer_destroy(&(*session)->raw_read_buffer);
 	switch_buffer_destroy(&(*session)->raw_write_buffer);
+	switch_buffer_destroy(&(*session)->translate_buffer);
 	switch_ivr_clear_speech_cache(*session);
 	switch_channel_uninit((*session)->channel);
 
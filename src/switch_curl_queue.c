@@ -0,0 +1,895 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_curl_queue.c -- Queued, batched HTTP delivery with an on-disk spool
+ *
+ */
+
+#include <switch.h>
+#include "switch_curl.h"
+#include <curl/curl.h>
+
+/* how long requests in flight get to finish once the queue is stopped */
+#define CURL_QUEUE_SHUTDOWN_GRACE 5000000
+#define CURL_QUEUE_SPOOL_EXT ".spool"
+
+typedef struct curl_queue_item_s {
+	char *id;
+	/* what the failed callback is told, NULL when it's the id */
+	char *name;
+	char *data;
+	switch_size_t len;
+	/* the spool file, NULL when the item is only in memory */
+	char *path;
+	switch_time_t pushed;
+	struct curl_queue_item_s *next;
+} curl_queue_item_t;
+
+typedef struct curl_queue_request_s {
+	curl_queue_item_t *items;
+	uint32_t count;
+	char *body;
+	switch_size_t body_len;
+	char *url;
+	int url_index;
+	uint32_t attempts;
+	switch_time_t due;
+	switch_CURL *curl;
+	struct curl_queue_request_s *next;
+} curl_queue_request_t;
+
+struct switch_curl_queue_s {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_thread_t *thread;
+
+	char *name;
+	char **urls;
+	int url_count;
+	int url_index;
+	switch_curl_slist_t *headers;
+	char *batch_prefix;
+	char *batch_separator;
+	char *batch_suffix;
+	char *id_param;
+	uint32_t batch_size;
+	uint32_t max_concurrent;
+	uint32_t capacity;
+	char *spool_dir;
+	uint32_t attempts;
+	uint32_t retry_delay_ms;
+	uint32_t max_retry_delay_ms;
+	switch_curl_queue_setup_func_t setup;
+	switch_curl_queue_failed_func_t failed;
+	void *user_data;
+
+	/* items not yet in a request */
+	curl_queue_item_t *head;
+	curl_queue_item_t *tail;
+	/* requests waiting to be retried, soonest first */
+	curl_queue_request_t *retry;
+	/* requests in flight */
+	curl_queue_request_t *active;
+	/* spool files of the items in memory */
+	switch_hash_t *spooled;
+	/* spool files not loaded yet, a hint for when to look at the spool */
+	uint32_t overflow;
+	uint32_t seq;
+	int running;
+	switch_curl_queue_stats_t stats;
+};
+
+static size_t curl_queue_discard(char *buffer, size_t size, size_t nitems, void *user_data)
+{
+	return size * nitems;
+}
+
+static void curl_queue_item_free(curl_queue_item_t *item)
+{
+	switch_safe_free(item->id);
+	switch_safe_free(item->name);
+	switch_safe_free(item->data);
+	switch_safe_free(item->path);
+	free(item);
+}
+
+static void curl_queue_request_free(curl_queue_request_t *request)
+{
+	curl_queue_item_t *item;
+
+	while ((item = request->items)) {
+		request->items = item->next;
+		curl_queue_item_free(item);
+	}
+
+	if (request->curl) {
+		switch_curl_easy_cleanup(request->curl);
+	}
+
+	switch_safe_free(request->body);
+	switch_safe_free(request->url);
+	free(request);
+}
+
+/* make a rename in the spool dir survive a crash, a no-op where directories can't be synced */
+static void curl_queue_spool_sync_dir(switch_curl_queue_t *queue)
+{
+#ifndef WIN32
+	int fd;
+
+	if ((fd = open(queue->spool_dir, O_RDONLY)) >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+#endif
+}
+
+static switch_bool_t curl_queue_spool_write(switch_curl_queue_t *queue, const char *path, const char *id, const char *name,
+											const char *data, switch_size_t len)
+{
+	char *tmp = switch_mprintf("%s.tmp", path);
+	FILE *fp;
+	switch_bool_t ok = SWITCH_FALSE;
+
+	if ((fp = fopen(tmp, "wb"))) {
+		ok = fprintf(fp, "%s%s%s\n", id, name ? " " : "", name ? name : "") > 0 && fwrite(data, 1, len, fp) == len && fflush(fp) == 0;
+
+		/* the data has to be on disk before the name is, or a crash leaves an empty spool file */
+#ifdef WIN32
+		ok = ok && _commit(_fileno(fp)) == 0;
+#else
+		ok = ok && fsync(fileno(fp)) == 0;
+#endif
+		ok = fclose(fp) == 0 && ok;
+
+		/* only complete files ever carry the spool name */
+		if (ok && rename(tmp, path)) {
+			ok = SWITCH_FALSE;
+		}
+
+		if (ok) {
+			curl_queue_spool_sync_dir(queue);
+		}
+
+		if (!ok) {
+			unlink(tmp);
+		}
+	}
+
+	if (!ok) {
+		char ebuf[512] = { 0 };
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: error spooling to %s [%s]\n",
+						  queue->name, path, switch_strerror_r(errno, ebuf, sizeof(ebuf)));
+	}
+
+	switch_safe_free(tmp);
+
+	return ok;
+}
+
+static curl_queue_item_t *curl_queue_spool_read(const char *path)
+{
+	curl_queue_item_t *item = NULL;
+	FILE *fp;
+	char *buf = NULL, *p, *name;
+	long size;
+
+	if (!(fp = fopen(path, "rb"))) {
+		return NULL;
+	}
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET)) {
+		goto end;
+	}
+
+	switch_malloc(buf, size + 1);
+
+	if (fread(buf, 1, size, fp) != (size_t) size) {
+		goto end;
+	}
+
+	buf[size] = '\0';
+
+	if (!(p = memchr(buf, '\n', size))) {
+		goto end;
+	}
+
+	*p++ = '\0';
+
+	switch_zmalloc(item, sizeof(*item));
+
+	/* the first line is the id, then the name if it has one */
+	if ((name = strchr(buf, ' '))) {
+		*name++ = '\0';
+		item->name = strdup(name);
+	}
+
+	item->id = strdup(buf);
+	item->len = size - (p - buf);
+	switch_malloc(item->data, item->len + 1);
+	memcpy(item->data, p, item->len);
+	item->data[item->len] = '\0';
+	item->path = strdup(path);
+	item->pushed = switch_micro_time_now();
+
+  end:
+
+	fclose(fp);
+	switch_safe_free(buf);
+
+	return item;
+}
+
+static int curl_queue_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*!
+ * Load the oldest spool files that aren't in memory, as many as there is
+ * room for.  Called from the delivery thread with the mutex held, the mutex
+ * is dropped while reading the directory.
+ */
+static void curl_queue_spool_load(switch_curl_queue_t *queue)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_dir_t *dir = NULL;
+	char buf[256];
+	const char *fname;
+	char **names = NULL;
+	size_t prefix_len = strlen(queue->name), ext_len = strlen(CURL_QUEUE_SPOOL_EXT);
+	uint32_t count = 0, size = 0, loaded = 0, i;
+
+	switch_mutex_unlock(queue->mutex);
+
+	switch_core_new_memory_pool(&pool);
+
+	if (switch_dir_open(&dir, queue->spool_dir, pool) == SWITCH_STATUS_SUCCESS) {
+		while ((fname = switch_dir_next_file(dir, buf, sizeof(buf)))) {
+			size_t len = strlen(fname);
+
+			if (len <= prefix_len + ext_len || strncmp(fname, queue->name, prefix_len) || fname[prefix_len] != '-' ||
+				strcmp(fname + len - ext_len, CURL_QUEUE_SPOOL_EXT)) {
+				continue;
+			}
+
+			if (count == size) {
+				size = size ? size * 2 : 64;
+				names = realloc(names, size * sizeof(*names));
+				switch_assert(names);
+			}
+
+			names[count++] = strdup(fname);
+		}
+		switch_dir_close(dir);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	/* the names sort in the order the items were pushed */
+	if (count) {
+		qsort(names, count, sizeof(*names), curl_queue_name_cmp);
+	}
+
+	switch_mutex_lock(queue->mutex);
+
+	queue->overflow = 0;
+
+	for (i = 0; i < count; i++) {
+		char *path = switch_mprintf("%s%s%s", queue->spool_dir, SWITCH_PATH_SEPARATOR, names[i]);
+		curl_queue_item_t *item;
+
+		if (!switch_core_hash_find(queue->spooled, path)) {
+			if (queue->stats.depth >= queue->capacity) {
+				queue->overflow++;
+			} else if ((item = curl_queue_spool_read(path))) {
+				switch_core_hash_insert(queue->spooled, item->path, item);
+
+				if (queue->tail) {
+					queue->tail->next = item;
+				} else {
+					queue->head = item;
+				}
+				queue->tail = item;
+
+				if (++queue->stats.depth > queue->stats.max_depth) {
+					queue->stats.max_depth = queue->stats.depth;
+				}
+				loaded++;
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: discarding unreadable spool file %s\n", queue->name, path);
+				unlink(path);
+			}
+		}
+
+		switch_safe_free(path);
+		free(names[i]);
+	}
+
+	switch_safe_free(names);
+
+	if (loaded) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s: loaded %u item(s) from the spool, %u left on disk\n",
+						  queue->name, loaded, queue->overflow);
+	}
+}
+
+static switch_time_t curl_queue_backoff(switch_curl_queue_t *queue, uint32_t attempts)
+{
+	switch_time_t delay = (switch_time_t) queue->retry_delay_ms * 1000;
+
+	while (--attempts && delay < (switch_time_t) queue->max_retry_delay_ms * 1000) {
+		delay *= 2;
+	}
+
+	if (delay > (switch_time_t) queue->max_retry_delay_ms * 1000) {
+		delay = (switch_time_t) queue->max_retry_delay_ms * 1000;
+	}
+
+	/* up to a quarter more so requests that failed together don't come back together */
+	return delay + (delay / 4 ? rand() % (delay / 4) : 0);
+}
+
+/*!
+ * Take the next request to send: a retry that is due, or a new one made
+ * of the oldest items.  Expects the mutex to be held.
+ */
+static curl_queue_request_t *curl_queue_next_request(switch_curl_queue_t *queue, switch_time_t now)
+{
+	curl_queue_request_t *request;
+	curl_queue_item_t *item;
+	size_t prefix_len, separator_len, suffix_len;
+	char *p;
+
+	if (queue->retry && queue->retry->due <= now) {
+		request = queue->retry;
+		queue->retry = request->next;
+		request->next = NULL;
+		return request;
+	}
+
+	if (!queue->head) {
+		return NULL;
+	}
+
+	switch_zmalloc(request, sizeof(*request));
+	request->items = queue->head;
+
+	for (item = queue->head; item; item = item->next) {
+		request->body_len += item->len;
+		if (++request->count == queue->batch_size || !item->next) {
+			break;
+		}
+	}
+
+	queue->head = item->next;
+	if (!queue->head) {
+		queue->tail = NULL;
+	}
+	item->next = NULL;
+
+	prefix_len = strlen(queue->batch_prefix);
+	separator_len = strlen(queue->batch_separator);
+	suffix_len = strlen(queue->batch_suffix);
+	request->body_len += prefix_len + suffix_len + separator_len * (request->count - 1);
+
+	switch_malloc(request->body, request->body_len + 1);
+	p = request->body;
+	memcpy(p, queue->batch_prefix, prefix_len);
+	p += prefix_len;
+
+	for (item = request->items; item; item = item->next) {
+		if (item != request->items) {
+			memcpy(p, queue->batch_separator, separator_len);
+			p += separator_len;
+		}
+		memcpy(p, item->data, item->len);
+		p += item->len;
+	}
+
+	memcpy(p, queue->batch_suffix, suffix_len);
+	p += suffix_len;
+	*p = '\0';
+
+	return request;
+}
+
+/*!
+ * Hand a request to curl.  Expects the mutex to be held.
+ */
+static void curl_queue_start_request(switch_curl_queue_t *queue, CURLM *multi, curl_queue_request_t *request)
+{
+	const char *url;
+
+	request->url_index = queue->url_index;
+	url = queue->urls[request->url_index];
+
+	switch_safe_free(request->url);
+	if (request->count == 1 && !zstr(queue->id_param)) {
+		request->url = switch_mprintf("%s%c%s=%s", url, strchr(url, '?') ? '&' : '?', queue->id_param, request->items->id);
+	} else {
+		request->url = strdup(url);
+	}
+
+	if (request->curl) {
+		switch_curl_easy_cleanup(request->curl);
+	}
+
+	request->curl = switch_curl_easy_init();
+	switch_curl_easy_setopt(request->curl, CURLOPT_URL, request->url);
+	switch_curl_easy_setopt(request->curl, CURLOPT_POST, 1);
+	switch_curl_easy_setopt(request->curl, CURLOPT_NOSIGNAL, 1);
+	switch_curl_easy_setopt(request->curl, CURLOPT_POSTFIELDS, request->body);
+	switch_curl_easy_setopt(request->curl, CURLOPT_POSTFIELDSIZE, (long) request->body_len);
+	switch_curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, curl_queue_discard);
+	switch_curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+
+	if (queue->headers) {
+		switch_curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, queue->headers);
+	}
+
+	if (queue->setup) {
+		queue->setup(request->curl, request->url, queue->user_data);
+	}
+
+	request->attempts++;
+	request->next = queue->active;
+	queue->active = request;
+	queue->stats.in_flight++;
+	queue->stats.requests++;
+
+	curl_multi_add_handle(multi, request->curl);
+}
+
+static void curl_queue_unlink_active(switch_curl_queue_t *queue, curl_queue_request_t *request)
+{
+	curl_queue_request_t **rp;
+
+	for (rp = &queue->active; *rp; rp = &(*rp)->next) {
+		if (*rp == request) {
+			*rp = request->next;
+			request->next = NULL;
+			queue->stats.in_flight--;
+			break;
+		}
+	}
+}
+
+/*!
+ * Drop a request's items from the queue.  Delivered or failed items are
+ * taken off the spool, the others are left there for the next run and the
+ * ones without a spool file go to the failed callback.  Expects the mutex
+ * to be held, drops it around the callback and file removal.
+ */
+static void curl_queue_release_request(switch_curl_queue_t *queue, curl_queue_request_t *request, switch_bool_t done, switch_bool_t delivered)
+{
+	curl_queue_item_t *item;
+
+	for (item = request->items; item; item = item->next) {
+		if (item->path) {
+			switch_core_hash_delete(queue->spooled, item->path);
+		}
+	}
+
+	queue->stats.depth -= request->count;
+
+	if (delivered) {
+		queue->stats.delivered += request->count;
+		queue->stats.last_latency = switch_micro_time_now() - request->items->pushed;
+	} else if (done) {
+		queue->stats.failed += request->count;
+	}
+
+	switch_mutex_unlock(queue->mutex);
+
+	for (item = request->items; item; item = item->next) {
+		if (!delivered && (done || !item->path) && queue->failed) {
+			queue->failed(item->name ? item->name : item->id, item->data, item->len, queue->user_data);
+		}
+
+		if (item->path && done) {
+			unlink(item->path);
+		}
+	}
+
+	curl_queue_request_free(request);
+
+	switch_mutex_lock(queue->mutex);
+}
+
+/*!
+ * Deal with the outcome of a request.  Expects the mutex to be held.
+ */
+static void curl_queue_finish_request(switch_curl_queue_t *queue, curl_queue_request_t *request, long code, CURLcode result)
+{
+	curl_queue_request_t **rp;
+
+	curl_queue_unlink_active(queue, request);
+
+	if (code >= 200 && code <= 299) {
+		curl_queue_release_request(queue, request, SWITCH_TRUE, SWITCH_TRUE);
+		return;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: got error [%ld] [%s] posting %u item(s) to web server [%s]\n",
+					  queue->name, code, switch_curl_easy_strerror(result), request->count, queue->urls[request->url_index]);
+
+	/* move on to the next url, unless another request already did */
+	if (queue->url_index == request->url_index && queue->url_count > 1) {
+		queue->url_index = (queue->url_index + 1) % queue->url_count;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: retry will be with url [%s]\n", queue->name, queue->urls[queue->url_index]);
+	}
+
+	if (!queue->running) {
+		curl_queue_release_request(queue, request, SWITCH_FALSE, SWITCH_FALSE);
+		return;
+	}
+
+	if (request->attempts >= queue->attempts) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: unable to post %u item(s) to web server after %u attempt(s)\n",
+						  queue->name, request->count, request->attempts);
+		curl_queue_release_request(queue, request, SWITCH_TRUE, SWITCH_FALSE);
+		return;
+	}
+
+	queue->stats.retries++;
+	request->due = switch_micro_time_now() + curl_queue_backoff(queue, request->attempts);
+
+	for (rp = &queue->retry; *rp && (*rp)->due <= request->due; rp = &(*rp)->next);
+	request->next = *rp;
+	*rp = request;
+}
+
+static void *SWITCH_THREAD_FUNC curl_queue_thread(switch_thread_t *thread, void *obj)
+{
+	switch_curl_queue_t *queue = (switch_curl_queue_t *) obj;
+	CURLM *multi = curl_multi_init();
+	switch_time_t deadline = 0;
+	curl_queue_request_t *request;
+	curl_queue_item_t *item;
+
+	switch_mutex_lock(queue->mutex);
+
+	while (queue->running || queue->active) {
+		switch_time_t now = switch_micro_time_now();
+		CURLMsg *msg;
+		int still_running = 0, left = 0;
+
+		if (queue->running) {
+			if (queue->overflow && queue->stats.depth <= queue->capacity / 2) {
+				curl_queue_spool_load(queue);
+			}
+
+			while (queue->stats.in_flight < queue->max_concurrent && (request = curl_queue_next_request(queue, now))) {
+				curl_queue_start_request(queue, multi, request);
+			}
+
+			if (!queue->active) {
+				switch_time_t wait = 1000000;
+
+				if (queue->retry && queue->retry->due - now < wait) {
+					wait = queue->retry->due - now;
+				}
+
+				if (wait > 0) {
+					switch_thread_cond_timedwait(queue->cond, queue->mutex, wait);
+				}
+				continue;
+			}
+		} else if (!deadline) {
+			deadline = now + CURL_QUEUE_SHUTDOWN_GRACE;
+		} else if (now > deadline) {
+			while ((request = queue->active)) {
+				curl_multi_remove_handle(multi, request->curl);
+				curl_queue_unlink_active(queue, request);
+				curl_queue_release_request(queue, request, SWITCH_FALSE, SWITCH_FALSE);
+			}
+			break;
+		}
+
+		switch_mutex_unlock(queue->mutex);
+
+		curl_multi_perform(multi, &still_running);
+
+		switch_mutex_lock(queue->mutex);
+		while ((msg = curl_multi_info_read(multi, &left))) {
+			long code = 0;
+			char *private = NULL;
+
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			switch_curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+			switch_curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &private);
+			curl_multi_remove_handle(multi, msg->easy_handle);
+			curl_queue_finish_request(queue, (curl_queue_request_t *) private, code, msg->data.result);
+		}
+		switch_mutex_unlock(queue->mutex);
+
+		/* new items wait at most this long for a free slot to be noticed */
+#if defined(LIBCURL_VERSION_NUM) && (LIBCURL_VERSION_NUM >= 0x071c00)
+		curl_multi_wait(multi, NULL, 0, 20, NULL);
+#else
+		switch_yield(20000);
+#endif
+
+		switch_mutex_lock(queue->mutex);
+	}
+
+	if (queue->stats.depth || queue->overflow) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s: stopping with %u item(s) undelivered\n",
+						  queue->name, queue->stats.depth + queue->overflow);
+	}
+
+	/* whatever is left waits in the spool for the next run */
+	while ((request = queue->retry)) {
+		queue->retry = request->next;
+		curl_queue_release_request(queue, request, SWITCH_FALSE, SWITCH_FALSE);
+	}
+
+	while ((item = queue->head)) {
+		queue->head = item->next;
+		switch_zmalloc(request, sizeof(*request));
+		request->items = item;
+		request->count = 1;
+		item->next = NULL;
+		curl_queue_release_request(queue, request, SWITCH_FALSE, SWITCH_FALSE);
+	}
+	queue->tail = NULL;
+
+	switch_mutex_unlock(queue->mutex);
+
+	curl_multi_cleanup(multi);
+
+	return NULL;
+}
+
+static char *curl_queue_strdup(switch_curl_queue_t *queue, const char *str)
+{
+	return switch_core_strdup(queue->pool, switch_str_nil(str));
+}
+
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_create(switch_curl_queue_t **queuep, const switch_curl_queue_settings_t *settings)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_curl_queue_t *queue;
+	switch_threadattr_t *thd_attr = NULL;
+	int i;
+
+	switch_assert(queuep && settings);
+
+	if (!settings->url_count || zstr(settings->name)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	queue = switch_core_alloc(pool, sizeof(*queue));
+	queue->pool = pool;
+
+	queue->name = curl_queue_strdup(queue, settings->name);
+	queue->url_count = settings->url_count;
+	queue->urls = switch_core_alloc(pool, sizeof(char *) * queue->url_count);
+	for (i = 0; i < queue->url_count; i++) {
+		queue->urls[i] = curl_queue_strdup(queue, settings->urls[i]);
+	}
+
+	for (i = 0; settings->headers && settings->headers[i]; i++) {
+		queue->headers = switch_curl_slist_append(queue->headers, settings->headers[i]);
+	}
+
+	queue->batch_prefix = curl_queue_strdup(queue, settings->batch_prefix);
+	queue->batch_separator = curl_queue_strdup(queue, settings->batch_separator);
+	queue->batch_suffix = curl_queue_strdup(queue, settings->batch_suffix);
+	queue->id_param = curl_queue_strdup(queue, settings->id_param);
+	queue->batch_size = settings->batch_size ? settings->batch_size : 1;
+	queue->max_concurrent = settings->max_concurrent ? settings->max_concurrent : 1;
+	queue->capacity = settings->capacity ? settings->capacity : 1000;
+	queue->attempts = settings->attempts ? settings->attempts : 1;
+	queue->retry_delay_ms = settings->retry_delay_ms ? settings->retry_delay_ms : 1000;
+	queue->max_retry_delay_ms = settings->max_retry_delay_ms > queue->retry_delay_ms ? settings->max_retry_delay_ms : queue->retry_delay_ms;
+	queue->setup = settings->setup;
+	queue->failed = settings->failed;
+	queue->user_data = settings->user_data;
+
+	if (!zstr(settings->spool_dir)) {
+		queue->spool_dir = curl_queue_strdup(queue, settings->spool_dir);
+
+		if (switch_dir_make_recursive(queue->spool_dir, SWITCH_DEFAULT_DIR_PERMS, pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: can't create spool dir %s\n", queue->name, queue->spool_dir);
+			switch_curl_slist_free_all(queue->headers);
+			switch_core_destroy_memory_pool(&pool);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		/* pick up what a previous run left behind */
+		queue->overflow = 1;
+	}
+
+	switch_core_hash_init(&queue->spooled);
+	switch_mutex_init(&queue->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&queue->cond, pool);
+	queue->running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&queue->thread, thd_attr, curl_queue_thread, queue, pool);
+
+	*queuep = queue;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_push(switch_curl_queue_t *queue, const char *id, const char *data, switch_size_t len)
+{
+	return switch_curl_queue_push_named(queue, id, NULL, data, len);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_curl_queue_push_named(switch_curl_queue_t *queue, const char *id, const char *name,
+															 const char *data, switch_size_t len)
+{
+	curl_queue_item_t *item = NULL;
+	char *path = NULL;
+	switch_bool_t spooled = SWITCH_FALSE;
+
+	switch_assert(queue && id && data);
+
+	switch_mutex_lock(queue->mutex);
+
+	if (!queue->running || (queue->stats.depth >= queue->capacity && !queue->spool_dir)) {
+		queue->stats.rejected++;
+		switch_mutex_unlock(queue->mutex);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (queue->spool_dir) {
+		path = switch_mprintf("%s%s%s-%016" SWITCH_TIME_T_FMT "-%08x" CURL_QUEUE_SPOOL_EXT,
+							  queue->spool_dir, SWITCH_PATH_SEPARATOR, queue->name, switch_micro_time_now(), queue->seq++);
+	}
+
+	if (queue->stats.depth < queue->capacity) {
+		/* keep our place, and keep the spool loader off the file we're about to write */
+		switch_zmalloc(item, sizeof(*item));
+		item->id = strdup(id);
+		item->name = name ? strdup(name) : NULL;
+		switch_malloc(item->data, len + 1);
+		memcpy(item->data, data, len);
+		item->data[len] = '\0';
+		item->len = len;
+		item->pushed = switch_micro_time_now();
+
+		if (path) {
+			item->path = path;
+			switch_core_hash_insert(queue->spooled, path, item);
+		}
+
+		if (++queue->stats.depth > queue->stats.max_depth) {
+			queue->stats.max_depth = queue->stats.depth;
+		}
+	}
+
+	queue->stats.pushed++;
+
+	switch_mutex_unlock(queue->mutex);
+
+	if (path) {
+		spooled = curl_queue_spool_write(queue, path, id, name, data, len);
+	}
+
+	switch_mutex_lock(queue->mutex);
+
+	if (item) {
+		if (path && !spooled) {
+			switch_core_hash_delete(queue->spooled, path);
+			switch_safe_free(item->path);
+		}
+
+		if (queue->tail) {
+			queue->tail->next = item;
+		} else {
+			queue->head = item;
+		}
+		queue->tail = item;
+
+		switch_thread_cond_signal(queue->cond);
+	} else if (spooled) {
+		/* full, it waits on disk until there's room */
+		queue->overflow++;
+	} else {
+		queue->stats.pushed--;
+		queue->stats.rejected++;
+	}
+
+	switch_mutex_unlock(queue->mutex);
+
+	if (!item) {
+		switch_safe_free(path);
+	}
+
+	return item || spooled ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+SWITCH_DECLARE(void) switch_curl_queue_stats(switch_curl_queue_t *queue, switch_curl_queue_stats_t *stats)
+{
+	switch_assert(queue && stats);
+
+	switch_mutex_lock(queue->mutex);
+	*stats = queue->stats;
+	stats->spooled = queue->overflow;
+	switch_mutex_unlock(queue->mutex);
+}
+
+SWITCH_DECLARE(void) switch_curl_queue_status(switch_curl_queue_t *queue, switch_stream_handle_t *stream)
+{
+	switch_curl_queue_stats_t stats = { 0 };
+
+	switch_curl_queue_stats(queue, &stats);
+	stream->write_function(stream, "queued %u/%u (max %u) spooled %u in-flight %u\n"
+						   "pushed %" SWITCH_UINT64_T_FMT " delivered %" SWITCH_UINT64_T_FMT " failed %" SWITCH_UINT64_T_FMT
+						   " rejected %" SWITCH_UINT64_T_FMT "\nrequests %" SWITCH_UINT64_T_FMT " retries %" SWITCH_UINT64_T_FMT
+						   " last-latency %" SWITCH_TIME_T_FMT "ms\n",
+						   stats.depth, queue->capacity, stats.max_depth, stats.spooled, stats.in_flight,
+						   stats.pushed, stats.delivered, stats.failed, stats.rejected, stats.requests, stats.retries,
+						   stats.last_latency / 1000);
+}
+
+SWITCH_DECLARE(void) switch_curl_queue_destroy(switch_curl_queue_t **queuep)
+{
+	switch_curl_queue_t *queue;
+	switch_memory_pool_t *pool;
+	switch_status_t st;
+
+	if (!queuep || !(queue = *queuep)) {
+		return;
+	}
+
+	*queuep = NULL;
+
+	switch_mutex_lock(queue->mutex);
+	queue->running = 0;
+	switch_thread_cond_signal(queue->cond);
+	switch_mutex_unlock(queue->mutex);
+
+	switch_thread_join(&st, queue->thread);
+
+	switch_core_hash_destroy(&queue->spooled);
+	switch_curl_slist_free_all(queue->headers);
+
+	pool = queue->pool;
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
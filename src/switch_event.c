@@ -1771,7 +1771,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_create_json(switch_event_t **event,
 	cJSON *cj, *cjp;
 
 
-	if (!(cj = cJSON_Parse(json))) {
+	if (!(cj = cJSON_ParseReadOnly(json))) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -0,0 +1,490 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_g711.c -- G.711 encode and decode over whole frames
+ *
+ * The vector kernels give exactly what linear_to_ulaw() and friends in
+ * g711.h give for every input.  The segment of a sample is the exponent
+ * of the sample converted to float and the four bits under its leading
+ * one are the top of the float's mantissa, which is what the scalar code
+ * gets from top_bit() and a shift.
+ *
+ */
+
+#include <switch.h>
+#include <g711.h>
+#include "private/switch_core_pvt.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define G711_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define G711_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*g711_encode_func_t)(uint8_t *out, const int16_t *in, switch_size_t samples);
+typedef void (*g711_decode_func_t)(int16_t *out, const uint8_t *in, switch_size_t samples);
+
+static void ulaw_encode_scalar(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i < samples; i++) {
+		out[i] = linear_to_ulaw(in[i]);
+	}
+}
+
+static void ulaw_decode_scalar(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i < samples; i++) {
+		out[i] = ulaw_to_linear(in[i]);
+	}
+}
+
+static void alaw_encode_scalar(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i < samples; i++) {
+		out[i] = linear_to_alaw(in[i]);
+	}
+}
+
+static void alaw_decode_scalar(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i < samples; i++) {
+		out[i] = alaw_to_linear(in[i]);
+	}
+}
+
+#ifdef G711_X86
+
+/* 1 << segment as bytes, for pshufb */
+#define ULAW_POW2 0, 0, 0, 0, 0, 0, 0, 0, (char) 128, 64, 32, 16, 8, 4, 2, 1
+#define ALAW_POW2 0, 0, 0, 0, 0, 0, 0, 0, 64, 32, 16, 8, 4, 2, 1, 1
+
+__attribute__((target("sse4.1")))
+static inline __m128i ulaw_encode_sse41_4(__m128i x)
+{
+	__m128i neg = _mm_srai_epi32(x, 31);
+	/* 0x84 + x, or 0x84 - x below zero */
+	__m128i mag = _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(x, neg), neg), _mm_set1_epi32(ULAW_BIAS));
+	__m128i bits = _mm_castps_si128(_mm_cvtepi32_ps(mag));
+	/* segment << 4 | 4 bits under the leading one, the biased exponent of 0x80 is 134 */
+	__m128i code = _mm_min_epi32(_mm_sub_epi32(_mm_srli_epi32(bits, 19), _mm_set1_epi32(134 << 4)), _mm_set1_epi32(0x7F));
+
+	return _mm_xor_si128(code, _mm_add_epi32(_mm_set1_epi32(0xFF), _mm_slli_epi32(neg, 7)));
+}
+
+__attribute__((target("sse4.1")))
+static void ulaw_encode_sse41(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i lo = ulaw_encode_sse41_4(_mm_cvtepi16_epi32(x));
+		__m128i hi = ulaw_encode_sse41_4(_mm_cvtepi16_epi32(_mm_srli_si128(x, 8)));
+		__m128i codes = _mm_packus_epi16(_mm_packus_epi32(lo, hi), _mm_setzero_si128());
+
+		_mm_storel_epi64((__m128i *) (out + i), codes);
+	}
+
+	ulaw_encode_scalar(out + i, in + i, samples - i);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i ulaw_decode_sse41_8(__m128i u)
+{
+	const __m128i pow2 = _mm_setr_epi8(ULAW_POW2);
+	__m128i c = _mm_xor_si128(u, _mm_set1_epi16(0xFF));
+	__m128i mant = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(c, _mm_set1_epi16(0x0F)), 3), _mm_set1_epi16(ULAW_BIAS));
+	/* the complemented segment picks from the top of the table, 0x80 in the high byte reads zero */
+	__m128i seg = _mm_or_si128(_mm_srli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x70)), 4), _mm_set1_epi16((short) 0x8008));
+	__m128i t = _mm_sub_epi16(_mm_mullo_epi16(mant, _mm_shuffle_epi8(pow2, seg)), _mm_set1_epi16(ULAW_BIAS));
+	__m128i neg = _mm_cmpeq_epi16(_mm_and_si128(u, _mm_set1_epi16(0x80)), _mm_setzero_si128());
+
+	return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+__attribute__((target("sse4.1")))
+static void ulaw_decode_sse41(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i u = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (in + i)));
+
+		_mm_storeu_si128((__m128i *) (out + i), ulaw_decode_sse41_8(u));
+	}
+
+	ulaw_decode_scalar(out + i, in + i, samples - i);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i alaw_encode_sse41_4(__m128i x)
+{
+	__m128i neg = _mm_srai_epi32(x, 31);
+	/* x, or -x - 8 below zero */
+	__m128i v = _mm_add_epi32(_mm_xor_si128(x, neg), _mm_and_si128(neg, _mm_set1_epi32(-7)));
+	__m128i bits = _mm_castps_si128(_mm_cvtepi32_ps(v));
+	__m128i high = _mm_sub_epi32(_mm_srli_epi32(bits, 19), _mm_set1_epi32(134 << 4));
+	__m128i code = _mm_blendv_epi8(_mm_srli_epi32(v, 4), high, _mm_cmpgt_epi32(v, _mm_set1_epi32(0xFF)));
+	__m128i mask = _mm_add_epi32(_mm_set1_epi32(ALAW_AMI_MASK | 0x80), _mm_slli_epi32(neg, 7));
+
+	/* just below zero comes out as 0 before the mask */
+	code = _mm_andnot_si128(_mm_srai_epi32(v, 31), code);
+
+	return _mm_xor_si128(code, mask);
+}
+
+__attribute__((target("sse4.1")))
+static void alaw_encode_sse41(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i lo = alaw_encode_sse41_4(_mm_cvtepi16_epi32(x));
+		__m128i hi = alaw_encode_sse41_4(_mm_cvtepi16_epi32(_mm_srli_si128(x, 8)));
+		__m128i codes = _mm_packus_epi16(_mm_packus_epi32(lo, hi), _mm_setzero_si128());
+
+		_mm_storel_epi64((__m128i *) (out + i), codes);
+	}
+
+	alaw_encode_scalar(out + i, in + i, samples - i);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i alaw_decode_sse41_8(__m128i a)
+{
+	const __m128i pow2 = _mm_setr_epi8(ALAW_POW2);
+	__m128i c = _mm_xor_si128(a, _mm_set1_epi16(ALAW_AMI_MASK));
+	__m128i seg = _mm_and_si128(c, _mm_set1_epi16(0x70));
+	/* segment 0 adds 8 and isn't shifted, the others add 0x108 and shift by segment - 1 */
+	__m128i base = _mm_blendv_epi8(_mm_set1_epi16(0x108), _mm_set1_epi16(8), _mm_cmpeq_epi16(seg, _mm_setzero_si128()));
+	__m128i i = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(c, _mm_set1_epi16(0x0F)), 4), base);
+	__m128i idx = _mm_or_si128(_mm_xor_si128(_mm_srli_epi16(seg, 4), _mm_set1_epi16(0x0F)), _mm_set1_epi16((short) 0x8000));
+	__m128i neg = _mm_cmpeq_epi16(_mm_and_si128(c, _mm_set1_epi16(0x80)), _mm_setzero_si128());
+
+	i = _mm_mullo_epi16(i, _mm_shuffle_epi8(pow2, idx));
+
+	return _mm_sub_epi16(_mm_xor_si128(i, neg), neg);
+}
+
+__attribute__((target("sse4.1")))
+static void alaw_decode_sse41(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (in + i)));
+
+		_mm_storeu_si128((__m128i *) (out + i), alaw_decode_sse41_8(a));
+	}
+
+	alaw_decode_scalar(out + i, in + i, samples - i);
+}
+
+/* the same with twice the lanes, pack and shuffle work per 128 bit half so the halves are put back in order */
+
+__attribute__((target("avx2")))
+static inline __m256i ulaw_encode_avx2_8(__m256i x)
+{
+	__m256i neg = _mm256_srai_epi32(x, 31);
+	__m256i mag = _mm256_add_epi32(_mm256_sub_epi32(_mm256_xor_si256(x, neg), neg), _mm256_set1_epi32(ULAW_BIAS));
+	__m256i bits = _mm256_castps_si256(_mm256_cvtepi32_ps(mag));
+	__m256i code = _mm256_min_epi32(_mm256_sub_epi32(_mm256_srli_epi32(bits, 19), _mm256_set1_epi32(134 << 4)), _mm256_set1_epi32(0x7F));
+
+	return _mm256_xor_si256(code, _mm256_add_epi32(_mm256_set1_epi32(0xFF), _mm256_slli_epi32(neg, 7)));
+}
+
+__attribute__((target("avx2")))
+static void ulaw_encode_avx2(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (in + i));
+		__m256i lo = ulaw_encode_avx2_8(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+		__m256i hi = ulaw_encode_avx2_8(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+		__m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+		__m256i codes = _mm256_packus_epi16(words, _mm256_setzero_si256());
+
+		_mm_storeu_si128((__m128i *) (out + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(codes, 0xD8)));
+	}
+
+	ulaw_encode_sse41(out + i, in + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_decode_avx2(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	const __m256i pow2 = _mm256_setr_epi8(ULAW_POW2, ULAW_POW2);
+	switch_size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (in + i)));
+		__m256i c = _mm256_xor_si256(u, _mm256_set1_epi16(0xFF));
+		__m256i mant = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(c, _mm256_set1_epi16(0x0F)), 3), _mm256_set1_epi16(ULAW_BIAS));
+		__m256i seg = _mm256_or_si256(_mm256_srli_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x70)), 4), _mm256_set1_epi16((short) 0x8008));
+		__m256i t = _mm256_sub_epi16(_mm256_mullo_epi16(mant, _mm256_shuffle_epi8(pow2, seg)), _mm256_set1_epi16(ULAW_BIAS));
+		__m256i neg = _mm256_cmpeq_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x80)), _mm256_setzero_si256());
+
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg));
+	}
+
+	ulaw_decode_sse41(out + i, in + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i alaw_encode_avx2_8(__m256i x)
+{
+	__m256i neg = _mm256_srai_epi32(x, 31);
+	__m256i v = _mm256_add_epi32(_mm256_xor_si256(x, neg), _mm256_and_si256(neg, _mm256_set1_epi32(-7)));
+	__m256i bits = _mm256_castps_si256(_mm256_cvtepi32_ps(v));
+	__m256i high = _mm256_sub_epi32(_mm256_srli_epi32(bits, 19), _mm256_set1_epi32(134 << 4));
+	__m256i code = _mm256_blendv_epi8(_mm256_srli_epi32(v, 4), high, _mm256_cmpgt_epi32(v, _mm256_set1_epi32(0xFF)));
+	__m256i mask = _mm256_add_epi32(_mm256_set1_epi32(ALAW_AMI_MASK | 0x80), _mm256_slli_epi32(neg, 7));
+
+	code = _mm256_andnot_si256(_mm256_srai_epi32(v, 31), code);
+
+	return _mm256_xor_si256(code, mask);
+}
+
+__attribute__((target("avx2")))
+static void alaw_encode_avx2(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (in + i));
+		__m256i lo = alaw_encode_avx2_8(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+		__m256i hi = alaw_encode_avx2_8(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+		__m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+		__m256i codes = _mm256_packus_epi16(words, _mm256_setzero_si256());
+
+		_mm_storeu_si128((__m128i *) (out + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(codes, 0xD8)));
+	}
+
+	alaw_encode_sse41(out + i, in + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void alaw_decode_avx2(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	const __m256i pow2 = _mm256_setr_epi8(ALAW_POW2, ALAW_POW2);
+	switch_size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (in + i)));
+		__m256i c = _mm256_xor_si256(a, _mm256_set1_epi16(ALAW_AMI_MASK));
+		__m256i seg = _mm256_and_si256(c, _mm256_set1_epi16(0x70));
+		__m256i base = _mm256_blendv_epi8(_mm256_set1_epi16(0x108), _mm256_set1_epi16(8), _mm256_cmpeq_epi16(seg, _mm256_setzero_si256()));
+		__m256i v = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(c, _mm256_set1_epi16(0x0F)), 4), base);
+		__m256i idx = _mm256_or_si256(_mm256_xor_si256(_mm256_srli_epi16(seg, 4), _mm256_set1_epi16(0x0F)), _mm256_set1_epi16((short) 0x8000));
+		__m256i neg = _mm256_cmpeq_epi16(_mm256_and_si256(c, _mm256_set1_epi16(0x80)), _mm256_setzero_si256());
+
+		v = _mm256_mullo_epi16(v, _mm256_shuffle_epi8(pow2, idx));
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_sub_epi16(_mm256_xor_si256(v, neg), neg));
+	}
+
+	alaw_decode_sse41(out + i, in + i, samples - i);
+}
+
+#endif
+
+#ifdef G711_NEON
+
+static inline int32x4_t ulaw_encode_neon_4(int32x4_t x)
+{
+	int32x4_t neg = vshrq_n_s32(x, 31);
+	int32x4_t mag = vaddq_s32(vabsq_s32(x), vdupq_n_s32(ULAW_BIAS));
+	int32x4_t bits = vreinterpretq_s32_f32(vcvtq_f32_s32(mag));
+	int32x4_t code = vminq_s32(vsubq_s32(vshrq_n_s32(bits, 19), vdupq_n_s32(134 << 4)), vdupq_n_s32(0x7F));
+
+	return veorq_s32(code, vaddq_s32(vdupq_n_s32(0xFF), vshlq_n_s32(neg, 7)));
+}
+
+static void ulaw_encode_neon(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t x = vld1q_s16(in + i);
+		int32x4_t lo = ulaw_encode_neon_4(vmovl_s16(vget_low_s16(x)));
+		int32x4_t hi = ulaw_encode_neon_4(vmovl_s16(vget_high_s16(x)));
+
+		vst1_u8(out + i, vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(lo)), vmovn_u32(vreinterpretq_u32_s32(hi)))));
+	}
+
+	ulaw_encode_scalar(out + i, in + i, samples - i);
+}
+
+static void ulaw_decode_neon(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t u = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in + i)));
+		int16x8_t c = veorq_s16(u, vdupq_n_s16(0xFF));
+		int16x8_t mant = vaddq_s16(vshlq_n_s16(vandq_s16(c, vdupq_n_s16(0x0F)), 3), vdupq_n_s16(ULAW_BIAS));
+		int16x8_t seg = vshrq_n_s16(vandq_s16(c, vdupq_n_s16(0x70)), 4);
+		int16x8_t t = vsubq_s16(vshlq_s16(mant, seg), vdupq_n_s16(ULAW_BIAS));
+		uint16x8_t pos = vceqq_s16(vandq_s16(u, vdupq_n_s16(0x80)), vdupq_n_s16(0));
+
+		vst1q_s16(out + i, vbslq_s16(pos, vnegq_s16(t), t));
+	}
+
+	ulaw_decode_scalar(out + i, in + i, samples - i);
+}
+
+static inline int32x4_t alaw_encode_neon_4(int32x4_t x)
+{
+	int32x4_t neg = vshrq_n_s32(x, 31);
+	int32x4_t v = vaddq_s32(veorq_s32(x, neg), vandq_s32(neg, vdupq_n_s32(-7)));
+	int32x4_t bits = vreinterpretq_s32_f32(vcvtq_f32_s32(v));
+	int32x4_t high = vsubq_s32(vshrq_n_s32(bits, 19), vdupq_n_s32(134 << 4));
+	int32x4_t code = vbslq_s32(vcgtq_s32(v, vdupq_n_s32(0xFF)), high, vshrq_n_s32(v, 4));
+	int32x4_t mask = vaddq_s32(vdupq_n_s32(ALAW_AMI_MASK | 0x80), vshlq_n_s32(neg, 7));
+
+	code = vbicq_s32(code, vshrq_n_s32(v, 31));
+
+	return veorq_s32(code, mask);
+}
+
+static void alaw_encode_neon(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t x = vld1q_s16(in + i);
+		int32x4_t lo = alaw_encode_neon_4(vmovl_s16(vget_low_s16(x)));
+		int32x4_t hi = alaw_encode_neon_4(vmovl_s16(vget_high_s16(x)));
+
+		vst1_u8(out + i, vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(lo)), vmovn_u32(vreinterpretq_u32_s32(hi)))));
+	}
+
+	alaw_encode_scalar(out + i, in + i, samples - i);
+}
+
+static void alaw_decode_neon(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	switch_size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t c = veorq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in + i))), vdupq_n_s16(ALAW_AMI_MASK));
+		int16x8_t seg = vshrq_n_s16(vandq_s16(c, vdupq_n_s16(0x70)), 4);
+		uint16x8_t seg0 = vceqq_s16(seg, vdupq_n_s16(0));
+		int16x8_t base = vbslq_s16(seg0, vdupq_n_s16(8), vdupq_n_s16(0x108));
+		int16x8_t v = vaddq_s16(vshlq_n_s16(vandq_s16(c, vdupq_n_s16(0x0F)), 4), base);
+		uint16x8_t pos = vceqq_s16(vandq_s16(c, vdupq_n_s16(0x80)), vdupq_n_s16(0));
+
+		v = vshlq_s16(v, vbslq_s16(seg0, seg, vsubq_s16(seg, vdupq_n_s16(1))));
+		vst1q_s16(out + i, vbslq_s16(pos, vnegq_s16(v), v));
+	}
+
+	alaw_decode_scalar(out + i, in + i, samples - i);
+}
+
+#endif
+
+/* scalar until switch_core_g711_init() has looked at the cpu, nothing runs a codec before that */
+static struct {
+	const char *name;
+	g711_encode_func_t ulaw_encode;
+	g711_decode_func_t ulaw_decode;
+	g711_encode_func_t alaw_encode;
+	g711_decode_func_t alaw_decode;
+} kernels = { "scalar", ulaw_encode_scalar, ulaw_decode_scalar, alaw_encode_scalar, alaw_decode_scalar };
+
+/* pick the widest kernels this cpu runs, once at core init */
+void switch_core_g711_init(void)
+{
+#if defined(G711_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.ulaw_encode = ulaw_encode_avx2;
+		kernels.ulaw_decode = ulaw_decode_avx2;
+		kernels.alaw_encode = alaw_encode_avx2;
+		kernels.alaw_decode = alaw_decode_avx2;
+		kernels.name = "avx2";
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		kernels.ulaw_encode = ulaw_encode_sse41;
+		kernels.ulaw_decode = ulaw_decode_sse41;
+		kernels.alaw_encode = alaw_encode_sse41;
+		kernels.alaw_decode = alaw_decode_sse41;
+		kernels.name = "sse4.1";
+	}
+#elif defined(G711_NEON)
+	kernels.ulaw_encode = ulaw_encode_neon;
+	kernels.ulaw_decode = ulaw_decode_neon;
+	kernels.alaw_encode = alaw_encode_neon;
+	kernels.alaw_decode = alaw_decode_neon;
+	kernels.name = "neon";
+#endif
+}
+
+SWITCH_DECLARE(void) switch_g711_ulaw_encode(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	kernels.ulaw_encode(out, in, samples);
+}
+
+SWITCH_DECLARE(void) switch_g711_ulaw_decode(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	kernels.ulaw_decode(out, in, samples);
+}
+
+SWITCH_DECLARE(void) switch_g711_alaw_encode(uint8_t *out, const int16_t *in, switch_size_t samples)
+{
+	kernels.alaw_encode(out, in, samples);
+}
+
+SWITCH_DECLARE(void) switch_g711_alaw_decode(int16_t *out, const uint8_t *in, switch_size_t samples)
+{
+	kernels.alaw_decode(out, in, samples);
+}
+
+SWITCH_DECLARE(const char *) switch_g711_kernel_name(void)
+{
+	return kernels.name;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
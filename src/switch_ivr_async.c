@@ -1660,6 +1660,7 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				if (file_trimmed_ms) switch_channel_set_variable(channel, "record_trimmed_ms", file_trimmed_ms);
 				if (file_size) switch_channel_set_variable(channel, "record_file_size", file_size);
 				if (file_trimmed) switch_channel_set_variable(channel, "record_trimmed", file_trimmed);
+				if (rh->fh->async_overruns) switch_channel_set_variable_printf(channel, "record_overruns", "%u", rh->fh->async_overruns);
 				switch_core_file_close(rh->fh);
 
 				if (!rh->writes && !rh->vwrites && !switch_test_flag(rh->fh, SWITCH_FILE_WRITE_APPEND)) {
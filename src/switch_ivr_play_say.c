@@ -997,6 +997,9 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_file_event(switch_core_session
 		switch_channel_set_variable(channel, "record_record_trimmed", file_trimmed);
 		switch_channel_set_variable(channel, "record_trimmed", file_trimmed);
 	}
+	if (fh->async_overruns) {
+		switch_channel_set_variable_printf(channel, "record_overruns", "%u", fh->async_overruns);
+	}
 	switch_core_file_close(fh);
 
 
@@ -2047,6 +2050,10 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 		switch_core_media_set_video_file(session, NULL, SWITCH_RW_WRITE);
 		switch_core_file_close(fh);
 
+		if (fh->async_underruns) {
+			switch_channel_set_variable_printf(channel, "playback_underruns", "%u", fh->async_underruns);
+		}
+
 		if (fh->audio_buffer) {
 			switch_buffer_destroy(&fh->audio_buffer);
 		}
@@ -31,17 +31,15 @@
  */
 #include <switch.h>
 #include <switch_jitterbuffer.h>
-#include "private/switch_hashtable_private.h"
 
 #define NACK_TIME 80000
 #define RENACK_TIME 100000
 #define MAX_FRAME_PADDING 2
 #define MAX_MISSING_SEQ 20
+#define JB_RING_MIN 64
+#define JB_RING_MAX 32768
 #define jb_debug(_jb, _level, _format, ...) if (_jb->debug_level >= _level) switch_log_printf(SWITCH_CHANNEL_SESSION_LOG_CLEAN(_jb->session), SWITCH_LOG_ALERT, "JB:%p:%s:%d/%d lv:%d ln:%.4d sz:%.3u/%.3u/%.3u/%.3u c:%.3u %.3u/%.3u/%.3u/%.3u %.2f%% ->" _format, (void *) _jb, (jb->type == SJB_TEXT ? "txt" : (jb->type == SJB_AUDIO ? "aud" : "vid")), _jb->allocated_nodes, _jb->visible_nodes, _level, __LINE__,  _jb->min_frame_len, _jb->max_frame_len, _jb->frame_len, _jb->complete_frames, _jb->period_count, _jb->consec_good_count, _jb->period_good_count, _jb->consec_miss_count, _jb->period_miss_count, _jb->period_miss_pct, __VA_ARGS__)
 
-//const char *TOKEN_1 = "ONE";
-//const char *TOKEN_2 = "TWO";
-
 struct switch_jb_s;
 
 static inline int check_jb_size(switch_jb_t *jb);
@@ -50,9 +48,13 @@ typedef struct switch_jb_node_s {
 	struct switch_jb_s *parent;
 	switch_rtp_packet_t packet;
 	uint32_t len;
+	/* the packet's seq in host order, ts mode rewrites the one in the header */
+	uint16_t seq;
 	uint8_t visible;
 	uint8_t bad_hits;
-	struct switch_jb_node_s *prev;
+	/* pushed out of its ts_ring slot by a packet whose ts maps to the same slot */
+	uint8_t ts_displaced;
+	/* free list */
 	struct switch_jb_node_s *next;
 	/* used for counting the number of partial or complete frames currently in the JB */
 	switch_bool_t complete_frame_mark;
@@ -82,7 +84,24 @@ typedef struct switch_jb_jitter_s {
 } switch_jb_jitter_t;
 
 struct switch_jb_s {
-	struct switch_jb_node_s *node_list;
+	/* Visible packets sit in a power of two ring at seq & ring_mask.  The
+	 * seqs in the ring always span less than ring_size so slots never alias,
+	 * ring_tail and ring_head are the oldest and newest of them. */
+	switch_jb_node_t **ring;
+	switch_jb_node_t **ts_ring;
+	/* visible nodes only found by scanning, see ts_displaced */
+	uint32_t ts_displaced;
+	uint64_t *visible_map;
+	uint32_t ring_size;
+	uint32_t ring_mask;
+	uint16_t ring_tail;
+	uint16_t ring_head;
+	/* seqs waiting to be nacked, video only */
+	uint64_t *missing_map;
+	uint16_t *missing_seq;
+	switch_time_t *nack_time;
+	uint32_t missing_count;
+	switch_jb_node_t *free_nodes;
 	uint32_t last_target_seq;
 	uint32_t highest_read_ts;
 	uint32_t highest_dropped_ts;
@@ -118,11 +137,7 @@ struct switch_jb_s {
 	uint8_t debug_level;
 	uint16_t next_seq;
 	switch_size_t last_len;
-	switch_inthash_t *missing_seq_hash;
-	switch_inthash_t *node_hash;
-	switch_inthash_t *node_hash_ts;
 	switch_mutex_t *mutex;
-	switch_mutex_t *list_mutex;
 	switch_memory_pool_t *pool;
 	int free_pool;
 	int drop_flag;
@@ -143,112 +158,289 @@ struct switch_jb_s {
 };
 
 
-static int node_cmp(const void *l, const void *r)
+static inline int jb_ctz64(uint64_t v)
 {
-	switch_jb_node_t *a = (switch_jb_node_t *) l;
-	switch_jb_node_t *b = (switch_jb_node_t *) r;
+#if defined(__GNUC__)
+	return __builtin_ctzll(v);
+#else
+	int n = 0;
 
-	if (!a->visible) return 0;
-	if (!b->visible) return 1;
+	while (!(v & 1)) {
+		v >>= 1;
+		n++;
+	}
 
-	return ntohs(a->packet.header.seq) - ntohs(b->packet.header.seq);
+	return n;
+#endif
 }
 
-//http://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.c
-switch_jb_node_t *sort_nodes(switch_jb_node_t *list, int (*cmp)(const void *, const void *)) {
-	switch_jb_node_t *p, *q, *e, *tail;
-	int insize, nmerges, psize, qsize, i;
+static inline int jb_clz64(uint64_t v)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(v);
+#else
+	int n = 0;
 
-	if (!list) {
-		return NULL;
+	while (!(v & ((uint64_t)1 << 63))) {
+		v <<= 1;
+		n++;
 	}
 
-	insize = 1;
+	return n;
+#endif
+}
 
-	while (1) {
-		p = list;
-		list = NULL;
-		tail = NULL;
+/* wrap aware a < b for host order seqs */
+static inline int jb_seq_before(uint16_t a, uint16_t b)
+{
+	return (int16_t)(a - b) < 0;
+}
 
-		nmerges = 0;  /* count number of merges we do in this pass */
+static inline int jb_map_test(uint64_t *map, uint32_t slot)
+{
+	return (map[slot >> 6] >> (slot & 63)) & 1;
+}
 
-		while (p) {
-			nmerges++;  /* there exists a merge to be done */
-			            /* step `insize' places along from p */
-			q = p;
-			psize = 0;
-			for (i = 0; i < insize; i++) {
-				psize++;
-				q = q->next;
-				if (!q) break;
-			}
+static inline void jb_map_set(uint64_t *map, uint32_t slot)
+{
+	map[slot >> 6] |= (uint64_t)1 << (slot & 63);
+}
 
-			/* if q hasn't fallen off end, we have two lists to merge */
-			qsize = insize;
-
-			/* now we have two lists; merge them */
-			while (psize > 0 || (qsize > 0 && q)) {
-
-				/* decide whether next switch_jb_node_t of merge comes from p or q */
-				if (psize == 0) {
-					/* p is empty; e must come from q. */
-					e = q; q = q->next; qsize--;
-				} else if (qsize == 0 || !q) {
-					/* q is empty; e must come from p. */
-					e = p; p = p->next; psize--;
-				} else if (cmp(p,q) <= 0) {
-					/* First switch_jb_node_t of p is lower (or same);
-					 * e must come from p. */
-					e = p; p = p->next; psize--;
-				} else {
-					/* First switch_jb_node_t of q is lower; e must come from q. */
-					e = q; q = q->next; qsize--;
-				}
+static inline void jb_map_clear(uint64_t *map, uint32_t slot)
+{
+	map[slot >> 6] &= ~((uint64_t)1 << (slot & 63));
+}
 
-				/* add the next switch_jb_node_t to the merged list */
-				if (tail) {
-					tail->next = e;
-				} else {
-					list = e;
-				}
+/* first set slot at or after slot going around the ring, there must be one */
+static inline uint32_t jb_map_next(switch_jb_t *jb, uint64_t *map, uint32_t slot)
+{
+	uint32_t words = jb->ring_size >> 6;
+	uint32_t w = slot >> 6, i;
+	uint64_t bits = map[w] & (~(uint64_t)0 << (slot & 63));
 
-				/* Maintain reverse pointers in a doubly linked list. */
-				e->prev = tail;
+	for (i = 0; i <= words; i++) {
+		if (bits) {
+			return (w << 6) + jb_ctz64(bits);
+		}
+		w = (w + 1) & (words - 1);
+		bits = map[w];
+	}
 
-				tail = e;
-			}
+	return slot;
+}
+
+/* last set slot at or before slot going around the ring, there must be one */
+static inline uint32_t jb_map_prev(switch_jb_t *jb, uint64_t *map, uint32_t slot)
+{
+	uint32_t words = jb->ring_size >> 6;
+	uint32_t w = slot >> 6, i;
+	uint64_t bits = map[w] & (~(uint64_t)0 >> (63 - (slot & 63)));
 
-			/* now p has stepped `insize' places along, and q has too */
-			p = q;
+	for (i = 0; i <= words; i++) {
+		if (bits) {
+			return (w << 6) + 63 - jb_clz64(bits);
 		}
+		w = (w - 1) & (words - 1);
+		bits = map[w];
+	}
+
+	return slot;
+}
+
+static inline uint32_t jb_ts_slot(switch_jb_t *jb, uint32_t ts)
+{
+	return (ntohl(ts) / jb->samples_per_frame) & jb->ring_mask;
+}
+
+static inline switch_jb_node_t *jb_find_seq(switch_jb_t *jb, uint16_t seq)
+{
+	uint16_t want = ntohs(seq);
+	switch_jb_node_t *node = jb->ring[want & jb->ring_mask];
+
+	return (node && node->seq == want) ? node : NULL;
+}
+
+/* The ts ring is sized for the seq span, a ts span that is wider (silence
+ * suppression, ts jumps) maps several packets to one slot.  The last one in
+ * wins and the others are marked displaced so lookups fall back to a scan. */
+static inline void jb_ts_link(switch_jb_t *jb, switch_jb_node_t **ts_ring, uint32_t mask, switch_jb_node_t *node)
+{
+	switch_jb_node_t **slot = &ts_ring[(ntohl(node->packet.header.ts) / jb->samples_per_frame) & mask];
+
+	if (*slot && *slot != node && (*slot)->visible && !(*slot)->ts_displaced) {
+		(*slot)->ts_displaced = 1;
+		jb->ts_displaced++;
+	}
+
+	node->ts_displaced = 0;
+	*slot = node;
+}
 
-		tail->next = NULL;
+static inline switch_jb_node_t *jb_find_ts(switch_jb_t *jb, uint32_t ts)
+{
+	switch_jb_node_t *node;
+	uint32_t w, words;
+
+	if (!jb->ts_ring) {
+		return NULL;
+	}
 
-		/* If we have done only one merge, we're finished. */
-		if (nmerges <= 1)   /* allow for nmerges==0, the empty list case */
-			return list;
+	node = jb->ts_ring[jb_ts_slot(jb, ts)];
 
-		/* Otherwise repeat, merging lists twice the size */
-		insize *= 2;
+	if (node && node->packet.header.ts == ts) {
+		return node;
+	}
+
+	if (!jb->ts_displaced) {
+		return NULL;
+	}
+
+	words = jb->ring_size >> 6;
+
+	for (w = 0; w < words; w++) {
+		uint64_t bits = jb->visible_map[w];
+
+		while (bits) {
+			node = jb->ring[(w << 6) + jb_ctz64(bits)];
+			bits &= bits - 1;
+
+			if (node->ts_displaced && node->packet.header.ts == ts) {
+				return node;
+			}
+		}
 	}
+
+	return NULL;
 }
 
-// static inline void thin_frames(switch_jb_t *jb, int freq, int max);
+static inline switch_bool_t jb_missing_test(switch_jb_t *jb, uint16_t seq)
+{
+	uint32_t slot = seq & jb->ring_mask;
 
+	return jb->missing_map && jb_map_test(jb->missing_map, slot) && jb->missing_seq[slot] == seq;
+}
 
-static inline switch_jb_node_t *new_node(switch_jb_t *jb)
+static inline switch_bool_t jb_missing_clear(switch_jb_t *jb, uint16_t seq)
 {
-	switch_jb_node_t *np;
+	if (jb_missing_test(jb, seq)) {
+		jb_map_clear(jb->missing_map, seq & jb->ring_mask);
+		jb->missing_count--;
+		return SWITCH_TRUE;
+	}
 
-	switch_mutex_lock(jb->list_mutex);
+	return SWITCH_FALSE;
+}
 
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) {
-			break;
+static inline void jb_missing_mark(switch_jb_t *jb, uint16_t seq)
+{
+	uint32_t slot = seq & jb->ring_mask;
+
+	if (!jb->missing_map || jb_missing_test(jb, seq)) {
+		return;
+	}
+
+	/* whatever was there is long expired */
+	if (!jb_map_test(jb->missing_map, slot)) {
+		jb_map_set(jb->missing_map, slot);
+		jb->missing_count++;
+	}
+
+	jb->missing_seq[slot] = seq;
+	jb->nack_time[slot] = 1;
+}
+
+static switch_status_t jb_ring_alloc(switch_jb_t *jb, uint32_t size)
+{
+	switch_jb_node_t **ring, **ts_ring = NULL;
+	uint64_t *visible_map, *missing_map = NULL;
+	uint16_t *missing_seq = NULL;
+	switch_time_t *nack_time = NULL;
+	uint32_t mask = size - 1, slot;
+
+	if (!(ring = calloc(size, sizeof(*ring))) || !(visible_map = calloc(size >> 6, sizeof(*visible_map)))) {
+		switch_safe_free(ring);
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	if (jb->samples_per_frame) {
+		ts_ring = calloc(size, sizeof(*ts_ring));
+	}
+
+	if (jb->type == SJB_VIDEO) {
+		missing_map = calloc(size >> 6, sizeof(*missing_map));
+		missing_seq = calloc(size, sizeof(*missing_seq));
+		nack_time = calloc(size, sizeof(*nack_time));
+	}
+
+	if ((jb->samples_per_frame && !ts_ring) || (jb->type == SJB_VIDEO && (!missing_map || !missing_seq || !nack_time))) {
+		switch_safe_free(ring);
+		switch_safe_free(visible_map);
+		switch_safe_free(ts_ring);
+		switch_safe_free(missing_map);
+		switch_safe_free(missing_seq);
+		switch_safe_free(nack_time);
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	/* move over whatever the old ring held */
+	jb->ts_displaced = 0;
+
+	if (jb->ring) {
+		for (slot = 0; slot < jb->ring_size; slot++) {
+			switch_jb_node_t *node = jb->ring[slot];
+
+			if (node) {
+				ring[node->seq & mask] = node;
+				jb_map_set(visible_map, node->seq & mask);
+
+				if (ts_ring) {
+					jb_ts_link(jb, ts_ring, mask, node);
+				}
+			}
+		}
+	}
+
+	if (jb->missing_map) {
+		for (slot = 0; slot < jb->ring_size; slot++) {
+			if (jb_map_test(jb->missing_map, slot)) {
+				uint32_t to = jb->missing_seq[slot] & mask;
+
+				if (jb_map_test(missing_map, to)) {
+					jb->missing_count--;
+				}
+				jb_map_set(missing_map, to);
+				missing_seq[to] = jb->missing_seq[slot];
+				nack_time[to] = jb->nack_time[slot];
+			}
 		}
 	}
 
-	if (!np) {
+	switch_safe_free(jb->ring);
+	switch_safe_free(jb->visible_map);
+	switch_safe_free(jb->ts_ring);
+	switch_safe_free(jb->missing_map);
+	switch_safe_free(jb->missing_seq);
+	switch_safe_free(jb->nack_time);
+
+	jb->ring = ring;
+	jb->ts_ring = ts_ring;
+	jb->visible_map = visible_map;
+	jb->missing_map = missing_map;
+	jb->missing_seq = missing_seq;
+	jb->nack_time = nack_time;
+	jb->ring_size = size;
+	jb->ring_mask = mask;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static inline switch_jb_node_t *new_node(switch_jb_t *jb)
+{
+	switch_jb_node_t *np;
+
+	if ((np = jb->free_nodes)) {
+		jb->free_nodes = np->next;
+	} else {
 		int mult = 2;
 
 		if (jb->type != SJB_VIDEO) {
@@ -263,102 +455,143 @@ static inline switch_jb_node_t *new_node(switch_jb_t *jb)
 			jb_debug(jb, 2, "ALLOCATED FRAMES TOO HIGH! %d\n", jb->allocated_nodes);
 			jb->jitter.stats.reset_too_big++;
 			switch_jb_reset(jb);
-			switch_mutex_unlock(jb->list_mutex);
 			return NULL;
 		}
-		
+
 		np = switch_core_alloc(jb->pool, sizeof(*np));
 		jb->allocated_nodes++;
-		np->next = jb->node_list;
-		if (np->next) {
-			np->next->prev = np;
-		}
-		jb->node_list = np;
-
 	}
 
 	switch_assert(np);
+	np->next = NULL;
 	np->bad_hits = 0;
 	np->visible = 1;
+	np->complete_frame_mark = FALSE;
 	jb->visible_nodes++;
 	np->parent = jb;
 
-	switch_mutex_unlock(jb->list_mutex);
-
 	return np;
 }
 
-static inline void push_to_top(switch_jb_t *jb, switch_jb_node_t *node)
+/* Make room for seq in the ring, growing it when the buffered seqs would span more than it holds */
+static inline void jb_ring_fit(switch_jb_t *jb, uint16_t seq)
 {
-	if (node == jb->node_list) {
-		jb->node_list = node->next;
-	} else if (node->prev) {
-		node->prev->next = node->next;
+	uint16_t head = jb->ring_head, tail = jb->ring_tail;
+	uint32_t span, size;
+
+	if (!jb->visible_nodes) {
+		return;
 	}
 
-	if (node->next) {
-		node->next->prev = node->prev;
+	if (jb_seq_before(head, seq)) {
+		head = seq;
+	} else if (jb_seq_before(seq, tail)) {
+		tail = seq;
 	}
 
-	node->next = jb->node_list;
-	node->prev = NULL;
+	span = (uint16_t)(head - tail) + 1;
 
-	if (node->next) {
-		node->next->prev = node;
+	if (span <= jb->ring_size) {
+		return;
+	}
+
+	if (span > JB_RING_MAX) {
+		jb_debug(jb, 2, "SEQ JUMP %u -> %u, Resetting\n", jb->ring_head, seq);
+		jb->jitter.stats.reset_ts_jump++;
+		switch_jb_reset(jb);
+		return;
 	}
 
-	jb->node_list = node;
+	for (size = jb->ring_size << 1; size < span; size <<= 1);
 
-	switch_assert(node->next != node);
-	switch_assert(node->prev != node);
+	if (jb_ring_alloc(jb, size) != SWITCH_STATUS_SUCCESS) {
+		jb->jitter.stats.reset_error++;
+		switch_jb_reset(jb);
+		return;
+	}
+
+	jb_debug(jb, 2, "RING GREW to %u for seq span %u\n", size, span);
 }
 
-static inline void hide_node(switch_jb_node_t *node, switch_bool_t pop)
+static inline void link_node(switch_jb_t *jb, switch_jb_node_t *node)
+{
+	uint32_t slot = node->seq & jb->ring_mask;
+
+	jb->ring[slot] = node;
+	jb_map_set(jb->visible_map, slot);
+
+	if (jb->visible_nodes == 1) {
+		jb->ring_tail = jb->ring_head = node->seq;
+	} else if (jb_seq_before(node->seq, jb->ring_tail)) {
+		jb->ring_tail = node->seq;
+	} else if (jb_seq_before(jb->ring_head, node->seq)) {
+		jb->ring_head = node->seq;
+	}
+
+	if (jb->ts_ring) {
+		jb_ts_link(jb, jb->ts_ring, jb->ring_mask, node);
+	}
+}
+
+static inline void hide_node(switch_jb_node_t *node)
 {
 	switch_jb_t *jb = node->parent;
+	uint32_t slot;
+
+	if (!node->visible) {
+		return;
+	}
 
-	switch_mutex_lock(jb->list_mutex);
+	slot = node->seq & jb->ring_mask;
 
-	if (node->visible) {
-		node->visible = 0;
-		node->bad_hits = 0;
-		jb->visible_nodes--;
+	node->visible = 0;
+	node->bad_hits = 0;
+	jb->visible_nodes--;
 
-		if (pop) {
-			push_to_top(jb, node);
+	jb->ring[slot] = NULL;
+	jb_map_clear(jb->visible_map, slot);
+
+	if (jb->ts_ring) {
+		uint32_t ts_slot = jb_ts_slot(jb, node->packet.header.ts);
+
+		if (jb->ts_ring[ts_slot] == node) {
+			jb->ts_ring[ts_slot] = NULL;
+		}
+
+		if (node->ts_displaced) {
+			node->ts_displaced = 0;
+			jb->ts_displaced--;
 		}
 	}
 
-	if (jb->node_hash_ts) {
-		switch_core_inthash_delete(jb->node_hash_ts, node->packet.header.ts);
+	if (node->complete_frame_mark && jb->type == SJB_VIDEO) {
+		jb->complete_frames--;
+		node->complete_frame_mark = FALSE;
 	}
 
-	if (switch_core_inthash_delete(jb->node_hash, node->packet.header.seq)) {
-		if (node->complete_frame_mark && jb->type == SJB_VIDEO) {
-			jb->complete_frames--;
-			node->complete_frame_mark = FALSE;
+	if (jb->visible_nodes) {
+		if (node->seq == jb->ring_tail) {
+			jb->ring_tail = jb->ring[jb_map_next(jb, jb->visible_map, slot)]->seq;
 		}
-	}
 
-	switch_mutex_unlock(jb->list_mutex);
-}
+		if (node->seq == jb->ring_head) {
+			jb->ring_head = jb->ring[jb_map_prev(jb, jb->visible_map, slot)]->seq;
+		}
+	}
 
-static inline void sort_free_nodes(switch_jb_t *jb)
-{
-	switch_mutex_lock(jb->list_mutex);
-	jb->node_list = sort_nodes(jb->node_list, node_cmp);
-	switch_mutex_unlock(jb->list_mutex);
+	node->next = jb->free_nodes;
+	jb->free_nodes = node;
 }
 
 static inline void hide_nodes(switch_jb_t *jb)
 {
-	switch_jb_node_t *np;
+	uint32_t w, words = jb->ring_size >> 6;
 
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		hide_node(np, SWITCH_FALSE);
+	for (w = 0; w < words && jb->visible_nodes; w++) {
+		while (jb->visible_map[w]) {
+			hide_node(jb->ring[(w << 6) + jb_ctz64(jb->visible_map[w])]);
+		}
 	}
-	switch_mutex_unlock(jb->list_mutex);
 }
 
 static inline switch_bool_t packet_vad(switch_jb_t *jb, switch_rtp_packet_t *packet, switch_size_t len) {
@@ -381,155 +614,49 @@ static inline switch_bool_t packet_vad(switch_jb_t *jb, switch_rtp_packet_t *pac
 	return SWITCH_TRUE;
 }
 
-static inline void drop_ts(switch_jb_t *jb, uint32_t ts)
+/* Hides every packet of the frame node belongs to.  The packets of a
+ * frame are consecutive so only its neighbours need to be looked at. */
+static inline void drop_frame(switch_jb_t *jb, switch_jb_node_t *node)
 {
+	uint32_t ts = node->packet.header.ts;
+	uint16_t first = node->seq, last = node->seq, seq;
 	switch_jb_node_t *np;
-	int x = 0;
-
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (ts == np->packet.header.ts) {
-			hide_node(np, SWITCH_FALSE);
-			x++;
-		}
-	}
-
-	if (x) {
-		sort_free_nodes(jb);
-	}
-
-	switch_mutex_unlock(jb->list_mutex);
-}
 
-static inline switch_jb_node_t *jb_find_lowest_seq(switch_jb_t *jb, uint32_t ts)
-{
-	switch_jb_node_t *np, *lowest = NULL;
-
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (ts && ts != np->packet.header.ts) continue;
-
-		if (!lowest || ntohs(lowest->packet.header.seq) > ntohs(np->packet.header.seq)) {
-			lowest = np;
+	while (first != jb->ring_tail) {
+		if ((np = jb->ring[(uint16_t)(first - 1) & jb->ring_mask]) && np->packet.header.ts != ts) {
+			break;
 		}
+		first--;
 	}
-	switch_mutex_unlock(jb->list_mutex);
-
-	return lowest;
-}
-
-static inline switch_jb_node_t *jb_find_lowest_node(switch_jb_t *jb)
-{
-	switch_jb_node_t *np, *lowest = NULL;
 
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (!lowest || ntohl(lowest->packet.header.ts) > ntohl(np->packet.header.ts)) {
-			lowest = np;
+	while (last != jb->ring_head) {
+		if ((np = jb->ring[(uint16_t)(last + 1) & jb->ring_mask]) && np->packet.header.ts != ts) {
+			break;
 		}
+		last++;
 	}
-	switch_mutex_unlock(jb->list_mutex);
-
-	return lowest ? lowest : NULL;
-}
-
-static inline uint32_t jb_find_lowest_ts(switch_jb_t *jb)
-{
-	switch_jb_node_t *lowest = jb_find_lowest_node(jb);
-
-	return lowest ? lowest->packet.header.ts : 0;
-}
 
-#if 0
-static inline void thin_frames(switch_jb_t *jb, int freq, int max)
-{
-	switch_jb_node_t *node, *this_node;
-	int i = -1;
-	int dropped = 0;
-
-	switch_mutex_lock(jb->list_mutex);
-	node = jb->node_list;
-
-	while (node && dropped <= max) {
-		this_node = node;
-		node = node->next;
-		
-		if (this_node->visible) {
-			i++;
-		} else {
-			continue;
+	for (seq = first; ; seq++) {
+		if ((np = jb->ring[seq & jb->ring_mask])) {
+			hide_node(np);
 		}
 
-		if ((i % freq) == 0) {
-			drop_ts(jb, this_node->packet.header.ts);
-			dropped++;
-		}
-	}
-
-	sort_free_nodes(jb);
-	switch_mutex_unlock(jb->list_mutex);
-}
-
-static inline switch_jb_node_t *jb_find_highest_node(switch_jb_t *jb)
-{
-	switch_jb_node_t *np, *highest = NULL;
-
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (!highest || ntohl(highest->packet.header.ts) < ntohl(np->packet.header.ts)) {
-			highest = np;
+		if (seq == last) {
+			break;
 		}
 	}
-	switch_mutex_unlock(jb->list_mutex);
-
-	return highest ? highest : NULL;
-}
-
-
-static inline uint32_t jb_find_highest_ts(switch_jb_t *jb)
-{
-	switch_jb_node_t *highest = jb_find_highest_node(jb);
-
-	return highest ? highest->packet.header.ts : 0;
 }
 
-static inline void drop_newest_frame(switch_jb_t *jb)
+static inline switch_jb_node_t *jb_find_lowest_seq(switch_jb_t *jb)
 {
-	uint32_t ts = jb_find_highest_ts(jb);
-
-	drop_ts(jb, ts);
-	jb_debug(jb, 1, "Dropping highest frame ts:%u\n", ntohl(ts));
+	return jb->visible_nodes ? jb->ring[jb->ring_tail & jb->ring_mask] : NULL;
 }
 
-
-
-
-static inline switch_jb_node_t *jb_find_penultimate_node(switch_jb_t *jb)
+/* timestamps follow seqs so the oldest seq also has the lowest ts */
+static inline switch_jb_node_t *jb_find_lowest_node(switch_jb_t *jb)
 {
-	switch_jb_node_t *np, *highest = NULL, *second_highest = NULL;
-
-	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (!highest || ntohl(highest->packet.header.ts) < ntohl(np->packet.header.ts)) {
-			if (highest) second_highest = highest;
-			highest = np;
-		}
-	}
-	switch_mutex_unlock(jb->list_mutex);
-
-	return second_highest ? second_highest : highest;
+	return jb_find_lowest_seq(jb);
 }
-#endif
 
 static inline void jb_hit(switch_jb_t *jb)
 {
@@ -590,69 +717,18 @@ static inline void jb_miss(switch_jb_t *jb)
 	jb->consec_good_count = 0;
 }
 
-#if 0
-static inline int verify_oldest_frame(switch_jb_t *jb)
-{
-	switch_jb_node_t *lowest = NULL, *np = NULL;
-	int r = 0;
-
-	lowest = jb_find_lowest_node(jb);
-
-	if (!lowest || !(lowest = jb_find_lowest_seq(jb, lowest->packet.header.ts))) {
-		goto end;
-	}
-
-	switch_mutex_lock(jb->mutex);
-
-	jb->node_list = sort_nodes(jb->node_list, node_cmp);
-
-	for (np = lowest->next; np; np = np->next) {
-
-		if (!np->visible) continue;
-
-		if (ntohs(np->packet.header.seq) != ntohs(np->prev->packet.header.seq) + 1) {
-			uint32_t val = (uint32_t)htons(ntohs(np->prev->packet.header.seq) + 1);
-
-			if (!switch_core_inthash_find(jb->missing_seq_hash, val)) {
-				switch_core_inthash_insert(jb->missing_seq_hash, val, (void *)(intptr_t)1);
-			}
-			break;
-		}
-
-		if (np->packet.header.ts != lowest->packet.header.ts || !np->next) {
-			r = 1;
-		}
-	}
-
-	switch_mutex_unlock(jb->mutex);
-
- end:
-
-	return r;
-}
-#endif
-
 static inline void drop_oldest_frame(switch_jb_t *jb)
 {
-	uint32_t ts = jb_find_lowest_ts(jb);
-
-	drop_ts(jb, ts);
-	jb_debug(jb, 1, "Dropping oldest frame ts:%u\n", ntohl(ts));
-}
-
-
+	switch_jb_node_t *lowest = jb_find_lowest_node(jb);
 
-#if 0
-static inline void drop_second_newest_frame(switch_jb_t *jb)
-{
-	switch_jb_node_t *second_newest = jb_find_penultimate_node(jb);
+	if (lowest) {
+		uint32_t ts = lowest->packet.header.ts;
 
-	if (second_newest) {
-		drop_ts(jb, second_newest->packet.header.ts);
-		jb_debug(jb, 1, "Dropping second highest frame ts:%u\n", ntohl(second_newest->packet.header.ts));
+		drop_frame(jb, lowest);
+		jb_debug(jb, 1, "Dropping oldest frame ts:%u\n", ntohl(ts));
 	}
 }
-#endif
+
 
 static inline int check_seq(uint16_t a, uint16_t b)
 {
@@ -680,21 +756,23 @@ static inline int check_ts(uint32_t a, uint32_t b)
 
 static inline void add_node(switch_jb_t *jb, switch_rtp_packet_t *packet, switch_size_t len)
 {
-	switch_jb_node_t *node = new_node(jb);
+	switch_jb_node_t *node;
 
-	if (!node) {
+	if (jb_find_seq(jb, packet->header.seq)) {
+		jb_debug(jb, 2, "DUPLICATE seq:%u, keeping the one we have\n", ntohs(packet->header.seq));
 		return;
 	}
 
+	jb_ring_fit(jb, ntohs(packet->header.seq));
+
+	if (!(node = new_node(jb))) {
+		return;
+	}
 
 	node->packet = *packet;
 	node->len = len;
-
-	switch_core_inthash_insert(jb->node_hash, node->packet.header.seq, node);
-
-	if (jb->node_hash_ts) {
-		switch_core_inthash_insert(jb->node_hash_ts, node->packet.header.ts, node);
-	}
+	node->seq = ntohs(packet->header.seq);
+	link_node(jb, node);
 
 	jb_debug(jb, (packet->header.m ? 2 : 3), "PUT packet last_ts:%u ts:%u seq:%u%s\n",
 			 ntohl(jb->highest_wrote_ts), ntohl(node->packet.header.ts), ntohs(node->packet.header.seq), packet->header.m ? " <MARK>" : "");
@@ -813,15 +891,15 @@ static inline switch_status_t jb_next_packet_by_seq(switch_jb_t *jb, switch_jb_n
 	}
 
 	if (!jb->target_seq) {
-		if ((node = switch_core_inthash_find(jb->node_hash, jb->target_seq))) {
+		if ((node = jb_find_seq(jb, jb->target_seq))) {
 			jb_debug(jb, 2, "FOUND rollover seq: %u\n", ntohs(jb->target_seq));
-		} else if ((node = jb_find_lowest_seq(jb, 0))) {
+		} else if ((node = jb_find_lowest_seq(jb))) {
 			jb_debug(jb, 2, "No target seq using seq: %u as a starting point\n", ntohs(node->packet.header.seq));
 		} else {
 			jb_debug(jb, 1, "%s", "No nodes available....\n");
 		}
 		jb_hit(jb);
-	} else if ((node = switch_core_inthash_find(jb->node_hash, jb->target_seq))) {
+	} else if ((node = jb_find_seq(jb, jb->target_seq))) {
 		jb_debug(jb, 2, "FOUND desired seq: %u\n", ntohs(jb->target_seq));
 		jb_hit(jb);
 	} else {
@@ -837,14 +915,14 @@ static inline switch_status_t jb_next_packet_by_seq(switch_jb_t *jb, switch_jb_n
 
 			for (x = 0; x < 10; x++) {
 				increment_seq(jb);
-				if ((node = switch_core_inthash_find(jb->node_hash, jb->target_seq))) {
+				if ((node = jb_find_seq(jb, jb->target_seq))) {
 					jb_debug(jb, 2, "FOUND incremental seq: %u\n", ntohs(jb->target_seq));
 
 					if (node->packet.header.m ||  node->packet.header.ts == jb->highest_read_ts) {
 						jb_debug(jb, 2, "%s", "SAME FRAME DROPPING\n");
 						jb->dropped++;
-						drop_ts(jb, node->packet.header.ts);
 						jb->highest_dropped_ts = ntohl(node->packet.header.ts);
+						drop_frame(jb, node);
 
 
 						if (jb->period_miss_count > 2 && jb->period_miss_inc < 1) {
@@ -889,7 +967,7 @@ static inline switch_status_t jb_next_packet_by_ts(switch_jb_t *jb, switch_jb_no
 			jb_debug(jb, 1, "%s", "No nodes available....\n");
 		}
 		jb_hit(jb);
-	} else if ((node = switch_core_inthash_find(jb->node_hash_ts, jb->target_ts))) {
+	} else if ((node = jb_find_ts(jb, jb->target_ts))) {
 		jb_debug(jb, 2, "FOUND desired ts: %u\n", ntohl(jb->target_ts));
 		jb_hit(jb);
 	} else {
@@ -912,42 +990,32 @@ static inline switch_status_t jb_next_packet_by_ts(switch_jb_t *jb, switch_jb_no
 
 static inline int check_jb_size(switch_jb_t *jb)
 {
-	switch_jb_node_t *np;
-	uint16_t seq_hs, target_seq_hs;
+	uint16_t target_seq_hs;
 	uint16_t l_seq = 0;
 	uint16_t h_seq = 0;
 	uint16_t count = 0;
 	uint16_t old = 0;
 
-	switch_mutex_lock(jb->list_mutex);
-
 	target_seq_hs = ntohs(jb->target_seq);
 
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) {
-			continue;
-		}
-
-		seq_hs = ntohs(np->packet.header.seq);
-		if (target_seq_hs > seq_hs) {
-			hide_node(np, SWITCH_FALSE);
+	if (target_seq_hs) {
+		/* everything before the seq we want next is too old to be played */
+		while (jb->visible_nodes && jb_seq_before(jb->ring_tail, target_seq_hs)) {
+			hide_node(jb->ring[jb->ring_tail & jb->ring_mask]);
 			old++;
-			continue;
-		}
-
-		if (count == 0) {
-			l_seq = h_seq = seq_hs;
 		}
-
-		count++;
-
-		if (seq_hs < l_seq) {
-			l_seq = seq_hs;
+	} else {
+		/* no read position yet, or it just rolled over to 0: keep the
+		 * buffer from growing past the most frames it may ever hold */
+		while (jb->max_frame_len && jb->visible_nodes > jb->max_frame_len) {
+			hide_node(jb->ring[jb->ring_tail & jb->ring_mask]);
+			old++;
 		}
+	}
 
-		if (seq_hs > h_seq) {
-			h_seq = seq_hs;
-		}
+	if ((count = jb->visible_nodes)) {
+		l_seq = jb->ring_tail;
+		h_seq = jb->ring_head;
 	}
 
 	if (count > jb->jitter.stats.size_max) {
@@ -982,13 +1050,7 @@ static inline int check_jb_size(switch_jb_t *jb)
 		}
 	}
 
-	if (old) {
-		sort_free_nodes(jb);
-	}
-
-	switch_mutex_unlock(jb->list_mutex);
-
-	jb_debug(jb, SWITCH_LOG_INFO, "JITTER buffersize %u == %u old[%u] target[%u] seq[%u|%u]\n", count, h_seq - l_seq + 1, old, target_seq_hs, l_seq, h_seq);
+	jb_debug(jb, SWITCH_LOG_INFO, "JITTER buffersize %u == %u old[%u] target[%u] seq[%u|%u]\n", count, (uint16_t)(h_seq - l_seq + 1), old, target_seq_hs, l_seq, h_seq);
 
 	return count;
 }
@@ -1062,18 +1124,18 @@ static inline switch_status_t jb_next_packet(switch_jb_t *jb, switch_jb_node_t *
 	return jb_next_packet_by_seq(jb, nodep);
 }
 
-static inline void free_nodes(switch_jb_t *jb)
-{
-	switch_mutex_lock(jb->list_mutex);
-	jb->node_list = NULL;
-	switch_mutex_unlock(jb->list_mutex);
-}
-
 SWITCH_DECLARE(void) switch_jb_ts_mode(switch_jb_t *jb, uint32_t samples_per_frame, uint32_t samples_per_second)
 {
+	switch_mutex_lock(jb->mutex);
 	jb->samples_per_frame = samples_per_frame;
 	jb->samples_per_second = samples_per_second;
-	switch_core_inthash_init(&jb->node_hash_ts);
+
+	/* reindex what we have by ts */
+	if (jb_ring_alloc(jb, jb->ring_size) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(jb->session), SWITCH_LOG_CRIT, "Memory Error!\n");
+		jb->samples_per_frame = 0;
+	}
+	switch_mutex_unlock(jb->mutex);
 }
 
 SWITCH_DECLARE(void) switch_jb_set_jitter_estimator(switch_jb_t *jb, double *jitter, uint32_t samples_per_frame, uint32_t samples_per_second)
@@ -1173,6 +1235,8 @@ SWITCH_DECLARE(void) switch_jb_debug_level(switch_jb_t *jb, uint8_t level)
 
 SWITCH_DECLARE(void) switch_jb_reset(switch_jb_t *jb)
 {
+	switch_mutex_lock(jb->mutex);
+
 	jb->jitter.stats.reset++;
 	if (jb->channel) {
 		switch_channel_set_variable_printf(jb->channel, "rtp_jb_reset_count", "%u", jb->jitter.stats.reset);
@@ -1183,10 +1247,8 @@ SWITCH_DECLARE(void) switch_jb_reset(switch_jb_t *jb)
 	}
 
 	if (jb->type == SJB_VIDEO) {
-		switch_mutex_lock(jb->mutex);
-		switch_core_inthash_destroy(&jb->missing_seq_hash);
-		switch_core_inthash_init(&jb->missing_seq_hash);
-		switch_mutex_unlock(jb->mutex);
+		memset(jb->missing_map, 0, (jb->ring_size >> 6) * sizeof(*jb->missing_map));
+		jb->missing_count = 0;
 
 		if (jb->session) {
 			switch_core_session_request_video_refresh(jb->session);
@@ -1195,9 +1257,7 @@ SWITCH_DECLARE(void) switch_jb_reset(switch_jb_t *jb)
 
 	jb_debug(jb, 2, "%s", "RESET BUFFER\n");
 
-	switch_mutex_lock(jb->mutex);
 	hide_nodes(jb);
-	switch_mutex_unlock(jb->mutex);
 
 	jb->drop_flag = 0;
 	jb->last_target_seq = 0;
@@ -1219,6 +1279,8 @@ SWITCH_DECLARE(void) switch_jb_reset(switch_jb_t *jb)
 	jb->period_miss_inc = 0;
 	jb->target_ts = 0;
 	jb->last_target_ts = 0;
+
+	switch_mutex_unlock(jb->mutex);
 }
 
 SWITCH_DECLARE(uint32_t) switch_jb_get_nack_success(switch_jb_t *jb) 
@@ -1242,12 +1304,16 @@ SWITCH_DECLARE(uint32_t) switch_jb_get_packets_per_frame(switch_jb_t *jb)
 SWITCH_DECLARE(switch_status_t) switch_jb_peek_frame(switch_jb_t *jb, uint32_t ts, uint16_t seq, int peek, switch_frame_t *frame)
 {
 	switch_jb_node_t *node = NULL;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_mutex_lock(jb->mutex);
+
 	if (seq) {
 		uint16_t want_seq = seq + peek;
-		node = switch_core_inthash_find(jb->node_hash, htons(want_seq));
+		node = jb_find_seq(jb, htons(want_seq));
 	} else if (ts && jb->samples_per_frame) {
 		uint32_t want_ts = ts + (peek * jb->samples_per_frame);
-		node = switch_core_inthash_find(jb->node_hash_ts, htonl(want_ts));
+		node = jb_find_ts(jb, htonl(want_ts));
 	}
 
 	if (node) {
@@ -1259,10 +1325,12 @@ SWITCH_DECLARE(switch_status_t) switch_jb_peek_frame(switch_jb_t *jb, uint32_t t
 		if (frame->data && frame->buflen > node->len - SWITCH_RTP_HEADER_LEN) {
 			memcpy(frame->data, node->packet.body, node->len - SWITCH_RTP_HEADER_LEN);
 		}
-		return SWITCH_STATUS_SUCCESS;
+		status = SWITCH_STATUS_SUCCESS;
 	}
 
-	return SWITCH_STATUS_FALSE;
+	switch_mutex_unlock(jb->mutex);
+
+	return status;
 }
 
 SWITCH_DECLARE(switch_status_t) switch_jb_get_frames(switch_jb_t *jb, uint32_t *min_frame_len, uint32_t *max_frame_len, uint32_t *cur_frame_len, uint32_t *highest_frame_len)
@@ -1324,6 +1392,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_create(switch_jb_t **jbp, switch_jb_ty
 {
 	switch_jb_t *jb;
 	int free_pool = 0;
+	uint32_t size, ring_size;
 
 	if (!pool) {
 		switch_core_new_memory_pool(&pool);
@@ -1339,15 +1408,24 @@ SWITCH_DECLARE(switch_status_t) switch_jb_create(switch_jb_t **jbp, switch_jb_ty
 	jb->highest_frame_len = jb->frame_len;
 
 	if (jb->type == SJB_VIDEO) {
-		switch_core_inthash_init(&jb->missing_seq_hash);
 		jb->period_len = 2500;
+		size = max_frame_len * 8;
 	} else {
 		jb->period_len = 250;
+		size = max_frame_len * 2;
 	}
-	
-	switch_core_inthash_init(&jb->node_hash);
+
+	/* the ring grows later on if the seqs we hold ever span more than this */
+	for (ring_size = JB_RING_MIN; ring_size < size && ring_size < JB_RING_MAX; ring_size <<= 1);
+
+	if (jb_ring_alloc(jb, ring_size) != SWITCH_STATUS_SUCCESS) {
+		if (free_pool) {
+			switch_core_destroy_memory_pool(&pool);
+		}
+		return SWITCH_STATUS_MEMERR;
+	}
+
 	switch_mutex_init(&jb->mutex, SWITCH_MUTEX_NESTED, pool);
-	switch_mutex_init(&jb->list_mutex, SWITCH_MUTEX_NESTED, pool);
 
 	*jbp = jb;
 
@@ -1362,18 +1440,15 @@ SWITCH_DECLARE(switch_status_t) switch_jb_destroy(switch_jb_t **jbp)
 	if (jb->type == SJB_VIDEO && !switch_test_flag(jb, SJB_QUEUE_ONLY)) {
 		jb_debug(jb, 3, "Stats: NACK saved the day: %u\n", jb->nack_saved_the_day);
 		jb_debug(jb, 3, "Stats: NACK was late: %u\n", jb->nack_didnt_save_the_day);
-		jb_debug(jb, 3, "Stats: Hash entrycount: missing_seq_hash %u\n", switch_hashtable_count(jb->missing_seq_hash));
-	}
-	if (jb->type == SJB_VIDEO) {
-		switch_core_inthash_destroy(&jb->missing_seq_hash);
-	}
-	switch_core_inthash_destroy(&jb->node_hash);
-
-	if (jb->node_hash_ts) {
-		switch_core_inthash_destroy(&jb->node_hash_ts);
+		jb_debug(jb, 3, "Stats: Missing seqs: %u\n", jb->missing_count);
 	}
 
-	free_nodes(jb);
+	switch_safe_free(jb->ring);
+	switch_safe_free(jb->visible_map);
+	switch_safe_free(jb->ts_ring);
+	switch_safe_free(jb->missing_map);
+	switch_safe_free(jb->missing_seq);
+	switch_safe_free(jb->nack_time);
 
 	if (jb->free_pool) {
 		switch_core_destroy_memory_pool(&jb->pool);
@@ -1384,13 +1459,12 @@ SWITCH_DECLARE(switch_status_t) switch_jb_destroy(switch_jb_t **jbp)
 
 SWITCH_DECLARE(uint32_t) switch_jb_pop_nack(switch_jb_t *jb)
 {
-	switch_hash_index_t *hi = NULL;
 	uint32_t nack = 0;
 	uint16_t blp = 0;
-	uint16_t least = 0;
-	int i = 0;
-	void *val;
-	const void *var;
+	uint16_t least = 0, oldest;
+	uint32_t w, words;
+	switch_time_t now;
+	int found = 0, i;
 
 	if (jb->type != SJB_VIDEO) {
 		return 0;
@@ -1398,56 +1472,51 @@ SWITCH_DECLARE(uint32_t) switch_jb_pop_nack(switch_jb_t *jb)
 
 	switch_mutex_lock(jb->mutex);
 
- top:
-
-	for (hi = switch_core_hash_first_iter(jb->missing_seq_hash, hi); hi; hi = switch_core_hash_next(&hi)) {
-		uint16_t seq;
-		//const char *token;
-		switch_time_t then = 0;
-
-		switch_core_hash_this(hi, &var, NULL, &val);
-		//token = (const char *) val;
+	now = switch_time_now();
+	oldest = ntohs(jb->target_seq) - jb->frame_len;
+	words = jb->ring_size >> 6;
 
-		//if (token == TOKEN_2) {
-			//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SKIP %u %s\n", ntohs(*((uint16_t *) var)), token);
-			//printf("WTf\n");
-		//	continue;
-		//}
+	for (w = 0; w < words && jb->missing_count; w++) {
+		uint64_t bits = jb->missing_map[w];
 
-		seq = ntohs(*((uint16_t *) var));
-		then = (intptr_t) val;
+		while (bits) {
+			uint32_t slot = (w << 6) + jb_ctz64(bits);
+			uint16_t seq = jb->missing_seq[slot];
+			switch_time_t then = jb->nack_time[slot];
 
-		if (then != 1 && ((uint32_t)(switch_time_now() - then)) < RENACK_TIME) {
-			jb_debug(jb, 3, "NACKABLE seq %u too soon to repeat\n", seq);
-			continue;
-		}
+			bits &= bits - 1;
 
-		//if (then != 1) {
-		//	jb_debug(jb, 3, "NACKABLE seq %u not too soon to repeat %lu\n", seq, switch_time_now() - then);
-		//}
+			if (then != 1 && ((uint32_t)(now - then)) < RENACK_TIME) {
+				jb_debug(jb, 3, "NACKABLE seq %u too soon to repeat\n", seq);
+				continue;
+			}
 
-		if (seq < ntohs(jb->target_seq) - jb->frame_len) {
-			jb_debug(jb, 3, "NACKABLE seq %u expired\n", seq);
-			switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(seq));
-			goto top;
-		}
+			/* until we know where we are reading from nothing can be called too old */
+			if (jb->target_seq && jb_seq_before(seq, oldest)) {
+				jb_debug(jb, 3, "NACKABLE seq %u expired\n", seq);
+				jb_map_clear(jb->missing_map, slot);
+				jb->missing_count--;
+				continue;
+			}
 
-		if (!least || seq < least) {
-			least = seq;
+			if (!found || jb_seq_before(seq, least)) {
+				least = seq;
+				found = 1;
+			}
 		}
 	}
 
-	switch_safe_free(hi);
-
-	if (least && switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(least))) {
+	if (found) {
 		jb_debug(jb, 3, "Found NACKABLE seq %u\n", least);
 		nack = (uint32_t) htons(least);
-		switch_core_inthash_insert(jb->missing_seq_hash, nack, (void *) (intptr_t)switch_time_now());
+		jb->nack_time[least & jb->ring_mask] = now;
 
 		for(i = 0; i < 16; i++) {
-			if (switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(least + i + 1))) {
-				switch_core_inthash_insert(jb->missing_seq_hash, (uint32_t)htons(least + i + 1), (void *)(intptr_t)switch_time_now());
-				jb_debug(jb, 3, "Found addtl NACKABLE seq %u\n", least + i + 1);
+			uint16_t seq = least + i + 1;
+
+			if (jb_missing_test(jb, seq)) {
+				jb->nack_time[seq & jb->ring_mask] = now;
+				jb_debug(jb, 3, "Found addtl NACKABLE seq %u\n", seq);
 				blp |= (1 << i);
 			}
 		}
@@ -1492,7 +1561,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_put_packet(switch_jb_t *jb, switch_rtp
 		jb->next_seq = htons(got + 1);
 	} else {
 
-		if (switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(got))) {
+		if (jb_missing_clear(jb, got)) {
 			if (got < ntohs(jb->target_seq)) {
 				jb_debug(jb, 2, "got nacked seq %u too late\n", got);
 				jb_frame_inc(jb, 1);
@@ -1517,7 +1586,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_put_packet(switch_jb_t *jb, switch_rtp
 
 				for (i = want; i < got; i++) {
 					jb_debug(jb, 2, "MARK MISSING %u ts:%u\n", i, ntohl(packet->header.ts));
-					switch_core_inthash_insert(jb->missing_seq_hash, (uint32_t)htons(i), (void *)(intptr_t)1);
+					jb_missing_mark(jb, (uint16_t) i);
 				}
 			}
 		}
@@ -1550,7 +1619,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_get_packet_by_seq(switch_jb_t *jb, uin
 	switch_status_t status = SWITCH_STATUS_NOTFOUND;
 
 	switch_mutex_lock(jb->mutex);
-	if ((node = switch_core_inthash_find(jb->node_hash, seq))) {
+	if ((node = jb_find_seq(jb, seq))) {
 		jb_debug(jb, 2, "Found buffered seq: %u\n", ntohs(seq));
 		*packet = node->packet;
 		*len = node->len;
@@ -1723,7 +1792,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_get_packet(switch_jb_t *jb, switch_rtp
 	*len = node->len;
 	jb->last_len = *len;
 	packet->header.version = 2;
-	hide_node(node, SWITCH_TRUE);
+	hide_node(node);
 
 	jb_debug(jb, 2, "GET packet ts:%u seq:%u %s\n", ntohl(packet->header.ts), ntohs(packet->header.seq), packet->header.m ? " <MARK>" : "");
 
@@ -103,9 +103,24 @@ struct switch_loadable_module_container {
 	switch_mutex_t *mutex;
 	switch_thread_rwlock_t *chat_rwlock;
 	switch_memory_pool_t *pool;
+	/* memoized switch_loadable_module_get_codecs_sorted() results, flushed whenever the codec catalog changes */
+	switch_thread_rwlock_t *codec_memo_rwlock;
+	switch_hash_t *codec_memo_hash;
+	switch_memory_pool_t *codec_memo_pool;
+	uint32_t codec_memo_count;
+	volatile uint32_t codec_catalog_version;
 };
 
+#define CODEC_MEMO_MAX 256
+
+typedef struct {
+	int count;
+	const switch_codec_implementation_t *array[SWITCH_MAX_CODECS];
+	char *fmtp[SWITCH_MAX_CODECS];
+} codec_memo_t;
+
 static struct switch_loadable_module_container loadable_modules;
+static void codec_catalog_changed(void);
 static switch_status_t do_shutdown(switch_loadable_module_t *module, switch_bool_t shutdown, switch_bool_t unload, switch_bool_t fail_if_busy,
 								   const char **err);
 static switch_status_t switch_loadable_module_load_module_ex(const char *dir, const char *fname, switch_bool_t runtime, switch_bool_t global, const char **err, switch_loadable_module_type_t type, switch_hash_t *event_hash);
@@ -314,6 +329,8 @@ static switch_status_t switch_loadable_module_process(char *key, switch_loadable
 				}
 			}
 		}
+
+		codec_catalog_changed();
 	}
 
 	if (new_module->module_interface->dialplan_interface) {
@@ -1247,7 +1264,12 @@ static switch_status_t switch_loadable_module_unprocess(switch_loadable_module_t
 					}
 				}
 			}
+
+			/* idle handles would outlive the code that has to destroy them */
+			switch_core_codec_pool_flush(ptr);
 		}
+
+		codec_catalog_changed();
 	}
 
 	if (old_module->module_interface->dialplan_interface) {
@@ -2282,6 +2304,7 @@ SWITCH_DECLARE(switch_status_t) switch_loadable_module_init(switch_bool_t autolo
 	switch_core_hash_init(&loadable_modules.secondary_recover_hash);
 	switch_mutex_init(&loadable_modules.mutex, SWITCH_MUTEX_NESTED, loadable_modules.pool);
 	switch_thread_rwlock_create(&loadable_modules.chat_rwlock, loadable_modules.pool);
+	switch_thread_rwlock_create(&loadable_modules.codec_memo_rwlock, loadable_modules.pool);
 
 	/*
 	   Build the optional interface allowlist from switch.conf.xml. When at least one <allow>
@@ -2641,6 +2664,7 @@ SWITCH_DECLARE(void) switch_loadable_module_shutdown(void)
 	switch_core_hash_destroy(&loadable_modules.module_hash);
 	switch_core_hash_destroy(&loadable_modules.endpoint_hash);
 	switch_core_hash_destroy(&loadable_modules.codec_hash);
+	codec_catalog_changed();
 	switch_core_hash_destroy(&loadable_modules.timer_hash);
 	switch_core_hash_destroy(&loadable_modules.application_hash);
 	switch_core_hash_destroy(&loadable_modules.chat_application_hash);
@@ -2979,13 +3003,140 @@ SWITCH_DECLARE(char *) switch_parse_codec_buf(char *buf, uint32_t *interval, uin
 	return name;
 }
 
+/* Called with loadable_modules.mutex held whenever codec implementations come or go. */
+static void codec_catalog_changed(void)
+{
+	switch_thread_rwlock_wrlock(loadable_modules.codec_memo_rwlock);
+	loadable_modules.codec_catalog_version++;
+	if (loadable_modules.codec_memo_hash) {
+		switch_core_hash_destroy(&loadable_modules.codec_memo_hash);
+	}
+	if (loadable_modules.codec_memo_pool) {
+		switch_core_destroy_memory_pool(&loadable_modules.codec_memo_pool);
+	}
+	loadable_modules.codec_memo_count = 0;
+	switch_thread_rwlock_unlock(loadable_modules.codec_memo_rwlock);
+}
+
+SWITCH_DECLARE(uint32_t) switch_loadable_module_codec_catalog_version(void)
+{
+	return loadable_modules.codec_catalog_version;
+}
+
+static switch_bool_t codec_memo_key(char *key, switch_size_t keylen, char **prefs, int preflen, int arraylen)
+{
+	switch_size_t used;
+	int x;
+
+	if (arraylen > SWITCH_MAX_CODECS || preflen <= 0) {
+		return SWITCH_FALSE;
+	}
+
+	used = switch_snprintf(key, keylen, "%d", arraylen);
+
+	for (x = 0; x < preflen; x++) {
+		switch_size_t len = strlen(prefs[x]);
+
+		if (used + len + 2 > keylen) {
+			return SWITCH_FALSE;
+		}
+
+		key[used++] = '|';
+		memcpy(key + used, prefs[x], len);
+		used += len;
+	}
+
+	key[used] = '\0';
+
+	return SWITCH_TRUE;
+}
+
+static int codec_memo_fetch(const char *key, const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN])
+{
+	codec_memo_t *memo;
+	int i, count = -1;
+
+	switch_thread_rwlock_rdlock(loadable_modules.codec_memo_rwlock);
+
+	if (loadable_modules.codec_memo_hash && (memo = switch_core_hash_find(loadable_modules.codec_memo_hash, key))) {
+		for (i = 0; i < memo->count; i++) {
+			array[i] = memo->array[i];
+			if (memo->fmtp[i]) {
+				switch_set_string(fmtp_array[i], memo->fmtp[i]);
+			}
+		}
+		count = memo->count;
+	}
+
+	switch_thread_rwlock_unlock(loadable_modules.codec_memo_rwlock);
+
+	return count;
+}
+
+static void codec_memo_store(const char *key, uint32_t version, const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN],
+							 const switch_bool_t *fmtp_set, int count)
+{
+	codec_memo_t *memo;
+	int i;
+
+	switch_thread_rwlock_wrlock(loadable_modules.codec_memo_rwlock);
+
+	/* a module came or went while the list was being built */
+	if (version != loadable_modules.codec_catalog_version) {
+		goto end;
+	}
+
+	if (loadable_modules.codec_memo_count >= CODEC_MEMO_MAX) {
+		switch_core_hash_destroy(&loadable_modules.codec_memo_hash);
+		switch_core_destroy_memory_pool(&loadable_modules.codec_memo_pool);
+		loadable_modules.codec_memo_count = 0;
+	}
+
+	if (!loadable_modules.codec_memo_pool) {
+		switch_core_new_memory_pool(&loadable_modules.codec_memo_pool);
+		switch_core_hash_init(&loadable_modules.codec_memo_hash);
+	}
+
+	if (switch_core_hash_find(loadable_modules.codec_memo_hash, key)) {
+		goto end;
+	}
+
+	memo = switch_core_alloc(loadable_modules.codec_memo_pool, sizeof(*memo));
+	memo->count = count;
+	for (i = 0; i < count; i++) {
+		memo->array[i] = array[i];
+		if (fmtp_set[i]) {
+			memo->fmtp[i] = switch_core_strdup(loadable_modules.codec_memo_pool, fmtp_array[i]);
+		}
+	}
+
+	switch_core_hash_insert(loadable_modules.codec_memo_hash, key, memo);
+	loadable_modules.codec_memo_count++;
+
+ end:
+
+	switch_thread_rwlock_unlock(loadable_modules.codec_memo_rwlock);
+}
+
 SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN], int arraylen, char **prefs, int preflen)
 {
 	int x, i = 0, j = 0;
 	switch_codec_interface_t *codec_interface;
 	const switch_codec_implementation_t *imp;
+	switch_bool_t fmtp_set[SWITCH_MAX_CODECS] = { 0 };
+	char key[2048];
+	switch_bool_t memoize;
+	uint32_t version;
+
+	if ((memoize = codec_memo_key(key, sizeof(key), prefs, preflen, arraylen))) {
+		if ((i = codec_memo_fetch(key, array, fmtp_array)) >= 0) {
+			return i;
+		}
+		i = 0;
+	}
 
 	switch_mutex_lock(loadable_modules.mutex);
+	version = loadable_modules.codec_catalog_version;
 
 	for (x = 0; x < preflen; x++) {
 		char *name, buf[256], jbuf[256], *modname = NULL, *fmtp = NULL;
@@ -3061,6 +3212,7 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_
 
 				if (!zstr(fmtp)) {
 					switch_set_string(fmtp_array[i], fmtp);
+					fmtp_set[i] = SWITCH_TRUE;
 				}
 				array[i++] = imp;
 				goto found;
@@ -3098,7 +3250,7 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_
 
 			UNPROTECT_INTERFACE(codec_interface);
 
-			if (i > arraylen) {
+			if (i >= arraylen) {
 				break;
 			}
 
@@ -3113,6 +3265,10 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_
 
 	switch_loadable_module_sort_codecs(array, i);
 
+	if (memoize) {
+		codec_memo_store(key, version, array, fmtp_array, fmtp_set, i);
+	}
+
 	return i;
 }
 
@@ -34,8 +34,26 @@
 #include <switch_msrp.h>
 #include <switch_stun.h>
 
+/* epoll based server side, enabled with reactor-threads in msrp.conf */
+#if defined(__linux__)
+#define MSRP_REACTOR 1
+#endif
+
+#ifndef WIN32
+#include <sys/uio.h>
+#include <poll.h>
+#endif
+#ifdef MSRP_REACTOR
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#endif
+
 #define MSRP_BUFF_SIZE (SWITCH_RTP_MAX_BUF_LEN - 32)
 #define DEBUG_MSRP 0
+#define MSRP_SEND_TIMEOUT_MS 5000
 
 struct msrp_socket_s {
 	switch_port_t port;
@@ -50,8 +68,23 @@ struct msrp_client_socket_s {
 	int secure;
 	int client_mode;
 	struct switch_msrp_session_s *msrp_session;
+	struct msrp_conn_s *conn; /* set when the connection is served by a reactor */
 };
 
+/* receive side of a connection, [buf, p) holds data and parsing resumes at last_p */
+typedef struct msrp_stream_s {
+	char *buf;
+	char *p;
+	char *last_p;
+	switch_msrp_msg_t *msrp_msg;
+} msrp_stream_t;
+
+/* a piece of an outgoing message */
+typedef struct msrp_iov_s {
+	const char *data;
+	switch_size_t len;
+} msrp_iov_t;
+
 static struct {
 	int running;
 	int debug;
@@ -70,6 +103,7 @@ static struct {
 
 	switch_msrp_socket_t msock;
 	switch_msrp_socket_t msock_ssl;
+	int reactor_threads;
 } globals;
 
 typedef struct worker_helper{
@@ -79,6 +113,78 @@ typedef struct worker_helper{
 	switch_msrp_session_t *msrp_session;
 } worker_helper_t;
 
+#ifdef MSRP_REACTOR
+/*
+ * Reactor mode: instead of a thread blocked in recv() per accepted connection, a few
+ * epoll threads own them.  Each reactor has its own SO_REUSEPORT listeners so the kernel
+ * spreads new connections across them, reads whatever a socket has into a buffer that
+ * only exists while a message is partially received, and parses it incrementally.
+ * Outbound connections (switch_msrp_start_client) keep their own thread.
+ */
+
+#define MSRP_REACTOR_EVENTS 256
+#define MSRP_REACTOR_SWEEP_MS 100
+#define MSRP_REACTOR_SETUP_TIMEOUT 30000000
+#define MSRP_REACTOR_BIND_TRIES 10
+
+typedef enum {
+	MSRP_CONN_TLS,
+	MSRP_CONN_FIRST,
+	MSRP_CONN_BIND,
+	MSRP_CONN_RUNNING
+} msrp_conn_state_t;
+
+typedef struct msrp_reactor_s msrp_reactor_t;
+
+typedef struct msrp_conn_s {
+	switch_msrp_client_socket_t csock;
+	switch_memory_pool_t *pool;
+	msrp_reactor_t *reactor;
+	int fd;
+	msrp_conn_state_t state;
+	uint32_t events;
+	int paused;
+	int closed;
+	int refs;
+	int bind_tries;
+	switch_time_t created;
+	switch_time_t next_try;
+	char uuid[128];
+	msrp_stream_t stream;
+	switch_msrp_session_t *msrp_session;
+	/* SSL_read and SSL_write must not run concurrently on one connection */
+	switch_mutex_t *io_mutex;
+	/* keeps the messages of concurrent senders whole */
+	switch_mutex_t *write_mutex;
+	struct msrp_conn_s *next;
+} msrp_conn_t;
+
+struct msrp_reactor_s {
+	int efd;
+	int wfd;
+	/* plain and TLS listeners, -1 when this reactor does not accept */
+	int lfd[2];
+	switch_socket_t *lsock[2];
+	uint32_t count;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	msrp_conn_t *pending;
+	msrp_conn_t *head;
+};
+
+static struct {
+	msrp_reactor_t *reactors;
+	int count;
+	int next;
+	int sharded;
+	volatile int running;
+} msrp_reactor;
+
+static switch_status_t msrp_reactor_start(void);
+static void msrp_reactor_stop(void);
+static void msrp_conn_free(msrp_conn_t *conn);
+#endif
+
 SWITCH_DECLARE(void) switch_msrp_msg_set_payload(switch_msrp_msg_t *msrp_msg, const char *buf, switch_size_t payload_bytes)
 {
 	if (!msrp_msg->payload) {
@@ -225,6 +331,14 @@ static switch_status_t load_config(void)
 			} else if (!strcasecmp(var, "message-buffer-size") && val) {
 				globals.message_buffer_size = atoi(val);
 				if (globals.message_buffer_size == 0) globals.message_buffer_size = 50;
+			} else if (!strcasecmp(var, "reactor-threads") && val) {
+#ifdef MSRP_REACTOR
+				globals.reactor_threads = atoi(val);
+				if (globals.reactor_threads < 0) globals.reactor_threads = 0;
+				if (globals.reactor_threads > 64) globals.reactor_threads = 64;
+#else
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "reactor-threads needs epoll, using a thread per connection\n");
+#endif
 			}
 		}
 	}
@@ -247,7 +361,7 @@ static void close_socket(switch_socket_t ** sock)
 	// switch_mutex_unlock(globals.sock_mutex);
 }
 
-static switch_status_t msock_init(char *ip, switch_port_t port, switch_socket_t **sock, switch_memory_pool_t *pool)
+static switch_status_t msock_init(char *ip, switch_port_t port, switch_socket_t **sock, switch_bool_t reuseport, switch_memory_pool_t *pool)
 {
 	switch_sockaddr_t *sa;
 	switch_status_t rv;
@@ -264,6 +378,23 @@ static switch_status_t msock_init(char *ip, switch_port_t port, switch_socket_t
 	rv = switch_socket_opt_set(*sock, SWITCH_SO_REUSEADDR, 1);
 	if (rv) goto sock_fail;
 
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		switch_os_socket_t fd = SWITCH_SOCK_INVALID;
+		int on = 1;
+
+		switch_os_sock_get(&fd, *sock);
+
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on)) < 0) {
+			rv = SWITCH_STATUS_FALSE;
+			goto sock_fail;
+		}
+#else
+		rv = SWITCH_STATUS_NOTIMPL;
+		goto sock_fail;
+#endif
+	}
+
 #ifdef WIN32
 	/* Enable dual-stack listening on Windows */
 	if (switch_sockaddr_get_family(sa) == AF_INET6) {
@@ -283,6 +414,11 @@ static switch_status_t msock_init(char *ip, switch_port_t port, switch_socket_t
 	return SWITCH_STATUS_SUCCESS;
 
 sock_fail:
+	if (*sock) {
+		switch_socket_close(*sock);
+		*sock = NULL;
+	}
+
 	return rv;
 }
 
@@ -314,10 +450,24 @@ SWITCH_DECLARE(switch_status_t) switch_msrp_init(void)
 
 	load_config();
 
+#ifdef MSRP_REACTOR
+	if ((globals.msock.port || globals.msock_ssl.port) && globals.reactor_threads > 0) {
+		globals.running = 1;
+
+		if (globals.msock_ssl.port) {
+			msrp_init_ssl();
+		}
+
+		if (msrp_reactor_start() == SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_SUCCESS;
+		}
+	}
+#endif
+
 	if (globals.msock.port) {
 		globals.running = 1;
 
-		status = msock_init(globals.ip, globals.msock.port, &globals.msock.sock, pool);
+		status = msock_init(globals.ip, globals.msock.port, &globals.msock.sock, SWITCH_FALSE, pool);
 
 		if (status == SWITCH_STATUS_SUCCESS) {
 			switch_threadattr_create(&thd_attr, pool);
@@ -331,8 +481,11 @@ SWITCH_DECLARE(switch_status_t) switch_msrp_init(void)
 	if (globals.msock_ssl.port) {
 		globals.running = 1;
 
-		msrp_init_ssl();
-		status = msock_init(globals.ip, globals.msock_ssl.port, &globals.msock_ssl.sock, pool);
+		if (!globals.ssl_client_ctx) {
+			msrp_init_ssl();
+		}
+
+		status = msock_init(globals.ip, globals.msock_ssl.port, &globals.msock_ssl.sock, SWITCH_FALSE, pool);
 
 		if (status == SWITCH_STATUS_SUCCESS) {
 			switch_threadattr_create(&thd_attr, pool);
@@ -355,6 +508,10 @@ SWITCH_DECLARE(switch_status_t) switch_msrp_destroy(void)
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "destroying thread\n");
 
+#ifdef MSRP_REACTOR
+	msrp_reactor_stop();
+#endif
+
 	sock = globals.msock.sock;
 	close_socket(&sock);
 
@@ -397,6 +554,12 @@ SWITCH_DECLARE(switch_status_t) switch_msrp_session_destroy(switch_msrp_session_
 
 	switch_mutex_lock((*ms)->mutex);
 
+#ifdef MSRP_REACTOR
+	if ((*ms)->csock && (*ms)->csock->conn) {
+		/* the reactor owns the socket, this wakes it up to close the connection */
+		shutdown((*ms)->csock->conn->fd, SHUT_RDWR);
+	} else
+#endif
 	if ((*ms)->csock && (*ms)->csock->sock) {
 		close_socket(&(*ms)->csock->sock);
 	}
@@ -546,16 +709,209 @@ static switch_status_t msrp_socket_recv(switch_msrp_client_socket_t *csock, char
 	return status;
 }
 
-static switch_status_t msrp_socket_send(switch_msrp_client_socket_t *csock, char *buf, switch_size_t *len)
+/* the parts as one buffer, stack is used when they fit, free the result if it isn't stack */
+static char *msrp_iov_join(msrp_iov_t *parts, int n, char *stack, switch_size_t stack_len, switch_size_t *len)
+{
+	char *buf = stack;
+	switch_size_t total = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		total += parts[i].len;
+	}
+
+	if (total > stack_len) {
+		switch_malloc(buf, total);
+	}
+
+	for (*len = 0, i = 0; i < n; i++) {
+		memcpy(buf + *len, parts[i].data, parts[i].len);
+		*len += parts[i].len;
+	}
+
+	return buf;
+}
+
+#ifndef WIN32
+/* wait for a socket to become readable or writable, > 0 when it did */
+static int msrp_wait_fd(int fd, int out)
+{
+	struct pollfd pfd = { 0 };
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = out ? POLLOUT : POLLIN;
+
+	do {
+		r = poll(&pfd, 1, MSRP_SEND_TIMEOUT_MS);
+	} while (r < 0 && errno == EINTR);
+
+	return r;
+}
+
+/* hands the parts to the kernel as they are, the payload is never copied */
+static switch_status_t msrp_fd_writev(int fd, msrp_iov_t *parts, int n)
+{
+	struct iovec iov[8];
+	int i, cnt = 0;
+
+	for (i = 0; i < n && cnt < 8; i++) {
+		if (parts[i].len) {
+			iov[cnt].iov_base = (void *) parts[i].data;
+			iov[cnt].iov_len = parts[i].len;
+			cnt++;
+		}
+	}
+
+	i = 0;
+
+	while (i < cnt) {
+		ssize_t r = writev(fd, iov + i, cnt - i);
+
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && msrp_wait_fd(fd, 1) > 0) continue;
+			return SWITCH_STATUS_FALSE;
+		}
+
+		while (i < cnt && (size_t) r >= iov[i].iov_len) {
+			r -= iov[i].iov_len;
+			i++;
+		}
+
+		if (i < cnt) {
+			iov[i].iov_base = (char *) iov[i].iov_base + r;
+			iov[i].iov_len -= r;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+#endif
+
+#ifdef MSRP_REACTOR
+static switch_status_t msrp_conn_ssl_write(msrp_conn_t *conn, const char *buf, switch_size_t len)
+{
+	while (len > 0) {
+		int r, err = SSL_ERROR_NONE;
+
+		switch_mutex_lock(conn->io_mutex);
+		r = SSL_write(conn->csock.ssl, buf, (int) len);
+		if (r <= 0) err = SSL_get_error(conn->csock.ssl, r);
+		switch_mutex_unlock(conn->io_mutex);
+
+		if (r > 0) {
+			buf += r;
+			len -= r;
+		} else if ((err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) && msrp_wait_fd(conn->fd, err == SSL_ERROR_WANT_WRITE) > 0) {
+			continue;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "TLS write error: ret=%d error=%d\n", r, err);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+#endif
+
+static switch_status_t msrp_socket_sendv(switch_msrp_client_socket_t *csock, msrp_iov_t *parts, int n)
 {
-	// switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "send: %s\n", buf);
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	char stack[4096];
+	char *buf = NULL;
+	switch_size_t len = 0;
+
+#ifdef MSRP_REACTOR
+	if (csock->conn) {
+		msrp_conn_t *conn = csock->conn;
+
+		switch_mutex_lock(conn->write_mutex);
+		if (csock->secure) {
+			buf = msrp_iov_join(parts, n, stack, sizeof(stack), &len);
+			status = msrp_conn_ssl_write(conn, buf, len);
+		} else {
+			status = msrp_fd_writev(conn->fd, parts, n);
+		}
+		switch_mutex_unlock(conn->write_mutex);
+
+		goto done;
+	}
+#endif
+
+#ifndef WIN32
+	if (!csock->secure) {
+		switch_os_socket_t fd = SWITCH_SOCK_INVALID;
+
+		if (csock->sock && switch_os_sock_get(&fd, csock->sock) == SWITCH_STATUS_SUCCESS && fd != SWITCH_SOCK_INVALID) {
+			status = msrp_fd_writev(fd, parts, n);
+		}
+
+		goto done;
+	}
+#endif
+
+	buf = msrp_iov_join(parts, n, stack, sizeof(stack), &len);
 
 	if (csock->secure) {
-		*len = SSL_write(csock->ssl, buf, *len);
-		return *len ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+		status = SSL_write(csock->ssl, buf, len) > 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
 	} else {
-		return switch_socket_send(csock->sock, buf, len);
+		status = switch_socket_send(csock->sock, buf, &len);
+	}
+
+ done:
+	if (buf != stack) {
+		switch_safe_free(buf);
+	}
+
+	return status;
+}
+
+static switch_status_t msrp_socket_send(switch_msrp_client_socket_t *csock, char *buf, switch_size_t *len)
+{
+	msrp_iov_t part;
+
+	part.data = buf;
+	part.len = *len;
+
+	return msrp_socket_sendv(csock, &part, 1);
+}
+
+/* the connection a session sends on, a reactor connection is not freed before it is released */
+static switch_msrp_client_socket_t *msrp_csock_hold(switch_msrp_session_t *ms)
+{
+	switch_msrp_client_socket_t *csock;
+
+	switch_mutex_lock(ms->mutex);
+	csock = ms->csock;
+#ifdef MSRP_REACTOR
+	if (csock && csock->conn) {
+		csock->conn->refs++;
 	}
+#endif
+	switch_mutex_unlock(ms->mutex);
+
+	return csock;
+}
+
+static void msrp_csock_release(switch_msrp_session_t *ms, switch_msrp_client_socket_t *csock)
+{
+#ifdef MSRP_REACTOR
+	msrp_conn_t *conn;
+	int last;
+
+	if (!csock || !(conn = csock->conn)) {
+		return;
+	}
+
+	switch_mutex_lock(ms->mutex);
+	last = (--conn->refs == 0 && conn->closed);
+	switch_mutex_unlock(ms->mutex);
+
+	if (last) {
+		msrp_conn_free(conn);
+	}
+#endif
 }
 
 void dump_buffer(const char *buf, switch_size_t len, int line, int is_send)
@@ -580,7 +936,7 @@ void dump_buffer(const char *buf, switch_size_t len, int line, int is_send)
 			buff[j++] = buf[i];
 		}
 		if ((++k) %80 == 0) buff[j++] = '\n';
-		if (j >= MSRP_BUFF_SIZE * 2) break;
+		if (j >= MSRP_BUFF_SIZE * 2 - 5) break;
 	}
 
 	buff[j] = '\0';
@@ -693,8 +1049,8 @@ static char *msrp_parse_header(char *start, int skip, const char *end, switch_ms
 	char *q;
 	if (*p && *p == ' ') p++;
 	q = p;
-	while(*q != '\n' && q < end) q++;
-	if (q > p) {
+	while(q < end && *q != '\n') q++;
+	if (q < end && q > p) {
 		if (*(q-1) == '\r') *(q-1) = '\0';
 		*q = '\0';
 		switch_msrp_msg_add_header(msrp_msg, htype, p);
@@ -710,6 +1066,9 @@ static switch_msrp_msg_t *msrp_parse_headers(char *start, int len, switch_msrp_m
 	const char *end = start + len;
 
 	while(p < end) {
+		/* only complete lines are parsed, the rest is picked up when more data arrives */
+		if (!memchr(p, '\n', end - p)) break;
+
 		if (!strncasecmp(p, "MSRP ", 5)) {
 			p += 5;
 			q = p;
@@ -889,9 +1248,13 @@ static switch_msrp_msg_t *msrp_parse_buffer(char *buf, int len, switch_msrp_msg_
 		dump_buffer(buf, len, __LINE__, 0);
 	}
 
-	if (msrp_msg->state == MSRP_ST_WAIT_HEADER) {
-		if ((start = (char *)switch_stristr("MSRP ", buf)) == NULL) {
+	if (msrp_msg->state == MSRP_ST_WAIT_HEADER || msrp_msg->state == MSRP_ST_PARSE_HEADER) {
+		if (msrp_msg->state == MSRP_ST_PARSE_HEADER) {
+			/* the start line and some headers came with an earlier read */
+			start = buf;
+		} else if ((start = (char *)switch_stristr("MSRP ", buf)) == NULL) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Not an MSRP packet, Skip!\n");
+			msrp_msg->last_p = buf + len;
 			return msrp_msg;
 		}
 
@@ -900,7 +1263,7 @@ static switch_msrp_msg_t *msrp_parse_buffer(char *buf, int len, switch_msrp_msg_
 		if (msrp_msg->state == MSRP_ST_ERROR) return msrp_msg;
 		if (msrp_msg->state == MSRP_ST_DONE) return msrp_msg;
 
-		if (msrp_msg->last_p && msrp_msg->last_p < buf + len) {
+		if (msrp_msg->state == MSRP_ST_WAIT_BODY && msrp_msg->last_p && msrp_msg->last_p < buf + len) {
 			msrp_msg = msrp_parse_buffer(msrp_msg->last_p, len - (msrp_msg->last_p - buf), msrp_msg, pool);
 		}
 	} else if (msrp_msg->state == MSRP_ST_WAIT_BODY) {
@@ -964,6 +1327,11 @@ static switch_msrp_msg_t *msrp_parse_buffer(char *buf, int len, switch_msrp_msg_
 		} else if (msrp_msg->payload_bytes == 0) {
 			int dlen = strlen(msrp_msg->delimiter);
 
+			if (len < dlen + 3) {
+				msrp_msg->last_p = buf;
+				return msrp_msg;
+			}
+
 			if (strncasecmp(buf, msrp_msg->delimiter, dlen)) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error find delimiter\n");
 				msrp_msg->state = MSRP_ST_ERROR;
@@ -978,29 +1346,19 @@ static switch_msrp_msg_t *msrp_parse_buffer(char *buf, int len, switch_msrp_msg_
 		} else {
 			int dlen = strlen(msrp_msg->delimiter);
 
-			if (msrp_msg->payload_bytes > len) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "payload too large ... %d > %d\n", (int)msrp_msg->payload_bytes, (int)len);
-				msrp_msg->state = MSRP_ST_ERROR; // not supported yet
+			if (msrp_msg->payload_bytes + dlen + 5 > (switch_size_t) len) {
+				/* wait for the rest of the body and the closing delimiter */
+				msrp_msg->last_p = buf;
 				return msrp_msg;
 			}
 
 			switch_msrp_msg_set_payload(msrp_msg, buf, msrp_msg->payload_bytes);
-			msrp_msg->last_p = buf + msrp_msg->payload_bytes;
 			msrp_msg->state = MSRP_ST_DONE;
-			msrp_msg->last_p = buf + msrp_msg->payload_bytes;
-
-			if (msrp_msg->payload_bytes <= len - dlen - 5) {
-				msrp_msg->last_p = buf + msrp_msg->payload_bytes + dlen + 5;
-
-				if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "payload bytes: %" SWITCH_SIZE_T_FMT " len: %d dlen: %d delimiter: %s\n", msrp_msg->payload_bytes, len, dlen, msrp_msg->delimiter);
-
-				return msrp_msg; /*Fixme: assuming \r\ndelimiter$\r\n present*/
-			}
+			msrp_msg->last_p = buf + msrp_msg->payload_bytes + dlen + 5;
 
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%" SWITCH_SIZE_T_FMT " %d %d\n", msrp_msg->payload_bytes, len, dlen);
-			msrp_msg->state = MSRP_ST_ERROR;
+			if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "payload bytes: %" SWITCH_SIZE_T_FMT " len: %d dlen: %d delimiter: %s\n", msrp_msg->payload_bytes, len, dlen, msrp_msg->delimiter);
 
-			return msrp_msg;
+			return msrp_msg; /*Fixme: assuming \r\ndelimiter$\r\n present*/
 		}
 	} else {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error code: %d\n", msrp_msg->state);
@@ -1048,10 +1406,14 @@ switch_status_t msrp_report(switch_msrp_client_socket_t *csock, switch_msrp_msg_
 
 static switch_bool_t msrp_find_uuid(char *uuid, const char *to_path)
 {
-	int len = strlen(to_path);
+	int len;
 	int i;
 	int slash_count = 0;
-	switch_assert(to_path);
+
+	if (!to_path) return SWITCH_FALSE;
+
+	len = strlen(to_path);
+
 	for(i=0; i<len; i++){
 		if (*(to_path + i) == '/') {
 			if (++slash_count == 3) break;
@@ -1063,14 +1425,139 @@ static switch_bool_t msrp_find_uuid(char *uuid, const char *to_path)
 	return SWITCH_TRUE;
 }
 
+/*
+ * Parse what was just received at stream->p plus anything left over from earlier reads.
+ * Complete SEND requests are answered and queued on the session; without a session the
+ * first complete message is returned in *first and the rest stays buffered.
+ */
+static switch_status_t msrp_stream_consume(msrp_stream_t *stream, switch_size_t bytes, switch_msrp_client_socket_t *csock,
+										   switch_msrp_session_t *msrp_session, switch_msrp_msg_t **first)
+{
+	stream->p += bytes;
+	*stream->p = '\0';
+
+	while (stream->last_p < stream->p) {
+		char *last_p = stream->last_p;
+
+		stream->msrp_msg = msrp_parse_buffer(last_p, stream->p - last_p, stream->msrp_msg, NULL);
+		switch_assert(stream->msrp_msg);
+
+		if (stream->msrp_msg->state == MSRP_ST_ERROR) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "msrp parse error!\n");
+			return SWITCH_STATUS_FALSE;
+		}
+
+		if (globals.debug) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "state:%d, len:%" SWITCH_SIZE_T_FMT " payload_bytes:%" SWITCH_SIZE_T_FMT "\n",
+							  stream->msrp_msg->state, (switch_size_t) (stream->p - last_p), stream->msrp_msg->payload_bytes);
+		}
+
+		if (stream->msrp_msg->last_p && stream->msrp_msg->last_p <= stream->p) {
+			stream->last_p = stream->msrp_msg->last_p;
+		} else {
+			stream->last_p = stream->p;
+		}
+
+		if (stream->msrp_msg->state == MSRP_ST_DONE && !msrp_session && first) {
+			*first = stream->msrp_msg;
+			stream->msrp_msg = NULL;
+			break;
+		} else if (stream->msrp_msg->state == MSRP_ST_DONE && stream->msrp_msg->method == MSRP_METHOD_SEND && msrp_session) {
+			msrp_reply(csock, stream->msrp_msg);
+
+			if (msrp_check_success_report(stream->msrp_msg)) {
+				msrp_report(csock, stream->msrp_msg, "200 OK");
+			}
+
+			switch_msrp_session_push_msg(msrp_session, stream->msrp_msg);
+			stream->msrp_msg = NULL;
+		} else if (stream->msrp_msg->state == MSRP_ST_DONE) { /* throw away */
+			switch_msrp_msg_destroy(&stream->msrp_msg);
+		} else if (stream->last_p == last_p) {
+			break; /* needs more data */
+		}
+	}
+
+	if (stream->last_p == stream->p) {
+		stream->p = stream->last_p = stream->buf;
+	} else if (stream->last_p > stream->buf) {
+		/* parsed messages keep no pointers into the buffer, move the unparsed rest to the front */
+		switch_size_t rest = stream->p - stream->last_p;
+
+		memmove(stream->buf, stream->last_p, rest);
+		stream->p = stream->buf + rest;
+		stream->last_p = stream->buf;
+	}
+
+	if (stream->p >= stream->buf + MSRP_BUFF_SIZE) {
+		switch_msrp_msg_t *msrp_msg = stream->msrp_msg;
+		switch_msrp_msg_t *new_msg;
+
+		if (!msrp_msg || msrp_msg->state != MSRP_ST_WAIT_BODY || !msrp_msg->range_star || !msrp_session) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "buffer overflow\n");
+			return SWITCH_STATUS_FALSE;
+		}
+
+		/* buffer full, pass on what we have of a chunk that has no end yet */
+		msrp_msg->payload_bytes = 0;
+		new_msg = switch_msrp_msg_dup(msrp_msg);
+		switch_msrp_msg_set_payload(new_msg, stream->buf, stream->p - stream->buf);
+		new_msg->state = MSRP_ST_DONE;
+		switch_msrp_session_push_msg(msrp_session, new_msg);
+
+		msrp_msg->accumulated_bytes += (stream->p - stream->buf);
+		msrp_msg->last_p = stream->buf;
+		msrp_msg->byte_start = msrp_msg->byte_end = 0;
+		msrp_msg->payload_bytes = 0;
+		stream->p = stream->last_p = stream->buf;
+
+		if (globals.debug) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "acc: %" SWITCH_SIZE_T_FMT "\n", msrp_msg->accumulated_bytes);
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* answer the first message of an accepted connection and find the session it belongs to */
+static switch_status_t msrp_first_msg(switch_msrp_client_socket_t *csock, switch_msrp_msg_t *msrp_msg, char *uuid)
+{
+	if (globals.debug) {
+		char *data = msrp_msg_serialize(msrp_msg);
+
+		if (data) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s\n", data);
+			free(data);
+		}
+	}
+
+	if (msrp_msg->method == MSRP_METHOD_SEND) {
+		msrp_reply(csock, msrp_msg);
+		if (msrp_check_success_report(msrp_msg)) {
+			msrp_report(csock, msrp_msg, "200 OK");
+		}
+	} else if (msrp_msg->method == MSRP_METHOD_AUTH) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP_METHOD_AUTH\n");
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Parse initial message error!\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (msrp_find_uuid(uuid, switch_msrp_msg_get_header(msrp_msg, MSRP_H_TO_PATH)) != SWITCH_TRUE) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid MSRP to-path!\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static void *SWITCH_THREAD_FUNC msrp_worker(switch_thread_t *thread, void *obj)
 {
 	worker_helper_t *helper = (worker_helper_t *) obj;
 	switch_msrp_client_socket_t *csock = &helper->csock;
 	switch_memory_pool_t *pool = helper->pool;
-	char buf[MSRP_BUFF_SIZE];
-	char *p;
-	char *last_p;
+	char buf[MSRP_BUFF_SIZE + 1];
+	msrp_stream_t stream = { 0 };
 	switch_size_t len = MSRP_BUFF_SIZE;
 	switch_status_t status;
 	switch_msrp_msg_t *msrp_msg = NULL;
@@ -1247,43 +1734,23 @@ static void *SWITCH_THREAD_FUNC msrp_worker(switch_thread_t *thread, void *obj)
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "SSL established = %d\n", secure_established);
 		}
 
-		len = MSRP_BUFF_SIZE;
-		status = msrp_socket_recv(csock, buf, &len);
-
-		if (helper->debug) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "status:%d, len:%" SWITCH_SIZE_T_FMT "\n", status, len);
-		}
-
-		if (status == SWITCH_STATUS_SUCCESS) {
-			msrp_msg = msrp_parse_buffer(buf, len, NULL, pool);
-			switch_assert(msrp_msg);
-		} else {
-			goto end;
-		}
+		stream.buf = stream.p = stream.last_p = buf;
 
-		if (helper->debug) {
-			char *data = msrp_msg_serialize(msrp_msg);
+		while (!msrp_msg) {
+			len = MSRP_BUFF_SIZE - (stream.p - stream.buf);
+			status = msrp_socket_recv(csock, stream.p, &len);
 
-			if (data) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s\n", data);
-				free(data);
+			if (helper->debug) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "status:%d, len:%" SWITCH_SIZE_T_FMT "\n", status, len);
 			}
-		}
 
-		if (msrp_msg->state == MSRP_ST_DONE && msrp_msg->method == MSRP_METHOD_SEND) {
-			msrp_reply(csock, msrp_msg);
-			if (msrp_check_success_report(msrp_msg)) {
-				msrp_report(csock, msrp_msg, "200 OK");
+			if (status != SWITCH_STATUS_SUCCESS || len == 0 || msrp_stream_consume(&stream, len, csock, NULL, &msrp_msg) != SWITCH_STATUS_SUCCESS) {
+				goto end;
 			}
-		} else if (msrp_msg->state == MSRP_ST_DONE && msrp_msg->method == MSRP_METHOD_AUTH) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP_METHOD_AUTH\n");
-		} else {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Parse initial message error!\n");
-			goto end;
 		}
 
-		if (msrp_find_uuid(uuid, switch_msrp_msg_get_header(msrp_msg, MSRP_H_TO_PATH)) != SWITCH_TRUE) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid MSRP to-path!\n");
+		if (msrp_first_msg(csock, msrp_msg, uuid) != SWITCH_STATUS_SUCCESS) {
+			goto end;
 		}
 
 		{
@@ -1308,50 +1775,32 @@ static void *SWITCH_THREAD_FUNC msrp_worker(switch_thread_t *thread, void *obj)
 		}
 	}
 
-	len = MSRP_BUFF_SIZE;
-	p = buf;
-	last_p = buf;
 	if (msrp_msg) switch_msrp_msg_destroy(&msrp_msg);
 
-	while (msrp_socket_recv(csock, p, &len) == SWITCH_STATUS_SUCCESS) {
+	if (!stream.buf) {
+		stream.buf = stream.p = stream.last_p = buf;
+	} else if (stream.p > stream.buf) {
+		/* whatever came in behind the first message */
+		if (msrp_stream_consume(&stream, 0, csock, msrp_session, NULL) != SWITCH_STATUS_SUCCESS) {
+			goto end;
+		}
+	}
+
+	len = MSRP_BUFF_SIZE - (stream.p - stream.buf);
+
+	while (msrp_socket_recv(csock, stream.p, &len) == SWITCH_STATUS_SUCCESS) {
 		// switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "read bytes: %" SWITCH_SIZE_T_FMT "\n", len);
 
 		if (len == 0) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "read bytes: %" SWITCH_SIZE_T_FMT "\n", len);
+			len = MSRP_BUFF_SIZE - (stream.p - stream.buf);
 			continue;
 		}
 
-		if (helper->debug) dump_buffer(buf, (p - buf) + len, __LINE__, 0);
-
-	again:
-		msrp_msg = msrp_parse_buffer(last_p, p - last_p + len, msrp_msg, pool);
-
-		switch_assert(msrp_msg);
-
-		if (msrp_msg->state == MSRP_ST_ERROR) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "msrp parse error!\n");
-			goto end;
-		}
-
-		if (helper->debug) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "state:%d, len:%" SWITCH_SIZE_T_FMT " payload_bytes:%" SWITCH_SIZE_T_FMT "\n", msrp_msg->state, len, msrp_msg->payload_bytes);
-		}
-
-		if (msrp_msg->state == MSRP_ST_DONE && msrp_msg->method == MSRP_METHOD_SEND) {
-			msrp_reply(csock, msrp_msg);
-
-			if (msrp_check_success_report(msrp_msg)) {
-				msrp_report(csock, msrp_msg, "200 OK");
-			}
+		if (helper->debug) dump_buffer(stream.buf, (stream.p - stream.buf) + len, __LINE__, 0);
 
-			last_p = msrp_msg->last_p;
-			switch_msrp_session_push_msg(msrp_session, msrp_msg);
-			msrp_msg = NULL;
-		} else if (msrp_msg->state == MSRP_ST_DONE) { /* throw away */
-			last_p = msrp_msg->last_p;
-			switch_msrp_msg_destroy(&msrp_msg);
-		} else {
-			last_p = msrp_msg->last_p;
+		if (msrp_stream_consume(&stream, len, csock, msrp_session, NULL) != SWITCH_STATUS_SUCCESS) {
+			break;
 		}
 
 		while (msrp_session && msrp_session->running && msrp_session->msrp_msg_count > msrp_session->msrp_msg_buffer_size) {
@@ -1359,74 +1808,24 @@ static void *SWITCH_THREAD_FUNC msrp_worker(switch_thread_t *thread, void *obj)
 			switch_yield(100000);
 		}
 
-		if (p + len > last_p) { // unparsed msg in buffer
-			p += len;
-			len = MSRP_BUFF_SIZE - (p - buf);
+		if (!msrp_session->running) break;
 
-			if (!msrp_msg) {
-				int rest_len = p - last_p;
+		len = MSRP_BUFF_SIZE - (stream.p - stream.buf);
+	}
 
-				memmove(buf, last_p, rest_len);
-				p = buf + rest_len;
-				len = MSRP_BUFF_SIZE - rest_len;
-				last_p = buf;
+end:
 
-				if (rest_len > 10) { // might have a complete msg in buffer, try parse again
-					len = 0;
-					goto again;
-				}
+	if (msrp_msg) switch_msrp_msg_destroy(&msrp_msg);
+	if (stream.msrp_msg) switch_msrp_msg_destroy(&stream.msrp_msg);
 
-				continue;
-			}
+	if (msrp_session) {
+		switch_mutex_lock(msrp_session->mutex);
+		close_socket(&csock->sock);
+		if (msrp_session->csock == csock) msrp_session->csock = NULL;
+		switch_mutex_unlock(msrp_session->mutex);
+	}
 
-			if (p >= buf + MSRP_BUFF_SIZE) {
-				switch_msrp_msg_t *new_msg;
-
-				if (msrp_msg->state != MSRP_ST_WAIT_BODY || !msrp_msg->range_star) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "buffer overflow\n");
-					/*todo, do a strstr in the whole buffer ?*/
-					break;
-				}
-
-				switch_assert(p == buf + MSRP_BUFF_SIZE);
-
-				/* buffer full*/
-				msrp_msg->payload_bytes = 0;
-				new_msg = switch_msrp_msg_dup(msrp_msg);
-				switch_msrp_msg_set_payload(new_msg, last_p, p - last_p);
-				new_msg->state = MSRP_ST_DONE;
-				switch_msrp_session_push_msg(msrp_session, new_msg);
-				new_msg = NULL;
-
-				msrp_msg->accumulated_bytes += (p - last_p);
-				p = buf;
-				len = MSRP_BUFF_SIZE;
-				last_p = buf;
-				msrp_msg->last_p = buf;
-				msrp_msg->byte_start = msrp_msg->byte_end = 0;
-				msrp_msg->payload_bytes = 0;
-
-				if (globals.debug) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "acc: %" SWITCH_SIZE_T_FMT "\n", msrp_msg->accumulated_bytes);
-				}
-			}
-		} else { /* all buffer parsed */
-			p = buf;
-			len = MSRP_BUFF_SIZE;
-			last_p = buf;
-		}
-		if (!msrp_session->running) break;
-	}
-
-end:
-
-	if (msrp_session) {
-		switch_mutex_lock(msrp_session->mutex);
-		close_socket(&csock->sock);
-		switch_mutex_unlock(msrp_session->mutex);
-	}
-
-	if (!client_mode) switch_core_destroy_memory_pool(&pool);
+	if (!client_mode) switch_core_destroy_memory_pool(&pool);
 
 	if (ssl) SSL_free(ssl);
 
@@ -1500,6 +1899,622 @@ static void *SWITCH_THREAD_FUNC msrp_listener(switch_thread_t *thread, void *obj
 	return NULL;
 }
 
+#ifdef MSRP_REACTOR
+static void msrp_conn_free(msrp_conn_t *conn)
+{
+	switch_memory_pool_t *pool = conn->pool;
+
+	if (conn->csock.ssl) {
+		SSL_free(conn->csock.ssl);
+		conn->csock.ssl = NULL;
+	}
+
+	if (conn->fd >= 0) {
+		close(conn->fd);
+		conn->fd = -1;
+	}
+
+	switch_safe_free(conn->stream.buf);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+static void msrp_reactor_wake(msrp_reactor_t *r)
+{
+	uint64_t one = 1;
+
+	if (write(r->wfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP reactor wakeup failed: %s\n", strerror(errno));
+	}
+}
+
+static void msrp_reactor_arm(msrp_conn_t *conn, uint32_t events)
+{
+	struct epoll_event ev = { 0 };
+
+	if (conn->events == events) {
+		return;
+	}
+
+	conn->events = events;
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(conn->reactor->efd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static void msrp_reactor_close(msrp_reactor_t *r, msrp_conn_t *conn)
+{
+	msrp_conn_t *cp, *last = NULL;
+	switch_msrp_session_t *msrp_session = conn->msrp_session;
+	int last_ref = 1;
+	char call_id[256] = "!";
+
+	for (cp = r->head; cp; cp = cp->next) {
+		if (cp == conn) {
+			if (last) {
+				last->next = cp->next;
+			} else {
+				r->head = cp->next;
+			}
+			break;
+		}
+		last = cp;
+	}
+
+	switch_mutex_lock(r->mutex);
+	r->count--;
+	switch_mutex_unlock(r->mutex);
+
+	epoll_ctl(r->efd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+	if (conn->stream.msrp_msg) {
+		switch_msrp_msg_destroy(&conn->stream.msrp_msg);
+	}
+
+	if (msrp_session) {
+		switch_mutex_lock(msrp_session->mutex);
+		if (msrp_session->csock == &conn->csock) {
+			msrp_session->csock = NULL;
+		}
+		conn->closed = 1;
+		last_ref = !conn->refs;
+		switch_mutex_unlock(msrp_session->mutex);
+
+		/* the session may be destroyed as soon as it stops running */
+		switch_copy_string(call_id, switch_str_nil(msrp_session->call_id), sizeof(call_id));
+		msrp_session->running = 0;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "MSRP connection down %s\n", call_id);
+
+	/* otherwise the last sender frees it */
+	if (last_ref) {
+		msrp_conn_free(conn);
+	}
+}
+
+/* hook the connection up with the session named in the To-Path of its first message */
+static switch_status_t msrp_reactor_bind(msrp_conn_t *conn)
+{
+	switch_core_session_t *session;
+	switch_msrp_session_t *msrp_session;
+
+	if (!(session = switch_core_session_locate(conn->uuid))) {
+		if (++conn->bind_tries >= MSRP_REACTOR_BIND_TRIES) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "No such session %s\n", conn->uuid);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "waiting for session %s\n", conn->uuid);
+		conn->state = MSRP_CONN_BIND;
+		conn->next_try = switch_micro_time_now() + 1000000;
+		msrp_reactor_arm(conn, 0);
+
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	msrp_session = switch_core_media_get_msrp_session(session);
+
+	if (!msrp_session) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Session %s has no MSRP\n", conn->uuid);
+		switch_core_session_rwunlock(session);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(msrp_session->mutex);
+	msrp_session->csock = &conn->csock;
+	msrp_session->running = 1;
+	switch_mutex_unlock(msrp_session->mutex);
+
+	conn->msrp_session = msrp_session;
+	conn->csock.msrp_session = msrp_session;
+	conn->state = MSRP_CONN_RUNNING;
+
+	switch_core_session_rwunlock(session);
+
+	msrp_reactor_arm(conn, EPOLLIN);
+
+	/* whatever came in behind the first message */
+	return msrp_stream_consume(&conn->stream, 0, &conn->csock, msrp_session, NULL);
+}
+
+/* stop reading while the session has a full queue, the sweep resumes it */
+static void msrp_reactor_throttle(msrp_conn_t *conn)
+{
+	switch_msrp_session_t *msrp_session = conn->msrp_session;
+
+	if (msrp_session->msrp_msg_count > msrp_session->msrp_msg_buffer_size) {
+		if (!conn->paused) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s reading too fast, relax...\n", msrp_session->call_id);
+		}
+		conn->paused = 1;
+		msrp_reactor_arm(conn, 0);
+	} else if (conn->paused) {
+		conn->paused = 0;
+		msrp_reactor_arm(conn, EPOLLIN);
+	}
+}
+
+static int msrp_reactor_tls_accept(msrp_conn_t *conn)
+{
+	int code, err;
+
+	if (!conn->csock.ssl) {
+		if (globals.ssl_ready != 1) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SSL not ready\n");
+			return -1;
+		}
+
+		conn->csock.ssl = SSL_new(globals.ssl_ctx);
+		switch_assert(conn->csock.ssl);
+		SSL_set_fd(conn->csock.ssl, conn->fd);
+	}
+
+	if ((code = SSL_accept(conn->csock.ssl)) == 1) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "SSL established = 1\n");
+		conn->state = MSRP_CONN_FIRST;
+		msrp_reactor_arm(conn, EPOLLIN);
+		return 0;
+	}
+
+	err = SSL_get_error(conn->csock.ssl, code);
+
+	if (err == SSL_ERROR_WANT_READ) {
+		msrp_reactor_arm(conn, EPOLLIN);
+	} else if (err == SSL_ERROR_WANT_WRITE) {
+		msrp_reactor_arm(conn, EPOLLIN | EPOLLOUT);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SSL ERR code=%d error=%d\n", code, err);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int msrp_reactor_read(msrp_reactor_t *r, msrp_conn_t *conn)
+{
+	int loops = 16;
+	int ret = 0;
+
+	while (loops-- > 0 && conn->state != MSRP_CONN_BIND && !conn->paused) {
+		msrp_stream_t *stream = &conn->stream;
+		switch_size_t room;
+		switch_ssize_t bytes;
+
+		if (!stream->buf) {
+			switch_malloc(stream->buf, MSRP_BUFF_SIZE + 1);
+			stream->p = stream->last_p = stream->buf;
+		}
+
+		room = MSRP_BUFF_SIZE - (stream->p - stream->buf);
+
+		if (conn->csock.secure) {
+			int err = SSL_ERROR_NONE;
+
+			switch_mutex_lock(conn->io_mutex);
+			bytes = SSL_read(conn->csock.ssl, stream->p, (int) room);
+			if (bytes <= 0) err = SSL_get_error(conn->csock.ssl, (int) bytes);
+			switch_mutex_unlock(conn->io_mutex);
+
+			if (bytes <= 0 && (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)) {
+				break;
+			}
+
+			if (bytes < 0) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "TLS read error: ret=%" SWITCH_SSIZE_T_FMT " error=%d errno=%d\n", bytes, err, errno);
+			}
+		} else {
+			bytes = recv(conn->fd, stream->p, room, 0);
+
+			if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				break;
+			}
+		}
+
+		if (bytes <= 0) {
+			ret = -1;
+			break;
+		}
+
+		if (globals.debug) dump_buffer(stream->buf, (stream->p - stream->buf) + bytes, __LINE__, 0);
+
+		if (conn->state == MSRP_CONN_FIRST) {
+			switch_msrp_msg_t *first = NULL;
+
+			if (msrp_stream_consume(stream, bytes, &conn->csock, NULL, &first) != SWITCH_STATUS_SUCCESS) {
+				ret = -1;
+				break;
+			}
+
+			if (first) {
+				switch_status_t status = msrp_first_msg(&conn->csock, first, conn->uuid);
+
+				switch_msrp_msg_destroy(&first);
+
+				if (status != SWITCH_STATUS_SUCCESS || msrp_reactor_bind(conn) != SWITCH_STATUS_SUCCESS) {
+					ret = -1;
+					break;
+				}
+			}
+		} else if (msrp_stream_consume(stream, bytes, &conn->csock, conn->msrp_session, NULL) != SWITCH_STATUS_SUCCESS) {
+			ret = -1;
+			break;
+		}
+
+		if (conn->state == MSRP_CONN_RUNNING) {
+			msrp_reactor_throttle(conn);
+		}
+
+		/* decrypted data can sit in the SSL buffer where epoll can't see it */
+		if (!conn->csock.secure && (switch_size_t) bytes < room) {
+			break;
+		}
+	}
+
+	/* idle connections carry no buffer */
+	if (conn->stream.buf && conn->stream.p == conn->stream.buf && !conn->stream.msrp_msg) {
+		switch_safe_free(conn->stream.buf);
+		conn->stream.p = conn->stream.last_p = NULL;
+	}
+
+	return ret;
+}
+
+static void msrp_reactor_add(msrp_reactor_t *r, msrp_conn_t *conn)
+{
+	struct epoll_event ev = { 0 };
+
+	conn->reactor = r;
+	conn->events = EPOLLIN;
+	ev.events = conn->events;
+	ev.data.ptr = conn;
+
+	conn->next = r->head;
+	r->head = conn;
+
+	if (epoll_ctl(r->efd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP epoll add failed: %s\n", strerror(errno));
+		msrp_reactor_close(r, conn);
+		return;
+	}
+
+	if (conn->state == MSRP_CONN_TLS && msrp_reactor_tls_accept(conn) < 0) {
+		msrp_reactor_close(r, conn);
+	}
+}
+
+static void msrp_reactor_adopt(msrp_reactor_t *r)
+{
+	msrp_conn_t *conn, *next;
+
+	switch_mutex_lock(r->mutex);
+	conn = r->pending;
+	r->pending = NULL;
+	switch_mutex_unlock(r->mutex);
+
+	for (; conn; conn = next) {
+		next = conn->next;
+		msrp_reactor_add(r, conn);
+	}
+}
+
+static void msrp_reactor_accept(msrp_reactor_t *r, int secure)
+{
+	for (;;) {
+		struct sockaddr_storage ss;
+		socklen_t sslen = sizeof(ss);
+		switch_memory_pool_t *pool = NULL;
+		msrp_conn_t *conn;
+		msrp_reactor_t *target = r;
+		int fd, on = 1;
+
+		if ((fd = accept(r->lfd[secure], (struct sockaddr *) &ss, &sslen)) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP accept failed: %s\n", strerror(errno));
+			}
+			break;
+		}
+
+		if (globals.debug > 0) {
+			char host[NI_MAXHOST] = "", serv[NI_MAXSERV] = "";
+
+			getnameinfo((struct sockaddr *) &ss, sslen, host, sizeof(host), serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Connection Open%s from %s:%s\n", secure ? " SSL" : "", host, serv);
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *) &on, sizeof(on));
+
+		if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "OH OH no pool\n");
+			close(fd);
+			break;
+		}
+
+		conn = switch_core_alloc(pool, sizeof(*conn));
+		conn->pool = pool;
+		conn->fd = fd;
+		conn->csock.secure = secure;
+		conn->csock.conn = conn;
+		conn->state = secure ? MSRP_CONN_TLS : MSRP_CONN_FIRST;
+		conn->created = switch_micro_time_now();
+		switch_mutex_init(&conn->io_mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_mutex_init(&conn->write_mutex, SWITCH_MUTEX_NESTED, pool);
+
+		/* without SO_REUSEPORT one reactor accepts for all of them */
+		if (!msrp_reactor.sharded) {
+			target = &msrp_reactor.reactors[msrp_reactor.next++ % msrp_reactor.count];
+		}
+
+		switch_mutex_lock(target->mutex);
+		target->count++;
+		if (target != r) {
+			conn->next = target->pending;
+			target->pending = conn;
+		}
+		switch_mutex_unlock(target->mutex);
+
+		if (target == r) {
+			msrp_reactor_add(r, conn);
+		} else {
+			msrp_reactor_wake(target);
+		}
+	}
+}
+
+/* timeouts of connections that never got going, retried binds and resumed reads */
+static void msrp_reactor_sweep(msrp_reactor_t *r)
+{
+	msrp_conn_t *conn, *next;
+	switch_time_t now = switch_micro_time_now();
+
+	for (conn = r->head; conn; conn = next) {
+		next = conn->next;
+
+		if (!msrp_reactor.running) {
+			msrp_reactor_close(r, conn);
+		} else if ((conn->state == MSRP_CONN_TLS || conn->state == MSRP_CONN_FIRST) && now - conn->created > MSRP_REACTOR_SETUP_TIMEOUT) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSRP connection sent no request, dropping it\n");
+			msrp_reactor_close(r, conn);
+		} else if (conn->state == MSRP_CONN_BIND && now >= conn->next_try) {
+			if (msrp_reactor_bind(conn) != SWITCH_STATUS_SUCCESS) {
+				msrp_reactor_close(r, conn);
+			}
+		} else if (conn->state == MSRP_CONN_RUNNING && conn->paused) {
+			msrp_reactor_throttle(conn);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC msrp_reactor_thread(switch_thread_t *thread, void *obj)
+{
+	msrp_reactor_t *r = (msrp_reactor_t *) obj;
+	struct epoll_event events[MSRP_REACTOR_EVENTS];
+	switch_time_t last_sweep = switch_micro_time_now();
+
+	while (msrp_reactor.running) {
+		int i, n = epoll_wait(r->efd, events, MSRP_REACTOR_EVENTS, MSRP_REACTOR_SWEEP_MS);
+		switch_time_t now;
+
+		if (n < 0 && errno != EINTR) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "epoll_wait failed: %s\n", strerror(errno));
+			switch_yield(100000);
+		}
+
+		for (i = 0; i < n; i++) {
+			msrp_conn_t *conn = (msrp_conn_t *) events[i].data.ptr;
+
+			if (!conn) {
+				uint64_t val;
+
+				while (read(r->wfd, &val, sizeof(val)) > 0);
+				msrp_reactor_adopt(r);
+			} else if (events[i].data.ptr == &r->lfd[0]) {
+				msrp_reactor_accept(r, 0);
+			} else if (events[i].data.ptr == &r->lfd[1]) {
+				msrp_reactor_accept(r, 1);
+			} else if (conn->state == MSRP_CONN_TLS) {
+				if (msrp_reactor_tls_accept(conn) < 0 || (conn->state == MSRP_CONN_FIRST && msrp_reactor_read(r, conn) < 0)) {
+					msrp_reactor_close(r, conn);
+				}
+			} else if ((events[i].events & (EPOLLHUP | EPOLLERR)) && !(events[i].events & EPOLLIN)) {
+				msrp_reactor_close(r, conn);
+			} else if (msrp_reactor_read(r, conn) < 0) {
+				msrp_reactor_close(r, conn);
+			}
+		}
+
+		now = switch_micro_time_now();
+		if (now - last_sweep >= MSRP_REACTOR_SWEEP_MS * 1000) {
+			msrp_reactor_sweep(r);
+			last_sweep = now;
+		}
+	}
+
+	msrp_reactor_adopt(r);
+	while (r->head) {
+		msrp_reactor_close(r, r->head);
+	}
+
+	return NULL;
+}
+
+/* a listener per reactor with SO_REUSEPORT, else only the first reactor listens */
+static switch_status_t msrp_reactor_listen(msrp_reactor_t *r, int secure, switch_bool_t reuseport)
+{
+	switch_msrp_socket_t *msock = secure ? &globals.msock_ssl : &globals.msock;
+	switch_os_socket_t fd = SWITCH_SOCK_INVALID;
+	struct epoll_event ev = { 0 };
+
+	if (!msock->port) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (msock_init(globals.ip, msock->port, &r->lsock[secure], reuseport, globals.pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_os_sock_get(&fd, r->lsock[secure]);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	r->lfd[secure] = fd;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &r->lfd[secure];
+
+	if (epoll_ctl(r->efd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void msrp_reactor_unlisten(msrp_reactor_t *r)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (r->lsock[i]) {
+			if (r->efd >= 0) epoll_ctl(r->efd, EPOLL_CTL_DEL, r->lfd[i], NULL);
+			close_socket(&r->lsock[i]);
+		}
+		r->lfd[i] = -1;
+	}
+}
+
+static void msrp_reactor_free(void)
+{
+	int i;
+
+	for (i = 0; i < msrp_reactor.count; i++) {
+		msrp_reactor_t *r = &msrp_reactor.reactors[i];
+
+		msrp_reactor_unlisten(r);
+		if (r->efd >= 0) close(r->efd);
+		if (r->wfd >= 0) close(r->wfd);
+		r->efd = r->wfd = -1;
+	}
+
+	msrp_reactor.count = 0;
+	msrp_reactor.reactors = NULL;
+}
+
+static switch_status_t msrp_reactor_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	struct epoll_event ev = { 0 };
+	int i, secure;
+
+	memset(&msrp_reactor, 0, sizeof(msrp_reactor));
+	msrp_reactor.count = globals.reactor_threads;
+	msrp_reactor.reactors = switch_core_alloc(globals.pool, sizeof(msrp_reactor_t) * msrp_reactor.count);
+
+	/* a NULL pointer marks the wakeup eventfd */
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+
+	for (i = 0; i < msrp_reactor.count; i++) {
+		msrp_reactor_t *r = &msrp_reactor.reactors[i];
+
+		switch_mutex_init(&r->mutex, SWITCH_MUTEX_NESTED, globals.pool);
+		r->lfd[0] = r->lfd[1] = -1;
+
+		if ((r->efd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (r->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+			epoll_ctl(r->efd, EPOLL_CTL_ADD, r->wfd, &ev) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP reactor setup failed: %s, using a thread per connection\n", strerror(errno));
+			for (; i < msrp_reactor.count; i++) {
+				msrp_reactor.reactors[i].efd = msrp_reactor.reactors[i].wfd = -1;
+			}
+			msrp_reactor_free();
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	/* every reactor gets its own listeners and the kernel spreads connections over them */
+	msrp_reactor.sharded = msrp_reactor.count > 1;
+
+	for (i = 0; msrp_reactor.sharded && i < msrp_reactor.count; i++) {
+		for (secure = 0; secure < 2; secure++) {
+			if (msrp_reactor_listen(&msrp_reactor.reactors[i], secure, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SO_REUSEPORT listeners unavailable, one reactor accepts for all\n");
+				msrp_reactor.sharded = 0;
+			}
+		}
+	}
+
+	if (!msrp_reactor.sharded) {
+		for (i = 0; i < msrp_reactor.count; i++) {
+			msrp_reactor_unlisten(&msrp_reactor.reactors[i]);
+		}
+
+		for (secure = 0; secure < 2; secure++) {
+			if (msrp_reactor_listen(&msrp_reactor.reactors[0], secure, SWITCH_FALSE) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "MSRP reactor cannot listen, using a thread per connection\n");
+				msrp_reactor_free();
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+	}
+
+	msrp_reactor.running = 1;
+
+	switch_threadattr_create(&thd_attr, globals.pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < msrp_reactor.count; i++) {
+		switch_thread_create(&msrp_reactor.reactors[i].thread, thd_attr, msrp_reactor_thread, &msrp_reactor.reactors[i], globals.pool);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "MSRP reactor started with %d epoll threads%s\n",
+					  msrp_reactor.count, msrp_reactor.sharded ? " and SO_REUSEPORT listeners" : "");
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void msrp_reactor_stop(void)
+{
+	switch_status_t st;
+	int i;
+
+	if (!msrp_reactor.running) {
+		return;
+	}
+
+	msrp_reactor.running = 0;
+
+	for (i = 0; i < msrp_reactor.count; i++) {
+		msrp_reactor_wake(&msrp_reactor.reactors[i]);
+	}
+
+	for (i = 0; i < msrp_reactor.count; i++) {
+		if (msrp_reactor.reactors[i].thread) {
+			switch_thread_join(&st, msrp_reactor.reactors[i].thread);
+		}
+	}
+
+	msrp_reactor_free();
+}
+#endif
+
 SWITCH_DECLARE(switch_status_t) switch_msrp_start_client(switch_msrp_session_t *msrp_session)
 {
 	worker_helper_t *helper;
@@ -1534,9 +2549,14 @@ void random_string(char *buf, uint16_t size)
 static switch_status_t switch_msrp_do_send(switch_msrp_session_t *ms, switch_msrp_msg_t *msrp_msg, const char *file, const char *func, int line)
 {
 	char transaction_id[MSRP_TRANS_ID_LEN + 1] = { 0 };
-	char buf[MSRP_BUFF_SIZE];
+	char head[4096];
+	char tail[MSRP_TRANS_ID_LEN + 11];
 	char message_id[SWITCH_UUID_FORMATTED_LENGTH + 1] = { 0 };
+	msrp_iov_t parts[4];
+	switch_msrp_client_socket_t *csock;
+	switch_status_t status;
 	switch_size_t len;
+	int n = 0;
 	const char *msrp_h_to_path = switch_msrp_msg_get_header(msrp_msg, MSRP_H_TO_PATH);
 	const char *msrp_h_from_path = switch_msrp_msg_get_header(msrp_msg, MSRP_H_FROM_PATH);
 	const char *to_path = msrp_h_to_path ? msrp_h_to_path : ms->remote_path;
@@ -1560,7 +2580,7 @@ static switch_status_t switch_msrp_do_send(switch_msrp_session_t *ms, switch_msr
 	random_string(transaction_id, MSRP_TRANS_ID_LEN);
 	switch_uuid_str(message_id, sizeof(message_id));
 
-	sprintf(buf, "MSRP %s SEND\r\nTo-Path: %s\r\nFrom-Path: %s\r\n"
+	len = switch_snprintf(head, sizeof(head), "MSRP %s SEND\r\nTo-Path: %s\r\nFrom-Path: %s\r\n"
 		"Message-ID: %s\r\n"
 		"Byte-Range: 1-%" SWITCH_SIZE_T_FMT "/%" SWITCH_SIZE_T_FMT "\r\n"
 		"%s%s%s",
@@ -1574,25 +2594,38 @@ static switch_status_t switch_msrp_do_send(switch_msrp_session_t *ms, switch_msr
 		msrp_msg->payload ? content_type : "",
 		msrp_msg->payload ? "\r\n\r\n" : "");
 
-	len = strlen(buf);
+	if (len >= sizeof(head) - 1) {
+		switch_log_printf(SWITCH_CHANNEL_ID_LOG, file, func, line, ms->call_id, SWITCH_LOG_ERROR, "MSRP headers too large!\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	parts[n].data = head;
+	parts[n++].len = len;
 
+	/* the payload goes out from where it is, however large */
 	if (msrp_msg->payload) {
-		if (len + msrp_msg->payload_bytes >= MSRP_BUFF_SIZE) {
-			switch_log_printf(SWITCH_CHANNEL_ID_LOG, file, func, line, ms->call_id, SWITCH_LOG_ERROR, "payload too large! %" SWITCH_SIZE_T_FMT "\n", len + msrp_msg->payload_bytes);
-			return SWITCH_STATUS_FALSE;
-		}
-		memcpy(buf + len, msrp_msg->payload, msrp_msg->payload_bytes);
-		len += msrp_msg->payload_bytes;
-		sprintf(buf + len, "\r\n");
-		len += 2;
+		parts[n].data = msrp_msg->payload;
+		parts[n++].len = msrp_msg->payload_bytes;
+		parts[n].data = "\r\n";
+		parts[n++].len = 2;
 	}
 
-	sprintf(buf + len, "-------%s$\r\n", transaction_id);
-	len += (10 + strlen(transaction_id));
+	parts[n].data = tail;
+	parts[n++].len = switch_snprintf(tail, sizeof(tail), "-------%s$\r\n", transaction_id);
 
-	if (globals.debug) dump_buffer(buf, len, __LINE__, 1);
+	if (globals.debug) {
+		char stack[MSRP_BUFF_SIZE];
+		char *buf = msrp_iov_join(parts, n, stack, sizeof(stack), &len);
 
-	return ms->csock ? msrp_socket_send(ms->csock, buf, &len) : SWITCH_STATUS_FALSE;
+		dump_buffer(buf, len, __LINE__, 1);
+		if (buf != stack) free(buf);
+	}
+
+	csock = msrp_csock_hold(ms);
+	status = csock ? msrp_socket_sendv(csock, parts, n) : SWITCH_STATUS_FALSE;
+	msrp_csock_release(ms, csock);
+
+	return status;
 }
 
 SWITCH_DECLARE (switch_status_t) switch_msrp_perform_send(switch_msrp_session_t *ms, switch_msrp_msg_t *msrp_msg, const char *file, const char *func, int line)
@@ -147,18 +147,10 @@ static switch_status_t switch_g711u_encode(switch_codec_t *codec,
 										   uint32_t decoded_rate, void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
-
-	dbuf = decoded_data;
-	ebuf = encoded_data;
+	uint32_t samples = decoded_data_len / sizeof(short);
 
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_ulaw(dbuf[i]);
-	}
-
-	*encoded_data_len = i;
+	switch_g711_ulaw_encode(encoded_data, decoded_data, samples);
+	*encoded_data_len = samples;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -170,22 +162,12 @@ static switch_status_t switch_g711u_decode(switch_codec_t *codec,
 										   uint32_t encoded_rate, void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
-
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
 	if (*flag & SWITCH_CODEC_FLAG_SILENCE) {
-		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
+		memset(decoded_data, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = ulaw_to_linear(ebuf[i]);
-		}
-
-		*decoded_data_len = i * 2;
+		switch_g711_ulaw_decode(decoded_data, encoded_data, encoded_data_len);
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -218,18 +200,10 @@ static switch_status_t switch_g711a_encode(switch_codec_t *codec,
 										   uint32_t decoded_rate, void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
+	uint32_t samples = decoded_data_len / sizeof(short);
 
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_alaw(dbuf[i]);
-	}
-
-	*encoded_data_len = i;
+	switch_g711_alaw_encode(encoded_data, decoded_data, samples);
+	*encoded_data_len = samples;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -241,22 +215,12 @@ static switch_status_t switch_g711a_decode(switch_codec_t *codec,
 										   uint32_t encoded_rate, void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate,
 										   unsigned int *flag)
 {
-	short *dbuf;
-	unsigned char *ebuf;
-	uint32_t i;
-
-	dbuf = decoded_data;
-	ebuf = encoded_data;
-
 	if (*flag & SWITCH_CODEC_FLAG_SILENCE) {
-		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
+		memset(decoded_data, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = alaw_to_linear(ebuf[i]);
-		}
-
-		*decoded_data_len = i * 2;
+		switch_g711_alaw_decode(decoded_data, encoded_data, encoded_data_len);
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -268,11 +232,52 @@ static switch_status_t switch_g711a_destroy(switch_codec_t *codec)
 }
 
 
+/* built from the decode and encode above so translating gives exactly what transcoding through linear would */
+static uint8_t ulaw_to_alaw_table[256];
+static uint8_t alaw_to_ulaw_table[256];
+
+static void switch_g711_ulaw_to_alaw(const uint8_t *in, uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = ulaw_to_alaw_table[in[i]];
+	}
+}
+
+static void switch_g711_alaw_to_ulaw(const uint8_t *in, uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i] = alaw_to_ulaw_table[in[i]];
+	}
+}
+
+static void mod_g711_add_translators(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		ulaw_to_alaw_table[i] = linear_to_alaw(ulaw_to_linear((uint8_t) i));
+		alaw_to_ulaw_table[i] = linear_to_ulaw(alaw_to_linear((uint8_t) i));
+	}
+
+	switch_core_codec_add_translator("PCMU", "PCMA", 8000, switch_g711_ulaw_to_alaw);
+	switch_core_codec_add_translator("PCMA", "PCMU", 8000, switch_g711_alaw_to_ulaw);
+
+	/* same codec at another ptime only needs repacketizing */
+	switch_core_codec_add_translator("PCMU", "PCMU", 8000, NULL);
+	switch_core_codec_add_translator("PCMA", "PCMA", 8000, NULL);
+}
+
 static void mod_g711_load(switch_loadable_module_interface_t ** module_interface, switch_memory_pool_t *pool)
 {
 	switch_codec_interface_t *codec_interface;
 	int mpf = 10000, spf = 80, bpf = 160, ebpf = 80, count;
 
+	mod_g711_add_translators();
+
 	SWITCH_ADD_CODEC(codec_interface, "G.711 ulaw");
 	for (count = 12; count > 0; count--) {
 		switch_core_codec_add_implementation(pool, codec_interface, SWITCH_CODEC_TYPE_AUDIO,	/* enumeration defining the type of the codec */
@@ -36,6 +36,7 @@
 #include <switch_private.h>
 #endif
 #include <speex/speex_resampler.h>
+#include "private/switch_core_pvt.h"
 
 #define NORMFACT (float)0x8000
 #define MAXSAMPLE (float)0x7FFF
@@ -52,6 +53,387 @@
 
 #define resample_buffer(a, b, c) a > b ? ((a / 1000) / 2) * c : ((b / 1000) / 2) * c
 
+/* Integer ratios, which is nearly every conversion we do (8k, 16k and 48k between each other), skip speex
+   for a polyphase FIR.  The filters are built once per ratio and size and shared by every resampler using them. */
+#define RESAMPLE_MAX_RATIO 12
+#define RESAMPLE_TAP_SIZES 3
+/* input samples per channel filtered in one go, longer frames are done in pieces */
+#define RESAMPLE_BLOCK 1024
+/* passband edge as a fraction of the lower rate's nyquist, and the kaiser window beta */
+#define RESAMPLE_CUTOFF 0.94
+#define RESAMPLE_BETA 6.0
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLE_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+typedef struct {
+	/* interpolate by up or decimate by down, the other one is 1 */
+	uint32_t up;
+	uint32_t down;
+	/* taps of each of the up phases, phase p's start at coefs + p * taps and go oldest input first */
+	uint32_t taps;
+	float *coefs;
+} resample_filter_t;
+
+typedef struct {
+	const resample_filter_t *filter;
+	uint32_t channels;
+	/* per channel, hist_size floats each, the last taps - 1 samples and then the new ones */
+	float *hist;
+	uint32_t hist_size;
+	uint32_t hlen;
+	/* the newest input sample of the next output */
+	uint32_t next;
+	/* one channel of filtered output before it is rounded into resampler->to */
+	float *out;
+} resample_polyphase_t;
+
+typedef void (*resample_filter_func_t)(const resample_filter_t *filter, const float *hist, uint32_t next, uint32_t steps, float *out);
+
+static struct {
+	switch_mutex_t *mutex;
+	resample_filter_t *filters[2][RESAMPLE_MAX_RATIO + 1][RESAMPLE_TAP_SIZES];
+	resample_filter_func_t run;
+	const char *name;
+} resample_globals;
+
+static double resample_bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+
+	for (k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static resample_filter_t *resample_filter_build(uint32_t up, uint32_t down, uint32_t taps)
+{
+	resample_filter_t *filter;
+	uint32_t ratio = up > down ? up : down, len = taps * ratio, p, j;
+	double *proto, center = (len - 1) / 2.0, fc = 0.5 * RESAMPLE_CUTOFF / ratio;
+
+	switch_zmalloc(filter, sizeof(*filter));
+	filter->up = up;
+	filter->down = down;
+	filter->taps = up > 1 ? taps : len;
+	filter->coefs = malloc(len * sizeof(float));
+	proto = malloc(len * sizeof(double));
+	switch_assert(filter->coefs && proto);
+
+	/* kaiser windowed sinc at the higher rate */
+	for (j = 0; j < len; j++) {
+		double t = j - center, r = 2.0 * t / (len - 1), sinc = t == 0.0 ? 1.0 : sin(2.0 * M_PI * fc * t) / (2.0 * M_PI * fc * t);
+
+		proto[j] = 2.0 * fc * sinc * resample_bessel_i0(RESAMPLE_BETA * sqrt(1.0 - r * r)) / resample_bessel_i0(RESAMPLE_BETA);
+	}
+
+	/* phase p of an interpolator is every up'th tap from p, each phase is scaled to unity gain on its own
+	   so a flat input stays flat, a decimator is the one phase of them all */
+	for (p = 0; p < up; p++) {
+		float *coefs = filter->coefs + p * filter->taps;
+		double sum = 0;
+
+		for (j = 0; j < filter->taps; j++) {
+			sum += proto[p + (filter->taps - 1 - j) * up];
+		}
+
+		for (j = 0; j < filter->taps; j++) {
+			coefs[j] = (float) (proto[p + (filter->taps - 1 - j) * up] / sum);
+		}
+	}
+
+	free(proto);
+
+	return filter;
+}
+
+static void resample_filter_scalar(const resample_filter_t *filter, const float *hist, uint32_t next, uint32_t steps, float *out)
+{
+	uint32_t s, p, j;
+
+	for (s = 0; s < steps; s++) {
+		const float *x = hist + next + s * filter->down + 1 - filter->taps;
+
+		for (p = 0; p < filter->up; p++) {
+			const float *c = filter->coefs + p * filter->taps;
+			float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+			for (j = 0; j + 4 <= filter->taps; j += 4) {
+				s0 += c[j] * x[j];
+				s1 += c[j + 1] * x[j + 1];
+				s2 += c[j + 2] * x[j + 2];
+				s3 += c[j + 3] * x[j + 3];
+			}
+			for (; j < filter->taps; j++) {
+				s0 += c[j] * x[j];
+			}
+
+			*out++ = (s0 + s1) + (s2 + s3);
+		}
+	}
+}
+
+#ifdef RESAMPLE_X86
+
+__attribute__((target("sse")))
+static void resample_filter_sse(const resample_filter_t *filter, const float *hist, uint32_t next, uint32_t steps, float *out)
+{
+	uint32_t s, p, j;
+
+	for (s = 0; s < steps; s++) {
+		const float *x = hist + next + s * filter->down + 1 - filter->taps;
+
+		for (p = 0; p < filter->up; p++) {
+			const float *c = filter->coefs + p * filter->taps;
+			__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+			float lanes[4], sum;
+
+			/* every filter is a multiple of 16 taps */
+			for (j = 0; j < filter->taps; j += 8) {
+				s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(c + j), _mm_loadu_ps(x + j)));
+				s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(c + j + 4), _mm_loadu_ps(x + j + 4)));
+			}
+
+			_mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+			sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			*out++ = sum;
+		}
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void resample_filter_avx2(const resample_filter_t *filter, const float *hist, uint32_t next, uint32_t steps, float *out)
+{
+	uint32_t s, p, j;
+
+	for (s = 0; s < steps; s++) {
+		const float *x = hist + next + s * filter->down + 1 - filter->taps;
+
+		for (p = 0; p < filter->up; p++) {
+			const float *c = filter->coefs + p * filter->taps;
+			__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+			__m128 h;
+
+			for (j = 0; j < filter->taps; j += 16) {
+				s0 = _mm256_fmadd_ps(_mm256_loadu_ps(c + j), _mm256_loadu_ps(x + j), s0);
+				s1 = _mm256_fmadd_ps(_mm256_loadu_ps(c + j + 8), _mm256_loadu_ps(x + j + 8), s1);
+			}
+
+			s0 = _mm256_add_ps(s0, s1);
+			h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+			h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+			h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+			*out++ = _mm_cvtss_f32(h);
+		}
+	}
+}
+
+#endif
+
+#ifdef RESAMPLE_NEON
+
+static void resample_filter_neon(const resample_filter_t *filter, const float *hist, uint32_t next, uint32_t steps, float *out)
+{
+	uint32_t s, p, j;
+
+	for (s = 0; s < steps; s++) {
+		const float *x = hist + next + s * filter->down + 1 - filter->taps;
+
+		for (p = 0; p < filter->up; p++) {
+			const float *c = filter->coefs + p * filter->taps;
+			float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+			float32x2_t h;
+
+			for (j = 0; j < filter->taps; j += 8) {
+				s0 = vmlaq_f32(s0, vld1q_f32(c + j), vld1q_f32(x + j));
+				s1 = vmlaq_f32(s1, vld1q_f32(c + j + 4), vld1q_f32(x + j + 4));
+			}
+
+			s0 = vaddq_f32(s0, s1);
+			h = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+			*out++ = vget_lane_f32(vpadd_f32(h, h), 0);
+		}
+	}
+}
+
+#endif
+
+/* pick the widest filter loop this cpu runs */
+static void resample_resolve(void)
+{
+	resample_globals.run = resample_filter_scalar;
+	resample_globals.name = "scalar";
+
+#if defined(RESAMPLE_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		resample_globals.run = resample_filter_avx2;
+		resample_globals.name = "avx2";
+	} else if (__builtin_cpu_supports("sse")) {
+		resample_globals.run = resample_filter_sse;
+		resample_globals.name = "sse";
+	}
+#elif defined(RESAMPLE_NEON)
+	resample_globals.run = resample_filter_neon;
+	resample_globals.name = "neon";
+#endif
+}
+
+void switch_core_resample_init(switch_memory_pool_t *pool)
+{
+	resample_resolve();
+	switch_mutex_init(&resample_globals.mutex, SWITCH_MUTEX_NESTED, pool);
+}
+
+void switch_core_resample_destroy(void)
+{
+	int i, j, k;
+
+	if (!resample_globals.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(resample_globals.mutex);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j <= RESAMPLE_MAX_RATIO; j++) {
+			for (k = 0; k < RESAMPLE_TAP_SIZES; k++) {
+				if (resample_globals.filters[i][j][k]) {
+					free(resample_globals.filters[i][j][k]->coefs);
+					free(resample_globals.filters[i][j][k]);
+					resample_globals.filters[i][j][k] = NULL;
+				}
+			}
+		}
+	}
+	switch_mutex_unlock(resample_globals.mutex);
+}
+
+/* the shared filter for from_rate -> to_rate, NULL when the ratio is not a whole number we handle */
+static const resample_filter_t *resample_filter_get(uint32_t from_rate, uint32_t to_rate, int quality)
+{
+	uint32_t up = 1, down = 1, ratio, size = quality < 2 ? 0 : quality < 6 ? 1 : 2;
+	resample_filter_t *filter;
+
+	if (!resample_globals.mutex || (quality & SWITCH_RESAMPLE_GENERIC) || !from_rate || !to_rate || from_rate == to_rate) {
+		return NULL;
+	}
+
+	if (to_rate > from_rate && !(to_rate % from_rate)) {
+		up = to_rate / from_rate;
+	} else if (from_rate > to_rate && !(from_rate % to_rate)) {
+		down = from_rate / to_rate;
+	} else {
+		return NULL;
+	}
+
+	if ((ratio = up * down) > RESAMPLE_MAX_RATIO) {
+		return NULL;
+	}
+
+	switch_mutex_lock(resample_globals.mutex);
+	if (!(filter = resample_globals.filters[up > 1][ratio][size])) {
+		filter = resample_globals.filters[up > 1][ratio][size] = resample_filter_build(up, down, 16 << size);
+	}
+	switch_mutex_unlock(resample_globals.mutex);
+
+	return filter;
+}
+
+static resample_polyphase_t *resample_polyphase_create(const resample_filter_t *filter, uint32_t channels)
+{
+	resample_polyphase_t *rp;
+
+	switch_zmalloc(rp, sizeof(*rp));
+	rp->filter = filter;
+	rp->channels = channels;
+	rp->hist_size = filter->taps - 1 + RESAMPLE_BLOCK;
+	rp->hist = calloc(rp->hist_size * channels, sizeof(float));
+	rp->out = malloc(RESAMPLE_BLOCK * filter->up * sizeof(float));
+	switch_assert(rp->hist && rp->out);
+
+	/* start on taps - 1 samples of silence */
+	rp->hlen = rp->next = filter->taps - 1;
+
+	return rp;
+}
+
+static void resample_polyphase_destroy(resample_polyphase_t *rp)
+{
+	free(rp->hist);
+	free(rp->out);
+	free(rp);
+}
+
+/* the most samples per channel srclen can turn into */
+static uint32_t resample_polyphase_out_max(const resample_filter_t *filter, uint32_t srclen)
+{
+	return filter->up * (srclen / filter->down + srclen / RESAMPLE_BLOCK + 2);
+}
+
+static uint32_t resample_polyphase_process(resample_polyphase_t *rp, const int16_t *src, uint32_t srclen, int16_t *to)
+{
+	const resample_filter_t *filter = rp->filter;
+	uint32_t done = 0, produced = 0;
+
+	while (done < srclen) {
+		uint32_t n = srclen - done, steps = 0, outs, next, shift, ch, i;
+
+		if (n > RESAMPLE_BLOCK) {
+			n = RESAMPLE_BLOCK;
+		}
+
+		if (rp->next < rp->hlen + n) {
+			steps = (rp->hlen + n - rp->next + filter->down - 1) / filter->down;
+		}
+		outs = steps * filter->up;
+
+		for (ch = 0; ch < rp->channels; ch++) {
+			float *hist = rp->hist + ch * rp->hist_size;
+			const int16_t *in = src + done * rp->channels + ch;
+			int16_t *o = to + produced * rp->channels + ch;
+
+			for (i = 0; i < n; i++) {
+				hist[rp->hlen + i] = in[i * rp->channels];
+			}
+
+			resample_globals.run(filter, hist, rp->next, steps, rp->out);
+
+			for (i = 0; i < outs; i++) {
+				float v = rp->out[i];
+
+				o[i * rp->channels] = v >= 32767.0f ? 32767 : v <= -32768.0f ? -32768 : (int16_t) lrintf(v);
+			}
+		}
+
+		/* keep the taps - 1 samples behind the next output and whatever is past it */
+		next = rp->next + steps * filter->down;
+		shift = next - (filter->taps - 1);
+		rp->hlen += n;
+
+		for (ch = 0; ch < rp->channels; ch++) {
+			float *hist = rp->hist + ch * rp->hist_size;
+
+			memmove(hist, hist + shift, (rp->hlen - shift) * sizeof(float));
+		}
+
+		rp->hlen -= shift;
+		rp->next = next - shift;
+		produced += outs;
+		done += n;
+	}
+
+	return produced;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate,
 															   uint32_t to_size,
@@ -59,31 +441,41 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 {
 	int err = 0;
 	switch_audio_resampler_t *resampler;
-	double lto_rate, lfrom_rate;
+	const resample_filter_t *filter;
+	uint32_t max_size;
 
 	switch_zmalloc(resampler, sizeof(*resampler));
 
 	if (!channels) channels = 1;
 
-	resampler->resampler = speex_resampler_init(channels, from_rate, to_rate, quality, &err);
+	if ((filter = resample_filter_get(from_rate, to_rate, quality))) {
+		resampler->polyphase = resample_polyphase_create(filter, channels);
+	} else {
+		resampler->resampler = speex_resampler_init(channels, from_rate, to_rate, quality & ~SWITCH_RESAMPLE_GENERIC, &err);
 
-	if (!resampler->resampler) {
-		free(resampler);
-		return SWITCH_STATUS_GENERR;
+		if (!resampler->resampler) {
+			free(resampler);
+			return SWITCH_STATUS_GENERR;
+		}
 	}
 
 	*new_resampler = resampler;
-	lto_rate = (double) resampler->to_rate;
-	lfrom_rate = (double) resampler->from_rate;
 	resampler->from_rate = from_rate;
 	resampler->to_rate = to_rate;
-	resampler->factor = (lto_rate / lfrom_rate);
-	resampler->rfactor = (lfrom_rate / lto_rate);
+	resampler->factor = ((double) to_rate / (double) from_rate);
+	resampler->rfactor = ((double) from_rate / (double) to_rate);
 	resampler->channels = channels;
 
 	//resampler->to_size = resample_buffer(to_rate, from_rate, (uint32_t) to_size);
 
+	/* room for the largest frame up front so switch_resample_process() never has to grow it */
 	resampler->to_size = switch_resample_calc_buffer_size(resampler->to_rate, resampler->from_rate, to_size) / 2;
+	max_size = SWITCH_RECOMMENDED_BUFFER_SIZE / 2 / channels;
+	max_size = filter ? resample_polyphase_out_max(filter, max_size) : switch_resample_calc_buffer_size(to_rate, from_rate, max_size) / 2;
+	if (resampler->to_size < max_size) {
+		resampler->to_size = max_size;
+	}
+
 	resampler->to = malloc(resampler->to_size * sizeof(int16_t) * resampler->channels);
 	switch_assert(resampler->to);
 
@@ -92,7 +484,14 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 
 SWITCH_DECLARE(uint32_t) switch_resample_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen)
 {
-	int to_size = switch_resample_calc_buffer_size(resampler->to_rate, resampler->from_rate, srclen) / 2;
+	resample_polyphase_t *rp = (resample_polyphase_t *) resampler->polyphase;
+	uint32_t to_size;
+
+	if (rp) {
+		to_size = resample_polyphase_out_max(rp->filter, srclen);
+	} else {
+		to_size = switch_resample_calc_buffer_size(resampler->to_rate, resampler->from_rate, srclen) / 2;
+	}
 
 	if (to_size > resampler->to_size) {
 		resampler->to_size = to_size;
@@ -100,6 +499,11 @@ SWITCH_DECLARE(uint32_t) switch_resample_process(switch_audio_resampler_t *resam
 		switch_assert(resampler->to);
 	}
 
+	if (rp) {
+		resampler->to_len = resample_polyphase_process(rp, src, srclen, resampler->to);
+		return resampler->to_len;
+	}
+
 	resampler->to_len = resampler->to_size;
 	speex_resampler_process_interleaved_int(resampler->resampler, src, &srclen, resampler->to, &resampler->to_len);
 	return resampler->to_len;
@@ -112,12 +516,24 @@ SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resample
 		if ((*resampler)->resampler) {
 			speex_resampler_destroy((*resampler)->resampler);
 		}
+		if ((*resampler)->polyphase) {
+			resample_polyphase_destroy((resample_polyphase_t *) (*resampler)->polyphase);
+		}
 		free((*resampler)->to);
 		free(*resampler);
 		*resampler = NULL;
 	}
 }
 
+SWITCH_DECLARE(const char *) switch_resample_kernel_name(switch_audio_resampler_t *resampler)
+{
+	if (!resampler->polyphase) {
+		return "speex";
+	}
+
+	return resample_globals.name;
+}
+
 SWITCH_DECLARE(switch_size_t) switch_float_to_short(float *f, short *s, switch_size_t len)
 {
 	switch_size_t i;
@@ -49,6 +49,7 @@
 #include <srtp_priv.h>
 #include <switch_ssl.h>
 #include <switch_jitterbuffer.h>
+#include "private/switch_core_pvt.h"
 
 //#define DEBUG_TS_ROLLOVER
 #ifdef DEBUG_TS_ROLLOVER
@@ -299,8 +300,64 @@ typedef struct switch_dtls_s {
 	/* How FreeSWITCH, as the DTLS server, verifies the client certificate (from the rtp_dtls_client_cert_verify_mode
 	 * channel variable). Server-only; the client role ignores it. */
 	dtls_client_cert_verify_t client_cert_verify;
+	/* Handshake offload (guarded by dtls_globals.hs_mutex): datagrams waiting for a crypto thread,
+	 * the queue link and the outcome the media thread applies to state. */
+	struct dtls_hs_packet_s *hs_in;
+	struct dtls_hs_packet_s *hs_in_tail;
+	int hs_in_count;
+	struct switch_dtls_s *hs_next;
+	uint8_t hs_queued;
+	uint8_t hs_running;
+	uint8_t hs_dead;
+	dtls_state_t hs_result;
+	switch_time_t hs_last_kick;
+	switch_time_t hs_start;
 } switch_dtls_t;
 
+/* Bounds for the handshake offload: total queued handshakes, datagrams held per handshake
+ * and how often an idle handshake is stepped so OpenSSL can retransmit a lost flight. */
+#define DTLS_HS_QUEUE_MAX 1024
+#define DTLS_HS_INBOX_MAX 32
+#define DTLS_HS_KICK_INTERVAL 20000
+#define DTLS_SESSION_CACHE_MAX 512
+
+typedef struct dtls_hs_packet_s {
+	struct dtls_hs_packet_s *next;
+	switch_size_t bytes;
+	unsigned char data[1];
+} dtls_hs_packet_t;
+
+typedef struct dtls_ctx_slot_s {
+	SSL_CTX *ctx;
+	uint64_t stamp;
+	char rsa[1024];
+} dtls_ctx_slot_t;
+
+/* DTLS state shared by every call: one SSL_CTX per role and version (so the certificate is loaded
+ * once and the server session cache and ticket keys span calls), the client sessions kept for
+ * resumption, the handshake stats and the crypto threads with their queue. */
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	dtls_ctx_slot_t ctx[2][2];
+	switch_hash_t *sessions;
+	uint32_t session_count;
+	switch_rtp_dtls_stats_t stats;
+	switch_mutex_t *hs_mutex;
+	switch_thread_cond_t *hs_cond;
+	struct switch_dtls_s *hs_head;
+	struct switch_dtls_s *hs_tail;
+	uint32_t hs_queued;
+	uint64_t hs_offloaded;
+	uint64_t hs_inline;
+	switch_thread_t **hs_threads;
+	uint32_t hs_thread_count;
+	uint8_t hs_started;
+	uint8_t hs_running;
+} dtls_globals;
+
+static const uint32_t dtls_hs_bucket_ms[SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 0 };
+
 typedef int (*dtls_state_handler_t)(switch_rtp_t *, switch_dtls_t *);
 
 
@@ -308,6 +365,8 @@ static int dtls_state_handshake(switch_rtp_t *rtp_session, switch_dtls_t *dtls);
 static int dtls_state_ready(switch_rtp_t *rtp_session, switch_dtls_t *dtls);
 static int dtls_state_setup(switch_rtp_t *rtp_session, switch_dtls_t *dtls);
 static int dtls_state_fail(switch_rtp_t *rtp_session, switch_dtls_t *dtls);
+static void dtls_session_store(switch_dtls_t *dtls);
+static void dtls_session_flush(void);
 
 dtls_state_handler_t dtls_states[DS_INVALID] = {NULL, dtls_state_handshake, dtls_state_setup, dtls_state_ready, dtls_state_fail};
 
@@ -1910,6 +1969,25 @@ static inline uint32_t calc_local_lsr_now(void)
 	return lsr_now;
 }
 
+/* sub-microsecond clock used to account for the cost of srtp_protect/srtp_unprotect */
+static inline uint64_t srtp_clock_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	return (uint64_t) switch_time_ref() * 1000;
+#endif
+}
+
+static inline void srtp_cost_add(switch_rtp_numbers_t *numbers, uint64_t start)
+{
+	numbers->srtp_packet_count++;
+	numbers->srtp_ns += (switch_size_t) (srtp_clock_ns() - start);
+}
+
 //#define DEBUG_RTCP
 /* extra param is for duplicates (received NACKed packets) */ 
 static void rtcp_generate_report_block(switch_rtp_t *rtp_session, struct switch_rtcp_report_block *rtcp_report_block, 
@@ -3332,7 +3410,18 @@ static int dtls_state_setup(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 	} else {
 		unsigned char *local_key, *remote_key, *local_salt, *remote_salt;
 
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_INFO, "%s Fingerprint Verified.\n", rtp_type(rtp_session));
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_INFO, "%s Fingerprint Verified%s.\n", rtp_type(rtp_session),
+						  SSL_session_reused(dtls->ssl) ? " (resumed session)" : "");
+
+		if (SSL_session_reused(dtls->ssl) && dtls_globals.mutex) {
+			switch_mutex_lock(dtls_globals.mutex);
+			dtls_globals.stats.resumed++;
+			switch_mutex_unlock(dtls_globals.mutex);
+		}
+
+		if ((dtls->type & DTLS_TYPE_CLIENT)) {
+			dtls_session_store(dtls);
+		}
 
 #ifdef HAVE_OPENSSL_DTLS_SRTP
 		if (!SSL_export_keying_material(dtls->ssl, raw_key_data, sizeof(raw_key_data), "EXTRACTOR-dtls_srtp", 19, NULL, 0, 0)) {
@@ -3407,7 +3496,40 @@ static int dtls_state_fail(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 }
 
 
-static int dtls_state_handshake(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
+static void dtls_hs_record(switch_rtp_t *rtp_session, switch_dtls_t *dtls, dtls_state_t result)
+{
+	switch_time_t ms = dtls->hs_start ? (switch_micro_time_now() - dtls->hs_start) / 1000 : 0;
+	int i;
+
+	if (!dtls_globals.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dtls_globals.mutex);
+
+	if (result == DS_FAIL) {
+		dtls_globals.stats.failures++;
+	} else {
+		dtls_globals.stats.handshakes++;
+		dtls_globals.stats.latency_total_ms += ms;
+
+		for (i = 0; i < SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS; i++) {
+			if (!dtls_hs_bucket_ms[i] || ms < dtls_hs_bucket_ms[i]) {
+				dtls_globals.stats.bucket[i]++;
+				break;
+			}
+		}
+	}
+
+	switch_mutex_unlock(dtls_globals.mutex);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "%s DTLS handshake %s after %" SWITCH_TIME_T_FMT "ms\n",
+					  rtp_type(rtp_session), result == DS_FAIL ? "failed" : "done", ms);
+}
+
+/* One handshake step; returns DS_SETUP once the handshake finished, DS_FAIL on error and DS_OFF while
+ * it is still in progress. It never touches dtls->state so it can run on a crypto thread. */
+static dtls_state_t dtls_handshake_step(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 {
 	int ret;
 
@@ -3419,16 +3541,313 @@ static int dtls_state_handshake(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 			break;
 		default:
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_WARNING, "%s Handshake failure %d. This may happen when you use legacy DTLS v1.0 (legacyDTLS channel var is set) but endpoint requires DTLS v1.2.\n", rtp_type(rtp_session), ret);
-			dtls_set_state(dtls, DS_FAIL);
-			return -1;
+			return DS_FAIL;
 		}
 	}
 
 	if (SSL_is_init_finished(dtls->ssl)) {
-		dtls_set_state(dtls, DS_SETUP);
+		return DS_SETUP;
 	}
 
-	return 0;
+	return DS_OFF;
+}
+
+static int dtls_state_handshake(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
+{
+	dtls_state_t result = dtls_handshake_step(rtp_session, dtls);
+
+	if (dtls_globals.hs_mutex) {
+		switch_mutex_lock(dtls_globals.hs_mutex);
+		dtls_globals.hs_inline++;
+		switch_mutex_unlock(dtls_globals.hs_mutex);
+	}
+
+	if (result != DS_OFF) {
+		dtls_hs_record(rtp_session, dtls, result);
+		dtls_set_state(dtls, result);
+	}
+
+	return result == DS_FAIL ? -1 : 0;
+}
+
+static void dtls_feed(switch_rtp_t *rtp_session, switch_dtls_t *dtls, void *data, switch_size_t bytes)
+{
+	int ret = BIO_write(dtls->read_bio, data, (int)bytes);
+
+	if (ret <= 0) {
+		ret = SSL_get_error(dtls->ssl, ret);
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet decode err: SSL err %d\n", rtp_type(rtp_session), ret);
+	} else if (ret != (int)bytes) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet decode err: read %d bytes instead of %d\n", rtp_type(rtp_session), ret, (int)bytes);
+	}
+}
+
+static void dtls_flush(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
+{
+	unsigned char buf[MAX_DTLS_MTU] = "";
+	switch_size_t bytes;
+	int ret, len, pending;
+
+	while ((pending = BIO_ctrl_pending(dtls->filter_bio)) > 0) {
+		switch_assert(pending <= sizeof(buf));
+
+		len = BIO_read(dtls->write_bio, buf, pending);
+		if (len > 0) {
+			bytes = len;
+			ret = switch_socket_sendto(dtls->sock_output, dtls->remote_addr, 0, (void *)buf, &bytes);
+
+			if (ret != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet not written to socket: %d\n", rtp_type(rtp_session), ret);
+			} else if (bytes != len) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet write err: written %d bytes instead of %d\n", rtp_type(rtp_session), (int)bytes, len);
+			}
+		} else {
+			ret = SSL_get_error(dtls->ssl, len);
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet encode err: SSL err %d\n", rtp_type(rtp_session), ret);
+		}
+	}
+}
+
+static void dtls_hs_free_inbox(switch_dtls_t *dtls)
+{
+	dtls_hs_packet_t *pkt;
+
+	while ((pkt = dtls->hs_in)) {
+		dtls->hs_in = pkt->next;
+		free(pkt);
+	}
+
+	dtls->hs_in_tail = NULL;
+	dtls->hs_in_count = 0;
+}
+
+static void *SWITCH_THREAD_FUNC dtls_hs_thread(switch_thread_t *thread, void *obj)
+{
+	switch_mutex_lock(dtls_globals.hs_mutex);
+
+	while (dtls_globals.hs_running) {
+		switch_dtls_t *dtls;
+
+		if (!(dtls = dtls_globals.hs_head)) {
+			switch_thread_cond_wait(dtls_globals.hs_cond, dtls_globals.hs_mutex);
+			continue;
+		}
+
+		if (!(dtls_globals.hs_head = dtls->hs_next)) {
+			dtls_globals.hs_tail = NULL;
+		}
+
+		dtls->hs_next = NULL;
+		dtls->hs_queued = 0;
+		dtls_globals.hs_queued--;
+
+		if (dtls->hs_dead || dtls->hs_result != DS_OFF) {
+			continue;
+		}
+
+		dtls->hs_running = 1;
+
+		do {
+			dtls_hs_packet_t *in = dtls->hs_in, *pkt;
+			dtls_state_t result;
+
+			dtls->hs_in = dtls->hs_in_tail = NULL;
+			dtls->hs_in_count = 0;
+
+			switch_mutex_unlock(dtls_globals.hs_mutex);
+
+			while ((pkt = in)) {
+				in = pkt->next;
+				dtls_feed(dtls->rtp_session, dtls, pkt->data, pkt->bytes);
+				free(pkt);
+			}
+
+			result = dtls_handshake_step(dtls->rtp_session, dtls);
+			dtls_flush(dtls->rtp_session, dtls);
+
+			switch_mutex_lock(dtls_globals.hs_mutex);
+			dtls_globals.hs_offloaded++;
+			dtls->hs_result = result;
+		} while (dtls->hs_result == DS_OFF && dtls->hs_in);
+
+		dtls->hs_running = 0;
+	}
+
+	switch_mutex_unlock(dtls_globals.hs_mutex);
+
+	return NULL;
+}
+
+static void dtls_hs_start(void)
+{
+	uint32_t i, count = runtime.dtls_handshake_threads;
+
+	if (!dtls_globals.hs_mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dtls_globals.hs_mutex);
+
+	if (dtls_globals.hs_started) {
+		goto end;
+	}
+
+	dtls_globals.hs_started = 1;
+
+	if (!count) {
+		goto end;
+	}
+
+	dtls_globals.hs_running = 1;
+	dtls_globals.hs_threads = switch_core_alloc(dtls_globals.pool, sizeof(switch_thread_t *) * count);
+
+	for (i = 0; i < count; i++) {
+		switch_threadattr_t *thd_attr = NULL;
+
+		switch_threadattr_create(&thd_attr, dtls_globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_IMPORTANT);
+
+		if (switch_thread_create(&dtls_globals.hs_threads[dtls_globals.hs_thread_count], thd_attr, dtls_hs_thread, NULL, dtls_globals.pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+
+		dtls_globals.hs_thread_count++;
+	}
+
+	if (!dtls_globals.hs_thread_count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to start DTLS handshake threads, handshakes run on the media threads\n");
+		dtls_globals.hs_running = 0;
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %u DTLS handshake thread%s\n", dtls_globals.hs_thread_count, dtls_globals.hs_thread_count == 1 ? "" : "s");
+	}
+
+ end:
+
+	switch_mutex_unlock(dtls_globals.hs_mutex);
+}
+
+/* Hand the handshake work of this read to the crypto threads. Returns SWITCH_STATUS_SUCCESS when the
+ * datagram was queued (or there is nothing to do yet) and SWITCH_STATUS_FALSE when the caller has to
+ * carry on inline: no threads, the queue is full, or a thread just finished the handshake. */
+static switch_status_t dtls_hs_offload(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_time_t now;
+	dtls_state_t result;
+
+	if (!dtls_globals.hs_running) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(dtls_globals.hs_mutex);
+
+	if ((result = dtls->hs_result) != DS_OFF) {
+		/* Only the media thread moves dtls->state; a datagram that raced the last step is a retransmit. */
+		dtls_hs_free_inbox(dtls);
+		switch_mutex_unlock(dtls_globals.hs_mutex);
+
+		dtls_hs_record(rtp_session, dtls, result);
+		dtls_set_state(dtls, result);
+
+		return SWITCH_STATUS_FALSE;
+	}
+
+	now = switch_micro_time_now();
+
+	if (!dtls->hs_queued && !dtls->hs_running) {
+		if (dtls_globals.hs_queued >= DTLS_HS_QUEUE_MAX) {
+			switch_goto_status(SWITCH_STATUS_FALSE, end);
+		}
+
+		if (!dtls->bytes && now - dtls->hs_last_kick < DTLS_HS_KICK_INTERVAL) {
+			goto end;
+		}
+	}
+
+	if (dtls->bytes > 0 && dtls->data && dtls->hs_in_count < DTLS_HS_INBOX_MAX) {
+		dtls_hs_packet_t *pkt;
+
+		switch_zmalloc(pkt, sizeof(*pkt) + dtls->bytes);
+		memcpy(pkt->data, dtls->data, dtls->bytes);
+		pkt->bytes = dtls->bytes;
+
+		if (dtls->hs_in_tail) {
+			dtls->hs_in_tail->next = pkt;
+		} else {
+			dtls->hs_in = pkt;
+		}
+
+		dtls->hs_in_tail = pkt;
+		dtls->hs_in_count++;
+	}
+
+	if (!dtls->hs_queued && !dtls->hs_running) {
+		dtls->hs_last_kick = now;
+		dtls->hs_queued = 1;
+
+		if (dtls_globals.hs_tail) {
+			dtls_globals.hs_tail->hs_next = dtls;
+		} else {
+			dtls_globals.hs_head = dtls;
+		}
+
+		dtls_globals.hs_tail = dtls;
+		dtls_globals.hs_queued++;
+		switch_thread_cond_signal(dtls_globals.hs_cond);
+	}
+
+ end:
+
+	switch_mutex_unlock(dtls_globals.hs_mutex);
+
+	return status;
+}
+
+/* Take the handshake off the crypto threads before the SSL object goes away. */
+static void dtls_hs_cancel(switch_dtls_t *dtls)
+{
+	if (!dtls_globals.hs_mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dtls_globals.hs_mutex);
+
+	dtls->hs_dead = 1;
+
+	if (dtls->hs_queued) {
+		switch_dtls_t *dp, *last = NULL;
+
+		for (dp = dtls_globals.hs_head; dp; last = dp, dp = dp->hs_next) {
+			if (dp == dtls) {
+				if (last) {
+					last->hs_next = dp->hs_next;
+				} else {
+					dtls_globals.hs_head = dp->hs_next;
+				}
+
+				if (dtls_globals.hs_tail == dp) {
+					dtls_globals.hs_tail = last;
+				}
+
+				dtls_globals.hs_queued--;
+				break;
+			}
+		}
+
+		dtls->hs_queued = 0;
+		dtls->hs_next = NULL;
+	}
+
+	while (dtls->hs_running) {
+		switch_mutex_unlock(dtls_globals.hs_mutex);
+		switch_yield(1000);
+		switch_mutex_lock(dtls_globals.hs_mutex);
+	}
+
+	dtls_hs_free_inbox(dtls);
+
+	switch_mutex_unlock(dtls_globals.hs_mutex);
 }
 
 static void free_dtls(switch_dtls_t **dtlsp)
@@ -3442,6 +3861,8 @@ static void free_dtls(switch_dtls_t **dtlsp)
 	dtls = *dtlsp;
 	*dtlsp = NULL;
 
+	dtls_hs_cancel(dtls);
+
 	if (dtls->ssl) {
 		SSL_free(dtls->ssl);
 	}
@@ -3453,12 +3874,9 @@ static void free_dtls(switch_dtls_t **dtlsp)
 
 static int do_dtls(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 {
-	int r = 0, ret = 0, len;
-	switch_size_t bytes;
-	unsigned char buf[MAX_DTLS_MTU] = "";
+	int r = 0;
 	uint8_t is_ice = rtp_session->ice.ice_user ? 1 : 0;
 	int ready = is_ice ? (rtp_session->ice.rready && rtp_session->ice.ready) : 1;
-	int pending;
 
 	if (!dtls->bytes && !ready) {
 		return 0;
@@ -3481,38 +3899,25 @@ static int do_dtls(switch_rtp_t *rtp_session, switch_dtls_t *dtls)
 		return 0;
 	}
 
-	if (dtls->bytes > 0 && dtls->data) {
-		ret = BIO_write(dtls->read_bio, dtls->data, (int)dtls->bytes);
-		if (ret <= 0) {
-			ret = SSL_get_error(dtls->ssl, ret);
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet decode err: SSL err %d\n", rtp_type(rtp_session), ret);
-		} else if (ret != (int)dtls->bytes) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet decode err: read %d bytes instead of %d\n", rtp_type(rtp_session), ret, (int)dtls->bytes);
+	if (dtls->state == DS_HANDSHAKE) {
+		if (!dtls->hs_start) {
+			dtls->hs_start = switch_micro_time_now();
+		}
+
+		if (dtls_hs_offload(rtp_session, dtls) == SWITCH_STATUS_SUCCESS) {
+			return 0;
 		}
 	}
 
+	if (dtls->bytes > 0 && dtls->data) {
+		dtls_feed(rtp_session, dtls, dtls->data, dtls->bytes);
+	}
+
 	if (dtls_states[dtls->state]) {
 		r = dtls_states[dtls->state](rtp_session, dtls);
 	}
 
-	while ((pending = BIO_ctrl_pending(dtls->filter_bio)) > 0) {
-		switch_assert(pending <= sizeof(buf));
-
-		len = BIO_read(dtls->write_bio, buf, pending);
-		if (len > 0) {
-			bytes = len;
-			ret = switch_socket_sendto(dtls->sock_output, dtls->remote_addr, 0, (void *)buf, &bytes);
-
-			if (ret != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet not written to socket: %d\n", rtp_type(rtp_session), ret);
-			} else if (bytes != len) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet write err: written %d bytes instead of %d\n", rtp_type(rtp_session), (int)bytes, len);
-			}
-		} else {
-			ret = SSL_get_error(dtls->ssl, len);
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS packet encode err: SSL err %d\n", rtp_type(rtp_session), ret);
-		}
-	}
+	dtls_flush(rtp_session, dtls);
 
 	return r;
 }
@@ -3757,6 +4162,13 @@ static BIO_METHOD *dtls_bio_filter_methods = NULL;
 #endif
 
 static void switch_rtp_dtls_init(void) {
+	memset(&dtls_globals, 0, sizeof(dtls_globals));
+	switch_core_new_memory_pool(&dtls_globals.pool);
+	switch_mutex_init(&dtls_globals.mutex, SWITCH_MUTEX_NESTED, dtls_globals.pool);
+	switch_mutex_init(&dtls_globals.hs_mutex, SWITCH_MUTEX_NESTED, dtls_globals.pool);
+	switch_thread_cond_create(&dtls_globals.hs_cond, dtls_globals.pool);
+	switch_core_hash_init(&dtls_globals.sessions);
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	dtls_bio_filter_methods = BIO_meth_new(BIO_TYPE_FILTER | BIO_get_new_index(), "DTLS filter");
 	BIO_meth_set_write(dtls_bio_filter_methods, dtls_bio_filter_write);
@@ -3767,6 +4179,46 @@ static void switch_rtp_dtls_init(void) {
 }
 
 static void switch_rtp_dtls_destroy(void) {
+	uint32_t i;
+	int x, y;
+
+	if (dtls_globals.hs_mutex) {
+		switch_status_t st;
+
+		switch_mutex_lock(dtls_globals.hs_mutex);
+		dtls_globals.hs_running = 0;
+		switch_thread_cond_broadcast(dtls_globals.hs_cond);
+		switch_mutex_unlock(dtls_globals.hs_mutex);
+
+		for (i = 0; i < dtls_globals.hs_thread_count; i++) {
+			switch_thread_join(&st, dtls_globals.hs_threads[i]);
+		}
+	}
+
+	if (dtls_globals.mutex) {
+		switch_mutex_lock(dtls_globals.mutex);
+
+		for (x = 0; x < 2; x++) {
+			for (y = 0; y < 2; y++) {
+				if (dtls_globals.ctx[x][y].ctx) {
+					SSL_CTX_free(dtls_globals.ctx[x][y].ctx);
+					dtls_globals.ctx[x][y].ctx = NULL;
+				}
+			}
+		}
+
+		dtls_session_flush();
+		switch_core_hash_destroy(&dtls_globals.sessions);
+
+		switch_mutex_unlock(dtls_globals.mutex);
+	}
+
+	if (dtls_globals.pool) {
+		switch_core_destroy_memory_pool(&dtls_globals.pool);
+	}
+
+	memset(&dtls_globals, 0, sizeof(dtls_globals));
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	if (dtls_bio_filter_methods) {
 		BIO_meth_free(dtls_bio_filter_methods);
@@ -3777,6 +4229,264 @@ static void switch_rtp_dtls_destroy(void) {
 
 ///////////
 
+static void dtls_ctx_ref(SSL_CTX *ctx)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	SSL_CTX_up_ref(ctx);
+#else
+	CRYPTO_add(&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+}
+
+static uint64_t dtls_file_stamp(const char *path)
+{
+	struct stat st;
+
+	if (zstr(path) || stat(path, &st)) {
+		return 0;
+	}
+
+	return ((uint64_t) st.st_mtime << 24) ^ (uint64_t) st.st_size;
+}
+
+static SSL_CTX *dtls_ctx_create(switch_rtp_t *rtp_session, switch_dtls_t *dtls, dtls_type_t type, uint8_t want_DTLSv1_2)
+{
+	const SSL_METHOD *ssl_method;
+	SSL_CTX *ssl_ctx;
+	int ret;
+#if OPENSSL_VERSION_NUMBER < 0x30000000
+	BIO *bio;
+	DH *dh;
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+	ssl_method = (type & DTLS_TYPE_SERVER) ? DTLS_server_method() : DTLS_client_method();
+#else
+    #ifdef HAVE_OPENSSL_DTLSv1_2_method
+		ssl_method = (type & DTLS_TYPE_SERVER) ? (want_DTLSv1_2 ? DTLSv1_2_server_method() : DTLSv1_server_method()) : (want_DTLSv1_2 ? DTLSv1_2_client_method() : DTLSv1_client_method());
+	#else
+		ssl_method = (type & DTLS_TYPE_SERVER) ? DTLSv1_server_method() : DTLSv1_client_method();
+    #endif // HAVE_OPENSSL_DTLSv1_2_method
+#endif
+
+	if (!ssl_method) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s ssl_method is NULL [%lu]\n", rtp_type(rtp_session), ERR_peek_error());
+	}
+
+	if (!(ssl_ctx = SSL_CTX_new(ssl_method))) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s SSL_CTX_new failed [%lu]\n", rtp_type(rtp_session), ERR_peek_error());
+		return NULL;
+	}
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000
+	bio = BIO_new_file(dtls->pem, "r");
+	dh = PEM_read_bio_DHparams(bio, NULL, NULL, NULL);
+	BIO_free(bio);
+	if (dh) {
+		SSL_CTX_set_tmp_dh(ssl_ctx, dh);
+		DH_free(dh);
+	}
+#else
+	if(!SSL_CTX_set_dh_auto(ssl_ctx, 1)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "Failed enable auto DH!\n");
+	}
+#endif
+	SSL_CTX_set_mode(ssl_ctx, SSL_MODE_AUTO_RETRY);
+
+	//SSL_CTX_set_cipher_list(ssl_ctx, "ECDH:!RC4:!SSLv3:RSA_WITH_AES_128_CBC_SHA");
+	//SSL_CTX_set_cipher_list(ssl_ctx, "ECDHE-RSA-AES256-GCM-SHA384");
+	SSL_CTX_set_cipher_list(ssl_ctx, "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH");
+	//SSL_CTX_set_cipher_list(ssl_ctx, "SUITEB128");
+	SSL_CTX_set_read_ahead(ssl_ctx, 1);
+#ifdef HAVE_OPENSSL_DTLS_SRTP
+	//SSL_CTX_set_tlsext_use_srtp(ssl_ctx, "SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
+	SSL_CTX_set_tlsext_use_srtp(ssl_ctx, "SRTP_AES128_CM_SHA1_80");
+#endif
+
+	/* The context outlives the call, so the server side session cache and ticket keys let a returning
+	 * peer resume instead of redoing the key exchange. The id context is required for resumption when a
+	 * client certificate is requested. Client sessions are kept by dtls_session_store(). */
+	SSL_CTX_set_session_id_context(ssl_ctx, (const unsigned char *) "freeswitch-dtls", 15);
+	SSL_CTX_set_session_cache_mode(ssl_ctx, (type & DTLS_TYPE_SERVER) ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+
+	if ((ret = SSL_CTX_use_certificate_file(ssl_ctx, dtls->rsa, SSL_FILETYPE_PEM)) != 1) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS cert err [%lu]\n", rtp_type(rtp_session), ERR_peek_error());
+		goto fail;
+	}
+
+	if ((ret = SSL_CTX_use_PrivateKey_file(ssl_ctx, dtls->pvt, SSL_FILETYPE_PEM)) != 1) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS key err [%lu]\n", rtp_type(rtp_session), ERR_peek_error());
+		goto fail;
+	}
+
+	if (SSL_CTX_check_private_key(ssl_ctx) == 0) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS check key failed\n", rtp_type(rtp_session));
+		goto fail;
+	}
+
+	if (!zstr(dtls->ca) && switch_file_exists(dtls->ca, rtp_session->pool) == SWITCH_STATUS_SUCCESS
+		&& (ret = SSL_CTX_load_verify_locations(ssl_ctx, dtls->ca, NULL)) != 1) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS check chain cert failed [%lu]\n",
+						  rtp_type(rtp_session), ERR_peek_error());
+		goto fail;
+	}
+
+	return ssl_ctx;
+
+ fail:
+
+	SSL_CTX_free(ssl_ctx);
+
+	return NULL;
+}
+
+static void dtls_session_flush(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	if (!dtls_globals.sessions) {
+		return;
+	}
+
+	for (hi = switch_core_hash_first(dtls_globals.sessions); hi; hi = switch_core_hash_next(&hi)) {
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		SSL_SESSION_free((SSL_SESSION *) val);
+	}
+
+	switch_core_hash_destroy(&dtls_globals.sessions);
+	switch_core_hash_init(&dtls_globals.sessions);
+	dtls_globals.session_count = 0;
+}
+
+/* Returns a new reference to the shared context for this role, building it on first use and again
+ * whenever the certificate, key or CA bundle on disk changes. */
+static SSL_CTX *dtls_ctx_get(switch_rtp_t *rtp_session, switch_dtls_t *dtls, dtls_type_t type, uint8_t want_DTLSv1_2)
+{
+	dtls_ctx_slot_t *slot = &dtls_globals.ctx[(type & DTLS_TYPE_SERVER) ? 1 : 0][want_DTLSv1_2 ? 1 : 0];
+	uint64_t stamp = dtls_file_stamp(dtls->rsa) * 31 + dtls_file_stamp(dtls->pvt) * 7 + dtls_file_stamp(dtls->ca);
+	SSL_CTX *ctx = NULL;
+
+	switch_mutex_lock(dtls_globals.mutex);
+
+	if (slot->ctx && slot->stamp == stamp && !strcmp(slot->rsa, dtls->rsa)) {
+		ctx = slot->ctx;
+	} else if ((ctx = dtls_ctx_create(rtp_session, dtls, type, want_DTLSv1_2))) {
+		if (slot->ctx) {
+			/* Our certificate changed, so sessions resumed with the old one would fail the peer's fingerprint check. */
+			SSL_CTX_free(slot->ctx);
+			dtls_session_flush();
+		}
+
+		slot->ctx = ctx;
+		slot->stamp = stamp;
+		switch_copy_string(slot->rsa, dtls->rsa, sizeof(slot->rsa));
+		dtls_globals.stats.ctx_builds++;
+	}
+
+	if (ctx) {
+		dtls_ctx_ref(ctx);
+	}
+
+	switch_mutex_unlock(dtls_globals.mutex);
+
+	return ctx;
+}
+
+/* Client side resumption: the session from the last handshake with the peer presenting this
+ * certificate (by SDP a=fingerprint) is offered again so it can be resumed by ticket or id. */
+static void dtls_session_key(dtls_fingerprint_t *fp, char *buf, switch_size_t len)
+{
+	*buf = '\0';
+
+	if (fp && fp->type && !zstr(fp->str)) {
+		switch_snprintf(buf, len, "%s %s", fp->type, fp->str);
+	}
+}
+
+static void dtls_session_resume(switch_dtls_t *dtls, dtls_fingerprint_t *remote_fp)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	char key[MAX_FPSTRLEN + 32];
+	SSL_SESSION *sess;
+
+	dtls_session_key(remote_fp, key, sizeof(key));
+
+	if (zstr(key)) {
+		return;
+	}
+
+	switch_mutex_lock(dtls_globals.mutex);
+
+	if ((sess = switch_core_hash_find(dtls_globals.sessions, key))) {
+		if (SSL_SESSION_is_resumable(sess) && (time_t) (SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess)) > switch_epoch_time_now(NULL)) {
+			SSL_set_session(dtls->ssl, sess);
+		} else {
+			switch_core_hash_delete(dtls_globals.sessions, key);
+			SSL_SESSION_free(sess);
+			dtls_globals.session_count--;
+		}
+	}
+
+	switch_mutex_unlock(dtls_globals.mutex);
+#endif
+}
+
+static void dtls_session_store(switch_dtls_t *dtls)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	char key[MAX_FPSTRLEN + 32];
+	SSL_SESSION *sess, *old;
+
+	dtls_session_key(dtls->remote_fp, key, sizeof(key));
+
+	if (zstr(key) || !(sess = SSL_get1_session(dtls->ssl))) {
+		return;
+	}
+
+	if (!SSL_SESSION_is_resumable(sess)) {
+		SSL_SESSION_free(sess);
+		return;
+	}
+
+	switch_mutex_lock(dtls_globals.mutex);
+
+	if ((old = switch_core_hash_find(dtls_globals.sessions, key))) {
+		switch_core_hash_delete(dtls_globals.sessions, key);
+		SSL_SESSION_free(old);
+		dtls_globals.session_count--;
+	}
+
+	if (dtls_globals.session_count >= DTLS_SESSION_CACHE_MAX) {
+		dtls_session_flush();
+	}
+
+	switch_core_hash_insert(dtls_globals.sessions, key, sess);
+	dtls_globals.session_count++;
+
+	switch_mutex_unlock(dtls_globals.mutex);
+#endif
+}
+
+SWITCH_DECLARE(void) switch_rtp_get_dtls_stats(switch_rtp_dtls_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (dtls_globals.mutex) {
+		switch_mutex_lock(dtls_globals.mutex);
+		*stats = dtls_globals.stats;
+		switch_mutex_unlock(dtls_globals.mutex);
+	}
+
+	if (dtls_globals.hs_mutex) {
+		switch_mutex_lock(dtls_globals.hs_mutex);
+		stats->offloaded = dtls_globals.hs_offloaded;
+		stats->inline_flights = dtls_globals.hs_inline;
+		switch_mutex_unlock(dtls_globals.hs_mutex);
+	}
+
+	memcpy(stats->bucket_ms, dtls_hs_bucket_ms, sizeof(stats->bucket_ms));
+}
 
 
 SWITCH_DECLARE(int) switch_rtp_has_dtls(void) {
@@ -3899,16 +4609,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_dtls(switch_rtp_t *rtp_session, d
 {
 	switch_dtls_t *dtls;
 	const char *var;
-	int ret;
 	const char *kind;
-	unsigned long ssl_method_error = 0;
-	unsigned long ssl_ctx_error = 0;
-	const SSL_METHOD *ssl_method;
-	SSL_CTX *ssl_ctx;
-#if OPENSSL_VERSION_NUMBER < 0x30000000
-	BIO *bio;
-	DH *dh;
-#endif
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 #ifndef OPENSSL_NO_EC
 #if OPENSSL_VERSION_NUMBER < 0x10002000L
@@ -3961,56 +4662,14 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_dtls(switch_rtp_t *rtp_session, d
 
 	dtls->ca = switch_core_sprintf(rtp_session->pool, "%s%sca-bundle.crt", SWITCH_GLOBAL_dirs.certs_dir, SWITCH_PATH_SEPARATOR);
 
-#if OPENSSL_VERSION_NUMBER >= 0x10100000
-	ssl_method = (type & DTLS_TYPE_SERVER) ? DTLS_server_method() : DTLS_client_method();
-#else
-    #ifdef HAVE_OPENSSL_DTLSv1_2_method
-		ssl_method = (type & DTLS_TYPE_SERVER) ? (want_DTLSv1_2 ? DTLSv1_2_server_method() : DTLSv1_server_method()) : (want_DTLSv1_2 ? DTLSv1_2_client_method() : DTLSv1_client_method());
-	#else
-		ssl_method = (type & DTLS_TYPE_SERVER) ? DTLSv1_server_method() : DTLSv1_client_method();
-    #endif // HAVE_OPENSSL_DTLSv1_2_method
-#endif
-
-	if (!ssl_method) {
-		ssl_method_error = ERR_peek_error();
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s ssl_method is NULL [%lu]\n", rtp_type(rtp_session), ssl_method_error);
-	}
-
-	dtls->ssl_ctx = ssl_ctx = SSL_CTX_new(ssl_method);
-
-	if (!ssl_ctx) {
-		ssl_ctx_error = ERR_peek_error();
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s SSL_CTX_new failed [%lu]\n", rtp_type(rtp_session), ssl_ctx_error);
-		switch_channel_hangup(switch_core_session_get_channel(rtp_session->session), SWITCH_CAUSE_NORMAL_TEMPORARY_FAILURE);
+	if (!(dtls->ssl_ctx = dtls_ctx_get(rtp_session, dtls, type, want_DTLSv1_2))) {
+		if (rtp_session->session) {
+			switch_channel_hangup(switch_core_session_get_channel(rtp_session->session), SWITCH_CAUSE_NORMAL_TEMPORARY_FAILURE);
+		}
 		switch_goto_status(SWITCH_STATUS_FALSE, done);
 	}
 
-	switch_assert(dtls->ssl_ctx);
-
-#if OPENSSL_VERSION_NUMBER < 0x30000000
-	bio = BIO_new_file(dtls->pem, "r");
-	dh = PEM_read_bio_DHparams(bio, NULL, NULL, NULL);
-	BIO_free(bio);
-	if (dh) {
-		SSL_CTX_set_tmp_dh(dtls->ssl_ctx, dh);
-		DH_free(dh);
-	}
-#else
-	if(!SSL_CTX_set_dh_auto(dtls->ssl_ctx, 1)) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "Failed enable auto DH!\n");
-	}
-#endif
-	SSL_CTX_set_mode(dtls->ssl_ctx, SSL_MODE_AUTO_RETRY);
-
-	//SSL_CTX_set_cipher_list(dtls->ssl_ctx, "ECDH:!RC4:!SSLv3:RSA_WITH_AES_128_CBC_SHA");
-	//SSL_CTX_set_cipher_list(dtls->ssl_ctx, "ECDHE-RSA-AES256-GCM-SHA384");
-	SSL_CTX_set_cipher_list(dtls->ssl_ctx, "ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH");
-	//SSL_CTX_set_cipher_list(dtls->ssl_ctx, "SUITEB128");
-	SSL_CTX_set_read_ahead(dtls->ssl_ctx, 1);
-#ifdef HAVE_OPENSSL_DTLS_SRTP
-	//SSL_CTX_set_tlsext_use_srtp(dtls->ssl_ctx, "SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
-	SSL_CTX_set_tlsext_use_srtp(dtls->ssl_ctx, "SRTP_AES128_CM_SHA1_80");
-#endif
+	dtls_hs_start();
 
 	dtls->type = type;
 
@@ -4032,29 +4691,6 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_dtls(switch_rtp_t *rtp_session, d
 	BIO_set_mem_eof_return(dtls->read_bio, -1);
 	BIO_set_mem_eof_return(dtls->write_bio, -1);
 
-	if ((ret=SSL_CTX_use_certificate_file(dtls->ssl_ctx, dtls->rsa, SSL_FILETYPE_PEM)) != 1) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS cert err [%d]\n", rtp_type(rtp_session), SSL_get_error(dtls->ssl, ret));
-		switch_goto_status(SWITCH_STATUS_FALSE, done);
-	}
-
-	if ((ret=SSL_CTX_use_PrivateKey_file(dtls->ssl_ctx, dtls->pvt, SSL_FILETYPE_PEM)) != 1) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS key err [%d]\n", rtp_type(rtp_session), SSL_get_error(dtls->ssl, ret));
-		switch_goto_status(SWITCH_STATUS_FALSE, done);
-	}
-
-	if (SSL_CTX_check_private_key(dtls->ssl_ctx) == 0) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS check key failed\n", rtp_type(rtp_session));
-		switch_goto_status(SWITCH_STATUS_FALSE, done);
-	}
-
-	if (!zstr(dtls->ca) && switch_file_exists(dtls->ca, rtp_session->pool) == SWITCH_STATUS_SUCCESS
-		&& (ret = SSL_CTX_load_verify_locations(dtls->ssl_ctx, dtls->ca, NULL)) != 1) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "%s DTLS check chain cert failed [%d]\n",
-						  rtp_type(rtp_session) ,
-						  SSL_get_error(dtls->ssl, ret));
-		switch_goto_status(SWITCH_STATUS_FALSE, done);
-	}
-
 	dtls->ssl = SSL_new(dtls->ssl_ctx);
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -4117,6 +4753,10 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_dtls(switch_rtp_t *rtp_session, d
 	}
 	SSL_set_app_data(dtls->ssl, dtls);
 
+	if (!(type & DTLS_TYPE_SERVER)) {
+		dtls_session_resume(dtls, remote_fp);
+	}
+
 	dtls->local_fp = local_fp;
 	dtls->remote_fp = remote_fp;
 	dtls->rtp_session = rtp_session;
@@ -6816,12 +7456,16 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 				}
 
 				if (!(*flags & SFF_PLC) && rtp_session->recv_ctx[rtp_session->srtp_idx_rtp]) {
+					uint64_t srtp_start = srtp_clock_ns();
+
 					if (!rtp_session->flags[SWITCH_RTP_FLAG_SECURE_RECV_MKI]) {
 						stat = srtp_unprotect(rtp_session->recv_ctx[rtp_session->srtp_idx_rtp], &rtp_session->recv_msg.header, &sbytes);
 					} else {
 						stat = srtp_unprotect_mki(rtp_session->recv_ctx[rtp_session->srtp_idx_rtp], &rtp_session->recv_msg.header, &sbytes, 1);
 					}
 
+					srtp_cost_add(&rtp_session->stats.inbound, srtp_start);
+
 					if (rtp_session->flags[SWITCH_RTP_FLAG_NACK] && stat == srtp_err_status_replay_fail) {
 						/* false alarm nack */
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG1, "REPLAY ERR, FALSE NACK\n");
@@ -9104,6 +9748,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 		if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND]) {
 			int sbytes = (int) bytes;
 			srtp_err_status_t stat;
+			uint64_t srtp_start;
 
 
 			if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND_RESET] || !rtp_session->send_ctx[rtp_session->srtp_idx_rtp]) {
@@ -9125,12 +9770,16 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 				}
 			}
 
+			srtp_start = srtp_clock_ns();
+
 			if (!rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND_MKI]) {
 				stat = srtp_protect(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], send_msg, &sbytes);
 			} else {
 				stat = srtp_protect_mki(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], send_msg, &sbytes, 1, SWITCH_CRYPTO_MKI_INDEX);
 			}
 
+			srtp_cost_add(&rtp_session->stats.outbound, srtp_start);
+
 			if (stat) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR,
 								  "Error: %s SRTP protection failed with code %d\n", rtp_type(rtp_session), stat);
@@ -9632,6 +10281,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_write_raw(switch_rtp_t *rtp_session,
 
 			int sbytes = (int) *bytes;
 			srtp_err_status_t stat;
+			uint64_t srtp_start;
 
 			if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND_RESET]) {
 				switch_rtp_clear_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND_RESET);
@@ -9649,12 +10299,16 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_write_raw(switch_rtp_t *rtp_session,
 				}
 			}
 
+			srtp_start = srtp_clock_ns();
+
 			if (!rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND_MKI]) {
 				stat = srtp_protect(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], &rtp_session->write_msg, &sbytes);
 			} else {
 				stat = srtp_protect_mki(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], &rtp_session->write_msg, &sbytes, 1, SWITCH_CRYPTO_MKI_INDEX);
 			}
 
+			srtp_cost_add(&rtp_session->stats.outbound, srtp_start);
+
 			if (stat) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "Error: SRTP protection failed with code %d\n", stat);
 			}
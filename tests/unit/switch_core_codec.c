@@ -31,9 +31,13 @@
  */
 #include <switch.h>
 #include <stdlib.h>
+#include <g711.h>
+#include <math.h>
 
 #include <test/switch_test.h>
 
+// #define BENCHMARK 1
+
 FST_CORE_BEGIN("./conf")
 {
 	FST_SUITE_BEGIN(switch_core_codec)
@@ -153,6 +157,381 @@ FST_CORE_BEGIN("./conf")
 		}
 		FST_TEST_END()
 
+		FST_TEST_BEGIN(test_g711_translate)
+		{
+			switch_codec_t pcmu = { 0 }, pcma = { 0 }, pcmu30 = { 0 }, g722 = { 0 };
+			switch_core_codec_translate_func_t func = NULL;
+			uint8_t in[256], translated[256], transcoded[256];
+			int16_t linear[256];
+			uint32_t linear_len, out_len, rate;
+			unsigned int flags = 0;
+			int i;
+#ifdef BENCHMARK
+			switch_core_codec_translate_func_t to_alaw;
+			int frames = 200000;
+			switch_time_t start, translate_time, transcode_time;
+#endif
+
+			fst_requires(switch_core_codec_init(&pcmu, "PCMU", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, fst_pool) == SWITCH_STATUS_SUCCESS);
+			fst_requires(switch_core_codec_init(&pcma, "PCMA", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, fst_pool) == SWITCH_STATUS_SUCCESS);
+			fst_requires(switch_core_codec_init(&pcmu30, "PCMU", NULL, NULL, 8000, 30, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, fst_pool) == SWITCH_STATUS_SUCCESS);
+			fst_requires(switch_core_codec_init(&g722, "G722", "mod_spandsp", NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, fst_pool) == SWITCH_STATUS_SUCCESS);
+
+			fst_check(switch_core_codec_find_translator(pcmu.implementation, g722.implementation, &func) == SWITCH_FALSE);
+			fst_check(switch_core_codec_find_translator(pcmu.implementation, pcmu30.implementation, &func) == SWITCH_TRUE);
+			fst_check(func == NULL);
+			fst_check(switch_core_codec_find_translator(pcmu.implementation, pcma.implementation, &func) == SWITCH_TRUE);
+			fst_requires(func != NULL);
+#ifdef BENCHMARK
+			to_alaw = func;
+#endif
+
+			for (i = 0; i < 256; i++) {
+				in[i] = (uint8_t) i;
+			}
+
+			/* the same bytes as going through linear, for every code */
+			func(in, translated, sizeof(in));
+			linear_len = sizeof(linear);
+			switch_core_codec_decode(&pcmu, NULL, in, sizeof(in), 8000, linear, &linear_len, &rate, &flags);
+			out_len = sizeof(transcoded);
+			switch_core_codec_encode(&pcma, NULL, linear, linear_len, 8000, transcoded, &out_len, &rate, &flags);
+			fst_check_int_equals(out_len, sizeof(in));
+			fst_check(!memcmp(translated, transcoded, sizeof(in)));
+
+			fst_check(switch_core_codec_find_translator(pcma.implementation, pcmu.implementation, &func) == SWITCH_TRUE);
+			fst_requires(func != NULL);
+			func(in, translated, sizeof(in));
+			linear_len = sizeof(linear);
+			switch_core_codec_decode(&pcma, NULL, in, sizeof(in), 8000, linear, &linear_len, &rate, &flags);
+			out_len = sizeof(transcoded);
+			switch_core_codec_encode(&pcmu, NULL, linear, linear_len, 8000, transcoded, &out_len, &rate, &flags);
+			fst_check(!memcmp(translated, transcoded, sizeof(in)));
+
+#ifdef BENCHMARK
+			/* a 20ms frame each way, what one bridged call costs 50 times a second */
+			start = switch_time_now();
+			for (i = 0; i < frames; i++) {
+				linear_len = sizeof(linear);
+				switch_core_codec_decode(&pcmu, NULL, in, 160, 8000, linear, &linear_len, &rate, &flags);
+				out_len = sizeof(transcoded);
+				switch_core_codec_encode(&pcma, NULL, linear, linear_len, 8000, transcoded, &out_len, &rate, &flags);
+				linear_len = sizeof(linear);
+				switch_core_codec_decode(&pcma, NULL, transcoded, 160, 8000, linear, &linear_len, &rate, &flags);
+				out_len = sizeof(translated);
+				switch_core_codec_encode(&pcmu, NULL, linear, linear_len, 8000, translated, &out_len, &rate, &flags);
+				in[i & 0xff] ^= translated[i & 0x7f];
+			}
+			transcode_time = switch_time_now() - start;
+
+			start = switch_time_now();
+			for (i = 0; i < frames; i++) {
+				to_alaw(in, transcoded, 160);
+				func(transcoded, translated, 160);
+				in[i & 0xff] ^= translated[i & 0x7f];
+			}
+			translate_time = switch_time_now() - start;
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "PCMU<->PCMA per call-second: transcode %.1fus, translate %.1fus\n",
+							  (double) transcode_time * 50 / frames, (double) translate_time * 50 / frames);
+#endif
+
+			switch_core_codec_destroy(&pcmu);
+			switch_core_codec_destroy(&pcma);
+			switch_core_codec_destroy(&pcmu30);
+			switch_core_codec_destroy(&g722);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_g711_kernels)
+		{
+			int16_t *linear = switch_core_alloc(fst_pool, 65536 * sizeof(int16_t));
+			int16_t *decoded = switch_core_alloc(fst_pool, 65536 * sizeof(int16_t));
+			uint8_t *ulaw = switch_core_alloc(fst_pool, 65536);
+			uint8_t *alaw = switch_core_alloc(fst_pool, 65536);
+			uint8_t codes[256 + 7];
+			int i, bad = 0;
+#ifdef BENCHMARK
+			int frames = 500000;
+			switch_time_t start, scalar_time, kernel_time;
+#endif
+
+			for (i = 0; i < 65536; i++) {
+				linear[i] = (int16_t) (i - 32768);
+			}
+
+			/* every input, with an odd length so the tail is done one by one */
+			switch_g711_ulaw_encode(ulaw, linear, 65535);
+			switch_g711_alaw_encode(alaw, linear, 65535);
+			for (i = 0; i < 65535; i++) {
+				bad += ulaw[i] != linear_to_ulaw(linear[i]);
+				bad += alaw[i] != linear_to_alaw(linear[i]);
+			}
+			fst_check_int_equals(bad, 0);
+
+			for (i = 0; i < (int) sizeof(codes); i++) {
+				codes[i] = (uint8_t) i;
+			}
+
+			switch_g711_ulaw_decode(decoded, codes, sizeof(codes));
+			for (i = 0; i < (int) sizeof(codes); i++) {
+				bad += decoded[i] != ulaw_to_linear(codes[i]);
+			}
+			switch_g711_alaw_decode(decoded, codes, sizeof(codes));
+			for (i = 0; i < (int) sizeof(codes); i++) {
+				bad += decoded[i] != alaw_to_linear(codes[i]);
+			}
+			fst_check_int_equals(bad, 0);
+
+#ifdef BENCHMARK
+			/* a 20ms frame encoded and decoded, both laws */
+			start = switch_time_now();
+			for (i = 0; i < frames; i++) {
+				int16_t *in = linear + (i & 0x7fff);
+				int j;
+
+				for (j = 0; j < 160; j++) {
+					ulaw[j] = linear_to_ulaw(in[j]);
+					alaw[j] = linear_to_alaw(in[j]);
+				}
+				for (j = 0; j < 160; j++) {
+					decoded[j] = ulaw_to_linear(ulaw[j]);
+					decoded[j + 160] = alaw_to_linear(alaw[j]);
+				}
+			}
+			scalar_time = switch_time_now() - start;
+
+			start = switch_time_now();
+			for (i = 0; i < frames; i++) {
+				int16_t *in = linear + (i & 0x7fff);
+
+				switch_g711_ulaw_encode(ulaw, in, 160);
+				switch_g711_alaw_encode(alaw, in, 160);
+				switch_g711_ulaw_decode(decoded, ulaw, 160);
+				switch_g711_alaw_decode(decoded + 160, alaw, 160);
+			}
+			kernel_time = switch_time_now() - start;
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "G.711 %d frames: scalar %" SWITCH_TIME_T_FMT "ms, %s %" SWITCH_TIME_T_FMT "ms\n",
+							  frames, scalar_time / 1000, switch_g711_kernel_name(), kernel_time / 1000);
+#endif
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_resample_kernels)
+		{
+			int rates[][3] = { { 8000, 48000, 1 }, { 8000, 48000, 2 }, { 48000, 16000, 1 }, { 48000, 16000, 2 } };
+			int16_t *in = switch_core_alloc(fst_pool, 960 * 2 * 50 * sizeof(int16_t));
+			int r, i;
+#ifdef BENCHMARK
+			int frames = 20000;
+#endif
+
+			for (r = 0; r < (int) (sizeof(rates) / sizeof(rates[0])); r++) {
+				uint32_t from = rates[r][0], to = rates[r][1], channels = rates[r][2], frame = from / 50, total = 0;
+				switch_audio_resampler_t *fast = NULL, *generic = NULL;
+				double a = 0, b = 0, fit = 0, err = 0, right = 0;
+#ifdef BENCHMARK
+				switch_time_t start, fast_time, generic_time;
+#endif
+
+				/* a second of a 1kHz tone on the left, silence on the right */
+				for (i = 0; i < (int) from; i++) {
+					in[i * channels] = (int16_t) (10000 * sin(2 * M_PI * 1000 * i / from));
+					if (channels == 2) {
+						in[i * channels + 1] = 0;
+					}
+				}
+
+				fst_requires(switch_resample_create(&fast, from, to, frame, SWITCH_RESAMPLE_QUALITY, channels) == SWITCH_STATUS_SUCCESS);
+				fst_requires(switch_resample_create(&generic, from, to, frame, SWITCH_RESAMPLE_QUALITY | SWITCH_RESAMPLE_GENERIC, channels) == SWITCH_STATUS_SUCCESS);
+				fst_check(strcmp(switch_resample_kernel_name(fast), "speex"));
+				fst_check_string_equals(switch_resample_kernel_name(generic), "speex");
+
+				for (i = 0; i < 50; i++) {
+					int16_t *to_ptr = fast->to;
+					uint32_t j, len = switch_resample_process(fast, in + i * frame * channels, frame);
+
+					/* 20ms in is 20ms out, into the buffer made at create time */
+					fst_check_int_equals(len, to / 50);
+					fst_check(fast->to == to_ptr);
+
+					/* fit the tone over the last 4/5 of the second and measure what is left over */
+					for (j = 0; j < len; j++, total++) {
+						int16_t y = fast->to[j * channels];
+						double t = 2 * M_PI * 1000 * total / to;
+
+						if (channels == 2) {
+							right += abs(fast->to[j * channels + 1]);
+						}
+
+						if (total >= to / 5) {
+							double s = sin(t), c = cos(t);
+
+							a += y * s;
+							b += y * c;
+							err += (double) y * y;
+						}
+					}
+				}
+
+				a *= 2.0 / (to - to / 5);
+				b *= 2.0 / (to - to / 5);
+				fit = (a * a + b * b) / 2 * (to - to / 5);
+				err -= fit;
+				fst_check(fit > 0 && err < fit / 10000);
+				fst_check(right == 0);
+
+#ifdef BENCHMARK
+				start = switch_time_now();
+				for (i = 0; i < frames; i++) {
+					switch_resample_process(fast, in + (i % 50) * frame * channels, frame);
+				}
+				fast_time = switch_time_now() - start;
+
+				start = switch_time_now();
+				for (i = 0; i < frames; i++) {
+					switch_resample_process(generic, in + (i % 50) * frame * channels, frame);
+				}
+				generic_time = switch_time_now() - start;
+
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "resample %u->%u %s %d 20ms frames: speex %" SWITCH_TIME_T_FMT "ms, %s %" SWITCH_TIME_T_FMT "ms\n",
+								  from, to, channels == 2 ? "stereo" : "mono", frames, generic_time / 1000, switch_resample_kernel_name(fast), fast_time / 1000);
+#endif
+
+				switch_resample_destroy(&fast);
+				switch_resample_destroy(&generic);
+			}
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_codec_pool)
+		{
+			switch_codec_t codec = { 0 };
+			switch_codec_settings_t codec_settings = { { 0 } };
+			int16_t pcm[960 * 3];
+			uint8_t first[SWITCH_RECOMMENDED_BUFFER_SIZE], again[SWITCH_RECOMMENDED_BUFFER_SIZE];
+			uint32_t first_len, again_len, rate, idle = 0;
+			uint64_t hits = 0, misses = 0, hits_before = 0, misses_before = 0;
+			unsigned int flag = 0;
+			void *private_info;
+			int i;
+#ifdef BENCHMARK
+			int cycles = 2000;
+			switch_time_t start, fresh_time, pooled_time;
+#endif
+			switch_status_t status;
+
+			for (i = 0; i < 960 * 3; i++) {
+				pcm[i] = (int16_t) (8000 * sin(i * 2 * M_PI * 440 / 48000));
+			}
+
+			switch_core_codec_pool_flush(NULL);
+			switch_core_codec_pool_stats(&idle, &hits_before, &misses_before);
+			fst_check_int_equals(idle, 0);
+
+			status = switch_core_codec_init(&codec, "OPUS", "mod_opus", NULL, 48000, 20, 1,
+											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, &codec_settings, fst_pool);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			private_info = codec.private_info;
+
+			first_len = sizeof(first);
+			status = switch_core_codec_encode(&codec, NULL, pcm, 1920, 48000, first, &first_len, &rate, &flag);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+
+			/* move the encoder on so a handle that isn't reset would give other bytes */
+			for (i = 1; i < 3; i++) {
+				uint8_t scratch[SWITCH_RECOMMENDED_BUFFER_SIZE];
+				uint32_t scratch_len = sizeof(scratch);
+
+				switch_core_codec_encode(&codec, NULL, pcm + i * 960, 1920, 48000, scratch, &scratch_len, &rate, &flag);
+			}
+
+			switch_core_codec_destroy(&codec);
+			switch_core_codec_pool_stats(&idle, &hits, &misses);
+			fst_check_int_equals(idle, 1);
+			fst_check(misses == misses_before + 1);
+
+			status = switch_core_codec_init(&codec, "OPUS", "mod_opus", NULL, 48000, 20, 1,
+											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, &codec_settings, fst_pool);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			fst_check(codec.private_info == private_info);
+			fst_check(switch_test_flag(&codec, SWITCH_CODEC_FLAG_HAS_PLC));
+
+			again_len = sizeof(again);
+			status = switch_core_codec_encode(&codec, NULL, pcm, 1920, 48000, again, &again_len, &rate, &flag);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			fst_check_int_equals(again_len, first_len);
+			fst_check(!memcmp(first, again, first_len));
+
+			switch_core_codec_pool_stats(&idle, &hits, &misses);
+			fst_check_int_equals(idle, 0);
+			fst_check(hits == hits_before + 1);
+
+			/* another fmtp is another setup */
+			switch_core_codec_destroy(&codec);
+			status = switch_core_codec_init(&codec, "OPUS", "mod_opus", "useinbandfec=0", 48000, 20, 1,
+											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, &codec_settings, fst_pool);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			fst_check(codec.private_info != private_info);
+			switch_core_codec_destroy(&codec);
+
+			switch_core_codec_pool_stats(&idle, NULL, NULL);
+			fst_check_int_equals(idle, 2);
+			switch_core_codec_pool_flush(NULL);
+			switch_core_codec_pool_stats(&idle, NULL, NULL);
+			fst_check_int_equals(idle, 0);
+
+#ifdef BENCHMARK
+			start = switch_time_now();
+			for (i = 0; i < cycles; i++) {
+				switch_core_codec_init(&codec, "OPUS", "mod_opus", NULL, 48000, 20, 1,
+									   SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, &codec_settings, fst_pool);
+				switch_core_codec_destroy(&codec);
+				switch_core_codec_pool_flush(NULL);
+			}
+			fresh_time = switch_time_now() - start;
+
+			start = switch_time_now();
+			for (i = 0; i < cycles; i++) {
+				switch_core_codec_init(&codec, "OPUS", "mod_opus", NULL, 48000, 20, 1,
+									   SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, &codec_settings, fst_pool);
+				switch_core_codec_destroy(&codec);
+			}
+			pooled_time = switch_time_now() - start;
+			switch_core_codec_pool_flush(NULL);
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "OPUS %d init/destroy: fresh %" SWITCH_TIME_T_FMT "us, pooled %" SWITCH_TIME_T_FMT "us\n",
+							  cycles, fresh_time, pooled_time);
+#endif
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_codecs_sorted_memo)
+		{
+			const switch_codec_implementation_t *first[SWITCH_MAX_CODECS] = { 0 }, *again[SWITCH_MAX_CODECS] = { 0 };
+			char first_fmtp[SWITCH_MAX_CODECS][MAX_FMTP_LEN] = { { 0 } }, again_fmtp[SWITCH_MAX_CODECS][MAX_FMTP_LEN] = { { 0 } };
+			char *prefs[] = { "OPUS", "PCMU@20i", "PCMA", "PCMU" };
+			uint32_t version = switch_loadable_module_codec_catalog_version();
+			int first_num, again_num, i;
+
+			first_num = switch_loadable_module_get_codecs_sorted(first, first_fmtp, SWITCH_MAX_CODECS, prefs, 4);
+			again_num = switch_loadable_module_get_codecs_sorted(again, again_fmtp, SWITCH_MAX_CODECS, prefs, 4);
+
+			/* the duplicate PCMU entry is dropped */
+			fst_check_int_equals(first_num, 3);
+			fst_check_int_equals(again_num, first_num);
+			for (i = 0; i < first_num; i++) {
+				fst_check(again[i] == first[i]);
+				fst_check_string_equals(again_fmtp[i], first_fmtp[i]);
+			}
+
+			/* the list is capped at arraylen */
+			fst_check_int_equals(switch_loadable_module_get_codecs_sorted(again, again_fmtp, 2, prefs, 4), 2);
+			fst_check(switch_loadable_module_codec_catalog_version() == version);
+		}
+		FST_TEST_END()
+
 	}
 	FST_SUITE_END()
 }
@@ -223,6 +223,148 @@ FST_CORE_BEGIN("./conf")
 			unlink(filename);
 		}
 		FST_TEST_END()
+		FST_TEST_BEGIN(test_switch_core_file_cache)
+		{
+			switch_status_t status = SWITCH_STATUS_FALSE;
+			switch_file_handle_t fhw = { 0 }, fh1 = { 0 }, fh2 = { 0 };
+			static char filename[] = "/tmp/fs_cache_unit_test.wav";
+			int16_t buf[160], buf1[160], buf2[160];
+			switch_size_t len, len1, len2, total = 0;
+			uint64_t hits = 0, misses = 0;
+			uint32_t entries = 0;
+			switch_size_t bytes = 0;
+			unsigned int pos = 0;
+			int i, j;
+
+			status = switch_core_file_open(&fhw, filename, 1, 8000, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT, NULL);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+
+			for (i = 0; i < 50; i++) {
+				for (j = 0; j < 160; j++) {
+					buf[j] = (int16_t)(i * 160 + j);
+				}
+				len = 160;
+				switch_core_file_write(&fhw, buf, &len);
+			}
+
+			status = switch_core_file_close(&fhw);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+
+			switch_core_file_cache_set_limits(1024 * 1024, 0);
+
+			status = switch_core_file_open(&fh1, filename, 1, 8000, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			status = switch_core_file_open(&fh2, filename, 1, 8000, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+
+			status = switch_core_file_cache_stats(&entries, &bytes, &hits, &misses);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			fst_check(entries == 1);
+			fst_check(bytes == 50 * 160 * 2);
+			fst_check(hits == 1);
+			fst_check(misses == 1);
+
+			for (;;) {
+				len1 = len2 = 160;
+
+				if (switch_core_file_read(&fh1, buf1, &len1) != SWITCH_STATUS_SUCCESS) {
+					fst_check(switch_core_file_read(&fh2, buf2, &len2) != SWITCH_STATUS_SUCCESS);
+					break;
+				}
+
+				status = switch_core_file_read(&fh2, buf2, &len2);
+				fst_requires(status == SWITCH_STATUS_SUCCESS);
+				fst_requires(len1 == len2);
+				fst_check(!memcmp(buf1, buf2, len1 * 2));
+				fst_check(buf1[0] == (int16_t) total);
+				total += len1;
+			}
+
+			fst_check(total == 50 * 160);
+
+			status = switch_core_file_seek(&fh1, &pos, 320, SEEK_SET);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			fst_check(pos == 320);
+			len1 = 160;
+			status = switch_core_file_read(&fh1, buf1, &len1);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			fst_check(buf1[0] == 320);
+
+			switch_core_file_cache_flush();
+
+			status = switch_core_file_close(&fh1);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			status = switch_core_file_close(&fh2);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+
+			switch_core_file_cache_set_limits(0, 0);
+			unlink(filename);
+		}
+		FST_TEST_END()
+		FST_TEST_BEGIN(test_switch_core_file_async_io)
+		{
+			switch_status_t status = SWITCH_STATUS_FALSE;
+			switch_file_handle_t fhw = { 0 }, fhr = { 0 };
+			static char filename[] = "/tmp/fs_async_unit_test.wav";
+			int16_t buf[160];
+			switch_size_t len, total = 0;
+			int i, j, mismatch = 0, tries = 0;
+			uint32_t underruns;
+
+			status = switch_core_file_open(&fhw, filename, 1, 8000, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT | SWITCH_FILE_FLAG_ASYNC, NULL);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			fst_check(fhw.async_io != NULL);
+
+			for (i = 0; i < 100; i++) {
+				for (j = 0; j < 160; j++) {
+					buf[j] = (int16_t)(i * 160 + j);
+				}
+				len = 160;
+				status = switch_core_file_write(&fhw, buf, &len);
+				fst_check(status == SWITCH_STATUS_SUCCESS);
+			}
+
+			status = switch_core_file_close(&fhw);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+			fst_check(fhw.async_io == NULL);
+
+			status = switch_core_file_open(&fhr, filename, 1, 8000, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT | SWITCH_FILE_FLAG_ASYNC, NULL);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			fst_check(fhr.async_io != NULL);
+
+			while (tries++ < 10000) {
+				len = 160;
+				underruns = fhr.async_underruns;
+				status = switch_core_file_read(&fhr, buf, &len);
+
+				if (status == SWITCH_STATUS_SUCCESS && fhr.async_underruns != underruns) {
+					/* storage was behind and we got silence, the file itself did not move */
+					switch_yield(1000);
+					continue;
+				}
+
+				if (status != SWITCH_STATUS_SUCCESS) {
+					break;
+				}
+
+				for (j = 0; j < (int) len; j++) {
+					if (buf[j] != (int16_t)(total + j)) {
+						mismatch++;
+					}
+				}
+
+				total += len;
+			}
+
+			fst_check(total == 100 * 160);
+			fst_check(mismatch == 0);
+
+			status = switch_core_file_close(&fhr);
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+
+			unlink(filename);
+		}
+		FST_TEST_END()
 
 	}
 	FST_SUITE_END()
@@ -0,0 +1,489 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_curl_queue.c -- Tests for queued HTTP delivery against a local server
+ *
+ */
+
+#include <switch.h>
+#include <switch_curl.h>
+#include <test/switch_test.h>
+
+#define MAX_REQUESTS 64
+#define MAX_REQUEST_LEN 4096
+
+/**
+ * Local stand-in for a CDR web server, answers every POST with status
+ * (or 500 while fail is above zero) and keeps what it was sent.
+ */
+struct cdr_server {
+	switch_memory_pool_t *pool;
+	switch_thread_t *thread;
+	switch_socket_t *listener;
+	switch_port_t port;
+	volatile int running;
+	volatile int hold;
+	volatile int fail;
+	volatile int status;
+	volatile int requests;
+	char lines[MAX_REQUESTS][256];
+	char bodies[MAX_REQUESTS][MAX_REQUEST_LEN];
+};
+
+static struct cdr_server server = { 0 };
+
+static void read_request(switch_socket_t *sock, int index)
+{
+	char buf[MAX_REQUEST_LEN];
+	switch_size_t pos = 0;
+	char *body = NULL, *p;
+	int content_length = 0;
+
+	while (pos < sizeof(buf) - 1) {
+		switch_size_t len = sizeof(buf) - 1 - pos;
+
+		if (switch_socket_recv(sock, buf + pos, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			break;
+		}
+
+		pos += len;
+		buf[pos] = '\0';
+
+		if (!body && (body = strstr(buf, "\r\n\r\n"))) {
+			const char *cl;
+
+			body += 4;
+			if ((cl = switch_stristr("Content-Length:", buf))) {
+				content_length = atoi(cl + 15);
+			}
+		}
+
+		if (body && (buf + pos) - body >= content_length) {
+			break;
+		}
+	}
+
+	buf[pos] = '\0';
+
+	if ((p = strstr(buf, "\r\n"))) {
+		*p = '\0';
+	}
+
+	switch_copy_string(server.lines[index], buf, sizeof(server.lines[index]));
+	switch_copy_string(server.bodies[index], body ? body : "", sizeof(server.bodies[index]));
+}
+
+static void *SWITCH_THREAD_FUNC cdr_server_thread(switch_thread_t *thread, void *obj)
+{
+	switch_memory_pool_t *pool = NULL;
+
+	switch_core_new_memory_pool(&pool);
+
+	while (server.running) {
+		switch_socket_t *sock = NULL;
+		char response[128];
+		switch_size_t len;
+		int status = server.status;
+
+		if (switch_socket_accept(&sock, server.listener, pool) != SWITCH_STATUS_SUCCESS) {
+			continue;
+		}
+
+		switch_socket_timeout_set(sock, 1000000);
+
+		while (server.hold && server.running) {
+			switch_sleep(10000);
+		}
+
+		if (server.requests < MAX_REQUESTS) {
+			read_request(sock, server.requests);
+		}
+
+		if (server.fail > 0) {
+			server.fail--;
+			status = 500;
+		}
+
+		switch_snprintf(response, sizeof(response), "HTTP/1.1 %d Whatever\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+		len = strlen(response);
+		switch_socket_send(sock, response, &len);
+		switch_socket_close(sock);
+
+		server.requests++;
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return NULL;
+}
+
+static switch_status_t cdr_server_start(void)
+{
+	switch_memory_pool_t *pool;
+	switch_sockaddr_t *addr = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+
+	memset(&server, 0, sizeof(server));
+	server.status = 200;
+	switch_core_new_memory_pool(&server.pool);
+	pool = server.pool;
+
+	if (switch_sockaddr_info_get(&addr, "127.0.0.1", SWITCH_UNSPEC, 0, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&server.listener, switch_sockaddr_get_family(addr), SOCK_STREAM, SWITCH_PROTO_TCP, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_bind(server.listener, addr) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_listen(server.listener, 16) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_addr_get(&addr, SWITCH_FALSE, server.listener) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* wake up periodically to check if we're done */
+	switch_socket_timeout_set(server.listener, 100000);
+	server.port = switch_sockaddr_get_port(addr);
+	server.running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	return switch_thread_create(&server.thread, thd_attr, cdr_server_thread, NULL, pool);
+}
+
+static void cdr_server_stop(void)
+{
+	switch_status_t st;
+
+	if (server.thread) {
+		server.running = 0;
+		switch_thread_join(&st, server.thread);
+	}
+
+	if (server.listener) {
+		switch_socket_close(server.listener);
+	}
+
+	switch_core_destroy_memory_pool(&server.pool);
+}
+
+struct failed_items {
+	int count;
+	char last_id[64];
+};
+
+static void record_failed(const char *id, const char *data, switch_size_t len, void *user_data)
+{
+	struct failed_items *failed = (struct failed_items *) user_data;
+
+	failed->count++;
+	switch_copy_string(failed->last_id, id, sizeof(failed->last_id));
+}
+
+/**
+ * Wait for delivered + failed to reach count
+ */
+static switch_bool_t wait_done(switch_curl_queue_t *queue, uint64_t count, switch_curl_queue_stats_t *stats)
+{
+	switch_time_t deadline = switch_micro_time_now() + 5000000;
+
+	do {
+		switch_curl_queue_stats(queue, stats);
+		if (stats->delivered + stats->failed >= count) {
+			return SWITCH_TRUE;
+		}
+		switch_sleep(10000);
+	} while (switch_micro_time_now() < deadline);
+
+	return SWITCH_FALSE;
+}
+
+static int count_items(const char *body)
+{
+	int count = 1;
+
+	for (; *body; body++) {
+		if (*body == ',') {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+FST_MINCORE_BEGIN("./conf")
+{
+	FST_SUITE_BEGIN(switch_curl_queue)
+	{
+		const char *urls[2] = { 0 };
+		switch_curl_queue_settings_t settings;
+
+		FST_SETUP_BEGIN()
+		{
+			fst_requires(cdr_server_start() == SWITCH_STATUS_SUCCESS);
+
+			urls[0] = switch_core_sprintf(fst_pool, "http://127.0.0.1:%u/cdr", server.port);
+			memset(&settings, 0, sizeof(settings));
+			settings.name = "test";
+			settings.urls = urls;
+			settings.url_count = 1;
+			settings.id_param = "uuid";
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+			cdr_server_stop();
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(batch_items)
+		{
+			switch_curl_queue_t *queue = NULL;
+			switch_curl_queue_stats_t stats = { 0 };
+			int i, items = 0, full = 0;
+
+			settings.batch_prefix = "[";
+			settings.batch_separator = ",";
+			settings.batch_suffix = "]";
+			settings.batch_size = 3;
+
+			/* the first request waits on the server while the rest pile up */
+			server.hold = 1;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+
+			for (i = 0; i < 7; i++) {
+				char item[16];
+
+				switch_snprintf(item, sizeof(item), "{\"n\":%d}", i);
+				fst_check(switch_curl_queue_push(queue, "id", item, strlen(item)) == SWITCH_STATUS_SUCCESS);
+			}
+
+			server.hold = 0;
+			fst_check(wait_done(queue, 7, &stats));
+			fst_check_int_equals(stats.delivered, 7);
+			fst_check_int_equals(stats.depth, 0);
+			fst_check_int_equals(stats.max_depth, 7);
+
+			for (i = 0; i < server.requests; i++) {
+				int count = count_items(server.bodies[i]);
+
+				fst_check(server.bodies[i][0] == '[');
+				fst_check(end_of(server.bodies[i]) == ']');
+				fst_check(count <= 3);
+				items += count;
+				full += count == 3;
+			}
+
+			fst_check_int_equals(items, 7);
+			fst_check(full >= 1);
+			fst_check(server.requests < 7);
+
+			switch_curl_queue_destroy(&queue);
+			fst_check(queue == NULL);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(retry_on_next_url)
+		{
+			switch_curl_queue_t *queue = NULL;
+			switch_curl_queue_stats_t stats = { 0 };
+			struct failed_items failed = { 0 };
+
+			/* nothing listens on the first url */
+			urls[1] = urls[0];
+			urls[0] = "http://127.0.0.1:1/cdr";
+			settings.url_count = 2;
+			settings.attempts = 3;
+			settings.retry_delay_ms = 50;
+			settings.max_retry_delay_ms = 200;
+			settings.failed = record_failed;
+			settings.user_data = &failed;
+
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_curl_queue_push(queue, "one", "cdr=1", 5) == SWITCH_STATUS_SUCCESS);
+			fst_check(wait_done(queue, 1, &stats));
+
+			fst_check_int_equals(stats.delivered, 1);
+			fst_check_int_equals(stats.retries, 1);
+			fst_check_int_equals(failed.count, 0);
+			fst_check_int_equals(server.requests, 1);
+			fst_check_string_equals(server.lines[0], "POST /cdr?uuid=one HTTP/1.1");
+			fst_check_string_equals(server.bodies[0], "cdr=1");
+
+			/* the server refuses until the attempts run out */
+			server.fail = 3;
+			fst_check(switch_curl_queue_push(queue, "two", "cdr=2", 5) == SWITCH_STATUS_SUCCESS);
+			fst_check(wait_done(queue, 2, &stats));
+
+			fst_check_int_equals(stats.failed, 1);
+			fst_check_int_equals(failed.count, 1);
+			fst_check_string_equals(failed.last_id, "two");
+
+			switch_curl_queue_destroy(&queue);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(spool_survives_restart)
+		{
+			switch_curl_queue_t *queue = NULL;
+			switch_curl_queue_stats_t stats = { 0 };
+			struct failed_items failed = { 0 };
+			char *spool_dir = switch_core_sprintf(fst_pool, "%s%scurl_queue_test_%d", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, (int) getpid());
+			switch_time_t deadline;
+
+			settings.spool_dir = spool_dir;
+			settings.attempts = 100;
+			settings.retry_delay_ms = 60000;
+			settings.max_retry_delay_ms = 60000;
+			settings.failed = record_failed;
+			settings.user_data = &failed;
+
+			server.status = 503;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_curl_queue_push(queue, "a", "cdr=a", 5) == SWITCH_STATUS_SUCCESS);
+
+			deadline = switch_micro_time_now() + 5000000;
+			do {
+				switch_sleep(10000);
+				switch_curl_queue_stats(queue, &stats);
+			} while (!stats.retries && switch_micro_time_now() < deadline);
+
+			fst_check_int_equals(stats.retries, 1);
+			switch_curl_queue_destroy(&queue);
+
+			/* still on disk, not handed back */
+			fst_check_int_equals(failed.count, 0);
+
+			server.status = 200;
+			server.requests = 0;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+			fst_check(wait_done(queue, 1, &stats));
+
+			fst_check_int_equals(stats.delivered, 1);
+			fst_check_int_equals(server.requests, 1);
+			fst_check_string_equals(server.lines[0], "POST /cdr?uuid=a HTTP/1.1");
+			fst_check_string_equals(server.bodies[0], "cdr=a");
+
+			switch_curl_queue_destroy(&queue);
+			/* delivered items are taken off the spool */
+			fst_check(rmdir(spool_dir) == 0);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(named_item_keeps_its_name)
+		{
+			switch_curl_queue_t *queue = NULL;
+			switch_curl_queue_stats_t stats = { 0 };
+			struct failed_items failed = { 0 };
+			char *spool_dir = switch_core_sprintf(fst_pool, "%s%scurl_queue_named_%d", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, (int) getpid());
+			switch_time_t deadline;
+
+			settings.spool_dir = spool_dir;
+			settings.attempts = 100;
+			settings.retry_delay_ms = 60000;
+			settings.max_retry_delay_ms = 60000;
+			settings.failed = record_failed;
+			settings.user_data = &failed;
+
+			server.status = 503;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_curl_queue_push_named(queue, "b", "a_b", "cdr=b", 5) == SWITCH_STATUS_SUCCESS);
+
+			deadline = switch_micro_time_now() + 5000000;
+			do {
+				switch_sleep(10000);
+				switch_curl_queue_stats(queue, &stats);
+			} while (!stats.retries && switch_micro_time_now() < deadline);
+
+			fst_check_int_equals(stats.retries, 1);
+			fst_check_string_equals(server.lines[0], "POST /cdr?uuid=b HTTP/1.1");
+			switch_curl_queue_destroy(&queue);
+
+			/* the name comes back from the spool along with the id */
+			server.requests = 0;
+			settings.attempts = 1;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+			fst_check(wait_done(queue, 1, &stats));
+
+			fst_check_int_equals(stats.failed, 1);
+			fst_check_int_equals(server.requests, 1);
+			fst_check_string_equals(server.lines[0], "POST /cdr?uuid=b HTTP/1.1");
+			fst_check_int_equals(failed.count, 1);
+			fst_check_string_equals(failed.last_id, "a_b");
+
+			switch_curl_queue_destroy(&queue);
+			/* failed items are taken off the spool too */
+			fst_check(rmdir(spool_dir) == 0);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(reject_when_full)
+		{
+			switch_curl_queue_t *queue = NULL;
+			switch_curl_queue_stats_t stats = { 0 };
+			switch_time_t start, elapsed;
+
+			settings.capacity = 2;
+
+			server.hold = 1;
+			fst_requires(switch_curl_queue_create(&queue, &settings) == SWITCH_STATUS_SUCCESS);
+
+			start = switch_micro_time_now();
+			fst_check(switch_curl_queue_push(queue, "1", "cdr=1", 5) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_curl_queue_push(queue, "2", "cdr=2", 5) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_curl_queue_push(queue, "3", "cdr=3", 5) != SWITCH_STATUS_SUCCESS);
+			elapsed = switch_micro_time_now() - start;
+
+			/* pushing never waits on the server */
+			fst_check(elapsed < 100000);
+
+			switch_curl_queue_stats(queue, &stats);
+			fst_check_int_equals(stats.depth, 2);
+			fst_check_int_equals(stats.rejected, 1);
+
+			server.hold = 0;
+			fst_check(wait_done(queue, 2, &stats));
+			fst_check_int_equals(stats.delivered, 2);
+
+			/* room again */
+			fst_check(switch_curl_queue_push(queue, "4", "cdr=4", 5) == SWITCH_STATUS_SUCCESS);
+			fst_check(wait_done(queue, 3, &stats));
+
+			switch_curl_queue_destroy(&queue);
+		}
+		FST_TEST_END()
+	}
+	FST_SUITE_END()
+}
+FST_MINCORE_END()
+
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -161,6 +161,102 @@ FST_TEST_BEGIN(expand_headers_offset)
 }
 FST_TEST_END()
 
+FST_TEST_BEGIN(json_channel_event)
+{
+  /* Round trips a CHANNEL_* sized event through the JSON serializer and the
+   * read-only parser, which must agree with the regular cJSON parser. */
+  switch_event_t *event = NULL, *clone = NULL;
+  switch_event_header_t *hp;
+  char *json = NULL, *heap_text = NULL, *ro_text = NULL;
+  cJSON *heap = NULL, *ro = NULL;
+  int x = 0;
+#ifdef BENCHMARK
+  int loops = 10000;
+  switch_time_t small_start_ts, small_end_ts;
+#endif
+
+  switch_event_create(&event, SWITCH_EVENT_CHANNEL_CREATE);
+  fst_requires(event);
+
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Channel-Name", "sofia/internal/1000@192.168.0.10:5060");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", "7f4de4bc-1a8e-11ef-9c54-5b4d2e3f0a61");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Caller-Caller-ID-Name", "Extension \"1000\"");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_switch_r_sdp", "v=0\r\no=- 1 1 IN IP4 192.168.0.10\r\ns=-\r\nc=IN IP4 192.168.0.10\r\nt=0 0\r\nm=audio 16384 RTP/AVP 0 8 101\r\n");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_sip_path", "C:\\path\ttab");
+  for (x = 0; x < 100; x++) {
+    switch_event_add_header(event, SWITCH_STACK_BOTTOM, switch_core_sprintf(fst_pool, "variable_header_%d", x), "<sip:1000@192.168.0.10:5060;transport=udp>;tag=%d", x);
+  }
+  switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_array", "one");
+  switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_array", "two");
+  switch_event_add_body(event, "%s", "body with \"quotes\"\n");
+
+  switch_event_serialize_json(event, &json);
+  fst_requires(json);
+
+  heap = cJSON_Parse(json);
+  ro = cJSON_ParseReadOnly(json);
+  fst_requires(heap);
+  fst_requires(ro);
+  heap_text = cJSON_PrintUnformatted(heap);
+  ro_text = cJSON_PrintUnformatted(ro);
+  fst_check_string_equals(ro_text, heap_text);
+  fst_check_string_equals(ro_text, json);
+
+  fst_xcheck(switch_event_create_json(&clone, json) == SWITCH_STATUS_SUCCESS, "Failed to parse event json");
+  fst_requires(clone);
+  fst_check(clone->event_id == SWITCH_EVENT_CHANNEL_CREATE);
+  fst_check_string_equals(clone->body, event->body);
+  for (hp = event->headers; hp; hp = hp->next) {
+    switch_event_header_t *chp = switch_event_get_header_ptr(clone, hp->name);
+
+    fst_requires(chp);
+    fst_check_string_equals(chp->value, hp->value);
+    fst_check(chp->idx == hp->idx);
+  }
+
+#ifdef BENCHMARK
+  small_start_ts = switch_time_now();
+  for (x = 0; x < loops; x++) {
+    cJSON_Delete(cJSON_Parse(json));
+  }
+  small_end_ts = switch_time_now();
+  printf("cJSON_Parse: %.2f us per event\n", (small_end_ts - small_start_ts) / (double) loops);
+
+  small_start_ts = switch_time_now();
+  for (x = 0; x < loops; x++) {
+    cJSON_Delete(cJSON_ParseReadOnly(json));
+  }
+  small_end_ts = switch_time_now();
+  printf("cJSON_ParseReadOnly: %.2f us per event\n", (small_end_ts - small_start_ts) / (double) loops);
+
+  small_start_ts = switch_time_now();
+  for (x = 0; x < loops; x++) {
+    free(cJSON_PrintUnformatted(heap));
+  }
+  small_end_ts = switch_time_now();
+  printf("cJSON_PrintUnformatted: %.2f us per event\n", (small_end_ts - small_start_ts) / (double) loops);
+
+  small_start_ts = switch_time_now();
+  for (x = 0; x < loops; x++) {
+    switch_event_t *tmp = NULL;
+
+    switch_event_create_json(&tmp, json);
+    switch_event_destroy(&tmp);
+  }
+  small_end_ts = switch_time_now();
+  printf("switch_event_create_json: %.2f us per event\n", (small_end_ts - small_start_ts) / (double) loops);
+#endif
+
+  cJSON_Delete(heap);
+  cJSON_Delete(ro);
+  switch_safe_free(heap_text);
+  switch_safe_free(ro_text);
+  switch_safe_free(json);
+  switch_event_destroy(&clone);
+  switch_event_destroy(&event);
+}
+FST_TEST_END()
+
 FST_SUITE_END()
 
 FST_MINCORE_END()
@@ -62,6 +62,32 @@ static switch_status_t partial_play_and_collect_input_callback(switch_core_sessi
 	return status;
 }
 
+typedef struct {
+	int frames;
+	int other_thread;
+	int delay_ms;
+	switch_thread_id_t media_thread;
+} fanout_tap_t;
+
+static switch_bool_t fanout_tap_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
+{
+	fanout_tap_t *tap = (fanout_tap_t *) user_data;
+
+	if (type == SWITCH_ABC_TYPE_WRITE) {
+		tap->frames++;
+
+		if (switch_thread_self() != tap->media_thread) {
+			tap->other_thread++;
+		}
+
+		if (tap->delay_ms) {
+			switch_yield(tap->delay_ms * 1000);
+		}
+	}
+
+	return SWITCH_TRUE;
+}
+
 FST_CORE_BEGIN("./conf_async")
 {
 	FST_SUITE_BEGIN(switch_ivr_play_async)
@@ -195,6 +221,47 @@ FST_CORE_BEGIN("./conf_async")
 			unlink(record_filename);
 		}
 		FST_SESSION_END()
+
+		FST_SESSION_BEGIN(session_media_bug_fanout)
+		{
+			fanout_tap_t inline_tap = { 0 }, fanout_tap = { 0 }, slow_tap = { 0 };
+			switch_media_bug_t *inline_bug = NULL, *fanout_bug = NULL, *slow_bug = NULL;
+			switch_time_t start, elapsed;
+			switch_status_t status;
+
+			inline_tap.media_thread = fanout_tap.media_thread = slow_tap.media_thread = switch_thread_self();
+			slow_tap.delay_ms = 100;
+
+			status = switch_core_media_bug_add(fst_session, "inline_tap", NULL, fanout_tap_callback, &inline_tap, 0, SMBF_WRITE_STREAM, &inline_bug);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			status = switch_core_media_bug_add(fst_session, "fanout_tap", NULL, fanout_tap_callback, &fanout_tap, 0, SMBF_WRITE_STREAM | SMBF_FANOUT, &fanout_bug);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+			status = switch_core_media_bug_add(fst_session, "slow_tap", NULL, fanout_tap_callback, &slow_tap, 0, SMBF_WRITE_STREAM | SMBF_FANOUT, &slow_bug);
+			fst_requires(status == SWITCH_STATUS_SUCCESS);
+
+			start = switch_time_now();
+			status = switch_ivr_play_file(fst_session, NULL, "silence_stream://3000,0", NULL);
+			elapsed = switch_time_now() - start;
+			fst_check(status == SWITCH_STATUS_SUCCESS);
+
+			/* a tap that sleeps 100ms a frame must not hold up the call */
+			fst_xcheck(elapsed < 3500000, "Expect the slow tap not to slow down playback");
+
+			slow_tap.delay_ms = 0;
+			fst_check(switch_core_media_bug_get_overruns(slow_bug) > 0);
+			fst_check_int_equals(switch_core_media_bug_get_overruns(fanout_bug), 0);
+
+			switch_core_media_bug_remove(fst_session, &slow_bug);
+			switch_core_media_bug_remove(fst_session, &fanout_bug);
+			switch_core_media_bug_remove(fst_session, &inline_bug);
+
+			fst_check(inline_tap.frames > 100);
+			fst_check_int_equals(inline_tap.other_thread, 0);
+			fst_check_int_equals(fanout_tap.frames, inline_tap.frames);
+			fst_check_int_equals(fanout_tap.other_thread, fanout_tap.frames);
+			fst_check(slow_tap.frames < inline_tap.frames);
+		}
+		FST_SESSION_END()
 	}
 	FST_SUITE_END()
 }
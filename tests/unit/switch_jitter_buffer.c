@@ -0,0 +1,338 @@
+/*
+* FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+* Copyright (C) 2005-2026, Anthony Minessale II <anthm@freeswitch.org>
+*
+* Version: MPL 1.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+*
+* The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+*
+* The Initial Developer of the Original Code is
+* Anthony Minessale II <anthm@freeswitch.org>
+* Portions created by the Initial Developer are Copyright (C)
+* the Initial Developer. All Rights Reserved.
+*
+* Contributor(s):
+*
+* switch_jitter_buffer.c -- tests the jitter buffer by replaying RTP from a pcap
+*/
+
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+#include <pcap.h>
+
+// #define BENCHMARK 1
+
+#define MAX_PCAP_PACKETS 1024
+
+/* IP header, see switch_rtp_pcap.c */
+struct sniff_ip {
+	u_char ip_vhl;
+	u_char ip_tos;
+	u_short ip_len;
+	u_short ip_id;
+	u_short ip_off;
+	u_char ip_ttl;
+	u_char ip_p;
+	u_short ip_sum;
+	struct in_addr ip_src,ip_dst;
+};
+
+#define IP_HL(ip)		(((ip)->ip_vhl) & 0x0f)
+
+struct rtp_capture {
+	switch_rtp_packet_t packets[MAX_PCAP_PACKETS];
+	switch_size_t lens[MAX_PCAP_PACKETS];
+	int count;
+};
+
+static struct rtp_capture capture;
+
+static int load_pcap(const char *file, struct rtp_capture *cap)
+{
+	pcap_t *pcap;
+	const unsigned char *packet;
+	char errbuf[PCAP_ERRBUF_SIZE];
+	struct pcap_pkthdr pcap_header;
+
+	cap->count = 0;
+
+	if (!(pcap = pcap_open_offline(file, errbuf))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't open %s: %s\n", file, errbuf);
+		return 0;
+	}
+
+	while ((packet = pcap_next(pcap, &pcap_header)) && cap->count < MAX_PCAP_PACKETS) {
+		const struct sniff_ip *ip = (struct sniff_ip *)(packet + 14);
+		int jump_over = 14 /*SIZE_ETHERNET*/ + IP_HL(ip) * 4 + 8 /* UDP HDR SIZE */;
+		size_t len = pcap_header.caplen;
+
+		if (len <= jump_over + SWITCH_RTP_HEADER_LEN || len - jump_over > SWITCH_RTP_MAX_PACKET_LEN) {
+			continue;
+		}
+
+		memcpy(&cap->packets[cap->count], packet + jump_over, len - jump_over);
+		cap->lens[cap->count] = len - jump_over;
+		cap->count++;
+	}
+
+	pcap_close(pcap);
+
+	return cap->count;
+}
+
+/* put the capture in the order given, reading once per packet put once we are past prebuffer.
+ * Returns how many frames are left buffered at the end. */
+static int replay(switch_jb_t *jb, int *order, int count, int prebuffer, int *got, int *missing, int *out_of_order, int *corrupt)
+{
+	uint16_t last_seq = 0;
+	int i, x;
+
+	*got = *missing = *out_of_order = *corrupt = 0;
+
+	for (i = 0; i < count + prebuffer; i++) {
+		switch_rtp_packet_t packet;
+		switch_size_t len = sizeof(packet);
+		switch_status_t status;
+
+		if (i < count && order[i] >= 0) {
+			switch_jb_put_packet(jb, &capture.packets[order[i]], capture.lens[order[i]]);
+		}
+
+		if (i < prebuffer) {
+			continue;
+		}
+
+		status = switch_jb_get_packet(jb, &packet, &len);
+
+		if (status == SWITCH_STATUS_NOTFOUND) {
+			(*missing)++;
+			continue;
+		}
+
+		if (status != SWITCH_STATUS_SUCCESS && status != SWITCH_STATUS_TIMEOUT) {
+			continue;
+		}
+
+		if (*got && (int16_t)(ntohs(packet.header.seq) - last_seq) <= 0) {
+			(*out_of_order)++;
+		}
+
+		last_seq = ntohs(packet.header.seq);
+		(*got)++;
+
+		/* what comes out is exactly what went in, the capture's seqs are consecutive */
+		x = (uint16_t)(ntohs(packet.header.seq) - ntohs(capture.packets[0].header.seq));
+		if (x >= capture.count || len != capture.lens[x] || memcmp(packet.body, capture.packets[x].body, len - SWITCH_RTP_HEADER_LEN)) {
+			(*corrupt)++;
+		}
+	}
+
+	return switch_jb_frame_count(jb);
+}
+
+FST_CORE_BEGIN("./conf")
+{
+FST_SUITE_BEGIN(switch_jitter_buffer)
+{
+FST_SETUP_BEGIN()
+{
+	fst_requires(load_pcap("pcap/milliwatt.long.pcmu.rtp.pcap", &capture) > 100);
+}
+FST_SETUP_END()
+
+FST_TEARDOWN_BEGIN()
+{
+}
+FST_TEARDOWN_END()
+
+	FST_TEST_BEGIN(test_jb_in_order)
+	{
+		switch_jb_t *jb = NULL;
+		int *order = switch_core_alloc(fst_pool, sizeof(int) * capture.count);
+		int i, got, missing, out_of_order, corrupt, buffered;
+
+		for (i = 0; i < capture.count; i++) {
+			order[i] = i;
+		}
+
+		fst_requires(switch_jb_create(&jb, SJB_AUDIO, 3, 10, fst_pool) == SWITCH_STATUS_SUCCESS);
+		buffered = replay(jb, order, capture.count, 3, &got, &missing, &out_of_order, &corrupt);
+		switch_jb_destroy(&jb);
+
+		fst_check_int_equals(got + buffered, capture.count);
+		fst_check_int_equals(missing, 0);
+		fst_check_int_equals(out_of_order, 0);
+		fst_check_int_equals(corrupt, 0);
+	}
+	FST_TEST_END()
+
+	FST_TEST_BEGIN(test_jb_reorder_and_loss)
+	{
+		switch_jb_t *jb = NULL;
+		int *order = switch_core_alloc(fst_pool, sizeof(int) * capture.count);
+		int i, lost = 0, got, missing, out_of_order, corrupt, buffered;
+
+		/* swap every pair and lose every 37th packet */
+		for (i = 0; i < capture.count; i++) {
+			order[i] = (i % 2) ? i - 1 : (i + 1 < capture.count ? i + 1 : i);
+		}
+
+		for (i = 0; i < capture.count; i++) {
+			if (order[i] % 37 == 5) {
+				order[i] = -1;
+				lost++;
+			}
+		}
+
+		fst_requires(switch_jb_create(&jb, SJB_AUDIO, 3, 10, fst_pool) == SWITCH_STATUS_SUCCESS);
+		buffered = replay(jb, order, capture.count, 3, &got, &missing, &out_of_order, &corrupt);
+		switch_jb_destroy(&jb);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "jb reorder: %d packets, %d lost, %d read, %d plc\n", capture.count, lost, got, missing);
+
+		fst_check_int_equals(out_of_order, 0);
+		fst_check_int_equals(corrupt, 0);
+		fst_check_int_equals(got + buffered, capture.count - lost);
+		fst_check(missing >= lost);
+	}
+	FST_TEST_END()
+
+	FST_TEST_BEGIN(test_jb_seq_wrap)
+	{
+		switch_jb_t *jb = NULL;
+		int *order = switch_core_alloc(fst_pool, sizeof(int) * capture.count);
+		int i, got, missing, out_of_order, corrupt, buffered;
+
+		/* make the capture run through seq 65535 */
+		for (i = 0; i < capture.count; i++) {
+			capture.packets[i].header.seq = htons((uint16_t)(65535 - 100 + i));
+			order[i] = (i % 2) ? i - 1 : (i + 1 < capture.count ? i + 1 : i);
+		}
+
+		fst_requires(switch_jb_create(&jb, SJB_AUDIO, 3, 10, fst_pool) == SWITCH_STATUS_SUCCESS);
+		buffered = replay(jb, order, capture.count, 3, &got, &missing, &out_of_order, &corrupt);
+		switch_jb_destroy(&jb);
+
+		fst_check_int_equals(got + buffered, capture.count);
+		fst_check_int_equals(out_of_order, 0);
+		fst_check_int_equals(corrupt, 0);
+	}
+	FST_TEST_END()
+
+	FST_TEST_BEGIN(test_jb_ts_collision)
+	{
+		switch_jb_t *jb = NULL;
+		switch_frame_t frame = { 0 };
+
+		fst_requires(switch_jb_create(&jb, SJB_AUDIO, 3, 10, fst_pool) == SWITCH_STATUS_SUCCESS);
+		switch_jb_ts_mode(jb, 160, 8000);
+
+		/* consecutive seqs whose ts are far enough apart to share a ts slot */
+		capture.packets[0].header.seq = htons(10);
+		capture.packets[0].header.ts = htonl(160 * 10);
+		capture.packets[1].header.seq = htons(11);
+		capture.packets[1].header.ts = htonl(160 * (10 + 32768));
+		switch_jb_put_packet(jb, &capture.packets[0], capture.lens[0]);
+		switch_jb_put_packet(jb, &capture.packets[1], capture.lens[1]);
+
+		fst_check(switch_jb_peek_frame(jb, 160 * 10, 0, 0, &frame) == SWITCH_STATUS_SUCCESS);
+		fst_check_int_equals(frame.seq, 10);
+		fst_check(switch_jb_peek_frame(jb, 160 * (10 + 32768), 0, 0, &frame) == SWITCH_STATUS_SUCCESS);
+		fst_check_int_equals(frame.seq, 11);
+		fst_check(switch_jb_peek_frame(jb, 160 * 11, 0, 0, &frame) != SWITCH_STATUS_SUCCESS);
+
+		switch_jb_destroy(&jb);
+	}
+	FST_TEST_END()
+
+	FST_TEST_BEGIN(test_jb_video_nack)
+	{
+		switch_jb_t *jb = NULL;
+		switch_rtp_packet_t packet;
+		switch_size_t len = sizeof(packet);
+		uint32_t nack;
+		int i;
+
+		fst_requires(switch_jb_create(&jb, SJB_VIDEO, 1, 50, fst_pool) == SWITCH_STATUS_SUCCESS);
+
+		/* two packets per frame, the second one marked */
+		for (i = 0; i < 20; i++) {
+			capture.packets[i].header.seq = htons(100 + i);
+			capture.packets[i].header.ts = htonl(9000 + (i / 2) * 3000);
+			capture.packets[i].header.m = i % 2;
+			switch_jb_put_packet(jb, &capture.packets[i], capture.lens[i]);
+		}
+
+		fst_check(switch_jb_get_packet(jb, &packet, &len) == SWITCH_STATUS_SUCCESS);
+
+		/* 120, 121 and 123 never show up */
+		capture.packets[22].header.seq = htons(122);
+		capture.packets[22].header.ts = htonl(9000 + 11 * 3000);
+		switch_jb_put_packet(jb, &capture.packets[22], capture.lens[22]);
+		capture.packets[24].header.seq = htons(124);
+		capture.packets[24].header.ts = htonl(9000 + 12 * 3000);
+		switch_jb_put_packet(jb, &capture.packets[24], capture.lens[24]);
+
+		nack = switch_jb_pop_nack(jb);
+		fst_check_int_equals(ntohs(nack & 0xffff), 120);
+		fst_check_int_equals(ntohs(nack >> 16), (1 << 0) | (1 << 2));
+
+		/* nothing new to ask for until it is time to ask again */
+		fst_check_int_equals(switch_jb_pop_nack(jb), 0);
+
+		len = sizeof(packet);
+		fst_check(switch_jb_get_packet_by_seq(jb, htons(122), &packet, &len) == SWITCH_STATUS_SUCCESS);
+		fst_check_int_equals(ntohs(packet.header.seq), 122);
+		fst_check(switch_jb_get_packet_by_seq(jb, htons(121), &packet, &len) == SWITCH_STATUS_NOTFOUND);
+
+		switch_jb_destroy(&jb);
+	}
+	FST_TEST_END()
+
+#ifdef BENCHMARK
+	FST_TEST_BEGIN(test_jb_replay_speed)
+	{
+		switch_jb_t *jb = NULL;
+		int *order = switch_core_alloc(fst_pool, sizeof(int) * capture.count);
+		int i, x, got, missing, out_of_order, corrupt, loops = 200;
+		switch_time_t start, elapsed;
+
+		for (i = 0; i < capture.count; i++) {
+			order[i] = (i % 2) ? i - 1 : (i + 1 < capture.count ? i + 1 : i);
+		}
+
+		start = switch_time_now();
+
+		for (x = 0; x < loops; x++) {
+			for (i = 0; i < capture.count; i++) {
+				capture.packets[i].header.seq = htons((uint16_t)(x * capture.count + i));
+			}
+
+			fst_requires(switch_jb_create(&jb, SJB_AUDIO, 3, 10, fst_pool) == SWITCH_STATUS_SUCCESS);
+			replay(jb, order, capture.count, 3, &got, &missing, &out_of_order, &corrupt);
+			switch_jb_destroy(&jb);
+			fst_check_int_equals(out_of_order, 0);
+		}
+
+		elapsed = switch_time_now() - start;
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "jb replay: %d packets in %" SWITCH_TIME_T_FMT " ms\n", loops * capture.count, elapsed / 1000);
+	}
+	FST_TEST_END()
+#endif
+}
+FST_SUITE_END()
+}
+FST_CORE_END()
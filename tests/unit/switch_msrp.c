@@ -0,0 +1,204 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_msrp.c -- Tests for the MSRP listener
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+#define MSRP_TEST_HOST "127.0.0.1"
+#define MSRP_TEST_PORT 22855
+
+#define MSRP_TEST_SEND(tid) \
+	"MSRP " tid " SEND\r\n" \
+	"To-Path: msrp://127.0.0.1:22855/nosuchsession;tcp\r\n" \
+	"From-Path: msrp://127.0.0.1:40000/peer;tcp\r\n" \
+	"Message-ID: " tid "\r\n" \
+	"Byte-Range: 1-5/5\r\n" \
+	"Content-Type: text/plain\r\n" \
+	"\r\n" \
+	"hello\r\n" \
+	"-------" tid "$\r\n"
+
+static switch_status_t msrp_connect(switch_socket_t **sock_out, switch_memory_pool_t *pool)
+{
+	switch_sockaddr_t *addr = NULL;
+	switch_socket_t *sock = NULL;
+	int attempts;
+
+	if (switch_sockaddr_info_get(&addr, MSRP_TEST_HOST, SWITCH_UNSPEC, MSRP_TEST_PORT, 0, pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (attempts = 0; attempts < 50; attempts++) {
+		if (switch_socket_create(&sock, switch_sockaddr_get_family(addr), SOCK_STREAM, SWITCH_PROTO_TCP, pool) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+		switch_socket_opt_set(sock, SWITCH_SO_TCP_NODELAY, 1);
+
+		if (switch_socket_connect(sock, addr) == SWITCH_STATUS_SUCCESS) {
+			switch_socket_timeout_set(sock, 5000000);
+			*sock_out = sock;
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		switch_socket_close(sock);
+		sock = NULL;
+		switch_yield(100000);
+	}
+
+	return SWITCH_STATUS_FALSE;
+}
+
+static switch_status_t send_all(switch_socket_t *sock, const char *buf, switch_size_t len)
+{
+	while (len > 0) {
+		switch_size_t n = len;
+
+		if (switch_socket_send(sock, buf, &n) != SWITCH_STATUS_SUCCESS || n == 0) {
+			return SWITCH_STATUS_FALSE;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* reads until the end-line has been seen */
+static switch_size_t recv_until(switch_socket_t *sock, char *out, switch_size_t cap, const char *end)
+{
+	switch_size_t got = 0;
+
+	do {
+		switch_size_t want = cap - 1 - got;
+
+		if (switch_socket_recv(sock, out + got, &want) != SWITCH_STATUS_SUCCESS || want == 0) {
+			break;
+		}
+		got += want;
+		out[got] = '\0';
+	} while (!strstr(out, end) && got < cap - 1);
+
+	out[got] = '\0';
+	return got;
+}
+
+FST_CORE_DB_BEGIN("./conf_msrp")
+{
+	FST_SUITE_BEGIN(switch_msrp)
+	{
+		FST_SETUP_BEGIN()
+		{
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(send_split_mid_header)
+		{
+			switch_memory_pool_t *pool = NULL;
+			switch_socket_t *sock = NULL;
+			const char *req = MSRP_TEST_SEND("a1b2c3d4");
+			char resp[2048] = { 0 };
+			switch_size_t split = 30;
+
+			do {
+				if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not allocate memory pool");
+					break;
+				}
+				if (msrp_connect(&sock, pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not connect to msrp listener");
+					break;
+				}
+
+				/* the first read ends inside the To-Path header */
+				if (send_all(sock, req, split) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not send first half");
+					break;
+				}
+				switch_yield(200000);
+				if (send_all(sock, req + split, strlen(req) - split) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not send second half");
+					break;
+				}
+
+				recv_until(sock, resp, sizeof(resp), "-------a1b2c3d4$");
+				fst_check_string_starts_with(resp, "MSRP a1b2c3d4 200 OK");
+			} while (0);
+
+			if (sock) switch_socket_close(sock);
+			if (pool) switch_core_destroy_memory_pool(&pool);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(send_split_mid_body)
+		{
+			switch_memory_pool_t *pool = NULL;
+			switch_socket_t *sock = NULL;
+			const char *req = MSRP_TEST_SEND("e5f6a7b8");
+			char resp[2048] = { 0 };
+			switch_size_t split = strstr(req, "hello") - req + 2;
+
+			do {
+				if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not allocate memory pool");
+					break;
+				}
+				if (msrp_connect(&sock, pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not connect to msrp listener");
+					break;
+				}
+
+				/* headers complete, the body arrives in two reads */
+				if (send_all(sock, req, split) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not send first half");
+					break;
+				}
+				switch_yield(200000);
+				if (send_all(sock, req + split, strlen(req) - split) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not send second half");
+					break;
+				}
+
+				recv_until(sock, resp, sizeof(resp), "-------e5f6a7b8$");
+				fst_check_string_starts_with(resp, "MSRP e5f6a7b8 200 OK");
+			} while (0);
+
+			if (sock) switch_socket_close(sock);
+			if (pool) switch_core_destroy_memory_pool(&pool);
+		}
+		FST_TEST_END()
+	}
+	FST_SUITE_END()
+}
+FST_CORE_END()
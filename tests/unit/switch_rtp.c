@@ -17,6 +17,8 @@
 #define MSG_CONFIRM 0
 #endif
 
+// #define BENCHMARK 1
+
 static const char *rx_host = "127.0.0.1";
 static switch_port_t rx_port = 1234;
 static const char *tx_host = "127.0.0.1";
@@ -529,6 +531,144 @@ FST_TEARDOWN_END()
 	}
 	FST_TEST_END()
 
+	FST_TEST_BEGIN(test_webrtc_offer_answer)
+	{
+		switch_core_session_t *session = NULL;
+		switch_channel_t *channel = NULL;
+		switch_status_t status;
+		switch_call_cause_t cause;
+		switch_media_handle_t *media_handle;
+		switch_core_media_params_t *mparams;
+		const char *r_sdp =
+			"v=0\r\n"
+			"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+			"s=-\r\n"
+			"t=0 0\r\n"
+			"a=group:BUNDLE 0 1 2\r\n"
+			"a=msid-semantic: WMS stream0\r\n"
+			"m=audio 9 UDP/TLS/RTP/SAVPF 111 0 126\r\n"
+			"c=IN IP4 0.0.0.0\r\n"
+			"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+			"a=candidate:1467250027 1 udp 2122260223 127.0.0.1 46243 typ host generation 0\r\n"
+			"a=candidate:435653019 1 tcp 1845501695 127.0.0.1 9 typ host tcptype active generation 0\r\n"
+			"a=ice-ufrag:Oyef7uvBlwafI3hT\r\n"
+			"a=ice-pwd:T0teqPLNQQOf+5W+ls+P2p16\r\n"
+			"a=fingerprint:sha-256 49:66:12:17:0D:1C:91:AE:57:4C:C6:36:DD:D5:97:D2:7D:62:C9:9A:7F:B9:A3:F4:70:03:E7:43:91:73:23:5E\r\n"
+			"a=setup:actpass\r\n"
+			"a=mid:0\r\n"
+			"a=sendrecv\r\n"
+			"a=rtcp-mux\r\n"
+			"a=rtpmap:111 opus/48000/2\r\n"
+			"a=rtcp-fb:111 transport-cc\r\n"
+			"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+			"a=rtpmap:0 PCMU/8000\r\n"
+			"a=rtpmap:126 telephone-event/8000\r\n"
+			"a=ssrc:3570614608 cname:4TOk42mSjXCkVIa6\r\n"
+			"a=ssrc:3570614608 msid:stream0 audio0\r\n"
+			"m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\n"
+			"c=IN IP4 0.0.0.0\r\n"
+			"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+			"a=candidate:1467250027 1 udp 2122260223 127.0.0.1 46245 typ host generation 0\r\n"
+			"a=ice-ufrag:Oyef7uvBlwafI3hT\r\n"
+			"a=ice-pwd:T0teqPLNQQOf+5W+ls+P2p16\r\n"
+			"a=fingerprint:sha-256 49:66:12:17:0D:1C:91:AE:57:4C:C6:36:DD:D5:97:D2:7D:62:C9:9A:7F:B9:A3:F4:70:03:E7:43:91:73:23:5E\r\n"
+			"a=setup:actpass\r\n"
+			"a=mid:1\r\n"
+			"a=sendrecv\r\n"
+			"a=rtcp-mux\r\n"
+			"a=rtcp-rsize\r\n"
+			"a=rtpmap:96 VP8/90000\r\n"
+			"a=rtcp-fb:96 ccm fir\r\n"
+			"a=rtcp-fb:96 nack\r\n"
+			"a=rtcp-fb:96 nack pli\r\n"
+			"a=rtpmap:97 rtx/90000\r\n"
+			"a=fmtp:97 apt=96\r\n"
+			"a=ssrc:2231627014 cname:4TOk42mSjXCkVIa6\r\n"
+			"a=ssrc:2231627014 msid:stream0 video0\r\n"
+			"m=application 9 UDP/DTLS/SCTP webrtc-datachannel\r\n"
+			"c=IN IP4 0.0.0.0\r\n"
+			"a=candidate:1467250027 1 udp 2122260223 127.0.0.1 46247 typ host generation 0\r\n"
+			"a=ice-ufrag:Oyef7uvBlwafI3hT\r\n"
+			"a=ice-pwd:T0teqPLNQQOf+5W+ls+P2p16\r\n"
+			"a=fingerprint:sha-256 49:66:12:17:0D:1C:91:AE:57:4C:C6:36:DD:D5:97:D2:7D:62:C9:9A:7F:B9:A3:F4:70:03:E7:43:91:73:23:5E\r\n"
+			"a=setup:actpass\r\n"
+			"a=mid:2\r\n"
+			"a=sctp-port:5000\r\n";
+		char *first_sdp = NULL;
+		uint8_t match = 0, p = 0;
+		int x, stable = 1;
+#ifdef BENCHMARK
+		int loops = 1000;
+		switch_time_t start, negotiate_time, generate_time;
+#else
+		int loops = 3;
+#endif
+
+		status = switch_ivr_originate(NULL, &session, &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+		fst_requires(session);
+		fst_check(status == SWITCH_STATUS_SUCCESS);
+
+		channel = switch_core_session_get_channel(session);
+		fst_requires(channel);
+		mparams = switch_core_session_alloc(session, sizeof(switch_core_media_params_t));
+		mparams->inbound_codec_string = switch_core_session_strdup(session, "OPUS,PCMU,VP8");
+		mparams->outbound_codec_string = switch_core_session_strdup(session, "OPUS,PCMU,VP8");
+		mparams->rtpip = switch_core_session_strdup(session, (char *)rx_host);
+
+		status = switch_media_handle_create(&media_handle, session, mparams);
+		fst_requires(status == SWITCH_STATUS_SUCCESS);
+
+		switch_channel_set_variable(channel, "absolute_codec_string", "OPUS,PCMU,VP8");
+		switch_channel_set_variable(channel, SWITCH_LOCAL_MEDIA_IP_VARIABLE, rx_host);
+		switch_channel_set_variable_printf(channel, SWITCH_LOCAL_MEDIA_PORT_VARIABLE, "%d", 1236);
+
+		switch_core_media_prepare_codecs(session, SWITCH_FALSE);
+		match = switch_core_media_negotiate_sdp(session, r_sdp, &p, SDP_OFFER);
+		switch_core_media_gen_local_sdp(session, SDP_ANSWER, rx_host, 1236, NULL, 1);
+		fst_requires(mparams->local_sdp_str);
+		fst_check(strstr(mparams->local_sdp_str, "m=audio 1236 ") != NULL);
+		first_sdp = strdup(mparams->local_sdp_str);
+
+		/* every pass after the first reuses the parsed offer */
+#ifdef BENCHMARK
+		start = switch_time_now();
+#endif
+		for (x = 0; x < loops; x++) {
+			if (switch_core_media_negotiate_sdp(session, r_sdp, &p, SDP_OFFER) != match) {
+				stable = 0;
+			}
+		}
+#ifdef BENCHMARK
+		negotiate_time = switch_time_now() - start;
+#endif
+		fst_check(stable);
+
+#ifdef BENCHMARK
+		start = switch_time_now();
+#endif
+		for (x = 0; x < loops; x++) {
+			switch_core_media_gen_local_sdp(session, SDP_ANSWER, rx_host, 1236, NULL, 1);
+		}
+#ifdef BENCHMARK
+		generate_time = switch_time_now() - start;
+#endif
+
+		/* only the o= version moves between answers */
+		fst_check(strstr(mparams->local_sdp_str, "m=audio 1236 ") != NULL);
+		fst_check_int_equals(strlen(mparams->local_sdp_str), strlen(first_sdp));
+
+#ifdef BENCHMARK
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "WebRTC offer/answer x%d: negotiate %" SWITCH_TIME_T_FMT "us, answer %" SWITCH_TIME_T_FMT "us\n",
+						  loops, negotiate_time, generate_time);
+#endif
+
+		switch_safe_free(first_sdp);
+		switch_channel_hangup(channel, SWITCH_CAUSE_NORMAL_CLEARING);
+		switch_media_handle_destroy(session);
+		switch_core_session_rwunlock(session);
+	}
+	FST_TEST_END()
+
 	FST_TEST_BEGIN(test_client_cert_verify)
 	{
 		dtls_state_t state;
@@ -561,6 +701,99 @@ FST_TEARDOWN_END()
 	}
 	FST_TEST_END()
 
+	FST_TEST_BEGIN(test_dtls_shared_ctx_and_stats)
+	{
+		switch_rtp_dtls_stats_t before, after;
+		dtls_fingerprint_t fp1 = { 0 };
+		dtls_fingerprint_t fp2 = { 0 };
+		dtls_state_t state;
+		uint64_t total = 0;
+		int i;
+
+		switch_core_gen_certs(DTLS_SRTP_FNAME);
+
+		/* The second lookup is served from the fingerprint cache and must be identical. */
+		fp1.type = fp2.type = "sha-256";
+		fst_check(switch_core_cert_gen_fingerprint(DTLS_SRTP_FNAME, &fp1));
+		fst_check(switch_core_cert_gen_fingerprint(DTLS_SRTP_FNAME, &fp2));
+		fst_check_string_equals(fp1.str, fp2.str);
+		fst_check(fp1.len == fp2.len && !memcmp(fp1.data, fp2.data, fp1.len));
+
+		/* Make sure the server context exists, then two more calls must reuse it. */
+		run_client_cert_verify_case("fingerprint", 1, REMOTE_FP_MATCH);
+		switch_rtp_get_dtls_stats(&before);
+
+		for (i = 0; i < 2; i++) {
+			state = run_client_cert_verify_case("fingerprint", 1, REMOTE_FP_MATCH);
+			fst_xcheck(state == DS_READY, "handshake on the shared context reaches DS_READY");
+		}
+
+		switch_rtp_get_dtls_stats(&after);
+
+		fst_check(after.ctx_builds == before.ctx_builds);
+		fst_check(after.handshakes == before.handshakes + 2);
+		fst_check(after.offloaded + after.inline_flights > before.offloaded + before.inline_flights);
+
+		for (i = 0; i < SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS; i++) {
+			total += after.bucket[i];
+		}
+
+		fst_check(total == after.handshakes);
+		fst_check(after.bucket_ms[SWITCH_RTP_DTLS_HISTOGRAM_BUCKETS - 1] == 0);
+	}
+	FST_TEST_END()
+
+	FST_TEST_BEGIN(test_srtp_cost_stats)
+	{
+		switch_core_session_t *session = NULL;
+		switch_status_t status;
+		switch_call_cause_t cause;
+		switch_secure_settings_t ssec = { 0 };
+		switch_rtp_stats_t *stats;
+		switch_frame_t *write_frame;
+		int x;
+
+		switch_core_new_memory_pool(&pool);
+
+		status = switch_ivr_originate(NULL, &session, &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+		fst_requires(session);
+		fst_check(status == SWITCH_STATUS_SUCCESS);
+
+		switch_core_memory_pool_set_data(pool, "__session", session);
+		rtp_session = switch_rtp_new(rx_host, rx_port, tx_host, tx_port, TEST_PT, 8000, 20 * 1000, flags, "soft", &err, pool, 0, 0);
+		fst_requires(rtp_session);
+		fst_requires(switch_rtp_ready(rtp_session));
+
+		ssec.crypto_type = AES_CM_128_HMAC_SHA1_80;
+		for (x = 0; x < SWITCH_RTP_MAX_CRYPTO_LEN; x++) {
+			ssec.local_raw_key[x] = (unsigned char) x;
+		}
+		status = switch_rtp_add_crypto_key(rtp_session, SWITCH_RTP_CRYPTO_SEND, 1, &ssec);
+		fst_requires(status == SWITCH_STATUS_SUCCESS);
+		switch_rtp_clear_flag(rtp_session, SWITCH_RTP_FLAG_PAUSE);
+
+		switch_frame_alloc(&write_frame, SWITCH_RECOMMENDED_BUFFER_SIZE);
+		write_frame->datalen = 160;
+		memset(write_frame->data, 0xff, write_frame->datalen);
+
+		for (x = 0; x < 3; x++) {
+			switch_rtp_write_frame(rtp_session, write_frame);
+		}
+
+		/* Every protected packet is counted and its cost accumulated. */
+		stats = switch_rtp_get_stats(rtp_session, pool);
+		fst_requires(stats);
+		fst_check(stats->outbound.srtp_packet_count == 3);
+		fst_check(stats->outbound.srtp_ns > 0);
+		fst_check(stats->inbound.srtp_packet_count == 0);
+
+		switch_frame_free(&write_frame);
+		switch_rtp_destroy(&rtp_session);
+		switch_core_session_rwunlock(session);
+		switch_core_destroy_memory_pool(&pool);
+	}
+	FST_TEST_END()
+
 }
 FST_SUITE_END()
 }
@@ -0,0 +1,268 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * test_mod_hash.c -- Tests for the mod_hash limit backend
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// #define BENCHMARK 1
+
+#define BENCH_THREADS 64
+#define BENCH_ITERATIONS 2000
+#define BENCH_RESOURCES 16
+
+#ifdef BENCHMARK
+struct bench_worker {
+	switch_core_session_t *session;
+	int id;
+	int iterations;
+	int limit;
+	volatile int *go;
+	int admitted;
+	int errors;
+};
+
+static void *SWITCH_THREAD_FUNC bench_thread(switch_thread_t *thread, void *obj)
+{
+	struct bench_worker *worker = (struct bench_worker *) obj;
+	int i;
+
+	while (!*worker->go) {
+		switch_cond_next();
+	}
+
+	for (i = 0; i < worker->iterations; i++) {
+		char resource[32];
+		uint32_t rcount = 0;
+
+		switch_snprintf(resource, sizeof(resource), "res%d", (worker->id + i) % BENCH_RESOURCES);
+
+		if (switch_limit_incr("hash", worker->session, "bench", resource, worker->limit, 0) == SWITCH_STATUS_SUCCESS) {
+			worker->admitted++;
+			if (switch_limit_usage("hash", "bench", resource, &rcount) < 1) {
+				worker->errors++;
+			}
+			switch_limit_release("hash", worker->session, "bench", resource);
+		}
+	}
+
+	return NULL;
+}
+
+static int run_workers(switch_core_session_t **sessions, struct bench_worker *workers, int iterations, int limit, switch_memory_pool_t *pool)
+{
+	switch_thread_t *threads[BENCH_THREADS] = { 0 };
+	volatile int go = 0;
+	int admitted = 0;
+	int i;
+
+	for (i = 0; i < BENCH_THREADS; i++) {
+		switch_threadattr_t *thd_attr = NULL;
+
+		memset(&workers[i], 0, sizeof(workers[i]));
+		workers[i].session = sessions[i];
+		workers[i].id = i;
+		workers[i].iterations = iterations;
+		workers[i].limit = limit;
+		workers[i].go = &go;
+
+		switch_threadattr_create(&thd_attr, pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&threads[i], thd_attr, bench_thread, &workers[i], pool);
+	}
+
+	go = 1;
+
+	for (i = 0; i < BENCH_THREADS; i++) {
+		switch_status_t st;
+
+		switch_thread_join(&st, threads[i]);
+		admitted += workers[i].admitted;
+	}
+
+	return admitted;
+}
+#endif
+
+FST_CORE_BEGIN("./conf_hash")
+{
+	FST_SUITE_BEGIN(test_mod_hash)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_loopback");
+			fst_requires_module("mod_hash");
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(limit_max_concurrent)
+		{
+			switch_core_session_t *sessions[BENCH_THREADS] = { 0 };
+			switch_call_cause_t cause;
+			uint32_t rcount = 0;
+			int admitted = 0;
+			int i;
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				switch_ivr_originate(NULL, &sessions[i], &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+				fst_requires(sessions[i]);
+			}
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				if (switch_limit_incr("hash", sessions[i], "test", "max", 10, 0) == SWITCH_STATUS_SUCCESS) {
+					admitted++;
+				}
+			}
+
+			fst_check_int_equals(admitted, 10);
+			fst_check_int_equals(switch_limit_usage("hash", "test", "max", &rcount), 10);
+
+			/* a second incr on the same channel doesn't count twice */
+			fst_check(switch_limit_incr("hash", sessions[0], "test", "max", 10, 0) == SWITCH_STATUS_SUCCESS);
+			fst_check_int_equals(switch_limit_usage("hash", "test", "max", &rcount), 10);
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				switch_limit_release("hash", sessions[i], "test", "max");
+			}
+
+			fst_check_int_equals(switch_limit_usage("hash", "test", "max", &rcount), 0);
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				switch_channel_hangup(switch_core_session_get_channel(sessions[i]), SWITCH_CAUSE_NORMAL_CLEARING);
+				switch_core_session_rwunlock(sessions[i]);
+			}
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(limit_rate_sliding_window)
+		{
+			switch_core_session_t *session = NULL;
+			switch_call_cause_t cause;
+			uint32_t rcount = 0;
+			int i;
+
+			switch_ivr_originate(NULL, &session, &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+			fst_requires(session);
+
+			for (i = 0; i < 5; i++) {
+				fst_check(switch_limit_incr("hash", session, "test", "rate", 5, 1) == SWITCH_STATUS_SUCCESS);
+			}
+			fst_check(switch_limit_incr("hash", session, "test", "rate", 5, 1) != SWITCH_STATUS_SUCCESS);
+
+			switch_limit_usage("hash", "test", "rate", &rcount);
+			fst_check_int_equals(rcount, 5);
+
+			/* a fixed window would let a second burst through right after the boundary */
+			switch_sleep(1050000);
+			fst_check(switch_limit_incr("hash", session, "test", "rate", 5, 1) != SWITCH_STATUS_SUCCESS);
+
+			/* the previous window has slid out entirely */
+			switch_sleep(1100000);
+			fst_check(switch_limit_incr("hash", session, "test", "rate", 5, 1) == SWITCH_STATUS_SUCCESS);
+
+			/* reset clears the window */
+			fst_check(switch_limit_interval_reset("hash", "test", "rate") == SWITCH_STATUS_SUCCESS);
+			switch_limit_usage("hash", "test", "rate", &rcount);
+			fst_check_int_equals(rcount, 0);
+
+			switch_limit_release("hash", session, NULL, NULL);
+			switch_channel_hangup(switch_core_session_get_channel(session), SWITCH_CAUSE_NORMAL_CLEARING);
+			switch_core_session_rwunlock(session);
+		}
+		FST_TEST_END()
+
+#ifdef BENCHMARK
+		FST_TEST_BEGIN(limit_contention_benchmark)
+		{
+			switch_core_session_t *sessions[BENCH_THREADS] = { 0 };
+			struct bench_worker *workers = switch_core_alloc(fst_pool, sizeof(*workers) * BENCH_THREADS);
+			switch_call_cause_t cause;
+			switch_time_t start, elapsed;
+			uint32_t rcount = 0;
+			int admitted, errors = 0;
+			int i;
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				switch_ivr_originate(NULL, &sessions[i], &cause, "null/+15553334444", 2, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL);
+				fst_requires(sessions[i]);
+			}
+
+			start = switch_time_now();
+			admitted = run_workers(sessions, workers, BENCH_ITERATIONS, -1, fst_pool);
+			elapsed = switch_time_now() - start;
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				errors += workers[i].errors;
+			}
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "limit hash: %d threads, %d incr/usage/release in %" SWITCH_TIME_T_FMT " ms, %.0f ops/sec\n",
+							  BENCH_THREADS, BENCH_THREADS * BENCH_ITERATIONS, elapsed / 1000,
+							  elapsed ? (double) BENCH_THREADS * BENCH_ITERATIONS * 3 * 1000000 / elapsed : 0.0);
+
+			fst_check_int_equals(admitted, BENCH_THREADS * BENCH_ITERATIONS);
+			fst_check_int_equals(errors, 0);
+
+			for (i = 0; i < BENCH_RESOURCES; i++) {
+				char resource[32];
+
+				switch_snprintf(resource, sizeof(resource), "res%d", i);
+				fst_check_int_equals(switch_limit_usage("hash", "bench", resource, &rcount), 0);
+			}
+
+			/* the same under a maximum, which serializes the check per shard */
+			start = switch_time_now();
+			run_workers(sessions, workers, BENCH_ITERATIONS, BENCH_THREADS, fst_pool);
+			elapsed = switch_time_now() - start;
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "limit hash with max: %d threads, %d incr/usage/release in %" SWITCH_TIME_T_FMT " ms\n",
+							  BENCH_THREADS, BENCH_THREADS * BENCH_ITERATIONS, elapsed / 1000);
+
+			for (i = 0; i < BENCH_RESOURCES; i++) {
+				char resource[32];
+
+				switch_snprintf(resource, sizeof(resource), "res%d", i);
+				fst_check_int_equals(switch_limit_usage("hash", "bench", resource, &rcount), 0);
+			}
+
+			for (i = 0; i < BENCH_THREADS; i++) {
+				switch_channel_hangup(switch_core_session_get_channel(sessions[i]), SWITCH_CAUSE_NORMAL_CLEARING);
+				switch_core_session_rwunlock(sessions[i]);
+			}
+		}
+		FST_TEST_END()
+#endif
+	}
+	FST_SUITE_END()
+}
+FST_CORE_END()
@@ -0,0 +1,162 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2026, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * test_mod_loopback.c -- mod_loopback frame handoff and call setup
+ *
+ */
+
+#include <switch.h>
+#include <test/switch_test.h>
+
+// #define BENCHMARK 1
+
+#define SETUP_CALLS 100
+#ifdef BENCHMARK
+#define BENCH_FRAMES 20000
+#endif
+
+FST_CORE_BEGIN("./conf_loopback")
+{
+	FST_SUITE_BEGIN(test_mod_loopback)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_loopback");
+			fst_requires_module("mod_dptools");
+			fst_requires_module("mod_dialplan_xml");
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_TEST_BEGIN(loopback_call_setup_rate)
+		{
+			switch_core_session_t *sessions[SETUP_CALLS] = { 0 };
+			switch_call_cause_t cause;
+#ifdef BENCHMARK
+			switch_time_t start, elapsed;
+#endif
+			int i, up = 0;
+
+#ifdef BENCHMARK
+			start = switch_time_now();
+#endif
+			for (i = 0; i < SETUP_CALLS; i++) {
+				if (switch_ivr_originate(NULL, &sessions[i], &cause, "loopback/echo/default/XML", 5, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL) == SWITCH_STATUS_SUCCESS) {
+					up++;
+				}
+			}
+#ifdef BENCHMARK
+			elapsed = switch_time_now() - start;
+#endif
+
+			fst_check_int_equals(up, SETUP_CALLS);
+
+#ifdef BENCHMARK
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%d loopback calls set up in %" SWITCH_TIME_T_FMT "ms, %.0f calls/sec\n",
+							  up, elapsed / 1000, elapsed ? up * 1000000.0 / elapsed : 0);
+#endif
+
+			for (i = 0; i < SETUP_CALLS; i++) {
+				if (sessions[i]) {
+					switch_channel_hangup(switch_core_session_get_channel(sessions[i]), SWITCH_CAUSE_NORMAL_CLEARING);
+					switch_core_session_rwunlock(sessions[i]);
+				}
+			}
+
+			switch_sleep(1000000);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(loopback_frame_handoff)
+		{
+			switch_core_session_t *session = NULL;
+			switch_channel_t *channel;
+			switch_call_cause_t cause;
+			switch_frame_t write_frame = { 0 };
+			switch_frame_t *read_frame = NULL;
+			int16_t data[160];
+#ifdef BENCHMARK
+			switch_time_t start, elapsed;
+#endif
+			int i, echoed = 0;
+
+			fst_requires(switch_ivr_originate(NULL, &session, &cause, "loopback/echo/default/XML", 5, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			channel = switch_core_session_get_channel(session);
+
+			for (i = 0; i < 160; i++) {
+				data[i] = (int16_t) (i * 100);
+			}
+
+			write_frame.data = data;
+			write_frame.datalen = sizeof(data);
+			write_frame.buflen = sizeof(data);
+			write_frame.samples = 160;
+			write_frame.rate = 8000;
+			write_frame.channels = 1;
+			write_frame.codec = switch_core_session_get_write_codec(session);
+
+			/* what we write comes back through the echo on the other half */
+			fst_check(switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0) == SWITCH_STATUS_SUCCESS);
+
+			for (i = 0; i < 50 && !echoed; i++) {
+				if (switch_core_session_read_frame(session, &read_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+					break;
+				}
+
+				if (!switch_test_flag(read_frame, SFF_CNG) && read_frame->datalen == sizeof(data) && !memcmp(read_frame->data, data, sizeof(data))) {
+					echoed = 1;
+				}
+			}
+
+			fst_check(echoed);
+
+#ifdef BENCHMARK
+			/* the cost of handing one 20ms frame to the other half, overruns included */
+			start = switch_time_now();
+			for (i = 0; i < BENCH_FRAMES; i++) {
+				switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0);
+			}
+			elapsed = switch_time_now() - start;
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%d loopback frames written in %" SWITCH_TIME_T_FMT "ms, %.0fns per frame\n",
+							  BENCH_FRAMES, elapsed / 1000, elapsed * 1000.0 / BENCH_FRAMES);
+#endif
+
+			fst_check(switch_channel_ready(channel));
+
+			switch_channel_hangup(channel, SWITCH_CAUSE_NORMAL_CLEARING);
+			switch_core_session_rwunlock(session);
+			switch_sleep(1000000);
+		}
+		FST_TEST_END()
+	}
+	FST_SUITE_END()
+}
+FST_CORE_END()
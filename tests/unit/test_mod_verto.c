@@ -104,6 +104,98 @@ static switch_size_t read_status_line(switch_socket_t *sock, char *out, switch_s
 	return got;
 }
 
+static switch_status_t recv_all(switch_socket_t *sock, uint8_t *buf, switch_size_t len)
+{
+	switch_size_t got = 0;
+
+	while (got < len) {
+		switch_size_t n = len - got;
+		if (switch_socket_recv(sock, (char *) buf + got, &n) != SWITCH_STATUS_SUCCESS || n == 0) {
+			return SWITCH_STATUS_FALSE;
+		}
+		got += n;
+	}
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t ws_upgrade(switch_socket_t *sock)
+{
+	const char *req =
+		"GET / HTTP/1.1\r\n"
+		"Host: " VERTO_TEST_HOST "\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n";
+	char resp[1024] = { 0 };
+	switch_size_t got = 0;
+
+	if (send_all(sock, req, strlen(req)) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* byte at a time so no frame data is swallowed with the headers */
+	while (got < sizeof(resp) - 1 && !strstr(resp, "\r\n\r\n")) {
+		if (recv_all(sock, (uint8_t *) resp + got, 1) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+		got++;
+	}
+
+	return strncmp(resp, "HTTP/1.1 101", 12) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+/* client frames must be masked */
+static switch_status_t ws_send_frame(switch_socket_t *sock, int fin, int opcode, const char *data, switch_size_t len)
+{
+	uint8_t frame[256];
+	uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+	switch_size_t i;
+
+	if (len > 125) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	frame[0] = (fin ? 0x80 : 0) | opcode;
+	frame[1] = 0x80 | (uint8_t) len;
+	memcpy(frame + 2, mask, 4);
+	for (i = 0; i < len; i++) {
+		frame[6 + i] = data[i] ^ mask[i & 3];
+	}
+
+	return send_all(sock, (const char *) frame, 6 + len);
+}
+
+static switch_status_t ws_read_frame(switch_socket_t *sock, int *opcode, char *buf, switch_size_t cap)
+{
+	uint8_t hdr[8];
+	switch_size_t len;
+
+	if (recv_all(sock, hdr, 2) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	*opcode = hdr[0] & 0x0f;
+	len = hdr[1] & 0x7f;
+
+	if (len == 126) {
+		if (recv_all(sock, hdr, 2) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+		len = (hdr[0] << 8) | hdr[1];
+	} else if (len == 127) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (len >= cap || recv_all(sock, (uint8_t *) buf, len) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+	buf[len] = '\0';
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 FST_CORE_DB_BEGIN("./conf_verto")
 {
 	FST_SUITE_BEGIN(test_mod_verto)
@@ -272,6 +364,56 @@ FST_CORE_DB_BEGIN("./conf_verto")
 		}
 		FST_TEST_END()
 
+		FST_TEST_BEGIN(websocket_fragmented_request)
+		{
+			switch_memory_pool_t *pool = NULL;
+			switch_socket_t *sock = NULL;
+			const char *part1 = "{\"jsonrpc\":\"2.0\",\"method\":\"verto.",
+				*part2 = "ping\",\"params\":{},\"id\":4242}";
+			char buf[4096];
+			int opcode = -1, got_pong = 0, got_reply = 0, frames;
+
+			do {
+				if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not allocate memory pool");
+					break;
+				}
+				if (verto_connect(&sock, pool) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("could not connect to verto listener");
+					break;
+				}
+				if (ws_upgrade(sock) != SWITCH_STATUS_SUCCESS) {
+					fst_fail("websocket upgrade failed");
+					break;
+				}
+
+				/* a request split over two fragments with a ping in between, the second half arriving late */
+				ws_send_frame(sock, 0, 0x1, part1, strlen(part1));
+				ws_send_frame(sock, 1, 0x9, "hi", 2);
+				switch_yield(100000);
+				ws_send_frame(sock, 1, 0x0, part2, strlen(part2));
+
+				switch_socket_timeout_set(sock, 5000000);
+				for (frames = 0; frames < 4 && !(got_pong && got_reply); frames++) {
+					if (ws_read_frame(sock, &opcode, buf, sizeof(buf)) != SWITCH_STATUS_SUCCESS) {
+						break;
+					}
+					if (opcode == 0xA && !strcmp(buf, "hi")) {
+						got_pong = 1;
+					} else if (opcode == 0x1 && strstr(buf, "4242")) {
+						got_reply = 1;
+					}
+				}
+
+				fst_xcheck(got_pong, "no pong for the ping");
+				fst_xcheck(got_reply, "no reply to the fragmented request");
+			} while (0);
+
+			if (sock) switch_socket_close(sock);
+			if (pool) switch_core_destroy_memory_pool(&pool);
+		}
+		FST_TEST_END()
+
 		FST_TEST_BEGIN(post_overflow_length_returns_413)
 		{
 			switch_memory_pool_t *pool = NULL;
@@ -6,6 +6,191 @@
 #include <switch.h>
 #include <test/switch_test.h>
 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define SHARDED_CALLS 8
+#define WHEEL_PING_USERS 3
+
+/* a bare UDP user agent registering with the internal profile, which runs the registration timer wheel */
+static struct {
+	int sock;
+	struct sockaddr_in profile;
+	const char *ip;
+	int port;
+	int ok;
+	int pinged;
+	char ping_user[WHEEL_PING_USERS][32];
+	switch_time_t ping_time[WHEEL_PING_USERS];
+} ua;
+
+static int ua_open(void)
+{
+	struct sockaddr_in addr = { 0 };
+	socklen_t len = sizeof(addr);
+	struct timeval tv = { 0, 100000 };
+
+	memset(&ua, 0, sizeof(ua));
+	ua.ip = switch_core_get_variable("local_ip_v4");
+
+	if ((ua.sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		return 0;
+	}
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr(ua.ip);
+
+	if (bind(ua.sock, (struct sockaddr *) &addr, sizeof(addr)) || getsockname(ua.sock, (struct sockaddr *) &addr, &len)) {
+		close(ua.sock);
+		return 0;
+	}
+
+	ua.port = ntohs(addr.sin_port);
+	setsockopt(ua.sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	ua.profile.sin_family = AF_INET;
+	ua.profile.sin_addr.s_addr = inet_addr(ua.ip);
+	ua.profile.sin_port = htons(61061);
+
+	return 1;
+}
+
+static void ua_close(void)
+{
+	close(ua.sock);
+}
+
+static void ua_register(const char *user, const char *call_id, int cseq, int expires)
+{
+	char *msg = switch_mprintf("REGISTER sip:%s:61061 SIP/2.0\r\n"
+							   "Via: SIP/2.0/UDP %s:%d;branch=z9hG4bK-%s-%d\r\n"
+							   "Max-Forwards: 70\r\n"
+							   "From: <sip:%s@%s>;tag=%s\r\n"
+							   "To: <sip:%s@%s>\r\n"
+							   "Call-ID: %s\r\n"
+							   "CSeq: %d REGISTER\r\n"
+							   "Contact: <sip:%s@%s:%d>\r\n"
+							   "Expires: %d\r\n"
+							   "Content-Length: 0\r\n\r\n",
+							   ua.ip, ua.ip, ua.port, call_id, cseq, user, ua.ip, user, user, ua.ip, call_id, cseq, user, ua.ip, ua.port, expires);
+
+	sendto(ua.sock, msg, strlen(msg), 0, (struct sockaddr *) &ua.profile, sizeof(ua.profile));
+	switch_safe_free(msg);
+}
+
+/* answer an OPTIONS ping with the headers it came with */
+static void ua_answer(const char *request, struct sockaddr_in *from)
+{
+	switch_stream_handle_t stream = { 0 };
+	char *dup = strdup(request), *line, *next;
+
+	SWITCH_STANDARD_STREAM(stream);
+	stream.write_function(&stream, "SIP/2.0 200 OK\r\n");
+
+	for (line = dup; line && *line; line = next) {
+		if ((next = strstr(line, "\r\n"))) {
+			*next = '\0';
+			next += 2;
+		}
+
+		if (!strncasecmp(line, "To:", 3)) {
+			stream.write_function(&stream, "%s;tag=ua\r\n", line);
+		} else if (!strncasecmp(line, "Via:", 4) || !strncasecmp(line, "From:", 5) ||
+				   !strncasecmp(line, "Call-ID:", 8) || !strncasecmp(line, "CSeq:", 5)) {
+			stream.write_function(&stream, "%s\r\n", line);
+		}
+	}
+
+	stream.write_function(&stream, "Content-Length: 0\r\n\r\n");
+	sendto(ua.sock, stream.data, strlen(stream.data), 0, (struct sockaddr *) from, sizeof(*from));
+
+	switch_safe_free(stream.data);
+	switch_safe_free(dup);
+}
+
+/* read for ms, counting the 200s to our REGISTERs and the first OPTIONS each user gets */
+static void ua_poll(int ms)
+{
+	switch_time_t end = switch_micro_time_now() + ms * 1000;
+	char buf[4096];
+
+	while (switch_micro_time_now() < end) {
+		struct sockaddr_in from = { 0 };
+		socklen_t len = sizeof(from);
+		ssize_t bytes = recvfrom(ua.sock, buf, sizeof(buf) - 1, 0, (struct sockaddr *) &from, &len);
+		char user[32] = "";
+		int i;
+
+		if (bytes <= 0) {
+			continue;
+		}
+
+		buf[bytes] = '\0';
+
+		if (!strncmp(buf, "SIP/2.0 200", 11) && strstr(buf, " REGISTER\r\n")) {
+			ua.ok++;
+			continue;
+		}
+
+		if (strncmp(buf, "OPTIONS sip:", 12)) {
+			continue;
+		}
+
+		ua_answer(buf, &from);
+		sscanf(buf + 12, "%31[^@]", user);
+
+		for (i = 0; i < ua.pinged; i++) {
+			if (!strcmp(ua.ping_user[i], user)) {
+				break;
+			}
+		}
+
+		if (i == ua.pinged && i < WHEEL_PING_USERS && !strncmp(user, "wheelping", 9)) {
+			switch_set_string(ua.ping_user[i], user);
+			ua.ping_time[i] = switch_micro_time_now();
+			ua.pinged++;
+		}
+	}
+}
+
+static int ua_wait_ok(int want)
+{
+	int sanity = 30;
+
+	while (ua.ok < want && --sanity) {
+		ua_poll(100);
+	}
+
+	return ua.ok >= want;
+}
+
+/* the rows the internal profile holds for a user, as sofia status shows them */
+static int reg_count(const char *user, char *out, switch_size_t outlen)
+{
+	switch_stream_handle_t stream = { 0 };
+	char *cmd = switch_mprintf("status profile internal user %s@", user);
+	const char *total;
+	int count = -1;
+
+	SWITCH_STANDARD_STREAM(stream);
+	switch_api_execute("sofia", cmd, NULL, &stream);
+
+	if (stream.data && (total = strstr(stream.data, "Total items returned: "))) {
+		count = atoi(total + 22);
+	}
+
+	if (out) {
+		switch_copy_string(out, stream.data ? stream.data : "", outlen);
+	}
+
+	switch_safe_free(stream.data);
+	switch_safe_free(cmd);
+
+	return count;
+}
+
 FST_CORE_DB_BEGIN("conf_sofia")
 {
 	FST_SUITE_BEGIN(switch_sofia)
@@ -13,6 +198,8 @@ FST_CORE_DB_BEGIN("conf_sofia")
 		FST_SETUP_BEGIN()
 		{
 			fst_requires_module("mod_sofia");
+			fst_requires_module("mod_dptools");
+			fst_requires_module("mod_dialplan_xml");
 		}
 		FST_SETUP_END()
 
@@ -25,6 +212,133 @@ FST_CORE_DB_BEGIN("conf_sofia")
 		{
 		}
 		FST_TEST_END()
+
+		/* conf_sofia runs the stack with message-thread-shards, every call
+		   here is set up and torn down through the per-dialog queues */
+		FST_TEST_BEGIN(sofia_sharded_calls)
+		{
+			switch_core_session_t *sessions[SHARDED_CALLS] = { 0 };
+			switch_call_cause_t cause;
+			char *dest = switch_core_sprintf(fst_pool, "sofia/external/sharded@%s:61061", switch_core_get_variable("local_ip_v4"));
+			int i, up = 0, sanity = 100;
+
+			for (i = 0; i < SHARDED_CALLS; i++) {
+				if (switch_ivr_originate(NULL, &sessions[i], &cause, dest, 5, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL, NULL) == SWITCH_STATUS_SUCCESS) {
+					up++;
+				}
+			}
+
+			fst_check_int_equals(up, SHARDED_CALLS);
+
+			/* both legs live in this process */
+			fst_check_int_equals(switch_core_session_count(), up * 2);
+
+			for (i = 0; i < SHARDED_CALLS; i++) {
+				if (sessions[i]) {
+					switch_channel_hangup(switch_core_session_get_channel(sessions[i]), SWITCH_CAUSE_NORMAL_CLEARING);
+					switch_core_session_rwunlock(sessions[i]);
+				}
+			}
+
+			/* the BYEs have to make it through the shards to the parked legs */
+			while (switch_core_session_count() && --sanity) {
+				switch_sleep(100000);
+			}
+
+			fst_check_int_equals(switch_core_session_count(), 0);
+		}
+		FST_TEST_END()
+
+		/* without the wheel nothing would expire before the 30 second registration sweep */
+		FST_TEST_BEGIN(sofia_reg_wheel_expire)
+		{
+			int sanity = 60;
+
+			fst_requires(ua_open());
+
+			ua_register("wheelexp", "wheelexp-1", 1, 2);
+			fst_check(ua_wait_ok(1));
+			fst_check_int_equals(reg_count("wheelexp", NULL, 0), 1);
+
+			while (reg_count("wheelexp", NULL, 0) > 0 && --sanity) {
+				ua_poll(100);
+			}
+
+			fst_check_int_equals(reg_count("wheelexp", NULL, 0), 0);
+			fst_check(sanity > 0);
+
+			ua_close();
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(sofia_reg_wheel_refresh)
+		{
+			char status[8192] = "";
+
+			fst_requires(ua_open());
+
+			ua_register("wheelmove", "wheelmove-1", 1, 2);
+			fst_check(ua_wait_ok(1));
+
+			/* the refresh moves the timer past the first expiry */
+			ua_register("wheelmove", "wheelmove-1", 2, 30);
+			fst_check(ua_wait_ok(2));
+			ua_poll(4000);
+			fst_check_int_equals(reg_count("wheelmove", NULL, 0), 1);
+
+			/* the same contact under a new Call-ID updates the row, the old timer goes with it */
+			ua_register("wheelmove", "wheelmove-2", 1, 30);
+			fst_check(ua_wait_ok(3));
+			fst_check_int_equals(reg_count("wheelmove", status, sizeof(status)), 1);
+			fst_check(strstr(status, "wheelmove-2") != NULL);
+			fst_check(strstr(status, "wheelmove-1") == NULL);
+
+			ua_register("wheelmove", "wheelmove-2", 2, 0);
+			fst_check(ua_wait_ok(4));
+			fst_check_int_equals(reg_count("wheelmove", NULL, 0), 0);
+
+			ua_close();
+		}
+		FST_TEST_END()
+
+		/* ping-rate-limit is 1, registrations due together are pinged a second apart */
+		FST_TEST_BEGIN(sofia_reg_wheel_ping_rate)
+		{
+			int i, sanity = 100;
+
+			fst_requires(ua_open());
+
+			for (i = 0; i < WHEEL_PING_USERS; i++) {
+				char user[32], call_id[32];
+
+				switch_snprintf(user, sizeof(user), "wheelping%d", i);
+				switch_snprintf(call_id, sizeof(call_id), "wheelping-%d", i);
+				ua_register(user, call_id, 1, 60);
+			}
+
+			while (ua.pinged < WHEEL_PING_USERS && --sanity) {
+				ua_poll(100);
+			}
+
+			fst_check_int_equals(ua.ok, WHEEL_PING_USERS);
+			fst_check_int_equals(ua.pinged, WHEEL_PING_USERS);
+
+			for (i = 1; i < ua.pinged; i++) {
+				fst_check(ua.ping_time[i] - ua.ping_time[i - 1] >= 500000);
+			}
+
+			for (i = 0; i < WHEEL_PING_USERS; i++) {
+				char user[32], call_id[32];
+
+				switch_snprintf(user, sizeof(user), "wheelping%d", i);
+				switch_snprintf(call_id, sizeof(call_id), "wheelping-%d", i);
+				ua_register(user, call_id, 2, 0);
+			}
+
+			ua_wait_ok(WHEEL_PING_USERS * 2);
+			ua_close();
+		}
+		FST_TEST_END()
 	}
 	FST_SUITE_END()
 }